@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+Native hook callback throughput: serialized vs parallel Lua dispatch
+
+Hooks libc clock_gettime twice in a row, first with callbacks on the
+main script state (one lock for every thread), then with
+`parallel = true` (a Lua state per hooked thread). Under each hook the
+load comes from Thread.stress(), which calls clock_gettime back to back
+from 1, 2, 4 and 8 threads inside the target. For each thread count it
+prints callbacks per second, the speedup over one thread, and how often
+a thread had to wait for the script lock.
+
+Serialized dispatch should stay flat (or drop) as threads are added;
+parallel dispatch should scale until it runs out of cores. The target's
+own threads call clock_gettime too, so counts from an idle target are
+the cleanest.
+
+Prerequisites: same as basic.py (server running, port forwarded).
+
+Usage:
+    bench_hooks.py <package_name|pid> [seconds] [thread_counts]
+
+    thread_counts is a comma separated list (default 1,2,4,8).
+"""
+
+import re
+import sys
+import os
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+from renef import Renef
+
+MODULE = "libc.so"
+SYMBOL = "clock_gettime"
+
+
+def lock_waits(session):
+    m = re.search(r"native\s+sync=\d+ parallel=\d+ lock_waits=(\d+)", session.hooks())
+    return int(m.group(1)) if m else 0
+
+
+def hook_id_at(session, addr):
+    for m in re.finditer(r"\[(\d+)\] target=(0x[0-9a-fA-F]+)", session.hooks()):
+        if int(m.group(2), 16) == addr:
+            return int(m.group(1))
+    return None
+
+
+def run(session, offset, addr, parallel, seconds, counts):
+    name = "parallel" if parallel else "serial"
+    lua = (
+        f"hook('{MODULE}', {offset:#x}, {{ parallel = {'true' if parallel else 'false'}, "
+        "  onEnter = function(args) end })"
+    )
+    ok, _, err = session.eval(lua)
+    if not ok:
+        print(f"  {name}: hook failed: {err}")
+        return None
+
+    rates = {}
+    for threads in counts:
+        before = lock_waits(session)
+        ok, out, err = session.eval(f"print(Thread.stress({threads}, {int(seconds * 1000)}))")
+        waits = lock_waits(session) - before
+        if not ok or not out:
+            print(f"  {name:8s} threads={threads:<2d} stress failed: {err}")
+            continue
+        rate = int(out.split()[0]) / seconds
+        rates[threads] = rate
+        base = rates.get(counts[0])
+        scale = f"{rate / base:5.2f}x" if base else "    -"
+        print(f"  {name:8s} threads={threads:<2d} {rate:12.0f} calls/s  {scale}"
+              f"  lock_waits={waits}")
+
+    hook_id = hook_id_at(session, addr)
+    if hook_id is not None:
+        session.unhook(hook_id)
+    return rates
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(f"Usage: {sys.argv[0]} <package_name|pid> [seconds] [thread_counts]")
+        return 1
+
+    target = sys.argv[1]
+    seconds = float(sys.argv[2]) if len(sys.argv) > 2 else 2.0
+    counts = [int(n) for n in sys.argv[3].split(",")] if len(sys.argv) > 3 else [1, 2, 4, 8]
+
+    r = Renef()
+    session = r.attach(int(target)) if target.isdigit() else r.spawn(target)
+    if not session:
+        print("[-] Failed to connect")
+        return 1
+
+    with session:
+        base = session.Module.find(MODULE)
+        offset = next((e["offset"] for e in session.Module.exports(MODULE) if e["name"] == SYMBOL), None)
+        if not base or offset is None:
+            print(f"[-] {MODULE}!{SYMBOL} not found")
+            return 1
+
+        print(f"[*] Hooking {MODULE}!{SYMBOL} ({base + offset:#x}), {seconds:g}s per run")
+        serial = run(session, offset, base + offset, False, seconds, counts)
+        parallel = run(session, offset, base + offset, True, seconds, counts)
+
+        if serial and parallel:
+            for threads in counts:
+                if serial.get(threads) and parallel.get(threads):
+                    print(f"[*] {threads} threads: parallel is "
+                          f"{parallel[threads] / serial[threads]:.1f}x serialized dispatch")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
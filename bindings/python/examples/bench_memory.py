@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""
+Memory read throughput: binary memory commands vs the Lua eval path
+
+Reads the start of a loaded module repeatedly with Memory.read_view()
+(native "mr" command, raw bytes in DATA frames) and with the Lua
+snippet the C API used before (Memory.read + hex encoding through exec),
+and prints MB/s for each.
+
+Prerequisites: same as basic.py (server running, port forwarded).
+
+Usage:
+    bench_memory.py <package_name|pid> [module] [size_kb] [rounds]
+"""
+
+import sys
+import os
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+from renef import Renef
+
+
+def lua_read(session, addr, size):
+    lua = (
+        f"local data = Memory.read({addr:#x}, {size}); "
+        "if data then "
+        "  local hex = {}; "
+        "  for i = 1, #data do hex[i] = string.format('%02x', string.byte(data, i)) end; "
+        "  print(table.concat(hex)) "
+        "else print('') end"
+    )
+    ok, out, _ = session.eval(lua)
+    if not ok or not out:
+        return None
+    return bytes.fromhex(out.split("\n", 1)[0].strip())
+
+
+def bench(name, fn, size, rounds):
+    start = time.perf_counter()
+    total = 0
+    for _ in range(rounds):
+        data = fn()
+        if data is None:
+            print(f"  {name:8s} read failed")
+            return None
+        total += len(data)
+    elapsed = time.perf_counter() - start
+    mbps = total / elapsed / (1024 * 1024)
+    print(f"  {name:8s} {total / 1024:10.0f} KB in {elapsed:7.3f}s  {mbps:8.2f} MB/s")
+    return mbps
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(f"Usage: {sys.argv[0]} <package_name|pid> [module] [size_kb] [rounds]")
+        return 1
+
+    target = sys.argv[1]
+    module = sys.argv[2] if len(sys.argv) > 2 else "libc.so"
+    size = int(sys.argv[3]) * 1024 if len(sys.argv) > 3 else 1024 * 1024
+    rounds = int(sys.argv[4]) if len(sys.argv) > 4 else 5
+
+    r = Renef()
+    session = r.attach(int(target)) if target.isdigit() else r.spawn(target)
+    if not session:
+        print("[-] Failed to connect")
+        return 1
+
+    with session:
+        base = session.Module.find(module)
+        if not base:
+            print(f"[-] {module} not loaded")
+            return 1
+
+        print(f"[*] Reading {size // 1024} KB at {module}+0 ({base:#x}), {rounds} round(s)")
+        native = bench("native", lambda: session.Memory.read_view(base, size), size, rounds)
+        lua = bench("lua", lambda: lua_read(session, base, size), size, rounds)
+
+        if native and lua:
+            print(f"[*] native is {native / lua:.1f}x the Lua path")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+"""
+Deferred hooks across a dlopen
+
+Hooks an exported function of a system library the target has not
+loaded yet, and the library's first constructor (its first .init_array
+entry), so both hooks are left pending, then has the target load the
+library through System.load(). The load runs the agent's library load
+callback inside the linker's lock, before the library's constructors;
+it must return (a lock-order bug there hangs the target's dlopen and
+this script with it), both hooks must be installed by the time
+System.load() returns, and the constructor hook must have fired, which
+it only does if the callback patched it before the linker called it.
+It prints how long the load took.
+
+The offsets are read from a pulled copy of the library (exports can
+only be listed for loaded modules), so adb has to be on PATH. The
+library must not be loaded in the target yet and must have a
+constructor; pick another one if not.
+
+Prerequisites: same as basic.py (server running, port forwarded).
+
+Usage:
+    test_deferred_hooks.py <package_name|pid> [library] [symbol] [timeout]
+"""
+
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+from renef import Renef
+
+SHT_RELA = 4
+SHT_DYNSYM = 11
+SHT_INIT_ARRAY = 14
+R_AARCH64_RELATIVE = 1027
+
+
+def sections(elf):
+    shoff, = struct.unpack_from("<Q", elf, 0x28)
+    shentsize, shnum = struct.unpack_from("<HH", elf, 0x3A)
+    return [shoff + i * shentsize for i in range(shnum)]
+
+
+def dynsym_offset(elf, symbol):
+    headers = sections(elf)
+    for sh in headers:
+        sh_type, = struct.unpack_from("<I", elf, sh + 4)
+        if sh_type != SHT_DYNSYM:
+            continue
+        offset, size, link, _, _, entsize = struct.unpack_from("<QQIIQQ", elf, sh + 0x18)
+        str_sh = headers[link]
+        str_off, = struct.unpack_from("<Q", elf, str_sh + 0x18)
+        for sym in range(offset, offset + size, entsize):
+            name_off, _, _, shndx, value = struct.unpack_from("<IBBHQ", elf, sym)
+            end = elf.index(b"\0", str_off + name_off)
+            if shndx and value and elf[str_off + name_off:end].decode() == symbol:
+                return value
+    return None
+
+
+def constructor_offset(elf):
+    """The first .init_array entry: in place (RELR), or a RELATIVE addend."""
+    init = None
+    for sh in sections(elf):
+        sh_type, = struct.unpack_from("<I", elf, sh + 4)
+        addr, offset, size = struct.unpack_from("<QQQ", elf, sh + 0x10)
+        if sh_type == SHT_INIT_ARRAY and size >= 8:
+            init = addr
+            value, = struct.unpack_from("<Q", elf, offset)
+            if value not in (0, 2**64 - 1):
+                return value
+    if init is None:
+        return None
+    for sh in sections(elf):
+        sh_type, = struct.unpack_from("<I", elf, sh + 4)
+        if sh_type != SHT_RELA:
+            continue
+        offset, size = struct.unpack_from("<QQ", elf, sh + 0x18)
+        for rel in range(offset, offset + size, 24):
+            r_offset, r_info, r_addend = struct.unpack_from("<QQq", elf, rel)
+            if r_offset == init and r_info & 0xFFFFFFFF == R_AARCH64_RELATIVE:
+                return r_addend
+    return None
+
+
+def pull_offsets(path, symbol):
+    with tempfile.TemporaryDirectory() as tmp:
+        local = os.path.join(tmp, os.path.basename(path))
+        if subprocess.run(["adb", "pull", path, local], capture_output=True).returncode != 0:
+            return None, None
+        with open(local, "rb") as f:
+            elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[4] != 2:
+        return None, None
+    return dynsym_offset(elf, symbol), constructor_offset(elf)
+
+
+def hook_at(session, addr):
+    for m in re.finditer(r"\[(\d+)\] target=(0x[0-9a-fA-F]+)", session.hooks()):
+        if int(m.group(2), 16) == addr:
+            return int(m.group(1))
+    return None
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(f"Usage: {sys.argv[0]} <package_name|pid> [library] [symbol] [timeout]")
+        return 1
+
+    target = sys.argv[1]
+    library = sys.argv[2] if len(sys.argv) > 2 else "libjnigraphics.so"
+    symbol = sys.argv[3] if len(sys.argv) > 3 else "AndroidBitmap_getInfo"
+    timeout = float(sys.argv[4]) if len(sys.argv) > 4 else 10.0
+    path = library if library.startswith("/") else f"/system/lib64/{library}"
+    name = os.path.basename(path)
+
+    offset, ctor = pull_offsets(path, symbol)
+    if offset is None:
+        print(f"[-] {symbol} not found in {path}")
+        return 1
+    if ctor is None:
+        print(f"[-] no constructor found in {path}, pick another library")
+        return 1
+
+    r = Renef()
+    session = r.attach(int(target)) if target.isdigit() else r.spawn(target)
+    if not session:
+        print("[-] Failed to connect")
+        return 1
+
+    with session:
+        if session.Module.find(name):
+            print(f"[-] {name} is already loaded in the target, pick another library")
+            return 1
+
+        ok, _, err = session.eval(
+            "ctor_calls = 0\n"
+            f"hook('{name}', {ctor:#x}, {{ onEnter = function(args) ctor_calls = ctor_calls + 1 end }})\n"
+            f"hook('{name}', {offset:#x}, {{ onEnter = function(args) end }})")
+        if not ok:
+            print(f"[-] hook failed: {err}")
+            return 1
+        print(f"[*] {name}!{symbol} (+{offset:#x}) and its constructor (+{ctor:#x}) hooked while not loaded")
+
+        # System.load() runs the dlopen, and with it the load callback,
+        # on the agent thread that evaluates it
+        result = {}
+        def load():
+            result["eval"] = session.eval(
+                f'Java.use("java/lang/System"):call("load", "(Ljava/lang/String;)V", "{path}")')
+
+        start = time.perf_counter()
+        loader = threading.Thread(target=load, daemon=True)
+        loader.start()
+        loader.join(timeout)
+        if loader.is_alive():
+            print(f"[-] System.load({path}) did not return within {timeout:g}s (deadlock?)")
+            # The session is stuck in the eval; do not wait for it on exit
+            os._exit(1)
+        loaded = time.perf_counter()
+
+        ok, _, err = result["eval"]
+        if not ok:
+            print(f"[-] System.load failed: {err}")
+            return 1
+        print(f"[*] System.load returned in {(loaded - start) * 1000:.1f} ms")
+
+        # Installed by the load itself, not some time after it
+        base = session.Module.find(name)
+        hook_ids = [hook_at(session, base + off) if base else None for off in (ctor, offset)]
+        if None in hook_ids:
+            print(f"[-] pending hooks not installed when System.load returned: {hook_ids}")
+            return 1
+        print(f"[*] hooks {hook_ids[0]} and {hook_ids[1]} installed by the load")
+
+        ok, out, _ = session.eval("print(ctor_calls)")
+        calls = int(out.strip()) if ok and out and out.strip().isdigit() else 0
+        for hook_id in hook_ids:
+            session.unhook(hook_id)
+        if calls == 0:
+            print("[-] constructor hook did not fire: installed after the constructors ran")
+            return 1
+        print(f"[*] constructor hook fired {calls} time(s)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
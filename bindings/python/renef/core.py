@@ -34,6 +34,13 @@ class RenefResult(Structure):
     ]
 
 
+class RenefMemRange(Structure):
+    _fields_ = [
+        ("addr", c_uint64),
+        ("size", c_size_t)
+    ]
+
+
 RenefMessageCallback = CFUNCTYPE(None, c_char_p, c_size_t, c_void_p)
 
 
@@ -45,19 +52,63 @@ class Memory:
 
     def read(self, addr: int, size: int) -> Optional[bytes]:
         """Read raw bytes from memory"""
-        buf = (c_uint8 * size)()
-        n = self._session._lib.renef_read_memory(
-            self._session._handle, addr, size, buf
-        )
+        view = self.read_view(addr, size)
+        return bytes(view) if view is not None else None
+
+    def read_view(self, addr: int, size: int) -> Optional[memoryview]:
+        """Read raw bytes without copying them again: a memoryview over
+        the buffer librenef filled (shorter than size if the range ran
+        into an unreadable page)"""
+        buf = bytearray(size)
+        n = self.read_into(addr, buf)
         if n <= 0:
             return None
-        return bytes(buf[:n])
+        return memoryview(buf)[:n]
+
+    def read_into(self, addr: int, buf) -> int:
+        """Read len(buf) bytes into a writable buffer (bytearray,
+        memoryview, array, mmap). Returns the number of bytes read, -1 on error"""
+        view = memoryview(buf).cast("B")
+        if view.nbytes == 0:
+            return 0
+        target = (c_uint8 * view.nbytes).from_buffer(view)
+        return self._session._lib.renef_read_memory(
+            self._session._handle, addr, view.nbytes, target
+        )
 
-    def write(self, addr: int, data: bytes) -> int:
-        """Write raw bytes to memory"""
-        buf = (c_uint8 * len(data))(*data)
+    def read_many(self, ranges: List[Tuple[int, int]]) -> List[Optional[memoryview]]:
+        """Read several (addr, size) ranges in one round trip. Each entry
+        is a memoryview of what was readable, or None if nothing was"""
+        if not ranges:
+            return []
+        total = sum(size for _, size in ranges)
+        buf = bytearray(total)
+        out = (c_uint8 * total).from_buffer(buf) if total else (c_uint8 * 1)()
+        c_ranges = (RenefMemRange * len(ranges))(*[RenefMemRange(a, s) for a, s in ranges])
+        lengths = (c_size_t * len(ranges))()
+        if self._session._lib.renef_read_memory_v(
+            self._session._handle, c_ranges, len(ranges), out, lengths
+        ) != 0:
+            return [None] * len(ranges)
+
+        view = memoryview(buf)
+        result = []
+        offset = 0
+        for i, (_, size) in enumerate(ranges):
+            n = lengths[i]
+            result.append(view[offset:offset + n] if n else None)
+            offset += size
+        return result
+
+    def write(self, addr: int, data) -> int:
+        """Write raw bytes to memory (bytes, bytearray or memoryview)"""
+        view = memoryview(data).cast("B")
+        if view.readonly:
+            buf = (c_uint8 * view.nbytes).from_buffer_copy(view)
+        else:
+            buf = (c_uint8 * view.nbytes).from_buffer(view)
         return self._session._lib.renef_write_memory(
-            self._session._handle, addr, buf, len(data)
+            self._session._handle, addr, buf, view.nbytes
         )
 
     def read_u8(self, addr: int) -> int:
@@ -677,6 +728,10 @@ class Renef:
         self._lib.renef_write_memory.argtypes = [c_void_p, c_uint64, POINTER(c_uint8), c_size_t]
         self._lib.renef_write_memory.restype = c_ssize_t
 
+        self._lib.renef_read_memory_v.argtypes = [c_void_p, POINTER(RenefMemRange), c_size_t,
+                                                  POINTER(c_uint8), POINTER(c_size_t)]
+        self._lib.renef_read_memory_v.restype = c_int
+
         self._lib.renef_read_u8.argtypes = [c_void_p, c_uint64]
         self._lib.renef_read_u8.restype = c_uint8
 
@@ -259,6 +259,76 @@ class TestKCovAPI(unittest.TestCase):
         self.assertTrue(ok)
 
 
+# ============================================================
+# Memory API Tests
+# ============================================================
+class TestMemoryAPI(unittest.TestCase):
+
+    def setUp(self):
+        self.mock = MockSession()
+        self.memory = Memory(self.mock)
+        self.target = bytes(range(64))
+
+        def read_memory(_handle, addr, size, out):
+            data = self.target[addr:addr + size]
+            ctypes.memmove(out, data, len(data))
+            return len(data) if data else -1
+
+        self.mock._lib.renef_read_memory.side_effect = read_memory
+
+    def test_read(self):
+        self.assertEqual(self.memory.read(4, 4), b"\x04\x05\x06\x07")
+
+    def test_read_short(self):
+        self.assertEqual(self.memory.read(60, 16), b"\x3c\x3d\x3e\x3f")
+
+    def test_read_failure(self):
+        self.assertIsNone(self.memory.read(128, 4))
+
+    def test_read_view_is_memoryview(self):
+        view = self.memory.read_view(8, 8)
+        self.assertIsInstance(view, memoryview)
+        self.assertEqual(view.tobytes(), self.target[8:16])
+
+    def test_read_into_fills_caller_buffer(self):
+        buf = bytearray(16)
+        self.assertEqual(self.memory.read_into(16, memoryview(buf)[4:12]), 8)
+        self.assertEqual(bytes(buf[4:12]), self.target[16:24])
+        self.assertEqual(bytes(buf[:4]), b"\x00" * 4)
+
+    def test_read_many(self):
+        def read_memory_v(_handle, ranges, count, out, lengths):
+            offset = 0
+            for i in range(count):
+                data = self.target[ranges[i].addr:ranges[i].addr + ranges[i].size]
+                ctypes.memmove(ctypes.addressof(out) + offset, data, len(data))
+                lengths[i] = len(data)
+                offset += ranges[i].size
+            return 0
+
+        self.mock._lib.renef_read_memory_v.side_effect = read_memory_v
+        views = self.memory.read_many([(0, 2), (100, 4), (62, 4)])
+        self.assertEqual(views[0].tobytes(), b"\x00\x01")
+        self.assertIsNone(views[1])
+        self.assertEqual(views[2].tobytes(), b"\x3e\x3f")
+
+    def test_read_many_failure(self):
+        self.mock._lib.renef_read_memory_v.return_value = -1
+        self.assertEqual(self.memory.read_many([(0, 2), (4, 2)]), [None, None])
+
+    def test_write_passes_bytes(self):
+        written = []
+
+        def write_memory(_handle, addr, buf, size):
+            written.append((addr, bytes(buf)[:size]))
+            return size
+
+        self.mock._lib.renef_write_memory.side_effect = write_memory
+        self.assertEqual(self.memory.write(0x1000, b"ab\n"), 3)
+        self.assertEqual(self.memory.write(0x2000, bytearray(b"\x00\xff")), 2)
+        self.assertEqual(written, [(0x1000, b"ab\n"), (0x2000, b"\x00\xff")])
+
+
 # ============================================================
 # RenefSession Property Tests
 # ============================================================
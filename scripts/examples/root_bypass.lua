@@ -562,16 +562,24 @@ local function scan_for_signatures()
         "/system/xbin/su"
     }
 
-    for _, sig in ipairs(signatures) do
-        log_info("Scanning for: " .. sig)
-        local results = Memory.scan(sig)
+    log_info("Scanning for " .. #signatures .. " signatures")
+    local results = Memory.scanMany(signatures)
+
+    -- Group hits by signature, keeping address order within each
+    local by_sig = {}
+    for _, r in ipairs(results or {}) do
+        by_sig[r.pattern] = by_sig[r.pattern] or {}
+        table.insert(by_sig[r.pattern], r)
+    end
 
-        if results and #results > 0 then
-            print(YELLOW .. "[!] Found " .. #results .. " occurrence(s) of: " .. sig .. RESET)
+    for i, sig in ipairs(signatures) do
+        local hits = by_sig[i]
+        if hits and #hits > 0 then
+            print(YELLOW .. "[!] Found " .. #hits .. " occurrence(s) of: " .. sig .. RESET)
 
             if config.verbose_logging then
-                for i, r in ipairs(results) do
-                    if i <= 3 then -- Limit output
+                for j, r in ipairs(hits) do
+                    if j <= 3 then -- Limit output
                         print("    Library: " .. r.library)
                         print("    Offset:  " .. string.format("0x%x", r.offset))
                     end
@@ -945,25 +945,36 @@ if flutter_base then
             "FF 43 01 D1 FE 67 01 A9 ?? ?? 06 94 ?? ?? 06 94 68 1A 40 F9 15 15 41 F9 B5 00 00 B4 B6 4A 40 F9",
         }
 
-        for _, pattern in ipairs(flutter_patterns) do
-            local ok, results = pcall(function()
-                return Memory.scan(pattern, "libflutter.so")
-            end)
-            if ok and results and #results > 0 then
-                local match = results[1]
-                local offset = match.offset
-                local ok2 = pcall(function()
-                    hook("libflutter.so", offset, {
-                        onLeave = function(retval)
-                            return 1
-                        end
-                    })
-                end)
-                if ok2 then
-                    bypass_count = bypass_count + 1
-                    print(GREEN .. string.format("  [+] Flutter SSL verify found via pattern at offset 0x%x", offset) .. RESET)
-                    hooked = true
-                    break
+        -- One pass over libflutter.so for all patterns; try the first hit of
+        -- each pattern in the order they are listed above
+        local ok, results = pcall(function()
+            return Memory.scanMany(flutter_patterns, "libflutter.so")
+        end)
+        if ok and results then
+            local first = {}
+            for _, match in ipairs(results) do
+                if not first[match.pattern] then
+                    first[match.pattern] = match
+                end
+            end
+
+            for i = 1, #flutter_patterns do
+                local match = first[i]
+                if match then
+                    local offset = match.offset
+                    local ok2 = pcall(function()
+                        hook("libflutter.so", offset, {
+                            onLeave = function(retval)
+                                return 1
+                            end
+                        })
+                    end)
+                    if ok2 then
+                        bypass_count = bypass_count + 1
+                        print(GREEN .. string.format("  [+] Flutter SSL verify found via pattern at offset 0x%x", offset) .. RESET)
+                        hooked = true
+                        break
+                    end
                 end
             end
         end
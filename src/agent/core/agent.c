@@ -3,7 +3,7 @@
  *
  * This file contains only:
  * - Constructor (init)
- * - Command handler thread
+ * - Command handler thread (epoll over every client connection)
  * - Command router
  *
  * All functionality is split into modules:
@@ -26,7 +26,9 @@
 #include <elf.h>
 #include <sys/mman.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
 
 #include <agent/globals.h>
 #include <agent/cmd_registry.h>
@@ -34,7 +36,11 @@
 #include <agent/hook_java.h>
 #include <agent/strace.h>
 #include <agent/proc.h>
+#include <agent/maps.h>
+#include <agent/symindex.h>
 #include <agent/handlers.h>
+#include <agent/output.h>
+#include <agent/frame.h>
 #include <sys/system_properties.h>
 
 static JavaVM* g_jvm = NULL;
@@ -54,130 +60,30 @@ static int get_device_api_level(void) {
     return cached_api;
 }
 
-// ELF symbol lookup - find symbol in loaded library by parsing ELF
+// ELF symbol lookup - find symbol in loaded library through its symbol index
 void* elf_lookup_symbol(const char* lib_path, uintptr_t load_addr, const char* symbol_name) {
-    int fd = open(lib_path, O_RDONLY);
-    if (fd < 0) {
-        LOGE("Cannot open %s: %s", lib_path, strerror(errno));
+    const SymIndex* idx = symindex_get_path(lib_path, load_addr);
+    if (!idx) {
+        LOGE("Cannot index %s", lib_path);
         return NULL;
     }
 
-    // Get file size
-    off_t file_size = lseek(fd, 0, SEEK_END);
-    lseek(fd, 0, SEEK_SET);
-
-    // Map the file
-    void* map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-
-    if (map == MAP_FAILED) {
-        LOGE("mmap failed: %s", strerror(errno));
+    SymInfo sym;
+    if (!symindex_find(idx, symbol_name, &sym)) {
         return NULL;
     }
 
-    void* result = NULL;
-    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)map;
-
-    // Verify ELF magic
-    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
-        LOGE("Not a valid ELF file");
-        goto cleanup;
-    }
-
-    // Find the first PT_LOAD segment to calculate proper load bias
-    Elf64_Phdr* phdr = (Elf64_Phdr*)((uint8_t*)map + ehdr->e_phoff);
-    uintptr_t first_load_vaddr = 0;
-    int found_load = 0;
-
-    for (int i = 0; i < ehdr->e_phnum; i++) {
-        if (phdr[i].p_type == PT_LOAD) {
-            first_load_vaddr = phdr[i].p_vaddr;
-            found_load = 1;
-            LOGI("First PT_LOAD vaddr: 0x%lx", (unsigned long)first_load_vaddr);
-            break;
-        }
-    }
-
-    if (!found_load) {
-        LOGE("No PT_LOAD segment found");
-        goto cleanup;
-    }
-
-    // Calculate actual load bias
-    uintptr_t load_bias = load_addr - first_load_vaddr;
-    LOGI("Load bias: 0x%lx (load_addr: 0x%lx - vaddr: 0x%lx)",
-         (unsigned long)load_bias, (unsigned long)load_addr, (unsigned long)first_load_vaddr);
-
-    // Find section headers
-    Elf64_Shdr* shdr = (Elf64_Shdr*)((uint8_t*)map + ehdr->e_shoff);
-    Elf64_Shdr* shstrtab = &shdr[ehdr->e_shstrndx];
-    const char* shstrtab_data = (const char*)map + shstrtab->sh_offset;
-
-    // Find .dynsym and .dynstr sections
-    Elf64_Shdr* dynsym_shdr = NULL;
-    Elf64_Shdr* dynstr_shdr = NULL;
-
-    for (int i = 0; i < ehdr->e_shnum; i++) {
-        const char* section_name = shstrtab_data + shdr[i].sh_name;
-        if (strcmp(section_name, ".dynsym") == 0) {
-            dynsym_shdr = &shdr[i];
-        } else if (strcmp(section_name, ".dynstr") == 0) {
-            dynstr_shdr = &shdr[i];
-        }
-    }
-
-    if (!dynsym_shdr || !dynstr_shdr) {
-        LOGE("Could not find .dynsym or .dynstr");
-        goto cleanup;
-    }
-
-    Elf64_Sym* symtab = (Elf64_Sym*)((uint8_t*)map + dynsym_shdr->sh_offset);
-    const char* strtab = (const char*)map + dynstr_shdr->sh_offset;
-    size_t sym_count = dynsym_shdr->sh_size / sizeof(Elf64_Sym);
-
-    // Search for the symbol
-    for (size_t i = 0; i < sym_count; i++) {
-        const char* name = strtab + symtab[i].st_name;
-        if (strcmp(name, symbol_name) == 0 && symtab[i].st_value != 0) {
-            result = (void*)(load_bias + symtab[i].st_value);
-            LOGI("ELF lookup: Found %s at %p (bias: 0x%lx, st_value: 0x%lx)",
-                 symbol_name, result, (unsigned long)load_bias, (unsigned long)symtab[i].st_value);
-            break;
-        }
-    }
-
-cleanup:
-    munmap(map, file_size);
+    void* result = (void*)(symindex_load_bias(idx) + sym.value);
+    LOGI("ELF lookup: Found %s at %p (bias: 0x%lx, st_value: 0x%lx)",
+         symbol_name, result, (unsigned long)symindex_load_bias(idx), (unsigned long)sym.value);
     return result;
 }
 
 // Try to find libart.so base from /proc/self/maps and resolve symbol
 static JNI_GetCreatedJavaVMs_t find_jvm_func_from_maps(void) {
-    FILE* fp = fopen("/proc/self/maps", "r");
-    if (!fp) return NULL;
-
-    char line[512];
-    uintptr_t libart_base = 0;
+    // The lowest mapping of libart.so is the true base
     char libart_path[256] = {0};
-
-    // Find the FIRST (lowest address) mapping of libart.so - this is the true base
-    while (fgets(line, sizeof(line), fp)) {
-        if (strstr(line, "libart.so")) {
-            unsigned long start;
-            char perms[5];
-            char path[256] = {0};
-            if (sscanf(line, "%lx-%*lx %4s %*x %*s %*d %255s", &start, perms, path) >= 2) {
-                // Take the first (lowest) mapping as base
-                if (libart_base == 0 || start < libart_base) {
-                    libart_base = (uintptr_t)start;
-                    if (path[0]) {
-                        strncpy(libart_path, path, sizeof(libart_path) - 1);
-                    }
-                }
-            }
-        }
-    }
-    fclose(fp);
+    uintptr_t libart_base = maps_module_base("libart.so", libart_path, sizeof(libart_path));
 
     if (!libart_base) {
         LOGI("libart.so not found in /proc/self/maps");
@@ -356,68 +262,81 @@ JNIEnv* get_jni_env(void) {
 }
 
 static char sock_path[256];
-static bool is_agent_established = false;
-static char session_key[33] = {0};
-
-static void filter_and_send(int client_fd, const char* data, const char* filter) {
-    if (!filter || !*filter) {
-        write(client_fd, data, strlen(data));
-        return;
-    }
 
-    char* data_copy = strdup(data);
-    if (!data_copy) return;
+#define AGENT_MAX_CLIENTS       8
+#define CMD_BUF_SIZE            65536
+#define CMD_TEXT_MAX            (2 * 1024 * 1024)
+// A frame at the payload limit plus whatever the client sent after it
+#define CLIENT_BUF_MAX          (FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + CMD_BUF_SIZE)
+#define CMD_QUIET_MS            50
+#define CMD_BUF_POOL            4
+#define CLIENT_SEND_TIMEOUT_S   2
+
+// One per connection. The command thread owns the input side; requests
+// hold a reference, so the fd is only closed (and can only be reused)
+// once nothing can write to it anymore.
+typedef struct AgentClient {
+    int fd;
+    int refs;                   // under g_req_lock
+    bool established;           // "con" seen on this connection
+    char session_key[33];
+    char* buf;
+    size_t buf_size;
+    size_t buf_used;
+    int64_t deadline_ms;        // text command is complete at this time, 0 = not yet
+} AgentClient;
+
+static AgentClient* g_agent_clients[AGENT_MAX_CLIENTS];
+static int g_agent_client_count = 0;
+
+// Input buffers are recycled across connections; one that had to grow
+// for a large payload is freed instead. Command thread only.
+static char* g_buf_pool[CMD_BUF_POOL];
+static int g_buf_pool_count = 0;
+
+static char* cmd_buf_get(void) {
+    if (g_buf_pool_count > 0) {
+        return g_buf_pool[--g_buf_pool_count];
+    }
+    return (char*)malloc(CMD_BUF_SIZE);
+}
 
-    char* line = strtok(data_copy, "\n");
-    while (line) {
-        if (strstr(line, filter)) {
-            write(client_fd, line, strlen(line));
-            write(client_fd, "\n", 1);
-        }
-        line = strtok(NULL, "\n");
+static void cmd_buf_put(char* buf, size_t size) {
+    if (size == CMD_BUF_SIZE && g_buf_pool_count < CMD_BUF_POOL) {
+        g_buf_pool[g_buf_pool_count++] = buf;
+    } else {
+        free(buf);
     }
-
-    free(data_copy);
 }
 
-static char* g_capture_buffer = NULL;
-static size_t g_capture_size = 0;
-static size_t g_capture_used = 0;
-static int g_capture_fd = -1;
-
-static void capture_init(void) {
-    g_capture_size = 65536;
-    g_capture_buffer = (char*)malloc(g_capture_size);
-    g_capture_used = 0;
-    if (g_capture_buffer) g_capture_buffer[0] = '\0';
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-static void capture_write(const char* data, size_t len) {
-    if (!g_capture_buffer) return;
-
-    while (g_capture_used + len + 1 > g_capture_size) {
-        g_capture_size *= 2;
-        char* new_buf = (char*)realloc(g_capture_buffer, g_capture_size);
-        if (!new_buf) return;
-        g_capture_buffer = new_buf;
+// Returns false when the command was rejected or unknown. Framed
+// requests are authenticated by the connection's "con", so they don't
+// carry the session key.
+static bool route_command(AgentClient* client, const char* cmd, size_t cmd_len, bool framed) {
+    // Raw commands carry binary data: hand it over untouched.
+    if (framed && client->established) {
+        int flags = cmd_flags(cmd);
+        if (flags >= 0 && (flags & CMD_F_RAW)) {
+            LOGI("Command: %.*s (%zu bytes)", (int)strcspn(cmd, "\n"), cmd, cmd_len);
+            return cmd_dispatch_raw(client->fd, cmd, cmd_len);
+        }
     }
 
-    memcpy(g_capture_buffer + g_capture_used, data, len);
-    g_capture_used += len;
-    g_capture_buffer[g_capture_used] = '\0';
-}
-
-static void capture_free(void) {
-    free(g_capture_buffer);
-    g_capture_buffer = NULL;
-    g_capture_size = 0;
-    g_capture_used = 0;
-}
-
-static void route_command(int client_fd, const char* cmd, size_t cmd_len) {
     LOGI("Command: %s", cmd);
 
-    static char main_cmd[65536];
+    // Per call: requests are routed from several threads at once.
+    size_t main_size = cmd_len + 1;
+    char* main_cmd = (char*)malloc(main_size);
+    if (!main_cmd) {
+        LOGE("malloc failed");
+        return false;
+    }
     char filter[256] = {0};
 
     const char* is_exec_cmd = strstr(cmd, " exec ");
@@ -429,62 +348,448 @@ static void route_command(int client_fd, const char* cmd, size_t cmd_len) {
 
     if (tilde) {
         size_t len = tilde - cmd;
-        if (len >= sizeof(main_cmd)) len = sizeof(main_cmd) - 1;
-        strncpy(main_cmd, cmd, len);
+        if (len >= main_size) len = main_size - 1;
+        memcpy(main_cmd, cmd, len);
         main_cmd[len] = '\0';
 
         strncpy(filter, tilde + 1, sizeof(filter) - 1);
         filter[sizeof(filter) - 1] = '\0';
         LOGI("Filter enabled: '%s'", filter);
     } else {
-        strncpy(main_cmd, cmd, sizeof(main_cmd) - 1);
-        main_cmd[sizeof(main_cmd) - 1] = '\0';
+        strncpy(main_cmd, cmd, main_size - 1);
+        main_cmd[main_size - 1] = '\0';
+    }
+
+    if(!client->established){
+        if(!framed && strncmp(main_cmd,"con ", 4) == 0){
+            strncpy(client->session_key, main_cmd + 4, 32);
+            client->session_key[32] = '\0';
+            client->established = true;
+            LOGI("Session established (fd=%d)", client->fd);
+
+            // "con <key> +frames": answer with a frame so the server knows
+            // it can stop guessing where responses end.
+            if (strlen(main_cmd) > 36 && strstr(main_cmd + 36, FRAME_HELLO)) {
+                output_set_framed(client->fd, true);
+                output_send_frame(client->fd, FRAME_END, 0, 0, FRAME_HELLO, strlen(FRAME_HELLO));
+                LOGI("Framed protocol enabled");
+            }
+            free(main_cmd);
+            return true;
+        }
+        free(main_cmd);
+        return false;
+    }
+
+    if (!framed) {
+        if(cmd_len < 33 || strncmp(main_cmd, client->session_key, 32) != 0 || main_cmd[32] != ' '){
+            free(main_cmd);
+            return false;
+        }
+
+        const char* actual_cmd = main_cmd + 33;
+        memmove(main_cmd, actual_cmd, strlen(actual_cmd) + 1);
+    }
+
+    // Dropping the key only shortened main_cmd, so the filter fits back.
+    if (filter[0] != '\0') {
+        size_t cmd_len_now = strlen(main_cmd);
+        snprintf(main_cmd + cmd_len_now, main_size - cmd_len_now, "~%s", filter);
+    }
+
+    bool known = cmd_dispatch(client->fd, main_cmd);
+    if (!known) {
+        const char* error = "{\"success\":false,\"error\":\"Unknown command\"}\n";
+        output_reply(client->fd, error, strlen(error));
+    }
+
+    free(main_cmd);
+    return known;
+}
+
+// Detach from JVM before blocking on read() to prevent
+// ART thread suspension timeouts on Android 9.
+// When attached, ART tries to suspend this thread for GC,
+// but blocking read() with SA_RESTART ignores the signal.
+static void release_jni_env(void) {
+    if (g_jvm && g_current_jni_env) {
+        (*g_jvm)->DetachCurrentThread(g_jvm);
+        g_current_jni_env = NULL;
+    }
+}
+
+// Requests run off the command thread so it can keep serving every
+// client. Framed commands registered CMD_F_CONCURRENT get a worker of
+// their own (up to REQUEST_WORKERS_MAX at once); everything else, text
+// commands and the overflow go through a single FIFO lane, so exec/hook
+// commands keep their order and only ever run one at a time.
+#define REQUEST_WORKERS_MAX 4
+
+typedef struct PendingRequest {
+    struct PendingRequest* next;
+    AgentClient* client;        // NULL: hook teardown after the last client left
+    uint32_t id;
+    bool framed;
+    size_t len;
+    char payload[];
+} PendingRequest;
+
+static pthread_mutex_t g_req_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_req_cond = PTHREAD_COND_INITIALIZER;
+static PendingRequest* g_lane_head = NULL;
+static PendingRequest* g_lane_tail = NULL;
+static bool g_lane_running = false;
+static int g_req_workers = 0;
+
+static void client_release(AgentClient* client) {
+    pthread_mutex_lock(&g_req_lock);
+    bool last = --client->refs == 0;
+    pthread_mutex_unlock(&g_req_lock);
+
+    if (last) {
+        close(client->fd);
+        free(client);
+    }
+}
+
+static void teardown_hooks(void) {
+    int native_count = uninstall_all_hooks();
+    if (native_count > 0)
+        LOGI("Cleaned up %d native hook(s)", native_count);
+
+    int java_count = uninstall_all_java_hooks();
+    if (java_count > 0)
+        LOGI("Cleaned up %d Java hook(s)", java_count);
+
+    strace_remove_all();
+    LOGI("Last client gone, all hooks restored");
+}
+
+static void run_request(PendingRequest* req, bool with_jni) {
+    AgentClient* client = req->client;
+    if (with_jni) g_current_jni_env = get_jni_env();
+
+    if (!client) {
+        teardown_hooks();
+    } else {
+        output_begin_request(client->fd, req->id);
+        bool ok = route_command(client, req->payload, req->len, req->framed);
+        output_end_request(ok ? 0 : FRAME_F_ERROR);
+    }
+
+    if (with_jni) release_jni_env();
+    free(req);
+    if (client) client_release(client);
+}
+
+static void* request_lane(void* arg) {
+    (void)arg;
+    output_set_direct(true);
+
+    while (1) {
+        pthread_mutex_lock(&g_req_lock);
+        while (!g_lane_head) {
+            pthread_cond_wait(&g_req_cond, &g_req_lock);
+        }
+        PendingRequest* req = g_lane_head;
+        g_lane_head = req->next;
+        if (!g_lane_head) g_lane_tail = NULL;
+        pthread_mutex_unlock(&g_req_lock);
+
+        run_request(req, true);
+    }
+    return NULL;
+}
+
+static void* request_worker(void* arg) {
+    output_set_direct(true);
+    run_request((PendingRequest*)arg, false);
+
+    pthread_mutex_lock(&g_req_lock);
+    g_req_workers--;
+    pthread_mutex_unlock(&g_req_lock);
+    return NULL;
+}
+
+static void submit_request(PendingRequest* req) {
+    bool concurrent = false;
+    if (req->framed) {
+        int flags = cmd_flags(req->payload);
+        concurrent = flags >= 0 && (flags & CMD_F_CONCURRENT);
     }
 
-    int use_capture = (filter[0] != '\0');
+    pthread_mutex_lock(&g_req_lock);
+    if (req->client) req->client->refs++;
 
-    if (use_capture) {
-        capture_init();
+    if (concurrent && g_req_workers < REQUEST_WORKERS_MAX) {
+        pthread_t tid;
+        g_req_workers++;
+        if (pthread_create(&tid, NULL, request_worker, req) == 0) {
+            pthread_detach(tid);
+            pthread_mutex_unlock(&g_req_lock);
+            return;
+        }
+        g_req_workers--;
     }
 
-    if(!is_agent_established){
-        if(strncmp(main_cmd,"con ", 4) == 0){
-            strncpy(session_key, main_cmd + 4, 32);
-            session_key[32] = '\0';
-            is_agent_established = true;
-            LOGI("Session established");
+    if (!g_lane_running) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, request_lane, NULL) != 0) {
+            pthread_mutex_unlock(&g_req_lock);
+            LOGE("Failed to start request lane, running inline");
+            run_request(req, true);
             return;
         }
+        pthread_detach(tid);
+        g_lane_running = true;
+    }
+
+    req->next = NULL;
+    if (g_lane_tail) g_lane_tail->next = req;
+    else g_lane_head = req;
+    g_lane_tail = req;
+    pthread_cond_broadcast(&g_req_cond);
+    pthread_mutex_unlock(&g_req_lock);
+}
+
+static PendingRequest* request_new(AgentClient* client, const char* payload, size_t len, bool framed) {
+    PendingRequest* req = (PendingRequest*)malloc(sizeof(PendingRequest) + len + 1);
+    if (!req) {
+        LOGE("malloc failed");
+        return NULL;
+    }
+    memset(req, 0, sizeof(*req));
+    req->client = client;
+    req->framed = framed;
+    memcpy(req->payload, payload, len);
+    req->payload[len] = '\0';
+
+    // Trailing whitespace is not part of any command, except for data
+    // that a raw command carries as its payload.
+    int flags = framed ? cmd_flags(req->payload) : -1;
+    if (flags < 0 || !(flags & CMD_F_RAW)) {
+        while (len > 0 && (payload[len-1] == '\n' || payload[len-1] == '\r' || payload[len-1] == ' ')) {
+            len--;
+        }
+        req->payload[len] = '\0';
+    }
+    req->len = len;
+    return req;
+}
+
+static void client_consume(AgentClient* client, size_t n) {
+    memmove(client->buf, client->buf + n, client->buf_used - n);
+    client->buf_used -= n;
+}
+
+// The whole buffer is one text command. Returns false to close the connection.
+static bool run_text_command(AgentClient* client) {
+    PendingRequest* req = request_new(client, client->buf, client->buf_used, false);
+    client->buf_used = 0;
+    client->deadline_ms = 0;
+    if (!req) return false;
+
+    if (req->len == 0) {
+        free(req);
+        return true;
+    }
+    LOGI("Received command (%zu bytes)", req->len);
+
+    if (strcmp(req->payload, "exit") == 0) {
+        LOGI("Exit requested");
+        free(req);
+        return false;
+    }
+
+    // "con" only touches this connection's state; answer it right here.
+    if (strncmp(req->payload, "con ", 4) == 0) {
+        route_command(client, req->payload, req->len, false);
+        free(req);
+        return true;
+    }
+
+    submit_request(req);
+    return true;
+}
+
+static bool handle_frame(AgentClient* client, const FrameHeader* header, const char* payload) {
+    if (header->type != FRAME_REQUEST) return true;
+
+    PendingRequest* req = request_new(client, payload, header->length, true);
+    if (!req) return false;
+    if (req->len == 0) {
+        free(req);
+        return true;
+    }
+
+    if (strcmp(req->payload, "exit") == 0) {
+        LOGI("Exit requested");
+        free(req);
+        return false;
+    }
+
+    req->id = header->id;
+    submit_request(req);
+    return true;
+}
+
+// Everything complete in the input buffer. A frame starts with
+// FRAME_MAGIC; anything else is a text command, complete once it ends in
+// a newline and nothing follows for CMD_QUIET_MS (payloads may contain
+// newlines). Returns false to close the connection.
+static bool client_process(AgentClient* client) {
+    while (client->buf_used > 0) {
+        if ((uint8_t)client->buf[0] == FRAME_MAGIC) {
+            if (client->buf_used < FRAME_HEADER_SIZE) break;
+
+            FrameHeader header;
+            if (!frame_decode((const uint8_t*)client->buf, &header)) {
+                LOGE("Malformed frame header, closing connection");
+                return false;
+            }
+            size_t total = FRAME_HEADER_SIZE + header.length;
+            if (client->buf_used < total) break;
+
+            bool keep = handle_frame(client, &header, client->buf + FRAME_HEADER_SIZE);
+            client_consume(client, total);
+            if (!keep) return false;
+            continue;
+        }
+
+        client->deadline_ms = 0;
+        if (client->buf_used > CMD_TEXT_MAX) {
+            LOGE("Command too large");
+            return false;
+        }
+        if (client->buf[client->buf_used - 1] != '\n') break;
+
+        // "con" is always a single line; answer it without the wait
+        if (strncmp(client->buf, "con ", 4) == 0) {
+            return run_text_command(client);
+        }
+        client->deadline_ms = now_ms() + CMD_QUIET_MS;
+        break;
+    }
+    return true;
+}
+
+static bool client_read(AgentClient* client) {
+    while (1) {
+        if (client->buf_used == client->buf_size) {
+            if (client->buf_size >= CLIENT_BUF_MAX) {
+                LOGE("Command too large");
+                return false;
+            }
+            // Doubling from CMD_BUF_SIZE overshoots the limit; stop at it
+            size_t size = client->buf_size * 2;
+            if (size > CLIENT_BUF_MAX) size = CLIENT_BUF_MAX;
+            char* grown = (char*)realloc(client->buf, size);
+            if (!grown) {
+                LOGE("realloc failed");
+                return false;
+            }
+            client->buf = grown;
+            client->buf_size = size;
+        }
+
+        ssize_t n = recv(client->fd, client->buf + client->buf_used,
+                         client->buf_size - client->buf_used, MSG_DONTWAIT);
+        if (n > 0) {
+            client->buf_used += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        LOGI("Client disconnected (fd=%d)", client->fd);
+        return false;
+    }
+    return client_process(client);
+}
+
+static void client_add(int epoll_fd, int fd) {
+    if (g_agent_client_count >= AGENT_MAX_CLIENTS) {
+        LOGE("Too many clients, refusing fd=%d", fd);
+        close(fd);
         return;
     }
 
-    if(cmd_len < 33 || strncmp(main_cmd, session_key, 32) != 0 || main_cmd[32] != ' '){
+    AgentClient* client = (AgentClient*)calloc(1, sizeof(AgentClient));
+    char* buf = cmd_buf_get();
+    if (!client || !buf) {
+        LOGE("malloc failed");
+        free(client);
+        free(buf);
+        close(fd);
         return;
     }
+    client->fd = fd;
+    client->refs = 1;
+    client->buf = buf;
+    client->buf_size = CMD_BUF_SIZE;
+
+    // Replies are written from request threads; don't let a stalled
+    // client hold the output lock for long.
+    struct timeval tv = {CLIENT_SEND_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = client;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        LOGE("epoll_ctl failed: %s", strerror(errno));
+        cmd_buf_put(buf, CMD_BUF_SIZE);
+        free(client);
+        close(fd);
+        return;
+    }
+
+    output_attach(fd);
+    g_agent_clients[g_agent_client_count++] = client;
+    LOGI("Client connected (fd=%d, %d connected)", fd, g_agent_client_count);
+}
 
-    const char* actual_cmd = main_cmd + 33;
-    memmove(main_cmd, actual_cmd, strlen(actual_cmd) + 1);
+static void client_remove(int epoll_fd, AgentClient* client) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    output_detach(client->fd);
 
-    if (filter[0] != '\0') {
-        size_t cmd_len_now = strlen(main_cmd);
-        snprintf(main_cmd + cmd_len_now, sizeof(main_cmd) - cmd_len_now, "~%s", filter);
+    for (int i = 0; i < g_agent_client_count; i++) {
+        if (g_agent_clients[i] == client) {
+            g_agent_clients[i] = g_agent_clients[--g_agent_client_count];
+            break;
+        }
     }
 
-    if (!cmd_dispatch(client_fd, main_cmd)) {
-        const char* error = "{\"success\":false,\"error\":\"Unknown command\"}\n";
-        write(client_fd, error, strlen(error));
+    cmd_buf_put(client->buf, client->buf_size);
+    client->buf = NULL;
+
+    // Queued behind whatever the lane still has to run.
+    if (g_agent_client_count == 0 && !g_keep_hooks) {
+        PendingRequest* teardown = request_new(NULL, "", 0, false);
+        if (teardown) submit_request(teardown);
     }
 
-    if (use_capture && g_capture_buffer) {
-        filter_and_send(client_fd, g_capture_buffer, filter);
-        capture_free();
+    LOGI("Connection closed (fd=%d, %d connected%s)", client->fd, g_agent_client_count,
+         g_keep_hooks ? ", hooks kept" : "");
+    client_release(client);
+}
+
+static int next_deadline_ms(void) {
+    int64_t earliest = 0;
+    for (int i = 0; i < g_agent_client_count; i++) {
+        int64_t d = g_agent_clients[i]->deadline_ms;
+        if (d && (earliest == 0 || d < earliest)) earliest = d;
     }
+    if (earliest == 0) return -1;
+    int64_t wait = earliest - now_ms();
+    return wait < 0 ? 0 : (int)wait;
 }
 
 static void* command_handler(void* arg) {
     LOGI("Starting command handler...");
 
-    int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (server_fd < 0) {
         LOGE("Socket creation failed");
         return NULL;
@@ -510,123 +815,55 @@ static void* command_handler(void* arg) {
         close(server_fd);
         return NULL;
     }
+    fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        LOGE("epoll_create1 failed: %s", strerror(errno));
+        close(server_fd);
+        return NULL;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
 
     LOGI("Listening on: @renef_pl_%d", getpid());
 
+    struct epoll_event events[AGENT_MAX_CLIENTS + 1];
     while (1) {
-        int client_fd = accept(server_fd, NULL, NULL);
-        if (client_fd < 0) continue;
-
-        LOGI("Client connected (fd=%d)", client_fd);
-        g_output_client_fd = client_fd;
-
-        while (1) {
-            size_t buf_size = 65536;
-            size_t buf_used = 0;
-            char* cmd = (char*)malloc(buf_size);
-            if (!cmd) {
-                LOGE("malloc failed");
-                break;
-            }
-
-            int complete = 0;
-            while (!complete) {
-                if (buf_used >= buf_size - 1) {
-                    buf_size *= 2;
-                    if (buf_size > 2 * 1024 * 1024) {
-                        LOGE("Command too large");
-                        break;
-                    }
-                    char* new_buf = (char*)realloc(cmd, buf_size);
-                    if (!new_buf) {
-                        LOGE("realloc failed");
-                        break;
-                    }
-                    cmd = new_buf;
-                }
-
-                ssize_t n = read(client_fd, cmd + buf_used, buf_size - buf_used - 1);
-
-                if (n <= 0) {
-                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                        usleep(10000);
-                        continue;
-                    }
-                    LOGI("Client disconnected");
-                    free(cmd);
-                    cmd = NULL;
-                    break;
-                }
-
-                buf_used += n;
-                cmd[buf_used] = '\0';
+        int n = epoll_wait(epoll_fd, events, AGENT_MAX_CLIENTS + 1, next_deadline_ms());
+        if (n < 0) {
+            if (errno != EINTR) LOGE("epoll_wait failed: %s", strerror(errno));
+            continue;
+        }
 
-                if (buf_used > 0 && cmd[buf_used - 1] == '\n') {
-                    // Check if more data follows (embedded newline in multi-line payload)
-                    struct pollfd pfd = {client_fd, POLLIN, 0};
-                    if (poll(&pfd, 1, 50) <= 0) {
-                        complete = 1;
-                    }
-                    // else: more data available, keep reading
+        for (int i = 0; i < n; i++) {
+            AgentClient* client = (AgentClient*)events[i].data.ptr;
+            if (!client) {
+                int fd;
+                while ((fd = accept4(server_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+                    client_add(epoll_fd, fd);
                 }
-            }
-
-            if (!cmd) break;
-
-            while (buf_used > 0 && (cmd[buf_used-1] == '\n' || cmd[buf_used-1] == '\r' || cmd[buf_used-1] == ' ')) {
-                cmd[--buf_used] = '\0';
-            }
-
-            if (buf_used == 0) {
-                free(cmd);
                 continue;
             }
-
-            LOGI("Received command (%zu bytes)", buf_used);
-
-            g_current_jni_env = get_jni_env();
-            if (g_current_jni_env) {
-                LOGI("JNIEnv available: %p", g_current_jni_env);
-            }
-
-            if (strcmp(cmd, "exit") == 0) {
-                LOGI("Exit requested");
-                free(cmd);
-                break;
-            }
-
-            route_command(client_fd, cmd, buf_used);
-            free(cmd);
-
-            // Detach from JVM before blocking on read() to prevent
-            // ART thread suspension timeouts on Android 9.
-            // When attached, ART tries to suspend this thread for GC,
-            // but blocking read() with SA_RESTART ignores the signal.
-            if (g_jvm && g_current_jni_env) {
-                (*g_jvm)->DetachCurrentThread(g_jvm);
-                g_current_jni_env = NULL;
+            if (!client_read(client)) {
+                client_remove(epoll_fd, client);
             }
         }
 
-        {
-            int native_count = uninstall_all_hooks();
-            if (native_count > 0)
-                LOGI("Cleaned up %d native hook(s)", native_count);
-
-            int java_count = uninstall_all_java_hooks();
-            if (java_count > 0)
-                LOGI("Cleaned up %d Java hook(s)", java_count);
-
-            strace_remove_all();
+        int64_t now = now_ms();
+        for (int i = 0; i < g_agent_client_count; i++) {
+            AgentClient* client = g_agent_clients[i];
+            if (client->deadline_ms && client->deadline_ms <= now && !run_text_command(client)) {
+                client_remove(epoll_fd, client);
+                i--;
+            }
         }
-
-        g_output_client_fd = -1;
-        close(client_fd);
-        is_agent_established = false;
-        memset(session_key, 0, sizeof(session_key));
-        LOGI("Connection closed, all hooks restored, session reset");
     }
 
+    close(epoll_fd);
     close(server_fd);
     return NULL;
 }
@@ -1,5 +1,6 @@
 #include <agent/globals.h>
 #include <agent/hook.h>
+#include <agent/output.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
@@ -9,22 +10,22 @@ LuaEngine* g_lua_engine = NULL;
 
 int g_output_client_fd = -1;
 
-bool g_verbose_mode = false;
+bool g_keep_hooks = false;
 
-void verbose_log(const char* fmt, ...) {
+int g_log_level = LOG_LEVEL_OFF;
+
+void verbose_log_impl(const char* fmt, ...) {
     char buf[512];
+    memcpy(buf, "[DBG] ", 6);
     va_list args;
     va_start(args, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, args);
+    int len = vsnprintf(buf + 6, sizeof(buf) - 6, fmt, args);
     va_end(args);
+    if (len < 0) return;
+    if ((size_t)len >= sizeof(buf) - 6) len = sizeof(buf) - 7;
 
-    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "%s", buf);
-
-    if (g_verbose_mode && g_output_client_fd >= 0) {
-        write(g_output_client_fd, "[DBG] ", 6);
-        write(g_output_client_fd, buf, strlen(buf));
-        write(g_output_client_fd, "\n", 1);
-    }
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "%s", buf + 6);
+    output_write_to(OUTPUT_CH_LOG, buf, (size_t)len + 6);
 }
 
 JNIEnv* g_current_jni_env = NULL;
@@ -0,0 +1,102 @@
+#include <agent/lz4.h>
+#include <string.h>
+
+#define LZ4_HASH_LOG        12
+#define LZ4_MIN_MATCH       4
+#define LZ4_LAST_LITERALS   5       // the block ends with at least this many literals
+#define LZ4_MF_LIMIT        12      // no match starts this close to the end
+#define LZ4_MAX_DISTANCE    65535
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+// Length fields of 15 and more continue in extra bytes of 255.
+static inline uint8_t* put_length(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static inline size_t sequence_bound(size_t lit, size_t mlen) {
+    return 1 + lit + lit / 255 + 1 + 2 + mlen / 255 + 1;
+}
+
+size_t lz4_compress_block(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_cap) {
+    uint32_t table[1 << LZ4_HASH_LOG];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* const iend = src + len;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_cap;
+
+    if (len > LZ4_MF_LIMIT) {
+        const uint8_t* const mf_limit = iend - LZ4_MF_LIMIT;
+        const uint8_t* const match_limit = iend - LZ4_LAST_LITERALS;
+
+        while (ip < mf_limit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash4(seq);
+            const uint8_t* ref = src + table[h];
+            table[h] = (uint32_t)(ip - src);
+
+            if (ref >= ip || ip - ref > LZ4_MAX_DISTANCE || read32(ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t* mp = ip + LZ4_MIN_MATCH;
+            const uint8_t* rp = ref + LZ4_MIN_MATCH;
+            while (mp < match_limit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            size_t lit = (size_t)(ip - anchor);
+            size_t mlen = (size_t)(mp - ip) - LZ4_MIN_MATCH;
+            if (sequence_bound(lit, mlen) > (size_t)(oend - op)) return 0;
+
+            uint8_t* token = op++;
+            *token = (uint8_t)((lit < 15 ? lit : 15) << 4);
+            if (lit >= 15) op = put_length(op, lit - 15);
+            memcpy(op, anchor, lit);
+            op += lit;
+
+            size_t dist = (size_t)(ip - ref);
+            *op++ = (uint8_t)dist;
+            *op++ = (uint8_t)(dist >> 8);
+
+            *token |= (uint8_t)(mlen < 15 ? mlen : 15);
+            if (mlen >= 15) op = put_length(op, mlen - 15);
+
+            ip = mp;
+            anchor = ip;
+        }
+    }
+
+    size_t lit = (size_t)(iend - anchor);
+    if (1 + lit + lit / 255 + 1 > (size_t)(oend - op)) return 0;
+
+    *op++ = (uint8_t)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15) op = put_length(op, lit - 15);
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    return (size_t)(op - dst);
+}
@@ -0,0 +1,611 @@
+#include <agent/output.h>
+#include <agent/globals.h>
+#include <agent/frame.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define OUTPUT_BATCH_SIZE   (32 * 1024)
+#define OUTPUT_IDLE_MS      50
+
+// Records are a 32-bit word (channel in the top byte, length below)
+// followed by the payload, padded to 4 bytes.
+// head is only advanced by the owning thread. tail is advanced by the
+// writer, and also by the owner under OUTPUT_DROP_OLDEST, so both sides
+// move it with CAS; the writer discards a copy whose CAS lost the race.
+typedef struct OutputRing {
+    struct OutputRing* next;
+    uint64_t head;
+    uint64_t tail;
+    int tid;
+    bool dead;
+    uint8_t data[OUTPUT_RING_SIZE];
+} OutputRing;
+
+static OutputRing* g_rings = NULL;
+static int g_ring_count = 0;
+static int g_policy = OUTPUT_DROP_NEWEST;
+
+static uint64_t g_queued = 0;
+static uint64_t g_written = 0;
+static uint64_t g_lost = 0;
+static uint64_t g_blocked = 0;
+static uint64_t g_direct = 0;
+
+#define REC_LEN_MASK        0x00FFFFFFu
+#define REC_CHANNEL_SHIFT   24
+
+static int g_channel_policy[OUTPUT_CH_COUNT];
+static bool g_channel_paused[OUTPUT_CH_COUNT];
+static uint64_t g_channel_queued[OUTPUT_CH_COUNT];
+static uint64_t g_channel_lost[OUTPUT_CH_COUNT];
+static const char* k_channel_names[OUTPUT_CH_COUNT] = {NULL, "hook", "strace", "log"};
+
+static pthread_mutex_t g_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Connected clients, under g_write_lock. Events go to all of them; a
+// thread's replies go to the client whose request it is handling (per
+// thread, so several requests can be in flight). g_output_client_fd
+// mirrors the newest client, -1 when nobody is listening.
+#define OUTPUT_MAX_CLIENTS  16
+
+typedef struct {
+    int fd;
+    bool framed;
+    bool broken;                // a write failed or timed out; skipped until detached
+} OutputClient;
+
+static OutputClient g_clients[OUTPUT_MAX_CLIENTS];
+static int g_client_count = 0;
+static pthread_key_t g_ring_key;
+static pthread_once_t g_output_once = PTHREAD_ONCE_INIT;
+static bool g_writer_running = false;
+static int g_writer_idle = 0;
+static sem_t g_writer_sem;
+
+static __thread OutputRing* t_ring = NULL;
+static __thread bool t_direct = false;
+static __thread bool t_request_active = false;
+static __thread int t_request_fd = -1;
+static __thread uint32_t t_request_id = 0;
+static __thread bool t_request_failed = false;
+
+static const char* k_policy_names[] = {"drop-newest", "drop-oldest", "block"};
+
+static inline uint32_t record_size(uint32_t len) {
+    return 4 + ((len + 3) & ~3u);
+}
+
+static void ring_copy_in(OutputRing* r, uint64_t pos, const void* src, size_t n) {
+    size_t off = pos & (OUTPUT_RING_SIZE - 1);
+    size_t first = OUTPUT_RING_SIZE - off;
+    if (first > n) first = n;
+    memcpy(r->data + off, src, first);
+    memcpy(r->data, (const uint8_t*)src + first, n - first);
+}
+
+static void ring_copy_out(const OutputRing* r, uint64_t pos, void* dst, size_t n) {
+    size_t off = pos & (OUTPUT_RING_SIZE - 1);
+    size_t first = OUTPUT_RING_SIZE - off;
+    if (first > n) first = n;
+    memcpy(dst, r->data + off, first);
+    memcpy((uint8_t*)dst + first, r->data, n - first);
+}
+
+// Client sockets carry a send timeout, so a stalled client fails here
+// instead of holding g_write_lock forever.
+static bool write_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Caller holds g_write_lock. `extra` (the trailing newline) goes into the
+// same frame.
+static bool write_frame_locked(int fd, uint8_t type, uint16_t flags, uint32_t id,
+                               const char* data, size_t len, const char* extra, size_t extra_len) {
+    uint8_t header[FRAME_HEADER_SIZE];
+    frame_encode(header, type, flags, id, (uint32_t)(len + extra_len));
+    if (!write_all(fd, (const char*)header, sizeof(header))) return false;
+    if (len && !write_all(fd, data, len)) return false;
+    if (extra_len && !write_all(fd, extra, extra_len)) return false;
+    return true;
+}
+
+static OutputClient* client_find_locked(int fd) {
+    for (int i = 0; i < g_client_count; i++) {
+        if (g_clients[i].fd == fd) return &g_clients[i];
+    }
+    return NULL;
+}
+
+static void send_client_locked(OutputClient* c, uint8_t type, uint32_t id, const char* data, size_t len,
+                               const char* extra, size_t extra_len) {
+    if (c->broken) return;
+
+    bool ok = true;
+    if (!c->framed) {
+        ok = write_all(c->fd, data, len) && (!extra_len || write_all(c->fd, extra, extra_len));
+    } else {
+        // Batches are far below FRAME_MAX_PAYLOAD; split oversized replies anyway.
+        while (ok && len > FRAME_MAX_PAYLOAD) {
+            ok = write_frame_locked(c->fd, type, 0, id, data, FRAME_MAX_PAYLOAD, NULL, 0);
+            data += FRAME_MAX_PAYLOAD;
+            len -= FRAME_MAX_PAYLOAD;
+        }
+        ok = ok && write_frame_locked(c->fd, type, 0, id, data, len, extra, extra_len);
+    }
+    if (!ok) {
+        c->broken = true;
+        LOGE("output: client fd=%d stopped accepting output", c->fd);
+    }
+}
+
+static void write_out_locked(bool request_output, OutputChannel channel, const char* data, size_t len,
+                             const char* extra, size_t extra_len) {
+    if (request_output && t_request_active) {
+        OutputClient* c = client_find_locked(t_request_fd);
+        if (c) send_client_locked(c, FRAME_DATA, t_request_id, data, len, extra, extra_len);
+        return;
+    }
+
+    for (int i = 0; i < g_client_count; i++) {
+        send_client_locked(&g_clients[i], FRAME_EVENT, (uint32_t)channel, data, len, extra, extra_len);
+    }
+}
+
+static void flush_batch(const char* batch, size_t len, OutputChannel channel) {
+    if (len == 0) return;
+
+    pthread_mutex_lock(&g_write_lock);
+    write_out_locked(false, channel, batch, len, NULL, 0);
+    pthread_mutex_unlock(&g_write_lock);
+}
+
+// A batch holds one channel only; a record for another channel flushes it.
+static int drain_ring(OutputRing* r, char* batch, size_t* batch_len, OutputChannel* batch_channel) {
+    int count = 0;
+
+    while (1) {
+        uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (tail == head) break;
+
+        uint32_t word;
+        ring_copy_out(r, tail, &word, sizeof(word));
+        uint32_t len = word & REC_LEN_MASK;
+        OutputChannel channel = (OutputChannel)(word >> REC_CHANNEL_SHIFT);
+        // word may be torn if the owner dropped this record meanwhile; the
+        // CAS below fails in that case, so only keep it in bounds here.
+        if (len > OUTPUT_BATCH_SIZE || len > head - tail - 4 || channel >= OUTPUT_CH_COUNT) {
+            continue;
+        }
+
+        if (*batch_len > 0 && (*batch_len + len > OUTPUT_BATCH_SIZE || channel != *batch_channel)) {
+            flush_batch(batch, *batch_len, *batch_channel);
+            *batch_len = 0;
+        }
+        *batch_channel = channel;
+        ring_copy_out(r, tail + 4, batch + *batch_len, len);
+
+        if (__atomic_compare_exchange_n(&r->tail, &tail, tail + record_size(len), false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *batch_len += len;
+            count++;
+        }
+    }
+    return count;
+}
+
+static void* writer_thread(void* arg) {
+    (void)arg;
+    char* batch = malloc(OUTPUT_BATCH_SIZE);
+    if (!batch) {
+        LOGE("output: writer batch allocation failed");
+        return NULL;
+    }
+
+    while (1) {
+        size_t batch_len = 0;
+        OutputChannel batch_channel = OUTPUT_CH_HOOK;
+        int count = 0;
+
+        OutputRing* prev = NULL;
+        OutputRing* r = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE);
+        while (r) {
+            count += drain_ring(r, batch, &batch_len, &batch_channel);
+            OutputRing* next = r->next;
+
+            // Only the list head is ever replaced by producers, so other
+            // dead rings can be unlinked once they are empty.
+            if (prev && __atomic_load_n(&r->dead, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head) {
+                prev->next = next;
+                free(r);
+                __atomic_sub_fetch(&g_ring_count, 1, __ATOMIC_RELAXED);
+            } else {
+                prev = r;
+            }
+            r = next;
+        }
+
+        flush_batch(batch, batch_len, batch_channel);
+        __atomic_add_fetch(&g_written, count, __ATOMIC_RELAXED);
+
+        if (count == 0) {
+            __atomic_store_n(&g_writer_idle, 1, __ATOMIC_SEQ_CST);
+
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += OUTPUT_IDLE_MS * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            sem_timedwait(&g_writer_sem, &ts);
+            __atomic_store_n(&g_writer_idle, 0, __ATOMIC_SEQ_CST);
+        }
+    }
+    return NULL;
+}
+
+static void ring_release(void* arg) {
+    OutputRing* r = (OutputRing*)arg;
+    if (r) {
+        __atomic_store_n(&r->dead, true, __ATOMIC_RELEASE);
+    }
+}
+
+static void output_init(void) {
+    pthread_key_create(&g_ring_key, ring_release);
+    sem_init(&g_writer_sem, 0, 0);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, writer_thread, NULL) == 0) {
+        pthread_detach(tid);
+        g_writer_running = true;
+    } else {
+        LOGE("output: failed to start writer thread, writing inline");
+    }
+}
+
+static OutputRing* ring_get(void) {
+    if (t_ring) {
+        return t_ring;
+    }
+
+    OutputRing* r = calloc(1, sizeof(OutputRing));
+    if (!r) return NULL;
+    r->tid = (int)syscall(SYS_gettid);
+
+    r->next = __atomic_load_n(&g_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&g_rings, &r->next, r, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    __atomic_add_fetch(&g_ring_count, 1, __ATOMIC_RELAXED);
+
+    pthread_setspecific(g_ring_key, r);
+    t_ring = r;
+    return r;
+}
+
+static void wake_writer(void) {
+    if (__atomic_exchange_n(&g_writer_idle, 0, __ATOMIC_SEQ_CST)) {
+        sem_post(&g_writer_sem);
+    }
+}
+
+static void write_direct(OutputChannel channel, const char* msg, size_t len, bool newline) {
+    pthread_mutex_lock(&g_write_lock);
+    write_out_locked(t_direct, channel, msg, len, "\n", newline ? 1 : 0);
+    pthread_mutex_unlock(&g_write_lock);
+    __atomic_add_fetch(&g_direct, 1, __ATOMIC_RELAXED);
+}
+
+// Make room for `need` bytes according to the policy; false drops the message.
+// The channel's policy decides; records dropped under drop-oldest are
+// charged to their own channel.
+static bool ring_reserve(OutputRing* r, uint32_t need, OutputChannel channel) {
+    uint64_t head = r->head;
+
+    while (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) + need > OUTPUT_RING_SIZE) {
+        switch (__atomic_load_n(&g_channel_policy[channel], __ATOMIC_RELAXED)) {
+        case OUTPUT_DROP_OLDEST: {
+            uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+            uint32_t old_word;
+            ring_copy_out(r, tail, &old_word, sizeof(old_word));
+            if (__atomic_compare_exchange_n(&r->tail, &tail, tail + record_size(old_word & REC_LEN_MASK), false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                uint32_t old_channel = old_word >> REC_CHANNEL_SHIFT;
+                __atomic_add_fetch(&g_lost, 1, __ATOMIC_RELAXED);
+                if (old_channel < OUTPUT_CH_COUNT) {
+                    __atomic_add_fetch(&g_channel_lost[old_channel], 1, __ATOMIC_RELAXED);
+                }
+            }
+            break;
+        }
+        case OUTPUT_BLOCK:
+            if (g_output_client_fd < 0) {
+                __atomic_add_fetch(&g_lost, 1, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&g_channel_lost[channel], 1, __ATOMIC_RELAXED);
+                return false;
+            }
+            __atomic_add_fetch(&g_blocked, 1, __ATOMIC_RELAXED);
+            wake_writer();
+            usleep(1000);
+            break;
+        default:
+            __atomic_add_fetch(&g_lost, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&g_channel_lost[channel], 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void output_append(OutputChannel channel, const char* msg, size_t len, bool newline) {
+    if (g_output_client_fd < 0 || !msg) {
+        return;
+    }
+    // Pausing a channel stops its events, not a request's own output.
+    bool request_output = t_direct && t_request_active;
+    if (!request_output && __atomic_load_n(&g_channel_paused[channel], __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&g_channel_lost[channel], 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    pthread_once(&g_output_once, output_init);
+
+    uint32_t rec_len = (uint32_t)len + (newline ? 1 : 0);
+    uint32_t need = record_size(rec_len);
+    OutputRing* r = NULL;
+    if (!t_direct && g_writer_running && need <= OUTPUT_RING_SIZE && len < OUTPUT_BATCH_SIZE) {
+        r = ring_get();
+    }
+    if (!r) {
+        write_direct(channel, msg, len, newline);
+        __atomic_add_fetch(&g_channel_queued[channel], 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    if (!ring_reserve(r, need, channel)) {
+        return;
+    }
+
+    uint64_t head = r->head;
+    uint32_t word = rec_len | ((uint32_t)channel << REC_CHANNEL_SHIFT);
+    ring_copy_in(r, head, &word, sizeof(word));
+    ring_copy_in(r, head + 4, msg, len);
+    if (newline) ring_copy_in(r, head + 4 + len, "\n", 1);
+    __atomic_store_n(&r->head, head + need, __ATOMIC_RELEASE);
+
+    __atomic_add_fetch(&g_queued, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_channel_queued[channel], 1, __ATOMIC_RELAXED);
+    wake_writer();
+}
+
+void output_write(const char* msg, size_t len) {
+    output_append(OUTPUT_CH_HOOK, msg, len, true);
+}
+
+void output_write_raw(const void* data, size_t len) {
+    output_append(OUTPUT_CH_HOOK, (const char*)data, len, false);
+}
+
+void output_write_to(OutputChannel channel, const char* msg, size_t len) {
+    if (channel <= 0 || channel >= OUTPUT_CH_COUNT) channel = OUTPUT_CH_HOOK;
+    output_append(channel, msg, len, true);
+}
+
+void output_write_raw_to(OutputChannel channel, const void* data, size_t len) {
+    if (channel <= 0 || channel >= OUTPUT_CH_COUNT) channel = OUTPUT_CH_HOOK;
+    output_append(channel, (const char*)data, len, false);
+}
+
+void output_set_direct(bool direct) {
+    t_direct = direct;
+}
+
+void output_attach(int fd) {
+    pthread_mutex_lock(&g_write_lock);
+    if (!client_find_locked(fd) && g_client_count < OUTPUT_MAX_CLIENTS) {
+        OutputClient* c = &g_clients[g_client_count++];
+        c->fd = fd;
+        c->framed = false;
+        c->broken = false;
+        g_output_client_fd = fd;
+    }
+    pthread_mutex_unlock(&g_write_lock);
+}
+
+void output_detach(int fd) {
+    pthread_mutex_lock(&g_write_lock);
+    OutputClient* c = client_find_locked(fd);
+    if (c) {
+        *c = g_clients[--g_client_count];
+        g_output_client_fd = g_client_count ? g_clients[g_client_count - 1].fd : -1;
+    }
+    pthread_mutex_unlock(&g_write_lock);
+}
+
+int output_client_count(void) {
+    pthread_mutex_lock(&g_write_lock);
+    int count = g_client_count;
+    pthread_mutex_unlock(&g_write_lock);
+    return count;
+}
+
+void output_set_framed(int fd, bool framed) {
+    pthread_mutex_lock(&g_write_lock);
+    OutputClient* c = client_find_locked(fd);
+    if (c) c->framed = framed;
+    pthread_mutex_unlock(&g_write_lock);
+}
+
+bool output_is_framed(int fd) {
+    pthread_mutex_lock(&g_write_lock);
+    OutputClient* c = client_find_locked(fd);
+    bool framed = c && c->framed;
+    pthread_mutex_unlock(&g_write_lock);
+    return framed;
+}
+
+void output_begin_request(int fd, uint32_t id) {
+    t_request_active = true;
+    t_request_fd = fd;
+    t_request_id = id;
+    t_request_failed = false;
+}
+
+void output_fail_request(void) {
+    t_request_failed = true;
+}
+
+bool output_request_writable(int timeout_ms) {
+    if (!t_request_active) return false;
+
+    pthread_mutex_lock(&g_write_lock);
+    OutputClient* c = client_find_locked(t_request_fd);
+    bool alive = c && !c->broken;
+    pthread_mutex_unlock(&g_write_lock);
+    if (!alive) return false;
+
+    // Without the lock: events keep flowing while we wait.
+    struct pollfd pfd = {t_request_fd, POLLOUT, 0};
+    int ret;
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    return ret > 0 && !(pfd.revents & (POLLERR | POLLHUP | POLLNVAL));
+}
+
+void output_end_request(uint16_t flags) {
+    if (t_request_failed) flags |= FRAME_F_ERROR;
+
+    pthread_mutex_lock(&g_write_lock);
+    OutputClient* c = t_request_active ? client_find_locked(t_request_fd) : NULL;
+    if (c && c->framed && !c->broken) {
+        if (!write_frame_locked(c->fd, FRAME_END, flags, t_request_id, NULL, 0, NULL, 0)) {
+            c->broken = true;
+        }
+    }
+    pthread_mutex_unlock(&g_write_lock);
+    t_request_active = false;
+    t_request_fd = -1;
+}
+
+void output_send_frame(int fd, uint8_t type, uint16_t flags, uint32_t id, const void* data, size_t len) {
+    pthread_mutex_lock(&g_write_lock);
+    OutputClient* c = client_find_locked(fd);
+    if (c && !c->broken && !write_frame_locked(fd, type, flags, id, (const char*)data, len, NULL, 0)) {
+        c->broken = true;
+    }
+    pthread_mutex_unlock(&g_write_lock);
+}
+
+OutputRequest output_request(int fd) {
+    OutputRequest req = {fd, t_request_id, t_request_active && t_request_fd == fd};
+    return req;
+}
+
+ssize_t output_reply_to(const OutputRequest* req, const void* data, size_t len) {
+    pthread_mutex_lock(&g_write_lock);
+    OutputClient* c = client_find_locked(req->fd);
+    if (c && req->active) {
+        send_client_locked(c, FRAME_DATA, req->id, (const char*)data, len, NULL, 0);
+    } else if (c) {
+        send_client_locked(c, FRAME_EVENT, OUTPUT_CH_HOOK, (const char*)data, len, NULL, 0);
+    } else {
+        write_all(req->fd, (const char*)data, len);
+    }
+    pthread_mutex_unlock(&g_write_lock);
+    return (ssize_t)len;
+}
+
+ssize_t output_reply(int fd, const void* data, size_t len) {
+    OutputRequest req = output_request(fd);
+    return output_reply_to(&req, data, len);
+}
+
+void output_set_policy(OutputPolicy policy) {
+    __atomic_store_n(&g_policy, (int)policy, __ATOMIC_RELAXED);
+    for (int i = 1; i < OUTPUT_CH_COUNT; i++) {
+        __atomic_store_n(&g_channel_policy[i], (int)policy, __ATOMIC_RELAXED);
+    }
+}
+
+void output_set_channel_policy(OutputChannel channel, OutputPolicy policy) {
+    if (channel <= 0 || channel >= OUTPUT_CH_COUNT) return;
+    __atomic_store_n(&g_channel_policy[channel], (int)policy, __ATOMIC_RELAXED);
+}
+
+void output_set_channel_paused(OutputChannel channel, bool paused) {
+    if (channel <= 0 || channel >= OUTPUT_CH_COUNT) return;
+    __atomic_store_n(&g_channel_paused[channel], paused, __ATOMIC_RELAXED);
+}
+
+const char* output_channel_name(OutputChannel channel) {
+    if (channel <= 0 || channel >= OUTPUT_CH_COUNT) return "unknown";
+    return k_channel_names[channel];
+}
+
+bool output_channel_parse(const char* name, OutputChannel* out) {
+    for (int i = 1; i < OUTPUT_CH_COUNT; i++) {
+        if (strcmp(name, k_channel_names[i]) == 0) {
+            *out = (OutputChannel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void output_get_channel_stats(OutputChannel channel, OutputChannelStats* out) {
+    memset(out, 0, sizeof(*out));
+    if (channel <= 0 || channel >= OUTPUT_CH_COUNT) return;
+    out->queued = __atomic_load_n(&g_channel_queued[channel], __ATOMIC_RELAXED);
+    out->lost = __atomic_load_n(&g_channel_lost[channel], __ATOMIC_RELAXED);
+    out->paused = __atomic_load_n(&g_channel_paused[channel], __ATOMIC_RELAXED);
+    out->policy = (OutputPolicy)__atomic_load_n(&g_channel_policy[channel], __ATOMIC_RELAXED);
+}
+
+OutputPolicy output_get_policy(void) {
+    return (OutputPolicy)__atomic_load_n(&g_policy, __ATOMIC_RELAXED);
+}
+
+const char* output_policy_name(OutputPolicy policy) {
+    if ((int)policy < 0 || (int)policy > OUTPUT_BLOCK) return "unknown";
+    return k_policy_names[policy];
+}
+
+bool output_policy_parse(const char* name, OutputPolicy* out) {
+    for (int i = 0; i <= OUTPUT_BLOCK; i++) {
+        if (strcmp(name, k_policy_names[i]) == 0) {
+            *out = (OutputPolicy)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void output_get_stats(OutputStats* out) {
+    out->queued = __atomic_load_n(&g_queued, __ATOMIC_RELAXED);
+    out->written = __atomic_load_n(&g_written, __ATOMIC_RELAXED);
+    out->lost = __atomic_load_n(&g_lost, __ATOMIC_RELAXED);
+    out->blocked = __atomic_load_n(&g_blocked, __ATOMIC_RELAXED);
+    out->direct = __atomic_load_n(&g_direct, __ATOMIC_RELAXED);
+    out->rings = __atomic_load_n(&g_ring_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,301 @@
+#include <agent/rcu.h>
+#include <agent/globals.h>
+#include <agent/quiesce.h>
+#include <agent/stub_alloc.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+// One per thread that ever ran a handler; reused after the thread exits.
+// epoch is the global epoch seen when the outermost read section began,
+// 0 outside of one. call is the stub an original function is running
+// through, NULL outside of one.
+typedef struct RcuReader {
+    struct RcuReader* next;
+    uint64_t epoch;
+    const void* call;
+    int nesting;
+    bool in_use;
+} RcuReader;
+
+typedef struct RcuCallback {
+    struct RcuCallback* next;
+    void (*fn)(void* arg);
+    void* arg;
+    uint64_t epoch;             // readers that began at or before it may see the object
+} RcuCallback;
+
+static RcuReader* g_readers = NULL;
+static int g_reader_count = 0;
+static uint64_t g_epoch = 1;
+
+static pthread_key_t g_reader_key;
+static pthread_once_t g_reader_once = PTHREAD_ONCE_INIT;
+static __thread RcuReader* t_reader = NULL;
+
+// Threads registering their first read section: calloc and pthread_*
+// take them out of the entry code where a round would see them
+static int g_joining = 0;
+
+// Epoch taken by the last quiesce round that found no thread on its way
+// into a handler; 0 before the first one
+static uint64_t g_clear_epoch = 0;
+// Newest rcu_retire_stamp(), 0 if none; wants a round past it
+static uint64_t g_newest_stamp = 0;
+static uint64_t g_next_round_ns = 0;
+static uint64_t g_rounds = 0;
+static uint64_t g_busy_rounds = 0;
+
+extern const char __start_renef_rcu_entry[] __attribute__((weak, visibility("hidden")));
+extern const char __stop_renef_rcu_entry[] __attribute__((weak, visibility("hidden")));
+
+// FIFO: epochs are taken under the lock, so they only grow towards the tail
+static pthread_mutex_t g_defer_lock = PTHREAD_MUTEX_INITIALIZER;
+static RcuCallback* g_pending_head = NULL;
+static RcuCallback* g_pending_tail = NULL;
+static int g_pending_count = 0;
+static uint64_t g_deferred = 0;
+static uint64_t g_reclaimed = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void reader_release(void* arg) {
+    RcuReader* r = (RcuReader*)arg;
+    if (r) {
+        r->nesting = 0;
+        __atomic_store_n(&r->call, NULL, __ATOMIC_RELEASE);
+        __atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&r->in_use, false, __ATOMIC_RELEASE);
+    }
+}
+
+static void reader_init(void) {
+    pthread_key_create(&g_reader_key, reader_release);
+}
+
+static RcuReader* reader_join(void) {
+    pthread_once(&g_reader_once, reader_init);
+
+    RcuReader* r = __atomic_load_n(&g_readers, __ATOMIC_ACQUIRE);
+    for (; r; r = r->next) {
+        bool expected = false;
+        if (!__atomic_load_n(&r->in_use, __ATOMIC_RELAXED) &&
+            __atomic_compare_exchange_n(&r->in_use, &expected, true, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (!r) {
+        r = calloc(1, sizeof(RcuReader));
+        if (!r) return NULL;
+        r->in_use = true;
+        r->next = __atomic_load_n(&g_readers, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&g_readers, &r->next, r, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        __atomic_add_fetch(&g_reader_count, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_setspecific(g_reader_key, r);
+    t_reader = r;
+    return r;
+}
+
+RCU_ENTRY_TEXT void rcu_read_lock(void) {
+    RcuReader* r = t_reader;
+    bool joining = !r;
+    if (joining) {
+        __atomic_add_fetch(&g_joining, 1, __ATOMIC_SEQ_CST);
+        r = reader_join();
+    }
+    if (r && r->nesting++ == 0) {
+        // Published before any hook state is read (store-load ordering)
+        __atomic_store_n(&r->epoch, __atomic_load_n(&g_epoch, __ATOMIC_ACQUIRE), __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+    if (joining) {
+        __atomic_sub_fetch(&g_joining, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void rcu_read_unlock(void) {
+    RcuReader* r = t_reader;
+    if (!r || r->nesting == 0) return;
+    if (--r->nesting == 0) {
+        __atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void rcu_call_enter(const void* stub) {
+    RcuReader* r = t_reader;
+    // Seen by whoever sees the read section end
+    if (r) __atomic_store_n(&r->call, stub, __ATOMIC_SEQ_CST);
+}
+
+void rcu_call_exit(void) {
+    RcuReader* r = t_reader;
+    if (r) __atomic_store_n(&r->call, NULL, __ATOMIC_RELEASE);
+}
+
+bool rcu_in_call(const void* lo, const void* hi) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (RcuReader* r = __atomic_load_n(&g_readers, __ATOMIC_ACQUIRE); r; r = r->next) {
+        const char* call = __atomic_load_n(&r->call, __ATOMIC_ACQUIRE);
+        if (call && call >= (const char*)lo && call < (const char*)hi) return true;
+    }
+    return false;
+}
+
+void rcu_defer(void (*fn)(void* arg), void* arg) {
+    RcuCallback* cb = calloc(1, sizeof(RcuCallback));
+    if (!cb) {
+        // Leaking beats freeing under a reader
+        LOGE("rcu: out of memory, leaking a retired object");
+        return;
+    }
+    cb->fn = fn;
+    cb->arg = arg;
+
+    pthread_mutex_lock(&g_defer_lock);
+    cb->epoch = __atomic_fetch_add(&g_epoch, 1, __ATOMIC_SEQ_CST);
+    if (g_pending_tail) {
+        g_pending_tail->next = cb;
+    } else {
+        g_pending_head = cb;
+    }
+    g_pending_tail = cb;
+    g_pending_count++;
+    g_deferred++;
+    pthread_mutex_unlock(&g_defer_lock);
+}
+
+// Epoch of the oldest read section in progress, or UINT64_MAX.
+static uint64_t oldest_reader(int* active, int* calling) {
+    uint64_t oldest = UINT64_MAX;
+    int n = 0, c = 0;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (RcuReader* r = __atomic_load_n(&g_readers, __ATOMIC_ACQUIRE); r; r = r->next) {
+        if (__atomic_load_n(&r->call, __ATOMIC_RELAXED)) c++;
+        uint64_t e = __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE);
+        if (e == 0) continue;
+        n++;
+        if (e < oldest) oldest = e;
+    }
+    if (active) *active = n;
+    if (calling) *calling = c;
+    return oldest;
+}
+
+// Parks every other thread and looks for one on its way into a handler.
+// Nothing here may lock or allocate while they are parked.
+static void quiesce_round(void) {
+    uint64_t now = now_ns();
+    if (now < __atomic_load_n(&g_next_round_ns, __ATOMIC_RELAXED)) return;
+
+    if (threads_quiesce() < 0) {
+        // Without rounds nothing is ever reclaimed
+        __atomic_store_n(&g_next_round_ns, UINT64_MAX, __ATOMIC_RELAXED);
+        LOGE("rcu: cannot quiesce threads, retired hooks are kept");
+        return;
+    }
+    bool busy = threads_unparked() > 0 ||
+                __atomic_load_n(&g_joining, __ATOMIC_SEQ_CST) > 0 ||
+                threads_quiesced_in((uintptr_t)__start_renef_rcu_entry,
+                                    (uintptr_t)__stop_renef_rcu_entry) ||
+                stub_quiesced_in_any();
+    if (!busy) {
+        // Read sections begun before this are older than it
+        __atomic_store_n(&g_clear_epoch, __atomic_fetch_add(&g_epoch, 1, __ATOMIC_SEQ_CST),
+                         __ATOMIC_RELEASE);
+    }
+    threads_resume();
+
+    __atomic_add_fetch(&g_rounds, 1, __ATOMIC_RELAXED);
+    if (busy) {
+        __atomic_add_fetch(&g_busy_rounds, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&g_next_round_ns, now + (uint64_t)RCU_ROUND_RETRY_MS * 1000000ULL,
+                         __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t rcu_retire_stamp(void) {
+    uint64_t stamp = __atomic_fetch_add(&g_epoch, 1, __ATOMIC_SEQ_CST);
+    uint64_t newest = __atomic_load_n(&g_newest_stamp, __ATOMIC_RELAXED);
+    while (newest < stamp &&
+           !__atomic_compare_exchange_n(&g_newest_stamp, &newest, stamp, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    return stamp;
+}
+
+bool rcu_grace_over(uint64_t stamp) {
+    uint64_t clear = __atomic_load_n(&g_clear_epoch, __ATOMIC_ACQUIRE);
+    return stamp < clear && clear < oldest_reader(NULL, NULL);
+}
+
+int rcu_poll(void) {
+    RcuCallback* head = __atomic_load_n(&g_pending_head, __ATOMIC_ACQUIRE);
+    uint64_t newest = __atomic_load_n(&g_newest_stamp, __ATOMIC_ACQUIRE);
+    if (!head && (newest == 0 || newest < __atomic_load_n(&g_clear_epoch, __ATOMIC_ACQUIRE))) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_defer_lock);
+    if (g_pending_tail && g_pending_tail->epoch > newest) newest = g_pending_tail->epoch;
+    pthread_mutex_unlock(&g_defer_lock);
+    if (newest >= __atomic_load_n(&g_clear_epoch, __ATOMIC_ACQUIRE)) {
+        quiesce_round();
+    }
+    if (!head) return 0;
+
+    uint64_t clear = __atomic_load_n(&g_clear_epoch, __ATOMIC_ACQUIRE);
+    if (clear >= oldest_reader(NULL, NULL)) {
+        return 0;
+    }
+
+    RcuCallback* ready = NULL;
+    RcuCallback** ready_tail = &ready;
+    pthread_mutex_lock(&g_defer_lock);
+    while (g_pending_head && g_pending_head->epoch < clear) {
+        RcuCallback* cb = g_pending_head;
+        g_pending_head = cb->next;
+        if (!g_pending_head) g_pending_tail = NULL;
+        g_pending_count--;
+        cb->next = NULL;
+        *ready_tail = cb;
+        ready_tail = &cb->next;
+    }
+    pthread_mutex_unlock(&g_defer_lock);
+
+    int count = 0;
+    while (ready) {
+        RcuCallback* cb = ready;
+        ready = cb->next;
+        cb->fn(cb->arg);
+        free(cb);
+        count++;
+    }
+    if (count > 0) {
+        __atomic_add_fetch(&g_reclaimed, count, __ATOMIC_RELAXED);
+    }
+    return count;
+}
+
+void rcu_get_stats(RcuStats* out) {
+    out->readers = __atomic_load_n(&g_reader_count, __ATOMIC_RELAXED);
+    oldest_reader(&out->active, &out->calling);
+    out->epoch = __atomic_load_n(&g_epoch, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&g_defer_lock);
+    out->pending = g_pending_count;
+    out->deferred = g_deferred;
+    pthread_mutex_unlock(&g_defer_lock);
+    out->reclaimed = __atomic_load_n(&g_reclaimed, __ATOMIC_RELAXED);
+    out->rounds = __atomic_load_n(&g_rounds, __ATOMIC_RELAXED);
+    out->busy_rounds = __atomic_load_n(&g_busy_rounds, __ATOMIC_RELAXED);
+}
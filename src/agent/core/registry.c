@@ -1,5 +1,6 @@
 #include <agent/cmd_registry.h>
 #include <agent/globals.h>
+#include <agent/output.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -8,12 +9,14 @@ struct cmd_entry {
     char name[CMD_MAX_NAME_LEN];
     size_t name_len;
     cmd_handler_t handler;
+    cmd_raw_handler_t raw_handler;
+    int flags;
 };
 
 static struct cmd_entry g_commands[CMD_MAX_COMMANDS];
 static int g_cmd_count = 0;
 
-void cmd_register(const char* name, cmd_handler_t handler) {
+static void cmd_add(const char* name, cmd_handler_t handler, cmd_raw_handler_t raw_handler, int flags) {
     if (g_cmd_count >= CMD_MAX_COMMANDS) {
         LOGE("Command registry full");
         return;
@@ -23,22 +26,59 @@ void cmd_register(const char* name, cmd_handler_t handler) {
     g_commands[g_cmd_count].name[CMD_MAX_NAME_LEN - 1] = '\0';
     g_commands[g_cmd_count].name_len = strlen(name);
     g_commands[g_cmd_count].handler = handler;
+    g_commands[g_cmd_count].raw_handler = raw_handler;
+    g_commands[g_cmd_count].flags = flags;
     g_cmd_count++;
 
     LOGI("Registered command: %s", name);
 }
 
-int cmd_dispatch(int fd, const char* cmd) {
-    for (int i = 0; i < g_cmd_count; i++) {
-        size_t len = g_commands[i].name_len;
+void cmd_register(const char* name, cmd_handler_t handler) {
+    cmd_add(name, handler, NULL, 0);
+}
 
-        if (strncmp(cmd, g_commands[i].name, len) == 0) {
-            const char* args = cmd + len;
-            while (*args == ' ') args++;
-            return g_commands[i].handler(fd, args);
+void cmd_register_flags(const char* name, cmd_handler_t handler, int flags) {
+    cmd_add(name, handler, NULL, flags);
+}
+
+void cmd_register_raw(const char* name, cmd_raw_handler_t handler, int flags) {
+    cmd_add(name, NULL, handler, flags | CMD_F_RAW);
+}
+
+static const struct cmd_entry* cmd_find(const char* cmd) {
+    for (int i = 0; i < g_cmd_count; i++) {
+        if (strncmp(cmd, g_commands[i].name, g_commands[i].name_len) == 0) {
+            return &g_commands[i];
         }
     }
-    return 0;
+    return NULL;
+}
+
+int cmd_dispatch(int fd, const char* cmd) {
+    const struct cmd_entry* entry = cmd_find(cmd);
+    if (!entry) return 0;
+
+    const char* args = cmd + entry->name_len;
+    while (*args == ' ') args++;
+    if (entry->raw_handler) {
+        return entry->raw_handler(fd, args, strlen(args));
+    }
+    return entry->handler(fd, args);
+}
+
+int cmd_dispatch_raw(int fd, const char* cmd, size_t len) {
+    const struct cmd_entry* entry = cmd_find(cmd);
+    if (!entry) return 0;
+    if (!entry->raw_handler) return cmd_dispatch(fd, cmd);
+
+    size_t skip = entry->name_len;
+    while (skip < len && cmd[skip] == ' ') skip++;
+    return entry->raw_handler(fd, cmd + skip, len - skip);
+}
+
+int cmd_flags(const char* cmd) {
+    const struct cmd_entry* entry = cmd_find(cmd);
+    return entry ? entry->flags : -1;
 }
 
 void cmd_list(int fd) {
@@ -51,5 +91,5 @@ void cmd_list(int fd) {
         offset += snprintf(buf + offset, sizeof(buf) - offset, "  %s\n", g_commands[i].name);
     }
 
-    write(fd, buf, offset);
+    output_reply(fd, buf, offset);
 }
@@ -0,0 +1,208 @@
+#include <agent/trace.h>
+#include <agent/output.h>
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+typedef struct {
+    uint64_t ts_ns;
+    const char* fmt;
+    int nargs;
+    uint64_t args[TRACE_MAX_ARGS];
+} TraceRecord;
+
+// Single producer (owning thread), single consumer (flusher thread).
+typedef struct TraceBuffer {
+    struct TraceBuffer* next;
+    uint32_t head;
+    uint32_t tail;
+    int tid;
+    bool dead;
+    TraceRecord records[TRACE_RING_SIZE];
+} TraceBuffer;
+
+static TraceBuffer* g_trace_buffers = NULL;
+static bool g_trace_deferred = true;
+static uint64_t g_trace_recorded = 0;
+static uint64_t g_trace_dropped = 0;
+
+static pthread_key_t g_trace_key;
+static pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+
+static __thread TraceBuffer* t_trace_buf = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int count_conversions(const char* fmt) {
+    int n = 0;
+    for (const char* p = fmt; *p; p++) {
+        if (*p != '%') continue;
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+        n++;
+    }
+    return n > TRACE_MAX_ARGS ? TRACE_MAX_ARGS : n;
+}
+
+static void output_record(int tid, const TraceRecord* rec) {
+    char msg[384];
+    char line[448];
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-nonliteral"
+    snprintf(msg, sizeof(msg), rec->fmt,
+             rec->args[0], rec->args[1], rec->args[2],
+             rec->args[3], rec->args[4], rec->args[5]);
+#pragma clang diagnostic pop
+
+    int len = snprintf(line, sizeof(line), "[TRC] [%d] %llu.%06llu %s\n", tid,
+                       (unsigned long long)(rec->ts_ns / 1000000000ULL),
+                       (unsigned long long)(rec->ts_ns % 1000000000ULL / 1000),
+                       msg);
+    if (len < 0) return;
+    if ((size_t)len >= sizeof(line)) {
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "%.*s", len - 1, line);
+    output_write_to(OUTPUT_CH_LOG, line, (size_t)len - 1);
+}
+
+static void drain_buffer(TraceBuffer* buf) {
+    uint32_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = buf->tail;
+
+    while (tail != head) {
+        output_record(buf->tid, &buf->records[tail % TRACE_RING_SIZE]);
+        tail++;
+    }
+    __atomic_store_n(&buf->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void* flusher_thread(void* arg) {
+    (void)arg;
+
+    while (1) {
+        usleep(20000);
+
+        TraceBuffer* prev = NULL;
+        TraceBuffer* buf = __atomic_load_n(&g_trace_buffers, __ATOMIC_ACQUIRE);
+        while (buf) {
+            drain_buffer(buf);
+            TraceBuffer* next = buf->next;
+
+            // Producers only ever swap the list head, so any other dead
+            // node can be unlinked here without racing them.
+            if (prev && __atomic_load_n(&buf->dead, __ATOMIC_ACQUIRE)) {
+                prev->next = next;
+                free(buf);
+            } else {
+                prev = buf;
+            }
+            buf = next;
+        }
+    }
+    return NULL;
+}
+
+static void buffer_release(void* arg) {
+    TraceBuffer* buf = (TraceBuffer*)arg;
+    if (buf) {
+        __atomic_store_n(&buf->dead, true, __ATOMIC_RELEASE);
+    }
+}
+
+static void trace_init(void) {
+    pthread_key_create(&g_trace_key, buffer_release);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, flusher_thread, NULL) == 0) {
+        pthread_detach(tid);
+    } else {
+        LOGE("trace: failed to start flusher thread, formatting inline");
+        g_trace_deferred = false;
+    }
+}
+
+static TraceBuffer* buffer_get(void) {
+    if (t_trace_buf) {
+        return t_trace_buf;
+    }
+
+    TraceBuffer* buf = calloc(1, sizeof(TraceBuffer));
+    if (!buf) return NULL;
+    buf->tid = (int)syscall(SYS_gettid);
+
+    buf->next = __atomic_load_n(&g_trace_buffers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&g_trace_buffers, &buf->next, buf, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+
+    pthread_setspecific(g_trace_key, buf);
+    t_trace_buf = buf;
+    return buf;
+}
+
+void trace_emit(const char* fmt, ...) {
+    pthread_once(&g_trace_once, trace_init);
+
+    TraceRecord rec;
+    rec.ts_ns = now_ns();
+    rec.fmt = fmt;
+    rec.nargs = count_conversions(fmt);
+
+    va_list ap;
+    va_start(ap, fmt);
+    for (int i = 0; i < TRACE_MAX_ARGS; i++) {
+        rec.args[i] = i < rec.nargs ? va_arg(ap, uint64_t) : 0;
+    }
+    va_end(ap);
+
+    __atomic_add_fetch(&g_trace_recorded, 1, __ATOMIC_RELAXED);
+
+    if (!__atomic_load_n(&g_trace_deferred, __ATOMIC_RELAXED)) {
+        output_record((int)syscall(SYS_gettid), &rec);
+        return;
+    }
+
+    TraceBuffer* buf = buffer_get();
+    if (!buf) {
+        __atomic_add_fetch(&g_trace_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint32_t head = buf->head;
+    if (head - __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE) {
+        __atomic_add_fetch(&g_trace_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    buf->records[head % TRACE_RING_SIZE] = rec;
+    __atomic_store_n(&buf->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_set_deferred(bool deferred) {
+    __atomic_store_n(&g_trace_deferred, deferred, __ATOMIC_RELAXED);
+}
+
+bool trace_is_deferred(void) {
+    return __atomic_load_n(&g_trace_deferred, __ATOMIC_RELAXED);
+}
+
+void trace_get_stats(uint64_t* recorded, uint64_t* dropped) {
+    if (recorded) *recorded = __atomic_load_n(&g_trace_recorded, __ATOMIC_RELAXED);
+    if (dropped) *dropped = __atomic_load_n(&g_trace_dropped, __ATOMIC_RELAXED);
+}
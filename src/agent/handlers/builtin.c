@@ -3,6 +3,12 @@
 #include <agent/hook.h>
 #include <agent/proc.h>
 #include <agent/handlers.h>
+#include <agent/lua_dispatch.h>
+#include <agent/trace.h>
+#include <agent/output.h>
+#include <agent/stub_alloc.h>
+#include <agent/rcu.h>
+#include <agent/linker_watch.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,7 +17,7 @@
 static int cmd_ping(int fd, const char* args) {
     (void)args;
     const char* pong = "pong\n";
-    write(fd, pong, strlen(pong));
+    output_reply(fd, pong, strlen(pong));
     return 1;
 }
 
@@ -33,8 +39,8 @@ static int cmd_list_apps(int fd, const char* args) {
                     len--;
                 }
                 if (filter == NULL || strstr(pkg_name, filter) != NULL) {
-                    write(fd, pkg_name, len);
-                    write(fd, "\n", 1);
+                    output_reply(fd, pkg_name, len);
+                    output_reply(fd, "\n", 1);
                 }
             }
         }
@@ -45,18 +51,103 @@ static int cmd_list_apps(int fd, const char* args) {
 
 static int cmd_hooks(int fd, const char* args) {
     (void)args;
-    char response[1024];
-    int len = snprintf(response, sizeof(response), "Active hooks: %d\n", g_hook_count);
-    for (int i = 0; i < g_hook_count; i++) {
-        if (g_hooks[i].data.trampoline.target_addr != NULL) {
+    char response[4096];
+    size_t len = snprintf(response, sizeof(response), "Active hooks: %d\n", hook_active_count());
+    int limit = hook_id_limit();
+    for (int i = 0; i < limit && len < sizeof(response); i++) {
+        HookInfo* hook = hook_get(i);
+        if (!hook) continue;
+        if (hook->type == HOOK_PLT_GOT) {
             len += snprintf(response + len, sizeof(response) - len,
-                "  [%d] target=%p\n", i, g_hooks[i].data.trampoline.target_addr);
+                "  [%d] plt/got entries=%d\n", i, hook->data.plt_got.patched_count);
         } else {
             len += snprintf(response + len, sizeof(response) - len,
-                "  [%d] (removed)\n", i);
+                "  [%d] target=%p\n", i, hook->data.trampoline.target_addr);
         }
     }
-    write(fd, response, len);
+
+    DispatchStats st;
+    lua_dispatch_get_stats(DISPATCH_NATIVE, &st);
+    if (len < sizeof(response)) {
+        len += snprintf(response + len, sizeof(response) - len,
+            "Lua dispatch (%d thread state(s)):\n", st.worker_states);
+    }
+    for (int s = 0; s < DISPATCH_SOURCE_COUNT && len < sizeof(response); s++) {
+        lua_dispatch_get_stats((DispatchSource)s, &st);
+        len += snprintf(response + len, sizeof(response) - len,
+            "  %-6s sync=%llu parallel=%llu lock_waits=%llu wait_avg=%lluus wait_max=%lluus"
+            " | async=%llu dropped=%llu depth=%d max=%d wait_avg=%lluus wait_max=%lluus\n",
+            lua_dispatch_source_name((DispatchSource)s),
+            (unsigned long long)st.sync_calls,
+            (unsigned long long)st.parallel_calls,
+            (unsigned long long)st.lock_waits,
+            (unsigned long long)(st.lock_waits ? st.lock_wait_ns / st.lock_waits / 1000 : 0),
+            (unsigned long long)(st.lock_wait_max_ns / 1000),
+            (unsigned long long)st.async_posted,
+            (unsigned long long)st.async_dropped,
+            st.async_depth, st.async_depth_max,
+            (unsigned long long)(st.async_posted ? st.async_wait_ns / st.async_posted / 1000 : 0),
+            (unsigned long long)(st.async_wait_max_ns / 1000));
+    }
+
+    OutputStats os;
+    output_get_stats(&os);
+    if (len < sizeof(response)) {
+        len += snprintf(response + len, sizeof(response) - len,
+            "Output (%s, %d thread ring(s)): queued=%llu written=%llu lost=%llu blocked=%llu direct=%llu\n",
+            output_policy_name(output_get_policy()), os.rings,
+            (unsigned long long)os.queued,
+            (unsigned long long)os.written,
+            (unsigned long long)os.lost,
+            (unsigned long long)os.blocked,
+            (unsigned long long)os.direct);
+    }
+    for (int ch = 1; ch < OUTPUT_CH_COUNT && len < sizeof(response); ch++) {
+        OutputChannelStats cs;
+        output_get_channel_stats((OutputChannel)ch, &cs);
+        len += snprintf(response + len, sizeof(response) - len,
+            "  %-6s %s%s queued=%llu lost=%llu\n",
+            output_channel_name((OutputChannel)ch), output_policy_name(cs.policy),
+            cs.paused ? " paused" : "",
+            (unsigned long long)cs.queued,
+            (unsigned long long)cs.lost);
+    }
+
+    StubStats ss;
+    stub_get_stats(&ss);
+    if (len < sizeof(response)) {
+        len += snprintf(response + len, sizeof(response) - len,
+            "Stubs (%s): slabs=%d near=%d live=%d parked=%d used=%zu/%zu allocs=%llu reused=%llu reclaimed=%llu near_hits=%llu near_misses=%llu\n",
+            ss.dual_mapped ? "W^X" : ss.slabs ? "RWX" : "none",
+            ss.slabs, ss.near_slabs, ss.live, ss.parked, ss.used_bytes, ss.mapped_bytes,
+            (unsigned long long)ss.allocs,
+            (unsigned long long)ss.reused,
+            (unsigned long long)ss.reclaimed,
+            (unsigned long long)ss.near_hits,
+            (unsigned long long)ss.near_misses);
+    }
+
+    RcuStats rs;
+    rcu_get_stats(&rs);
+    if (len < sizeof(response)) {
+        len += snprintf(response + len, sizeof(response) - len,
+            "Reclaim: readers=%d active=%d calling=%d pending=%d deferred=%llu reclaimed=%llu rounds=%llu busy=%llu\n",
+            rs.readers, rs.active, rs.calling, rs.pending,
+            (unsigned long long)rs.deferred,
+            (unsigned long long)rs.reclaimed,
+            (unsigned long long)rs.rounds,
+            (unsigned long long)rs.busy_rounds);
+    }
+
+    static const char* watch_names[] = {"none", "constructors", "dlopen"};
+    if (len < sizeof(response)) {
+        len += snprintf(response + len, sizeof(response) - len,
+            "Deferred: pending=%d watch=%s\n",
+            pending_hook_count(), watch_names[linker_watch_mode()]);
+    }
+
+    if (len > sizeof(response)) len = sizeof(response) - 1;
+    output_reply(fd, response, len);
     return 1;
 }
 
@@ -65,16 +156,16 @@ static int cmd_unhook(int fd, const char* args) {
         int count = uninstall_all_hooks();
         char response[128];
         snprintf(response, sizeof(response), "Removed %d hook(s)\n", count);
-        write(fd, response, strlen(response));
+        output_reply(fd, response, strlen(response));
     } else {
         int hook_id = atoi(args);
         if (uninstall_hook(hook_id) == 0) {
             char response[128];
             snprintf(response, sizeof(response), "Hook %d removed\n", hook_id);
-            write(fd, response, strlen(response));
+            output_reply(fd, response, strlen(response));
         } else {
             const char* error = "ERROR: Failed to remove hook\n";
-            write(fd, error, strlen(error));
+            output_reply(fd, error, strlen(error));
         }
     }
     return 1;
@@ -85,6 +176,11 @@ static int cmd_hook(int fd, const char* args) {
     return 1;
 }
 
+static int cmd_hook_batch(int fd, const char* args) {
+    handle_inspect_batch(fd, args);
+    return 1;
+}
+
 static int cmd_eval(int fd, const char* args) {
     handle_eval(fd, args);
     return 1;
@@ -95,11 +191,51 @@ static int cmd_memscan(int fd, const char* args) {
     return 1;
 }
 
+static int cmd_memscan_page(int fd, const char* args) {
+    handle_memscan_page(fd, args);
+    return 1;
+}
+
+static int cmd_valscan(int fd, const char* args) {
+    handle_valscan(fd, args);
+    return 1;
+}
+
 static int cmd_memdump(int fd, const char* args) {
     handle_memdump(fd, args);
     return 1;
 }
 
+static int cmd_memdump_stream(int fd, const char* args) {
+    handle_memdump_stream(fd, args);
+    return 1;
+}
+
+static int cmd_module_dump(int fd, const char* args) {
+    handle_module_dump(fd, args);
+    return 1;
+}
+
+static int cmd_mem_read(int fd, const char* args) {
+    handle_mem_read(fd, args);
+    return 1;
+}
+
+static int cmd_mem_readv(int fd, const char* args) {
+    handle_mem_readv(fd, args);
+    return 1;
+}
+
+static int cmd_mem_write(int fd, const char* args, size_t len) {
+    handle_mem_write(fd, args, len);
+    return 1;
+}
+
+static int cmd_syms(int fd, const char* args) {
+    handle_syms(fd, args);
+    return 1;
+}
+
 static int cmd_sec(int fd, const char* args) {
     char* lib_path = find_library_path(args);
     if (lib_path) {
@@ -108,7 +244,7 @@ static int cmd_sec(int fd, const char* args) {
     } else {
         char err[256];
         snprintf(err, sizeof(err), "ERROR: Library '%s' not found in process\n", args);
-        write(fd, err, strlen(err));
+        output_reply(fd, err, strlen(err));
     }
     return 1;
 }
@@ -121,33 +257,117 @@ static int cmd_help(int fd, const char* args) {
 
 static int cmd_verbose(int fd, const char* args) {
     if (!args || !*args) {
-        char response[64];
-        snprintf(response, sizeof(response), "verbose: %s\n", g_verbose_mode ? "on" : "off");
-        write(fd, response, strlen(response));
+        static const char* level_names[] = {"off", "on", "trace"};
+        uint64_t recorded = 0, dropped = 0;
+        trace_get_stats(&recorded, &dropped);
+
+        char response[160];
+        snprintf(response, sizeof(response),
+                 "verbose: %s (trace %s, %llu recorded, %llu dropped)\n",
+                 level_names[g_log_level],
+                 trace_is_deferred() ? "deferred" : "sync",
+                 (unsigned long long)recorded, (unsigned long long)dropped);
+        output_reply(fd, response, strlen(response));
         return 1;
     }
 
     if (strcmp(args, "on") == 0 || strcmp(args, "1") == 0) {
-        g_verbose_mode = true;
+        g_log_level = LOG_LEVEL_DEBUG;
         const char* msg = "verbose: enabled\n";
-        write(fd, msg, strlen(msg));
+        output_reply(fd, msg, strlen(msg));
         LOGI("Verbose mode enabled");
+    } else if (strncmp(args, "trace", 5) == 0) {
+        // Per-call hook tracing; formatted on a background thread unless "sync"
+        trace_set_deferred(strstr(args + 5, "sync") == NULL);
+        g_log_level = LOG_LEVEL_TRACE;
+        const char* msg = trace_is_deferred() ? "verbose: trace (deferred)\n"
+                                              : "verbose: trace (sync)\n";
+        output_reply(fd, msg, strlen(msg));
+        LOGI("Trace mode enabled");
     } else if (strcmp(args, "off") == 0 || strcmp(args, "0") == 0) {
-        g_verbose_mode = false;
+        g_log_level = LOG_LEVEL_OFF;
         const char* msg = "verbose: disabled\n";
-        write(fd, msg, strlen(msg));
+        output_reply(fd, msg, strlen(msg));
         LOGI("Verbose mode disabled");
     } else {
-        const char* err = "Usage: verbose [on|off]\n";
-        write(fd, err, strlen(err));
+        const char* err = "Usage: verbose [on|off|trace [sync]]\n";
+        output_reply(fd, err, strlen(err));
+    }
+    return 1;
+}
+
+// output [<channel>] [<policy>|pause|resume]
+static int cmd_output(int fd, const char* args) {
+    static const char* usage =
+        "Usage: output [hook|strace|log] [drop-newest|drop-oldest|block|pause|resume]\n";
+    char word[32] = {0};
+    char action[32] = {0};
+    OutputChannel channel = (OutputChannel)0;   // 0 = every channel
+    OutputPolicy policy;
+
+    if (args && *args) {
+        sscanf(args, "%31s %31s", word, action);
+        if (!output_channel_parse(word, &channel)) {
+            strcpy(action, word);
+        }
+    }
+
+    if (action[0]) {
+        if (strcmp(action, "pause") == 0 || strcmp(action, "resume") == 0) {
+            bool paused = action[0] == 'p';
+            for (OutputChannel ch = OUTPUT_CH_HOOK; ch < OUTPUT_CH_COUNT; ch++) {
+                if (channel == 0 || channel == ch) output_set_channel_paused(ch, paused);
+            }
+        } else if (output_policy_parse(action, &policy)) {
+            if (channel == 0) output_set_policy(policy);
+            else output_set_channel_policy(channel, policy);
+        } else {
+            output_reply(fd, usage, strlen(usage));
+            return 1;
+        }
+        LOGI("Output %s: %s", channel ? output_channel_name(channel) : "all", action);
+    }
+
+    char response[256];
+    size_t len = 0;
+    for (OutputChannel ch = OUTPUT_CH_HOOK; ch < OUTPUT_CH_COUNT; ch++) {
+        if (channel != 0 && channel != ch) continue;
+        OutputChannelStats cs;
+        output_get_channel_stats(ch, &cs);
+        len += snprintf(response + len, sizeof(response) - len, "output %s: %s%s\n",
+                        output_channel_name(ch), output_policy_name(cs.policy),
+                        cs.paused ? " (paused)" : "");
+        if (len >= sizeof(response)) len = sizeof(response) - 1;
     }
+    output_reply(fd, response, len);
+    return 1;
+}
+
+static int cmd_persist(int fd, const char* args) {
+    if (args && *args) {
+        if (strcmp(args, "on") == 0) {
+            g_keep_hooks = true;
+        } else if (strcmp(args, "off") == 0) {
+            g_keep_hooks = false;
+        } else {
+            const char* err = "Usage: persist [on|off]\n";
+            output_reply(fd, err, strlen(err));
+            return 1;
+        }
+        LOGI("Hooks %s client disconnects", g_keep_hooks ? "survive" : "are removed on");
+    }
+
+    char response[128];
+    snprintf(response, sizeof(response), "persist: %s (%d client(s) connected)\n",
+             g_keep_hooks ? "on" : "off", output_client_count());
+    output_reply(fd, response, strlen(response));
     return 1;
 }
 
 static int cmd_hexexec(int fd, const char* args) {
     if (!args || !*args) {
         const char* err = "ERROR: hexexec requires hex-encoded Lua code\n";
-        write(fd, err, strlen(err));
+        output_reply(fd, err, strlen(err));
         return 1;
     }
 
@@ -156,7 +376,7 @@ static int cmd_hexexec(int fd, const char* args) {
     char* lua_code = (char*)malloc(lua_len + 1);
     if (!lua_code) {
         const char* err = "ERROR: malloc failed\n";
-        write(fd, err, strlen(err));
+        output_reply(fd, err, strlen(err));
         return 1;
     }
 
@@ -172,16 +392,27 @@ static int cmd_hexexec(int fd, const char* args) {
 }
 
 void register_builtin_commands(void) {
-    cmd_register("ping", cmd_ping);
-    cmd_register("la", cmd_list_apps);
+    cmd_register_flags("ping", cmd_ping, CMD_F_CONCURRENT);
+    cmd_register_flags("la", cmd_list_apps, CMD_F_CONCURRENT);
     cmd_register("hooks", cmd_hooks);
     cmd_register("unhook", cmd_unhook);
     cmd_register("hookn", cmd_hook);
+    cmd_register("hookm", cmd_hook_batch);
     cmd_register("exec", cmd_eval);
     cmd_register("hexexec", cmd_hexexec);
+    cmd_register("msp", cmd_memscan_page);     // before "ms", names are prefix-matched
+    cmd_register_flags("msv", cmd_valscan, CMD_F_CONCURRENT);
     cmd_register("ms", cmd_memscan);
+    cmd_register_flags("mdump", cmd_memdump_stream, CMD_F_CONCURRENT);  // before "md"
+    cmd_register_flags("dumpmod", cmd_module_dump, CMD_F_CONCURRENT);
     cmd_register("md", cmd_memdump);
-    cmd_register("sec", cmd_sec);
-    cmd_register("help", cmd_help);
+    cmd_register_flags("mrv", cmd_mem_readv, CMD_F_CONCURRENT);  // before "mr"
+    cmd_register_flags("mr", cmd_mem_read, CMD_F_CONCURRENT);
+    cmd_register_raw("mw", cmd_mem_write, 0);
+    cmd_register_flags("sec", cmd_sec, CMD_F_CONCURRENT);
+    cmd_register_flags("syms", cmd_syms, CMD_F_CONCURRENT);
+    cmd_register_flags("help", cmd_help, CMD_F_CONCURRENT);
     cmd_register("verbose", cmd_verbose);
+    cmd_register_flags("output", cmd_output, CMD_F_CONCURRENT);
+    cmd_register("persist", cmd_persist);
 }
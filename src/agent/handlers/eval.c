@@ -1,5 +1,7 @@
 #include <agent/handlers.h>
 #include <agent/globals.h>
+#include <agent/lua_dispatch.h>
+#include <agent/output.h>
 
 #include <string.h>
 #include <unistd.h>
@@ -9,16 +11,16 @@ void handle_eval(int client_fd, const char* lua_code) {
 
     if (!g_lua_engine) {
         const char* error = "ERROR: Lua engine not initialized\n";
-        write(client_fd, error, strlen(error));
+        output_reply(client_fd, error, strlen(error));
         return;
     }
 
-    bool success = lua_engine_load_script(g_lua_engine, lua_code);
-    if (success) {
+    // Hooks on other threads share this state; runs under the dispatch lock
+    if (lua_dispatch_exec(lua_code)) {
         const char* ok = "OK\n";
-        write(client_fd, ok, strlen(ok));
+        output_reply(client_fd, ok, strlen(ok));
     } else {
         const char* error = "ERROR: Lua execution failed\n";
-        write(client_fd, error, strlen(error));
+        output_reply(client_fd, error, strlen(error));
     }
 }
@@ -2,10 +2,13 @@
 #include <agent/globals.h>
 #include <agent/hook.h>
 #include <agent/proc.h>
+#include <agent/output.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <lauxlib.h>
 
 void handle_inspect_binary(int client_fd, const char* args) {
     char lib_name[128];
@@ -14,7 +17,7 @@ void handle_inspect_binary(int client_fd, const char* args) {
     if (sscanf(args, "%127s 0x%llx", lib_name, (unsigned long long*)&offset) != 2 &&
         sscanf(args, "%127s %llu", lib_name, (unsigned long long*)&offset) != 2) {
         const char* error = "ERROR: Usage: inspect_binary <lib_name> <offset>\n";
-        write(client_fd, error, strlen(error));
+        output_reply(client_fd, error, strlen(error));
         return;
     }
 
@@ -23,34 +26,122 @@ void handle_inspect_binary(int client_fd, const char* args) {
     void* base_addr = find_library_base(lib_name);
     if (!base_addr) {
         const char* error = "ERROR: Library not found in process\n";
-        write(client_fd, error, strlen(error));
+        output_reply(client_fd, error, strlen(error));
         return;
     }
 
     void* target_func = (void*)((uintptr_t)base_addr + offset);
     verbose_log("Target function: %p", target_func);
 
-    if (g_hook_count >= MAX_HOOKS) {
+    int hook_id;
+    HookInfo* hook_info = hook_alloc(&hook_id);
+    if (!hook_info) {
         const char* error = "ERROR: Maximum hooks reached\n";
-        write(client_fd, error, strlen(error));
+        output_reply(client_fd, error, strlen(error));
         return;
     }
 
-    HookInfo* hook_info = &g_hooks[g_hook_count];
-
     if (install_trampoline_hook(target_func, (void*)generic_hook_handler, hook_info) != 0) {
         const char* error = "ERROR: Failed to install hook\n";
-        write(client_fd, error, strlen(error));
+        output_reply(client_fd, error, strlen(error));
+        uninstall_hook(hook_id);
         return;
     }
 
-    g_hook_count++;
-
     char response[256];
     snprintf(response, sizeof(response),
              "{\"success\":true,\"lib\":\"%s\",\"offset\":\"0x%llx\",\"addr\":\"%p\",\"hook_id\":%d}\n",
-             lib_name, (unsigned long long)offset, target_func, g_hook_count - 1);
-    write(client_fd, response, strlen(response));
+             lib_name, (unsigned long long)offset, target_func, hook_id);
+    output_reply(client_fd, response, strlen(response));
+
+    verbose_log("Hook installed (total: %d)", hook_active_count());
+}
+
+// hookm <lib_name> <offset> [offset ...] [quiesce]
+void handle_inspect_batch(int client_fd, const char* args) {
+    char lib_name[128];
+    int consumed = 0;
+    if (sscanf(args, "%127s%n", lib_name, &consumed) != 1) {
+        const char* error = "ERROR: Usage: hookm <lib_name> <offset> [offset ...] [quiesce]\n";
+        output_reply(client_fd, error, strlen(error));
+        return;
+    }
+
+    void* base_addr = find_library_base(lib_name);
+    if (!base_addr) {
+        const char* error = "ERROR: Library not found in process\n";
+        output_reply(client_fd, error, strlen(error));
+        return;
+    }
+
+    HookBatchEntry* entries = NULL;
+    int count = 0;
+    int cap = 0;
+    int flags = 0;
+    const char* p = args + consumed;
+    char token[64];
+    int len;
+    while (sscanf(p, "%63s%n", token, &len) == 1) {
+        p += len;
+        if (strcmp(token, "quiesce") == 0) {
+            flags |= HOOK_BATCH_QUIESCE;
+            continue;
+        }
+        char* end;
+        unsigned long long offset = strtoull(token, &end, 0);
+        if (*end != '\0') {
+            char error[128];
+            snprintf(error, sizeof(error), "ERROR: Invalid offset: %s\n", token);
+            output_reply(client_fd, error, strlen(error));
+            free(entries);
+            return;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            HookBatchEntry* grown = realloc(entries, (size_t)cap * sizeof(HookBatchEntry));
+            if (!grown) {
+                const char* error = "ERROR: Out of memory\n";
+                output_reply(client_fd, error, strlen(error));
+                free(entries);
+                return;
+            }
+            entries = grown;
+        }
+        entries[count++] = (HookBatchEntry){
+            .target = (void*)((uintptr_t)base_addr + offset),
+            .onEnter_ref = LUA_NOREF,
+            .onLeave_ref = LUA_NOREF,
+            .hook_id = -1,
+        };
+    }
+
+    if (count == 0) {
+        const char* error = "ERROR: No offsets given\n";
+        output_reply(client_fd, error, strlen(error));
+        return;
+    }
+
+    if (install_hook_batch(entries, count, flags) < 0) {
+        const char* error = "ERROR: Failed to install hooks, none installed\n";
+        output_reply(client_fd, error, strlen(error));
+        free(entries);
+        return;
+    }
+
+    size_t size = 128 + strlen(lib_name) + (size_t)count * 12;
+    char* response = malloc(size);
+    if (response) {
+        size_t off = (size_t)snprintf(response, size,
+                                      "{\"success\":true,\"lib\":\"%s\",\"count\":%d,\"hook_ids\":[",
+                                      lib_name, count);
+        for (int i = 0; i < count; i++) {
+            off += (size_t)snprintf(response + off, size - off, "%s%d", i ? "," : "", entries[i].hook_id);
+        }
+        off += (size_t)snprintf(response + off, size - off, "]}\n");
+        output_reply(client_fd, response, off);
+        free(response);
+    }
+    free(entries);
 
-    verbose_log("Hook installed (total: %d)", g_hook_count);
+    verbose_log("Batch of %d hooks installed (total: %d)", count, hook_active_count());
 }
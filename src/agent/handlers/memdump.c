@@ -1,77 +1,385 @@
 #include <agent/handlers.h>
+#include <agent/output.h>
+#include <agent/dump.h>
+#include <agent/lz4.h>
+#include <agent/maps.h>
+#include <elf.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
-#include <signal.h>
-#include <setjmp.h>
+#include <stdio.h>
 #include <android/log.h>
 
 #define TAG "RENEF_MEMDUMP"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
 
-static sigjmp_buf jump_buffer;
-static volatile sig_atomic_t fault_occurred = 0;
-
-static void segfault_handler(int sig) {
-    fault_occurred = 1;
-    siglongjmp(jump_buffer, 1);
-}
+#define MEMDUMP_MAX             4096
+#define MEMDUMP_WRITE_TIMEOUT   30000   // ms a stream waits for a stalled client
 
 void handle_memdump(int client_fd, const char* args) {
     unsigned long address = 0;
     size_t size = 0;
 
     int parsed = sscanf(args, "%lx %zu", &address, &size);
-    if (parsed != 2 || size == 0 || size > 4096) {
+    if (parsed != 2 || size == 0 || size > MEMDUMP_MAX) {
         const char* error = "ERROR: Invalid arguments. Usage: memdump <address> <size>\n";
-        write(client_fd, error, strlen(error));
+        output_reply(client_fd, error, strlen(error));
         return;
     }
 
     LOGI("Memory dump requested: addr=0x%lx, size=%zu", address, size);
 
-    void* mem_ptr = (void*)address;
-
-    char* buffer = (char*)malloc(size);
-    if (!buffer) {
-        const char* error = "ERROR: Memory allocation failed\n";
-        write(client_fd, error, strlen(error));
+    char buffer[MEMDUMP_MAX];
+    if (memio_copy(buffer, address, size) != size) {
+        LOGI("Memory access fault at 0x%lx", address);
+        const char* error = "ERROR: Invalid memory address or access violation\n";
+        output_reply(client_fd, error, strlen(error));
         return;
     }
 
-    struct sigaction sa, old_sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = segfault_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
+    size_t total_sent = (size_t)output_reply(client_fd, buffer, size);
+
+    LOGI("Sent %zu bytes to client", total_sent);
+}
+
+// Streamed dumps (mdump): see agent/dump.h for the record format.
+
+typedef struct {
+    int client_fd;
+    bool lz4;
+    uint8_t* out;               // record header + payload
+    uint8_t* chunk;             // memory being sent
+    uint64_t data_bytes;
+    uint64_t hole_bytes;
+    uint64_t stored_bytes;
+} DumpStream;
+
+static void dump_error(int client_fd, const char* msg) {
+    output_fail_request();
+    output_reply(client_fd, msg, strlen(msg));
+}
+
+static bool dump_open(DumpStream* ds, int client_fd, bool lz4) {
+    memset(ds, 0, sizeof(*ds));
+    ds->client_fd = client_fd;
+    ds->lz4 = lz4;
+    ds->out = (uint8_t*)malloc(DUMP_RECORD_SIZE + LZ4_BOUND(DUMP_CHUNK_SIZE));
+    ds->chunk = (uint8_t*)malloc(DUMP_CHUNK_SIZE);
+    if (!ds->out || !ds->chunk) {
+        free(ds->out);
+        free(ds->chunk);
+        dump_error(client_fd, "ERROR: Memory allocation failed\n");
+        return false;
+    }
+    return true;
+}
+
+static bool dump_send(DumpStream* ds, uint8_t type, uint8_t codec, uint64_t offset, size_t length,
+                      const void* payload, size_t stored) {
+    if (!output_request_writable(MEMDUMP_WRITE_TIMEOUT)) return false;
+
+    DumpRecord rec = {type, codec, (uint32_t)length, offset, (uint32_t)stored};
+    dump_encode(ds->out, &rec);
+    if (stored && payload != ds->out + DUMP_RECORD_SIZE) {
+        memcpy(ds->out + DUMP_RECORD_SIZE, payload, stored);
+    }
+    output_reply(ds->client_fd, ds->out, DUMP_RECORD_SIZE + stored);
+    ds->stored_bytes += stored;
+    return true;
+}
+
+static bool dump_data(DumpStream* ds, uint64_t offset, const uint8_t* data, size_t len) {
+    ds->data_bytes += len;
+    if (ds->lz4) {
+        uint8_t* payload = ds->out + DUMP_RECORD_SIZE;
+        size_t packed = lz4_compress_block(data, len, payload, len - len / 16);
+        if (packed > 0) {
+            return dump_send(ds, DUMP_DATA, DUMP_CODEC_LZ4, offset, len, payload, packed);
+        }
+    }
+    return dump_send(ds, DUMP_DATA, DUMP_CODEC_RAW, offset, len, data, len);
+}
+
+// First readable address in [addr, end), or end. Unmapped gaps and
+// regions without read permission are skipped whole; readable regions
+// (guard pages, PROT_NONE'd pages inside them) are probed page by page.
+static uintptr_t skip_unreadable(const MapsIndex* idx, uintptr_t addr, uintptr_t end) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t probe;
+
+    while (addr < end) {
+        const MapRegion* r = maps_lookup(idx, addr);
+        if (r && (r->perms & MAPS_PERM_R)) {
+            if (memio_copy(&probe, addr, 1) == 1) return addr;
+            addr = (addr | (page - 1)) + 1;
+            continue;
+        }
+        if (r) {
+            addr = r->end;
+            continue;
+        }
+
+        uintptr_t next = end;
+        for (int i = 0; i < idx->count; i++) {
+            if (idx->regions[i].start > addr) {
+                next = idx->regions[i].start;
+                break;
+            }
+        }
+        addr = next < end ? next : end;
+    }
+    return end;
+}
 
-    sigaction(SIGSEGV, &sa, &old_sa);
-    fault_occurred = 0;
+// Sends [*off, end) of the range at `image` as DATA and HOLE records and
+// advances *off. False once the client is gone.
+static bool dump_range(DumpStream* ds, const MapsIndex* idx, uintptr_t image, uint64_t* off, uint64_t end) {
+    while (*off < end) {
+        size_t want = end - *off < DUMP_CHUNK_SIZE ? (size_t)(end - *off) : DUMP_CHUNK_SIZE;
+        size_t got = memio_copy(ds->chunk, image + *off, want);
+        if (got > 0) {
+            if (!dump_data(ds, *off, ds->chunk, got)) return false;
+            *off += got;
+        }
+        if (got < want) {
+            uint64_t hole = *off;
+            *off = skip_unreadable(idx, image + *off, image + end) - image;
+            ds->hole_bytes += *off - hole;
+            if (!dump_send(ds, DUMP_HOLE, DUMP_CODEC_RAW, hole, *off - hole, NULL, 0)) return false;
+        }
+    }
+    return true;
+}
 
-    if (sigsetjmp(jump_buffer, 1) == 0) {
-        memcpy(buffer, mem_ptr, size);
+static void dump_finish(DumpStream* ds, bool ok, uint64_t off) {
+    if (ok) {
+        dump_send(ds, DUMP_END, DUMP_CODEC_RAW, off, 0, NULL, 0);
+        LOGI("dump done: %llu bytes, %llu in holes, %llu sent",
+             (unsigned long long)ds->data_bytes, (unsigned long long)ds->hole_bytes,
+             (unsigned long long)ds->stored_bytes);
     } else {
-        LOGI("Memory access fault at 0x%lx", address);
-        sigaction(SIGSEGV, &old_sa, NULL);
-        free(buffer);
-        const char* error = "ERROR: Invalid memory address or access violation\n";
-        write(client_fd, error, strlen(error));
+        LOGI("dump aborted at offset %llu (client gone)", (unsigned long long)off);
+    }
+    free(ds->chunk);
+    free(ds->out);
+}
+
+// [base, end) of a module: its first through last mapping, plus the
+// .bss mapping that follows. False if nothing matches.
+static bool module_range(const MapsIndex* idx, const char* name, uintptr_t* base, uintptr_t* end,
+                         char* path, size_t path_size) {
+    int first = maps_find_path(idx, name, 0);
+    if (first < 0) return false;
+
+    uint32_t path_id = idx->regions[first].path_id;
+    *base = idx->regions[first].start;
+    *end = idx->regions[first].end;
+
+    for (int i = first + 1; i < idx->count; i++) {
+        const MapRegion* r = &idx->regions[i];
+        if (r->path_id == path_id) {
+            *end = r->end;
+        } else if (r->start == *end && strcmp(maps_region_path(idx, r), "[anon:.bss]") == 0) {
+            *end = r->end;
+        }
+    }
+
+    snprintf(path, path_size, "%s", maps_region_path(idx, &idx->regions[first]));
+    return true;
+}
+
+/*
+ * mdump <address> <size> [from=<offset>] [lz4]
+ * mdump <module> [from=<offset>] [lz4]
+ *
+ * Streams the range in DUMP_CHUNK_SIZE records. Unreadable pages become
+ * HOLE records instead of ending the dump; from= resumes at an offset
+ * (relative to the start of the range) after an interrupted transfer.
+ */
+void handle_memdump_stream(int client_fd, const char* args) {
+    char target[256] = {0};
+    unsigned long address = 0;
+    unsigned long long size = 0;
+    unsigned long long from = 0;
+    bool lz4 = false;
+
+    char* copy = strdup(args);
+    if (!copy) {
+        dump_error(client_fd, "ERROR: Memory allocation failed\n");
         return;
     }
 
-    sigaction(SIGSEGV, &old_sa, NULL);
+    int positional = 0;
+    char* save = NULL;
+    for (char* tok = strtok_r(copy, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+        if (strncmp(tok, "from=", 5) == 0) {
+            from = strtoull(tok + 5, NULL, 0);
+        } else if (strcmp(tok, "lz4") == 0) {
+            lz4 = true;
+        } else if (positional == 0) {
+            snprintf(target, sizeof(target), "%s", tok);
+            positional++;
+        } else if (positional == 1) {
+            size = strtoull(tok, NULL, 0);
+            positional++;
+        }
+    }
+    free(copy);
+
+    const MapsIndex* idx = maps_acquire_fresh();
+    if (!idx) {
+        dump_error(client_fd, "ERROR: Cannot read /proc/self/maps\n");
+        return;
+    }
 
-    size_t total_sent = 0;
-    while (total_sent < size) {
-        ssize_t sent = write(client_fd, buffer + total_sent, size - total_sent);
-        if (sent <= 0) {
-            LOGI("Failed to send data to client: sent=%zd, total_sent=%zu", sent, total_sent);
-            free(buffer);
+    char path[512] = "";
+    char* end_ptr = NULL;
+    address = strtoul(target, &end_ptr, 16);
+    if (positional == 2 && end_ptr && *end_ptr == '\0' && size > 0) {
+        const MapRegion* r = maps_lookup(idx, address);
+        if (r) snprintf(path, sizeof(path), "%s", maps_region_path(idx, r));
+    } else if (positional == 1) {
+        uintptr_t base, end;
+        if (!module_range(idx, target, &base, &end, path, sizeof(path))) {
+            maps_release(idx);
+            char error[320];
+            snprintf(error, sizeof(error), "ERROR: Module not found: %s\n", target);
+            dump_error(client_fd, error);
             return;
         }
-        total_sent += sent;
+        address = base;
+        size = end - base;
+    } else {
+        maps_release(idx);
+        dump_error(client_fd, "ERROR: Usage: mdump <address> <size> | <module> [from=<offset>] [lz4]\n");
+        return;
     }
+    if (from > size) from = size;
 
-    LOGI("Sent %zu bytes to client", total_sent);
-    free(buffer);
+    DumpStream ds;
+    if (!dump_open(&ds, client_fd, lz4)) {
+        maps_release(idx);
+        return;
+    }
+
+    LOGI("mdump 0x%lx +%llu from %llu%s", address, size, from, lz4 ? " (lz4)" : "");
+
+    char info[640];
+    int info_len = snprintf(info, sizeof(info), "base=0x%lx size=%llu path=%s\n", address, size, path);
+    bool ok = dump_send(&ds, DUMP_INFO, DUMP_CODEC_RAW, from, 0, info, (size_t)info_len);
+
+    uint64_t off = from;
+    if (ok) ok = dump_range(&ds, idx, address, &off, size);
+    maps_release(idx);
+    dump_finish(&ds, ok, off);
+}
+
+/*
+ * dumpmod <module> [from=<offset>] [raw]
+ *
+ * The module's PT_LOAD segments as one image, offsets relative to its
+ * lowest mapping (the ELF header). Gaps between segments are not sent;
+ * the host rebuilds a loadable ELF from the image. LZ4 unless raw.
+ */
+void handle_module_dump(int client_fd, const char* args) {
+    char name[256] = {0};
+    unsigned long long from = 0;
+    bool lz4 = true;
+
+    char* copy = strdup(args);
+    if (!copy) {
+        dump_error(client_fd, "ERROR: Memory allocation failed\n");
+        return;
+    }
+    char* save = NULL;
+    for (char* tok = strtok_r(copy, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+        if (strncmp(tok, "from=", 5) == 0) {
+            from = strtoull(tok + 5, NULL, 0);
+        } else if (strcmp(tok, "raw") == 0) {
+            lz4 = false;
+        } else if (!name[0]) {
+            snprintf(name, sizeof(name), "%s", tok);
+        }
+    }
+    free(copy);
+
+    if (!name[0]) {
+        dump_error(client_fd, "ERROR: Usage: dumpmod <module> [from=<offset>] [raw]\n");
+        return;
+    }
+
+    const MapsIndex* idx = maps_acquire_fresh();
+    if (!idx) {
+        dump_error(client_fd, "ERROR: Cannot read /proc/self/maps\n");
+        return;
+    }
+
+    char error[320];
+    int first = maps_find_path(idx, name, 0);
+    if (first < 0) {
+        maps_release(idx);
+        snprintf(error, sizeof(error), "ERROR: Module not found: %s\n", name);
+        dump_error(client_fd, error);
+        return;
+    }
+    uintptr_t base = idx->regions[first].start;
+    char path[512];
+    snprintf(path, sizeof(path), "%s", maps_region_path(idx, &idx->regions[first]));
+
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr phdr[64];
+    if (memio_copy(&ehdr, base, sizeof(ehdr)) != sizeof(ehdr) ||
+        memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 || ehdr.e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr.e_phentsize != sizeof(Elf64_Phdr) || ehdr.e_phnum == 0 || ehdr.e_phnum > 64 ||
+        memio_copy(phdr, base + ehdr.e_phoff, ehdr.e_phnum * sizeof(Elf64_Phdr)) !=
+            ehdr.e_phnum * sizeof(Elf64_Phdr)) {
+        maps_release(idx);
+        snprintf(error, sizeof(error), "ERROR: No ELF header in memory at 0x%lx (%s)\n",
+                 (unsigned long)base, path);
+        dump_error(client_fd, error);
+        return;
+    }
+
+    // PT_LOADs are sorted by p_vaddr; the first one is mapped at base.
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t min_vaddr = UINT64_MAX, max_end = 0;
+    int segments = 0;
+    for (int i = 0; i < ehdr.e_phnum; i++) {
+        if (phdr[i].p_type != PT_LOAD) continue;
+        uint64_t start = phdr[i].p_vaddr & ~(page - 1);
+        if (start < min_vaddr) min_vaddr = start;
+        if (phdr[i].p_vaddr + phdr[i].p_memsz > max_end) max_end = phdr[i].p_vaddr + phdr[i].p_memsz;
+        segments++;
+    }
+    if (segments == 0) {
+        maps_release(idx);
+        dump_error(client_fd, "ERROR: Module has no PT_LOAD segments\n");
+        return;
+    }
+    uint64_t size = max_end - min_vaddr;
+
+    DumpStream ds;
+    if (!dump_open(&ds, client_fd, lz4)) {
+        maps_release(idx);
+        return;
+    }
+
+    LOGI("dumpmod %s at 0x%lx, %d segments, %llu bytes from %llu", path, (unsigned long)base,
+         segments, (unsigned long long)size, from);
+
+    char info[640];
+    int info_len = snprintf(info, sizeof(info), "base=0x%lx size=%llu path=%s segments=%d\n",
+                            (unsigned long)base, (unsigned long long)size, path, segments);
+    bool ok = dump_send(&ds, DUMP_INFO, DUMP_CODEC_RAW, from, 0, info, (size_t)info_len);
+
+    uint64_t off = from;
+    for (int i = 0; ok && i < ehdr.e_phnum; i++) {
+        if (phdr[i].p_type != PT_LOAD) continue;
+        uint64_t seg_start = (phdr[i].p_vaddr & ~(page - 1)) - min_vaddr;
+        uint64_t seg_end = phdr[i].p_vaddr + phdr[i].p_memsz - min_vaddr;
+        if (off < seg_start) off = seg_start;
+        if (off < seg_end) ok = dump_range(&ds, idx, base, &off, seg_end);
+    }
+    maps_release(idx);
+    dump_finish(&ds, ok, size);
 }
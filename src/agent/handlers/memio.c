@@ -0,0 +1,197 @@
+#include <agent/handlers.h>
+#include <agent/output.h>
+#include <agent/frame.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <android/log.h>
+
+#define TAG "RENEF_MEMIO"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
+
+/*
+ * Bulk memory access with binary replies (mr / mrv / mw). Memory is
+ * copied with process_vm_readv/writev on our own pid: an unmapped or
+ * protected page makes the call come up short instead of faulting, so
+ * no SIGSEGV handler is needed and requests can run concurrently. The
+ * syscalls are made directly: bionic only wraps them from API 23.
+ */
+
+#define MEMIO_CHUNK     (256 * 1024)
+#define MEMIO_MAX       (FRAME_MAX_PAYLOAD - 4096)
+#define MEMIO_MAX_RANGES 1024
+
+static void reply_error(int client_fd, const char* msg) {
+    output_fail_request();
+    output_reply(client_fd, msg, strlen(msg));
+}
+
+size_t memio_copy(void* out, uintptr_t address, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        struct iovec local = {(char*)out + done, size - done};
+        struct iovec remote = {(void*)(address + done), size - done};
+        ssize_t n = (ssize_t)syscall(__NR_process_vm_readv, getpid(), &local, 1, &remote, 1, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    return done;
+}
+
+// Reads [address, address + size) and replies with the bytes, in chunks.
+// Returns the number of bytes sent; a short count means an unreadable page.
+static size_t send_range(int client_fd, char* chunk, uintptr_t address, size_t size) {
+    size_t sent = 0;
+    while (sent < size) {
+        size_t want = size - sent < MEMIO_CHUNK ? size - sent : MEMIO_CHUNK;
+        size_t got = memio_copy(chunk, address + sent, want);
+        if (got > 0) output_reply(client_fd, chunk, got);
+        sent += got;
+        if (got < want) break;
+    }
+    return sent;
+}
+
+/*
+ * mr <address> <size>
+ * Replies with the raw bytes. The reply is shorter than `size` when the
+ * range runs into an unreadable page; nothing readable is an error.
+ */
+void handle_mem_read(int client_fd, const char* args) {
+    unsigned long address = 0;
+    size_t size = 0;
+
+    if (sscanf(args, "%lx %zu", &address, &size) != 2 || size == 0 || size > MEMIO_MAX) {
+        reply_error(client_fd, "ERROR: Usage: mr <address> <size> (at most 16MB)\n");
+        return;
+    }
+
+    char* chunk = (char*)malloc(size < MEMIO_CHUNK ? size : MEMIO_CHUNK);
+    if (!chunk) {
+        reply_error(client_fd, "ERROR: Memory allocation failed\n");
+        return;
+    }
+
+    size_t sent = send_range(client_fd, chunk, address, size);
+    free(chunk);
+
+    if (sent == 0) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "ERROR: Invalid memory address 0x%lx\n", address);
+        reply_error(client_fd, msg);
+        return;
+    }
+    LOGI("mr 0x%lx: %zu/%zu bytes", address, sent, size);
+}
+
+/*
+ * mrv <address>:<size> [<address>:<size> ...]
+ * Several ranges in one round trip. Each range is answered with a u32
+ * little-endian byte count followed by that many bytes; the count is
+ * short (possibly 0) where a range hits an unreadable page.
+ */
+void handle_mem_readv(int client_fd, const char* args) {
+    unsigned long addresses[MEMIO_MAX_RANGES];
+    size_t sizes[MEMIO_MAX_RANGES];
+    size_t count = 0;
+    size_t total = 0;
+
+    const char* p = args;
+    while (*p) {
+        while (*p == ' ' || *p == ',') p++;
+        if (!*p) break;
+
+        int used = 0;
+        if (count >= MEMIO_MAX_RANGES ||
+            sscanf(p, "%lx:%zu%n", &addresses[count], &sizes[count], &used) != 2) {
+            reply_error(client_fd, "ERROR: Usage: mrv <address>:<size> ... (at most 1024 ranges)\n");
+            return;
+        }
+        total += sizes[count] + 4;
+        if (sizes[count] > MEMIO_MAX || total > MEMIO_MAX) {
+            reply_error(client_fd, "ERROR: mrv reads at most 16MB at once\n");
+            return;
+        }
+        count++;
+        p += used;
+    }
+    if (count == 0) {
+        reply_error(client_fd, "ERROR: Usage: mrv <address>:<size> ... (at most 1024 ranges)\n");
+        return;
+    }
+
+    // The count goes ahead of the bytes, so each range is copied out in
+    // full before anything of it is sent.
+    size_t largest = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (sizes[i] > largest) largest = sizes[i];
+    }
+    char* buf = (char*)malloc(largest ? largest : 1);
+    if (!buf) {
+        reply_error(client_fd, "ERROR: Memory allocation failed\n");
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        size_t got = memio_copy(buf, addresses[i], sizes[i]);
+
+        uint8_t header[4];
+        frame_put32(header, (uint32_t)got);
+        output_reply(client_fd, header, sizeof(header));
+        if (got > 0) output_reply(client_fd, buf, got);
+    }
+
+    free(buf);
+    LOGI("mrv: %zu range(s), %zu bytes", count, total - count * 4);
+}
+
+/*
+ * mw <address> <size>\n<size raw bytes>
+ * Binary write. Only a framed request delivers the data byte for byte;
+ * writes to read-only pages fail (use Memory.patch for code).
+ */
+void handle_mem_write(int client_fd, const char* args, size_t len) {
+    unsigned long address = 0;
+    size_t size = 0;
+
+    const char* newline = memchr(args, '\n', len);
+    if (!newline || sscanf(args, "%lx %zu", &address, &size) != 2 || size == 0) {
+        reply_error(client_fd, "ERROR: Usage: mw <address> <size>\\n<data>\n");
+        return;
+    }
+
+    const char* data = newline + 1;
+    size_t available = len - (size_t)(data - args);
+    if (available < size) {
+        reply_error(client_fd, "ERROR: mw expects its data in the same (framed) request\n");
+        return;
+    }
+
+    size_t done = 0;
+    while (done < size) {
+        struct iovec local = {(void*)(data + done), size - done};
+        struct iovec remote = {(void*)(address + done), size - done};
+        ssize_t n = (ssize_t)syscall(__NR_process_vm_writev, getpid(), &local, 1, &remote, 1, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+
+    if (done == 0) {
+        char msg[80];
+        snprintf(msg, sizeof(msg), "ERROR: Cannot write at 0x%lx (unmapped or read-only)\n", address);
+        reply_error(client_fd, msg);
+        return;
+    }
+
+    char reply[64];
+    int reply_len = snprintf(reply, sizeof(reply), "OK %zu\n", done);
+    if (done < size) output_fail_request();
+    output_reply(client_fd, reply, (size_t)reply_len);
+    LOGI("mw 0x%lx: %zu/%zu bytes", address, done, size);
+}
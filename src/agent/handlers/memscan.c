@@ -1,26 +1,52 @@
 #include <agent/handlers.h>
 #include <agent/globals.h>
 #include <agent/lua_memory.h>
+#include <agent/scan.h>
+#include <agent/valscan.h>
+#include <agent/output.h>
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-static size_t hex_to_bytes(const char* hex, unsigned char* out, size_t max_len) {
-    size_t hex_len = strlen(hex);
-    size_t byte_len = hex_len / 2;
+#define MEMSCAN_MAX_HITS        (4 * 1024 * 1024)
+#define MEMSCAN_PAGE_SIZE       100
+#define MEMSCAN_MAX_PAGE        10000
+#define MEMSCAN_WILDCARD_LIMIT  (512 * 1024 * 1024)
 
-    if (byte_len > max_len) {
-        byte_len = max_len;
-    }
+/*
+ * ms streams NDJSON, one record per line:
+ *   {"type":"hit","index":0,["pattern":1,]"library":..,"offset":..,"address":..,"hex":..,"ascii":..}
+ *   {"type":"done","scan":3,"count":123456,"patterns":1,"truncated":false}
+ *   {"type":"page","scan":3,"offset":100,"count":100,"total":123456}
+ *   {"type":"error","error":"..."}
+ *
+ * Hits of the first page are sent while the scan is still running. Every
+ * hit is kept (up to MEMSCAN_MAX_HITS) as address + region only, so later
+ * pages ("msp <scan> <offset> [count]") render their hex/ascii context on
+ * demand. Only the most recent scan is kept.
+ */
+typedef struct {
+    int id;
+    MemoryRegions regions;
+    ScanHit* hits;
+    int count;
+    bool truncated;
+    int npatterns;
+    size_t lens[SCAN_MULTI_MAX_PATTERNS];
+} MemscanSession;
 
-    for (size_t i = 0; i < byte_len; i++) {
-        sscanf(hex + (i * 2), "%2hhx", &out[i]);
-    }
+typedef struct {
+    OutputRequest request;      // hits are sent from scan workers
+    const MemscanSession* session;
+    int page;
+    int sent;
+} MemscanStream;
 
-    return byte_len;
-}
+static MemscanSession g_session;
+static int g_next_scan_id = 1;
 
 static void json_escape(const char* src, char* dst, size_t dst_size) {
     size_t j = 0;
@@ -36,58 +62,315 @@ static void json_escape(const char* src, char* dst, size_t dst_size) {
     dst[j] = '\0';
 }
 
-void handle_memscan(int client_fd, const char* pattern) {
-    LOGI("Memory scan for pattern: %s", pattern);
+static void send_line(int fd, const char* buf, size_t len) {
+    output_reply(fd, buf, len);
+}
+
+static void send_error(int fd, const char* error) {
+    char line[256];
+    int len = snprintf(line, sizeof(line), "{\"type\":\"error\",\"error\":\"%s\"}\n", error);
+    send_line(fd, line, (size_t)len);
+}
+
+static void send_hit(const OutputRequest* req, const MemscanSession* s, int index, const ScanHit* hit) {
+    const ScanRange* r = &s->regions.ranges[hit->range];
+    size_t len = s->lens[hit->pattern];
+
+    char hex[512], ascii[128];
+    if (!memory_format_context(hit->addr, r->start, r->end, len, hex, sizeof(hex), ascii, sizeof(ascii))) {
+        snprintf(hex, sizeof(hex), "<unreadable>");
+    }
+
+    char lib_escaped[512], hex_escaped[1024], ascii_escaped[256];
+    json_escape(s->regions.paths[hit->range], lib_escaped, sizeof(lib_escaped));
+    json_escape(hex, hex_escaped, sizeof(hex_escaped));
+    json_escape(ascii, ascii_escaped, sizeof(ascii_escaped));
+
+    char pattern_field[32] = "";
+    if (s->npatterns > 1) {
+        snprintf(pattern_field, sizeof(pattern_field), "\"pattern\":%d,", hit->pattern + 1);
+    }
+
+    char line[2048];
+    int n = snprintf(line, sizeof(line),
+        "{\"type\":\"hit\",\"index\":%d,%s\"library\":\"%s\",\"offset\":%lu,\"address\":%lu,"
+        "\"hex\":\"%s\",\"ascii\":\"%s\"}\n",
+        index, pattern_field, lib_escaped,
+        (unsigned long)(hit->addr - r->start), (unsigned long)hit->addr,
+        hex_escaped, ascii_escaped);
+    if (n >= (int)sizeof(line)) n = sizeof(line) - 1;
+    output_reply_to(req, line, (size_t)n);
+}
+
+// Runs on a scan worker while the scan is in progress; the hits only land
+// in g_session.hits once it finishes. Workers aren't in the request, so
+// replies go through the handle taken on the command thread.
+static void stream_hits(const ScanHit* hits, int count, void* ctx) {
+    MemscanStream* st = (MemscanStream*)ctx;
 
-    unsigned char pattern_bytes[256];
-    size_t pattern_len = hex_to_bytes(pattern, pattern_bytes, sizeof(pattern_bytes));
+    for (int i = 0; i < count && st->sent < st->page; i++) {
+        send_hit(&st->request, st->session, st->sent, &hits[i]);
+        st->sent++;
+    }
+}
 
-    if (pattern_len == 0) {
-        const char* error = "{\"success\":false,\"error\":\"Invalid pattern\"}\n";
-        write(client_fd, error, strlen(error));
+static void session_reset(void) {
+    memory_free_regions(&g_session.regions);
+    free(g_session.hits);
+    memset(&g_session, 0, sizeof(g_session));
+}
+
+static ScanMulti* parse_patterns(int fd, const char* patterns, MemscanSession* s) {
+    ScanMulti* multi = scan_multi_create();
+    if (!multi) {
+        send_error(fd, "Out of memory");
+        return NULL;
+    }
+
+    const char* p = patterns;
+    while (1) {
+        const char* bar = strchr(p, '|');
+        size_t len = bar ? (size_t)(bar - p) : strlen(p);
+
+        char sig[1024];
+        if (len >= sizeof(sig)) len = sizeof(sig) - 1;
+        memcpy(sig, p, len);
+        sig[len] = '\0';
+
+        int pattern[256];
+        int pattern_len = memory_parse_pattern(sig, pattern, 256);
+        if (pattern_len == 0 || scan_multi_add(multi, pattern, pattern_len) < 0) {
+            char error[64];
+            snprintf(error, sizeof(error), "Invalid pattern #%d", s->npatterns + 1);
+            send_error(fd, error);
+            scan_multi_free(multi);
+            return NULL;
+        }
+        s->lens[s->npatterns++] = (size_t)pattern_len;
+
+        if (!bar) break;
+        p = bar + 1;
+    }
+
+    scan_multi_compile(multi);
+    return multi;
+}
+
+// "ms [-n <page>] <sig>[|<sig>...]" - every signature is hex with optional
+// ?? wildcards and spaces; all of them are matched in a single pass.
+void handle_memscan(int client_fd, const char* args) {
+    int page = MEMSCAN_PAGE_SIZE;
+    if (strncmp(args, "-n ", 3) == 0) {
+        char* end;
+        page = (int)strtol(args + 3, &end, 10);
+        args = end;
+        while (*args == ' ') args++;
+        if (page < 0) page = 0;
+        if (page > MEMSCAN_MAX_PAGE) page = MEMSCAN_MAX_PAGE;
+    }
+
+    LOGI("Memory scan for pattern: %s", args);
+
+    session_reset();
+    ScanMulti* multi = parse_patterns(client_fd, args, &g_session);
+    if (!multi) {
         return;
     }
+    g_session.id = g_next_scan_id++;
+
+    // A single pattern keeps the vectorised anchor search
+    ScanPattern sp;
+    bool single = g_session.npatterns == 1;
+    bool wildcards = true;
+    if (single) {
+        int pattern[256];
+        int pattern_len = memory_parse_pattern(args, pattern, 256);
+        scan_pattern_init_masked(&sp, pattern, pattern_len);
+        wildcards = sp.has_wildcards;
+    }
 
-    LOGI("Pattern bytes: %zu", pattern_len);
+    size_t searched = memory_collect_regions(&g_session.regions, NULL, 1,
+                                             wildcards ? MEMSCAN_WILDCARD_LIMIT : 0);
 
-    MemorySearchResult result = memory_search(pattern_bytes, pattern_len);
+    MemscanStream stream = { output_request(client_fd), &g_session, page, 0 };
+    ScanSink sink = { stream_hits, &stream };
+    if (single) {
+        g_session.count = scan_ranges(&sp, g_session.regions.ranges, g_session.regions.count,
+                                      MEMSCAN_MAX_HITS, &sink, &g_session.hits);
+    } else {
+        g_session.count = scan_ranges_multi(multi, g_session.regions.ranges, g_session.regions.count,
+                                            MEMSCAN_MAX_HITS, &sink, &g_session.hits);
+    }
+    g_session.truncated = g_session.count >= MEMSCAN_MAX_HITS;
+    scan_multi_free(multi);
 
-    size_t buf_size = result.count * 1024 + 256;
-    char* response = (char*)malloc(buf_size);
-    if (!response) {
-        const char* error = "{\"success\":false,\"error\":\"Out of memory\"}\n";
-        write(client_fd, error, strlen(error));
-        free_search_result(&result);
+    char done[256];
+    int len = snprintf(done, sizeof(done),
+        "{\"type\":\"done\",\"scan\":%d,\"count\":%d,\"patterns\":%d,\"truncated\":%s}\n",
+        g_session.id, g_session.count, g_session.npatterns, g_session.truncated ? "true" : "false");
+    send_line(client_fd, done, (size_t)len);
+
+    LOGI("Memory scan %d complete: %d results, %zu bytes in %d regions",
+         g_session.id, g_session.count, searched, g_session.regions.count);
+}
+
+// "msp <scan> <offset> [count]"
+void handle_memscan_page(int client_fd, const char* args) {
+    int scan = 0, offset = 0, count = MEMSCAN_PAGE_SIZE;
+    if (sscanf(args, "%d %d %d", &scan, &offset, &count) < 2) {
+        send_error(client_fd, "Usage: msp <scan> <offset> [count]");
+        return;
+    }
+    if (scan != g_session.id || g_session.id == 0) {
+        send_error(client_fd, "Scan results expired, run ms again");
         return;
     }
+    if (offset < 0) offset = 0;
+    if (count < 0) count = 0;
+    if (count > MEMSCAN_MAX_PAGE) count = MEMSCAN_MAX_PAGE;
+
+    int end = offset + count < g_session.count ? offset + count : g_session.count;
+    OutputRequest req = output_request(client_fd);
+    for (int i = offset; i < end; i++) {
+        send_hit(&req, &g_session, i, &g_session.hits[i]);
+    }
+
+    char tail[256];
+    int len = snprintf(tail, sizeof(tail),
+        "{\"type\":\"page\",\"scan\":%d,\"offset\":%d,\"count\":%d,\"total\":%d}\n",
+        g_session.id, offset, end > offset ? end - offset : 0, g_session.count);
+    send_line(client_fd, tail, (size_t)len);
+}
+
+static uint64_t parse_value(const char* str, ValueType type) {
+    bool is_float = type == VS_F32 || type == VS_F64 ||
+                    (strpbrk(str, ".eE") && strncmp(str, "0x", 2) != 0);
+    if (is_float) {
+        return valscan_encode(type, strtod(str, NULL), 0, false);
+    }
+    return valscan_encode(type, 0, (int64_t)strtoull(str, NULL, 0), true);
+}
+
+static void send_values(int fd, size_t offset, size_t max) {
+    ValueHit* hits = malloc((max ? max : 1) * sizeof(ValueHit));
+    if (!hits) {
+        send_error(fd, "Out of memory");
+        return;
+    }
+    size_t n = valscan_results(offset, max, hits);
+    ValueType type = valscan_type();
+
+    for (size_t i = 0; i < n; i++) {
+        char value[64], lib_escaped[256], line[512];
+        valscan_format(type, hits[i].value, value, sizeof(value));
+        json_escape(hits[i].path, lib_escaped, sizeof(lib_escaped));
+
+        int len = snprintf(line, sizeof(line),
+            "{\"type\":\"hit\",\"index\":%zu,\"library\":\"%s\",\"offset\":%lu,\"address\":%lu,\"value\":\"%s\"}\n",
+            offset + i, lib_escaped, (unsigned long)(hits[i].addr - hits[i].base),
+            (unsigned long)hits[i].addr, value);
+        send_line(fd, line, (size_t)len);
+    }
+    free(hits);
+}
 
-    int offset = snprintf(response, buf_size, "{\"success\":true,\"count\":%d,\"results\":[", result.count);
+/*
+ * Value scans, same record format as ms (hits carry "value" instead of
+ * hex/ascii):
+ *   msv <type[:align]> [eq|ne|gt|lt|range] <a> [b]     first scan
+ *   msv next <op> [a] [b]                              narrow the candidates
+ *   msv list [offset] [count]
+ *   msv reset
+ * Scans answer with the first page of candidates and a done record.
+ */
+void handle_valscan(int client_fd, const char* args) {
+    char argv[5][64] = {{0}};
+    int argc = sscanf(args, "%63s %63s %63s %63s %63s", argv[0], argv[1], argv[2], argv[3], argv[4]);
+    if (argc < 1) {
+        send_error(client_fd, "Usage: msv <type> [op] <value> [value2] | msv next <op> [value] | msv list | msv reset");
+        return;
+    }
 
-    for (int i = 0; i < result.count; i++) {
-        char lib_escaped[512];
-        char hex_escaped[1024];
-        char ascii_escaped[256];
+    if (strcmp(argv[0], "reset") == 0) {
+        valscan_reset();
+        const char* done = "{\"type\":\"done\",\"count\":0,\"scans\":0}\n";
+        send_line(client_fd, done, strlen(done));
+        return;
+    }
 
-        json_escape(result.items[i].library_name ? result.items[i].library_name : "", lib_escaped, sizeof(lib_escaped));
-        json_escape(result.items[i].hex_result ? result.items[i].hex_result : "", hex_escaped, sizeof(hex_escaped));
-        json_escape(result.items[i].ascii_result ? result.items[i].ascii_result : "", ascii_escaped, sizeof(ascii_escaped));
+    if (strcmp(argv[0], "list") == 0) {
+        if (valscan_scans() == 0) {
+            send_error(client_fd, "No value scan");
+            return;
+        }
+        size_t offset = argc > 1 ? strtoul(argv[1], NULL, 10) : 0;
+        size_t count = argc > 2 ? strtoul(argv[2], NULL, 10) : MEMSCAN_PAGE_SIZE;
+        if (count > MEMSCAN_MAX_PAGE) count = MEMSCAN_MAX_PAGE;
+        send_values(client_fd, offset, count);
 
-        offset += snprintf(response + offset, buf_size - offset,
-            "%s{\"library\":\"%s\",\"offset\":%lu,\"address\":%lu,\"hex\":\"%s\",\"ascii\":\"%s\"}",
-            (i > 0) ? "," : "",
-            lib_escaped,
-            (unsigned long)result.items[i].found_offset_addr,
-            (unsigned long)result.items[i].absolute_addr,
-            hex_escaped,
-            ascii_escaped);
+        size_t total = valscan_count();
+        size_t shown = offset < total ? (total - offset < count ? total - offset : count) : 0;
+        char tail[192];
+        int len = snprintf(tail, sizeof(tail),
+            "{\"type\":\"page\",\"offset\":%zu,\"count\":%zu,\"total\":%zu}\n", offset, shown, total);
+        send_line(client_fd, tail, (size_t)len);
+        return;
     }
 
-    snprintf(response + offset, buf_size - offset, "]}\n");
+    long count;
+    int first_arg;
+    ValueOp op = VS_EQ;
+    if (strcmp(argv[0], "next") == 0) {
+        if (valscan_scans() == 0) {
+            send_error(client_fd, "No value scan, start with msv <type> <value>");
+            return;
+        }
+        if (argc < 2 || !valscan_parse_op(argv[1], &op)) {
+            send_error(client_fd, "Unknown scan op");
+            return;
+        }
+        first_arg = 2;
+        ValueType type = valscan_type();
+        bool needs_value = !VS_OP_NEEDS_PREVIOUS(op);
+        if (needs_value && argc < first_arg + (op == VS_RANGE ? 2 : 1)) {
+            send_error(client_fd, "Missing value");
+            return;
+        }
+        uint64_t a = needs_value ? parse_value(argv[first_arg], type) : 0;
+        uint64_t b = op == VS_RANGE ? parse_value(argv[first_arg + 1], type) : 0;
+        count = valscan_next(op, a, b);
+    } else {
+        ValueType type;
+        size_t align;
+        if (!valscan_parse_type(argv[0], &type, &align)) {
+            send_error(client_fd, "Unknown value type (u8..u64, i8..i64, f32, f64)");
+            return;
+        }
+        first_arg = 1;
+        if (argc > 1 && valscan_parse_op(argv[1], &op)) first_arg = 2;
+        if (VS_OP_NEEDS_PREVIOUS(op)) {
+            send_error(client_fd, "Op needs a previous scan, use msv next");
+            return;
+        }
+        if (argc < first_arg + (op == VS_RANGE ? 2 : 1)) {
+            send_error(client_fd, "Missing value");
+            return;
+        }
+        uint64_t a = parse_value(argv[first_arg], type);
+        uint64_t b = op == VS_RANGE ? parse_value(argv[first_arg + 1], type) : 0;
+        count = valscan_first(type, align, op, a, b);
+    }
 
-    write(client_fd, response, strlen(response));
+    if (count < 0) {
+        send_error(client_fd, "Value scan failed");
+        return;
+    }
 
-    free(response);
-    free_search_result(&result);
+    send_values(client_fd, 0, MEMSCAN_PAGE_SIZE);
 
-    LOGI("Memory scan complete: %d results", result.count);
+    char done[192];
+    int len = snprintf(done, sizeof(done),
+        "{\"type\":\"done\",\"count\":%ld,\"scans\":%d,\"value_type\":\"%s\"}\n",
+        count, valscan_scans(), valscan_type_name(valscan_type()));
+    send_line(client_fd, done, (size_t)len);
 }
@@ -0,0 +1,93 @@
+#include <agent/handlers.h>
+#include <agent/globals.h>
+#include <agent/symindex.h>
+#include <agent/output.h>
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SYMS_BUF_SIZE (64 * 1024)
+
+static void flush_buf(int client_fd, char* buf, size_t* len) {
+    output_reply(client_fd, buf, *len);
+    *len = 0;
+}
+
+/*
+ * syms [-k] <lib>
+ *
+ *   SYMS <key> <path>
+ *   <value> <size> <type> <d|s> <name>     (hex value/size, STT_* type)
+ *   ...
+ *   END
+ *
+ * With -k only the header and END are sent, so the server can check its
+ * on-disk cache before asking for the table itself.
+ */
+void handle_syms(int client_fd, const char* args) {
+    bool key_only = false;
+    while (*args == ' ') args++;
+    if (strncmp(args, "-k ", 3) == 0) {
+        key_only = true;
+        args += 3;
+        while (*args == ' ') args++;
+    }
+
+    char lib_name[256];
+    if (sscanf(args, "%255s", lib_name) != 1) {
+        const char* error = "ERROR: Usage: syms [-k] <lib_name>\n";
+        output_reply(client_fd, error, strlen(error));
+        return;
+    }
+
+    const SymIndex* idx = symindex_get(lib_name);
+    if (!idx) {
+        char error[320];
+        snprintf(error, sizeof(error), "ERROR: Library '%s' not found in process\n", lib_name);
+        output_reply(client_fd, error, strlen(error));
+        return;
+    }
+
+    char* buf = (char*)malloc(SYMS_BUF_SIZE);
+    if (!buf) {
+        const char* error = "ERROR: Memory allocation failed\n";
+        output_reply(client_fd, error, strlen(error));
+        return;
+    }
+    size_t len = (size_t)snprintf(buf, SYMS_BUF_SIZE, "SYMS %s %s\n",
+                                  symindex_key(idx), symindex_path(idx));
+
+    size_t sent = 0;
+    for (int pass = 0; pass < 2 && !key_only; pass++) {
+        bool dynamic = pass == 0;
+        size_t count = symindex_count(idx, dynamic);
+
+        for (size_t i = 0; i < count; i++) {
+            SymInfo sym;
+            if (!symindex_entry(idx, dynamic, i, &sym)) continue;
+            if (!sym.defined || sym.value == 0 || sym.name[0] == '\0') continue;
+            if (sym.type == STT_SECTION || sym.type == STT_FILE) continue;
+
+            if (len + strlen(sym.name) + 64 > SYMS_BUF_SIZE) {
+                flush_buf(client_fd, buf, &len);
+            }
+            len += (size_t)snprintf(buf + len, SYMS_BUF_SIZE - len, "%llx %llx %u %c %s\n",
+                                    (unsigned long long)sym.value, (unsigned long long)sym.size,
+                                    sym.type, dynamic ? 'd' : 's', sym.name);
+            sent++;
+        }
+    }
+
+    if (len + 4 > SYMS_BUF_SIZE) {
+        flush_buf(client_fd, buf, &len);
+    }
+    memcpy(buf + len, "END\n", 4);
+    len += 4;
+    flush_buf(client_fd, buf, &len);
+    free(buf);
+
+    verbose_log("syms: %s key=%s sent=%zu", lib_name, symindex_key(idx), sent);
+}
@@ -0,0 +1,183 @@
+#include <agent/hook_table.h>
+#include <agent/rcu.h>
+#include <agent/globals.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOT_FREE       0
+#define SLOT_LIVE       1
+#define SLOT_RETIRED    2
+
+#define SLOT_HEADER     16
+
+typedef struct {
+    HookTable* table;
+    int index;
+} RetiredSlot;
+
+static size_t slot_stride(const HookTable* t) {
+    return SLOT_HEADER + ALIGN_UP(t->elem_size, 16);
+}
+
+static int segment_of(int index, int* offset) {
+    unsigned q = (unsigned)index / HOOK_TABLE_BASE + 1;
+    int seg = 31 - __builtin_clz(q);
+    *offset = index - HOOK_TABLE_BASE * ((1 << seg) - 1);
+    return seg;
+}
+
+static uint8_t* slot_at(HookTable* t, int index) {
+    int offset;
+    int seg = segment_of(index, &offset);
+    if (seg >= HOOK_TABLE_SEGS) return NULL;
+    uint8_t* base = __atomic_load_n(&t->segs[seg], __ATOMIC_ACQUIRE);
+    return base ? base + (size_t)offset * slot_stride(t) : NULL;
+}
+
+static uint32_t* slot_state(uint8_t* slot) {
+    return (uint32_t*)slot;
+}
+
+static uint32_t* slot_gen(uint8_t* slot) {
+    return (uint32_t*)slot + 1;
+}
+
+// Written under the lock; hook_table_at() reads it without.
+static void set_state(uint8_t* slot, uint32_t state) {
+    __atomic_store_n(slot_state(slot), state, __ATOMIC_RELEASE);
+}
+
+static bool push_free(HookTable* t, int index) {
+    if (t->free_count == t->free_cap) {
+        int cap = t->free_cap ? t->free_cap * 2 : HOOK_TABLE_BASE;
+        int* slots = realloc(t->free_slots, (size_t)cap * sizeof(int));
+        if (!slots) return false;       // the slot stays unused
+        t->free_slots = slots;
+        t->free_cap = cap;
+    }
+    t->free_slots[t->free_count++] = index;
+    return true;
+}
+
+int hook_table_alloc(HookTable* t, void** elem_out) {
+    rcu_poll();
+
+    pthread_mutex_lock(&t->lock);
+
+    int index;
+    if (t->free_count > 0) {
+        index = t->free_slots[--t->free_count];
+    } else {
+        index = t->count;
+        int offset;
+        int seg = segment_of(index, &offset);
+        if (index >= HOOK_TABLE_MAX || seg >= HOOK_TABLE_SEGS) {
+            pthread_mutex_unlock(&t->lock);
+            LOGE("hook table full (%d slots)", HOOK_TABLE_MAX);
+            return -1;
+        }
+        if (!t->segs[seg]) {
+            uint8_t* base = calloc((size_t)HOOK_TABLE_BASE << seg, slot_stride(t));
+            if (!base) {
+                pthread_mutex_unlock(&t->lock);
+                LOGE("hook table: out of memory");
+                return -1;
+            }
+            __atomic_store_n(&t->segs[seg], base, __ATOMIC_RELEASE);
+        }
+    }
+
+    uint8_t* slot = slot_at(t, index);
+    // Before the new contents, for handlers checking it after reading them
+    __atomic_store_n(slot_gen(slot), *slot_gen(slot) + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memset(slot + SLOT_HEADER, 0, t->elem_size);
+    set_state(slot, SLOT_LIVE);
+    if (index == t->count) {
+        __atomic_store_n(&t->count, index + 1, __ATOMIC_RELEASE);
+    }
+    t->live++;
+
+    pthread_mutex_unlock(&t->lock);
+
+    *elem_out = slot + SLOT_HEADER;
+    return index;
+}
+
+void hook_table_free(HookTable* t, int index) {
+    pthread_mutex_lock(&t->lock);
+    uint8_t* slot = index >= 0 && index < t->count ? slot_at(t, index) : NULL;
+    if (slot && *slot_state(slot) == SLOT_LIVE) {
+        set_state(slot, SLOT_FREE);
+        t->live--;
+        push_free(t, index);
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+static void reclaim_slot(void* arg) {
+    RetiredSlot* rs = (RetiredSlot*)arg;
+    HookTable* t = rs->table;
+    uint8_t* slot = slot_at(t, rs->index);
+
+    if (t->reclaim) {
+        t->reclaim(slot + SLOT_HEADER);
+    }
+
+    pthread_mutex_lock(&t->lock);
+    set_state(slot, SLOT_FREE);
+    t->retired--;
+    push_free(t, rs->index);
+    pthread_mutex_unlock(&t->lock);
+    free(rs);
+}
+
+void hook_table_retire(HookTable* t, int index) {
+    RetiredSlot* rs = malloc(sizeof(RetiredSlot));
+
+    pthread_mutex_lock(&t->lock);
+    uint8_t* slot = index >= 0 && index < t->count ? slot_at(t, index) : NULL;
+    bool ok = slot && *slot_state(slot) == SLOT_LIVE;
+    if (ok) {
+        set_state(slot, SLOT_RETIRED);
+        t->live--;
+        t->retired++;
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    if (!ok || !rs) {
+        // Without a record of it the slot is never reused, but never freed under a reader either
+        free(rs);
+        return;
+    }
+    rs->table = t;
+    rs->index = index;
+    rcu_defer(reclaim_slot, rs);
+    rcu_poll();
+}
+
+void* hook_table_at(HookTable* t, int index) {
+    if (index < 0 || index >= hook_table_count(t)) return NULL;
+    uint8_t* slot = slot_at(t, index);
+    if (!slot) return NULL;
+    // Free: never published, or reclaimed and not yet handed out again
+    uint32_t state = __atomic_load_n(slot_state(slot), __ATOMIC_ACQUIRE);
+    return state == SLOT_LIVE || state == SLOT_RETIRED ? slot + SLOT_HEADER : NULL;
+}
+
+uint32_t hook_table_gen(HookTable* t, int index) {
+    if (index < 0 || index >= hook_table_count(t)) return 0;
+    uint8_t* slot = slot_at(t, index);
+    if (!slot) return 0;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(slot_gen(slot), __ATOMIC_RELAXED);
+}
+
+void* hook_table_get(HookTable* t, int index) {
+    pthread_mutex_lock(&t->lock);
+    uint8_t* slot = index >= 0 && index < t->count ? slot_at(t, index) : NULL;
+    void* elem = slot && *slot_state(slot) == SLOT_LIVE ? slot + SLOT_HEADER : NULL;
+    pthread_mutex_unlock(&t->lock);
+    return elem;
+}
@@ -1,6 +1,12 @@
 #include <agent/hook_java.h>
 #include <agent/globals.h>
+#include <agent/maps.h>
+#include <agent/symindex.h>
 #include <agent/agent.h>
+#include <agent/lua_dispatch.h>
+#include <agent/stub_alloc.h>
+#include <agent/hook_table.h>
+#include <agent/rcu.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,27 +19,15 @@
 #include <elf.h>
 #include <fcntl.h>
 
-JavaHookInfo g_java_hooks[MAX_JAVA_HOOKS];
-int g_java_hook_count = 0;
+static void java_hook_reclaim(void* elem);
+
+static HookTable g_java_hook_table = HOOK_TABLE_INIT(JavaHookInfo, java_hook_reclaim);
 
 static int g_api_level = 0;
 static ArtMethodOffsets g_offsets = {0};
 static bool g_java_hook_initialized = false;
 static pthread_mutex_t g_java_hook_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-// Use recursive mutex to allow nested hook callbacks (parent calling child)
-static pthread_mutex_t g_java_lua_mutex;
-static pthread_once_t g_lua_mutex_init_once = PTHREAD_ONCE_INIT;
-
-static void init_recursive_lua_mutex(void) {
-    pthread_mutexattr_t attr;
-    pthread_mutexattr_init(&attr);
-    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-    pthread_mutex_init(&g_java_lua_mutex, &attr);
-    pthread_mutexattr_destroy(&attr);
-    LOGI("Initialized recursive Lua mutex for nested hooks");
-}
-
 // Thread-local hook call stack for tracking nested calls
 #define MAX_HOOK_CALL_DEPTH 16
 typedef struct {
@@ -47,10 +41,31 @@ static __thread int g_current_java_hook_index = -1;
 
 static void* g_interpreter_bridge = NULL;
 
+JavaHookInfo* java_hook_get(int hook_index) {
+    return (JavaHookInfo*)hook_table_get(&g_java_hook_table, hook_index);
+}
+
+JavaHookInfo* java_hook_at(int hook_index) {
+    return (JavaHookInfo*)hook_table_at(&g_java_hook_table, hook_index);
+}
+
+int java_hook_active_count(void) {
+    return hook_table_live(&g_java_hook_table);
+}
+
+static void java_hook_reclaim(void* elem) {
+    JavaHookInfo* hook = (JavaHookInfo*)elem;
+    if (hook->hook_trampoline) {
+        stub_free(hook->hook_trampoline);
+        hook->hook_trampoline = NULL;
+    }
+    free(hook->stored_string_value);
+    hook->stored_string_value = NULL;
+}
+
 static uint64_t nativized_method_stub(void) {
-    int hook_index = g_current_java_hook_index;
-    if (hook_index >= 0 && hook_index < g_java_hook_count) {
-        JavaHookInfo* hook = &g_java_hooks[hook_index];
+    JavaHookInfo* hook = java_hook_at(g_current_java_hook_index);
+    if (hook) {
         if (hook->has_stored_return) {
             LOGI("nativized_method_stub returning stored value: 0x%llx",
                  (unsigned long long)hook->stored_return_value);
@@ -80,174 +95,58 @@ int get_android_api_level(void) {
 }
 
 static void* elf_find_symbol(const char* lib_path, uintptr_t load_addr, const char* symbol_name) {
-    int fd = open(lib_path, O_RDONLY);
-    if (fd < 0) return NULL;
-
-    off_t file_size = lseek(fd, 0, SEEK_END);
-    lseek(fd, 0, SEEK_SET);
-
-    void* map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-
-    if (map == MAP_FAILED) return NULL;
-
-    void* result = NULL;
-    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)map;
-
-    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
-        goto cleanup;
-    }
+    const SymIndex* idx = symindex_get_path(lib_path, load_addr);
+    SymInfo sym;
+    if (!symindex_find(idx, symbol_name, &sym)) return NULL;
 
-    Elf64_Phdr* phdr = (Elf64_Phdr*)((uint8_t*)map + ehdr->e_phoff);
-    uintptr_t first_load_vaddr = 0;
-
-    for (int i = 0; i < ehdr->e_phnum; i++) {
-        if (phdr[i].p_type == PT_LOAD) {
-            first_load_vaddr = phdr[i].p_vaddr;
-            break;
-        }
-    }
-
-    uintptr_t load_bias = load_addr - first_load_vaddr;
-
-    Elf64_Shdr* shdr = (Elf64_Shdr*)((uint8_t*)map + ehdr->e_shoff);
-    Elf64_Shdr* shstrtab = &shdr[ehdr->e_shstrndx];
-    const char* shstrtab_data = (const char*)map + shstrtab->sh_offset;
-
-    Elf64_Shdr* dynsym_shdr = NULL;
-    Elf64_Shdr* dynstr_shdr = NULL;
-    Elf64_Shdr* symtab_shdr = NULL;
-    Elf64_Shdr* strtab_shdr = NULL;
-
-    for (int i = 0; i < ehdr->e_shnum; i++) {
-        const char* name = shstrtab_data + shdr[i].sh_name;
-        if (strcmp(name, ".dynsym") == 0) dynsym_shdr = &shdr[i];
-        else if (strcmp(name, ".dynstr") == 0) dynstr_shdr = &shdr[i];
-        else if (strcmp(name, ".symtab") == 0) symtab_shdr = &shdr[i];
-        else if (strcmp(name, ".strtab") == 0) strtab_shdr = &shdr[i];
-    }
-
-    if (dynsym_shdr && dynstr_shdr) {
-        Elf64_Sym* symtab = (Elf64_Sym*)((uint8_t*)map + dynsym_shdr->sh_offset);
-        const char* strtab = (const char*)map + dynstr_shdr->sh_offset;
-        size_t sym_count = dynsym_shdr->sh_size / sizeof(Elf64_Sym);
-
-        for (size_t i = 0; i < sym_count; i++) {
-            const char* name = strtab + symtab[i].st_name;
-            if (strcmp(name, symbol_name) == 0 && symtab[i].st_value != 0) {
-                result = (void*)(load_bias + symtab[i].st_value);
-                LOGI("ELF: Found %s in .dynsym at %p", symbol_name, result);
-                goto cleanup;
-            }
-        }
-    }
-
-    if (!result && symtab_shdr && strtab_shdr) {
-        Elf64_Sym* symtab = (Elf64_Sym*)((uint8_t*)map + symtab_shdr->sh_offset);
-        const char* strtab = (const char*)map + strtab_shdr->sh_offset;
-        size_t sym_count = symtab_shdr->sh_size / sizeof(Elf64_Sym);
-
-        for (size_t i = 0; i < sym_count; i++) {
-            const char* name = strtab + symtab[i].st_name;
-            if (strcmp(name, symbol_name) == 0 && symtab[i].st_value != 0) {
-                result = (void*)(load_bias + symtab[i].st_value);
-                LOGI("ELF: Found %s in .symtab at %p", symbol_name, result);
-                goto cleanup;
-            }
-        }
-    }
-
-cleanup:
-    munmap(map, file_size);
+    void* result = (void*)(symindex_load_bias(idx) + sym.value);
+    LOGI("ELF: Found %s in %s at %p", symbol_name, sym.dynamic ? ".dynsym" : ".symtab", result);
     return result;
 }
 
 static void* elf_find_symbol_containing(const char* lib_path, uintptr_t load_addr,
                                          const char* pattern, char* found_name, size_t found_name_size) {
-    int fd = open(lib_path, O_RDONLY);
-    if (fd < 0) return NULL;
-
-    off_t file_size = lseek(fd, 0, SEEK_END);
-    lseek(fd, 0, SEEK_SET);
-
-    void* map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-
-    if (map == MAP_FAILED) return NULL;
-
-    void* result = NULL;
-    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)map;
-
-    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
-        goto cleanup;
-    }
-
-    Elf64_Phdr* phdr = (Elf64_Phdr*)((uint8_t*)map + ehdr->e_phoff);
-    uintptr_t first_load_vaddr = 0;
-
-    for (int i = 0; i < ehdr->e_phnum; i++) {
-        if (phdr[i].p_type == PT_LOAD) {
-            first_load_vaddr = phdr[i].p_vaddr;
-            break;
-        }
-    }
-
-    uintptr_t load_bias = load_addr - first_load_vaddr;
-
-    Elf64_Shdr* shdr = (Elf64_Shdr*)((uint8_t*)map + ehdr->e_shoff);
-    Elf64_Shdr* shstrtab = &shdr[ehdr->e_shstrndx];
-    const char* shstrtab_data = (const char*)map + shstrtab->sh_offset;
-
-    Elf64_Shdr* dynsym_shdr = NULL;
-    Elf64_Shdr* dynstr_shdr = NULL;
-
-    for (int i = 0; i < ehdr->e_shnum; i++) {
-        const char* name = shstrtab_data + shdr[i].sh_name;
-        if (strcmp(name, ".dynsym") == 0) dynsym_shdr = &shdr[i];
-        else if (strcmp(name, ".dynstr") == 0) dynstr_shdr = &shdr[i];
-    }
-
-    if (dynsym_shdr && dynstr_shdr) {
-        Elf64_Sym* symtab = (Elf64_Sym*)((uint8_t*)map + dynsym_shdr->sh_offset);
-        const char* strtab = (const char*)map + dynstr_shdr->sh_offset;
-        size_t sym_count = dynsym_shdr->sh_size / sizeof(Elf64_Sym);
-
-        for (size_t i = 0; i < sym_count; i++) {
-            const char* name = strtab + symtab[i].st_name;
-            if (strstr(name, pattern) && symtab[i].st_value != 0) {
-                if (strstr(name, "_ZN3art6Thread") || strstr(name, "_ZN3art9JNIEnvExt")) {
-                    if (strstr(name, "Offset") || strstr(name, "Cookie") ||
-                        strstr(name, "Size") || strstr(name, "Capacity") ||
-                        strstr(name, "Count") || strstr(name, "Get") ||
-                        strstr(name, "Set") || strstr(name, "Check") ||
-                        strstr(name, "Trim") || strstr(name, "Remove") ||
-                        strstr(name, "Pop") || strstr(name, "Segment")) {
-                        LOGI("ELF: Skipping wrong function: %s", name);
-                        continue;
-                    }
+    const SymIndex* idx = symindex_get_path(lib_path, load_addr);
+    if (!idx) return NULL;
+
+    uintptr_t load_bias = symindex_load_bias(idx);
+    size_t sym_count = symindex_count(idx, true);
+
+    for (size_t i = 0; i < sym_count; i++) {
+        SymInfo sym;
+        symindex_entry(idx, true, i, &sym);
+        const char* name = sym.name;
+        if (strstr(name, pattern) && sym.value != 0) {
+            if (strstr(name, "_ZN3art6Thread") || strstr(name, "_ZN3art9JNIEnvExt")) {
+                if (strstr(name, "Offset") || strstr(name, "Cookie") ||
+                    strstr(name, "Size") || strstr(name, "Capacity") ||
+                    strstr(name, "Count") || strstr(name, "Get") ||
+                    strstr(name, "Set") || strstr(name, "Check") ||
+                    strstr(name, "Trim") || strstr(name, "Remove") ||
+                    strstr(name, "Pop") || strstr(name, "Segment")) {
+                    LOGI("ELF: Skipping wrong function: %s", name);
+                    continue;
+                }
 
-                    bool is_create_func = (strstr(name, "Create") || strstr(name, "New") ||
-                                           strstr(name, "Add") || strstr(name, "Push"));
-                    bool is_ref_func = (strstr(name, "LocalRef") || strstr(name, "Reference") ||
-                                        strstr(name, "JObject"));
+                bool is_create_func = (strstr(name, "Create") || strstr(name, "New") ||
+                                       strstr(name, "Add") || strstr(name, "Push"));
+                bool is_ref_func = (strstr(name, "LocalRef") || strstr(name, "Reference") ||
+                                    strstr(name, "JObject"));
 
-                    if (is_create_func && is_ref_func) {
-                        result = (void*)(load_bias + symtab[i].st_value);
-                        if (found_name && found_name_size > 0) {
-                            strncpy(found_name, name, found_name_size - 1);
-                            found_name[found_name_size - 1] = '\0';
-                        }
-                        LOGI("ELF: Found matching symbol '%s': %s at %p", pattern, name, result);
-                        goto cleanup;
+                if (is_create_func && is_ref_func) {
+                    void* result = (void*)(load_bias + sym.value);
+                    if (found_name && found_name_size > 0) {
+                        strncpy(found_name, name, found_name_size - 1);
+                        found_name[found_name_size - 1] = '\0';
                     }
+                    LOGI("ELF: Found matching symbol '%s': %s at %p", pattern, name, result);
+                    return result;
                 }
             }
         }
     }
 
-cleanup:
-    munmap(map, file_size);
-    return result;
+    return NULL;
 }
 
 static void* find_interpreter_bridge(JNIEnv* env) {
@@ -267,26 +166,8 @@ static void* find_interpreter_bridge(JNIEnv* env) {
         }
     }
 
-    FILE* fp = fopen("/proc/self/maps", "r");
-    if (!fp) return NULL;
-
-    char line[512];
-    uintptr_t libart_base = 0;
     char libart_path[256] = {0};
-
-    while (fgets(line, sizeof(line), fp)) {
-        if (strstr(line, "libart.so")) {
-            unsigned long start;
-            char path[256] = {0};
-            if (sscanf(line, "%lx-%*lx %*4s %*x %*s %*d %255s", &start, path) >= 1) {
-                if (libart_base == 0 || start < libart_base) {
-                    libart_base = start;
-                    if (path[0]) strncpy(libart_path, path, sizeof(libart_path) - 1);
-                }
-            }
-        }
-    }
-    fclose(fp);
+    uintptr_t libart_base = maps_module_base("libart.so", libart_path, sizeof(libart_path));
 
     if (!libart_base || !libart_path[0]) {
         LOGE("Could not find libart.so in /proc/self/maps");
@@ -413,16 +294,11 @@ void* jmethodid_to_art_method(JNIEnv* env, jmethodID method_id, jclass clazz) {
 
 static uint64_t java_hook_call_original(int hook_index, uint64_t* saved_regs);
 
-void* create_java_hook_trampoline(int hook_index) {
-    void* trampoline = mmap(NULL, PAGE_SIZE,
-                            PROT_READ | PROT_WRITE | PROT_EXEC,
-                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (trampoline == MAP_FAILED) {
-        LOGE("Failed to allocate trampoline: %s", strerror(errno));
-        return NULL;
-    }
+#define JAVA_TRAMPOLINE_SIZE 256
 
-    uint32_t* code = (uint32_t*)trampoline;
+static size_t build_java_hook_trampoline(uint32_t* code, uintptr_t pc, void* ctx) {
+    (void)pc;
+    int hook_index = *(int*)ctx;
     int idx = 0;
 
     // Prologue
@@ -504,9 +380,17 @@ void* create_java_hook_trampoline(int hook_index) {
     int onleave_offset = (onleave_addr_idx - onleave_ldr_idx) * 4;
     code[onleave_ldr_idx] = 0x58000010 | ((onleave_offset / 4) << 5);
 
-    __builtin___clear_cache((char*)trampoline, (char*)trampoline + idx * 4 + 32);
+    return (size_t)idx * 4;
+}
+
+void* create_java_hook_trampoline(int hook_index) {
+    void* trampoline = stub_create(JAVA_TRAMPOLINE_SIZE, NULL, build_java_hook_trampoline, &hook_index);
+    if (!trampoline) {
+        LOGE("Failed to allocate trampoline");
+        return NULL;
+    }
 
-    LOGI("Created Java hook trampoline at %p (size=%d bytes)", trampoline, idx * 4);
+    LOGI("Created Java hook trampoline at %p", trampoline);
 
     return trampoline;
 }
@@ -574,42 +458,24 @@ static void init_decode_jobject(void) {
         }
     }
 
-    FILE* fp = fopen("/proc/self/maps", "r");
-    if (fp) {
-        char line[512];
-        uintptr_t libart_base = 0;
-        char libart_path[256] = {0};
-
-        while (fgets(line, sizeof(line), fp)) {
-            if (strstr(line, "libart.so")) {
-                unsigned long start;
-                char path[256] = {0};
-                if (sscanf(line, "%lx-%*lx %*4s %*x %*s %*d %255s", &start, path) >= 1) {
-                    if (libart_base == 0 || start < libart_base) {
-                        libart_base = (uintptr_t)start;
-                        if (path[0]) strncpy(libart_path, path, sizeof(libart_path) - 1);
-                    }
-                }
+    char libart_path[256] = {0};
+    uintptr_t libart_base = maps_module_base("libart.so", libart_path, sizeof(libart_path));
+
+    if (libart_base && libart_path[0]) {
+        LOGI("DecodeJObject: trying ELF lookup in %s @ 0x%lx", libart_path, libart_base);
+        for (int i = 0; general_symbols[i] && !g_decode_jobject; i++) {
+            g_decode_jobject = (DecodeJObject_t)elf_lookup_symbol(libart_path, libart_base, general_symbols[i]);
+            if (g_decode_jobject) {
+                LOGI("Found DecodeJObject via ELF: %s at %p", general_symbols[i], g_decode_jobject);
+                return;
             }
         }
-        fclose(fp);
-
-        if (libart_base && libart_path[0]) {
-            LOGI("DecodeJObject: trying ELF lookup in %s @ 0x%lx", libart_path, libart_base);
-            for (int i = 0; general_symbols[i] && !g_decode_jobject; i++) {
-                g_decode_jobject = (DecodeJObject_t)elf_lookup_symbol(libart_path, libart_base, general_symbols[i]);
-                if (g_decode_jobject) {
-                    LOGI("Found DecodeJObject via ELF: %s at %p", general_symbols[i], g_decode_jobject);
-                    return;
-                }
-            }
-            for (int i = 0; global_symbols[i] && !g_decode_jobject; i++) {
-                g_decode_jobject = (DecodeJObject_t)elf_lookup_symbol(libart_path, libart_base, global_symbols[i]);
-                if (g_decode_jobject) {
-                    g_decode_global_only = 1;
-                    LOGI("Found DecodeGlobalJObject via ELF: %s at %p", global_symbols[i], g_decode_jobject);
-                    return;
-                }
+        for (int i = 0; global_symbols[i] && !g_decode_jobject; i++) {
+            g_decode_jobject = (DecodeJObject_t)elf_lookup_symbol(libart_path, libart_base, global_symbols[i]);
+            if (g_decode_jobject) {
+                g_decode_global_only = 1;
+                LOGI("Found DecodeGlobalJObject via ELF: %s at %p", global_symbols[i], g_decode_jobject);
+                return;
             }
         }
     }
@@ -663,92 +529,17 @@ void* jni_ref_to_raw_ptr(JNIEnv* env, jobject ref) {
 
 // Resolve a dynamic symbol from the in-memory ELF image (no file I/O, SELinux-safe)
 static void* find_symbol_in_mapped_elf(uintptr_t base, const char* symbol_name) {
-    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)base;
-    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
-        LOGW("ELF(mem): bad magic at 0x%lx", (unsigned long)base);
-        return NULL;
-    }
-
-    Elf64_Phdr* phdr = (Elf64_Phdr*)(base + ehdr->e_phoff);
-
-    uintptr_t load_bias = 0;
-    for (int i = 0; i < ehdr->e_phnum; i++) {
-        if (phdr[i].p_type == PT_LOAD) {
-            load_bias = base - phdr[i].p_vaddr;
-            break;
-        }
-    }
-
-    Elf64_Dyn* dynamic = NULL;
-    for (int i = 0; i < ehdr->e_phnum; i++) {
-        if (phdr[i].p_type == PT_DYNAMIC) {
-            dynamic = (Elf64_Dyn*)(load_bias + phdr[i].p_vaddr);
-            break;
-        }
-    }
-    if (!dynamic) {
-        LOGW("ELF(mem): no PT_DYNAMIC");
-        return NULL;
-    }
-
-    uintptr_t dyn_bias = load_bias; // assume NOT relocated
-    for (Elf64_Dyn* d = dynamic; d->d_tag != DT_NULL; d++) {
-        if (d->d_tag == DT_SYMTAB || d->d_tag == DT_STRTAB) {
-            if (d->d_un.d_ptr >= base) {
-                dyn_bias = 0; // already absolute, don't add bias
-            }
-            break;
-        }
-    }
-    LOGI("ELF(mem): base=0x%lx load_bias=0x%lx dyn_bias=0x%lx",
-         (unsigned long)base, (unsigned long)load_bias, (unsigned long)dyn_bias);
-
-    Elf64_Sym* symtab = NULL;
-    const char* strtab = NULL;
-    uint32_t nchain = 0;
-
-    for (Elf64_Dyn* d = dynamic; d->d_tag != DT_NULL; d++) {
-        if (d->d_tag == DT_SYMTAB)
-            symtab = (Elf64_Sym*)(dyn_bias + d->d_un.d_ptr);
-        else if (d->d_tag == DT_STRTAB)
-            strtab = (const char*)(dyn_bias + d->d_un.d_ptr);
-        else if (d->d_tag == DT_HASH) {
-            uint32_t* h = (uint32_t*)(dyn_bias + d->d_un.d_ptr);
-            nchain = h[1];
-        }
-    }
-
-    if (!symtab || !strtab) {
-        LOGW("ELF(mem): symtab=%p strtab=%p - missing", symtab, strtab);
+    const SymIndex* idx = symindex_get_image(base);
+    SymInfo sym;
+    if (!symindex_find(idx, symbol_name, &sym)) {
+        LOGW("ELF(mem): %s not found at 0x%lx", symbol_name, (unsigned long)base);
         return NULL;
     }
 
-    if (nchain == 0) {
-        uintptr_t sym_start = (uintptr_t)symtab;
-        uintptr_t str_start = (uintptr_t)strtab;
-        if (str_start > sym_start)
-            nchain = (str_start - sym_start) / sizeof(Elf64_Sym);
-        if (nchain == 0 || nchain > 100000)
-            nchain = 10000;
-    }
-
-    LOGI("ELF(mem): symtab=%p strtab=%p nchain=%u, searching for %s",
-         symtab, strtab, nchain, symbol_name);
-
-    for (uint32_t i = 0; i < nchain; i++) {
-        if (symtab[i].st_name && symtab[i].st_value) {
-            const char* name = strtab + symtab[i].st_name;
-            if (strcmp(name, symbol_name) == 0) {
-                void* result = (void*)(load_bias + symtab[i].st_value);
-                LOGI("ELF(mem): Found %s at %p (st_value=0x%lx + bias=0x%lx)",
-                     symbol_name, result,
-                     (unsigned long)symtab[i].st_value, (unsigned long)load_bias);
-                return result;
-            }
-        }
-    }
-    LOGW("ELF(mem): %s not found in %u symbols", symbol_name, nchain);
-    return NULL;
+    void* result = (void*)(symindex_load_bias(idx) + sym.value);
+    LOGI("ELF(mem): Found %s at %p (st_value=0x%lx + bias=0x%lx)",
+         symbol_name, result, (unsigned long)sym.value, (unsigned long)symindex_load_bias(idx));
+    return result;
 }
 
 typedef jobject (*CreateLocalRef_t)(void* self, void* obj);
@@ -821,29 +612,8 @@ static void init_create_local_ref(void) {
     if (g_create_local_ref) return;
 
     // Fall back to ELF parsing
-    FILE* fp = fopen("/proc/self/maps", "r");
-    if (!fp) {
-        LOGE("CreateLocalRef: Cannot open /proc/self/maps");
-        return;
-    }
-
-    char line[512];
-    uintptr_t libart_base = 0;
     char libart_path[256] = {0};
-
-    while (fgets(line, sizeof(line), fp)) {
-        if (strstr(line, "libart.so")) {
-            unsigned long start;
-            char path[256] = {0};
-            if (sscanf(line, "%lx-%*lx %*4s %*x %*s %*d %255s", &start, path) >= 1) {
-                if (libart_base == 0 || start < libart_base) {
-                    libart_base = start;
-                    if (path[0]) strncpy(libart_path, path, sizeof(libart_path) - 1);
-                }
-            }
-        }
-    }
-    fclose(fp);
+    uintptr_t libart_base = maps_module_base("libart.so", libart_path, sizeof(libart_path));
 
     if (!libart_base || !libart_path[0]) {
         LOGE("CreateLocalRef: Could not find libart.so in maps");
@@ -1347,14 +1117,13 @@ static void call_original_via_interpreter(JavaHookInfo* hook, uint64_t* saved_re
     hook->has_stored_return = true;
 }
 
-static uint64_t java_hook_call_original(int hook_index, uint64_t* saved_regs) {
-    if (hook_index < 0 || hook_index >= g_java_hook_count) {
+static uint64_t call_original_locked(int hook_index, uint64_t* saved_regs) {
+    JavaHookInfo* hook = java_hook_at(hook_index);
+    if (!hook) {
         LOGE("java_hook_call_original: Invalid hook index: %d", hook_index);
         return 0;
     }
 
-    JavaHookInfo* hook = &g_java_hooks[hook_index];
-
     LOGI("java_hook_call_original: hook #%d, was_nativized=%d, method_id=%p",
          hook_index, hook->was_nativized, hook->method_id);
 
@@ -1496,14 +1265,13 @@ static uint64_t java_hook_call_original(int hook_index, uint64_t* saved_regs) {
     return result;
 }
 
-void java_hook_on_enter(int hook_index, uint64_t* saved_regs) {
-    if (hook_index < 0 || hook_index >= g_java_hook_count) {
+static void on_enter_locked(int hook_index, uint64_t* saved_regs) {
+    JavaHookInfo* hook = java_hook_at(hook_index);
+    if (!hook) {
         LOGE("Invalid Java hook index: %d", hook_index);
         return;
     }
 
-    JavaHookInfo* hook = &g_java_hooks[hook_index];
-
     if (g_hook_call_stack.depth < MAX_HOOK_CALL_DEPTH) {
         g_hook_call_stack.hook_indices[g_hook_call_stack.depth] = hook_index;
         g_hook_call_stack.depth++;
@@ -1531,11 +1299,9 @@ void java_hook_on_enter(int hook_index, uint64_t* saved_regs) {
     hook->skip_original = false;
 
     if (hook->lua_onEnter_ref != LUA_NOREF && g_lua_engine) {
-        pthread_mutex_lock(&g_java_lua_mutex);
-        lua_State* L = lua_engine_get_state(g_lua_engine);
+        // Dispatch lock is recursive, so nested hooks (parent calling child) are fine
+        lua_State* L = lua_dispatch_acquire(DISPATCH_JAVA, hook->lua_onEnter_ref, hook->lua_flags);
         if (L) {
-            lua_rawgeti(L, LUA_REGISTRYINDEX, hook->lua_onEnter_ref);
-
             lua_newtable(L);
 
             lua_pushstring(L, hook->class_name);
@@ -1585,19 +1351,18 @@ void java_hook_on_enter(int hook_index, uint64_t* saved_regs) {
             }
 
             luaL_unref(L, LUA_REGISTRYINDEX, args_ref);
+            lua_dispatch_release(L);
         }
-        pthread_mutex_unlock(&g_java_lua_mutex);
     }
 }
 
-uint64_t java_hook_on_leave(int hook_index, uint64_t ret_val) {
-    if (hook_index < 0 || hook_index >= g_java_hook_count) {
+static uint64_t on_leave_locked(int hook_index, uint64_t ret_val) {
+    JavaHookInfo* hook = java_hook_at(hook_index);
+    if (!hook) {
         LOGE("Invalid Java hook index in onLeave: %d", hook_index);
         return ret_val;
     }
 
-    JavaHookInfo* hook = &g_java_hooks[hook_index];
-
     LOGI("=== Java Hook #%d onLeave: %s.%s%s (depth=%d) ===",
          hook_index, hook->class_name, hook->method_name, hook->method_sig,
          g_hook_call_stack.depth);
@@ -1609,11 +1374,8 @@ uint64_t java_hook_on_leave(int hook_index, uint64_t ret_val) {
     }
 
     if (hook->lua_onLeave_ref != LUA_NOREF && g_lua_engine) {
-        pthread_mutex_lock(&g_java_lua_mutex);
-        lua_State* L = lua_engine_get_state(g_lua_engine);
+        lua_State* L = lua_dispatch_acquire(DISPATCH_JAVA, hook->lua_onLeave_ref, hook->lua_flags);
         if (L) {
-            lua_rawgeti(L, LUA_REGISTRYINDEX, hook->lua_onLeave_ref);
-
             lua_newtable(L);
 
             lua_pushinteger(L, ret_val);
@@ -1699,8 +1461,8 @@ uint64_t java_hook_on_leave(int hook_index, uint64_t ret_val) {
                 LOGE("Java hook onLeave callback failed: %s", lua_tostring(L, -1));
                 lua_pop(L, 1);
             }
+            lua_dispatch_release(L);
         }
-        pthread_mutex_unlock(&g_java_lua_mutex);
     }
 
     if (g_hook_call_stack.depth > 0) {
@@ -1715,10 +1477,32 @@ uint64_t java_hook_on_leave(int hook_index, uint64_t ret_val) {
     return ret_val;
 }
 
+// Called from the hook trampoline. Each call is its own read section: ART
+// may unwind past the trampoline and skip onLeave. Outside of it a thread
+// is on its way back into the trampoline, so the three are entry text
+// (rcu.h).
+RCU_ENTRY_TEXT void java_hook_on_enter(int hook_index, uint64_t* saved_regs) {
+    rcu_read_lock();
+    on_enter_locked(hook_index, saved_regs);
+    rcu_read_unlock();
+}
+
+RCU_ENTRY_TEXT static uint64_t java_hook_call_original(int hook_index, uint64_t* saved_regs) {
+    rcu_read_lock();
+    uint64_t ret = call_original_locked(hook_index, saved_regs);
+    rcu_read_unlock();
+    return ret;
+}
+
+RCU_ENTRY_TEXT uint64_t java_hook_on_leave(int hook_index, uint64_t ret_val) {
+    rcu_read_lock();
+    ret_val = on_leave_locked(hook_index, ret_val);
+    rcu_read_unlock();
+    return ret_val;
+}
+
 
 int java_hook_init(JNIEnv* env) {
-    pthread_once(&g_lua_mutex_init_once, init_recursive_lua_mutex);
-
     if (g_java_hook_initialized) {
         return 0;
     }
@@ -1732,9 +1516,6 @@ int java_hook_init(JNIEnv* env) {
 
     get_art_method_offsets();
 
-    memset(g_java_hooks, 0, sizeof(g_java_hooks));
-    g_java_hook_count = 0;
-
     if (!g_interpreter_bridge) {
         g_interpreter_bridge = find_interpreter_bridge(env);
         if (g_interpreter_bridge) {
@@ -1768,12 +1549,6 @@ int install_java_hook(JNIEnv* env,
 
     pthread_mutex_lock(&g_java_hook_mutex);
 
-    if (g_java_hook_count >= MAX_JAVA_HOOKS) {
-        LOGE("Maximum Java hooks reached (%d)", MAX_JAVA_HOOKS);
-        pthread_mutex_unlock(&g_java_hook_mutex);
-        return -1;
-    }
-
     LOGI("Installing Java hook: %s.%s%s", class_name, method_name, signature);
 
     char java_class_name[256];
@@ -1960,8 +1735,14 @@ int install_java_hook(JNIEnv* env,
         }
     }
 
-    int hook_index = g_java_hook_count;
-    JavaHookInfo* hook = &g_java_hooks[hook_index];
+    JavaHookInfo* hook = NULL;
+    int hook_index = hook_table_alloc(&g_java_hook_table, (void**)&hook);
+    if (hook_index < 0) {
+        LOGE("Maximum Java hooks reached");
+        (*env)->DeleteLocalRef(env, clazz);
+        pthread_mutex_unlock(&g_java_hook_mutex);
+        return -1;
+    }
 
     strncpy(hook->class_name, class_name, sizeof(hook->class_name) - 1);
     strncpy(hook->method_name, method_name, sizeof(hook->method_name) - 1);
@@ -1971,6 +1752,7 @@ int install_java_hook(JNIEnv* env,
     hook->original_entry_point = original_entry;
     hook->lua_onEnter_ref = onEnter_ref;
     hook->lua_onLeave_ref = onLeave_ref;
+    hook->lua_flags = 0;
     hook->hook_index = hook_index;
     hook->original_access_flags = original_flags;
     hook->was_nativized = need_nativize;
@@ -1983,6 +1765,7 @@ int install_java_hook(JNIEnv* env,
     void* trampoline = create_java_hook_trampoline(hook_index);
     if (!trampoline) {
         LOGE("Failed to create trampoline");
+        hook_table_free(&g_java_hook_table, hook_index);
         (*env)->DeleteLocalRef(env, clazz);
         pthread_mutex_unlock(&g_java_hook_mutex);
         return -1;
@@ -2019,7 +1802,6 @@ int install_java_hook(JNIEnv* env,
     }
 
     hook->is_hooked = true;
-    g_java_hook_count++;
 
     (*env)->DeleteLocalRef(env, clazz);
     pthread_mutex_unlock(&g_java_hook_mutex);
@@ -2030,19 +1812,13 @@ int install_java_hook(JNIEnv* env,
 }
 
 int uninstall_java_hook(int hook_index) {
-    if (hook_index < 0 || hook_index >= g_java_hook_count) {
-        LOGE("Invalid hook index: %d", hook_index);
-        return -1;
-    }
-
     pthread_mutex_lock(&g_java_hook_mutex);
 
-    JavaHookInfo* hook = &g_java_hooks[hook_index];
-
-    if (!hook->is_hooked) {
-        LOGI("Hook %d already uninstalled", hook_index);
+    JavaHookInfo* hook = java_hook_get(hook_index);
+    if (!hook) {
+        LOGE("Invalid hook index: %d", hook_index);
         pthread_mutex_unlock(&g_java_hook_mutex);
-        return 0;
+        return -1;
     }
 
     const ArtMethodOffsets* offsets = get_art_method_offsets();
@@ -2065,26 +1841,29 @@ int uninstall_java_hook(int hook_index) {
     *entry_point_ptr = hook->original_entry_point;
     __builtin___clear_cache((char*)entry_point_ptr, (char*)entry_point_ptr + 8);
 
-    if (hook->hook_trampoline) {
-        munmap(hook->hook_trampoline, PAGE_SIZE);
-        hook->hook_trampoline = NULL;
-    }
+    // The trampoline is freed with the slot, once no thread can be in it
+    int onEnter_ref = __atomic_exchange_n(&hook->lua_onEnter_ref, LUA_NOREF, __ATOMIC_ACQ_REL);
+    int onLeave_ref = __atomic_exchange_n(&hook->lua_onLeave_ref, LUA_NOREF, __ATOMIC_ACQ_REL);
 
     if (g_lua_engine) {
-        lua_State* L = lua_engine_get_state(g_lua_engine);
+        lua_State* L = lua_dispatch_lock(DISPATCH_JAVA);
         if (L) {
-            if (hook->lua_onEnter_ref != LUA_NOREF) {
-                luaL_unref(L, LUA_REGISTRYINDEX, hook->lua_onEnter_ref);
+            // Released refs get reused; only this hook's queued and
+            // cached callbacks go stale
+            if (onEnter_ref != LUA_NOREF) {
+                luaL_unref(L, LUA_REGISTRYINDEX, onEnter_ref);
+                lua_dispatch_invalidate(onEnter_ref);
             }
-            if (hook->lua_onLeave_ref != LUA_NOREF) {
-                luaL_unref(L, LUA_REGISTRYINDEX, hook->lua_onLeave_ref);
+            if (onLeave_ref != LUA_NOREF) {
+                luaL_unref(L, LUA_REGISTRYINDEX, onLeave_ref);
+                lua_dispatch_invalidate(onLeave_ref);
             }
+            lua_dispatch_unlock();
         }
     }
 
-    hook->lua_onEnter_ref = LUA_NOREF;
-    hook->lua_onLeave_ref = LUA_NOREF;
     hook->is_hooked = false;
+    hook_table_retire(&g_java_hook_table, hook_index);
 
     pthread_mutex_unlock(&g_java_hook_mutex);
 
@@ -2094,11 +1873,10 @@ int uninstall_java_hook(int hook_index) {
 
 int uninstall_all_java_hooks(void) {
     int count = 0;
-    for (int i = 0; i < g_java_hook_count; i++) {
-        if (g_java_hooks[i].is_hooked) {
-            if (uninstall_java_hook(i) == 0) {
-                count++;
-            }
+    int limit = hook_table_count(&g_java_hook_table);
+    for (int i = 0; i < limit; i++) {
+        if (java_hook_get(i) && uninstall_java_hook(i) == 0) {
+            count++;
         }
     }
     LOGI("Uninstalled %d Java hooks", count);
@@ -2106,8 +1884,6 @@ int uninstall_all_java_hooks(void) {
 }
 
 void* get_java_hook_original_entry(int hook_index) {
-    if (hook_index < 0 || hook_index >= g_java_hook_count) {
-        return NULL;
-    }
-    return g_java_hooks[hook_index].original_entry_point;
+    JavaHookInfo* hook = java_hook_at(hook_index);
+    return hook ? hook->original_entry_point : NULL;
 }
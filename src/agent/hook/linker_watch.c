@@ -0,0 +1,134 @@
+#include <agent/linker_watch.h>
+#include <agent/hook.h>
+#include <agent/globals.h>
+#include <agent/maps.h>
+#include <agent/symindex.h>
+
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__LP64__)
+#define LINKER_NAME "linker64"
+#else
+#define LINKER_NAME "/linker"
+#endif
+
+#define SYM_CALL_CONSTRUCTORS   "__dl__ZN6soinfo17call_constructorsEv"
+#define SYM_LOADER_DLOPEN       "__loader_dlopen"
+#define SYM_LOADER_DLOPEN_EXT   "__loader_android_dlopen_ext"
+
+typedef void (*call_constructors_fn)(void* si);
+typedef void* (*loader_dlopen_fn)(const char* filename, int flags, const void* caller_addr);
+typedef void* (*loader_dlopen_ext_fn)(const char* filename, int flags, const void* extinfo,
+                                      const void* caller_addr);
+
+// Not in the hook table: `unhook` and uninstall_all_hooks() leave them be
+static HookInfo g_ctor_hook;
+static HookInfo g_dlopen_hook;
+static HookInfo g_dlopen_ext_hook;
+
+static pthread_mutex_t g_watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static LinkerWatchMode g_mode = LINKER_WATCH_NONE;
+static bool g_tried = false;
+static linker_load_fn g_on_load = NULL;
+
+// The callback may load libraries itself
+static __thread int t_notifying = 0;
+
+static void notify_load(void) {
+    if (t_notifying) return;
+    t_notifying = 1;
+    maps_invalidate();
+    linker_load_fn fn = __atomic_load_n(&g_on_load, __ATOMIC_ACQUIRE);
+    if (fn) fn();
+    t_notifying = 0;
+}
+
+static void* original_of(HookInfo* hook) {
+    // Set before the patch went live
+    return __atomic_load_n(&hook->data.trampoline.trampoline_addr, __ATOMIC_ACQUIRE);
+}
+
+// Dependencies come through here too, from inside their parent's call
+static void on_call_constructors(void* si) {
+    notify_load();
+    ((call_constructors_fn)original_of(&g_ctor_hook))(si);
+}
+
+// caller_addr picks the linker namespace, so it is passed on untouched
+static void* on_loader_dlopen(const char* filename, int flags, const void* caller_addr) {
+    void* handle = ((loader_dlopen_fn)original_of(&g_dlopen_hook))(filename, flags, caller_addr);
+    if (handle) notify_load();
+    return handle;
+}
+
+static void* on_loader_dlopen_ext(const char* filename, int flags, const void* extinfo,
+                                  const void* caller_addr) {
+    void* handle = ((loader_dlopen_ext_fn)original_of(&g_dlopen_ext_hook))(filename, flags, extinfo,
+                                                                           caller_addr);
+    if (handle) notify_load();
+    return handle;
+}
+
+static void* linker_symbol(const SymIndex* idx, const char* name) {
+    SymInfo sym;
+    if (!symindex_find(idx, name, &sym) || !sym.defined) {
+        return NULL;
+    }
+    return (void*)(symindex_load_bias(idx) + (uintptr_t)sym.value);
+}
+
+static bool hook_linker(const SymIndex* idx, const char* name, void* handler, HookInfo* hook) {
+    void* target = linker_symbol(idx, name);
+    if (!target) {
+        LOGW("[linker] %s not found", name);
+        return false;
+    }
+    if (install_trampoline_hook(target, handler, hook) != 0) {
+        LOGE("[linker] Failed to hook %s at %p", name, target);
+        hook_info_release(hook);
+        return false;
+    }
+    LOGI("[linker] Hooked %s at %p", name, target);
+    return true;
+}
+
+LinkerWatchMode linker_watch_start(linker_load_fn on_load) {
+    pthread_mutex_lock(&g_watch_lock);
+    if (!g_on_load) {
+        __atomic_store_n(&g_on_load, on_load, __ATOMIC_RELEASE);
+    }
+    if (g_tried) {
+        LinkerWatchMode mode = g_mode;
+        pthread_mutex_unlock(&g_watch_lock);
+        return mode;
+    }
+    g_tried = true;
+
+    const SymIndex* idx = symindex_get(LINKER_NAME);
+    if (!idx) {
+        LOGE("[linker] No symbols for %s", LINKER_NAME);
+    } else if (hook_linker(idx, SYM_CALL_CONSTRUCTORS, (void*)on_call_constructors, &g_ctor_hook)) {
+        g_mode = LINKER_WATCH_CONSTRUCTORS;
+    } else {
+        bool ext = hook_linker(idx, SYM_LOADER_DLOPEN_EXT, (void*)on_loader_dlopen_ext, &g_dlopen_ext_hook);
+        bool plain = hook_linker(idx, SYM_LOADER_DLOPEN, (void*)on_loader_dlopen, &g_dlopen_hook);
+        if (ext || plain) {
+            g_mode = LINKER_WATCH_DLOPEN;
+        }
+        if (ext != plain) {
+            LOGW("[linker] Loads through %s go unseen", ext ? SYM_LOADER_DLOPEN : SYM_LOADER_DLOPEN_EXT);
+        }
+    }
+
+    LinkerWatchMode mode = g_mode;
+    pthread_mutex_unlock(&g_watch_lock);
+    return mode;
+}
+
+LinkerWatchMode linker_watch_mode(void) {
+    pthread_mutex_lock(&g_watch_lock);
+    LinkerWatchMode mode = g_mode;
+    pthread_mutex_unlock(&g_watch_lock);
+    return mode;
+}
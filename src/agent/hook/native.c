@@ -1,15 +1,24 @@
 #include <agent/hook.h>
 #include <agent/globals.h>
 #include <agent/proc.h>
+#include <agent/maps.h>
 #include <agent/lua_thread.h>
-
+#include <agent/lua_dispatch.h>
+#include <agent/trace.h>
+#include <agent/stub_alloc.h>
+#include <agent/relocate.h>
+#include <agent/hook_table.h>
+#include <agent/rcu.h>
+#include <agent/quiesce.h>
+#include <agent/linker_watch.h>
+
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <pthread.h>
-#include <sched.h>
 #include <dlfcn.h>
 #include <link.h>
 #include <elf.h>
@@ -21,12 +30,23 @@
 static __thread int g_hook_reentrant = 0;
 #include <capstone/arm64.h>
 
-HookInfo g_hooks[MAX_HOOKS];
-int g_hook_count = 0;
+static void hook_reclaim(void* elem);
+
+static HookTable g_hook_table = HOOK_TABLE_INIT(HookInfo, hook_reclaim);
 
 __thread int g_current_hook_index = -1;
 
-static pthread_mutex_t g_lua_mutex = PTHREAD_MUTEX_INITIALIZER;
+// The hook a handler entered for, kept across the original function,
+// which runs outside of any read section so that a call that blocks
+// holds up no reclamation. log_return_value() looks the hook up again
+// and checks it is still the same one. The reentrancy guard keeps this
+// one deep.
+typedef struct {
+    int index;
+    uint32_t gen;
+} HookFrame;
+
+static __thread HookFrame t_hook_frame = { -1, 0 };
 
 int change_page_protection(void* addr, int prot) {
     void* page = PAGE_START(addr);
@@ -34,43 +54,83 @@ int change_page_protection(void* addr, int prot) {
         LOGE("mprotect failed: %s", strerror(errno));
         return -1;
     }
+    maps_invalidate();
     return 0;
 }
 
+HookInfo* hook_alloc(int* hook_id) {
+    void* elem = NULL;
+    int id = hook_table_alloc(&g_hook_table, &elem);
+    if (id < 0) return NULL;
+    HookInfo* hook = (HookInfo*)elem;
+    hook->hook_index = id;
+    hook->lua_onEnter_ref = LUA_NOREF;
+    hook->lua_onLeave_ref = LUA_NOREF;
+    *hook_id = id;
+    return hook;
+}
+
+HookInfo* hook_get(int hook_id) {
+    return (HookInfo*)hook_table_get(&g_hook_table, hook_id);
+}
+
+HookInfo* hook_at(int hook_id) {
+    return (HookInfo*)hook_table_at(&g_hook_table, hook_id);
+}
+
+uint32_t hook_generation(int hook_id) {
+    return hook_table_gen(&g_hook_table, hook_id);
+}
+
+int hook_id_limit(void) {
+    return hook_table_count(&g_hook_table);
+}
+
+int hook_active_count(void) {
+    return hook_table_live(&g_hook_table);
+}
+
+void hook_info_release(HookInfo* hook) {
+    if (hook->type == HOOK_TRAMPOLINE && hook->data.trampoline.trampoline_addr) {
+        stub_free(hook->data.trampoline.trampoline_addr);
+        hook->data.trampoline.trampoline_addr = NULL;
+    }
+    if (hook->type == HOOK_PLT_GOT) {
+        free(hook->data.plt_got.got_entries);
+        free(hook->data.plt_got.original_funcs);
+        hook->data.plt_got.got_entries = NULL;
+        hook->data.plt_got.original_funcs = NULL;
+        hook->data.plt_got.capacity = 0;
+    }
+    if (hook->thunk_addr) {
+        stub_free(hook->thunk_addr);
+        hook->thunk_addr = NULL;
+    }
+}
+
+static void hook_reclaim(void* elem) {
+    hook_info_release((HookInfo*)elem);
+}
+
 uint32_t create_branch_insn(void* from, void* to) {
     int64_t offset = (int64_t)to - (int64_t)from;
     offset >>= 2;
     return 0x14000000 | (offset & 0x03FFFFFF);
 }
 
-void* allocate_trampoline(size_t size) {
-    size_t aligned_size = ALIGN_UP(size, PAGE_SIZE);
-    void* mem = mmap(NULL, aligned_size,
-                     PROT_READ | PROT_WRITE | PROT_EXEC,
-                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (mem == MAP_FAILED) {
-        LOGE("mmap failed: %s", strerror(errno));
+void* allocate_trampoline(size_t size, const void* near) {
+    void* mem = stub_alloc(size, near);
+    if (!mem) {
+        LOGE("Failed to allocate %zu byte stub", size);
         return NULL;
     }
     return mem;
 }
 
-size_t disassemble_instructions(void* addr, void** insn_out, size_t min_bytes) {
-    csh handle;
-    size_t count;
-    cs_insn** out = (cs_insn**)insn_out;
-
-    if (cs_open(CS_ARCH_ARM64, CS_MODE_ARM, &handle) != CS_ERR_OK) {
-        LOGE("cs_open failed");
-        return 0;
-    }
-
-    cs_option(handle, CS_OPT_DETAIL, CS_OPT_ON);
-
-    count = cs_disasm(handle, (uint8_t*)addr, 16, (uint64_t)addr, 0, out);
+static size_t disassemble_with(csh handle, void* addr, cs_insn** out, size_t min_bytes) {
+    size_t count = cs_disasm(handle, (uint8_t*)addr, min_bytes, (uint64_t)addr, 0, out);
     if (count == 0) {
         LOGE("cs_disasm failed");
-        cs_close(&handle);
         return 0;
     }
 
@@ -78,7 +138,24 @@ size_t disassemble_instructions(void* addr, void** insn_out, size_t min_bytes) {
     for (size_t i = 0; i < count && total_bytes < min_bytes; i++) {
         total_bytes += (*out)[i].size;
     }
+    return total_bytes;
+}
+
+static bool disasm_open(csh* handle) {
+    if (cs_open(CS_ARCH_ARM64, CS_MODE_ARM, handle) != CS_ERR_OK) {
+        LOGE("cs_open failed");
+        return false;
+    }
+    cs_option(*handle, CS_OPT_DETAIL, CS_OPT_ON);
+    return true;
+}
 
+size_t disassemble_instructions(void* addr, void** insn_out, size_t min_bytes) {
+    csh handle;
+    if (!disasm_open(&handle)) {
+        return 0;
+    }
+    size_t total_bytes = disassemble_with(handle, addr, (cs_insn**)insn_out, min_bytes);
     cs_close(&handle);
     return total_bytes;
 }
@@ -119,6 +196,7 @@ struct got_scan_ctx {
     void* hook_func;            // The hook thunk to redirect to
     HookInfo* hook_info;        // Where to store patched GOT entries
     void* original_func;        // The resolved original function address
+    int mem_fd;                 // /proc/self/mem for the whole scan, or -1
 };
 
 static int got_scan_callback(struct dl_phdr_info *info, size_t size, void *data) {
@@ -211,24 +289,32 @@ static int got_scan_callback(struct dl_phdr_info *info, size_t size, void *data)
             LOGI("Found GOT entry for '%s' in %s at %p (current value: %p)",
                  ctx->sym_name, info->dlpi_name, got_addr, *got_addr);
 
-            int idx = ctx->hook_info->data.plt_got.patched_count;
-            if (idx >= 64) {
-                LOGW("Maximum GOT patches reached (64)");
-                return 1;
+            PltGotHook* plt = &ctx->hook_info->data.plt_got;
+            int idx = plt->patched_count;
+            if (idx == plt->capacity) {
+                int cap = plt->capacity ? plt->capacity * 2 : 8;
+                void*** entries = realloc(plt->got_entries, (size_t)cap * sizeof(void**));
+                if (entries) plt->got_entries = entries;
+                void** originals = entries ? realloc(plt->original_funcs, (size_t)cap * sizeof(void*)) : NULL;
+                if (originals) plt->original_funcs = originals;
+                if (!entries || !originals) {
+                    LOGW("Out of memory after %d GOT patches", idx);
+                    return 1;
+                }
+                plt->capacity = cap;
             }
 
-            ctx->hook_info->data.plt_got.got_entries[idx] = got_addr;
-            ctx->hook_info->data.plt_got.original_funcs[idx] = *got_addr;
+            plt->got_entries[idx] = got_addr;
+            plt->original_funcs[idx] = *got_addr;
             if (idx == 0) {
+                // Handlers call through this one; set before the first patch is live
+                __atomic_store_n(&plt->original_func, *got_addr, __ATOMIC_RELEASE);
                 ctx->original_func = *got_addr;
             }
 
             void* new_val = ctx->hook_func;
-            int got_fd = open("/proc/self/mem", O_RDWR);
-            if (got_fd >= 0) {
-                pwrite(got_fd, &new_val, sizeof(void*), (off_t)(uintptr_t)got_addr);
-                close(got_fd);
-            } else {
+            if (ctx->mem_fd < 0 ||
+                pwrite(ctx->mem_fd, &new_val, sizeof(void*), (off_t)(uintptr_t)got_addr) != sizeof(void*)) {
                 if (change_page_protection(got_addr, PROT_READ | PROT_WRITE) != 0) {
                     LOGE("Failed to change GOT page protection for %p", got_addr);
                     continue;
@@ -268,10 +354,12 @@ int install_plt_got_hook(void* target_func, void* hook_func, HookInfo* hook_info
         .caller_lib = caller_lib,
         .hook_func = hook_func,
         .hook_info = hook_info,
-        .original_func = NULL
+        .original_func = NULL,
+        .mem_fd = open("/proc/self/mem", O_RDWR)
     };
 
     dl_iterate_phdr(got_scan_callback, &ctx);
+    if (ctx.mem_fd >= 0) close(ctx.mem_fd);
 
     if (hook_info->data.plt_got.patched_count == 0) {
         LOGE("No GOT entries found for symbol '%s'", dl_info.dli_sname);
@@ -284,110 +372,316 @@ int install_plt_got_hook(void* target_func, void* hook_func, HookInfo* hook_info
     return 0;
 }
 
-int install_trampoline_hook(void* target_func, void* hook_func, HookInfo* hook_info) {
-    LOGI("Installing trampoline hook: target=%p hook=%p", target_func, hook_func);
+// A trampoline hook built but not yet live: the bytes for its target.
+typedef struct {
+    void* target;
+    uint8_t bytes[16];
+    size_t size;
+} HookPatch;
+
+typedef struct {
+    void* target_func;
+    size_t insn_count;
+} TrampolineCode;
+
+// The moved instructions, then a branch back past them.
+static size_t build_trampoline(uint32_t* code, uintptr_t pc, void* ctx) {
+    TrampolineCode* tc = (TrampolineCode*)ctx;
+    size_t words = relocate_insns((const uint32_t*)tc->target_func, tc->insn_count,
+                                  (uintptr_t)tc->target_func, code, pc);
+    if (words == 0) return 0;
+
+    void* return_addr = (void*)((uintptr_t)tc->target_func + tc->insn_count * 4);
+    void* branch_location = (void*)(pc + words * 4);
+
+    if (stub_in_branch_range(branch_location, return_addr)) {
+        code[words++] = create_branch_insn(branch_location, return_addr);
+    } else {
+        code[words++] = 0x58000050;
+        code[words++] = 0xd61f0200;
+        *(uint64_t*)(&code[words]) = (uint64_t)return_addr;
+        words += 2;
+    }
+    return words * 4;
+}
+
+// Builds the trampoline and the patch for target_func and records them
+// in hook_info, all but target_addr, which marks the patch as written.
+// On failure hook_info_release() frees whatever was allocated.
+static int prepare_trampoline_hook(csh cs, void* target_func, void* hook_func,
+                                   HookInfo* hook_info, HookPatch* patch) {
+    // A hook within B range costs one instruction at the target, else an
+    // absolute LDR x16/BR x16 jump over four.
+    bool near = stub_in_branch_range(target_func, hook_func);
+    size_t patch_size = near ? 4 : 16;
 
     cs_insn* insn = NULL;
-    size_t bytes_to_copy = disassemble_instructions(target_func, (void**)&insn, 16);
-    if (bytes_to_copy == 0) {
+    size_t bytes_to_copy = disassemble_with(cs, target_func, &insn, patch_size);
+    if (bytes_to_copy < patch_size) {
         LOGE("Failed to disassemble target function");
+        if (insn) cs_free(insn, bytes_to_copy / 4);
         return -1;
     }
 
-    LOGI("Will copy %zu bytes from target function", bytes_to_copy);
+    LOGI("Will relocate %zu bytes from target function", bytes_to_copy);
 
     size_t insn_count = bytes_to_copy / 4;
     for (size_t i = 0; i < insn_count; i++) {
         if (is_pc_relative(&insn[i])) {
-            LOGW("PC-relative instruction at offset %zu: %s", i * 4, insn[i].mnemonic);
+            LOGI("Relocating PC-relative instruction at offset %zu: %s %s",
+                 i * 4, insn[i].mnemonic, insn[i].op_str);
         }
     }
+    cs_free(insn, insn_count);
 
-    size_t trampoline_size = bytes_to_copy + 16;
-    void* trampoline = allocate_trampoline(trampoline_size);
+    size_t trampoline_size = insn_count * RELOC_MAX_WORDS * 4 + 16;
+    TrampolineCode tc = { target_func, insn_count };
+    void* trampoline = stub_create(trampoline_size, target_func, build_trampoline, &tc);
     if (!trampoline) {
         LOGE("Failed to allocate trampoline");
-        cs_free(insn, insn_count);
         return -1;
     }
+    hook_info->type = HOOK_TRAMPOLINE;
+    hook_info->data.trampoline.trampoline_addr = trampoline;
+
+    LOGI("Relocated %zu bytes to %p, branch back to %p",
+         bytes_to_copy, trampoline, (void*)((uintptr_t)target_func + bytes_to_copy));
+
+    uint32_t* target = (uint32_t*)target_func;
+    for (size_t i = 0; i < insn_count; i++) {
+        hook_info->data.trampoline.original_insn[i] = target[i];
+    }
+    // Handlers read these as soon as the patch is live
+    hook_info->data.trampoline.hook_addr = hook_func;
+    hook_info->data.trampoline.original_size = bytes_to_copy;
 
-    memcpy(trampoline, target_func, bytes_to_copy);
+    uint32_t* hb = (uint32_t*)patch->bytes;
+    if (near) {
+        hb[0] = create_branch_insn(target_func, hook_func);
+    } else {
+        hb[0] = 0x58000050;
+        hb[1] = 0xd61f0200;
+        *(uint64_t*)(&hb[2]) = (uint64_t)hook_func;
+    }
+    patch->target = target_func;
+    patch->size = patch_size;
+    return 0;
+}
 
-    LOGI("Copied %zu bytes to trampoline at %p", bytes_to_copy, trampoline);
+// Writes a patch through mem_fd (/proc/self/mem, no mprotect needed), or
+// with mprotect when that is -1 or refused. Does not log or allocate, so
+// it is safe while other threads are quiesced.
+static int write_patch(int mem_fd, const HookPatch* patch) {
+    if (mem_fd >= 0 &&
+        pwrite(mem_fd, patch->bytes, patch->size, (off_t)(uintptr_t)patch->target) == (ssize_t)patch->size) {
+        return 0;
+    }
 
-    void* return_addr = (void*)((uintptr_t)target_func + bytes_to_copy);
-    void* branch_location = (void*)((uintptr_t)trampoline + bytes_to_copy);
+    uintptr_t start = (uintptr_t)PAGE_START(patch->target);
+    uintptr_t end = (uintptr_t)patch->target + patch->size;
+    if (mprotect((void*)start, ALIGN_UP(end - start, PAGE_SIZE), PROT_READ | PROT_WRITE | PROT_EXEC) != 0) {
+        return -1;
+    }
+    maps_invalidate();
 
-    uint32_t* branch_insns = (uint32_t*)branch_location;
-    branch_insns[0] = 0x58000050;
-    branch_insns[1] = 0xd61f0200;
-    *(uint64_t*)(&branch_insns[2]) = (uint64_t)return_addr;
+    if (patch->size == 4) {
+        // Single-copy atomic: other threads see the old or the new instruction
+        __atomic_store_n((uint32_t*)patch->target, *(const uint32_t*)patch->bytes, __ATOMIC_RELEASE);
+    } else {
+        memcpy(patch->target, patch->bytes, patch->size);
+    }
+    return 0;
+}
 
-    LOGI("Added branch back: from %p to %p", branch_location, return_addr);
+static void flush_patch(const HookPatch* patch) {
+    __builtin___clear_cache((char*)patch->target, (char*)patch->target + patch->size);
+}
 
-    __builtin___clear_cache((char*)trampoline, (char*)((uintptr_t)trampoline + trampoline_size));
+// The original instructions a patch replaced, as a patch of its own.
+static HookPatch patch_original(const HookPatch* patch, const HookInfo* hook_info) {
+    HookPatch orig = { .target = patch->target, .size = patch->size };
+    memcpy(orig.bytes, hook_info->data.trampoline.original_insn, patch->size);
+    return orig;
+}
 
-    uint32_t* target = (uint32_t*)target_func;
-    hook_info->data.trampoline.original_insn[0] = target[0];
-    if (bytes_to_copy > 4)  hook_info->data.trampoline.original_insn[1] = target[1];
-    if (bytes_to_copy > 8)  hook_info->data.trampoline.original_insn[2] = target[2];
-    if (bytes_to_copy > 12) hook_info->data.trampoline.original_insn[3] = target[3];
+int install_trampoline_hook(void* target_func, void* hook_func, HookInfo* hook_info) {
+    LOGI("Installing trampoline hook: target=%p hook=%p", target_func, hook_func);
 
-    uint8_t hook_bytes[16];
-    uint32_t* hb = (uint32_t*)hook_bytes;
-    hb[0] = 0x58000050;
-    hb[1] = 0xd61f0200;
-    *(uint64_t*)(&hb[2]) = (uint64_t)hook_func;
+    csh cs;
+    if (!disasm_open(&cs)) {
+        return -1;
+    }
+    HookPatch patch;
+    int result = prepare_trampoline_hook(cs, target_func, hook_func, hook_info, &patch);
+    cs_close(&cs);
+    if (result != 0) {
+        return -1;
+    }
 
     int mem_fd = open("/proc/self/mem", O_RDWR);
-    if (mem_fd >= 0) {
-        ssize_t written = pwrite(mem_fd, hook_bytes, 16, (off_t)(uintptr_t)target_func);
-        close(mem_fd);
-        if (written != 16) {
-            LOGE("pwrite failed (%zd): %s, falling back to mprotect", written, strerror(errno));
-            goto mprotect_fallback;
+    result = write_patch(mem_fd, &patch);
+    if (mem_fd >= 0) close(mem_fd);
+    if (result != 0) {
+        LOGE("Failed to write hook at %p: %s", target_func, strerror(errno));
+        return -1;
+    }
+    flush_patch(&patch);
+
+    hook_info->data.trampoline.target_addr = target_func;
+
+    LOGI("Trampoline hook installed: target=%p trampoline=%p patch=%zu bytes",
+         target_func, hook_info->data.trampoline.trampoline_addr, patch.size);
+    return 0;
+}
+
+int install_hook_batch(HookBatchEntry* entries, int count, int flags) {
+    if (count <= 0) return 0;
+
+    HookPatch* patches = calloc((size_t)count, sizeof(HookPatch));
+    HookInfo** hooks = calloc((size_t)count, sizeof(HookInfo*));
+    csh cs;
+    if (!patches || !hooks || !disasm_open(&cs)) {
+        LOGE("Hook batch: cannot start (%d targets)", count);
+        free(patches);
+        free(hooks);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        entries[i].hook_id = -1;
+    }
+
+    // Phase 1: every thunk and trampoline, nothing patched yet
+    int prepared = 0;
+    int failed = -1;
+    for (; prepared < count; prepared++) {
+        HookBatchEntry* e = &entries[prepared];
+        HookInfo* hook = hook_alloc(&e->hook_id);
+        if (!hook) {
+            failed = prepared;
+            break;
         }
-        LOGI("Wrote hook via /proc/self/mem (no mprotect)");
-    } else {
-        mprotect_fallback:
-        if (change_page_protection(target_func, PROT_READ | PROT_WRITE | PROT_EXEC) != 0) {
-            LOGE("Failed to change target page protection");
-            munmap(trampoline, ALIGN_UP(trampoline_size, PAGE_SIZE));
-            cs_free(insn, insn_count);
-            return -1;
+        hooks[prepared] = hook;
+        hook->lua_onEnter_ref = e->onEnter_ref;
+        hook->lua_onLeave_ref = e->onLeave_ref;
+        hook->lua_flags = e->lua_flags;
+
+        hook->thunk_addr = create_hook_thunk(e->hook_id, e->target);
+        if (!hook->thunk_addr ||
+            prepare_trampoline_hook(cs, e->target, hook->thunk_addr, hook, &patches[prepared]) != 0) {
+            failed = prepared;
+            prepared++;
+            break;
+        }
+
+        const HookPatch* p = &patches[prepared];
+        for (int j = 0; j < prepared; j++) {
+            const HookPatch* q = &patches[j];
+            if ((uintptr_t)p->target < (uintptr_t)q->target + q->size &&
+                (uintptr_t)q->target < (uintptr_t)p->target + p->size) {
+                LOGE("Hook batch: target %p overlaps %p", p->target, q->target);
+                failed = prepared;
+                break;
+            }
+        }
+        if (failed >= 0) {
+            prepared++;
+            break;
         }
-        memcpy(target_func, hook_bytes, 16);
-        LOGI("Wrote hook via mprotect fallback");
     }
+    cs_close(&cs);
+
+    // Phase 2: all patches through one descriptor, then one flush pass
+    int written = 0;
+    int busy = -1;
+    int parked = 0;
+    int unparked = 0;
+    int write_errno = 0;
+    if (failed < 0) {
+        int mem_fd = open("/proc/self/mem", O_RDWR);
+        parked = (flags & HOOK_BATCH_QUIESCE) ? threads_quiesce() : -1;
+        // One that did not stop could be anywhere
+        if (parked >= 0) unparked = threads_unparked();
+
+        // A thread stopped inside the replaced instructions, or about to
+        // return into them, would resume in the middle of the patch
+        for (int i = 0; parked > 0 && !unparked && i < count && busy < 0; i++) {
+            if (threads_quiesced_in((uintptr_t)patches[i].target + 4,
+                                    (uintptr_t)patches[i].target + patches[i].size)) {
+                busy = i;
+            }
+        }
 
-    __builtin___clear_cache((char*)target_func, (char*)((uintptr_t)target_func + 16));
+        if (busy < 0 && !unparked) {
+            for (; written < count; written++) {
+                if (write_patch(mem_fd, &patches[written]) != 0) {
+                    write_errno = errno;
+                    break;
+                }
+            }
+        }
+        if (written < count) {
+            for (int i = 0; i < written; i++) {
+                HookPatch orig = patch_original(&patches[i], hooks[i]);
+                write_patch(mem_fd, &orig);
+            }
+        }
+        for (int i = 0; i < written; i++) {
+            flush_patch(&patches[i]);
+        }
 
-    hook_info->type = HOOK_TRAMPOLINE;
-    hook_info->data.trampoline.target_addr = target_func;
-    hook_info->data.trampoline.trampoline_addr = trampoline;
-    hook_info->data.trampoline.hook_addr = hook_func;
-    hook_info->data.trampoline.original_size = bytes_to_copy;
+        if (parked >= 0) threads_resume();
+        if (mem_fd >= 0) close(mem_fd);
+
+        if (unparked) {
+            LOGE("Hook batch: %d threads did not stop within %d ms, nothing patched",
+                 unparked, QUIESCE_TIMEOUT_MS);
+            failed = 0;
+        } else if (busy >= 0) {
+            LOGE("Hook batch: a thread is executing inside %p, nothing patched", patches[busy].target);
+            failed = busy;
+        } else if (written < count) {
+            LOGE("Hook batch: writing %p failed (%s), %d patches reverted",
+                 patches[written].target, strerror(write_errno), written);
+            failed = written;
+        }
+    }
 
-    cs_free(insn, insn_count);
+    if (failed >= 0) {
+        for (int i = 0; i < prepared; i++) {
+            if (i < written) {
+                // Reverted, but a thread may have gone through it meanwhile
+                __atomic_store_n(&hooks[i]->lua_onEnter_ref, LUA_NOREF, __ATOMIC_RELEASE);
+                __atomic_store_n(&hooks[i]->lua_onLeave_ref, LUA_NOREF, __ATOMIC_RELEASE);
+                hook_table_retire(&g_hook_table, entries[i].hook_id);
+            } else if (hooks[i]) {
+                hook_info_release(hooks[i]);
+                hook_table_free(&g_hook_table, entries[i].hook_id);
+            }
+            entries[i].hook_id = -1;
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            hooks[i]->data.trampoline.target_addr = entries[i].target;
+        }
+        LOGI("Hook batch: %d trampoline hooks installed%s", count,
+             parked >= 0 ? " (threads quiesced)" : "");
+    }
 
-    LOGI("Trampoline hook installed: target=%p trampoline=%p", target_func, trampoline);
-    return 0;
+    free(patches);
+    free(hooks);
+    return failed >= 0 ? -1 : count;
 }
 
 int uninstall_hook(int hook_id) {
-    if (hook_id < 0 || hook_id >= g_hook_count) {
+    HookInfo* hook = hook_get(hook_id);
+    if (!hook) {
         LOGE("Invalid hook ID: %d", hook_id);
         return -1;
     }
 
-    HookInfo* hook = &g_hooks[hook_id];
-
-    if (hook->type == HOOK_TRAMPOLINE) {
-        if (hook->data.trampoline.target_addr == NULL) {
-            LOGI("Hook %d already uninstalled", hook_id);
-            return 0;
-        }
-
+    // Nothing to unpatch when installing it failed half way
+    if (hook->type == HOOK_TRAMPOLINE && hook->data.trampoline.target_addr) {
         void* target = hook->data.trampoline.target_addr;
 
         if (change_page_protection(target, PROT_READ | PROT_WRITE | PROT_EXEC) != 0) {
@@ -396,26 +690,18 @@ int uninstall_hook(int hook_id) {
         }
 
         uint32_t* target_insns = (uint32_t*)target;
-        target_insns[0] = hook->data.trampoline.original_insn[0];
-        target_insns[1] = hook->data.trampoline.original_insn[1];
-        target_insns[2] = hook->data.trampoline.original_insn[2];
-        target_insns[3] = hook->data.trampoline.original_insn[3];
-
-        __builtin___clear_cache((char*)target, (char*)((uintptr_t)target + 16));
-
-        if (hook->data.trampoline.trampoline_addr) {
-            munmap(hook->data.trampoline.trampoline_addr, PAGE_SIZE);
+        size_t restore = hook->data.trampoline.original_size / 4;
+        for (size_t i = 0; i < restore; i++) {
+            __atomic_store_n(&target_insns[i], hook->data.trampoline.original_insn[i], __ATOMIC_RELEASE);
         }
 
+        __builtin___clear_cache((char*)target, (char*)((uintptr_t)target + restore * 4));
+
+        // The trampoline stays until the slot is reclaimed: handlers in
+        // flight still call through it.
         hook->data.trampoline.target_addr = NULL;
-        hook->data.trampoline.trampoline_addr = NULL;
 
     } else if (hook->type == HOOK_PLT_GOT) {
-        if (hook->data.plt_got.patched_count == 0) {
-            LOGI("Hook %d already uninstalled", hook_id);
-            return 0;
-        }
-
         for (int i = 0; i < hook->data.plt_got.patched_count; i++) {
             void** got_entry = hook->data.plt_got.got_entries[i];
             if (!got_entry) continue;
@@ -431,28 +717,30 @@ int uninstall_hook(int hook_id) {
         }
 
         hook->data.plt_got.patched_count = 0;
-
-        if (hook->thunk_addr) {
-            munmap(hook->thunk_addr, PAGE_SIZE);
-            hook->thunk_addr = NULL;
-        }
     }
 
-    if (g_lua_engine && hook->lua_onEnter_ref != LUA_NOREF) {
-        lua_State* L = lua_engine_get_state(g_lua_engine);
-        if (L) {
-            luaL_unref(L, LUA_REGISTRYINDEX, hook->lua_onEnter_ref);
-        }
-    }
-    if (g_lua_engine && hook->lua_onLeave_ref != LUA_NOREF) {
-        lua_State* L = lua_engine_get_state(g_lua_engine);
+    // Handlers still in flight see no callbacks from here on
+    int onEnter_ref = __atomic_exchange_n(&hook->lua_onEnter_ref, LUA_NOREF, __ATOMIC_ACQ_REL);
+    int onLeave_ref = __atomic_exchange_n(&hook->lua_onLeave_ref, LUA_NOREF, __ATOMIC_ACQ_REL);
+
+    if (g_lua_engine) {
+        lua_State* L = lua_dispatch_lock(DISPATCH_NATIVE);
         if (L) {
-            luaL_unref(L, LUA_REGISTRYINDEX, hook->lua_onLeave_ref);
+            // Released refs get reused; only this hook's queued and
+            // cached callbacks go stale
+            if (onEnter_ref != LUA_NOREF) {
+                luaL_unref(L, LUA_REGISTRYINDEX, onEnter_ref);
+                lua_dispatch_invalidate(onEnter_ref);
+            }
+            if (onLeave_ref != LUA_NOREF) {
+                luaL_unref(L, LUA_REGISTRYINDEX, onLeave_ref);
+                lua_dispatch_invalidate(onLeave_ref);
+            }
+            lua_dispatch_unlock();
         }
     }
 
-    hook->lua_onEnter_ref = LUA_NOREF;
-    hook->lua_onLeave_ref = LUA_NOREF;
+    hook_table_retire(&g_hook_table, hook_id);
 
     LOGI("Hook %d uninstalled", hook_id);
     return 0;
@@ -460,16 +748,9 @@ int uninstall_hook(int hook_id) {
 
 int uninstall_all_hooks(void) {
     int count = 0;
-    for (int i = 0; i < g_hook_count; i++) {
-        bool is_installed = false;
-
-        if (g_hooks[i].type == HOOK_TRAMPOLINE) {
-            is_installed = (g_hooks[i].data.trampoline.target_addr != NULL);
-        } else if (g_hooks[i].type == HOOK_PLT_GOT) {
-            is_installed = (g_hooks[i].data.plt_got.patched_count > 0);
-        }
-
-        if (is_installed && uninstall_hook(i) == 0) {
+    int limit = hook_id_limit();
+    for (int i = 0; i < limit; i++) {
+        if (hook_get(i) && uninstall_hook(i) == 0) {
             count++;
         }
     }
@@ -477,16 +758,9 @@ int uninstall_all_hooks(void) {
     return count;
 }
 
-void* create_hook_thunk(int hook_index) {
-    void* thunk = mmap(NULL, PAGE_SIZE,
-                       PROT_READ | PROT_WRITE | PROT_EXEC,
-                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (thunk == MAP_FAILED) {
-        LOGE("Failed to allocate thunk");
-        return NULL;
-    }
-
-    uint32_t* code = (uint32_t*)thunk;
+static size_t build_hook_thunk(uint32_t* code, uintptr_t pc, void* ctx) {
+    (void)pc;
+    int hook_index = *(int*)ctx;
 
     code[0] = 0xD2800011 | ((hook_index & 0xFFFF) << 5);
 
@@ -497,8 +771,15 @@ void* create_hook_thunk(int hook_index) {
     code[3] = 0xD503201F;
 
     *(uint64_t*)(&code[4]) = (uint64_t)generic_hook_handler;
+    return 32;
+}
 
-    __builtin___clear_cache((char*)thunk, (char*)thunk + 32);
+void* create_hook_thunk(int hook_index, const void* near) {
+    void* thunk = stub_create(32, near, build_hook_thunk, &hook_index);
+    if (!thunk) {
+        LOGE("Failed to allocate thunk");
+        return NULL;
+    }
 
     LOGI("Created thunk at %p for hook index %d", thunk, hook_index);
     return thunk;
@@ -513,85 +794,161 @@ typedef struct {
     uintptr_t offset;
     int onEnter_ref;
     int onLeave_ref;
+    int lua_flags;
     char caller_lib[128];
     bool active;
 } PendingHook;
 
-#define MAX_PENDING_HOOKS 16
-static PendingHook g_pending_hooks[MAX_PENDING_HOOKS];
+#define DEFERRED_POLL_MS    10      // only without a linker watch
+
+// Grown under g_pending_lock; finished entries are reused.
+static PendingHook* g_pending_hooks = NULL;
 static int g_pending_hook_count = 0;
-static bool g_dlopen_hooked = false;
+static int g_pending_hook_cap = 0;
+static pthread_mutex_t g_pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool g_pending_polling = false;
 
-static void try_install_pending_hooks(void);
+static int try_install_pending_hooks(bool in_linker);
+static bool install_lua_hook_at(uintptr_t base, uintptr_t offset, int onEnter_ref, int onLeave_ref,
+                                const char* caller_lib, int lua_flags);
 
+// Last resort when the linker cannot be hooked: look for loads on a timer.
 static void* deferred_poll_thread(void* arg) {
     (void)arg;
-    LOGI("[deferred] Poll thread started (busy-wait for lib load)");
+    LOGI("[deferred] Poll thread started (every %d ms)", DEFERRED_POLL_MS);
 
-    // Busy-wait poll: no sleep between iterations. Maximizes chances of
-    // installing the hook between dlopen() returning and the first call
-    // to the hooked function. sched_yield() lets other threads run but
-    // we resume polling as soon as the scheduler gives us CPU.
     while (1) {
-        bool all_done = true;
-        for (int i = 0; i < g_pending_hook_count; i++) {
-            if (g_pending_hooks[i].active) {
-                all_done = false;
-                break;
+        if (try_install_pending_hooks(false) == 0) {
+            // Stop unless a hook was added since the scan
+            pthread_mutex_lock(&g_pending_lock);
+            bool any = false;
+            for (int i = 0; i < g_pending_hook_count && !any; i++) {
+                any = g_pending_hooks[i].active;
             }
+            if (!any) g_pending_polling = false;
+            pthread_mutex_unlock(&g_pending_lock);
+            if (!any) break;
         }
-        if (all_done) break;
-
-        try_install_pending_hooks();
-        sched_yield(); // give other threads a chance, but no sleep
+        usleep(DEFERRED_POLL_MS * 1000);
     }
 
     LOGI("[deferred] All pending hooks installed, poll thread exiting");
     return NULL;
 }
 
-static void start_deferred_poll(void) {
-    if (g_dlopen_hooked) return;
-    g_dlopen_hooked = true;
+// Runs on the loading thread inside the linker, with its lock held and
+// before the new library's constructors (LINKER_WATCH_CONSTRUCTORS): its
+// pending hooks are live before any of its code runs, JNI_OnLoad
+// included. Bases come straight from /proc/self/maps and no Lua state is
+// touched, so nothing here waits on a thread that is calling into the
+// linker.
+static void on_library_load(void) {
+    if (pending_hook_count() == 0) return;
+    int saved_errno = errno;
+    try_install_pending_hooks(true);
+    errno = saved_errno;
+}
+
+static void start_deferred_watch(void) {
+    if (linker_watch_start(on_library_load) != LINKER_WATCH_NONE) {
+        // The library may have loaded before the watch was in place
+        try_install_pending_hooks(false);
+        return;
+    }
 
-    pthread_t tid;
-    pthread_create(&tid, NULL, deferred_poll_thread, NULL);
-    pthread_detach(tid);
-    LOGI("[deferred] Started library load watcher (busy-wait)");
+    pthread_mutex_lock(&g_pending_lock);
+    if (!g_pending_polling) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, deferred_poll_thread, NULL) == 0) {
+            pthread_detach(tid);
+            g_pending_polling = true;
+        } else {
+            LOGE("[deferred] Failed to start library load watcher");
+        }
+    }
+    pthread_mutex_unlock(&g_pending_lock);
 }
 
-static void try_install_pending_hooks(void) {
-    for (int i = 0; i < g_pending_hook_count; i++) {
-        PendingHook* ph = &g_pending_hooks[i];
-        if (!ph->active) continue;
+// Installs the hooks whose library is loaded; returns how many still wait.
+// in_linker: called back by the linker, which must not be called into.
+static int try_install_pending_hooks(bool in_linker) {
+    int remaining = 0;
+
+    pthread_mutex_lock(&g_pending_lock);
+    int count = g_pending_hook_count;
+    pthread_mutex_unlock(&g_pending_lock);
+
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&g_pending_lock);
+        PendingHook ph = g_pending_hooks[i];
+        pthread_mutex_unlock(&g_pending_lock);
+        if (!ph.active) continue;
+
+        uintptr_t base = in_linker ? maps_read_module_base(ph.lib_name)
+                                   : (uintptr_t)find_library_base(ph.lib_name);
+        if (base == 0) {
+            remaining++;
+            continue;
+        }
 
-        uintptr_t base = (uintptr_t)find_library_base(ph->lib_name);
-        if (base == 0) continue;
+        // Loads on other threads race for the same entry
+        pthread_mutex_lock(&g_pending_lock);
+        bool claimed = g_pending_hooks[i].active;
+        g_pending_hooks[i].active = false;
+        pthread_mutex_unlock(&g_pending_lock);
+        if (!claimed) continue;
 
         LOGI("[deferred] Library %s now loaded at 0x%lx, installing hook at +0x%lx",
-             ph->lib_name, base, ph->offset);
+             ph.lib_name, base, ph.offset);
 
-        // Install the hook now
-        ph->active = false;
-        install_lua_hook(ph->lib_name, ph->offset,
-                        ph->onEnter_ref, ph->onLeave_ref,
-                        ph->caller_lib[0] ? ph->caller_lib : NULL);
+        install_lua_hook_at(base, ph.offset,
+                            ph.onEnter_ref, ph.onLeave_ref,
+                            ph.caller_lib[0] ? ph.caller_lib : NULL,
+                            ph.lua_flags);
     }
+    return remaining;
+}
+
+int pending_hook_count(void) {
+    int count = 0;
+    pthread_mutex_lock(&g_pending_lock);
+    for (int i = 0; i < g_pending_hook_count; i++) {
+        if (g_pending_hooks[i].active) count++;
+    }
+    pthread_mutex_unlock(&g_pending_lock);
+    return count;
 }
 
 static bool add_pending_hook(const char* lib_name, uintptr_t offset,
                              int onEnter_ref, int onLeave_ref,
-                             const char* caller_lib) {
-    if (g_pending_hook_count >= MAX_PENDING_HOOKS) {
-        LOGE("[deferred] Maximum pending hooks reached");
-        return false;
+                             const char* caller_lib, int lua_flags) {
+    pthread_mutex_lock(&g_pending_lock);
+
+    PendingHook* ph = NULL;
+    for (int i = 0; i < g_pending_hook_count && !ph; i++) {
+        if (!g_pending_hooks[i].active) ph = &g_pending_hooks[i];
+    }
+    if (!ph) {
+        if (g_pending_hook_count == g_pending_hook_cap) {
+            int cap = g_pending_hook_cap ? g_pending_hook_cap * 2 : 16;
+            PendingHook* grown = realloc(g_pending_hooks, (size_t)cap * sizeof(PendingHook));
+            if (!grown) {
+                pthread_mutex_unlock(&g_pending_lock);
+                LOGE("[deferred] Out of memory for pending hooks");
+                return false;
+            }
+            g_pending_hooks = grown;
+            g_pending_hook_cap = cap;
+        }
+        ph = &g_pending_hooks[g_pending_hook_count++];
     }
 
-    PendingHook* ph = &g_pending_hooks[g_pending_hook_count++];
+    memset(ph, 0, sizeof(*ph));
     strncpy(ph->lib_name, lib_name, sizeof(ph->lib_name) - 1);
     ph->offset = offset;
     ph->onEnter_ref = onEnter_ref;
     ph->onLeave_ref = onLeave_ref;
+    ph->lua_flags = lua_flags;
     if (caller_lib) {
         strncpy(ph->caller_lib, caller_lib, sizeof(ph->caller_lib) - 1);
     } else {
@@ -599,42 +956,50 @@ static bool add_pending_hook(const char* lib_name, uintptr_t offset,
     }
     ph->active = true;
 
-    // Start polling for library loads
-    start_deferred_poll();
+    pthread_mutex_unlock(&g_pending_lock);
 
     LOGI("[deferred] Pending hook registered: %s+0x%lx (will install on load)",
          lib_name, offset);
+
+    start_deferred_watch();
     return true;
 }
 
 // ============================================================
 
-bool install_lua_hook(const char* lib_name, uintptr_t offset, int onEnter_ref, int onLeave_ref, const char* caller_lib) {
+bool install_lua_hook(const char* lib_name, uintptr_t offset, int onEnter_ref, int onLeave_ref,
+                      const char* caller_lib, int lua_flags) {
     LOGI("Installing Lua hook: %s+0x%lx", lib_name, offset);
 
     uintptr_t base = (uintptr_t)find_library_base(lib_name);
     if (base == 0) {
         LOGI("Library %s not loaded yet, deferring hook", lib_name);
-        return add_pending_hook(lib_name, offset, onEnter_ref, onLeave_ref, caller_lib);
+        return add_pending_hook(lib_name, offset, onEnter_ref, onLeave_ref, caller_lib, lua_flags);
     }
+    return install_lua_hook_at(base, offset, onEnter_ref, onLeave_ref, caller_lib, lua_flags);
+}
 
+// Also run by the linker's load callback: takes no lock whose holder
+// calls into the linker.
+static bool install_lua_hook_at(uintptr_t base, uintptr_t offset, int onEnter_ref, int onLeave_ref,
+                                const char* caller_lib, int lua_flags) {
     uintptr_t target_addr = base + offset;
     LOGI("Hook target address: 0x%lx", target_addr);
 
-    if (g_hook_count >= MAX_HOOKS) {
+    int hook_index;
+    HookInfo* hook_info = hook_alloc(&hook_index);
+    if (!hook_info) {
         LOGE("Maximum hooks reached");
         return false;
     }
-
-    int hook_index = g_hook_count;
-    HookInfo* hook_info = &g_hooks[hook_index];
     hook_info->lua_onEnter_ref = onEnter_ref;
     hook_info->lua_onLeave_ref = onLeave_ref;
-    hook_info->hook_index = hook_index;
+    hook_info->lua_flags = lua_flags;
 
-    void* thunk = create_hook_thunk(hook_index);
+    void* thunk = create_hook_thunk(hook_index, (void*)target_addr);
     if (!thunk) {
         LOGE("Failed to create hook thunk");
+        hook_table_free(&g_hook_table, hook_index);
         return false;
     }
     hook_info->thunk_addr = thunk;
@@ -650,12 +1015,11 @@ bool install_lua_hook(const char* lib_name, uintptr_t offset, int onEnter_ref, i
 
     if (result != 0) {
         LOGE("Failed to install hook");
-        munmap(thunk, PAGE_SIZE);
+        hook_info_release(hook_info);
+        hook_table_free(&g_hook_table, hook_index);
         return false;
     }
 
-    g_hook_count++;
-
     LOGI("Lua hook #%d installed (type=%s, onEnter=%d, onLeave=%d)",
          hook_index,
          (caller_lib && strlen(caller_lib) > 0) ? "PLT/GOT" : "Trampoline",
@@ -663,19 +1027,40 @@ bool install_lua_hook(const char* lib_name, uintptr_t offset, int onEnter_ref, i
     return true;
 }
 
+// What handlers call the original through: the trampoline, or the
+// function a GOT entry held. Inside a read section.
+static void* original_of(int hook_index) {
+    HookInfo* hook = hook_at(hook_index);
+    if (hook) {
+        if (hook->type == HOOK_TRAMPOLINE) {
+            return hook->data.trampoline.trampoline_addr;
+        } else if (hook->type == HOOK_PLT_GOT) {
+            return __atomic_load_n(&hook->data.plt_got.original_func, __ATOMIC_ACQUIRE);
+        }
+    }
+    return NULL;
+}
+
 // Check reentrancy and return trampoline address for bypass.
 // Returns NULL if not reentrant (normal path), or trampoline addr to skip handler.
-void* check_hook_reentrant(int hook_index) {
+// The normal path holds an RCU read section until hook_call_original().
+RCU_ENTRY_TEXT void* check_hook_reentrant(int hook_index) {
     if (g_hook_reentrant) {
         // Reentrant: return trampoline so handler can be bypassed
-        g_current_hook_index = hook_index;
-        return get_current_trampoline();
+        rcu_read_lock();
+        void* trampoline = original_of(hook_index);
+        rcu_read_unlock();
+        return trampoline;
     }
     g_hook_reentrant = 1;
+    rcu_read_lock();
     return NULL;
 }
 
-__attribute__((naked)) void generic_hook_handler(void) {
+// Up to the read lock in check_hook_reentrant(), and on the reentrant
+// bypass, the handler is entry text (rcu.h); the rest is in a section of
+// its own.
+RCU_ENTRY_TEXT __attribute__((naked)) void generic_hook_handler(void) {
     __asm__ __volatile__(
         "stp x29, x30, [sp, #-16]!\n"
         "mov x29, sp\n"
@@ -704,7 +1089,27 @@ __attribute__((naked)) void generic_hook_handler(void) {
         "ldr x0, [sp, #256]\n"       // x0 = hook_index
         "bl check_hook_reentrant\n"
         "cbnz x0, .Lreentrant_bypass\n" // if non-NULL, skip handler
+        "b .Lhook_body\n"
+
+        // Reentrant bypass: skip handler, go straight to trampoline. Still
+        // entry text: the trampoline is held in no read section
+        ".Lreentrant_bypass:\n"
+        "str x0, [sp, #264]\n"       // store trampoline addr
 
+        "ldp x0, x1, [sp, #0]\n"
+        "ldp x2, x3, [sp, #16]\n"
+        "ldp x4, x5, [sp, #32]\n"
+        "ldp x6, x7, [sp, #48]\n"
+        "ldp x8, x9, [sp, #64]\n"
+
+        "ldr x16, [sp, #264]\n"
+
+        "add sp, sp, #288\n"
+        "ldp x29, x30, [sp], #16\n"
+        "br x16\n"                    // tail-call trampoline (no blr — don't return here)
+
+        ".pushsection .text.generic_hook_handler_body,\"ax\",%progbits\n"
+        ".Lhook_body:\n"
         // Normal path: run hook handler
         "ldr x0, [sp, #256]\n"
         "bl set_current_hook_index\n"
@@ -712,7 +1117,7 @@ __attribute__((naked)) void generic_hook_handler(void) {
         "mov x0, sp\n"
         "bl hook_logger\n"
 
-        "bl get_current_trampoline\n"
+        "bl hook_call_original\n"
         "str x0, [sp, #264]\n"
 
         "ldp x0, x1, [sp, #0]\n"
@@ -730,27 +1135,14 @@ __attribute__((naked)) void generic_hook_handler(void) {
         "add sp, sp, #288\n"
         "ldp x29, x30, [sp], #16\n"
         "ret\n"
-
-        // Reentrant bypass: skip handler, go straight to trampoline
-        ".Lreentrant_bypass:\n"
-        "str x0, [sp, #264]\n"       // store trampoline addr
-
-        "ldp x0, x1, [sp, #0]\n"
-        "ldp x2, x3, [sp, #16]\n"
-        "ldp x4, x5, [sp, #32]\n"
-        "ldp x6, x7, [sp, #48]\n"
-        "ldp x8, x9, [sp, #64]\n"
-
-        "ldr x16, [sp, #264]\n"
-
-        "add sp, sp, #288\n"
-        "ldp x29, x30, [sp], #16\n"
-        "br x16\n"                    // tail-call trampoline (no blr — don't return here)
+        ".popsection\n"
     );
 }
 
 void set_current_hook_index(int index) {
     g_current_hook_index = index;
+    t_hook_frame.index = index;
+    t_hook_frame.gen = hook_generation(index);
 }
 
 void hook_logger(uint64_t* saved_regs) {
@@ -767,26 +1159,28 @@ void hook_logger(uint64_t* saved_regs) {
         g_current_jni_env = (JNIEnv*)x0;
     }
 
-    verbose_log("=== HOOK #%d: Function Called ===", g_current_hook_index);
-    verbose_log("  x0-x3: 0x%llx 0x%llx 0x%llx 0x%llx",
+    trace_log("=== HOOK #%lld: Function Called ===", (long long)g_current_hook_index);
+    trace_log("  x0-x3: 0x%llx 0x%llx 0x%llx 0x%llx",
          (unsigned long long)x0, (unsigned long long)x1,
          (unsigned long long)x2, (unsigned long long)x3);
 
-    verbose_log("  [DEBUG] g_lua_engine=%p, hook_index=%d", g_lua_engine, g_current_hook_index);
-
     g_hook_caller_fp = saved_regs[36];
     g_hook_caller_lr = saved_regs[37];
 
-    if (g_current_hook_index >= 0 && g_lua_engine) {
-        HookInfo* hook = &g_hooks[g_current_hook_index];
-        verbose_log("  [DEBUG] onEnter_ref=%d (NOREF=%d)", hook->lua_onEnter_ref, LUA_NOREF);
-
-        if (hook->lua_onEnter_ref != LUA_NOREF) {
-            pthread_mutex_lock(&g_lua_mutex);
-            lua_State* L = lua_engine_get_state(g_lua_engine);
-            verbose_log("  [DEBUG] lua_State=%p", L);
+    HookInfo* hook = g_lua_engine ? hook_at(g_current_hook_index) : NULL;
+    if (hook) {
+        if (hook->lua_onEnter_ref != LUA_NOREF && (hook->lua_flags & DISPATCH_ASYNC)) {
+            DispatchEvent* ev = lua_dispatch_event_new(DISPATCH_NATIVE, DISPATCH_EV_ARGS,
+                                                       hook->lua_onEnter_ref, NULL);
+            if (ev) {
+                ev->nargs = 8;
+                memcpy(ev->args, saved_regs, 8 * sizeof(uint64_t));
+                lua_dispatch_post(ev);
+            }
+        } else if (hook->lua_onEnter_ref != LUA_NOREF) {
+            lua_State* L = lua_dispatch_acquire(DISPATCH_NATIVE, hook->lua_onEnter_ref,
+                                                hook->lua_flags);
             if (L) {
-                lua_rawgeti(L, LUA_REGISTRYINDEX, hook->lua_onEnter_ref);
                 lua_newtable(L);
 
                 uint64_t params[] = {x0, x1, x2, x3, x4, x5, x6, x7};
@@ -799,20 +1193,17 @@ void hook_logger(uint64_t* saved_regs) {
                 lua_pushvalue(L, -1);
                 int args_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
-                verbose_log("  [DEBUG] Calling lua_pcall...");
                 if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
                     LOGE("onEnter callback failed: %s", lua_tostring(L, -1));
                     lua_pop(L, 1);
                 } else {
-                    verbose_log("  [DEBUG] lua_pcall succeeded");
-
                     lua_rawgeti(L, LUA_REGISTRYINDEX, args_ref);
                     for (int i = 0; i < 8; i++) {
                         lua_rawgeti(L, -1, i);
                         if (lua_isinteger(L, -1)) {
                             uint64_t new_val = (uint64_t)lua_tointeger(L, -1);
                             if (new_val != saved_regs[i]) {
-                                verbose_log("  Arg %d modified: 0x%llx -> 0x%llx", i,
+                                trace_log("  Arg %lld modified: 0x%llx -> 0x%llx", (long long)i,
                                     (unsigned long long)saved_regs[i], (unsigned long long)new_val);
                                 saved_regs[i] = new_val;
                             }
@@ -823,11 +1214,11 @@ void hook_logger(uint64_t* saved_regs) {
                 }
 
                 luaL_unref(L, LUA_REGISTRYINDEX, args_ref);
+                lua_dispatch_release(L);
             }
-            pthread_mutex_unlock(&g_lua_mutex);
         }
     } else {
-        verbose_log("  [DEBUG] Skipped: engine=%p, index=%d", g_lua_engine, g_current_hook_index);
+        trace_log("  Skipped: engine=%p, index=%lld", (void*)g_lua_engine, (long long)g_current_hook_index);
     }
 
     g_hook_caller_fp = 0;
@@ -835,9 +1226,21 @@ void hook_logger(uint64_t* saved_regs) {
     // Note: don't reset g_hook_reentrant here — log_return_value still needs it
 }
 
+// Ends the read section check_hook_reentrant() opened; the trampoline
+// stays marked in use until log_return_value().
+void* hook_call_original(void) {
+    void* original = original_of(t_hook_frame.index);
+    rcu_call_enter(original);
+    rcu_read_unlock();
+    return original;
+}
+
 uint64_t log_return_value(uint64_t ret_val) {
-    verbose_log("=== HOOK: Function Returned ===");
-    verbose_log("  x0 (return): 0x%llx (%lld)", (unsigned long long)ret_val, (long long)ret_val);
+    rcu_read_lock();
+    rcu_call_exit();
+
+    trace_log("=== HOOK: Function Returned ===");
+    trace_log("  x0 (return): 0x%llx (%lld)", (unsigned long long)ret_val, (long long)ret_val);
 
     uintptr_t my_fp;
     __asm__ volatile("mov %0, x29" : "=r"(my_fp));
@@ -845,14 +1248,28 @@ uint64_t log_return_value(uint64_t ret_val) {
     g_hook_caller_fp = *(uintptr_t*)handler_fp;
     g_hook_caller_lr = *(uintptr_t*)(handler_fp + 8);
 
-    if (g_current_hook_index >= 0 && g_lua_engine) {
-        HookInfo* hook = &g_hooks[g_current_hook_index];
-
-        if (hook->lua_onLeave_ref != LUA_NOREF) {
-            pthread_mutex_lock(&g_lua_mutex);
-            lua_State* L = lua_engine_get_state(g_lua_engine);
+    HookInfo* hook = g_lua_engine ? hook_at(t_hook_frame.index) : NULL;
+    int onLeave_ref = LUA_NOREF;
+    int lua_flags = 0;
+    if (hook) {
+        onLeave_ref = __atomic_load_n(&hook->lua_onLeave_ref, __ATOMIC_ACQUIRE);
+        lua_flags = hook->lua_flags;
+        // Reclaimed and handed to another hook during the call
+        if (hook_generation(t_hook_frame.index) != t_hook_frame.gen) {
+            onLeave_ref = LUA_NOREF;
+        }
+    }
+    if (onLeave_ref != LUA_NOREF) {
+        if (lua_flags & DISPATCH_ASYNC) {
+            DispatchEvent* ev = lua_dispatch_event_new(DISPATCH_NATIVE, DISPATCH_EV_RETVAL,
+                                                       onLeave_ref, NULL);
+            if (ev) {
+                ev->retval = ret_val;
+                lua_dispatch_post(ev);
+            }
+        } else {
+            lua_State* L = lua_dispatch_acquire(DISPATCH_NATIVE, onLeave_ref, lua_flags);
             if (L) {
-                lua_rawgeti(L, LUA_REGISTRYINDEX, hook->lua_onLeave_ref);
                 lua_pushinteger(L, ret_val);
 
                 if (lua_pcall(L, 1, 1, 0) == LUA_OK) {
@@ -884,41 +1301,28 @@ uint64_t log_return_value(uint64_t ret_val) {
                         }
                     } else if (lua_isinteger(L, -1) || lua_isnumber(L, -1)) {
                         ret_val = (uint64_t)lua_tointeger(L, -1);
-                        verbose_log("  Modified to: 0x%llx", (unsigned long long)ret_val);
+                        trace_log("  Modified to: 0x%llx", (unsigned long long)ret_val);
                     }
                     lua_pop(L, 1);
                 } else {
                     LOGE("onLeave callback failed: %s", lua_tostring(L, -1));
                     lua_pop(L, 1);
                 }
+                lua_dispatch_release(L);
             }
-            pthread_mutex_unlock(&g_lua_mutex);
         }
     }
 
     g_hook_caller_fp = 0;
     g_hook_caller_lr = 0;
     g_hook_reentrant = 0;  // Reset guard at the very end of hook processing
+    rcu_read_unlock();
     return ret_val;
 }
 
-void* get_current_trampoline(void) {
-    if (g_current_hook_index >= 0) {
-        HookInfo* hook = &g_hooks[g_current_hook_index];
-
-        if (hook->type == HOOK_TRAMPOLINE) {
-            return hook->data.trampoline.trampoline_addr;
-        } else if (hook->type == HOOK_PLT_GOT) {
-            return (hook->data.plt_got.patched_count > 0)
-                ? hook->data.plt_got.original_funcs[0]
-                : NULL;
-        }
-    }
-    return NULL;
-}
-
 bool install_lua_java_hook(const char* class_name, const char* method_name,
-                           const char* signature, int onEnter_ref, int onLeave_ref) {
+                           const char* signature, int onEnter_ref, int onLeave_ref,
+                           int lua_flags) {
     if (!g_current_jni_env) {
         LOGE("JNIEnv not available for Java hook");
         return false;
@@ -930,5 +1334,9 @@ bool install_lua_java_hook(const char* class_name, const char* method_name,
                                    signature,
                                    onEnter_ref,
                                    onLeave_ref);
+    if (result >= 0) {
+        JavaHookInfo* hook = java_hook_get(result);
+        if (hook) hook->lua_flags = lua_flags;
+    }
     return result >= 0;
 }
@@ -0,0 +1,221 @@
+#include <agent/quiesce.h>
+#include <agent/globals.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/syscall.h>
+
+// Above the real-time signals bionic keeps for itself (SIGRTMIN already
+// skips those); nothing else in the agent or ART uses it.
+#define QUIESCE_SIGNAL  (SIGRTMIN + 5)
+
+static pthread_mutex_t g_quiesce_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_quiesce_once = PTHREAD_ONCE_INIT;
+static bool g_handler_ok = false;
+
+// A round is open while g_round != g_released. Handlers wait for their
+// own round, so one still leaving the previous round is not confused
+// with the next, whose signal it takes right after.
+static uint32_t g_round = 0;
+static uint32_t g_released = 0;
+static int g_parked = 0;                // threads that reached the handler
+static int g_signalled = 0;
+static int g_missed = 0;                // listed, but no room to track them
+static int g_slots = 0;
+
+// Grown before a round opens, to the thread count. Replaced arrays are
+// never freed: a handler of an earlier round that timed out may still
+// write to the one it loaded.
+typedef struct {
+    int capacity;
+    uintptr_t* pcs;
+    uintptr_t* lrs;
+    uintptr_t* ips;             // x16 and x17, two per slot
+} ParkSlots;
+
+static ParkSlots* g_park = NULL;
+static pid_t* g_tids = NULL;
+static int g_tids_cap = 0;
+
+static void quiesce_handler(int sig, siginfo_t* info, void* ucontext) {
+    (void)sig;
+    (void)info;
+    int saved_errno = errno;
+
+    // A late signal from an earlier round has nothing to wait for
+    uint32_t round = __atomic_load_n(&g_round, __ATOMIC_ACQUIRE);
+    if (round != __atomic_load_n(&g_released, __ATOMIC_ACQUIRE)) {
+        ParkSlots* park = __atomic_load_n(&g_park, __ATOMIC_ACQUIRE);
+        int slot = __atomic_fetch_add(&g_slots, 1, __ATOMIC_RELAXED);
+        if (park && slot < park->capacity) {
+#if defined(__aarch64__)
+            park->pcs[slot] = (uintptr_t)((ucontext_t*)ucontext)->uc_mcontext.pc;
+            park->lrs[slot] = (uintptr_t)((ucontext_t*)ucontext)->uc_mcontext.regs[30];
+            park->ips[slot * 2] = (uintptr_t)((ucontext_t*)ucontext)->uc_mcontext.regs[16];
+            park->ips[slot * 2 + 1] = (uintptr_t)((ucontext_t*)ucontext)->uc_mcontext.regs[17];
+#elif defined(__x86_64__)
+            park->pcs[slot] = (uintptr_t)((ucontext_t*)ucontext)->uc_mcontext.gregs[REG_RIP];
+            park->lrs[slot] = 0;
+            park->ips[slot * 2] = 0;
+            park->ips[slot * 2 + 1] = 0;
+#else
+            (void)ucontext;
+            park->pcs[slot] = 0;
+            park->lrs[slot] = 0;
+            park->ips[slot * 2] = 0;
+            park->ips[slot * 2 + 1] = 0;
+#endif
+        }
+        __atomic_add_fetch(&g_parked, 1, __ATOMIC_RELEASE);
+
+        while (__atomic_load_n(&g_released, __ATOMIC_ACQUIRE) != round) {
+            sched_yield();
+        }
+    }
+
+    errno = saved_errno;
+}
+
+static void install_handler(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = quiesce_handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+    sigfillset(&sa.sa_mask);
+    if (sigaction(QUIESCE_SIGNAL, &sa, NULL) == 0) {
+        g_handler_ok = true;
+    } else {
+        LOGE("quiesce: sigaction failed: %s", strerror(errno));
+    }
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static bool grow_park_slots(int count) {
+    ParkSlots* park = g_park;
+    if (park && park->capacity >= count) return true;
+
+    int capacity = park ? park->capacity : QUIESCE_INITIAL_THREADS;
+    while (capacity < count) capacity *= 2;
+    ParkSlots* grown = malloc(sizeof(*grown));
+    uintptr_t* pcs = calloc((size_t)capacity, sizeof(uintptr_t));
+    uintptr_t* lrs = calloc((size_t)capacity, sizeof(uintptr_t));
+    uintptr_t* ips = calloc((size_t)capacity * 2, sizeof(uintptr_t));
+    if (!grown || !pcs || !lrs || !ips) {
+        free(grown);
+        free(pcs);
+        free(lrs);
+        free(ips);
+        return false;
+    }
+    *grown = (ParkSlots){ capacity, pcs, lrs, ips };
+    __atomic_store_n(&g_park, grown, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Read before anything is parked: opendir and the arrays allocate.
+// Threads there is no room for are counted in g_missed.
+static int list_threads(pid_t self) {
+    g_missed = 0;
+    DIR* dir = opendir("/proc/self/task");
+    int count = 0;
+    struct dirent* ent;
+    while (dir && (ent = readdir(dir))) {
+        pid_t tid = (pid_t)atoi(ent->d_name);
+        if (tid <= 0 || tid == self) continue;
+        if (count == g_tids_cap) {
+            int cap = g_tids_cap ? g_tids_cap * 2 : QUIESCE_INITIAL_THREADS;
+            pid_t* grown = realloc(g_tids, (size_t)cap * sizeof(pid_t));
+            if (!grown) {
+                g_missed++;
+                continue;
+            }
+            g_tids = grown;
+            g_tids_cap = cap;
+        }
+        g_tids[count++] = tid;
+    }
+    if (dir) closedir(dir);
+
+    if (!grow_park_slots(count)) {
+        g_missed += count ? count : 1;
+        return 0;
+    }
+    return count;
+}
+
+int threads_quiesce(void) {
+    pthread_once(&g_quiesce_once, install_handler);
+    pthread_mutex_lock(&g_quiesce_lock);
+    if (!g_handler_ok) {
+        pthread_mutex_unlock(&g_quiesce_lock);
+        return -1;
+    }
+
+    pid_t pid = getpid();
+    int count = list_threads((pid_t)syscall(SYS_gettid));
+
+    // A slot taken but not yet filled matches nothing
+    if (g_park) {
+        memset(g_park->pcs, 0, (size_t)g_park->capacity * sizeof(uintptr_t));
+        memset(g_park->lrs, 0, (size_t)g_park->capacity * sizeof(uintptr_t));
+        memset(g_park->ips, 0, (size_t)g_park->capacity * 2 * sizeof(uintptr_t));
+    }
+    __atomic_store_n(&g_parked, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_slots, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_round, 1, __ATOMIC_RELEASE);
+
+    int signalled = 0;
+    for (int i = 0; i < count; i++) {
+        // Threads that exited since the listing fail with ESRCH
+        if (syscall(SYS_tgkill, pid, g_tids[i], QUIESCE_SIGNAL) == 0) {
+            signalled++;
+        }
+    }
+
+    uint64_t deadline = now_ms() + QUIESCE_TIMEOUT_MS;
+    while (__atomic_load_n(&g_parked, __ATOMIC_ACQUIRE) < signalled && now_ms() < deadline) {
+        sched_yield();
+    }
+    g_signalled = signalled;
+
+    // Lock stays held until threads_resume()
+    return __atomic_load_n(&g_parked, __ATOMIC_ACQUIRE);
+}
+
+int threads_unparked(void) {
+    int missing = g_signalled - __atomic_load_n(&g_parked, __ATOMIC_ACQUIRE);
+    return (missing > 0 ? missing : 0) + g_missed;
+}
+
+bool threads_quiesced_in(uintptr_t lo, uintptr_t hi) {
+    if (!g_park) return false;
+    int n = __atomic_load_n(&g_slots, __ATOMIC_ACQUIRE);
+    if (n > g_park->capacity) n = g_park->capacity;
+    for (int i = 0; i < n; i++) {
+        if (g_park->pcs[i] >= lo && g_park->pcs[i] < hi) return true;
+        // A leaf callee (or one that has not saved LR yet) returns there
+        if (g_park->lrs[i] >= lo && g_park->lrs[i] < hi) return true;
+        // Loaded for a BR/BLR not taken yet (thunk, PLT and far patch jumps)
+        if (g_park->ips[i * 2] >= lo && g_park->ips[i * 2] < hi) return true;
+        if (g_park->ips[i * 2 + 1] >= lo && g_park->ips[i * 2 + 1] < hi) return true;
+    }
+    return false;
+}
+
+void threads_resume(void) {
+    __atomic_store_n(&g_released, __atomic_load_n(&g_round, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_quiesce_lock);
+}
@@ -0,0 +1,216 @@
+#include <agent/relocate.h>
+
+#define X17             17
+#define INSN_NOP        0xD503201F
+#define INSN_BR_X17     0xD61F0220
+#define INSN_BLR_X17    0xD63F0220
+
+enum insn_class {
+    INSN_OTHER,
+    INSN_B,             // B, BL: imm26
+    INSN_BCOND,         // B.cond, CBZ/CBNZ: imm19
+    INSN_TBZ,           // TBZ/TBNZ: imm14
+    INSN_ADR,
+    INSN_ADRP,
+    INSN_LDR_LIT,       // LDR (literal), LDRSW, PRFM, SIMD loads: imm19
+};
+
+static enum insn_class classify(uint32_t insn) {
+    if ((insn & 0x7C000000) == 0x14000000) return INSN_B;
+    if ((insn & 0xFF000000) == 0x54000000) return INSN_BCOND;
+    if ((insn & 0x7E000000) == 0x34000000) return INSN_BCOND;
+    if ((insn & 0x7E000000) == 0x36000000) return INSN_TBZ;
+    if ((insn & 0x9F000000) == 0x10000000) return INSN_ADR;
+    if ((insn & 0x9F000000) == 0x90000000) return INSN_ADRP;
+    if ((insn & 0x3B000000) == 0x18000000) return INSN_LDR_LIT;
+    return INSN_OTHER;
+}
+
+bool reloc_is_pc_relative(uint32_t insn) {
+    return classify(insn) != INSN_OTHER;
+}
+
+static int64_t sext(uint64_t v, int bits) {
+    return (int64_t)(v << (64 - bits)) >> (64 - bits);
+}
+
+// Whether a byte delta fits a signed word-scaled field of `bits`.
+static bool fits(int64_t delta, int bits) {
+    int64_t lim = (int64_t)1 << (bits + 1);
+    return delta >= -lim && delta < lim;
+}
+
+static uint32_t with_imm(uint32_t insn, int shift, int bits, int64_t value) {
+    uint32_t mask = ((1U << bits) - 1) << shift;
+    return (insn & ~mask) | (((uint32_t)value << shift) & mask);
+}
+
+static uint32_t with_adr_imm(uint32_t insn, int64_t imm) {
+    insn &= ~((3U << 29) | (0x7FFFFU << 5));
+    return insn | (((uint32_t)imm & 3) << 29) | ((((uint32_t)imm >> 2) & 0x7FFFF) << 5);
+}
+
+static uintptr_t target_of(uint32_t insn, enum insn_class cls, uintptr_t pc) {
+    switch (cls) {
+    case INSN_B:
+        return pc + (sext(insn & 0x03FFFFFF, 26) << 2);
+    case INSN_BCOND:
+    case INSN_LDR_LIT:
+        return pc + (sext((insn >> 5) & 0x7FFFF, 19) << 2);
+    case INSN_TBZ:
+        return pc + (sext((insn >> 5) & 0x3FFF, 14) << 2);
+    case INSN_ADR:
+    case INSN_ADRP: {
+        int64_t imm = sext((((insn >> 5) & 0x7FFFF) << 2) | ((insn >> 29) & 3), 21);
+        if (cls == INSN_ADR) return pc + imm;
+        return (pc & ~(uintptr_t)0xFFF) + (imm << 12);
+    }
+    default:
+        return 0;
+    }
+}
+
+typedef struct {
+    uint32_t* out;      // NULL while sizing
+    size_t n;
+} Emitter;
+
+static void put(Emitter* e, uint32_t word) {
+    if (e->out) e->out[e->n] = word;
+    e->n++;
+}
+
+static void put_quad(Emitter* e, uint64_t value) {
+    put(e, (uint32_t)value);
+    put(e, (uint32_t)(value >> 32));
+}
+
+static uint32_t ldr_literal_x(int rt, int words) {
+    return 0x58000000 | ((uint32_t)words << 5) | (uint32_t)rt;
+}
+
+// One instruction, moved from pc to at, branching to `target` if it is PC-relative.
+static void emit(Emitter* e, uint32_t insn, enum insn_class cls, uintptr_t target, uintptr_t at) {
+    int64_t delta = (int64_t)(target - at);
+    int rt = insn & 0x1F;
+
+    switch (cls) {
+    case INSN_OTHER:
+        put(e, insn);
+        return;
+
+    case INSN_B:
+        if (fits(delta, 26)) {
+            put(e, with_imm(insn, 0, 26, delta >> 2));
+        } else if (insn & 0x80000000) {     // BL: return past the literal
+            put(e, ldr_literal_x(X17, 3));
+            put(e, INSN_BLR_X17);
+            put(e, 0x14000003);
+            put_quad(e, target);
+        } else {
+            put(e, ldr_literal_x(X17, 2));
+            put(e, INSN_BR_X17);
+            put_quad(e, target);
+        }
+        return;
+
+    case INSN_BCOND:
+    case INSN_TBZ: {
+        int shift = 5, bits = cls == INSN_TBZ ? 14 : 19;
+        if (fits(delta, bits)) {
+            put(e, with_imm(insn, shift, bits, delta >> 2));
+            return;
+        }
+        // Taken: skip to an absolute jump. Not taken: skip over it.
+        put(e, with_imm(insn, shift, bits, 2));
+        put(e, 0x14000005);
+        put(e, ldr_literal_x(X17, 2));
+        put(e, INSN_BR_X17);
+        put_quad(e, target);
+        return;
+    }
+
+    case INSN_ADR:
+    case INSN_ADRP:
+        if (cls == INSN_ADR && fits(delta, 19)) {
+            put(e, with_adr_imm(insn, delta));
+            return;
+        }
+        if (cls == INSN_ADRP) {
+            int64_t pages = (int64_t)(target >> 12) - (int64_t)(at >> 12);
+            if (pages >= -(1 << 20) && pages < (1 << 20)) {
+                put(e, with_adr_imm(insn, pages));
+                return;
+            }
+        }
+        put(e, ldr_literal_x(rt, 2));
+        put(e, 0x14000003);
+        put_quad(e, target);
+        return;
+
+    case INSN_LDR_LIT: {
+        if (fits(delta, 19)) {
+            put(e, with_imm(insn, 5, 19, delta >> 2));
+            return;
+        }
+        uint32_t opc = insn >> 30;
+        bool simd = (insn >> 26) & 1;
+        if (!simd && opc == 3) {            // PRFM: only a hint
+            put(e, INSN_NOP);
+            return;
+        }
+        // GPR loads fetch the address into the destination itself
+        int base = simd ? X17 : rt;
+        uint32_t load;
+        if (simd) {
+            static const uint32_t simd_loads[] = { 0xBD400000, 0xFD400000, 0x3DC00000 };
+            load = simd_loads[opc < 3 ? opc : 2];
+        } else {
+            static const uint32_t gpr_loads[] = { 0xB9400000, 0xF9400000, 0xB9800000 };
+            load = gpr_loads[opc];
+        }
+        put(e, ldr_literal_x(base, 3));
+        put(e, load | ((uint32_t)base << 5) | (uint32_t)rt);
+        put(e, 0x14000003);
+        put_quad(e, target);
+        return;
+    }
+    }
+}
+
+// Whether a code target lies in the block being moved. Literal loads keep
+// their address: the copy of an expanded instruction is not its data.
+static bool internal(enum insn_class cls, uintptr_t target, uintptr_t src_pc, size_t count) {
+    if (cls == INSN_OTHER || cls == INSN_ADRP || cls == INSN_LDR_LIT) return false;
+    return target >= src_pc && target < src_pc + count * 4 && (target - src_pc) % 4 == 0;
+}
+
+size_t relocate_insns(const uint32_t* src, size_t count, uintptr_t src_pc,
+                      uint32_t* out, uintptr_t out_pc) {
+    size_t offsets[RELOC_MAX_INSNS];
+    if (count > RELOC_MAX_INSNS) return 0;
+
+    // Sizing pass: branches within the block stay short, so their size
+    // does not depend on where the copies land.
+    Emitter e = { NULL, 0 };
+    for (size_t i = 0; i < count; i++) {
+        offsets[i] = e.n;
+        enum insn_class cls = classify(src[i]);
+        uintptr_t at = out_pc + e.n * 4;
+        uintptr_t target = target_of(src[i], cls, src_pc + i * 4);
+        emit(&e, src[i], cls, internal(cls, target, src_pc, count) ? at : target, at);
+    }
+
+    e.out = out;
+    e.n = 0;
+    for (size_t i = 0; i < count; i++) {
+        enum insn_class cls = classify(src[i]);
+        uintptr_t at = out_pc + e.n * 4;
+        uintptr_t target = target_of(src[i], cls, src_pc + i * 4);
+        if (internal(cls, target, src_pc, count)) {
+            target = out_pc + offsets[(target - src_pc) / 4] * 4;
+        }
+        emit(&e, src[i], cls, target, at);
+    }
+    return e.n;
+}
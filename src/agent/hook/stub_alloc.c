@@ -0,0 +1,416 @@
+#include <agent/stub_alloc.h>
+#include <agent/globals.h>
+#include <agent/maps.h>
+#include <agent/quiesce.h>
+#include <agent/rcu.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000    // older kernels take it as a plain hint
+#endif
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+#define SLAB_SLOTS          (STUB_SLAB_SIZE / STUB_SLOT_SIZE)
+#define SLAB_WORDS          (SLAB_SLOTS / 64)
+#define NEAR_CANDIDATES     8
+#define LOWEST_SLAB_ADDR    (1024 * 1024)   // stay clear of mmap_min_addr
+
+typedef struct StubSlab {
+    uint8_t* rx;
+    uint8_t* rw;                // == rx without dual mapping
+    uint64_t used[SLAB_WORDS];
+    uint64_t parked[SLAB_WORDS];    // by first slot: freed, code kept
+    uint16_t run[SLAB_SLOTS];   // slots of the stub starting at each slot
+    uint32_t len[SLAB_SLOTS];   // bytes of code committed to it
+    uint64_t parked_at[SLAB_SLOTS];     // rcu_retire_stamp() when parked
+    int free_slots;
+    struct StubSlab* next;
+} StubSlab;
+
+static pthread_mutex_t g_stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static StubSlab* g_slabs = NULL;
+static int g_memfd_state = 0;   // 0 untried, 1 works, -1 exec mappings refused
+static StubStats g_stats;
+
+static bool slot_used(const StubSlab* s, int i) {
+    return (s->used[i / 64] >> (i % 64)) & 1;
+}
+
+static bool slot_parked(const StubSlab* s, int i) {
+    return (s->parked[i / 64] >> (i % 64)) & 1;
+}
+
+static void set_parked(StubSlab* s, int i, bool parked) {
+    if (parked) s->parked[i / 64] |= 1ULL << (i % 64);
+    else s->parked[i / 64] &= ~(1ULL << (i % 64));
+}
+
+static void mark_slots(StubSlab* s, int first, int n, bool used) {
+    for (int i = first; i < first + n; i++) {
+        if (used) s->used[i / 64] |= 1ULL << (i % 64);
+        else s->used[i / 64] &= ~(1ULL << (i % 64));
+    }
+}
+
+// First run of n free slots, or -1.
+static int find_run(const StubSlab* s, int n) {
+    if (s->free_slots < n) return -1;
+    int start = 0, len = 0;
+    for (int i = 0; i < SLAB_SLOTS; i++) {
+        if (slot_used(s, i)) {
+            len = 0;
+            start = i + 1;
+            continue;
+        }
+        if (++len == n) return start;
+    }
+    return -1;
+}
+
+static bool slab_reaches(const StubSlab* s, const void* near) {
+    return stub_in_branch_range(near, s->rx) && stub_in_branch_range(near, s->rx + STUB_SLAB_SIZE);
+}
+
+// Both views of a memfd, or anonymous RWX memory once exec mappings of a
+// memfd turned out to be refused. hint = 0: anywhere.
+static StubSlab* slab_map(uintptr_t hint) {
+    int fixed = hint ? MAP_FIXED_NOREPLACE : 0;
+    uint8_t* rx = MAP_FAILED;
+    uint8_t* rw = MAP_FAILED;
+
+    if (g_memfd_state >= 0) {
+        int fd = (int)syscall(__NR_memfd_create, "renef-stubs", MFD_CLOEXEC);
+        if (fd >= 0 && ftruncate(fd, STUB_SLAB_SIZE) == 0) {
+            rx = mmap((void*)hint, STUB_SLAB_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED | fixed, fd, 0);
+            if (rx == MAP_FAILED && (errno == EACCES || errno == EPERM)) {
+                LOGW("stubs: exec mapping of memfd refused, using RWX memory");
+                g_memfd_state = -1;
+            } else if (rx != MAP_FAILED) {
+                rw = mmap(NULL, STUB_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (rw == MAP_FAILED) {
+                    munmap(rx, STUB_SLAB_SIZE);
+                    rx = MAP_FAILED;
+                } else {
+                    g_memfd_state = 1;
+                }
+            }
+        } else if (g_memfd_state == 0) {
+            g_memfd_state = -1;
+        }
+        if (fd >= 0) close(fd);
+        if (rx == MAP_FAILED && g_memfd_state >= 0) return NULL;
+    }
+
+    if (rx == MAP_FAILED) {
+        rx = mmap((void*)hint, STUB_SLAB_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                  MAP_PRIVATE | MAP_ANONYMOUS | fixed, -1, 0);
+        if (rx == MAP_FAILED) return NULL;
+        rw = rx;
+    }
+
+    StubSlab* s = (StubSlab*)calloc(1, sizeof(StubSlab));
+    if (!s) {
+        if (rw != rx) munmap(rw, STUB_SLAB_SIZE);
+        munmap(rx, STUB_SLAB_SIZE);
+        return NULL;
+    }
+    s->rx = rx;
+    s->rw = rw;
+    s->free_slots = SLAB_SLOTS;
+    maps_invalidate();
+    return s;
+}
+
+static void slab_unmap(StubSlab* s) {
+    if (s->rw != s->rx) munmap(s->rw, STUB_SLAB_SIZE);
+    munmap(s->rx, STUB_SLAB_SIZE);
+    free(s);
+    maps_invalidate();
+}
+
+// Unmapped gaps within branch range of near, closest first. Called
+// without g_stub_lock: maps_acquire() asks the loader, and the linker's
+// load callback creates stubs (linker_watch.h).
+static int near_candidates(const void* near, uintptr_t cand[NEAR_CANDIDATES]) {
+    uintptr_t target = (uintptr_t)near;
+    uintptr_t dist[NEAR_CANDIDATES];
+    int count = 0;
+
+    const MapsIndex* idx = maps_acquire();
+    if (!idx) return 0;
+    for (int i = 0; i < idx->count; i++) {
+        uintptr_t gap_start = i > 0 ? idx->regions[i - 1].end : LOWEST_SLAB_ADDR;
+        uintptr_t gap_end = idx->regions[i].start;
+        if (gap_start < LOWEST_SLAB_ADDR) gap_start = LOWEST_SLAB_ADDR;
+        if (gap_end <= gap_start || gap_end - gap_start < STUB_SLAB_SIZE) continue;
+
+        // The end of the gap nearest the target
+        uintptr_t addr = gap_end <= target ? gap_end - STUB_SLAB_SIZE : gap_start;
+        uintptr_t far_end = addr < target ? addr : addr + STUB_SLAB_SIZE;
+        uintptr_t d = far_end < target ? target - far_end : far_end - target;
+        if (d >= STUB_BRANCH_RANGE) continue;
+
+        int pos = count < NEAR_CANDIDATES ? count++ : NEAR_CANDIDATES;
+        if (pos == NEAR_CANDIDATES) {
+            if (d >= dist[NEAR_CANDIDATES - 1]) continue;
+            pos = NEAR_CANDIDATES - 1;
+        }
+        while (pos > 0 && dist[pos - 1] > d) {
+            cand[pos] = cand[pos - 1];
+            dist[pos] = dist[pos - 1];
+            pos--;
+        }
+        cand[pos] = addr;
+        dist[pos] = d;
+    }
+    maps_release(idx);
+    return count;
+}
+
+// A slab at the first candidate that takes one in range of near. NULL if
+// none could be mapped there.
+static StubSlab* slab_map_near(const void* near, const uintptr_t* cand, int count) {
+    for (int i = 0; i < count; i++) {
+        StubSlab* s = slab_map(cand[i]);
+        if (!s) continue;
+        if (slab_reaches(s, near)) return s;
+        slab_unmap(s);      // hint not honoured
+    }
+    return NULL;
+}
+
+// Gives back the slots of the stub starting at first.
+static void slots_release(StubSlab* s, int first) {
+    int n = s->run[first];
+    mark_slots(s, first, n, false);
+    s->run[first] = 0;
+    s->len[first] = 0;
+    s->free_slots += n;
+    g_stats.used_bytes -= (size_t)n * STUB_SLOT_SIZE;
+}
+
+// Frees the slots of parked stubs no thread can be in any more: their
+// grace period is over and nothing calls through them (rcu.h).
+static void reclaim_parked(void) {
+    if (g_stats.parked == 0) return;
+    for (StubSlab* s = g_slabs; s; s = s->next) {
+        for (int w = 0; w < SLAB_WORDS; w++) {
+            for (uint64_t bits = s->parked[w]; bits; bits &= bits - 1) {
+                int first = w * 64 + __builtin_ctzll(bits);
+                uint8_t* stub = s->rx + (size_t)first * STUB_SLOT_SIZE;
+                if (!rcu_grace_over(s->parked_at[first]) ||
+                    rcu_in_call(stub, stub + (size_t)s->run[first] * STUB_SLOT_SIZE)) {
+                    continue;
+                }
+                set_parked(s, first, false);
+                slots_release(s, first);
+                g_stats.parked--;
+                g_stats.reclaimed++;
+            }
+        }
+    }
+}
+
+static void* slab_take(StubSlab* s, int first, int n) {
+    mark_slots(s, first, n, true);
+    s->run[first] = (uint16_t)n;
+    s->len[first] = 0;
+    s->free_slots -= n;
+    g_stats.live++;
+    g_stats.used_bytes += (size_t)n * STUB_SLOT_SIZE;
+    g_stats.allocs++;
+    return s->rx + (size_t)first * STUB_SLOT_SIZE;
+}
+
+// Slabs are only ever pushed, so the list can be walked without the lock
+static void slab_add(StubSlab* s, bool near) {
+    s->next = g_slabs;
+    __atomic_store_n(&g_slabs, s, __ATOMIC_RELEASE);
+    g_stats.slabs++;
+    g_stats.mapped_bytes += STUB_SLAB_SIZE;
+    if (near) g_stats.near_slabs++;
+    g_stats.dual_mapped = s->rw != s->rx;
+}
+
+// n free slots, in reach of near if given.
+static void* take_free(int n, const void* near) {
+    for (StubSlab* s = g_slabs; s; s = s->next) {
+        if (near && !slab_reaches(s, near)) continue;
+        int first = find_run(s, n);
+        if (first >= 0) return slab_take(s, first, n);
+    }
+    return NULL;
+}
+
+void* stub_alloc(size_t size, const void* near) {
+    int n = (int)((size + STUB_SLOT_SIZE - 1) / STUB_SLOT_SIZE);
+    if (n <= 0 || n > SLAB_SLOTS) return NULL;
+
+    pthread_mutex_lock(&g_stub_lock);
+    reclaim_parked();
+    void* stub = take_free(n, near);
+    pthread_mutex_unlock(&g_stub_lock);
+
+    uintptr_t cand[NEAR_CANDIDATES];
+    int count = !stub && near ? near_candidates(near, cand) : 0;
+
+    pthread_mutex_lock(&g_stub_lock);
+    if (!stub && near) {
+        // Another thread may have mapped one there meanwhile
+        stub = take_free(n, near);
+        StubSlab* s = stub ? NULL : slab_map_near(near, cand, count);
+        if (s) {
+            slab_add(s, true);
+            stub = slab_take(s, 0, n);
+        }
+    }
+    if (stub && near) g_stats.near_hits++;
+
+    if (!stub) {
+        stub = take_free(n, NULL);
+        if (!stub) {
+            StubSlab* s = slab_map(0);
+            if (s) {
+                slab_add(s, false);
+                stub = slab_take(s, 0, n);
+            }
+        }
+        if (stub && near) g_stats.near_misses++;
+    }
+
+    pthread_mutex_unlock(&g_stub_lock);
+
+    if (!stub) LOGE("stubs: cannot map a slab: %s", strerror(errno));
+    return stub;
+}
+
+static StubSlab* slab_of(const void* stub) {
+    for (StubSlab* s = g_slabs; s; s = s->next) {
+        if ((const uint8_t*)stub >= s->rx && (const uint8_t*)stub < s->rx + STUB_SLAB_SIZE) return s;
+    }
+    return NULL;
+}
+
+// Gives back the slots of a stub that never ran.
+static void release_unused(void* stub) {
+    pthread_mutex_lock(&g_stub_lock);
+    StubSlab* s = slab_of(stub);
+    int first = s ? (int)(((uint8_t*)stub - s->rx) / STUB_SLOT_SIZE) : -1;
+    if (s && s->run[first] > 0) {
+        slots_release(s, first);
+        g_stats.live--;
+    }
+    pthread_mutex_unlock(&g_stub_lock);
+}
+
+// A thread can still be running in a freed stub (between a restored
+// patch and its handler, or returning through a trampoline), so it stays
+// parked with its code: stub_create() may want exactly that code again,
+// and stub_alloc() frees its slots once RCU says no thread can be in it.
+void stub_free(void* stub) {
+    if (!stub) return;
+    pthread_mutex_lock(&g_stub_lock);
+    StubSlab* s = slab_of(stub);
+    int first = s ? (int)(((uint8_t*)stub - s->rx) / STUB_SLOT_SIZE) : -1;
+    if (s && s->run[first] > 0 && !slot_parked(s, first)) {
+        set_parked(s, first, true);
+        s->parked_at[first] = rcu_retire_stamp();
+        g_stats.live--;
+        g_stats.parked++;
+    } else {
+        LOGW("stubs: free of unknown stub %p", stub);
+    }
+    pthread_mutex_unlock(&g_stub_lock);
+}
+
+// A parked stub of n slots, in reach of near if given, that already
+// holds what build() writes for its address.
+static void* take_parked(int n, const void* near, StubBuildFn build, void* ctx, uint32_t* scratch) {
+    for (StubSlab* s = g_slabs; s; s = s->next) {
+        if (near && !slab_reaches(s, near)) continue;
+        for (int w = 0; w < SLAB_WORDS; w++) {
+            for (uint64_t bits = s->parked[w]; bits; bits &= bits - 1) {
+                int first = w * 64 + __builtin_ctzll(bits);
+                if (s->run[first] != n) continue;
+
+                uint8_t* stub = s->rx + (size_t)first * STUB_SLOT_SIZE;
+                size_t len = build(scratch, (uintptr_t)stub, ctx);
+                if (len == 0 || len != s->len[first] ||
+                    memcmp(s->rw + (size_t)first * STUB_SLOT_SIZE, scratch, len) != 0) {
+                    continue;
+                }
+                set_parked(s, first, false);
+                g_stats.live++;
+                g_stats.parked--;
+                g_stats.reused++;
+                return stub;
+            }
+        }
+    }
+    return NULL;
+}
+
+void* stub_create(size_t size, const void* near, StubBuildFn build, void* ctx) {
+    int n = (int)((size + STUB_SLOT_SIZE - 1) / STUB_SLOT_SIZE);
+    if (n <= 0 || n > SLAB_SLOTS) return NULL;
+    uint32_t* scratch = (uint32_t*)malloc((size_t)n * STUB_SLOT_SIZE);
+    if (!scratch) return NULL;
+
+    pthread_mutex_lock(&g_stub_lock);
+    void* stub = take_parked(n, near, build, ctx, scratch);
+    pthread_mutex_unlock(&g_stub_lock);
+    free(scratch);
+    if (stub) return stub;
+
+    stub = stub_alloc(size, near);
+    if (!stub) return NULL;
+    size_t len = build((uint32_t*)stub_writable(stub), (uintptr_t)stub, ctx);
+    if (len == 0 || len > size) {
+        // Never ran: nothing to keep it parked for
+        release_unused(stub);
+        return NULL;
+    }
+    stub_commit(stub, len);
+    return stub;
+}
+
+void* stub_writable(void* stub) {
+    pthread_mutex_lock(&g_stub_lock);
+    StubSlab* s = slab_of(stub);
+    void* rw = s ? s->rw + ((uint8_t*)stub - s->rx) : NULL;
+    pthread_mutex_unlock(&g_stub_lock);
+    return rw;
+}
+
+void stub_commit(void* stub, size_t len) {
+    // Caches are physically tagged: cleaning through the exec view also
+    // covers what was written through the alias.
+    __builtin___clear_cache((char*)stub, (char*)stub + len);
+
+    pthread_mutex_lock(&g_stub_lock);
+    StubSlab* s = slab_of(stub);
+    if (s) s->len[((uint8_t*)stub - s->rx) / STUB_SLOT_SIZE] = (uint32_t)len;
+    pthread_mutex_unlock(&g_stub_lock);
+}
+
+bool stub_quiesced_in_any(void) {
+    for (StubSlab* s = __atomic_load_n(&g_slabs, __ATOMIC_ACQUIRE); s; s = s->next) {
+        if (threads_quiesced_in((uintptr_t)s->rx, (uintptr_t)s->rx + STUB_SLAB_SIZE)) return true;
+    }
+    return false;
+}
+
+void stub_get_stats(StubStats* out) {
+    pthread_mutex_lock(&g_stub_lock);
+    *out = g_stats;
+    pthread_mutex_unlock(&g_stub_lock);
+}
@@ -6,10 +6,25 @@
 #define CMD_MAX_COMMANDS 128
 #define CMD_MAX_NAME_LEN 64
 
+// Safe to run next to other requests (own locking or no shared state).
+// Everything else runs one at a time, in arrival order.
+#define CMD_F_CONCURRENT 0x1
+// Takes a binary payload: framed requests reach the handler byte for
+// byte (no ~filter, no whitespace trimming) together with their length.
+#define CMD_F_RAW        0x2
+
 typedef int (*cmd_handler_t)(int fd, const char* args);
+typedef int (*cmd_raw_handler_t)(int fd, const char* args, size_t len);
 
 void cmd_register(const char* name, cmd_handler_t handler);
+void cmd_register_flags(const char* name, cmd_handler_t handler, int flags);
+/* Registers with CMD_F_RAW added to flags. */
+void cmd_register_raw(const char* name, cmd_raw_handler_t handler, int flags);
 int cmd_dispatch(int fd, const char* cmd);
+/* cmd is `len` bytes and need not be NUL-terminated past the command name. */
+int cmd_dispatch_raw(int fd, const char* cmd, size_t len);
+/* Flags of the command `cmd` would dispatch to, -1 if there is none. */
+int cmd_flags(const char* cmd);
 void cmd_list(int fd);
 
 #endif
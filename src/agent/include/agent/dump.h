@@ -0,0 +1,79 @@
+#ifndef AGENT_DUMP_H
+#define AGENT_DUMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <agent/frame.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Streamed memory dumps (mdump). The reply is a sequence of records, each
+ * a 24-byte little-endian header followed by `stored` payload bytes:
+ *
+ *   u8 magic (0xD5)  u8 type  u8 codec  u8 reserved
+ *   u32 length  u64 offset  u32 stored  u32 reserved
+ *
+ * offset is relative to the start of the dumped range and length is the
+ * number of bytes of it the record covers. The stream opens with an INFO
+ * record (text "base=0x... size=N path=..."), carries DATA and HOLE
+ * records in ascending offset order and closes with END, whose offset is
+ * where the dump stopped (the range's size unless it was cut short).
+ * Bytes no record covers (dumpmod: gaps between segments) read as zero.
+ */
+
+#define DUMP_MAGIC          0xD5
+#define DUMP_RECORD_SIZE    24
+#define DUMP_CHUNK_SIZE     (64 * 1024)     // bytes of memory per DATA record
+
+typedef enum {
+    DUMP_INFO = 1,
+    DUMP_DATA = 2,      // `length` bytes at `offset`, encoded with `codec`
+    DUMP_HOLE = 3,      // `length` unreadable bytes at `offset`, no payload
+    DUMP_END  = 4
+} DumpRecordType;
+
+typedef enum {
+    DUMP_CODEC_RAW = 0,
+    DUMP_CODEC_LZ4 = 1  // LZ4 block format (agent/lz4.h)
+} DumpCodec;
+
+typedef struct {
+    uint8_t type;
+    uint8_t codec;
+    uint32_t length;
+    uint64_t offset;
+    uint32_t stored;
+} DumpRecord;
+
+static inline void dump_encode(uint8_t out[DUMP_RECORD_SIZE], const DumpRecord* rec) {
+    out[0] = DUMP_MAGIC;
+    out[1] = rec->type;
+    out[2] = rec->codec;
+    out[3] = 0;
+    frame_put32(out + 4, rec->length);
+    frame_put32(out + 8, (uint32_t)rec->offset);
+    frame_put32(out + 12, (uint32_t)(rec->offset >> 32));
+    frame_put32(out + 16, rec->stored);
+    frame_put32(out + 20, 0);
+}
+
+/* False if the bytes aren't a record header. */
+static inline bool dump_decode(const uint8_t in[DUMP_RECORD_SIZE], DumpRecord* out) {
+    if (in[0] != DUMP_MAGIC || in[1] < DUMP_INFO || in[1] > DUMP_END) return false;
+    out->type = in[1];
+    out->codec = in[2];
+    out->length = frame_get32(in + 4);
+    out->offset = (uint64_t)frame_get32(in + 8) | ((uint64_t)frame_get32(in + 12) << 32);
+    out->stored = frame_get32(in + 16);
+    return out->codec <= DUMP_CODEC_LZ4 && out->stored <= FRAME_MAX_PAYLOAD;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef AGENT_ELF_HASH_H
+#define AGENT_ELF_HASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Non-Linux hosts bring their own Elf64_* definitions (see the injector).
+#ifdef __linux__
+#include <elf.h>
+#endif
+#ifndef SHN_UNDEF
+#define SHN_UNDEF 0
+#endif
+#ifndef STN_UNDEF
+#define STN_UNDEF 0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * DT_GNU_HASH / DT_HASH lookups over a .dynsym. Header-only so the agent
+ * and the injector (C++) share one implementation. Tables are passed as
+ * plain pointers, so they can come from a mapped file or a loaded image.
+ */
+
+static inline uint32_t elf_gnu_hash(const char* name) {
+    uint32_t h = 5381;
+    for (const uint8_t* p = (const uint8_t*)name; *p; p++) {
+        h = (h << 5) + h + *p;
+    }
+    return h;
+}
+
+static inline uint32_t elf_sysv_hash(const char* name) {
+    uint32_t h = 0, g;
+    for (const uint8_t* p = (const uint8_t*)name; *p; p++) {
+        h = (h << 4) + *p;
+        g = h & 0xf0000000;
+        if (g) h ^= g >> 24;
+        h &= ~g;
+    }
+    return h;
+}
+
+/* Returns the symbol index, or -1. Undefined symbols are skipped. */
+static inline long elf_gnu_lookup(const uint32_t* table, const Elf64_Sym* syms,
+                                  const char* strtab, const char* name) {
+    uint32_t nbuckets = table[0];
+    uint32_t symoffset = table[1];
+    uint32_t bloom_size = table[2];
+    uint32_t bloom_shift = table[3];
+    const uint64_t* bloom = (const uint64_t*)(table + 4);
+    const uint32_t* buckets = (const uint32_t*)(bloom + bloom_size);
+    const uint32_t* chain = buckets + nbuckets;
+
+    if (nbuckets == 0 || bloom_size == 0) return -1;
+
+    uint32_t h = elf_gnu_hash(name);
+    uint64_t word = bloom[(h / 64) % bloom_size];
+    uint64_t mask = ((uint64_t)1 << (h % 64)) | ((uint64_t)1 << ((h >> bloom_shift) % 64));
+    if ((word & mask) != mask) return -1;
+
+    uint32_t i = buckets[h % nbuckets];
+    if (i < symoffset) return -1;
+
+    for (;; i++) {
+        uint32_t h2 = chain[i - symoffset];
+        if ((h | 1) == (h2 | 1) && syms[i].st_shndx != SHN_UNDEF &&
+            strcmp(strtab + syms[i].st_name, name) == 0) {
+            return i;
+        }
+        if (h2 & 1) break;
+    }
+    return -1;
+}
+
+static inline long elf_sysv_lookup(const uint32_t* table, const Elf64_Sym* syms,
+                                   const char* strtab, const char* name) {
+    uint32_t nbuckets = table[0];
+    uint32_t nchain = table[1];
+    const uint32_t* buckets = table + 2;
+    const uint32_t* chain = buckets + nbuckets;
+
+    if (nbuckets == 0) return -1;
+
+    for (uint32_t i = buckets[elf_sysv_hash(name) % nbuckets]; i != STN_UNDEF && i < nchain; i = chain[i]) {
+        if (syms[i].st_shndx != SHN_UNDEF && strcmp(strtab + syms[i].st_name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Number of .dynsym entries according to the GNU hash table (the table
+ * doesn't store it, so walk the chain of the highest bucket). */
+static inline uint32_t elf_gnu_symbol_count(const uint32_t* table) {
+    uint32_t nbuckets = table[0];
+    uint32_t symoffset = table[1];
+    uint32_t bloom_size = table[2];
+    const uint32_t* buckets = table + 4 + bloom_size * 2;
+    const uint32_t* chain = buckets + nbuckets;
+
+    uint32_t last = 0;
+    for (uint32_t b = 0; b < nbuckets; b++) {
+        if (buckets[b] > last) last = buckets[b];
+    }
+    if (last < symoffset) return symoffset;
+    while (!(chain[last - symoffset] & 1)) last++;
+    return last + 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
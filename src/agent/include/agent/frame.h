@@ -0,0 +1,82 @@
+#ifndef AGENT_FRAME_H
+#define AGENT_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Framed messages between client, server and agent. Each frame is a
+ * 12-byte little-endian header followed by `length` payload bytes:
+ *
+ *   u8 magic (0xFE)  u8 type  u16 flags  u32 request id  u32 length
+ *
+ * 0xFE never occurs in UTF-8, so a reader can tell a frame from a text
+ * command by its first byte. Framing is negotiated per connection
+ * ("con <key> +frames" to the agent, "con +frames" to the server); a peer
+ * that doesn't answer keeps the newline text protocol.
+ */
+
+#define FRAME_MAGIC         0xFE
+#define FRAME_HEADER_SIZE   12
+#define FRAME_MAX_PAYLOAD   (16 * 1024 * 1024)
+
+#define FRAME_HELLO         "+frames"
+
+typedef enum {
+    FRAME_REQUEST = 1,      // command text, no trailing newline needed
+    FRAME_DATA    = 2,      // part of the response to `id`
+    FRAME_END     = 3,      // response to `id` is complete
+    FRAME_EVENT   = 4,      // unsolicited output, id = output channel (agent/output.h)
+    FRAME_INPUT   = 5       // bytes for the command running as `id` (watch 'q')
+} FrameType;
+
+#define FRAME_F_ERROR       0x0001      // on END: the command failed
+
+typedef struct {
+    uint8_t type;
+    uint16_t flags;
+    uint32_t id;
+    uint32_t length;
+} FrameHeader;
+
+static inline void frame_put32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t frame_get32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void frame_encode(uint8_t out[FRAME_HEADER_SIZE], uint8_t type, uint16_t flags,
+                                uint32_t id, uint32_t length) {
+    out[0] = FRAME_MAGIC;
+    out[1] = type;
+    out[2] = (uint8_t)flags;
+    out[3] = (uint8_t)(flags >> 8);
+    frame_put32(out + 4, id);
+    frame_put32(out + 8, length);
+}
+
+/* False if the bytes aren't a frame header (bad magic, type or length). */
+static inline bool frame_decode(const uint8_t in[FRAME_HEADER_SIZE], FrameHeader* out) {
+    if (in[0] != FRAME_MAGIC || in[1] < FRAME_REQUEST || in[1] > FRAME_INPUT) return false;
+    out->type = in[1];
+    out->flags = (uint16_t)(in[2] | (in[3] << 8));
+    out->id = frame_get32(in + 4);
+    out->length = frame_get32(in + 8);
+    return out->length <= FRAME_MAX_PAYLOAD;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -16,20 +16,40 @@
 #define PAGE_START(addr) ((void*)((uintptr_t)(addr) & ~(PAGE_SIZE - 1)))
 #define ALIGN_UP(addr, size) (((addr) + (size) - 1) & ~((size) - 1))
 
-#define MAX_HOOKS 32
-
 extern LuaEngine* g_lua_engine;
 
 extern int g_output_client_fd;
 
+// Keep hooks and traces installed when the last client disconnects
+// (the `persist` command), so a reconnecting client finds them in place.
+extern bool g_keep_hooks;
+
 extern JNIEnv* g_current_jni_env;
 
 extern JavaVM* g_java_vm;
 
 
-extern bool g_verbose_mode;
+// Log levels. g_log_level is the runtime switch (the `verbose` command);
+// RENEF_LOG_LEVEL_MAX caps what is compiled in at all, e.g.
+// -DRENEF_LOG_LEVEL_MAX=0 strips every verbose_log/trace_log call.
+#define LOG_LEVEL_OFF   0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_TRACE 2
+
+#ifndef RENEF_LOG_LEVEL_MAX
+#define RENEF_LOG_LEVEL_MAX LOG_LEVEL_TRACE
+#endif
+
+extern int g_log_level;
+
+#define LOG_ENABLED(level) \
+    ((level) <= RENEF_LOG_LEVEL_MAX && __builtin_expect(g_log_level >= (level), 0))
+
+// Arguments are only evaluated when debug logging is on.
+#define verbose_log(...) \
+    do { if (LOG_ENABLED(LOG_LEVEL_DEBUG)) verbose_log_impl(__VA_ARGS__); } while (0)
 
-void verbose_log(const char* fmt, ...);
+void verbose_log_impl(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
 
 JNIEnv* get_current_jni_env(void);
 JNIEnv* get_jni_env(void);
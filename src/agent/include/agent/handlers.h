@@ -1,6 +1,7 @@
 #ifndef AGENT_HANDLERS_H
 #define AGENT_HANDLERS_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -8,9 +9,24 @@ typedef void (*cmd_handler_fn)(int client_fd, const char* args);
 
 void handle_eval(int client_fd, const char* lua_code);
 void handle_inspect_binary(int client_fd, const char* args);
-void handle_memscan(int client_fd, const char* pattern);
+void handle_inspect_batch(int client_fd, const char* args);
+void handle_memscan(int client_fd, const char* args);
+void handle_memscan_page(int client_fd, const char* args);
+void handle_valscan(int client_fd, const char* args);
 void handle_list_apps(int client_fd, const char* args);
 void handle_memdump(int client_fd, const char* args);
+void handle_mem_read(int client_fd, const char* args);
+void handle_mem_readv(int client_fd, const char* args);
+void handle_mem_write(int client_fd, const char* args, size_t len);
+void handle_memdump_stream(int client_fd, const char* args);
+void handle_module_dump(int client_fd, const char* args);
+
+/* Copies up to `size` bytes at `address` of our own memory into `out`
+ * (process_vm_readv, no fault handler), stopping at the first unreadable
+ * page. Returns the number of bytes copied. */
+size_t memio_copy(void* out, uintptr_t address, size_t size);
+
+void handle_syms(int client_fd, const char* args);
 
 void register_builtin_commands(void);
 
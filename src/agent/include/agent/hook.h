@@ -21,9 +21,11 @@ typedef struct {
 } TrampolineHook;
 
 typedef struct {
-    void** got_entries[64];
-    void* original_funcs[64];
+    void*** got_entries;        // patched_count of capacity, grown while patching
+    void** original_funcs;
     int patched_count;
+    int capacity;
+    void* original_func;        // what handlers call through
     void* hook_func;
 } PltGotHook;
 
@@ -38,30 +40,62 @@ typedef struct {
 
     int lua_onEnter_ref;
     int lua_onLeave_ref;
+    int lua_flags;
 
     void* thunk_addr;
     int hook_index;
 } HookInfo;
 
-extern HookInfo g_hooks[32];
-extern int g_hook_count;
+/* Native hook records by hook id, the index their thunk carries. Ids
+ * of uninstalled hooks are reused once no handler can still see them. */
+HookInfo* hook_alloc(int* hook_id);
+HookInfo* hook_get(int hook_id);        // installed hooks only
+HookInfo* hook_at(int hook_id);         // handlers: also hooks being retired
+uint32_t hook_generation(int hook_id);  // see hook_table_gen()
+int hook_id_limit(void);                // ids are below this
+int hook_active_count(void);
+/* Frees the thunk, trampoline and GOT bookkeeping of a removed hook. */
+void hook_info_release(HookInfo* hook);
+
 extern __thread int g_current_hook_index;
 
 int change_page_protection(void* addr, int prot);
 uint32_t create_branch_insn(void* from, void* to);
-void* allocate_trampoline(size_t size);
+void* allocate_trampoline(size_t size, const void* near);
 size_t disassemble_instructions(void* addr, void** insn_out, size_t min_bytes);
 bool is_pc_relative(void* insn);
 int install_trampoline_hook(void* target_func, void* hook_func, HookInfo* hook_info);
 int install_plt_got_hook(void* target_func, void* hook_func, HookInfo* hook_info, const char* caller_lib);
-bool install_lua_hook(const char* lib_name, uintptr_t offset, int onEnter_ref, int onLeave_ref, const char* caller_lib);
+bool install_lua_hook(const char* lib_name, uintptr_t offset, int onEnter_ref, int onLeave_ref,
+                      const char* caller_lib, int lua_flags);
+/* Hooks on libraries not loaded yet, waiting for the linker to load them. */
+int pending_hook_count(void);
+
+/* One target of install_hook_batch(). */
+typedef struct {
+    void* target;
+    int onEnter_ref;
+    int onLeave_ref;
+    int lua_flags;
+    int hook_id;                // set when the batch went in, else -1
+} HookBatchEntry;
+
+#define HOOK_BATCH_QUIESCE  0x1 // park other threads while the patches go in
+
+/* Trampoline hooks on all targets or none. Thunks and trampolines are
+ * built first, then every patch is written through one /proc/self/mem
+ * descriptor and flushed; if one fails the ones written are reverted.
+ * With HOOK_BATCH_QUIESCE nothing is written when a thread did not park
+ * or would resume inside a patch.
+ * Returns count, or -1 with the Lua refs still owned by the caller. */
+int install_hook_batch(HookBatchEntry* entries, int count, int flags);
 
 void generic_hook_handler(void);
 void hook_logger(uint64_t* saved_regs);
 uint64_t log_return_value(uint64_t ret_val);
-void* get_current_trampoline(void);
+void* hook_call_original(void);
 
-void* create_hook_thunk(int hook_index);
+void* create_hook_thunk(int hook_index, const void* near);
 void set_current_hook_index(int index);
 
 int uninstall_hook(int hook_id);
@@ -70,6 +104,7 @@ int uninstall_all_hooks(void);
 #include "hook_java.h"
 
 bool install_lua_java_hook(const char* class_name, const char* method_name,
-                           const char* signature, int onEnter_ref, int onLeave_ref);
+                           const char* signature, int onEnter_ref, int onLeave_ref,
+                           int lua_flags);
 
 #endif
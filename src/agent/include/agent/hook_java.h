@@ -9,8 +9,6 @@
 extern "C" {
 #endif
 
-#define MAX_JAVA_HOOKS 32
-
 typedef struct {
     int api_level;
     size_t access_flags_offset;
@@ -33,6 +31,7 @@ typedef struct {
 
     int lua_onEnter_ref;
     int lua_onLeave_ref;
+    int lua_flags;
 
     bool is_hooked;
     int hook_index;
@@ -56,8 +55,12 @@ typedef struct {
     bool skip_original;
 } JavaHookInfo;
 
-extern JavaHookInfo g_java_hooks[MAX_JAVA_HOOKS];
-extern int g_java_hook_count;
+/* Java hook records by index (see hook_table.h): java_hook_get() for
+ * installed hooks, java_hook_at() for handlers, which may still be
+ * running in a hook being uninstalled. */
+JavaHookInfo* java_hook_get(int hook_index);
+JavaHookInfo* java_hook_at(int hook_index);
+int java_hook_active_count(void);
 
 int java_hook_init(JNIEnv* env);
 
@@ -0,0 +1,74 @@
+#ifndef AGENT_HOOK_TABLE_H
+#define AGENT_HOOK_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Growable table of hook records, addressed by the index a thunk or
+ * trampoline carries. Records live in segments that never move or get
+ * freed, so hook_table_at() is a lock-free lookup for handlers (inside
+ * rcu_read_lock). Slots are handed out under the table's lock. A removed
+ * record is retired: handlers still in flight keep reading it, and once
+ * RCU says none can be, reclaim() releases what it owns and the slot is
+ * reused. That includes threads on their way in from a thunk with the
+ * index (see rcu.h). A handler that leaves its read section and looks
+ * the index up again later (after the original function returns)
+ * checks the generation it saw first.
+ */
+
+#define HOOK_TABLE_MAX      65536   // thunks load the index with a 16-bit MOVZ
+#define HOOK_TABLE_BASE     32      // slots in segment 0, doubling per segment
+#define HOOK_TABLE_SEGS     12
+
+typedef struct {
+    size_t elem_size;
+    void (*reclaim)(void* elem);
+    uint8_t* segs[HOOK_TABLE_SEGS];
+    int count;                      // slots ever handed out
+    int live;
+    int retired;
+    int* free_slots;
+    int free_count;
+    int free_cap;
+    pthread_mutex_t lock;
+} HookTable;
+
+#define HOOK_TABLE_INIT(type, reclaim_fn) \
+    { sizeof(type), (reclaim_fn), {NULL}, 0, 0, 0, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER }
+
+/* Zeroed live slot; its index, or -1 when the table is full. */
+int hook_table_alloc(HookTable* t, void** elem_out);
+/* Gives back a slot that was never published (nothing can run in it). */
+void hook_table_free(HookTable* t, int index);
+/* Unpublished slot: reclaimed and reused after a grace period. */
+void hook_table_retire(HookTable* t, int index);
+
+/* Live or retired slots; NULL for free ones and past the end. Lock-free. */
+void* hook_table_at(HookTable* t, int index);
+/* Live slots only, for the writer side. */
+void* hook_table_get(HookTable* t, int index);
+/* Bumped each time the slot is handed out. Read it after the record's
+ * fields: if it still matches, they were this record's. Lock-free. */
+uint32_t hook_table_gen(HookTable* t, int index);
+
+/* Upper bound for iterating indices. */
+static inline int hook_table_count(HookTable* t) {
+    return __atomic_load_n(&t->count, __ATOMIC_ACQUIRE);
+}
+
+static inline int hook_table_live(HookTable* t) {
+    return __atomic_load_n(&t->live, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
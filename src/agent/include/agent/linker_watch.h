@@ -0,0 +1,42 @@
+#ifndef AGENT_LINKER_WATCH_H
+#define AGENT_LINKER_WATCH_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Library load notifications from inside the dynamic linker. The
+ * linker's soinfo::call_constructors() is hooked, so the callback sees
+ * every newly loaded library mapped and relocated but before any of its
+ * constructors ran. Without that symbol the linker's __loader_dlopen /
+ * __loader_android_dlopen_ext are hooked instead and the callback runs
+ * once dlopen is done, constructors included.
+ *
+ * The callback runs on the loading thread with the linker's lock held,
+ * and the load waits for it. It must not wait on any lock that another
+ * thread may hold while calling into the linker: not the Lua dispatch
+ * lock, not find_library_base(). maps_read_module_base() and stub
+ * allocation are safe; maps_acquire() asks the linker before it locks.
+ */
+
+typedef enum {
+    LINKER_WATCH_NONE,
+    LINKER_WATCH_CONSTRUCTORS,      // before the library's constructors
+    LINKER_WATCH_DLOPEN,            // after dlopen returns
+} LinkerWatchMode;
+
+typedef void (*linker_load_fn)(void);
+
+/* Hooks the linker once; later calls only report the mode. The first
+ * callback set wins. */
+LinkerWatchMode linker_watch_start(linker_load_fn on_load);
+LinkerWatchMode linker_watch_mode(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef LUA_DISPATCH_H
+#define LUA_DISPATCH_H
+
+#include <lua.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Every path that runs script code goes through here: native, Java and
+ * strace hooks, and the exec command. The main script state is guarded by
+ * one recursive lock; hooks can opt out of it with DISPATCH_PARALLEL
+ * (per-thread Lua state) or DISPATCH_ASYNC (queued to the executor thread).
+ */
+
+typedef enum {
+    DISPATCH_NATIVE,
+    DISPATCH_JAVA,
+    DISPATCH_STRACE,
+    DISPATCH_EXEC,
+    DISPATCH_SOURCE_COUNT
+} DispatchSource;
+
+#define DISPATCH_PARALLEL   0x1
+#define DISPATCH_ASYNC      0x2
+
+#define DISPATCH_QUEUE_MAX  4096
+#define DISPATCH_MAX_ARGS   8
+
+typedef enum {
+    DISPATCH_EV_ARGS,       // callback(args), args[base..] = registers
+    DISPATCH_EV_RETVAL,     // callback(retval)
+    DISPATCH_EV_INFO        // callback(info), strace-style info table
+} DispatchEventKind;
+
+typedef struct DispatchEvent {
+    struct DispatchEvent* next;
+    DispatchSource source;
+    DispatchEventKind kind;
+    int ref;
+    uint32_t generation;
+    uint64_t enqueue_ns;
+
+    int tid;
+    int nargs;
+    int arg_base;
+    uint64_t args[DISPATCH_MAX_ARGS];
+    bool has_retval;
+    uint64_t retval;
+    const char* name;       // must outlive the event (static string)
+    const char* text_key;   // info field name for `text`
+    char text[];
+} DispatchEvent;
+
+typedef struct {
+    uint64_t sync_calls;
+    uint64_t parallel_calls;
+    uint64_t lock_waits;
+    uint64_t lock_wait_ns;
+    uint64_t lock_wait_max_ns;
+    uint64_t async_posted;
+    uint64_t async_dropped;
+    uint64_t async_wait_ns;
+    uint64_t async_wait_max_ns;
+    int async_depth;
+    int async_depth_max;
+    int worker_states;
+} DispatchStats;
+
+/*
+ * Push the callback `ref` (a registry ref in the main state) and return the
+ * state it was pushed on. With DISPATCH_PARALLEL, callbacks that only close
+ * over _ENV run in a lua_State owned by the calling thread; otherwise the
+ * main state lock is held until lua_dispatch_release().
+ *
+ * Returns NULL (nothing pushed, no lock held) if the callback is missing.
+ */
+lua_State* lua_dispatch_acquire(DispatchSource source, int ref, int flags);
+void lua_dispatch_release(lua_State* L);
+
+/* Take the main state lock directly (ref bookkeeping). Recursive. */
+lua_State* lua_dispatch_lock(DispatchSource source);
+void lua_dispatch_unlock(void);
+
+/*
+ * Run an exec script on the main state. The lock is handed to waiting
+ * hooks every few milliseconds of script time, so a long script delays
+ * callbacks instead of blocking them until it ends.
+ */
+bool lua_dispatch_exec(const char* script);
+
+/*
+ * Let hooks use the main state while a C function called from it does
+ * long work that does not touch Lua (memory scans). The function must
+ * not use its lua_State until lua_dispatch_resume(token). A no-op unless
+ * the thread holds the lock exactly once.
+ */
+int lua_dispatch_suspend(void);
+void lua_dispatch_resume(int token);
+
+/*
+ * Queue a callback for the executor thread. The hooked thread never waits
+ * for it, so return values and argument changes are ignored. Takes
+ * ownership of `ev`; returns false if the queue is full and it was dropped.
+ */
+DispatchEvent* lua_dispatch_event_new(DispatchSource source, DispatchEventKind kind,
+                                      int ref, const char* text);
+bool lua_dispatch_post(DispatchEvent* ev);
+
+/* Drop queued events and cached copies of callback `ref` only. Call under
+ * the main state lock right after luaL_unref, before the ref can be handed
+ * out again. */
+void lua_dispatch_invalidate(int ref);
+
+void lua_dispatch_get_stats(DispatchSource source, DispatchStats* out);
+const char* lua_dispatch_source_name(DispatchSource source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,6 +6,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <lua.h>
+#include <agent/scan.h>
 
 #define DEFAULT_MAX_RESULTS 1000
 #define WILDCARD_BYTE 0x100
@@ -16,6 +17,7 @@ typedef struct {
     uintptr_t absolute_addr;
     char* hex_result;
     char* ascii_result;
+    int pattern_index;          // which pattern matched (memory_search_many)
 } MemoryResult;
 
 typedef struct {
@@ -24,11 +26,32 @@ typedef struct {
     int capacity;
 } MemorySearchResult;
 
+/* Readable mappings collected for a scan; paths[i] belongs to ranges[i]. */
+typedef struct {
+    ScanRange* ranges;
+    char (*paths)[256];
+    int count;
+    int capacity;
+} MemoryRegions;
+
+/* Skips /dev mappings, [vdso] and [vvar] unless lib_filter is given; stops
+ * once max_bytes (0 = no limit) were collected. Returns the bytes collected. */
+size_t memory_collect_regions(MemoryRegions* regions, const char* lib_filter,
+                              size_t min_len, size_t max_bytes);
+void memory_free_regions(MemoryRegions* regions);
+
+/* Fill hex/ascii with the bytes around a hit; false if no longer readable. */
+bool memory_format_context(uintptr_t addr, uintptr_t regionBegin, uintptr_t regionEnd,
+                           size_t patternLen, char* hex, size_t hexSize,
+                           char* ascii, size_t asciiSize);
+
 MemorySearchResult memory_search(const unsigned char* pattern, size_t patternLen);
 MemorySearchResult memory_search_pattern(const int* pattern, size_t patternLen);
 MemorySearchResult memory_search_string(const char* str);
 MemorySearchResult memory_search_in_lib(const char* libName, const unsigned char* pattern, size_t patternLen);
 MemorySearchResult memory_search_pattern_in_lib(const char* libName, const int* pattern, size_t patternLen);
+MemorySearchResult memory_search_many(const ScanMulti* multi, const char* libName);
+int memory_parse_pattern(const char* patternStr, int* outPattern, size_t maxLen);
 void free_search_result(MemorySearchResult* result);
 void register_memory_search_api(lua_State* L);
 
@@ -0,0 +1,16 @@
+#ifndef LUA_SHARED_H
+#define LUA_SHARED_H
+
+#include <lua.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void register_shared_api(lua_State* L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef AGENT_LZ4_H
+#define AGENT_LZ4_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * LZ4 block format (no frame header or checksums): the agent compresses
+ * dump chunks with it and the host decodes them. Blocks are independent
+ * and at most a dump chunk large, so a fast single-pass compressor with
+ * a small hash table is enough; the output is readable by any LZ4 block
+ * decoder (LZ4_decompress_safe).
+ */
+
+/* Worst case output size for `len` input bytes. */
+#define LZ4_BOUND(len)  ((len) + (len) / 255 + 16)
+
+/* Compresses src into dst. Returns the compressed size, or 0 if it would
+ * not fit in dst_cap (store the block raw then). Agent only. */
+size_t lz4_compress_block(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_cap);
+
+/* Decodes a block into dst, which must hold exactly the original size.
+ * Returns the decoded size, or -1 on malformed input. */
+static inline long lz4_decompress_block(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + len;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_len;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip >= iend) break;      // last sequence has no match
+
+        if (iend - ip < 2) return -1;
+        size_t dist = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (dist == 0 || dist > (size_t)(op - dst)) return -1;
+
+        size_t mlen = token & 15;
+        if (mlen == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                mlen += b;
+            } while (b == 255);
+        }
+        mlen += 4;
+        if (mlen > (size_t)(oend - op)) return -1;
+
+        // Overlapping copies are how LZ4 encodes runs; go byte by byte.
+        const uint8_t* match = op - dist;
+        for (size_t i = 0; i < mlen; i++) op[i] = match[i];
+        op += mlen;
+    }
+    return (long)(op - dst);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
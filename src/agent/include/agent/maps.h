@@ -0,0 +1,84 @@
+#ifndef AGENT_MAPS_H
+#define AGENT_MAPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Shared index of /proc/self/maps: regions sorted by address, paths
+ * interned once per snapshot. The snapshot is only rebuilt when the
+ * generation moves (maps_invalidate) or dl_iterate_phdr reports a
+ * different set of loaded objects, which moves the generation as well.
+ * Anonymous mmap/munmap don't show up
+ * in either, so memory scanners take a fresh snapshot instead.
+ */
+
+#define MAPS_PERM_R     0x1
+#define MAPS_PERM_W     0x2
+#define MAPS_PERM_X     0x4
+#define MAPS_PERM_P     0x8     // private (copy-on-write)
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    uint64_t offset;
+    uint64_t inode;
+    uint32_t dev_major;
+    uint32_t dev_minor;
+    uint32_t path_id;           // index into MapsIndex.paths, 0 = anonymous
+    uint8_t perms;              // MAPS_PERM_*
+} MapRegion;
+
+typedef struct {
+    MapRegion* regions;
+    int count;
+    const char** paths;         // paths[0] is ""
+    int npaths;
+    uint64_t generation;
+
+    // private
+    char* strings;
+    int refs;
+} MapsIndex;
+
+/* Snapshots are immutable and reference counted; release every acquire. */
+const MapsIndex* maps_acquire(void);
+const MapsIndex* maps_acquire_fresh(void);
+void maps_release(const MapsIndex* idx);
+
+/* Call after the agent changes the address space itself. */
+void maps_invalidate(void);
+uint64_t maps_generation(void);
+
+/* Region containing addr, or NULL. */
+const MapRegion* maps_lookup(const MapsIndex* idx, uintptr_t addr);
+
+/* Index of the first region at or after `from` whose path contains
+ * `name`, or -1. */
+int maps_find_path(const MapsIndex* idx, const char* name, int from);
+
+static inline const char* maps_region_path(const MapsIndex* idx, const MapRegion* r) {
+    return idx->paths[r->path_id];
+}
+
+/* "r-xp" style permission string, and the region as a maps line
+ * (newline included). */
+void maps_format_perms(uint8_t perms, char out[5]);
+int maps_format_line(const MapsIndex* idx, const MapRegion* r, char* buf, size_t size);
+
+/* Lowest mapping of a module whose path contains name; path is optional. */
+uintptr_t maps_module_base(const char* name, char* path, size_t path_size);
+/* The same base read straight from /proc/self/maps: no lock, no
+ * allocation, no call into the loader. For the linker's load callback. */
+uintptr_t maps_read_module_base(const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
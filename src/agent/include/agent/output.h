@@ -0,0 +1,139 @@
+#ifndef AGENT_OUTPUT_H
+#define AGENT_OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OUTPUT_RING_SIZE    (64 * 1024)     // per thread, power of two
+
+/*
+ * Client output (console.log, strace lines, [DBG] messages). Hooked threads
+ * append to their own ring and a single writer thread drains all rings to
+ * the client socket, so a slow client never stalls the target app.
+ *
+ * Threads marked direct (the command thread) write synchronously instead,
+ * which keeps exec output ahead of the command's response.
+ */
+
+typedef enum {
+    OUTPUT_DROP_NEWEST,     // ring full: discard the new message (default)
+    OUTPUT_DROP_OLDEST,     // ring full: discard queued messages to make room
+    OUTPUT_BLOCK            // ring full: wait for the writer
+} OutputPolicy;
+
+/*
+ * Event channels. On a framed connection each channel's output goes out
+ * as EVENT frames whose id is the channel, so a client can follow hooks,
+ * syscall traces and debug logs separately while commands are running.
+ * Every channel has its own overflow policy and can be paused (output is
+ * dropped and counted until resumed).
+ */
+typedef enum {
+    OUTPUT_CH_HOOK   = 1,   // console.log and other script/hook output
+    OUTPUT_CH_STRACE = 2,   // syscall trace lines and records
+    OUTPUT_CH_LOG    = 3,   // [DBG] and [TRC] messages
+    OUTPUT_CH_COUNT  = 4
+} OutputChannel;
+
+typedef struct {
+    uint64_t queued;
+    uint64_t lost;
+    bool paused;
+    OutputPolicy policy;
+} OutputChannelStats;
+
+typedef struct {
+    uint64_t queued;
+    uint64_t written;
+    uint64_t lost;          // dropped by the overflow policy
+    uint64_t blocked;       // producer waits under OUTPUT_BLOCK
+    uint64_t direct;        // written synchronously (direct thread / oversize)
+    int rings;
+} OutputStats;
+
+/* Send `len` bytes of `msg` followed by a newline (hook channel). */
+void output_write(const char* msg, size_t len);
+
+/* Same, without the newline (binary records). */
+void output_write_raw(const void* data, size_t len);
+
+/* Same as above on an explicit channel. */
+void output_write_to(OutputChannel channel, const char* msg, size_t len);
+void output_write_raw_to(OutputChannel channel, const void* data, size_t len);
+
+void output_set_direct(bool direct);
+
+/*
+ * Clients output goes to. Events reach every attached client; a request's
+ * replies only its own. A client is on the text protocol until
+ * output_set_framed().
+ */
+void output_attach(int fd);
+void output_detach(int fd);
+int output_client_count(void);
+
+/*
+ * Command replies. Handlers write through this instead of write(2) so a
+ * framed connection gets them as DATA frames of the current request;
+ * on a text connection the bytes go out unchanged.
+ */
+ssize_t output_reply(int fd, const void* data, size_t len);
+
+/*
+ * The calling thread's request on fd, as a handle other threads can
+ * reply through. Work a handler fans out (scan workers) runs outside the
+ * request, where output_reply() would turn its output into EVENTs for
+ * every client; take the handle on the handler's thread and pass it on.
+ * Only valid until the handler returns.
+ */
+typedef struct {
+    int fd;
+    uint32_t id;
+    bool active;            // false: not inside a request on fd, replies become EVENTs
+} OutputRequest;
+
+OutputRequest output_request(int fd);
+ssize_t output_reply_to(const OutputRequest* req, const void* data, size_t len);
+
+/* Framed connections (see agent/frame.h). Replies and direct output of a
+ * thread between begin and end belong to its request; the rest becomes
+ * EVENTs. Requests are per thread, so several can be in flight. */
+void output_set_framed(int fd, bool framed);
+bool output_is_framed(int fd);
+/* id is ignored on text clients, which get no END. */
+void output_begin_request(int fd, uint32_t id);
+void output_end_request(uint16_t flags);
+/* Mark the thread's request failed: its END carries FRAME_F_ERROR. For
+ * replies that are binary, where an "ERROR:" line can't be told apart. */
+void output_fail_request(void);
+/* Streaming replies: wait up to timeout_ms until the request's client can
+ * take more output. False once it is gone or stalled; stop sending then.
+ * Keeps a long stream from running into the send timeout. */
+bool output_request_writable(int timeout_ms);
+void output_send_frame(int fd, uint8_t type, uint16_t flags, uint32_t id, const void* data, size_t len);
+
+/* Sets every channel's policy. */
+void output_set_policy(OutputPolicy policy);
+OutputPolicy output_get_policy(void);
+
+void output_set_channel_policy(OutputChannel channel, OutputPolicy policy);
+void output_set_channel_paused(OutputChannel channel, bool paused);
+const char* output_channel_name(OutputChannel channel);
+bool output_channel_parse(const char* name, OutputChannel* out);
+void output_get_channel_stats(OutputChannel channel, OutputChannelStats* out);
+const char* output_policy_name(OutputPolicy policy);
+bool output_policy_parse(const char* name, OutputPolicy* out);
+
+void output_get_stats(OutputStats* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
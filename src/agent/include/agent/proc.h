@@ -1,6 +1,7 @@
 #ifndef AGENT_PROC_H
 #define AGENT_PROC_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 void* find_library_base(const char* lib_name);
@@ -0,0 +1,44 @@
+#ifndef AGENT_QUIESCE_H
+#define AGENT_QUIESCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Parks every other thread of the process in a signal handler so code
+ * can be patched with nothing executing it. Threads that do not answer
+ * within QUIESCE_TIMEOUT_MS (signal blocked, stuck in the kernel) are
+ * left running, and threads_unparked() counts them: with any, nothing
+ * is known about where they are. Between threads_quiesce() and
+ * threads_resume() the caller must not take any lock a parked thread
+ * may hold: no malloc, no logging.
+ */
+
+#define QUIESCE_INITIAL_THREADS 256     /* grown to the thread count */
+#define QUIESCE_TIMEOUT_MS      100
+
+/* Returns how many threads are parked; pair with threads_resume().
+ * -1 when the signal handler cannot be installed (nothing to resume). */
+int threads_quiesce(void);
+
+/* Threads signalled by threads_quiesce() that did not park in time,
+ * plus any it could not allocate room to track (never signalled). */
+int threads_unparked(void);
+
+/* True when a parked thread stopped with its PC, LR, x16 or x17 in
+ * [lo, hi). Return addresses already saved on a stack are not seen. */
+bool threads_quiesced_in(uintptr_t lo, uintptr_t hi);
+
+/* Releases the parked threads; returning from the signal handler
+ * resynchronizes their instruction stream with the patched code. */
+void threads_resume(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef AGENT_RCU_H
+#define AGENT_RCU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Deferred reclamation for state that hook handlers read without locks.
+ * Handlers bracket their use of hook state with rcu_read_lock() and
+ * rcu_read_unlock(), which only touch thread-local state and nest. A
+ * writer that has unpublished something hands its cleanup to
+ * rcu_defer().
+ *
+ * A thread between a patched instruction and its handler's read lock
+ * (in a thunk, or in RCU_ENTRY_TEXT) already holds a hook index it has
+ * not looked up yet, and no read section tracks it. So rcu_poll() first
+ * runs a quiesce round: every other thread is parked and none may stop
+ * in a stub or in entry code, or hold a stub address in LR, x16 or
+ * x17. A callback deferred before a clear round runs once the read
+ * sections in progress at that round have ended. A round that fails is
+ * retried after RCU_ROUND_RETRY_MS.
+ *
+ * Not seen by a round: a thread whose first use of the agent's TLS
+ * (dynamic, allocated by the linker) happens on its way in.
+ *
+ * Handlers do not hold a read section across the original function,
+ * which may block. The stub they call it through is marked with
+ * rcu_call_enter() instead.
+ */
+
+#define RCU_ROUND_RETRY_MS  100
+
+// Code on the way from a patched instruction to the read lock
+#define RCU_ENTRY_TEXT      __attribute__((section("renef_rcu_entry")))
+
+typedef struct {
+    int readers;                // threads that ever entered a read section
+    int active;                 // of them, inside one right now
+    int calling;                // of them, inside an original function
+    int pending;                // callbacks waiting for a grace period
+    uint64_t epoch;
+    uint64_t deferred;
+    uint64_t reclaimed;
+    uint64_t rounds;            // quiesce rounds run
+    uint64_t busy_rounds;       // of them, ones a thread was on its way in
+} RcuStats;
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+
+/* Inside a read section: this thread is about to leave it and call
+ * through stub (NULL: nothing to keep). rcu_call_exit() after the call. */
+void rcu_call_enter(const void* stub);
+void rcu_call_exit(void);
+/* True while a thread calls through a stub in [lo, hi). Lock-free.
+ * stub_alloc.c checks it before handing a parked stub's slots on. */
+bool rcu_in_call(const void* lo, const void* hi);
+
+void rcu_defer(void (*fn)(void* arg), void* arg);
+
+/* For things retired without a callback (parked stubs): a stamp to keep
+ * with the object, and whether its grace period is over. The next
+ * rcu_poll() runs a round for a stamp even with nothing deferred. */
+uint64_t rcu_retire_stamp(void);
+bool rcu_grace_over(uint64_t stamp);
+
+/* Runs the callbacks whose grace period is over; returns how many. */
+int rcu_poll(void);
+
+void rcu_get_stats(RcuStats* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
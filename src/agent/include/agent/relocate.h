@@ -0,0 +1,38 @@
+#ifndef AGENT_RELOCATE_H
+#define AGENT_RELOCATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A64 instruction relocator for hook trampolines. Instructions that
+ * address relative to the PC (B, BL, B.cond, CBZ/CBNZ, TBZ/TBNZ, ADR,
+ * ADRP and literal loads) are re-encoded for their new address when
+ * the target is still in reach, else expanded into an equivalent
+ * sequence through an absolute literal. Expansions use x17 (IP1) as
+ * scratch. Branches and ADR into the relocated block itself are pointed
+ * at their copy. Everything else is copied unchanged.
+ */
+
+#define RELOC_MAX_WORDS     6   // words one instruction may expand to
+#define RELOC_MAX_INSNS     8
+
+bool reloc_is_pc_relative(uint32_t insn);
+
+/* Rewrites `count` instructions read from src (located at src_pc) into
+ * out, to be executed at out_pc; out may be a writable alias of out_pc
+ * and must hold count * RELOC_MAX_WORDS words. Returns words written,
+ * 0 for more than RELOC_MAX_INSNS instructions. */
+size_t relocate_insns(const uint32_t* src, size_t count, uintptr_t src_pc,
+                      uint32_t* out, uintptr_t out_pc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef AGENT_SCAN_H
+#define AGENT_SCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCAN_MAX_PATTERN 1024
+
+/*
+ * Compiled search pattern. Candidates are found by comparing two anchor
+ * bytes (the least common non-wildcard bytes) across a whole vector at a
+ * time (NEON on arm64, SSE2/AVX2 on x86_64); each candidate is then
+ * verified against bytes/mask eight bytes at a time.
+ */
+typedef struct {
+    uint8_t bytes[SCAN_MAX_PATTERN];
+    uint8_t mask[SCAN_MAX_PATTERN];     // 0xFF = must match, 0x00 = wildcard
+    size_t len;
+    size_t anchor;
+    size_t anchor2;
+    bool has_anchor;                    // false if every byte is a wildcard
+    bool has_wildcards;
+} ScanPattern;
+
+bool scan_pattern_init(ScanPattern* sp, const uint8_t* bytes, size_t len);
+
+/* `pattern` entries are 0..255 or WILDCARD_BYTE. */
+bool scan_pattern_init_masked(ScanPattern* sp, const int* pattern, size_t len);
+
+/* First match starting in [begin, end - len], or NULL. */
+const uint8_t* scan_find(const ScanPattern* sp, const uint8_t* begin, const uint8_t* end);
+
+#define SCAN_CHUNK_SIZE     (1024 * 1024)
+#define SCAN_MAX_THREADS    16
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+} ScanRange;
+
+typedef struct {
+    uintptr_t addr;
+    int range;          // index into the ranges passed to scan_ranges()
+    int pattern;        // index into the ScanMulti set, 0 for scan_ranges()
+} ScanHit;
+
+/*
+ * Optional consumer for hits while the scan is still running. It sees
+ * them in final order, batch by batch as the completed prefix of the scan
+ * grows, and is never called concurrently with itself. It runs on
+ * whichever worker completed the prefix, not on the caller's thread, so
+ * anything thread-local (the output request) has to travel in ctx.
+ */
+typedef struct {
+    void (*fn)(const ScanHit* hits, int count, void* ctx);
+    void* ctx;
+} ScanSink;
+
+/*
+ * Scan `ranges` (ascending, non-overlapping) on the scan thread pool.
+ * Ranges are cut into SCAN_CHUNK_SIZE chunks that overlap by len - 1
+ * bytes and handed out with work stealing. Hits are returned in address
+ * order and are the same first `max_hits` a sequential scan would find,
+ * whatever the thread count. *out is malloc'd; returns the hit count.
+ * `sink` may be NULL.
+ */
+int scan_ranges(const ScanPattern* sp, const ScanRange* ranges, int nranges,
+                int max_hits, const ScanSink* sink, ScanHit** out);
+
+#define SCAN_MULTI_MAX_PATTERNS 256
+#define SCAN_MULTI_KEYWORD_MAX  16
+
+/*
+ * Pattern set matched in one pass. Each pattern contributes a keyword (its
+ * rarest run of up to SCAN_MULTI_KEYWORD_MAX fixed bytes) to an
+ * Aho-Corasick DFA; keyword hits are then verified against the full
+ * pattern. The per-byte cost is one table lookup however many patterns
+ * the set holds.
+ */
+typedef struct ScanMulti ScanMulti;
+
+ScanMulti* scan_multi_create(void);
+void scan_multi_free(ScanMulti* m);
+
+/* Same encoding as scan_pattern_init_masked(). Fails if the pattern has no
+ * fixed byte or the set is full. Returns the pattern index or -1. */
+int scan_multi_add(ScanMulti* m, const int* pattern, size_t len);
+
+/* Build the automaton; must be called once after the last add. */
+bool scan_multi_compile(ScanMulti* m);
+
+int scan_multi_count(const ScanMulti* m);
+size_t scan_multi_pattern_len(const ScanMulti* m, int index);
+
+/* scan_ranges() for a pattern set. Hits are ordered by address, then by
+ * pattern index when several patterns match at the same address. */
+int scan_ranges_multi(const ScanMulti* m, const ScanRange* ranges, int nranges,
+                      int max_hits, const ScanSink* sink, ScanHit** out);
+
+/* 0 = one per online CPU (capped at SCAN_MAX_THREADS). */
+void scan_set_threads(int threads);
+int scan_get_threads(void);
+
+/* Pin worker i to cpus[i % ncpus]; ncpus = 0 disables pinning. */
+void scan_set_cpus(const int* cpus, int ncpus);
+int scan_get_cpus(int* out, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
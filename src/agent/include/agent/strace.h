@@ -4,26 +4,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <agent/hook.h>
+#include <agent/strace_event.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define MAX_STRACE_HOOKS 64
 #define STRACE_MAX_ARGS 6
 
-enum SyscallArgType {
-    ARG_INT,
-    ARG_UINT,
-    ARG_FD,
-    ARG_PTR,
-    ARG_STR,
-    ARG_BUF,
-    ARG_FLAGS_OPEN,
-    ARG_MODE,
-    ARG_SIZE
-};
-
 typedef struct {
     const char* name;
     const char* symbol;
@@ -38,16 +26,19 @@ typedef struct {
     HookInfo hook;
     int lua_onCall_ref;
     int lua_onReturn_ref;
+    int lua_flags;
     bool active;
     void* resolved_addr;
     void* thunk_addr;
 } StraceEntry;
 
-extern StraceEntry g_strace_hooks[MAX_STRACE_HOOKS];
-extern int g_strace_count;
+/* Installed traces by index (the one their thunk carries); indices
+ * below strace_entry_limit(), NULL for free or removed ones. */
+StraceEntry* strace_entry_get(int index);
+int strace_entry_limit(void);
 
 int strace_install(const char* syscall_name, const char* caller_lib,
-                   int onCall_ref, int onReturn_ref);
+                   int onCall_ref, int onReturn_ref, int lua_flags);
 int strace_remove(const char* syscall_name);
 void strace_remove_all(void);
 
@@ -63,6 +54,10 @@ int strace_get_all_defs(SyscallDef** out, int max);
 
 void strace_set_current_index(int index);
 
+/* Emit StraceEventCall records instead of formatted text lines. */
+void strace_set_binary(bool binary);
+bool strace_is_binary(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,92 @@
+#ifndef AGENT_STRACE_EVENT_H
+#define AGENT_STRACE_EVENT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary strace wire format, shared by the agent and renef-strace.
+ *
+ * Records are interleaved with ordinary newline-terminated text on the
+ * client stream. Each one starts with STRACE_EVENT_MAGIC (ASCII record
+ * separator, never produced by text output) and carries its total size,
+ * so the reader can skip types it does not know. All fields are
+ * little-endian and unaligned.
+ */
+
+#define STRACE_EVENT_MAGIC      0x1E
+#define STRACE_EVENT_MAX_ARGS   6
+#define STRACE_EVENT_NAME_LEN   16
+#define STRACE_EVENT_MAX_SIZE   1024
+
+#define STRACE_STR_MAX          64      // ARG_STR bytes copied
+#define STRACE_FDPATH_MAX       127     // ARG_FD path bytes copied
+#define STRACE_BUF_PREVIEW      32      // ARG_BUF bytes copied (after return)
+
+enum SyscallArgType {
+    ARG_INT,
+    ARG_UINT,
+    ARG_FD,
+    ARG_PTR,
+    ARG_STR,
+    ARG_BUF,
+    ARG_FLAGS_OPEN,
+    ARG_MODE,
+    ARG_SIZE
+};
+
+enum {
+    STRACE_EV_DEF = 1,      // StraceEventDef: describes a traced syscall id
+    STRACE_EV_CALL = 2      // StraceEventCall + payloads: one completed call
+};
+
+enum {
+    STRACE_PAYLOAD_STR = 1,
+    STRACE_PAYLOAD_FDPATH = 2,
+    STRACE_PAYLOAD_BUF = 3
+};
+
+#define STRACE_PAYLOAD_TRUNCATED 0x1
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t type;
+    uint16_t size;          // whole record, header included
+} StraceEventHeader;
+
+typedef struct __attribute__((packed)) {
+    StraceEventHeader hdr;
+    uint16_t id;
+    uint8_t nargs;
+    uint8_t arg_types[STRACE_EVENT_MAX_ARGS];
+    char name[STRACE_EVENT_NAME_LEN];   // NUL padded
+} StraceEventDef;
+
+typedef struct __attribute__((packed)) {
+    StraceEventHeader hdr;
+    uint16_t id;
+    uint8_t nargs;
+    uint8_t npayloads;
+    int32_t tid;
+    int32_t err;            // errno, only meaningful when retval < 0
+    uint64_t ts_ns;         // CLOCK_REALTIME at entry
+    int64_t retval;
+    uint64_t args[STRACE_EVENT_MAX_ARGS];
+} StraceEventCall;
+
+/* Follows StraceEventCall, npayloads times. */
+typedef struct __attribute__((packed)) {
+    uint8_t arg;            // argument index
+    uint8_t kind;           // STRACE_PAYLOAD_*
+    uint8_t flags;
+    uint8_t len;
+} StraceEventPayload;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef AGENT_STUB_ALLOC_H
+#define AGENT_STUB_ALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Executable stubs (hook thunks, trampolines) carved out of shared slabs
+ * instead of a page each. Slabs are placed within B/BL range of the code
+ * they serve when a free gap allows, and are backed by a memfd mapped
+ * twice: stubs execute from a read+exec view and are written through a
+ * read+write alias. Where exec mappings of a memfd are refused, slabs
+ * fall back to anonymous RWX memory.
+ *
+ * Write a stub through stub_writable(), then stub_commit() it before it
+ * runs. Slabs are never unmapped. A freed stub is not rewritten while a
+ * thread may still be running in it: it is parked, and stub_create()
+ * hands it out again to whoever builds the same code for it (the same
+ * hook installed again). Once its RCU grace period is over and no
+ * thread calls through it, its slots go back to the slab.
+ */
+
+#define STUB_SLOT_SIZE      64
+#define STUB_SLAB_SIZE      (64 * 1024)
+#define STUB_BRANCH_RANGE   (128 * 1024 * 1024)     // reach of B/BL
+
+typedef struct {
+    int slabs;
+    int near_slabs;             // slabs placed near a requested address
+    bool dual_mapped;           // W^X views (false: RWX fallback)
+    int live;                   // stubs allocated now
+    int parked;                 // freed, kept for reuse
+    size_t used_bytes;          // slots in use or parked, in bytes
+    size_t mapped_bytes;
+    uint64_t allocs;
+    uint64_t near_hits;         // stub in branch range of `near`
+    uint64_t near_misses;       // asked for `near`, got a far stub
+    uint64_t reused;            // parked stubs taken back by stub_create
+    uint64_t reclaimed;         // parked stubs whose slots were freed
+} StubStats;
+
+/* Writes a stub's code, as it is to run at pc, into code (room for the
+ * size asked for); returns its length in bytes, 0 on failure. */
+typedef size_t (*StubBuildFn)(uint32_t* code, uintptr_t pc, void* ctx);
+
+/* Executable address of `size` bytes, in branch range of `near` if one
+ * can be found there (check with stub_in_branch_range), else anywhere.
+ * near may be NULL. NULL if nothing could be mapped. */
+void* stub_alloc(size_t size, const void* near);
+/* Parks a stub; see above. */
+void stub_free(void* stub);
+
+/* A committed stub holding what build() writes: a parked one in range of
+ * near (when given) that already holds exactly that, else a new one from
+ * stub_alloc(). NULL if none could be had or build() failed. */
+void* stub_create(size_t size, const void* near, StubBuildFn build, void* ctx);
+
+/* Writable alias of a stub's code (the stub itself without dual mapping). */
+void* stub_writable(void* stub);
+/* Makes `len` bytes written through the alias visible to execution. */
+void stub_commit(void* stub, size_t len);
+
+static inline bool stub_in_branch_range(const void* from, const void* to) {
+    int64_t delta = (int64_t)((uintptr_t)to - (uintptr_t)from);
+    return delta >= -(int64_t)STUB_BRANCH_RANGE && delta < (int64_t)STUB_BRANCH_RANGE;
+}
+
+/* For a caller that has quiesced threads (quiesce.h): true when a parked
+ * thread is in a stub or holds a stub address in LR, x16 or x17. Takes
+ * no lock. */
+bool stub_quiesced_in_any(void);
+
+void stub_get_stats(StubStats* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef AGENT_SYMBOLIZE_H
+#define AGENT_SYMBOLIZE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * PC -> module/symbol resolution for backtraces. Modules are found through
+ * the shared maps index, symbols through the module's symindex (.dynsym and
+ * .symtab), and recent PCs are kept in an LRU cache that is flushed when
+ * the maps generation moves. Module ids are stable for the agent's
+ * lifetime, so raw frames (id + offset) can be symbolized later in bulk.
+ */
+
+typedef struct {
+    uintptr_t pc;
+    int module_id;              // -1 outside any file-backed mapping
+    const char* name;           // module file name, NULL if module_id < 0
+    const char* path;
+    uintptr_t base;             // lowest mapping of the module
+    const char* symbol;         // NULL when no symbol covers pc
+    uintptr_t symbol_addr;
+} SymbolizedPC;
+
+typedef struct {
+    const char* name;
+    const char* path;
+    uintptr_t base;
+} SymModule;
+
+/* Module and symbol. False only when pc is outside every module. */
+bool symbolize_pc(uintptr_t pc, SymbolizedPC* out);
+/* Module only (raw mode): no symbol tables are touched. */
+bool symbolize_pc_module(uintptr_t pc, SymbolizedPC* out);
+
+int symbolize_module_count(void);
+bool symbolize_module(int id, SymModule* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
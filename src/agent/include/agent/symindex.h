@@ -0,0 +1,57 @@
+#ifndef AGENT_SYMINDEX_H
+#define AGENT_SYMINDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-module symbol index, built once and cached for the agent's lifetime.
+ * .dynsym is looked up through the module's own DT_GNU_HASH / DT_HASH
+ * table; .symtab (and a .dynsym without one) through a hash-sorted array.
+ * Entries are keyed by path and revalidated against inode, mtime and load
+ * address, so a replaced or reloaded library gets a fresh index.
+ */
+
+typedef struct SymIndex SymIndex;
+
+typedef struct {
+    const char* name;
+    uint64_t value;         // st_value, link-time address
+    uint64_t size;
+    uint8_t type;           // STT_*
+    uint8_t bind;           // STB_*
+    bool dynamic;           // from .dynsym
+    bool defined;           // st_shndx != SHN_UNDEF
+} SymInfo;
+
+/* Loaded module whose path contains lib_name. */
+const SymIndex* symindex_get(const char* lib_name);
+/* ELF file at path, loaded at load_addr (its lowest mapping). */
+const SymIndex* symindex_get_path(const char* path, uintptr_t load_addr);
+/* Loaded image only, no file I/O (APK-embedded libraries, SELinux). */
+const SymIndex* symindex_get_image(uintptr_t base);
+
+/* .dynsym first, then .symtab. Symbols with a zero value are skipped. */
+bool symindex_find(const SymIndex* idx, const char* name, SymInfo* out);
+/* Closest symbol at or below value; out->value/size tell how close. */
+bool symindex_find_addr(const SymIndex* idx, uint64_t value, SymInfo* out);
+
+size_t symindex_count(const SymIndex* idx, bool dynamic);
+bool symindex_entry(const SymIndex* idx, bool dynamic, size_t i, SymInfo* out);
+
+/* runtime address = load bias + st_value */
+uintptr_t symindex_load_bias(const SymIndex* idx);
+const char* symindex_path(const SymIndex* idx);
+/* GNU build-id in hex, or "i<inode>-<mtime>" when the module has none. */
+const char* symindex_key(const SymIndex* idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef AGENT_TRACE_H
+#define AGENT_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <agent/globals.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_MAX_ARGS  6
+#define TRACE_RING_SIZE 256
+
+/*
+ * Hot-path tracing for hook handlers. Records are stored in binary form
+ * (format pointer + raw 64-bit args) in a per-thread ring and formatted
+ * later by a background thread, so a hooked call only pays for a few
+ * stores. Restrictions that follow from that:
+ *   - at most TRACE_MAX_ARGS arguments, each cast to a 64-bit integer
+ *     (use %llx/%lld/%llu/%p, never %f);
+ *   - %s only for strings that outlive the record (string literals,
+ *     static tables).
+ */
+#define trace_log(fmt, ...) \
+    do { if (LOG_ENABLED(LOG_LEVEL_TRACE)) trace_emit(fmt, ##__VA_ARGS__); } while (0)
+
+void trace_emit(const char* fmt, ...);
+
+/* Deferred (default): format on the flusher thread. Otherwise inline. */
+void trace_set_deferred(bool deferred);
+bool trace_is_deferred(void);
+
+void trace_get_stats(uint64_t* recorded, uint64_t* dropped);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef AGENT_VALSCAN_H
+#define AGENT_VALSCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Incremental value scanner ("first scan" / "next scan"). The first scan
+ * walks every writable mapping for a typed value; each next scan only
+ * revisits the surviving candidates. Per region, candidates are kept as a
+ * bitmap over aligned slots while they are dense and as an offset/value
+ * list once that is smaller. One session is shared by Lua and msv.
+ */
+
+typedef enum {
+    VS_U8, VS_U16, VS_U32, VS_U64,
+    VS_I8, VS_I16, VS_I32, VS_I64,
+    VS_F32, VS_F64
+} ValueType;
+
+typedef enum {
+    VS_EQ,
+    VS_NE,
+    VS_GT,
+    VS_LT,
+    VS_RANGE,           // a <= v <= b
+    VS_CHANGED,         // the rest compare against the previous scan
+    VS_UNCHANGED,
+    VS_INCREASED,
+    VS_DECREASED
+} ValueOp;
+
+/* Ops that compare against the previous scan can't start a session. */
+#define VS_OP_NEEDS_PREVIOUS(op) ((op) >= VS_CHANGED)
+
+typedef struct {
+    uintptr_t addr;
+    uint64_t value;     // raw little-endian bits as of the last scan
+    uintptr_t base;     // start of the mapping
+    char path[128];
+} ValueHit;
+
+/* "u32", "u32:1" (alignment 1), "f64", ... */
+bool valscan_parse_type(const char* name, ValueType* type, size_t* align);
+const char* valscan_type_name(ValueType type);
+bool valscan_parse_op(const char* name, ValueOp* op);
+
+/* Raw bits of a number in `type`; integers wrap, floats round. */
+uint64_t valscan_encode(ValueType type, double number, int64_t integer, bool is_integer);
+void valscan_format(ValueType type, uint64_t raw, char* buf, size_t size);
+
+/* Both return the number of candidates, or -1 on error (no session,
+ * op not valid for a first scan, out of memory). */
+long valscan_first(ValueType type, size_t align, ValueOp op, uint64_t a, uint64_t b);
+long valscan_next(ValueOp op, uint64_t a, uint64_t b);
+
+/* Copy candidates [offset, offset + max) in address order. */
+size_t valscan_results(size_t offset, size_t max, ValueHit* out);
+
+size_t valscan_count(void);
+int valscan_scans(void);            // 0 = no session
+ValueType valscan_type(void);
+void valscan_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,6 +1,8 @@
 #include <agent/lua_hook.h>
 #include <agent/hook.h>
 #include <agent/globals.h>
+#include <agent/lua_dispatch.h>
+#include <agent/proc.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -105,6 +107,23 @@ static int lua_hook(lua_State* L) {
         verbose_log("onLeave callback registered (ref: %d)", onLeave_ref);
     }
 
+    // Optional dispatch mode. parallel: per-thread Lua state instead of the
+    // main script lock. async: queue to the executor, never block the caller.
+    int lua_flags = 0;
+    lua_getfield(L, callback_index, "parallel");
+    if (lua_toboolean(L, -1)) lua_flags |= DISPATCH_PARALLEL;
+    lua_pop(L, 1);
+
+    lua_getfield(L, callback_index, "async");
+    if (lua_toboolean(L, -1)) {
+        if (target.type == NATIVE_METHOD) {
+            lua_flags |= DISPATCH_ASYNC;
+        } else {
+            verbose_log("async ignored for Java hooks (callbacks control skip/return)");
+        }
+    }
+    lua_pop(L, 1);
+
     // Parse optional 'caller' field for PLT/GOT targeted hooking
     // Can be a string (single library) or a table (array of library names)
     const char* caller_lib = NULL;
@@ -154,7 +173,7 @@ static int lua_hook(lua_State* L) {
         bool result = install_lua_hook(target.info.native.lib_name,
                                        target.info.native.offset,
                                        onEnter_ref, onLeave_ref,
-                                       caller_lib);
+                                       caller_lib, lua_flags);
         if (!result) {
             return luaL_error(L, "Failed to install native hook");
         }
@@ -162,7 +181,8 @@ static int lua_hook(lua_State* L) {
         bool result = install_lua_java_hook(target.info.java.class_name,
                                             target.info.java.method_name,
                                             target.info.java.method_sig,
-                                            onEnter_ref, onLeave_ref);
+                                            onEnter_ref, onLeave_ref,
+                                            lua_flags);
         if (!result) {
             return luaL_error(L, "Failed to install Java hook");
         }
@@ -171,7 +191,95 @@ static int lua_hook(lua_State* L) {
     return 0;
 }
 
+static int ref_field(lua_State* L, int table_index, const char* name) {
+    lua_getfield(L, table_index, name);
+    if (lua_isfunction(L, -1)) {
+        return luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    lua_pop(L, 1);
+    return LUA_NOREF;
+}
+
+// hookMany(lib, {offset, ...}, {onEnter=, onLeave=, parallel=, async=, quiesce=})
+// Trampoline hooks on every offset or on none; returns how many.
+static int lua_hook_many(lua_State* L) {
+    const char* lib_name = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    luaL_checktype(L, 3, LUA_TTABLE);
+
+    int count = (int)lua_rawlen(L, 2);
+    if (count == 0) {
+        return luaL_error(L, "hookMany: no offsets");
+    }
+
+    uintptr_t base = (uintptr_t)find_library_base(lib_name);
+    if (base == 0) {
+        return luaL_error(L, "hookMany: %s is not loaded", lib_name);
+    }
+
+    int lua_flags = 0;
+    lua_getfield(L, 3, "parallel");
+    if (lua_toboolean(L, -1)) lua_flags |= DISPATCH_PARALLEL;
+    lua_pop(L, 1);
+    lua_getfield(L, 3, "async");
+    if (lua_toboolean(L, -1)) lua_flags |= DISPATCH_ASYNC;
+    lua_pop(L, 1);
+
+    int batch_flags = 0;
+    lua_getfield(L, 3, "quiesce");
+    if (lua_toboolean(L, -1)) batch_flags |= HOOK_BATCH_QUIESCE;
+    lua_pop(L, 1);
+
+    HookBatchEntry* entries = calloc((size_t)count, sizeof(HookBatchEntry));
+    if (!entries) {
+        return luaL_error(L, "hookMany: out of memory");
+    }
+
+    for (int i = 0; i < count; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        int isnum = 0;
+        lua_Integer offset = lua_tointegerx(L, -1, &isnum);
+        lua_pop(L, 1);
+        if (!isnum) {
+            for (int j = 0; j < i; j++) {
+                luaL_unref(L, LUA_REGISTRYINDEX, entries[j].onEnter_ref);
+                luaL_unref(L, LUA_REGISTRYINDEX, entries[j].onLeave_ref);
+            }
+            free(entries);
+            return luaL_error(L, "hookMany: offset #%d is not an integer", i + 1);
+        }
+        // Every hook owns its refs: uninstalling one releases them
+        entries[i].target = (void*)(base + (uintptr_t)offset);
+        entries[i].onEnter_ref = ref_field(L, 3, "onEnter");
+        entries[i].onLeave_ref = ref_field(L, 3, "onLeave");
+        entries[i].lua_flags = lua_flags;
+    }
+
+    int installed = install_hook_batch(entries, count, batch_flags);
+    if (installed < 0) {
+        // Reverted hooks may have run their callbacks already
+        for (int i = 0; i < count; i++) {
+            luaL_unref(L, LUA_REGISTRYINDEX, entries[i].onEnter_ref);
+            lua_dispatch_invalidate(entries[i].onEnter_ref);
+            luaL_unref(L, LUA_REGISTRYINDEX, entries[i].onLeave_ref);
+            lua_dispatch_invalidate(entries[i].onLeave_ref);
+        }
+        free(entries);
+        return luaL_error(L, "hookMany: failed, no hook installed in %s", lib_name);
+    }
+
+    verbose_log("hookMany: %d hooks in %s (ids %d..%d)", installed, lib_name,
+                entries[0].hook_id, entries[count - 1].hook_id);
+    free(entries);
+
+    lua_pushinteger(L, installed);
+    return 1;
+}
+
 void register_memory_api(lua_State* L) {
     lua_pushcfunction(L, lua_hook);
     lua_setglobal(L, "hook");
+
+    lua_pushcfunction(L, lua_hook_many);
+    lua_setglobal(L, "hookMany");
 }
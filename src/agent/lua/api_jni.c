@@ -1,6 +1,8 @@
 #include <agent/lua_jni.h>
 #include <agent/lua_engine.h>
 #include <agent/globals.h>
+#include <agent/maps.h>
+#include <agent/symindex.h>
 
 #include <string.h>
 #include <stdint.h>
@@ -28,136 +30,16 @@ typedef struct {
 } JNIEnvExt;
 
 static uintptr_t find_lib_info(const char* lib_name, char* path_out, size_t path_size) {
-    FILE* fp = fopen("/proc/self/maps", "r");
-    if (!fp) return 0;
-
-    char line[512];
-    uintptr_t base = 0;
-
-    while (fgets(line, sizeof(line), fp)) {
-        if (strstr(line, lib_name)) {
-            unsigned long start;
-            char path[256] = {0};
-            if (sscanf(line, "%lx-%*lx %*4s %*x %*s %*d %255s", &start, path) >= 1) {
-                if (base == 0 || start < base) {
-                    base = (uintptr_t)start;
-                    if (path_out && path[0]) {
-                        strncpy(path_out, path, path_size - 1);
-                        path_out[path_size - 1] = '\0';
-                    }
-                }
-            }
-        }
-    }
-
-    fclose(fp);
-    return base;
+    return maps_module_base(lib_name, path_out, path_size);
 }
 
-static uintptr_t get_first_load_vaddr(const char* lib_path) {
-    FILE* fp = fopen(lib_path, "rb");
-    if (!fp) return 0;
+static uintptr_t find_symbol_offset(const SymIndex* idx, const char* symbol_name) {
+    SymInfo sym;
+    if (!symindex_find(idx, symbol_name, &sym)) return 0;
 
-    Elf64_Ehdr ehdr;
-    if (fread(&ehdr, sizeof(ehdr), 1, fp) != 1) {
-        fclose(fp);
-        return 0;
-    }
-
-    uintptr_t first_load_vaddr = 0;
-
-    fseek(fp, ehdr.e_phoff, SEEK_SET);
-    for (int i = 0; i < ehdr.e_phnum; i++) {
-        Elf64_Phdr phdr;
-        if (fread(&phdr, sizeof(phdr), 1, fp) != 1) break;
-
-        if (phdr.p_type == PT_LOAD) {
-            first_load_vaddr = phdr.p_vaddr;
-            break;
-        }
-    }
-
-    fclose(fp);
-    return first_load_vaddr;
-}
-
-static uintptr_t find_symbol_offset(const char* lib_path, const char* symbol_name) {
-    FILE* fp = fopen(lib_path, "rb");
-    if (!fp) return 0;
-
-    Elf64_Ehdr ehdr;
-    if (fread(&ehdr, sizeof(ehdr), 1, fp) != 1) {
-        fclose(fp);
-        return 0;
-    }
-
-    fseek(fp, ehdr.e_shoff, SEEK_SET);
-
-    Elf64_Shdr* shdrs = malloc(ehdr.e_shnum * sizeof(Elf64_Shdr));
-    if (!shdrs || fread(shdrs, sizeof(Elf64_Shdr), ehdr.e_shnum, fp) != ehdr.e_shnum) {
-        free(shdrs);
-        fclose(fp);
-        return 0;
-    }
-
-    Elf64_Shdr* shstrtab = &shdrs[ehdr.e_shstrndx];
-    char* shstrtab_data = malloc(shstrtab->sh_size);
-    if (shstrtab_data) {
-        fseek(fp, shstrtab->sh_offset, SEEK_SET);
-        fread(shstrtab_data, 1, shstrtab->sh_size, fp);
-    }
-
-    uintptr_t offset = 0;
-
-    for (int pass = 0; pass < 2 && offset == 0; pass++) {
-        Elf64_Shdr* symtab_shdr = NULL;
-        Elf64_Shdr* strtab_shdr = NULL;
-
-        for (int i = 0; i < ehdr.e_shnum; i++) {
-            if (pass == 0 && shdrs[i].sh_type == SHT_DYNSYM) {
-                symtab_shdr = &shdrs[i];
-                strtab_shdr = &shdrs[symtab_shdr->sh_link];
-                break;
-            }
-            if (pass == 1 && shdrs[i].sh_type == SHT_SYMTAB) {
-                symtab_shdr = &shdrs[i];
-                strtab_shdr = &shdrs[symtab_shdr->sh_link];
-                break;
-            }
-        }
-
-        if (symtab_shdr && strtab_shdr) {
-            char* strtab = malloc(strtab_shdr->sh_size);
-            if (strtab) {
-                fseek(fp, strtab_shdr->sh_offset, SEEK_SET);
-                fread(strtab, 1, strtab_shdr->sh_size, fp);
-
-                int num_syms = symtab_shdr->sh_size / sizeof(Elf64_Sym);
-                Elf64_Sym* syms = malloc(symtab_shdr->sh_size);
-                if (syms) {
-                    fseek(fp, symtab_shdr->sh_offset, SEEK_SET);
-                    fread(syms, sizeof(Elf64_Sym), num_syms, fp);
-
-                    for (int i = 0; i < num_syms; i++) {
-                        if (syms[i].st_name && syms[i].st_value != 0 &&
-                            strcmp(&strtab[syms[i].st_name], symbol_name) == 0) {
-                            offset = syms[i].st_value;
-                            LOGI("Found %s in %s at offset 0x%lx",
-                                 symbol_name, pass == 0 ? ".dynsym" : ".symtab", offset);
-                            break;
-                        }
-                    }
-                    free(syms);
-                }
-                free(strtab);
-            }
-        }
-    }
-
-    free(shstrtab_data);
-    free(shdrs);
-    fclose(fp);
-    return offset;
+    LOGI("Found %s in %s at offset 0x%lx",
+         symbol_name, sym.dynamic ? ".dynsym" : ".symtab", (unsigned long)sym.value);
+    return sym.value;
 }
 
 static void init_decode_jobject(void) {
@@ -184,12 +66,16 @@ static void init_decode_jobject(void) {
     }
     LOGI("libart.so load_addr: 0x%lx, path: %s", load_addr, lib_path);
 
-    uintptr_t first_load_vaddr = get_first_load_vaddr(lib_path);
-    uintptr_t load_bias = load_addr - first_load_vaddr;
-    LOGI("libart.so first_load_vaddr: 0x%lx, load_bias: 0x%lx", first_load_vaddr, load_bias);
+    const SymIndex* idx = symindex_get_path(lib_path, load_addr);
+    if (!idx) {
+        LOGI("Could not index %s", lib_path);
+        return;
+    }
+    uintptr_t load_bias = symindex_load_bias(idx);
+    LOGI("libart.so load_bias: 0x%lx", load_bias);
 
     for (int s = 0; decode_symbols[s] && !g_decode_jobject; s++) {
-        uintptr_t offset = find_symbol_offset(lib_path, decode_symbols[s]);
+        uintptr_t offset = find_symbol_offset(idx, decode_symbols[s]);
         if (offset) {
             g_decode_jobject = (DecodeJObject_t)(load_bias + offset);
             LOGI("Found DecodeJObject: %s at 0x%lx (bias=0x%lx + offset=0x%lx)",
@@ -198,7 +84,7 @@ static void init_decode_jobject(void) {
     }
 
     for (int s = 0; global_symbols[s] && !g_decode_global_jobject; s++) {
-        uintptr_t offset = find_symbol_offset(lib_path, global_symbols[s]);
+        uintptr_t offset = find_symbol_offset(idx, global_symbols[s]);
         if (offset) {
             g_decode_global_jobject = (DecodeJObject_t)(load_bias + offset);
             LOGI("Found DecodeGlobalJObject: %s at 0x%lx (bias=0x%lx + offset=0x%lx)",
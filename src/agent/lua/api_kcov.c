@@ -1,6 +1,7 @@
 #include <agent/lua_kcov.h>
 #include <agent/kcov.h>
 #include <agent/globals.h>
+#include <agent/output.h>
 
 #include <lua.h>
 #include <lualib.h>
@@ -9,13 +10,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 
-extern int g_output_client_fd;
-
 static void send_to_cli(const char* msg) {
-    if (g_output_client_fd >= 0 && msg) {
-        size_t len = strlen(msg);
-        write(g_output_client_fd, msg, len);
-        write(g_output_client_fd, "\n", 1);
+    if (msg) {
+        output_write(msg, strlen(msg));
     }
 }
 
@@ -3,202 +3,71 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <android/log.h>
 #include <lauxlib.h>
 #include <agent/lua_memory.h>
+#include <agent/scan.h>
+#include <agent/maps.h>
+#include <agent/valscan.h>
+#include <agent/output.h>
+#include <agent/lua_dispatch.h>
 
 #define TAG "LUA_MEMORY"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
 
-extern int g_output_client_fd;
-
 static void send_to_cli(const char* msg) {
-    LOGI("[CLI_SEND] g_output_client_fd=%d, msg=%s", g_output_client_fd, msg ? msg : "NULL");
-    if (g_output_client_fd >= 0 && msg) {
-        size_t len = strlen(msg);
-        ssize_t written = write(g_output_client_fd, msg, len);
-        write(g_output_client_fd, "\n", 1);
-        LOGI("[CLI_SEND] wrote %zd bytes to fd %d", written, g_output_client_fd);
-    } else {
-        LOGI("[CLI_SEND] SKIPPED - fd=%d", g_output_client_fd);
+    if (msg) {
+        output_write(msg, strlen(msg));
     }
 }
 
-static bool pattern_matches(const unsigned char* data, const int* pattern, size_t patternLen) {
-    for (size_t i = 0; i < patternLen; i++) {
-        if (pattern[i] != WILDCARD_BYTE && pattern[i] != data[i]) {
-            return false;
-        }
-    }
-    return true;
-}
-
-static void* my_memmem(const void* haystack, size_t haystack_len,
-                       const void* needle, size_t needle_len) {
-    if (needle_len == 0) return (void*)haystack;
-    if (haystack_len < needle_len) return NULL;
-
-    const unsigned char* h = (const unsigned char*)haystack;
-    const unsigned char* n = (const unsigned char*)needle;
-    const unsigned char* end = h + haystack_len - needle_len + 1;
+// Hex/ASCII view of the match plus 16 bytes either side (clipped to the
+// region). The window is copied with process_vm_readv so a region that was
+// unmapped since the scan yields false instead of a fault.
+bool memory_format_context(uintptr_t addr, uintptr_t regionBegin, uintptr_t regionEnd,
+                           size_t patternLen, char* hex, size_t hexSize,
+                           char* ascii, size_t asciiSize) {
+    const size_t contextSize = 16;
+    uintptr_t contextStart = (addr - regionBegin >= contextSize) ? addr - contextSize : regionBegin;
+    uintptr_t contextEnd = (regionEnd - (addr + patternLen) >= contextSize) ? addr + patternLen + contextSize : regionEnd;
+    size_t totalContextSize = contextEnd - contextStart;
+    size_t patternOffset = addr - contextStart;
 
-    while (h < end) {
-        if (memcmp(h, n, needle_len) == 0) {
-            return (void*)h;
-        }
-        h++;
-    }
-    return NULL;
-}
+    hex[0] = '\0';
+    ascii[0] = '\0';
 
-MemorySearchResult memory_search(const unsigned char* pattern, size_t patternLen) {
-    MemorySearchResult result;
-    memset(&result, 0, sizeof(result));
+    unsigned char window[160];
+    if (totalContextSize > sizeof(window)) totalContextSize = sizeof(window);
 
-    result.capacity = 256;
-    result.items = (MemoryResult*)malloc(result.capacity * sizeof(MemoryResult));
-    if (!result.items) {
-        return result;
+    struct iovec local = { window, totalContextSize };
+    struct iovec remote = { (void*)contextStart, totalContextSize };
+    if (syscall(__NR_process_vm_readv, getpid(), &local, 1, &remote, 1, 0) != (long)totalContextSize) {
+        return false;
     }
 
-    FILE* maps = fopen("/proc/self/maps", "r");
-    if (maps == NULL) {
-        free(result.items);
-        result.items = NULL;
-        return result;
-    }
-
-    char buffer[512];
-
-    while (fgets(buffer, sizeof(buffer), maps) && result.count < DEFAULT_MAX_RESULTS) {
-        char addr[64], perms[8], offset[16], dev[16], inode[16], path[256];
-        path[0] = '\0';
-
-        int parsed = sscanf(buffer, "%63s %7s %15s %15s %15s %255[^\n]",
-                           addr, perms, offset, dev, inode, path);
-        if (parsed < 5) {
-            continue;
-        }
-
-        if (perms[0] != 'r') {
-            continue;
-        }
-
-        if (strstr(path, "/dev/") || strstr(buffer, "[vdso]") || strstr(buffer, "[vvar]")) {
-            continue;
-        }
-
-        char* dash = strchr(addr, '-');
-        if (dash == NULL) {
-            continue;
-        }
-
-        *dash = '\0';
-        char* start_str = addr;
-        char* end_str = dash + 1;
-
-        uintptr_t startAddr = strtoull(start_str, NULL, 16);
-        uintptr_t endAddr = strtoull(end_str, NULL, 16);
-        if (endAddr <= startAddr) {
-            continue;
-        }
-
-        size_t regionSize = endAddr - startAddr;
-        if (regionSize < patternLen) {
-            continue;
-        }
-
-        const unsigned char* regionBegin = (const unsigned char*)startAddr;
-        const unsigned char* regionEnd = regionBegin + regionSize;
-        const unsigned char* searchStart = regionBegin;
-
-        while (searchStart < regionEnd && result.count < DEFAULT_MAX_RESULTS) {
-            size_t remaining = regionEnd - searchStart;
-            const unsigned char* found = (const unsigned char*)my_memmem(
-                searchStart, remaining, pattern, patternLen
-            );
-
-            if (found == NULL) {
-                break;
-            }
-
-            LOGI("Pattern found at %p in %s", (const void*)found, path);
-
-            const size_t contextSize = 16;
-            const unsigned char* contextStart = (found - regionBegin >= contextSize)
-                ? found - contextSize : regionBegin;
-            const unsigned char* contextEnd = (regionEnd - (found + patternLen) >= contextSize)
-                ? found + patternLen + contextSize : regionEnd;
-
-            size_t totalContextSize = contextEnd - contextStart;
-            size_t patternOffset = found - contextStart;
-
-            char hexDump[512];
-            char* hexPtr = hexDump;
-            hexDump[0] = '\0';
-            for (size_t i = 0; i < totalContextSize && (hexPtr - hexDump) < 480; i++) {
-                if (i == patternOffset) hexPtr += sprintf(hexPtr, "[");
-                hexPtr += sprintf(hexPtr, "%02X ", contextStart[i]);
-                if (i == patternOffset + patternLen - 1) hexPtr += sprintf(hexPtr, "] ");
-            }
-
-            char asciiDump[128];
-            char* asciiPtr = asciiDump;
-            asciiDump[0] = '\0';
-            for (size_t i = 0; i < totalContextSize && i < 100; i++) {
-                unsigned char c = contextStart[i];
-                if (i == patternOffset) *asciiPtr++ = '[';
-                *asciiPtr++ = (c >= 32 && c <= 126) ? (char)c : '.';
-                if (i == patternOffset + patternLen - 1) *asciiPtr++ = ']';
-            }
-            *asciiPtr = '\0';
-
-            LOGI("Offset: 0x%lx", (unsigned long)(found - regionBegin));
-            LOGI("HEX: %s", hexDump);
-            LOGI("ASCII: %s", asciiDump);
-
-            if (result.count >= result.capacity) {
-                int new_capacity = result.capacity * 2;
-                MemoryResult* new_items = (MemoryResult*)realloc(result.items, new_capacity * sizeof(MemoryResult));
-                if (!new_items) {
-                    break;
-                }
-                result.items = new_items;
-                result.capacity = new_capacity;
-            }
-
-            result.items[result.count].library_name = strdup(path);
-            result.items[result.count].hex_result = strdup(hexDump);
-            result.items[result.count].ascii_result = strdup(asciiDump);
-            result.items[result.count].found_offset_addr = (uintptr_t)(found - regionBegin);
-            result.items[result.count].absolute_addr = (uintptr_t)found;
-            result.count++;
-
-            searchStart = found + 1;
-        }
+    size_t h = 0;
+    for (size_t i = 0; i < totalContextSize && h + 8 < hexSize; i++) {
+        if (i == patternOffset) h += snprintf(hex + h, hexSize - h, "[");
+        h += snprintf(hex + h, hexSize - h, "%02X ", window[i]);
+        if (i == patternOffset + patternLen - 1) h += snprintf(hex + h, hexSize - h, "] ");
     }
 
-    fclose(maps);
-    return result;
-}
-
-void free_search_result(MemorySearchResult* result) {
-    if (result->items) {
-        for (int i = 0; i < result->count; i++) {
-            free(result->items[i].library_name);
-            free(result->items[i].hex_result);
-            free(result->items[i].ascii_result);
-        }
-        free(result->items);
-        result->items = NULL;
+    size_t a = 0;
+    for (size_t i = 0; i < totalContextSize && a + 4 < asciiSize; i++) {
+        unsigned char c = window[i];
+        if (i == patternOffset) ascii[a++] = '[';
+        ascii[a++] = (c >= 32 && c <= 126) ? (char)c : '.';
+        if (i == patternOffset + patternLen - 1) ascii[a++] = ']';
     }
-    result->count = 0;
-    result->capacity = 0;
+    ascii[a] = '\0';
+    return true;
 }
 
-static bool add_result(MemorySearchResult* result, const char* path,
-                       const unsigned char* found, const unsigned char* regionBegin,
-                       const unsigned char* regionEnd, size_t patternLen) {
+static bool add_result(MemorySearchResult* result, const char* path, uintptr_t found,
+                       uintptr_t regionBegin, uintptr_t regionEnd, size_t patternLen,
+                       int patternIndex) {
     if (result->count >= result->capacity) {
         int new_capacity = result->capacity * 2;
         MemoryResult* new_items = (MemoryResult*)realloc(result->items, new_capacity * sizeof(MemoryResult));
@@ -207,241 +76,182 @@ static bool add_result(MemorySearchResult* result, const char* path,
         result->capacity = new_capacity;
     }
 
-    const size_t contextSize = 16;
-    const unsigned char* contextStart = (found - regionBegin >= contextSize) ? found - contextSize : regionBegin;
-    const unsigned char* contextEnd = (regionEnd - (found + patternLen) >= contextSize) ? found + patternLen + contextSize : regionEnd;
-    size_t totalContextSize = contextEnd - contextStart;
-    size_t patternOffset = found - contextStart;
-
     char hexDump[512];
-    char* hexPtr = hexDump;
-    hexDump[0] = '\0';
-    for (size_t i = 0; i < totalContextSize && (hexPtr - hexDump) < 480; i++) {
-        if (i == patternOffset) hexPtr += sprintf(hexPtr, "[");
-        hexPtr += sprintf(hexPtr, "%02X ", contextStart[i]);
-        if (i == patternOffset + patternLen - 1) hexPtr += sprintf(hexPtr, "] ");
-    }
-
     char asciiDump[128];
-    char* asciiPtr = asciiDump;
-    for (size_t i = 0; i < totalContextSize && i < 100; i++) {
-        unsigned char c = contextStart[i];
-        if (i == patternOffset) *asciiPtr++ = '[';
-        *asciiPtr++ = (c >= 32 && c <= 126) ? (char)c : '.';
-        if (i == patternOffset + patternLen - 1) *asciiPtr++ = ']';
-    }
-    *asciiPtr = '\0';
+    memory_format_context(found, regionBegin, regionEnd, patternLen,
+                          hexDump, sizeof(hexDump), asciiDump, sizeof(asciiDump));
 
     result->items[result->count].library_name = strdup(path);
     result->items[result->count].hex_result = strdup(hexDump);
     result->items[result->count].ascii_result = strdup(asciiDump);
-    result->items[result->count].found_offset_addr = (uintptr_t)(found - regionBegin);
-    result->items[result->count].absolute_addr = (uintptr_t)found;
+    result->items[result->count].found_offset_addr = found - regionBegin;
+    result->items[result->count].absolute_addr = found;
+    result->items[result->count].pattern_index = patternIndex;
     result->count++;
     return true;
 }
 
-MemorySearchResult memory_search_pattern(const int* pattern, size_t patternLen) {
-    MemorySearchResult result;
-    memset(&result, 0, sizeof(result));
-    result.capacity = 256;
-    result.items = (MemoryResult*)malloc(result.capacity * sizeof(MemoryResult));
-    if (!result.items) return result;
-
-    FILE* maps = fopen("/proc/self/maps", "r");
-    if (!maps) {
-        free(result.items);
-        result.items = NULL;
-        return result;
-    }
-
-    int firstByte = -1;
-    size_t firstByteIdx = 0;
-    for (size_t i = 0; i < patternLen; i++) {
-        if (pattern[i] != WILDCARD_BYTE) {
-            firstByte = pattern[i];
-            firstByteIdx = i;
-            if (pattern[i] != 0x00 && pattern[i] != 0xFF && pattern[i] != 0x48) {
-                break;
-            }
-        }
+static bool region_list_add(MemoryRegions* list, uintptr_t start, uintptr_t end, const char* path) {
+    if (list->count >= list->capacity) {
+        int cap = list->capacity ? list->capacity * 2 : 256;
+        ScanRange* ranges = (ScanRange*)realloc(list->ranges, cap * sizeof(ScanRange));
+        if (!ranges) return false;
+        list->ranges = ranges;
+        char (*paths)[256] = realloc(list->paths, cap * sizeof(*paths));
+        if (!paths) return false;
+        list->paths = paths;
+        list->capacity = cap;
     }
+    list->ranges[list->count].start = start;
+    list->ranges[list->count].end = end;
+    snprintf(list->paths[list->count], sizeof(list->paths[0]), "%s", path);
+    list->count++;
+    return true;
+}
 
-    LOGI("Pattern search: len=%zu, firstByte=0x%02X at idx=%zu", patternLen, firstByte, firstByteIdx);
+// Collect readable mappings (optionally only those whose path contains
+// lib_filter) for the scan thread pool. Scans want anonymous mappings as
+// they are now, so this always takes a fresh maps snapshot.
+size_t memory_collect_regions(MemoryRegions* regions, const char* lib_filter,
+                              size_t min_len, size_t max_bytes) {
+    const MapsIndex* maps = maps_acquire_fresh();
+    if (!maps) return 0;
 
-    char buffer[512];
     size_t totalBytesSearched = 0;
-    const size_t MAX_SEARCH_BYTES = 512 * 1024 * 1024;  // 512MB limit
 
-    while (fgets(buffer, sizeof(buffer), maps) && result.count < DEFAULT_MAX_RESULTS) {
-        if (totalBytesSearched > MAX_SEARCH_BYTES) {
-            LOGI("Pattern search: reached 50MB limit, stopping");
+    for (int i = 0; i < maps->count; i++) {
+        if (max_bytes && totalBytesSearched > max_bytes) {
+            LOGI("Memory search: reached %zu MB limit, stopping", max_bytes >> 20);
             break;
         }
+        const MapRegion* r = &maps->regions[i];
+        const char* path = maps_region_path(maps, r);
+        if (lib_filter && !strstr(path, lib_filter)) continue;
+        if (!(r->perms & MAPS_PERM_R)) continue;
 
-        char addr[64], perms[8], offset[16], dev[16], inode[16], path[256];
-        path[0] = '\0';
-
-        if (sscanf(buffer, "%63s %7s %15s %15s %15s %255[^\n]", addr, perms, offset, dev, inode, path) < 5)
+        if (!lib_filter &&
+            (strstr(path, "/dev/") || strcmp(path, "[vdso]") == 0 || strcmp(path, "[vvar]") == 0)) {
             continue;
-        if (perms[0] != 'r') continue;
-
-        if (strstr(path, "/dev/") || strstr(buffer, "[vdso]") || strstr(buffer, "[vvar]")) continue;
-
-        char* dash = strchr(addr, '-');
-        if (!dash) continue;
-        *dash = '\0';
-
-        uintptr_t startAddr = strtoull(addr, NULL, 16);
-        uintptr_t endAddr = strtoull(dash + 1, NULL, 16);
-        if (endAddr <= startAddr) continue;
-
-        size_t regionSize = endAddr - startAddr;
-        if (regionSize < patternLen) continue;
-
-        totalBytesSearched += regionSize;
-
-        const unsigned char* regionBegin = (const unsigned char*)startAddr;
-        const unsigned char* maxSearchPos = regionBegin + regionSize - patternLen;
-        const unsigned char* regionEnd = regionBegin + regionSize;
-
-        if (firstByte >= 0) {
-            const unsigned char* p = regionBegin + firstByteIdx;  // Start at offset where anchor byte would be
-            while (p < regionEnd && result.count < DEFAULT_MAX_RESULTS) {
-                size_t searchLen = regionEnd - p;
-                const unsigned char* candidate = (const unsigned char*)memchr(p, firstByte, searchLen);
-                if (!candidate) break;
-
-                const unsigned char* checkPos = candidate - firstByteIdx;
-                if (checkPos >= regionBegin && checkPos <= maxSearchPos) {
-                    if (pattern_matches(checkPos, pattern, patternLen)) {
-                        add_result(&result, path, checkPos, regionBegin, regionEnd, patternLen);
-                    }
-                }
-                p = candidate + 1;
-            }
-        } else {
-            for (const unsigned char* p = regionBegin; p <= maxSearchPos && result.count < DEFAULT_MAX_RESULTS; p++) {
-                if (pattern_matches(p, pattern, patternLen)) {
-                    add_result(&result, path, p, regionBegin, regionEnd, patternLen);
-                }
-            }
         }
-    }
-
-    LOGI("Pattern search done: %d results, searched %zu bytes", result.count, totalBytesSearched);
-    fclose(maps);
-    return result;
-}
+        if (r->end - r->start < min_len) continue;
 
-MemorySearchResult memory_search_string(const char* str) {
-    return memory_search((const unsigned char*)str, strlen(str));
+        if (!region_list_add(regions, r->start, r->end, path)) break;
+        totalBytesSearched += r->end - r->start;
+    }
+    maps_release(maps);
+    return totalBytesSearched;
 }
 
-MemorySearchResult memory_search_in_lib(const char* libName, const unsigned char* pattern, size_t patternLen) {
+static MemorySearchResult build_results(const MemoryRegions* regions, const ScanHit* hits, int nhits,
+                                        const ScanMulti* multi, size_t len) {
     MemorySearchResult result;
     memset(&result, 0, sizeof(result));
-    result.capacity = 256;
-    result.items = (MemoryResult*)malloc(result.capacity * sizeof(MemoryResult));
-    if (!result.items) return result;
 
-    FILE* maps = fopen("/proc/self/maps", "r");
-    if (!maps) {
-        free(result.items);
-        result.items = NULL;
-        return result;
+    result.capacity = nhits > 0 ? nhits : 1;
+    result.items = (MemoryResult*)malloc(result.capacity * sizeof(MemoryResult));
+    for (int i = 0; i < nhits && result.items; i++) {
+        const ScanRange* r = &regions->ranges[hits[i].range];
+        size_t patternLen = multi ? scan_multi_pattern_len(multi, hits[i].pattern) : len;
+        add_result(&result, regions->paths[hits[i].range], hits[i].addr,
+                   r->start, r->end, patternLen, hits[i].pattern);
     }
+    return result;
+}
 
-    char buffer[512];
-    while (fgets(buffer, sizeof(buffer), maps) && result.count < DEFAULT_MAX_RESULTS) {
-        if (!strstr(buffer, libName)) continue;
+void memory_free_regions(MemoryRegions* regions) {
+    free(regions->ranges);
+    free(regions->paths);
+}
 
-        char addr[64], perms[8], offset[16], dev[16], inode[16], path[256];
-        path[0] = '\0';
+// Every match is reported, overlapping ones included, in address order.
+static MemorySearchResult search_regions(const ScanPattern* sp, const char* lib_filter,
+                                         size_t max_bytes) {
+    MemoryRegions regions = {0};
+    size_t searched = memory_collect_regions(&regions, lib_filter, sp->len, max_bytes);
 
-        if (sscanf(buffer, "%63s %7s %15s %15s %15s %255[^\n]", addr, perms, offset, dev, inode, path) < 5)
-            continue;
-        if (perms[0] != 'r') continue;
+    ScanHit* hits = NULL;
+    int nhits = scan_ranges(sp, regions.ranges, regions.count, DEFAULT_MAX_RESULTS, NULL, &hits);
+    MemorySearchResult result = build_results(&regions, hits, nhits, NULL, sp->len);
 
-        char* dash = strchr(addr, '-');
-        if (!dash) continue;
-        *dash = '\0';
+    LOGI("Memory search done: %d results, searched %zu bytes in %d regions (%d threads)",
+         result.count, searched, regions.count, scan_get_threads());
 
-        uintptr_t startAddr = strtoull(addr, NULL, 16);
-        uintptr_t endAddr = strtoull(dash + 1, NULL, 16);
-        if (endAddr <= startAddr) continue;
+    free(hits);
+    memory_free_regions(&regions);
+    return result;
+}
 
-        size_t regionSize = endAddr - startAddr;
-        if (regionSize < patternLen) continue;
+MemorySearchResult memory_search_many(const ScanMulti* multi, const char* libName) {
+    MemoryRegions regions = {0};
+    size_t searched = memory_collect_regions(&regions, libName, 1, libName ? 0 : 512 * 1024 * 1024);
 
-        const unsigned char* regionBegin = (const unsigned char*)startAddr;
-        const unsigned char* regionEnd = regionBegin + regionSize;
-        const unsigned char* searchStart = regionBegin;
+    ScanHit* hits = NULL;
+    int nhits = scan_ranges_multi(multi, regions.ranges, regions.count, DEFAULT_MAX_RESULTS, NULL, &hits);
+    MemorySearchResult result = build_results(&regions, hits, nhits, multi, 0);
 
-        while (searchStart < regionEnd && result.count < DEFAULT_MAX_RESULTS) {
-            size_t remaining = regionEnd - searchStart;
-            const unsigned char* found = (const unsigned char*)my_memmem(searchStart, remaining, pattern, patternLen);
-            if (!found) break;
-            add_result(&result, path, found, regionBegin, regionEnd, patternLen);
-            searchStart = found + 1;
-        }
-    }
+    LOGI("Memory search (%d patterns) done: %d results, searched %zu bytes in %d regions",
+         scan_multi_count(multi), result.count, searched, regions.count);
 
-    fclose(maps);
+    free(hits);
+    memory_free_regions(&regions);
     return result;
 }
 
-MemorySearchResult memory_search_pattern_in_lib(const char* libName, const int* pattern, size_t patternLen) {
-    MemorySearchResult result;
-    memset(&result, 0, sizeof(result));
-    result.capacity = 256;
-    result.items = (MemoryResult*)malloc(result.capacity * sizeof(MemoryResult));
-    if (!result.items) return result;
-
-    FILE* maps = fopen("/proc/self/maps", "r");
-    if (!maps) {
-        free(result.items);
-        result.items = NULL;
-        return result;
+MemorySearchResult memory_search(const unsigned char* pattern, size_t patternLen) {
+    ScanPattern sp;
+    if (!scan_pattern_init(&sp, pattern, patternLen)) {
+        MemorySearchResult empty = {0};
+        return empty;
     }
+    return search_regions(&sp, NULL, 0);
+}
 
-    char buffer[512];
-    while (fgets(buffer, sizeof(buffer), maps) && result.count < DEFAULT_MAX_RESULTS) {
-        if (!strstr(buffer, libName)) continue;
-
-        char addr[64], perms[8], offset[16], dev[16], inode[16], path[256];
-        path[0] = '\0';
-
-        if (sscanf(buffer, "%63s %7s %15s %15s %15s %255[^\n]", addr, perms, offset, dev, inode, path) < 5)
-            continue;
-        if (perms[0] != 'r') continue;
-
-        char* dash = strchr(addr, '-');
-        if (!dash) continue;
-        *dash = '\0';
-
-        uintptr_t startAddr = strtoull(addr, NULL, 16);
-        uintptr_t endAddr = strtoull(dash + 1, NULL, 16);
-        if (endAddr <= startAddr) continue;
+void free_search_result(MemorySearchResult* result) {
+    if (result->items) {
+        for (int i = 0; i < result->count; i++) {
+            free(result->items[i].library_name);
+            free(result->items[i].hex_result);
+            free(result->items[i].ascii_result);
+        }
+        free(result->items);
+        result->items = NULL;
+    }
+    result->count = 0;
+    result->capacity = 0;
+}
 
-        size_t regionSize = endAddr - startAddr;
-        if (regionSize < patternLen) continue;
+MemorySearchResult memory_search_pattern(const int* pattern, size_t patternLen) {
+    ScanPattern sp;
+    if (!scan_pattern_init_masked(&sp, pattern, patternLen)) {
+        MemorySearchResult empty = {0};
+        return empty;
+    }
+    return search_regions(&sp, NULL, 512 * 1024 * 1024);
+}
 
-        const unsigned char* regionBegin = (const unsigned char*)startAddr;
-        const unsigned char* regionEnd = regionBegin + regionSize;
+MemorySearchResult memory_search_string(const char* str) {
+    return memory_search((const unsigned char*)str, strlen(str));
+}
 
-        for (const unsigned char* p = regionBegin; p <= regionEnd - patternLen && result.count < DEFAULT_MAX_RESULTS; p++) {
-            if (pattern_matches(p, pattern, patternLen)) {
-                add_result(&result, path, p, regionBegin, regionEnd, patternLen);
-            }
-        }
+MemorySearchResult memory_search_in_lib(const char* libName, const unsigned char* pattern, size_t patternLen) {
+    ScanPattern sp;
+    if (!scan_pattern_init(&sp, pattern, patternLen)) {
+        MemorySearchResult empty = {0};
+        return empty;
     }
+    return search_regions(&sp, libName, 0);
+}
 
-    fclose(maps);
-    return result;
+MemorySearchResult memory_search_pattern_in_lib(const char* libName, const int* pattern, size_t patternLen) {
+    ScanPattern sp;
+    if (!scan_pattern_init_masked(&sp, pattern, patternLen)) {
+        MemorySearchResult empty = {0};
+        return empty;
+    }
+    return search_regions(&sp, libName, 0);
 }
 
-static int parse_pattern(const char* patternStr, int* outPattern, size_t maxLen) {
+int memory_parse_pattern(const char* patternStr, int* outPattern, size_t maxLen) {
     int count = 0;
     const char* p = patternStr;
 
@@ -463,15 +273,46 @@ static int parse_pattern(const char* patternStr, int* outPattern, size_t maxLen)
     return count;
 }
 
+static void push_results(lua_State* L, const MemorySearchResult* result, bool with_pattern) {
+    lua_newtable(L);
+    for (int i = 0; i < result->count; i++) {
+        lua_newtable(L);
+
+        if (with_pattern) {
+            lua_pushinteger(L, result->items[i].pattern_index + 1);
+            lua_setfield(L, -2, "pattern");
+        }
+
+        lua_pushstring(L, result->items[i].library_name);
+        lua_setfield(L, -2, "library");
+
+        lua_pushinteger(L, result->items[i].absolute_addr);
+        lua_setfield(L, -2, "addr");
+
+        lua_pushinteger(L, result->items[i].found_offset_addr);
+        lua_setfield(L, -2, "offset");
+
+        lua_pushstring(L, result->items[i].hex_result);
+        lua_setfield(L, -2, "hex");
+
+        lua_pushstring(L, result->items[i].ascii_result);
+        lua_setfield(L, -2, "ascii");
+
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
 static int lua_mem_search(lua_State* L) {
     const char* input = luaL_checkstring(L, 1);
     const char* libFilter = lua_isstring(L, 2) ? lua_tostring(L, 2) : NULL;
 
     MemorySearchResult result;
 
+    // Arguments stay on the stack; hooks may use the state meanwhile
+    int token = lua_dispatch_suspend();
     if (strstr(input, " ") || strstr(input, "??")) {
         int pattern[256];
-        int patternLen = parse_pattern(input, pattern, 256);
+        int patternLen = memory_parse_pattern(input, pattern, 256);
 
         if (libFilter) {
             result = memory_search_pattern_in_lib(libFilter, pattern, patternLen);
@@ -485,30 +326,236 @@ static int lua_mem_search(lua_State* L) {
             result = memory_search_string(input);
         }
     }
+    lua_dispatch_resume(token);
+
+    push_results(L, &result, false);
+    free_search_result(&result);
+    return 1;
+}
+
+// Memory.searchMany({ "48 8B ?? ?? 00", "frida", ... } [, lib])
+// Same pattern syntax as Memory.search; `pattern` in each result is the
+// 1-based index of the pattern that matched.
+static int lua_mem_search_many(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    const char* libFilter = lua_isstring(L, 2) ? lua_tostring(L, 2) : NULL;
+
+    ScanMulti* multi = scan_multi_create();
+    if (!multi) {
+        return luaL_error(L, "Memory.searchMany: out of memory");
+    }
+
+    int n = (int)luaL_len(L, 1);
+    for (int i = 1; i <= n; i++) {
+        lua_rawgeti(L, 1, i);
+        size_t inputLen;
+        const char* input = lua_tolstring(L, -1, &inputLen);
+        int pattern[256];
+        int patternLen = 0;
+
+        if (input && (strstr(input, " ") || strstr(input, "??"))) {
+            patternLen = memory_parse_pattern(input, pattern, 256);
+        } else if (input) {
+            for (size_t k = 0; k < inputLen && k < 256; k++) {
+                pattern[patternLen++] = (unsigned char)input[k];
+            }
+        }
+        lua_pop(L, 1);
+
+        if (patternLen == 0 || scan_multi_add(multi, pattern, patternLen) < 0) {
+            scan_multi_free(multi);
+            return luaL_error(L, "Memory.searchMany: invalid pattern #%d", i);
+        }
+    }
+
+    if (!scan_multi_compile(multi)) {
+        scan_multi_free(multi);
+        return luaL_error(L, "Memory.searchMany: no patterns");
+    }
+
+    int token = lua_dispatch_suspend();
+    MemorySearchResult result = memory_search_many(multi, libFilter);
+    lua_dispatch_resume(token);
+    scan_multi_free(multi);
+
+    push_results(L, &result, true);
+    free_search_result(&result);
+    return 1;
+}
+
+static uint64_t check_value(lua_State* L, int idx, ValueType type) {
+    if (lua_isinteger(L, idx)) {
+        return valscan_encode(type, 0, lua_tointeger(L, idx), true);
+    }
+    return valscan_encode(type, luaL_checknumber(L, idx), 0, false);
+}
+
+static ValueOp check_op(lua_State* L, int idx) {
+    ValueOp op;
+    const char* name = luaL_checkstring(L, idx);
+    if (!valscan_parse_op(name, &op)) {
+        luaL_error(L, "unknown scan op '%s'", name);
+    }
+    return op;
+}
+
+// Memory.scanValue("u32", 100) or Memory.scanValue("f32", "range", 1.0, 2.0)
+// Type may carry an alignment ("u32:1"). Returns the candidate count.
+static int lua_mem_scan_value(lua_State* L) {
+    ValueType type;
+    size_t align;
+    const char* type_name = luaL_checkstring(L, 1);
+    if (!valscan_parse_type(type_name, &type, &align)) {
+        return luaL_error(L, "unknown value type '%s'", type_name);
+    }
+
+    ValueOp op = VS_EQ;
+    int arg = 2;
+    if (lua_type(L, 2) == LUA_TSTRING) {
+        op = check_op(L, 2);
+        arg = 3;
+    }
+    if (VS_OP_NEEDS_PREVIOUS(op)) {
+        return luaL_error(L, "'%s' needs a previous scan, use Memory.nextScan", lua_tostring(L, 2));
+    }
+
+    uint64_t a = check_value(L, arg, type);
+    uint64_t b = op == VS_RANGE ? check_value(L, arg + 1, type) : 0;
+
+    int token = lua_dispatch_suspend();
+    long count = valscan_first(type, align, op, a, b);
+    lua_dispatch_resume(token);
+    if (count < 0) {
+        return luaL_error(L, "value scan failed");
+    }
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+// Memory.nextScan("increased") / ("eq", 95) / ("range", 10, 20)
+static int lua_mem_next_scan(lua_State* L) {
+    if (valscan_scans() == 0) {
+        return luaL_error(L, "no value scan, use Memory.scanValue first");
+    }
+    ValueOp op = check_op(L, 1);
+    ValueType type = valscan_type();
+
+    uint64_t a = 0, b = 0;
+    if (!VS_OP_NEEDS_PREVIOUS(op)) {
+        a = check_value(L, 2, type);
+        if (op == VS_RANGE) b = check_value(L, 3, type);
+    }
+
+    int token = lua_dispatch_suspend();
+    long count = valscan_next(op, a, b);
+    lua_dispatch_resume(token);
+    if (count < 0) {
+        return luaL_error(L, "value scan failed");
+    }
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+static void push_value(lua_State* L, ValueType type, uint64_t raw) {
+    if (type == VS_F32) {
+        float f;
+        uint32_t bits = (uint32_t)raw;
+        memcpy(&f, &bits, sizeof(f));
+        lua_pushnumber(L, f);
+    } else if (type == VS_F64) {
+        double d;
+        memcpy(&d, &raw, sizeof(d));
+        lua_pushnumber(L, d);
+    } else if (type >= VS_I8 && type <= VS_I32) {
+        int shift = 64 - (int)(8 << (type - VS_I8));
+        lua_pushinteger(L, (lua_Integer)((int64_t)(raw << shift) >> shift));
+    } else {
+        lua_pushinteger(L, (lua_Integer)raw);
+    }
+}
+
+// Memory.scanResults([offset [, count]]) -> { {addr, value, library, offset}, ... }
+// Values are as of the last scan; offset is 0-based, count defaults to 100.
+static int lua_mem_scan_results(lua_State* L) {
+    lua_Integer offset = luaL_optinteger(L, 1, 0);
+    lua_Integer count = luaL_optinteger(L, 2, 100);
+    if (offset < 0) offset = 0;
+    if (count < 0) count = 0;
+    if (count > 100000) count = 100000;
+
+    ValueHit* hits = malloc((count ? count : 1) * sizeof(ValueHit));
+    if (!hits) {
+        return luaL_error(L, "Memory.scanResults: out of memory");
+    }
+    size_t n = valscan_results((size_t)offset, (size_t)count, hits);
+    ValueType type = valscan_type();
 
     lua_newtable(L);
-    for (int i = 0; i < result.count; i++) {
+    for (size_t i = 0; i < n; i++) {
         lua_newtable(L);
 
-        lua_pushstring(L, result.items[i].library_name);
-        lua_setfield(L, -2, "library");
-
-        lua_pushinteger(L, result.items[i].absolute_addr);
+        lua_pushinteger(L, hits[i].addr);
         lua_setfield(L, -2, "addr");
 
-        lua_pushinteger(L, result.items[i].found_offset_addr);
-        lua_setfield(L, -2, "offset");
+        push_value(L, type, hits[i].value);
+        lua_setfield(L, -2, "value");
 
-        lua_pushstring(L, result.items[i].hex_result);
-        lua_setfield(L, -2, "hex");
+        lua_pushstring(L, hits[i].path);
+        lua_setfield(L, -2, "library");
 
-        lua_pushstring(L, result.items[i].ascii_result);
-        lua_setfield(L, -2, "ascii");
+        lua_pushinteger(L, hits[i].addr - hits[i].base);
+        lua_setfield(L, -2, "offset");
 
         lua_rawseti(L, -2, i + 1);
     }
+    free(hits);
+    return 1;
+}
 
-    free_search_result(&result);
+static int lua_mem_scan_reset(lua_State* L) {
+    (void)L;
+    valscan_reset();
+    return 0;
+}
+
+// Memory.scanOptions({ threads = n, cpus = {4, 5, 6, 7} }) -> current options
+static int lua_mem_scan_options(lua_State* L) {
+    if (lua_istable(L, 1)) {
+        lua_getfield(L, 1, "threads");
+        if (lua_isinteger(L, -1)) {
+            scan_set_threads((int)lua_tointeger(L, -1));
+        }
+        lua_pop(L, 1);
+
+        lua_getfield(L, 1, "cpus");
+        if (lua_istable(L, -1)) {
+            int cpus[SCAN_MAX_THREADS];
+            int n = 0;
+            int len = (int)luaL_len(L, -1);
+            for (int i = 1; i <= len && n < SCAN_MAX_THREADS; i++) {
+                lua_rawgeti(L, -1, i);
+                if (lua_isinteger(L, -1)) cpus[n++] = (int)lua_tointeger(L, -1);
+                lua_pop(L, 1);
+            }
+            scan_set_cpus(cpus, n);
+        } else if (lua_isboolean(L, -1) && !lua_toboolean(L, -1)) {
+            scan_set_cpus(NULL, 0);
+        }
+        lua_pop(L, 1);
+    }
+
+    lua_newtable(L);
+    lua_pushinteger(L, scan_get_threads());
+    lua_setfield(L, -2, "threads");
+
+    int cpus[SCAN_MAX_THREADS];
+    int n = scan_get_cpus(cpus, SCAN_MAX_THREADS);
+    lua_newtable(L);
+    for (int i = 0; i < n; i++) {
+        lua_pushinteger(L, cpus[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "cpus");
     return 1;
 }
 
@@ -650,10 +697,10 @@ static int lua_mem_patch(lua_State* L) {
         lua_pushstring(L, "mprotect failed");
         return 2;
     }
+    maps_invalidate();
 
     memcpy((void*)address, patch_bytes, patch_len);
 
-
     char success_msg[256];
     snprintf(success_msg, sizeof(success_msg), "✓ Patched %zu bytes at 0x%lx", patch_len, (unsigned long)address);
     send_to_cli(success_msg);
@@ -814,9 +861,30 @@ void register_memory_search_api(lua_State* L) {
     lua_pushcfunction(L, lua_mem_search);
     lua_setfield(L, -2, "search");
 
+    lua_pushcfunction(L, lua_mem_scan_options);
+    lua_setfield(L, -2, "scanOptions");
+
     lua_pushcfunction(L, lua_mem_search);
     lua_setfield(L, -2, "scan");
 
+    lua_pushcfunction(L, lua_mem_search_many);
+    lua_setfield(L, -2, "searchMany");
+
+    lua_pushcfunction(L, lua_mem_search_many);
+    lua_setfield(L, -2, "scanMany");
+
+    lua_pushcfunction(L, lua_mem_scan_value);
+    lua_setfield(L, -2, "scanValue");
+
+    lua_pushcfunction(L, lua_mem_next_scan);
+    lua_setfield(L, -2, "nextScan");
+
+    lua_pushcfunction(L, lua_mem_scan_results);
+    lua_setfield(L, -2, "scanResults");
+
+    lua_pushcfunction(L, lua_mem_scan_reset);
+    lua_setfield(L, -2, "scanReset");
+
     lua_pushcfunction(L, lua_mem_dump);
     lua_setfield(L, -2, "dump");
 
@@ -0,0 +1,188 @@
+#include <agent/lua_shared.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Process-wide key/value store visible from every Lua state (main script
+// and per-thread hook states). Values are copied in and out, so only
+// nil, booleans, numbers and strings can be stored.
+
+typedef enum {
+    SHARED_NIL,
+    SHARED_BOOL,
+    SHARED_INT,
+    SHARED_FLOAT,
+    SHARED_STRING
+} SharedType;
+
+typedef struct {
+    char* key;
+    SharedType type;
+    union {
+        int b;
+        lua_Integer i;
+        lua_Number n;
+        struct {
+            char* data;
+            size_t len;
+        } s;
+    } v;
+} SharedEntry;
+
+static SharedEntry* g_shared = NULL;
+static int g_shared_count = 0;
+static int g_shared_capacity = 0;
+static pthread_mutex_t g_shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static SharedEntry* shared_find(const char* key) {
+    for (int i = 0; i < g_shared_count; i++) {
+        if (strcmp(g_shared[i].key, key) == 0) {
+            return &g_shared[i];
+        }
+    }
+    return NULL;
+}
+
+static SharedEntry* shared_insert(const char* key) {
+    if (g_shared_count >= g_shared_capacity) {
+        int new_cap = g_shared_capacity ? g_shared_capacity * 2 : 16;
+        SharedEntry* new_items = realloc(g_shared, new_cap * sizeof(SharedEntry));
+        if (!new_items) return NULL;
+        g_shared = new_items;
+        g_shared_capacity = new_cap;
+    }
+
+    SharedEntry* e = &g_shared[g_shared_count];
+    e->key = strdup(key);
+    if (!e->key) return NULL;
+    e->type = SHARED_NIL;
+    g_shared_count++;
+    return e;
+}
+
+static void shared_clear_value(SharedEntry* e) {
+    if (e->type == SHARED_STRING) {
+        free(e->v.s.data);
+    }
+    e->type = SHARED_NIL;
+}
+
+static void shared_push(lua_State* L, const SharedEntry* e) {
+    switch (e->type) {
+        case SHARED_BOOL:   lua_pushboolean(L, e->v.b); break;
+        case SHARED_INT:    lua_pushinteger(L, e->v.i); break;
+        case SHARED_FLOAT:  lua_pushnumber(L, e->v.n); break;
+        case SHARED_STRING: lua_pushlstring(L, e->v.s.data, e->v.s.len); break;
+        default:            lua_pushnil(L); break;
+    }
+}
+
+// Shared.get(key) -> value or nil
+static int lua_shared_get(lua_State* L) {
+    const char* key = luaL_checkstring(L, 1);
+
+    pthread_mutex_lock(&g_shared_mutex);
+    SharedEntry* e = shared_find(key);
+    if (e) {
+        shared_push(L, e);
+    } else {
+        lua_pushnil(L);
+    }
+    pthread_mutex_unlock(&g_shared_mutex);
+    return 1;
+}
+
+// Shared.set(key, value)
+static int lua_shared_set(lua_State* L) {
+    const char* key = luaL_checkstring(L, 1);
+    int type = lua_type(L, 2);
+    if (type != LUA_TNIL && type != LUA_TNONE && type != LUA_TBOOLEAN &&
+        type != LUA_TNUMBER && type != LUA_TSTRING) {
+        return luaL_argerror(L, 2, "only nil, boolean, number or string can be shared");
+    }
+
+    char* str_copy = NULL;
+    size_t str_len = 0;
+    if (type == LUA_TSTRING) {
+        const char* s = lua_tolstring(L, 2, &str_len);
+        str_copy = malloc(str_len + 1);
+        if (!str_copy) return luaL_error(L, "out of memory");
+        memcpy(str_copy, s, str_len + 1);
+    }
+
+    pthread_mutex_lock(&g_shared_mutex);
+    SharedEntry* e = shared_find(key);
+    if (!e) e = shared_insert(key);
+    if (!e) {
+        pthread_mutex_unlock(&g_shared_mutex);
+        free(str_copy);
+        return luaL_error(L, "out of memory");
+    }
+
+    shared_clear_value(e);
+    switch (type) {
+        case LUA_TBOOLEAN:
+            e->type = SHARED_BOOL;
+            e->v.b = lua_toboolean(L, 2);
+            break;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, 2)) {
+                e->type = SHARED_INT;
+                e->v.i = lua_tointeger(L, 2);
+            } else {
+                e->type = SHARED_FLOAT;
+                e->v.n = lua_tonumber(L, 2);
+            }
+            break;
+        case LUA_TSTRING:
+            e->type = SHARED_STRING;
+            e->v.s.data = str_copy;
+            e->v.s.len = str_len;
+            break;
+        default:
+            break;
+    }
+    pthread_mutex_unlock(&g_shared_mutex);
+    return 0;
+}
+
+// Shared.incr(key, [delta]) -> new integer value
+static int lua_shared_incr(lua_State* L) {
+    const char* key = luaL_checkstring(L, 1);
+    lua_Integer delta = luaL_optinteger(L, 2, 1);
+
+    pthread_mutex_lock(&g_shared_mutex);
+    SharedEntry* e = shared_find(key);
+    if (!e) e = shared_insert(key);
+    if (!e) {
+        pthread_mutex_unlock(&g_shared_mutex);
+        return luaL_error(L, "out of memory");
+    }
+
+    if (e->type != SHARED_INT) {
+        shared_clear_value(e);
+        e->type = SHARED_INT;
+        e->v.i = 0;
+    }
+    e->v.i += delta;
+    lua_Integer value = e->v.i;
+    pthread_mutex_unlock(&g_shared_mutex);
+
+    lua_pushinteger(L, value);
+    return 1;
+}
+
+static const luaL_Reg shared_funcs[] = {
+    {"get", lua_shared_get},
+    {"set", lua_shared_set},
+    {"incr", lua_shared_incr},
+    {NULL, NULL}
+};
+
+void register_shared_api(lua_State* L) {
+    luaL_newlib(L, shared_funcs);
+    lua_setglobal(L, "Shared");
+}
@@ -1,6 +1,8 @@
 #include <agent/lua_strace.h>
 #include <agent/strace.h>
 #include <agent/globals.h>
+#include <agent/lua_dispatch.h>
+#include <agent/output.h>
 
 #include <lua.h>
 #include <lualib.h>
@@ -8,13 +10,9 @@
 #include <string.h>
 #include <unistd.h>
 
-extern int g_output_client_fd;
-
 static void send_to_cli(const char* msg) {
-    if (g_output_client_fd >= 0 && msg) {
-        size_t len = strlen(msg);
-        write(g_output_client_fd, msg, len);
-        write(g_output_client_fd, "\n", 1);
+    if (msg) {
+        output_write_to(OUTPUT_CH_STRACE, msg, strlen(msg));
     }
 }
 
@@ -38,7 +36,7 @@ static int lua_syscall_trace(lua_State* L) {
 
             int installed = 0;
             for (int i = 0; i < count; i++) {
-                if (strace_install(defs[i]->name, NULL, LUA_NOREF, LUA_NOREF) >= 0) {
+                if (strace_install(defs[i]->name, NULL, LUA_NOREF, LUA_NOREF, 0) >= 0) {
                     installed++;
                 }
             }
@@ -56,6 +54,7 @@ static int lua_syscall_trace(lua_State* L) {
     const char* caller_lib = NULL;
     int onCall_ref = LUA_NOREF;
     int onReturn_ref = LUA_NOREF;
+    int lua_flags = 0;
     int last_string_arg = nargs;
 
     if (lua_istable(L, nargs)) {
@@ -67,6 +66,14 @@ static int lua_syscall_trace(lua_State* L) {
         }
         lua_pop(L, 1);
 
+        lua_getfield(L, nargs, "parallel");
+        if (lua_toboolean(L, -1)) lua_flags |= DISPATCH_PARALLEL;
+        lua_pop(L, 1);
+
+        lua_getfield(L, nargs, "async");
+        if (lua_toboolean(L, -1)) lua_flags |= DISPATCH_ASYNC;
+        lua_pop(L, 1);
+
         lua_getfield(L, nargs, "onCall");
         if (lua_isfunction(L, -1)) {
             onCall_ref = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -86,7 +93,7 @@ static int lua_syscall_trace(lua_State* L) {
     for (int i = 1; i <= last_string_arg; i++) {
         if (!lua_isstring(L, i)) continue;
         const char* name = lua_tostring(L, i);
-        if (strace_install(name, caller_lib, onCall_ref, onReturn_ref) >= 0) {
+        if (strace_install(name, caller_lib, onCall_ref, onReturn_ref, lua_flags) >= 0) {
             installed++;
         } else {
             char msg[128];
@@ -116,7 +123,7 @@ static int lua_syscall_trace_all(lua_State* L) {
             strcmp(defs[i]->name, "getuid") == 0) {
             continue;
         }
-        if (strace_install(defs[i]->name, NULL, LUA_NOREF, LUA_NOREF) >= 0) {
+        if (strace_install(defs[i]->name, NULL, LUA_NOREF, LUA_NOREF, 0) >= 0) {
             installed++;
         }
     }
@@ -151,10 +158,16 @@ static int lua_syscall_untrace(lua_State* L) {
 static int lua_syscall_stop(lua_State* L) {
     (void)L;
     strace_remove_all();
+    strace_set_binary(false);
     send_to_cli("Syscall tracing stopped");
     return 0;
 }
 
+static int lua_syscall_binary(lua_State* L) {
+    strace_set_binary(lua_toboolean(L, 1));
+    return 0;
+}
+
 static int lua_syscall_list(lua_State* L) {
     SyscallDef* defs[64];
     int count;
@@ -202,14 +215,16 @@ static int lua_syscall_active(lua_State* L) {
     lua_newtable(L);
     int count = 0;
 
-    for (int i = 0; i < g_strace_count; i++) {
-        if (!g_strace_hooks[i].active) continue;
+    int limit = strace_entry_limit();
+    for (int i = 0; i < limit; i++) {
+        StraceEntry* entry = strace_entry_get(i);
+        if (!entry || !entry->active) continue;
         lua_newtable(L);
-        lua_pushstring(L, g_strace_hooks[i].def->name);
+        lua_pushstring(L, entry->def->name);
         lua_setfield(L, -2, "name");
-        lua_pushstring(L, g_strace_hooks[i].def->category);
+        lua_pushstring(L, entry->def->category);
         lua_setfield(L, -2, "category");
-        lua_pushinteger(L, g_strace_hooks[i].hook.data.plt_got.patched_count);
+        lua_pushinteger(L, entry->hook.data.plt_got.patched_count);
         lua_setfield(L, -2, "hooks");
         lua_rawseti(L, -2, ++count);
     }
@@ -236,6 +251,9 @@ void register_strace_api(lua_State* L) {
     lua_pushcfunction(L, lua_syscall_stop);
     lua_setfield(L, -2, "stop");
 
+    lua_pushcfunction(L, lua_syscall_binary);
+    lua_setfield(L, -2, "binary");
+
     lua_pushcfunction(L, lua_syscall_list);
     lua_setfield(L, -2, "list");
 
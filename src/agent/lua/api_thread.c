@@ -1,10 +1,13 @@
 #include <agent/lua_thread.h>
+#include <agent/lua_dispatch.h>
 #include <agent/lua_engine.h>
 #include <agent/globals.h>
+#include <agent/symbolize.h>
 
-#include <dlfcn.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/syscall.h>
 
@@ -90,34 +93,56 @@ static void push_frame_table(lua_State* L, int index, uintptr_t raw_pc) {
     lua_pushinteger(L, (lua_Integer)pc);
     lua_settable(L, -3);
 
-    Dl_info info;
-    if (dladdr((void*)pc, &info)) {
-        if (info.dli_sname) {
+    SymbolizedPC sym;
+    if (symbolize_pc(pc, &sym)) {
+        if (sym.symbol) {
             lua_pushstring(L, "symbol");
-            lua_pushstring(L, info.dli_sname);
+            lua_pushstring(L, sym.symbol);
             lua_settable(L, -3);
         }
 
-        if (info.dli_fname) {
-            lua_pushstring(L, "module");
-            const char* filename = strrchr(info.dli_fname, '/');
-            lua_pushstring(L, filename ? filename + 1 : info.dli_fname);
-            lua_settable(L, -3);
+        lua_pushstring(L, "module");
+        lua_pushstring(L, sym.name);
+        lua_settable(L, -3);
 
-            lua_pushstring(L, "path");
-            lua_pushstring(L, info.dli_fname);
-            lua_settable(L, -3);
-        }
+        lua_pushstring(L, "path");
+        lua_pushstring(L, sym.path);
+        lua_settable(L, -3);
 
-        if (info.dli_fbase) {
-            lua_pushstring(L, "base");
-            lua_pushinteger(L, (lua_Integer)info.dli_fbase);
-            lua_settable(L, -3);
+        lua_pushstring(L, "base");
+        lua_pushinteger(L, (lua_Integer)sym.base);
+        lua_settable(L, -3);
 
-            lua_pushstring(L, "offset");
-            lua_pushinteger(L, (lua_Integer)(pc - (uintptr_t)info.dli_fbase));
-            lua_settable(L, -3);
-        }
+        lua_pushstring(L, "offset");
+        lua_pushinteger(L, (lua_Integer)(pc - sym.base));
+        lua_settable(L, -3);
+    }
+}
+
+// Raw frames carry the module id instead of names; Thread.modules() maps
+// ids to paths so the host can symbolize offsets in bulk.
+static void push_raw_frame_table(lua_State* L, int index, uintptr_t raw_pc) {
+    uintptr_t pc = strip_pac(raw_pc);
+
+    lua_newtable(L);
+
+    lua_pushstring(L, "index");
+    lua_pushinteger(L, (lua_Integer)(index + 1));
+    lua_settable(L, -3);
+
+    lua_pushstring(L, "pc");
+    lua_pushinteger(L, (lua_Integer)pc);
+    lua_settable(L, -3);
+
+    SymbolizedPC sym;
+    if (symbolize_pc_module(pc, &sym)) {
+        lua_pushstring(L, "module");
+        lua_pushinteger(L, sym.module_id);
+        lua_settable(L, -3);
+
+        lua_pushstring(L, "offset");
+        lua_pushinteger(L, (lua_Integer)(pc - sym.base));
+        lua_settable(L, -3);
     }
 }
 
@@ -134,7 +159,9 @@ static int lua_backtrace_tostring(lua_State* L) {
         lua_pop(L, 1);
 
         lua_getfield(L, -1, "module");
-        const char* module = lua_tostring(L, -1);
+        bool raw = lua_isinteger(L, -1);
+        lua_Integer module_id = raw ? lua_tointeger(L, -1) : -1;
+        const char* module = raw ? NULL : lua_tostring(L, -1);
         lua_pop(L, 1);
 
         lua_getfield(L, -1, "symbol");
@@ -151,7 +178,9 @@ static int lua_backtrace_tostring(lua_State* L) {
 
         char line[256];
         const char* mod = module ? module : "???";
-        if (symbol) {
+        if (raw) {
+            snprintf(line, sizeof(line), "  #%02d  [%ld]+0x%lx", index, (long)module_id, (unsigned long)offset);
+        } else if (symbol) {
             snprintf(line, sizeof(line), "  #%02d  %s  %s", index, mod, symbol);
         } else if (module) {
             snprintf(line, sizeof(line), "  #%02d  %s  +0x%lx", index, mod, (unsigned long)offset);
@@ -169,8 +198,7 @@ static int lua_backtrace_tostring(lua_State* L) {
     return 1;
 }
 
-static int lua_thread_backtrace(lua_State* L) {
-    uintptr_t frames[MAX_FRAMES];
+static size_t collect_frames(lua_State* L, uintptr_t* frames) {
     size_t frame_count = 0;
 
     uintptr_t start_fp;
@@ -204,9 +232,20 @@ static int lua_thread_backtrace(lua_State* L) {
         fp = next_fp;
     }
 
+    return frame_count;
+}
+
+static int push_backtrace(lua_State* L, bool raw) {
+    uintptr_t frames[MAX_FRAMES];
+    size_t frame_count = collect_frames(L, frames);
+
     lua_newtable(L);
     for (size_t i = 0; i < frame_count; i++) {
-        push_frame_table(L, i, frames[i]);
+        if (raw) {
+            push_raw_frame_table(L, i, frames[i]);
+        } else {
+            push_frame_table(L, i, frames[i]);
+        }
         lua_rawseti(L, -2, i + 1);
     }
 
@@ -218,20 +257,110 @@ static int lua_thread_backtrace(lua_State* L) {
     return 1;
 }
 
+static int lua_thread_backtrace(lua_State* L) {
+    return push_backtrace(L, false);
+}
+
+static int lua_thread_raw_backtrace(lua_State* L) {
+    return push_backtrace(L, true);
+}
+
+static int lua_thread_modules(lua_State* L) {
+    lua_newtable(L);
+
+    int count = symbolize_module_count();
+    for (int id = 0; id < count; id++) {
+        SymModule m;
+        if (!symbolize_module(id, &m)) continue;
+
+        lua_newtable(L);
+        lua_pushstring(L, m.name);
+        lua_setfield(L, -2, "name");
+        lua_pushstring(L, m.path);
+        lua_setfield(L, -2, "path");
+        lua_pushinteger(L, (lua_Integer)m.base);
+        lua_setfield(L, -2, "base");
+        lua_rawseti(L, -2, id);
+    }
+    return 1;
+}
+
 static int lua_thread_id(lua_State* L) {
     lua_pushinteger(L, (lua_Integer)get_thread_id());
     return 1;
 }
 
+// Thread.stress(threads, ms): load generator for hook benchmarks. Each
+// thread calls libc clock_gettime back to back (so a hook on it fires
+// every time) until `ms` have passed; returns the total number of calls.
+#define STRESS_MAX_THREADS  64
+
+typedef struct {
+    uint64_t deadline_ns;
+    uint64_t calls;
+} StressWorker;
+
+static void* stress_worker(void* arg) {
+    StressWorker* w = (StressWorker*)arg;
+    struct timespec ts;
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        w->calls++;
+    } while ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec < w->deadline_ns);
+    return NULL;
+}
+
+static int lua_thread_stress(lua_State* L) {
+    lua_Integer threads = luaL_checkinteger(L, 1);
+    lua_Integer ms = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, threads >= 1 && threads <= STRESS_MAX_THREADS, 1, "1..64 threads");
+    luaL_argcheck(L, ms >= 0, 2, "negative duration");
+
+    StressWorker workers[STRESS_MAX_THREADS];
+    pthread_t tids[STRESS_MAX_THREADS];
+    bool started[STRESS_MAX_THREADS];
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t deadline = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec +
+                        (uint64_t)ms * 1000000ULL;
+
+    // Serialized hooks on the workers need the main state meanwhile
+    int token = lua_dispatch_suspend();
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (StressWorker){ deadline, 0 };
+        started[i] = pthread_create(&tids[i], NULL, stress_worker, &workers[i]) == 0;
+    }
+    uint64_t calls = 0;
+    for (int i = 0; i < threads; i++) {
+        if (!started[i]) continue;
+        pthread_join(tids[i], NULL);
+        calls += workers[i].calls;
+    }
+    lua_dispatch_resume(token);
+
+    lua_pushinteger(L, (lua_Integer)calls);
+    return 1;
+}
+
 void lua_register_thread(lua_State* L) {
     lua_newtable(L);
 
     lua_pushcfunction(L, lua_thread_backtrace);
     lua_setfield(L, -2, "backtrace");
 
+    lua_pushcfunction(L, lua_thread_raw_backtrace);
+    lua_setfield(L, -2, "rawBacktrace");
+
+    lua_pushcfunction(L, lua_thread_modules);
+    lua_setfield(L, -2, "modules");
+
     lua_pushcfunction(L, lua_thread_id);
     lua_setfield(L, -2, "id");
 
+    lua_pushcfunction(L, lua_thread_stress);
+    lua_setfield(L, -2, "stress");
+
     lua_setglobal(L, "Thread");
 
     LOGI("Thread API registered");
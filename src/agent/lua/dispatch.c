@@ -0,0 +1,635 @@
+#include <agent/lua_dispatch.h>
+#include <agent/lua_engine.h>
+#include <agent/lua_memory.h>
+#include <agent/lua_file.h>
+#include <agent/lua_os.h>
+#include <agent/lua_shared.h>
+#include <agent/globals.h>
+
+#include <lualib.h>
+#include <lauxlib.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Main script state is single-threaded. Recursive so that a hook firing
+// on a thread that already runs script code (exec, nested Java hooks,
+// the executor) does not deadlock.
+static pthread_mutex_t g_main_mutex;
+static pthread_once_t g_main_mutex_once = PTHREAD_ONCE_INIT;
+static int g_main_waiters = 0;
+static uint32_t g_main_handoffs = 0;    // contended acquisitions
+static __thread int t_main_depth = 0;
+
+// Exec scripts hand the lock to waiting hooks every slice of VM time
+#define EXEC_SLICE_NS       (5 * 1000000ULL)
+#define EXEC_HOOK_COUNT     1000    // VM instructions between clock checks
+
+static __thread bool t_exec_slicing = false;
+static __thread uint64_t t_slice_start = 0;
+
+// Generation per callback ref, hashed. Bumped when a hook releases its
+// ref, which makes queued events and cached copies of that callback stale
+// and leaves every other hook's alone.
+#define REF_GEN_SLOTS       4096
+
+static uint32_t g_ref_generation[REF_GEN_SLOTS];
+static int g_worker_states = 0;
+
+typedef struct {
+    uint64_t sync_calls;
+    uint64_t parallel_calls;
+    uint64_t lock_waits;
+    uint64_t lock_wait_ns;
+    uint64_t lock_wait_max_ns;
+    uint64_t async_posted;
+    uint64_t async_dropped;
+    uint64_t async_wait_ns;
+    uint64_t async_wait_max_ns;
+    int async_depth;
+    int async_depth_max;
+} SourceCounters;
+
+static SourceCounters g_counters[DISPATCH_SOURCE_COUNT];
+
+static const char* s_source_names[DISPATCH_SOURCE_COUNT] = {
+    "native", "java", "strace", "exec"
+};
+
+// Intrusive MPSC queue (Vyukov): producers swap g_queue_head, the executor
+// is the only consumer and owns g_queue_tail.
+static DispatchEvent g_queue_stub;
+static DispatchEvent* g_queue_head = &g_queue_stub;
+static DispatchEvent* g_queue_tail = &g_queue_stub;
+static int g_queue_depth = 0;
+static sem_t g_queue_sem;
+static pthread_once_t g_executor_once = PTHREAD_ONCE_INIT;
+static bool g_executor_running = false;
+
+static pthread_key_t g_worker_key;
+static pthread_once_t g_worker_key_once = PTHREAD_ONCE_INIT;
+
+static __thread lua_State* t_worker = NULL;
+
+// Registry key of the per-state callback cache: main ref -> function, or
+// false when the callback cannot be moved out of the main state, and
+// -ref -> the ref generation the entry was loaded at.
+static const char k_cache_key = 0;
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} ChunkBuf;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void update_max(uint64_t* slot, uint64_t value) {
+    uint64_t cur = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    while (value > cur &&
+           !__atomic_compare_exchange_n(slot, &cur, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void init_main_mutex(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&g_main_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static uint32_t ref_generation(int ref) {
+    return __atomic_load_n(&g_ref_generation[(unsigned)ref % REF_GEN_SLOTS], __ATOMIC_ACQUIRE);
+}
+
+static void main_lock(SourceCounters* c) {
+    pthread_once(&g_main_mutex_once, init_main_mutex);
+
+    if (pthread_mutex_trylock(&g_main_mutex) == 0) {
+        t_main_depth++;
+        return;
+    }
+
+    __atomic_add_fetch(&g_main_waiters, 1, __ATOMIC_RELAXED);
+    uint64_t start = now_ns();
+    pthread_mutex_lock(&g_main_mutex);
+    uint64_t waited = now_ns() - start;
+    __atomic_sub_fetch(&g_main_waiters, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_main_handoffs, 1, __ATOMIC_RELEASE);
+    t_main_depth++;
+
+    if (c) {
+        __atomic_add_fetch(&c->lock_waits, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&c->lock_wait_ns, waited, __ATOMIC_RELAXED);
+        update_max(&c->lock_wait_max_ns, waited);
+    }
+}
+
+static void main_unlock(void) {
+    t_main_depth--;
+    pthread_mutex_unlock(&g_main_mutex);
+}
+
+// Let the threads queued on the lock run, then take it back. Only the
+// outermost holder may: a nested one is inside a callback that expects
+// the state to stay as it left it.
+static void main_yield(void) {
+    int waiters = __atomic_load_n(&g_main_waiters, __ATOMIC_RELAXED);
+    if (waiters == 0 || t_main_depth != 1) {
+        return;
+    }
+
+    uint32_t target = __atomic_load_n(&g_main_handoffs, __ATOMIC_ACQUIRE) + (uint32_t)waiters;
+    uint64_t deadline = now_ns() + EXEC_SLICE_NS;
+    main_unlock();
+    while ((int32_t)(__atomic_load_n(&g_main_handoffs, __ATOMIC_ACQUIRE) - target) < 0 &&
+           now_ns() < deadline) {
+        sched_yield();
+    }
+    main_lock(NULL);
+}
+
+// ============================================================
+// Per-thread worker states (DISPATCH_PARALLEL)
+// ============================================================
+
+static void worker_destroy(void* arg) {
+    lua_State* W = (lua_State*)arg;
+    if (W) {
+        lua_close(W);
+        __atomic_sub_fetch(&g_worker_states, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void worker_key_init(void) {
+    pthread_key_create(&g_worker_key, worker_destroy);
+}
+
+static lua_State* worker_get(void) {
+    if (t_worker) {
+        return t_worker;
+    }
+
+    pthread_once(&g_worker_key_once, worker_key_init);
+
+    lua_State* W = luaL_newstate();
+    if (!W) {
+        LOGE("Failed to create worker Lua state");
+        return NULL;
+    }
+
+    luaL_openlibs(W);
+    register_renef_api(W);
+    register_memory_search_api(W);
+    register_file_api(W);
+    register_os_api(W);
+    register_shared_api(W);
+
+    // No hook()/hookMany() here: they are registered on the main state
+    // only (see lua_engine_create)
+
+    lua_newtable(W);
+    lua_rawsetp(W, LUA_REGISTRYINDEX, &k_cache_key);
+
+    t_worker = W;
+    pthread_setspecific(g_worker_key, W);
+
+    int n = __atomic_add_fetch(&g_worker_states, 1, __ATOMIC_RELAXED);
+    verbose_log("[dispatch] worker state %p created (%d live)", W, n);
+    return W;
+}
+
+static int chunk_writer(lua_State* L, const void* p, size_t sz, void* ud) {
+    (void)L;
+    ChunkBuf* buf = (ChunkBuf*)ud;
+    if (buf->len + sz > buf->cap) {
+        size_t new_cap = buf->cap ? buf->cap * 2 : 1024;
+        while (new_cap < buf->len + sz) new_cap *= 2;
+        char* new_data = realloc(buf->data, new_cap);
+        if (!new_data) return 1;
+        buf->data = new_data;
+        buf->cap = new_cap;
+    }
+    memcpy(buf->data + buf->len, p, sz);
+    buf->len += sz;
+    return 0;
+}
+
+// Returns 1 and fills `buf` with bytecode if the callback only depends on
+// _ENV, 0 if it has to run in the main state, -1 if the ref is not a function.
+static int dump_main_callback(int ref, ChunkBuf* buf) {
+    int result = -1;
+
+    main_lock(NULL);
+    lua_State* L = lua_engine_get_state(g_lua_engine);
+    if (L) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+        if (lua_isfunction(L, -1)) {
+            result = lua_iscfunction(L, -1) ? 0 : 1;
+
+            for (int i = 1; result == 1; i++) {
+                const char* name = lua_getupvalue(L, -1, i);
+                if (!name) break;
+                lua_pop(L, 1);
+                if (strcmp(name, "_ENV") != 0) {
+                    LOGI("Callback %d captures '%s', running it serialized", ref, name);
+                    result = 0;
+                }
+            }
+
+            if (result == 1 && lua_dump(L, chunk_writer, buf, 0) != 0) {
+                result = 0;
+            }
+        }
+        lua_pop(L, 1);
+    }
+    main_unlock();
+
+    return result;
+}
+
+// Push the callback onto the worker state. Returns 1 if pushed, 0 if the
+// callback must run in the main state, -1 if it does not exist.
+static int worker_push(lua_State* W, int ref) {
+    uint32_t gen = ref_generation(ref);
+
+    lua_rawgetp(W, LUA_REGISTRYINDEX, &k_cache_key);
+    lua_rawgeti(W, -1, -ref);
+    bool fresh = lua_isinteger(W, -1) && (uint32_t)lua_tointeger(W, -1) == gen;
+    lua_pop(W, 1);
+
+    if (fresh) {
+        lua_rawgeti(W, -1, ref);
+        if (lua_isfunction(W, -1)) {
+            lua_remove(W, -2);
+            return 1;
+        }
+        if (lua_isboolean(W, -1)) {
+            lua_pop(W, 2);
+            return 0;
+        }
+        lua_pop(W, 1);
+    }
+
+    // Stamped with the generation read before the dump: a release racing
+    // with it leaves the entry stale rather than cached for good
+    lua_pushinteger(W, (lua_Integer)gen);
+    lua_rawseti(W, -2, -ref);
+
+    ChunkBuf buf = {0};
+    int state = dump_main_callback(ref, &buf);
+    if (state < 0) {
+        free(buf.data);
+        lua_pushnil(W);
+        lua_rawseti(W, -2, -ref);
+        lua_pop(W, 1);
+        return -1;
+    }
+
+    if (state == 1) {
+        if (luaL_loadbuffer(W, buf.data, buf.len, "=hook") == LUA_OK) {
+            free(buf.data);
+            lua_pushvalue(W, -1);
+            lua_rawseti(W, -3, ref);
+            lua_remove(W, -2);
+            return 1;
+        }
+        LOGE("Failed to load callback %d into worker: %s", ref, lua_tostring(W, -1));
+        lua_pop(W, 1);
+    }
+    free(buf.data);
+
+    lua_pushboolean(W, 0);
+    lua_rawseti(W, -2, ref);
+    lua_pop(W, 1);
+    return 0;
+}
+
+// ============================================================
+// Synchronous dispatch
+// ============================================================
+
+lua_State* lua_dispatch_acquire(DispatchSource source, int ref, int flags) {
+    if (ref == LUA_NOREF || !g_lua_engine) {
+        return NULL;
+    }
+
+    SourceCounters* c = &g_counters[source];
+
+    if (flags & DISPATCH_PARALLEL) {
+        lua_State* W = worker_get();
+        if (W) {
+            int pushed = worker_push(W, ref);
+            if (pushed > 0) {
+                __atomic_add_fetch(&c->parallel_calls, 1, __ATOMIC_RELAXED);
+                return W;
+            }
+            if (pushed < 0) {
+                return NULL;
+            }
+        }
+    }
+
+    lua_State* L = lua_dispatch_lock(source);
+    if (!L) {
+        return NULL;
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    return L;
+}
+
+void lua_dispatch_release(lua_State* L) {
+    if (L && L != t_worker) {
+        main_unlock();
+    }
+}
+
+lua_State* lua_dispatch_lock(DispatchSource source) {
+    SourceCounters* c = &g_counters[source];
+
+    main_lock(c);
+    lua_State* L = lua_engine_get_state(g_lua_engine);
+    if (!L) {
+        main_unlock();
+        return NULL;
+    }
+    __atomic_add_fetch(&c->sync_calls, 1, __ATOMIC_RELAXED);
+    return L;
+}
+
+void lua_dispatch_unlock(void) {
+    main_unlock();
+}
+
+int lua_dispatch_suspend(void) {
+    if (t_main_depth != 1) {
+        return 0;
+    }
+    main_unlock();
+    return 1;
+}
+
+void lua_dispatch_resume(int token) {
+    if (token) {
+        main_lock(NULL);
+    }
+}
+
+static void exec_slice_hook(lua_State* L, lua_Debug* ar) {
+    (void)L;
+    (void)ar;
+    // Hook callbacks run on this state while the script is suspended
+    if (!t_exec_slicing) return;
+
+    if (now_ns() - t_slice_start >= EXEC_SLICE_NS) {
+        main_yield();
+        t_slice_start = now_ns();
+    }
+}
+
+bool lua_dispatch_exec(const char* script) {
+    lua_State* L = lua_dispatch_lock(DISPATCH_EXEC);
+    if (!L) {
+        return false;
+    }
+
+    // A debug hook the script set for itself is left alone
+    bool slicing = lua_gethook(L) == NULL;
+    if (slicing) {
+        t_exec_slicing = true;
+        t_slice_start = now_ns();
+        lua_sethook(L, exec_slice_hook, LUA_MASKCOUNT, EXEC_HOOK_COUNT);
+    }
+
+    bool ok = lua_engine_load_script(g_lua_engine, script);
+
+    if (slicing) {
+        if (lua_gethook(L) == exec_slice_hook) {
+            lua_sethook(L, NULL, 0, 0);
+        }
+        t_exec_slicing = false;
+    }
+    lua_dispatch_unlock();
+    return ok;
+}
+
+// ============================================================
+// Asynchronous dispatch
+// ============================================================
+
+static DispatchEvent* queue_pop(void) {
+    DispatchEvent* tail = g_queue_tail;
+    DispatchEvent* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &g_queue_stub) {
+        if (!next) return NULL;
+        g_queue_tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next) {
+        g_queue_tail = next;
+        return tail;
+    }
+
+    // A producer swapped the head but has not linked its node yet
+    if (tail != __atomic_load_n(&g_queue_head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    g_queue_stub.next = NULL;
+    DispatchEvent* prev = __atomic_exchange_n(&g_queue_head, &g_queue_stub, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, &g_queue_stub, __ATOMIC_RELEASE);
+
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        g_queue_tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static void push_event_args(lua_State* L, const DispatchEvent* ev) {
+    lua_newtable(L);
+    for (int i = 0; i < ev->nargs; i++) {
+        lua_pushinteger(L, (lua_Integer)ev->args[i]);
+        lua_rawseti(L, -2, i + ev->arg_base);
+    }
+}
+
+static void run_event(DispatchEvent* ev) {
+    SourceCounters* c = &g_counters[ev->source];
+
+    uint64_t waited = now_ns() - ev->enqueue_ns;
+    __atomic_add_fetch(&c->async_wait_ns, waited, __ATOMIC_RELAXED);
+    update_max(&c->async_wait_max_ns, waited);
+
+    // Checked under the lock, which refs are released under
+    main_lock(NULL);
+    lua_State* L = lua_engine_get_state(g_lua_engine);
+    if (L && ev->generation == ref_generation(ev->ref)) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ev->ref);
+
+        switch (ev->kind) {
+            case DISPATCH_EV_RETVAL:
+                lua_pushinteger(L, (lua_Integer)ev->retval);
+                break;
+            case DISPATCH_EV_INFO:
+                lua_newtable(L);
+                if (ev->name) {
+                    lua_pushstring(L, ev->name);
+                    lua_setfield(L, -2, "name");
+                }
+                lua_pushinteger(L, ev->tid);
+                lua_setfield(L, -2, "tid");
+                if (ev->text_key && ev->text[0]) {
+                    lua_pushstring(L, ev->text);
+                    lua_setfield(L, -2, ev->text_key);
+                }
+                if (ev->nargs > 0) {
+                    push_event_args(L, ev);
+                    lua_setfield(L, -2, "args");
+                }
+                if (ev->has_retval) {
+                    lua_pushinteger(L, (lua_Integer)ev->retval);
+                    lua_setfield(L, -2, "retval");
+                }
+                break;
+            case DISPATCH_EV_ARGS:
+            default:
+                push_event_args(L, ev);
+                break;
+        }
+
+        if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+            LOGE("%s async callback failed: %s",
+                 s_source_names[ev->source], lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+    main_unlock();
+}
+
+static void* executor_thread(void* arg) {
+    (void)arg;
+    LOGI("[dispatch] executor started");
+
+    while (1) {
+        sem_wait(&g_queue_sem);
+
+        while (__atomic_load_n(&g_queue_depth, __ATOMIC_ACQUIRE) > 0) {
+            DispatchEvent* ev = queue_pop();
+            if (!ev) {
+                sched_yield();
+                continue;
+            }
+            __atomic_sub_fetch(&g_queue_depth, 1, __ATOMIC_RELAXED);
+            __atomic_sub_fetch(&g_counters[ev->source].async_depth, 1, __ATOMIC_RELAXED);
+
+            run_event(ev);
+            free(ev);
+        }
+    }
+    return NULL;
+}
+
+static void start_executor(void) {
+    sem_init(&g_queue_sem, 0, 0);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, executor_thread, NULL) != 0) {
+        LOGE("[dispatch] failed to start executor thread");
+        return;
+    }
+    pthread_detach(tid);
+    g_executor_running = true;
+}
+
+DispatchEvent* lua_dispatch_event_new(DispatchSource source, DispatchEventKind kind,
+                                      int ref, const char* text) {
+    size_t text_len = text ? strlen(text) : 0;
+    DispatchEvent* ev = malloc(sizeof(DispatchEvent) + text_len + 1);
+    if (!ev) return NULL;
+
+    memset(ev, 0, sizeof(DispatchEvent));
+    ev->source = source;
+    ev->kind = kind;
+    ev->ref = ref;
+    ev->generation = ref_generation(ref);
+    if (text_len) memcpy(ev->text, text, text_len);
+    ev->text[text_len] = '\0';
+    return ev;
+}
+
+bool lua_dispatch_post(DispatchEvent* ev) {
+    if (!ev) return false;
+
+    pthread_once(&g_executor_once, start_executor);
+
+    SourceCounters* c = &g_counters[ev->source];
+
+    if (!g_executor_running ||
+        __atomic_load_n(&g_queue_depth, __ATOMIC_RELAXED) >= DISPATCH_QUEUE_MAX) {
+        __atomic_add_fetch(&c->async_dropped, 1, __ATOMIC_RELAXED);
+        free(ev);
+        return false;
+    }
+
+    ev->enqueue_ns = now_ns();
+    ev->next = NULL;
+
+    __atomic_add_fetch(&g_queue_depth, 1, __ATOMIC_RELEASE);
+    int depth = __atomic_add_fetch(&c->async_depth, 1, __ATOMIC_RELAXED);
+    int max_depth = __atomic_load_n(&c->async_depth_max, __ATOMIC_RELAXED);
+    while (depth > max_depth &&
+           !__atomic_compare_exchange_n(&c->async_depth_max, &max_depth, depth, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    __atomic_add_fetch(&c->async_posted, 1, __ATOMIC_RELAXED);
+
+    DispatchEvent* prev = __atomic_exchange_n(&g_queue_head, ev, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, ev, __ATOMIC_RELEASE);
+
+    sem_post(&g_queue_sem);
+    return true;
+}
+
+// ============================================================
+
+void lua_dispatch_invalidate(int ref) {
+    if (ref == LUA_NOREF || ref == LUA_REFNIL) return;
+    __atomic_add_fetch(&g_ref_generation[(unsigned)ref % REF_GEN_SLOTS], 1, __ATOMIC_RELEASE);
+}
+
+void lua_dispatch_get_stats(DispatchSource source, DispatchStats* out) {
+    if (!out || source < 0 || source >= DISPATCH_SOURCE_COUNT) return;
+
+    SourceCounters* c = &g_counters[source];
+    out->sync_calls = __atomic_load_n(&c->sync_calls, __ATOMIC_RELAXED);
+    out->parallel_calls = __atomic_load_n(&c->parallel_calls, __ATOMIC_RELAXED);
+    out->lock_waits = __atomic_load_n(&c->lock_waits, __ATOMIC_RELAXED);
+    out->lock_wait_ns = __atomic_load_n(&c->lock_wait_ns, __ATOMIC_RELAXED);
+    out->lock_wait_max_ns = __atomic_load_n(&c->lock_wait_max_ns, __ATOMIC_RELAXED);
+    out->async_posted = __atomic_load_n(&c->async_posted, __ATOMIC_RELAXED);
+    out->async_dropped = __atomic_load_n(&c->async_dropped, __ATOMIC_RELAXED);
+    out->async_wait_ns = __atomic_load_n(&c->async_wait_ns, __ATOMIC_RELAXED);
+    out->async_wait_max_ns = __atomic_load_n(&c->async_wait_max_ns, __ATOMIC_RELAXED);
+    out->async_depth = __atomic_load_n(&c->async_depth, __ATOMIC_RELAXED);
+    out->async_depth_max = __atomic_load_n(&c->async_depth_max, __ATOMIC_RELAXED);
+    out->worker_states = __atomic_load_n(&g_worker_states, __ATOMIC_RELAXED);
+}
+
+const char* lua_dispatch_source_name(DispatchSource source) {
+    if (source < 0 || source >= DISPATCH_SOURCE_COUNT) return "?";
+    return s_source_names[source];
+}
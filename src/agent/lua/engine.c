@@ -13,23 +13,16 @@
 #include <agent/lua_java.h>
 #include <agent/lua_strace.h>
 #include <agent/lua_kcov.h>
+#include <agent/lua_shared.h>
+#include <agent/output.h>
 #include <agent/proc.h>
 
 #define TAG "RENEF_LUA"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
 
-extern int g_output_client_fd;
-
-
 static void send_to_cli(const char* msg) {
-    LOGI("[CLI_SEND] g_output_client_fd=%d, msg=%s", g_output_client_fd, msg ? msg : "NULL");
-    if (g_output_client_fd >= 0 && msg) {
-        size_t len = strlen(msg);
-        ssize_t written = write(g_output_client_fd, msg, len);
-        write(g_output_client_fd, "\n", 1);
-        LOGI("[CLI_SEND] wrote %zd bytes to fd %d", written, g_output_client_fd);
-    } else {
-        LOGI("[CLI_SEND] SKIPPED - fd=%d", g_output_client_fd);
+    if (msg) {
+        output_write(msg, strlen(msg));
     }
 }
 
@@ -221,8 +214,6 @@ void register_renef_api(lua_State* L) {
     lua_setfield(L, -2, "boolean");
     lua_setglobal(L, "JNI");
 
-    LOGI("Registering memory API...");
-    register_memory_api(L);
     LOGI("Registering thread API...");
     lua_register_thread(L);
     LOGI("Registering JNI API...");
@@ -249,11 +240,16 @@ LuaEngine* lua_engine_create(void) {
     luaL_openlibs(engine->L);
 
     register_renef_api(engine->L);
+    // hook()/hookMany() take callback refs in the calling state's registry,
+    // which the dispatcher reads from this one: main state only.
+    LOGI("Registering hook API...");
+    register_memory_api(engine->L);
     register_memory_search_api(engine->L);
     register_file_api(engine->L);
     register_os_api(engine->L);
     register_strace_api(engine->L);
     register_kcov_api(engine->L);
+    register_shared_api(engine->L);
 
     engine->initialized = true;
     LOGI("Lua engine initialized");
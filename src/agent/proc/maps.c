@@ -0,0 +1,399 @@
+#include <agent/maps.h>
+#include <agent/globals.h>
+
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// How often maps_acquire asks the loader whether objects came or went.
+#define MAPS_RECHECK_NS     (50 * 1000 * 1000ULL)
+
+static pthread_mutex_t g_maps_lock = PTHREAD_MUTEX_INITIALIZER;
+static MapsIndex* g_current = NULL;
+static uint64_t g_generation = 1;
+
+// Loader state g_current was built against
+static uint64_t g_objects = 0;
+static uint64_t g_objects_hash = 0;
+static uint64_t g_checked_ns = 0;
+static uint64_t g_built_generation = 0;     // g_current's, readable unlocked
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int objects_callback(struct dl_phdr_info* info, size_t size, void* data) {
+    (void)size;
+    uint64_t* sig = (uint64_t*)data;
+    sig[0]++;
+    sig[1] = sig[1] * 31 + info->dlpi_addr;
+    return 0;
+}
+
+// procfs reports a size of 0, so read until EOF into a growing buffer.
+static char* read_maps(size_t* out_len) {
+    int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("Failed to open /proc/self/maps");
+        return NULL;
+    }
+
+    size_t cap = 64 * 1024, len = 0;
+    char* buf = (char*)malloc(cap + 1);
+    while (buf) {
+        if (len == cap) {
+            cap *= 2;
+            char* grown = (char*)realloc(buf, cap + 1);
+            if (!grown) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = grown;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0) {
+            free(buf);
+            buf = NULL;
+            break;
+        }
+        if (n == 0) break;
+        len += n;
+    }
+    close(fd);
+
+    if (buf) {
+        buf[len] = '\0';
+        *out_len = len;
+    }
+    return buf;
+}
+
+static const char* parse_hex(const char* p, uint64_t* out) {
+    uint64_t v = 0;
+    for (;; p++) {
+        char c = *p;
+        if (c >= '0' && c <= '9') v = (v << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f') v = (v << 4) | (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v = (v << 4) | (c - 'A' + 10);
+        else break;
+    }
+    *out = v;
+    return p;
+}
+
+static uint32_t hash_path(const char* s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h = (h ^ (uint8_t)*s++) * 16777619u;
+    }
+    return h;
+}
+
+// Paths point into the maps text itself (newlines become NULs), so
+// interning only has to dedup.
+static uint32_t intern_path(MapsIndex* idx, uint32_t* table, uint32_t mask, const char* path) {
+    uint32_t slot = hash_path(path) & mask;
+    while (table[slot]) {
+        uint32_t id = table[slot];
+        if (strcmp(idx->paths[id], path) == 0) return id;
+        slot = (slot + 1) & mask;
+    }
+    uint32_t id = idx->npaths++;
+    idx->paths[id] = path;
+    table[slot] = id;
+    return id;
+}
+
+static void index_free(MapsIndex* idx) {
+    if (!idx) return;
+    free(idx->regions);
+    free(idx->paths);
+    free(idx->strings);
+    free(idx);
+}
+
+static MapsIndex* index_build(void) {
+    size_t len = 0;
+    char* text = read_maps(&len);
+    if (!text) return NULL;
+
+    int lines = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') lines++;
+    }
+    lines++;
+
+    uint32_t table_size = 64;
+    while (table_size < (uint32_t)lines * 2) table_size <<= 1;
+
+    MapsIndex* idx = (MapsIndex*)calloc(1, sizeof(MapsIndex));
+    uint32_t* table = (uint32_t*)calloc(table_size, sizeof(uint32_t));
+    if (idx) {
+        idx->strings = text;
+        idx->regions = (MapRegion*)malloc(lines * sizeof(MapRegion));
+        idx->paths = (const char**)malloc((lines + 1) * sizeof(char*));
+    }
+    if (!idx || !table || !idx->regions || !idx->paths) {
+        if (idx) index_free(idx);
+        else free(text);
+        free(table);
+        return NULL;
+    }
+    idx->paths[0] = "";
+    idx->npaths = 1;
+
+    char* line = text;
+    while (*line) {
+        char* eol = strchr(line, '\n');
+        if (eol) *eol = '\0';
+
+        // start-end perms offset major:minor inode   path
+        MapRegion r;
+        uint64_t start, end, major, minor;
+        const char* p = parse_hex(line, &start);
+        if (*p == '-') {
+            p = parse_hex(p + 1, &end);
+            while (*p == ' ') p++;
+
+            r.perms = 0;
+            if (p[0] == 'r') r.perms |= MAPS_PERM_R;
+            if (p[0] && p[1] == 'w') r.perms |= MAPS_PERM_W;
+            if (p[0] && p[1] && p[2] == 'x') r.perms |= MAPS_PERM_X;
+            if (p[0] && p[1] && p[2] && p[3] == 'p') r.perms |= MAPS_PERM_P;
+            while (*p && *p != ' ') p++;
+            while (*p == ' ') p++;
+
+            p = parse_hex(p, &r.offset);
+            while (*p == ' ') p++;
+            p = parse_hex(p, &major);
+            if (*p == ':') p = parse_hex(p + 1, &minor);
+            else minor = 0;
+            while (*p == ' ') p++;
+
+            r.inode = strtoull(p, (char**)&p, 10);
+            while (*p == ' ') p++;
+
+            r.start = (uintptr_t)start;
+            r.end = (uintptr_t)end;
+            r.dev_major = (uint32_t)major;
+            r.dev_minor = (uint32_t)minor;
+            r.path_id = *p ? intern_path(idx, table, table_size - 1, p) : 0;
+            if (r.end > r.start) {
+                idx->regions[idx->count++] = r;
+            }
+        }
+
+        if (!eol) break;
+        line = eol + 1;
+    }
+
+    free(table);
+    return idx;
+}
+
+// The loader is asked before g_maps_lock is taken, never under it:
+// dl_iterate_phdr takes the linker's lock, and load callbacks run with
+// that lock held and may come here.
+static const MapsIndex* acquire(bool fresh) {
+    uint64_t generation = __atomic_load_n(&g_generation, __ATOMIC_ACQUIRE);
+    uint64_t now = now_ns();
+    bool check = fresh || __atomic_load_n(&g_built_generation, __ATOMIC_ACQUIRE) != generation ||
+                 now - __atomic_load_n(&g_checked_ns, __ATOMIC_RELAXED) >= MAPS_RECHECK_NS;
+    uint64_t sig[2] = {0, 0};
+    if (check) {
+        dl_iterate_phdr(objects_callback, sig);
+    }
+
+    pthread_mutex_lock(&g_maps_lock);
+
+    generation = __atomic_load_n(&g_generation, __ATOMIC_ACQUIRE);
+    bool stale = fresh || !g_current || g_current->generation != generation;
+    if (check) {
+        __atomic_store_n(&g_checked_ns, now, __ATOMIC_RELAXED);
+        // A signature older than the current index only costs a rebuild
+        if (sig[0] != g_objects || sig[1] != g_objects_hash) {
+            // Moves the generation too, so caches keyed on it see dlopen/dlclose
+            generation = __atomic_add_fetch(&g_generation, 1, __ATOMIC_ACQ_REL);
+            stale = true;
+        }
+    }
+
+    if (stale) {
+        MapsIndex* idx = index_build();
+        if (idx) {
+            idx->generation = generation;
+            idx->refs = 1;
+            if (g_current && --g_current->refs == 0) {
+                index_free(g_current);
+            }
+            g_current = idx;
+            __atomic_store_n(&g_built_generation, generation, __ATOMIC_RELEASE);
+            if (check) {
+                g_objects = sig[0];
+                g_objects_hash = sig[1];
+            }
+        }
+    }
+
+    MapsIndex* result = g_current;
+    if (result) result->refs++;
+    pthread_mutex_unlock(&g_maps_lock);
+    return result;
+}
+
+const MapsIndex* maps_acquire(void) {
+    return acquire(false);
+}
+
+const MapsIndex* maps_acquire_fresh(void) {
+    return acquire(true);
+}
+
+void maps_release(const MapsIndex* idx) {
+    if (!idx) return;
+    MapsIndex* mutable_idx = (MapsIndex*)idx;
+
+    pthread_mutex_lock(&g_maps_lock);
+    bool last = --mutable_idx->refs == 0;
+    pthread_mutex_unlock(&g_maps_lock);
+
+    if (last) index_free(mutable_idx);
+}
+
+void maps_invalidate(void) {
+    __atomic_add_fetch(&g_generation, 1, __ATOMIC_RELEASE);
+}
+
+uint64_t maps_generation(void) {
+    return __atomic_load_n(&g_generation, __ATOMIC_ACQUIRE);
+}
+
+const MapRegion* maps_lookup(const MapsIndex* idx, uintptr_t addr) {
+    int lo = 0, hi = idx->count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        const MapRegion* r = &idx->regions[mid];
+        if (addr < r->start) hi = mid - 1;
+        else if (addr >= r->end) lo = mid + 1;
+        else return r;
+    }
+    return NULL;
+}
+
+int maps_find_path(const MapsIndex* idx, const char* name, int from) {
+    uint32_t last_id = 0;
+    bool last_match = false;
+
+    for (int i = from < 0 ? 0 : from; i < idx->count; i++) {
+        uint32_t id = idx->regions[i].path_id;
+        if (id == 0) continue;
+        if (id != last_id) {
+            last_id = id;
+            last_match = strstr(idx->paths[id], name) != NULL;
+        }
+        if (last_match) return i;
+    }
+    return -1;
+}
+
+void maps_format_perms(uint8_t perms, char out[5]) {
+    out[0] = (perms & MAPS_PERM_R) ? 'r' : '-';
+    out[1] = (perms & MAPS_PERM_W) ? 'w' : '-';
+    out[2] = (perms & MAPS_PERM_X) ? 'x' : '-';
+    out[3] = (perms & MAPS_PERM_P) ? 'p' : 's';
+    out[4] = '\0';
+}
+
+// Same layout as the kernel: the path starts at column 73 on 64-bit.
+int maps_format_line(const MapsIndex* idx, const MapRegion* r, char* buf, size_t size) {
+    char perms[5];
+    maps_format_perms(r->perms, perms);
+
+    int n = snprintf(buf, size, "%08lx-%08lx %s %08llx %02x:%02x %llu",
+                     (unsigned long)r->start, (unsigned long)r->end, perms,
+                     (unsigned long long)r->offset, r->dev_major, r->dev_minor,
+                     (unsigned long long)r->inode);
+    if (n < 0 || (size_t)n >= size) return n;
+
+    const char* path = maps_region_path(idx, r);
+    if (*path) {
+        int pad = n < 72 ? 72 - n : 0;
+        n += snprintf(buf + n, size - n, "%*s %s\n", pad, "", path);
+    } else {
+        n += snprintf(buf + n, size - n, " \n");
+    }
+    return n;
+}
+
+// The path of a maps line: what follows the address, perms, offset, dev
+// and inode fields.
+static const char* line_path(const char* line) {
+    const char* p = line;
+    for (int field = 0; field < 5; field++) {
+        while (*p && *p != ' ') p++;
+        while (*p == ' ') p++;
+    }
+    return p;
+}
+
+uintptr_t maps_read_module_base(const char* name) {
+    int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    // Whole lines only; one longer than the buffer is skipped
+    char buf[8192];
+    size_t len = 0;
+    bool skipping = false;
+    uintptr_t base = 0;
+    while (!base) {
+        ssize_t n = read(fd, buf + len, sizeof(buf) - 1 - len);
+        if (n <= 0) break;
+        len += (size_t)n;
+        buf[len] = '\0';
+
+        char* line = buf;
+        char* eol;
+        while (!base && (eol = memchr(line, '\n', (size_t)(buf + len - line)))) {
+            *eol = '\0';
+            if (!skipping && strstr(line_path(line), name)) {
+                uint64_t start;
+                parse_hex(line, &start);
+                base = (uintptr_t)start;
+            }
+            skipping = false;
+            line = eol + 1;
+        }
+        len = (size_t)(buf + len - line);
+        if (len == sizeof(buf) - 1) {
+            skipping = true;
+            len = 0;
+        }
+        memmove(buf, line, len);
+    }
+    close(fd);
+    return base;
+}
+
+uintptr_t maps_module_base(const char* name, char* path, size_t path_size) {
+    const MapsIndex* idx = maps_acquire();
+    if (!idx) return 0;
+
+    uintptr_t base = 0;
+    int i = maps_find_path(idx, name, 0);
+    if (i >= 0) {
+        base = idx->regions[i].start;
+        if (path && path_size) {
+            snprintf(path, path_size, "%s", maps_region_path(idx, &idx->regions[i]));
+        }
+    }
+    maps_release(idx);
+    return base;
+}
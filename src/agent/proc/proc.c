@@ -1,6 +1,10 @@
 #include <agent/proc.h>
 #include <agent/globals.h>
+#include <agent/maps.h>
+#include <agent/symindex.h>
+#include <agent/output.h>
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,29 +48,23 @@ void* find_library_base(const char* lib_name) {
         return find_data.base_addr;
     }
 
-    FILE* fp = fopen("/proc/self/maps", "r");
-    if (!fp) {
-        LOGE("Failed to open /proc/self/maps");
+    const MapsIndex* maps = maps_acquire();
+    if (!maps) {
         return NULL;
     }
 
-    char line[512];
     void* base_addr = NULL;
-
-    while (fgets(line, sizeof(line), fp)) {
-        if (strstr(line, lib_name)) {
-            if (strstr(line, "r-xp") || (strstr(line, "r--p") && strstr(line, " 00000000 "))) {
-                unsigned long addr;
-                if (sscanf(line, "%lx", &addr) == 1) {
-                    base_addr = (void*)addr;
-                    verbose_log("Found %s at base: %p (via /proc/self/maps)", lib_name, base_addr);
-                    break;
-                }
-            }
+    for (int i = maps_find_path(maps, lib_name, 0); i >= 0; i = maps_find_path(maps, lib_name, i + 1)) {
+        const MapRegion* r = &maps->regions[i];
+        if (r->perms & MAPS_PERM_W) continue;
+        if ((r->perms & MAPS_PERM_X) || ((r->perms & MAPS_PERM_R) && r->offset == 0)) {
+            base_addr = (void*)r->start;
+            verbose_log("Found %s at base: %p (via /proc/self/maps)", lib_name, base_addr);
+            break;
         }
     }
 
-    fclose(fp);
+    maps_release(maps);
 
     if (!base_addr) {
         LOGW("Library %s not found", lib_name);
@@ -75,56 +73,36 @@ void* find_library_base(const char* lib_name) {
     return base_addr;
 }
 
+// First r-x/r-- mapping of every .so, one maps line each
 char* get_loaded_libraries(void) {
-    FILE* fp = fopen("/proc/self/maps", "r");
-    if (!fp) {
+    const MapsIndex* maps = maps_acquire();
+    if (!maps) {
         return NULL;
     }
 
     size_t buf_size = 4096;
     size_t buf_used = 0;
     char* result = (char*)malloc(buf_size);
-    if (!result) {
-        fclose(fp);
+    bool* seen = (bool*)calloc(maps->npaths, sizeof(bool));
+    if (!result || !seen) {
+        free(result);
+        free(seen);
+        maps_release(maps);
         return NULL;
     }
     result[0] = '\0';
 
-    char** seen_paths = NULL;
-    size_t seen_count = 0;
-    size_t seen_capacity = 0;
-
-    char line[512];
-    while (fgets(line, sizeof(line), fp)) {
-        if (!strstr(line, ".so")) continue;
-        if (!strstr(line, "r-xp") && !strstr(line, "r--p")) continue;
+    for (int i = 0; i < maps->count; i++) {
+        const MapRegion* r = &maps->regions[i];
+        if (r->path_id == 0 || seen[r->path_id]) continue;
+        if ((r->perms & (MAPS_PERM_R | MAPS_PERM_W | MAPS_PERM_P)) != (MAPS_PERM_R | MAPS_PERM_P)) continue;
+        if (!strstr(maps_region_path(maps, r), ".so")) continue;
+        seen[r->path_id] = true;
 
-        char addr[64], perms[8], offset[16], dev[16], inode[16], path[256];
-        path[0] = '\0';
-        if (sscanf(line, "%63s %7s %15s %15s %15s %255[^\n]",
-                   addr, perms, offset, dev, inode, path) < 6 || path[0] == '\0') {
-            continue;
-        }
+        char line[512];
+        int line_len = maps_format_line(maps, r, line, sizeof(line));
+        if (line_len <= 0 || (size_t)line_len >= sizeof(line)) continue;
 
-        int already_seen = 0;
-        for (size_t i = 0; i < seen_count; i++) {
-            if (strcmp(seen_paths[i], path) == 0) {
-                already_seen = 1;
-                break;
-            }
-        }
-        if (already_seen) continue;
-
-        // Track this path
-        if (seen_count >= seen_capacity) {
-            seen_capacity = seen_capacity ? seen_capacity * 2 : 64;
-            char** new_seen = (char**)realloc(seen_paths, seen_capacity * sizeof(char*));
-            if (!new_seen) break;
-            seen_paths = new_seen;
-        }
-        seen_paths[seen_count++] = strdup(path);
-
-        size_t line_len = strlen(line);
         if (buf_used + line_len + 1 > buf_size) {
             buf_size *= 2;
             char* new_buf = (char*)realloc(result, buf_size);
@@ -136,16 +114,12 @@ char* get_loaded_libraries(void) {
             result = new_buf;
         }
 
-        strcat(result, line);
+        memcpy(result + buf_used, line, line_len + 1);
         buf_used += line_len;
     }
 
-    for (size_t i = 0; i < seen_count; i++) {
-        free(seen_paths[i]);
-    }
-    free(seen_paths);
-
-    fclose(fp);
+    free(seen);
+    maps_release(maps);
     return result;
 }
 
@@ -155,7 +129,7 @@ void list_apps(int client_fd) {
     FILE *fp = popen("pm list packages", "r");
     if (!fp) {
         const char* error = "ERROR: pm command failed\n";
-        write(client_fd, error, strlen(error));
+        output_reply(client_fd, error, strlen(error));
         return;
     }
 
@@ -164,7 +138,7 @@ void list_apps(int client_fd) {
 
     while (fgets(line, sizeof(line), fp) != NULL) {
         if (strncmp(line, "package:", 8) == 0) {
-            if (write(client_fd, line + 8, strlen(line + 8)) < 0) {
+            if (output_reply(client_fd, line + 8, strlen(line + 8)) < 0) {
                 LOGW("Write failed, client disconnected");
                 pclose(fp);
                 return;
@@ -175,7 +149,7 @@ void list_apps(int client_fd) {
 
     char summary[128];
     snprintf(summary, sizeof(summary), "\nTotal: %d packages\n", count);
-    write(client_fd, summary, strlen(summary));
+    output_reply(client_fd, summary, strlen(summary));
 
     pclose(fp);
     LOGI("Listed %d packages", count);
@@ -294,7 +268,7 @@ void dump_elf_sections(int client_fd, const char* file_path) {
     elf_sections_t* secs = parse_elf_sections(file_path);
     if (!secs) {
         const char* err = "ERROR: Failed to parse ELF\n";
-        write(client_fd, err, strlen(err));
+        output_reply(client_fd, err, strlen(err));
         return;
     }
 
@@ -305,7 +279,7 @@ void dump_elf_sections(int client_fd, const char* file_path) {
         "------------------------------------------------------------\n\n",
         file_path, secs->count,
         "Name", "Addr", "Size", "Type");
-    write(client_fd, header, strlen(header));
+    output_reply(client_fd, header, strlen(header));
 
     for (size_t i = 0; i < secs->count; i++) {
         elf_section_t* s = &secs->sections[i];
@@ -331,7 +305,7 @@ void dump_elf_sections(int client_fd, const char* file_path) {
             (unsigned long)s->addr,
             (unsigned long)s->size,
             type_str);
-        write(client_fd, line, strlen(line));
+        output_reply(client_fd, line, strlen(line));
     }
 
     free_elf_sections(secs);
@@ -368,33 +342,22 @@ char* find_library_path(const char* lib_name) {
         return path_data.path;
     }
 
-    FILE* fp = fopen("/proc/self/maps", "r");
-    if (!fp) {
-        LOGE("Failed to open /proc/self/maps");
+    const MapsIndex* maps = maps_acquire();
+    if (!maps) {
         return NULL;
     }
 
-    char line[512];
     char* result = NULL;
-
-    while (fgets(line, sizeof(line), fp)) {
-        if (strstr(line, lib_name)) {
-            char* path_start = strrchr(line, '/');
-            if (path_start) {
-                char* newline = strchr(path_start, '\n');
-                if (newline) *newline = '\0';
-
-                char* full_path = strchr(line, '/');
-                if (full_path) {
-                    result = strdup(full_path);
-                    verbose_log("Found library path: %s (via /proc/self/maps)", result);
-                    break;
-                }
-            }
+    for (int i = maps_find_path(maps, lib_name, 0); i >= 0; i = maps_find_path(maps, lib_name, i + 1)) {
+        const char* path = maps_region_path(maps, &maps->regions[i]);
+        if (path[0] == '/') {
+            result = strdup(path);
+            verbose_log("Found library path: %s (via /proc/self/maps)", result);
+            break;
         }
     }
 
-    fclose(fp);
+    maps_release(maps);
 
     if (!result) {
         LOGW("Library path not found for: %s", lib_name);
@@ -404,143 +367,58 @@ char* find_library_path(const char* lib_name) {
 }
 
 
-elf_exports_t* get_exports(const char* lib_name) {
-    char* file_path = find_library_path(lib_name);
-    void* base_addr = find_library_base(lib_name);
-
-    if (!base_addr) {
+// Copy one symbol table of the module's index. Exports are the global
+// and weak definitions in .dynsym; symbols are everything named in .symtab.
+static elf_exports_t* collect_symbols(const char* lib_name, bool dynamic) {
+    const SymIndex* idx = symindex_get(lib_name);
+    if (!idx) {
         LOGE("Library not loaded: %s", lib_name);
-        if (file_path) free(file_path);
-        return NULL;
-    }
-
-    int is_apk_embedded = (file_path && strstr(file_path, "!") != NULL);
-
-    void* map = NULL;
-    size_t map_size = 0;
-    int needs_unmap = 0;
-
-    if (is_apk_embedded) {
-        LOGI("Reading exports from memory for APK-embedded library: %s", lib_name);
-        map = base_addr;
-        needs_unmap = 0;
-    } else {
-        int fd = open(file_path, O_RDONLY);
-        if (fd < 0) {
-            LOGE("Failed to open: %s", file_path);
-            free(file_path);
-            return NULL;
-        }
-
-        struct stat st;
-        if (fstat(fd, &st) < 0) {
-            LOGE("fstat failed");
-            close(fd);
-            free(file_path);
-            return NULL;
-        }
-
-        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-        map_size = st.st_size;
-        close(fd);
-
-        if (map == MAP_FAILED) {
-            LOGE("mmap failed");
-            free(file_path);
-            return NULL;
-        }
-        needs_unmap = 1;
-    }
-
-    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)map;
-
-    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
-        LOGE("Not a valid ELF file");
-        if (needs_unmap) munmap(map, map_size);
-        if (file_path) free(file_path);
-        return NULL;
-    }
-
-    if (ehdr->e_ident[EI_CLASS] != ELFCLASS64) {
-        LOGE("Not a 64-bit ELF");
-        if (needs_unmap) munmap(map, map_size);
-        if (file_path) free(file_path);
         return NULL;
     }
 
-    if (ehdr->e_shoff == 0 || ehdr->e_shnum == 0) {
-        LOGE("No section headers");
-        if (needs_unmap) munmap(map, map_size);
-        if (file_path) free(file_path);
-        return NULL;
-    }
-
-    Elf64_Shdr* shdr = (Elf64_Shdr*)((uint8_t*)map + ehdr->e_shoff);
-
-    Elf64_Shdr* dynsym_shdr = NULL;
-    for (uint16_t i = 0; i < ehdr->e_shnum; i++) {
-        if (shdr[i].sh_type == SHT_DYNSYM) {
-            dynsym_shdr = &shdr[i];
-            break;
-        }
-    }
-
-    if (!dynsym_shdr) {
-        LOGE("No .dynsym section found");
-        if (needs_unmap) munmap(map, map_size);
-        if (file_path) free(file_path);
+    size_t sym_count = symindex_count(idx, dynamic);
+    if (!dynamic && sym_count == 0) {
+        LOGE("No .symtab section found (binary may be stripped)");
         return NULL;
     }
 
-    Elf64_Sym* symtab = (Elf64_Sym*)((uint8_t*)map + dynsym_shdr->sh_offset);
-    size_t sym_count = dynsym_shdr->sh_size / sizeof(Elf64_Sym);
-
-    const char* strtab = (const char*)((uint8_t*)map + shdr[dynsym_shdr->sh_link].sh_offset);
-
     elf_exports_t* result = (elf_exports_t*)malloc(sizeof(elf_exports_t));
     if (!result) {
-        if (needs_unmap) munmap(map, map_size);
-        if (file_path) free(file_path);
         return NULL;
     }
 
-    result->exports = (elf_export_t*)malloc(sizeof(elf_export_t) * sym_count);
+    result->exports = (elf_export_t*)malloc(sizeof(elf_export_t) * (sym_count ? sym_count : 1));
     if (!result->exports) {
         free(result);
-        if (needs_unmap) munmap(map, map_size);
-        if (file_path) free(file_path);
         return NULL;
     }
 
     result->count = 0;
 
     for (size_t i = 0; i < sym_count; i++) {
-        unsigned char type = ELF64_ST_TYPE(symtab[i].st_info);
-        unsigned char bind = ELF64_ST_BIND(symtab[i].st_info);
-
-        if ((type == STT_FUNC || type == STT_OBJECT || type == STT_NOTYPE || type == STT_GNU_IFUNC) && 
-            symtab[i].st_value != 0 &&
-            symtab[i].st_shndx != SHN_UNDEF &&
-            (bind == STB_GLOBAL || bind == STB_WEAK)) {
+        SymInfo sym;
+        symindex_entry(idx, dynamic, i, &sym);
 
-            elf_export_t* exp = &result->exports[result->count];
-            const char* name = strtab + symtab[i].st_name;
+        if (sym.type != STT_FUNC && sym.type != STT_OBJECT && sym.type != STT_NOTYPE && sym.type != STT_GNU_IFUNC) continue;
+        if (!sym.defined || sym.value == 0 || sym.name[0] == '\0') continue;
+        if (dynamic && sym.bind != STB_GLOBAL && sym.bind != STB_WEAK) continue;
 
-            strncpy(exp->name, name, sizeof(exp->name) - 1);
-            exp->name[sizeof(exp->name) - 1] = '\0';
-            exp->offset = symtab[i].st_value;
+        elf_export_t* exp = &result->exports[result->count];
+        strncpy(exp->name, sym.name, sizeof(exp->name) - 1);
+        exp->name[sizeof(exp->name) - 1] = '\0';
+        exp->offset = sym.value;
 
-            result->count++;
-        }
+        result->count++;
     }
 
-    verbose_log("Found %zu exports in %s", result->count, lib_name);
-
-    if (needs_unmap) munmap(map, map_size);
-    if (file_path) free(file_path);
+    verbose_log("Found %zu %s in %s", result->count, dynamic ? "exports" : "symbols (.symtab)", lib_name);
     return result;
 }
 
+elf_exports_t* get_exports(const char* lib_name) {
+    return collect_symbols(lib_name, true);
+}
+
 void free_elf_exports(elf_exports_t* exp) {
     if (exp) {
         free(exp->exports);
@@ -549,121 +427,5 @@ void free_elf_exports(elf_exports_t* exp) {
 }
 
 elf_exports_t* get_symbols(const char* lib_name) {
-    char* file_path = find_library_path(lib_name);
-
-    if (!file_path) {
-        LOGE("Library path not found: %s", lib_name);
-        return NULL;
-    }
-
-    int fd = open(file_path, O_RDONLY);
-    if (fd < 0) {
-        LOGE("Failed to open: %s", file_path);
-        free(file_path);
-        return NULL;
-    }
-
-    struct stat st;
-    if (fstat(fd, &st) < 0) {
-        LOGE("fstat failed");
-        close(fd);
-        free(file_path);
-        return NULL;
-    }
-
-    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-
-    if (map == MAP_FAILED) {
-        LOGE("mmap failed");
-        free(file_path);
-        return NULL;
-    }
-
-    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)map;
-
-    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
-        LOGE("Not a valid ELF file");
-        munmap(map, st.st_size);
-        free(file_path);
-        return NULL;
-    }
-
-    if (ehdr->e_ident[EI_CLASS] != ELFCLASS64) {
-        LOGE("Not a 64-bit ELF");
-        munmap(map, st.st_size);
-        free(file_path);
-        return NULL;
-    }
-
-    if (ehdr->e_shoff == 0 || ehdr->e_shnum == 0) {
-        LOGE("No section headers");
-        munmap(map, st.st_size);
-        free(file_path);
-        return NULL;
-    }
-
-    Elf64_Shdr* shdr = (Elf64_Shdr*)((uint8_t*)map + ehdr->e_shoff);
-
-    Elf64_Shdr* symtab_shdr = NULL;
-    for (uint16_t i = 0; i < ehdr->e_shnum; i++) {
-        if (shdr[i].sh_type == SHT_SYMTAB) {
-            symtab_shdr = &shdr[i];
-            break;
-        }
-    }
-
-    if (!symtab_shdr) {
-        LOGE("No .symtab section found (binary may be stripped)");
-        munmap(map, st.st_size);
-        free(file_path);
-        return NULL;
-    }
-
-    Elf64_Sym* symtab = (Elf64_Sym*)((uint8_t*)map + symtab_shdr->sh_offset);
-    size_t sym_count = symtab_shdr->sh_size / sizeof(Elf64_Sym);
-
-    const char* strtab = (const char*)((uint8_t*)map + shdr[symtab_shdr->sh_link].sh_offset);
-
-    elf_exports_t* result = (elf_exports_t*)malloc(sizeof(elf_exports_t));
-    if (!result) {
-        munmap(map, st.st_size);
-        free(file_path);
-        return NULL;
-    }
-
-    result->exports = (elf_export_t*)malloc(sizeof(elf_export_t) * sym_count);
-    if (!result->exports) {
-        free(result);
-        munmap(map, st.st_size);
-        free(file_path);
-        return NULL;
-    }
-
-    result->count = 0;
-
-    for (size_t i = 0; i < sym_count; i++) {
-        unsigned char type = ELF64_ST_TYPE(symtab[i].st_info);
-
-        if ((type == STT_FUNC || type == STT_OBJECT || type == STT_NOTYPE || type == STT_GNU_IFUNC) && 
-            symtab[i].st_value != 0 &&
-            symtab[i].st_shndx != SHN_UNDEF) {
-            elf_export_t* exp = &result->exports[result->count];
-            const char* name = strtab + symtab[i].st_name;
-
-            if (name[0] == '\0') continue;
-
-            strncpy(exp->name, name, sizeof(exp->name) - 1);
-            exp->name[sizeof(exp->name) - 1] = '\0';
-            exp->offset = symtab[i].st_value;
-
-            result->count++;
-        }
-    }
-
-    verbose_log("Found %zu symbols in %s (.symtab)", result->count, lib_name);
-
-    munmap(map, st.st_size);
-    free(file_path);
-    return result;
+    return collect_symbols(lib_name, false);
 }
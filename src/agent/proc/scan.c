@@ -0,0 +1,701 @@
+#include <agent/scan.h>
+#include <agent/lua_memory.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Rough commonness of a byte value in process memory (higher = more
+// common). Only used to pick anchors, so it just has to rank zero/0xFF
+// fill, small integers and ASCII above the rest.
+static int byte_commonness(uint8_t b) {
+    if (b == 0x00) return 255;
+    if (b == 0xFF) return 200;
+    if (b < 0x10) return 150;
+    if (b == ' ' || b == 'e' || b == 't' || b == 'a') return 130;
+    if ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9')) return 110;
+    if (b < 0x80) return 90;
+    return 40;
+}
+
+static void choose_anchors(ScanPattern* sp) {
+    sp->has_anchor = false;
+    sp->anchor = sp->anchor2 = 0;
+
+    int best = 1000, second = 1000;
+    for (size_t i = 0; i < sp->len; i++) {
+        if (!sp->mask[i]) continue;
+        int c = byte_commonness(sp->bytes[i]);
+        if (c < best) {
+            second = best;
+            sp->anchor2 = sp->anchor;
+            best = c;
+            sp->anchor = i;
+        } else if (c < second && sp->bytes[i] != sp->bytes[sp->anchor]) {
+            second = c;
+            sp->anchor2 = i;
+        }
+        sp->has_anchor = true;
+    }
+    if (second == 1000) {
+        sp->anchor2 = sp->anchor;
+    }
+}
+
+bool scan_pattern_init(ScanPattern* sp, const uint8_t* bytes, size_t len) {
+    if (len == 0 || len > SCAN_MAX_PATTERN) return false;
+
+    memset(sp, 0, sizeof(*sp));
+    memcpy(sp->bytes, bytes, len);
+    memset(sp->mask, 0xFF, len);
+    sp->len = len;
+    choose_anchors(sp);
+    return true;
+}
+
+bool scan_pattern_init_masked(ScanPattern* sp, const int* pattern, size_t len) {
+    if (len == 0 || len > SCAN_MAX_PATTERN) return false;
+
+    memset(sp, 0, sizeof(*sp));
+    for (size_t i = 0; i < len; i++) {
+        if (pattern[i] == WILDCARD_BYTE) {
+            sp->has_wildcards = true;
+        } else {
+            sp->bytes[i] = (uint8_t)pattern[i];
+            sp->mask[i] = 0xFF;
+        }
+    }
+    sp->len = len;
+    choose_anchors(sp);
+    return true;
+}
+
+static inline bool verify(const ScanPattern* sp, const uint8_t* p) {
+    if (!sp->has_wildcards) {
+        return memcmp(p, sp->bytes, sp->len) == 0;
+    }
+
+    size_t i = 0;
+    for (; i + 8 <= sp->len; i += 8) {
+        uint64_t d, b, m;
+        memcpy(&d, p + i, 8);
+        memcpy(&b, sp->bytes + i, 8);
+        memcpy(&m, sp->mask + i, 8);
+        if ((d ^ b) & m) return false;
+    }
+    for (; i < sp->len; i++) {
+        if ((p[i] ^ sp->bytes[i]) & sp->mask[i]) return false;
+    }
+    return true;
+}
+
+// Candidates for positions [p, p + width) where both anchors match, as a
+// bitmask with `stride` bits per position.
+#if defined(__aarch64__)
+#define SCAN_WIDTH  16
+#define SCAN_STRIDE 4
+static inline uint64_t candidates(const uint8_t* p, uint8x16_t a1, uint8x16_t a2,
+                                  size_t off1, size_t off2) {
+    uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(p + off1), a1),
+                             vceqq_u8(vld1q_u8(p + off2), a2));
+    uint8x8_t nib = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nib), 0);
+}
+#elif defined(__x86_64__) && defined(__AVX2__)
+#define SCAN_WIDTH  32
+#define SCAN_STRIDE 1
+static inline uint64_t candidates(const uint8_t* p, __m256i a1, __m256i a2,
+                                  size_t off1, size_t off2) {
+    __m256i eq = _mm256_and_si256(
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + off1)), a1),
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + off2)), a2));
+    return (uint32_t)_mm256_movemask_epi8(eq);
+}
+#elif defined(__x86_64__)
+#define SCAN_WIDTH  16
+#define SCAN_STRIDE 1
+static inline uint64_t candidates(const uint8_t* p, __m128i a1, __m128i a2,
+                                  size_t off1, size_t off2) {
+    __m128i eq = _mm_and_si128(
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + off1)), a1),
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + off2)), a2));
+    return (uint32_t)_mm_movemask_epi8(eq);
+}
+#endif
+
+const uint8_t* scan_find(const ScanPattern* sp, const uint8_t* begin, const uint8_t* end) {
+    if (end < begin || (size_t)(end - begin) < sp->len) return NULL;
+    const uint8_t* last = end - sp->len;    // last valid start
+
+    if (!sp->has_anchor) {
+        return begin;
+    }
+
+    const uint8_t* p = begin;
+
+#ifdef SCAN_WIDTH
+    size_t off1 = sp->anchor, off2 = sp->anchor2;
+    size_t reach = (off1 > off2 ? off1 : off2) + SCAN_WIDTH;
+
+#if defined(__aarch64__)
+    uint8x16_t a1 = vdupq_n_u8(sp->bytes[off1]);
+    uint8x16_t a2 = vdupq_n_u8(sp->bytes[off2]);
+#elif defined(__AVX2__)
+    __m256i a1 = _mm256_set1_epi8((char)sp->bytes[off1]);
+    __m256i a2 = _mm256_set1_epi8((char)sp->bytes[off2]);
+#else
+    __m128i a1 = _mm_set1_epi8((char)sp->bytes[off1]);
+    __m128i a2 = _mm_set1_epi8((char)sp->bytes[off2]);
+#endif
+
+    // Vector loads stay inside [begin, end) as long as p + reach <= end
+    while ((size_t)(end - p) >= reach) {
+        uint64_t bits = candidates(p, a1, a2, off1, off2);
+        while (bits) {
+            int bit = __builtin_ctzll(bits);
+            const uint8_t* cand = p + bit / SCAN_STRIDE;
+            if (cand > last) return NULL;
+            if (verify(sp, cand)) return cand;
+            bits &= ~((((uint64_t)1 << SCAN_STRIDE) - 1) << (bit - bit % SCAN_STRIDE));
+        }
+        p += SCAN_WIDTH;
+    }
+#endif
+
+    // Tail (or no vector unit): memchr on the first anchor
+    uint8_t a = sp->bytes[sp->anchor];
+    while (p <= last) {
+        const uint8_t* hit = memchr(p + sp->anchor, a, (size_t)(last - p) + 1);
+        if (!hit) return NULL;
+        const uint8_t* cand = hit - sp->anchor;
+        if (verify(sp, cand)) return cand;
+        p = cand + 1;
+    }
+    return NULL;
+}
+
+struct ScanMulti {
+    ScanPattern* patterns;
+    uint16_t kw_off[SCAN_MULTI_MAX_PATTERNS];
+    uint8_t kw_len[SCAN_MULTI_MAX_PATTERNS];
+    int pat_next[SCAN_MULTI_MAX_PATTERNS];  // next pattern sharing the keyword
+    int count;
+    size_t min_len;
+    size_t max_len;
+
+    uint16_t (*next)[256];  // DFA transitions
+    int* out;               // first pattern whose keyword ends in this state
+    int* out_link;          // nearest state on the fail chain with output
+    int* match;             // first state to report from (self or out_link)
+    int nstates;
+    bool compiled;
+};
+
+ScanMulti* scan_multi_create(void) {
+    ScanMulti* m = calloc(1, sizeof(ScanMulti));
+    if (!m) return NULL;
+    m->patterns = calloc(SCAN_MULTI_MAX_PATTERNS, sizeof(ScanPattern));
+    if (!m->patterns) {
+        free(m);
+        return NULL;
+    }
+    return m;
+}
+
+void scan_multi_free(ScanMulti* m) {
+    if (!m) return;
+    free(m->patterns);
+    free(m->next);
+    free(m->out);
+    free(m->out_link);
+    free(m->match);
+    free(m);
+}
+
+// Keyword = the SCAN_MULTI_KEYWORD_MAX window of fixed bytes (or shorter
+// fixed run) with the lowest total commonness, preferring longer runs.
+static bool choose_keyword(const ScanPattern* sp, uint16_t* off, uint8_t* len) {
+    int best_score = 0;
+    bool found = false;
+
+    size_t i = 0;
+    while (i < sp->len) {
+        if (!sp->mask[i]) {
+            i++;
+            continue;
+        }
+        size_t run = i;
+        while (run < sp->len && sp->mask[run]) run++;
+
+        size_t run_len = run - i;
+        size_t win = run_len < SCAN_MULTI_KEYWORD_MAX ? run_len : SCAN_MULTI_KEYWORD_MAX;
+        for (size_t s = i; s + win <= run; s++) {
+            int score = (int)win * 256;
+            for (size_t k = s; k < s + win; k++) {
+                score -= byte_commonness(sp->bytes[k]);
+            }
+            if (!found || score > best_score) {
+                best_score = score;
+                *off = (uint16_t)s;
+                *len = (uint8_t)win;
+                found = true;
+            }
+        }
+        i = run;
+    }
+    return found;
+}
+
+int scan_multi_add(ScanMulti* m, const int* pattern, size_t len) {
+    if (m->compiled || m->count >= SCAN_MULTI_MAX_PATTERNS) return -1;
+
+    int idx = m->count;
+    ScanPattern* sp = &m->patterns[idx];
+    if (!scan_pattern_init_masked(sp, pattern, len)) return -1;
+    if (!choose_keyword(sp, &m->kw_off[idx], &m->kw_len[idx])) return -1;
+
+    if (m->count == 0 || len < m->min_len) m->min_len = len;
+    if (len > m->max_len) m->max_len = len;
+    m->count++;
+    return idx;
+}
+
+bool scan_multi_compile(ScanMulti* m) {
+    if (m->compiled || m->count == 0) return false;
+
+    int cap = 1;
+    for (int i = 0; i < m->count; i++) cap += m->kw_len[i];
+
+    m->next = calloc(cap, sizeof(*m->next));
+    m->out = malloc(cap * sizeof(int));
+    m->out_link = malloc(cap * sizeof(int));
+    m->match = malloc(cap * sizeof(int));
+    int* fail = calloc(cap, sizeof(int));
+    int* queue = malloc(cap * sizeof(int));
+    if (!m->next || !m->out || !m->out_link || !m->match || !fail || !queue) {
+        free(fail);
+        free(queue);
+        return false;
+    }
+    for (int s = 0; s < cap; s++) {
+        m->out[s] = m->out_link[s] = m->match[s] = -1;
+    }
+
+    // Trie; state 0 is the root, so a 0 edge means "none" until the BFS
+    m->nstates = 1;
+    for (int i = 0; i < m->count; i++) {
+        const uint8_t* kw = m->patterns[i].bytes + m->kw_off[i];
+        int s = 0;
+        for (int k = 0; k < m->kw_len[i]; k++) {
+            if (!m->next[s][kw[k]]) {
+                m->next[s][kw[k]] = (uint16_t)m->nstates++;
+            }
+            s = m->next[s][kw[k]];
+        }
+        m->pat_next[i] = -1;
+        if (m->out[s] < 0) {
+            m->out[s] = i;
+        } else {
+            int t = m->out[s];
+            while (m->pat_next[t] >= 0) t = m->pat_next[t];
+            m->pat_next[t] = i;
+        }
+    }
+
+    // BFS turns the trie into a DFA; a state's fail target is always
+    // shallower, so its row is already complete when we copy from it.
+    int qh = 0, qt = 0;
+    for (int c = 0; c < 256; c++) {
+        int child = m->next[0][c];
+        if (child) {
+            fail[child] = 0;
+            queue[qt++] = child;
+        }
+    }
+    while (qh < qt) {
+        int s = queue[qh++];
+        int f = fail[s];
+        m->out_link[s] = m->out[f] >= 0 ? f : m->out_link[f];
+        for (int c = 0; c < 256; c++) {
+            int child = m->next[s][c];
+            if (child) {
+                fail[child] = m->next[f][c];
+                queue[qt++] = child;
+            } else {
+                m->next[s][c] = m->next[f][c];
+            }
+        }
+    }
+    for (int s = 0; s < m->nstates; s++) {
+        m->match[s] = m->out[s] >= 0 ? s : m->out_link[s];
+    }
+
+    free(fail);
+    free(queue);
+    m->compiled = true;
+    return true;
+}
+
+int scan_multi_count(const ScanMulti* m) {
+    return m->count;
+}
+
+size_t scan_multi_pattern_len(const ScanMulti* m, int index) {
+    return index >= 0 && index < m->count ? m->patterns[index].len : 0;
+}
+
+typedef struct {
+    int range;
+    uintptr_t start;        // hits must start in [start, limit)
+    uintptr_t limit;
+    uintptr_t end;          // limit + overlap, clipped to the range
+    ScanHit* hits;
+    int count;
+    int capacity;
+    bool done;
+} ScanChunk;
+
+// Chunk indices [lo, hi) still owned by one worker, packed so the owner
+// (taking lo) and thieves (taking the upper half) can both use CAS.
+typedef struct {
+    uint64_t span;
+    char pad[56];
+} ScanQueue;
+
+typedef struct {
+    const ScanPattern* sp;  // exactly one of sp / multi is set
+    const ScanMulti* multi;
+    const ScanSink* sink;
+    ScanChunk* chunks;
+    int nchunks;
+    int max_hits;
+    int nworkers;
+    ScanQueue queues[SCAN_MAX_THREADS];
+
+    pthread_mutex_t lock;
+    int prefix;             // chunks [0, prefix) are done
+    int prefix_hits;
+    int cutoff;             // chunks >= cutoff can't contribute any more
+} ScanJob;
+
+typedef struct {
+    ScanJob* job;
+    int id;
+} ScanWorker;
+
+static int g_scan_threads = 0;
+static int g_scan_cpus[SCAN_MAX_THREADS];
+static int g_scan_ncpus = 0;
+
+static inline uint64_t span_pack(uint32_t lo, uint32_t hi) {
+    return (uint64_t)lo | ((uint64_t)hi << 32);
+}
+
+static bool queue_pop(ScanQueue* q, int* idx) {
+    uint64_t span = __atomic_load_n(&q->span, __ATOMIC_ACQUIRE);
+    while (1) {
+        uint32_t lo = (uint32_t)span, hi = (uint32_t)(span >> 32);
+        if (lo >= hi) return false;
+        if (__atomic_compare_exchange_n(&q->span, &span, span_pack(lo + 1, hi), false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *idx = (int)lo;
+            return true;
+        }
+    }
+}
+
+static bool queue_steal(ScanJob* job, int self) {
+    for (int k = 1; k < job->nworkers; k++) {
+        ScanQueue* victim = &job->queues[(self + k) % job->nworkers];
+        uint64_t span = __atomic_load_n(&victim->span, __ATOMIC_ACQUIRE);
+        while (1) {
+            uint32_t lo = (uint32_t)span, hi = (uint32_t)(span >> 32);
+            if (lo >= hi) break;
+            uint32_t mid = hi - (hi - lo + 1) / 2;
+            if (__atomic_compare_exchange_n(&victim->span, &span, span_pack(lo, mid), false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&job->queues[self].span, span_pack(mid, hi), __ATOMIC_RELEASE);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool chunk_push(ScanChunk* c, uintptr_t addr, int pattern) {
+    if (c->count >= c->capacity) {
+        int cap = c->capacity ? c->capacity * 2 : 16;
+        ScanHit* hits = realloc(c->hits, cap * sizeof(ScanHit));
+        if (!hits) return false;
+        c->hits = hits;
+        c->capacity = cap;
+    }
+    c->hits[c->count].addr = addr;
+    c->hits[c->count].range = c->range;
+    c->hits[c->count].pattern = pattern;
+    c->count++;
+    return true;
+}
+
+static int hit_cmp(const void* a, const void* b) {
+    const ScanHit* x = (const ScanHit*)a;
+    const ScanHit* y = (const ScanHit*)b;
+    if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+    return x->pattern - y->pattern;
+}
+
+static void chunk_scan(ScanJob* job, ScanChunk* c) {
+    const uint8_t* p = (const uint8_t*)c->start;
+    const uint8_t* end = (const uint8_t*)c->end;
+
+    while (c->count < job->max_hits) {
+        const uint8_t* found = scan_find(job->sp, p, end);
+        if (!found || (uintptr_t)found >= c->limit) break;
+        if (!chunk_push(c, (uintptr_t)found, 0)) break;
+        p = found + 1;
+    }
+}
+
+// Keywords are reported at their last byte, so hits arrive roughly but
+// not strictly in address order. Once 2 * max_hits are buffered, keep the
+// lowest max_hits; no later hit can start below p - max_len + 1, which
+// bounds how long we keep scanning after that.
+static void chunk_scan_multi(ScanJob* job, ScanChunk* c) {
+    const ScanMulti* m = job->multi;
+    const uint8_t* p = (const uint8_t*)c->start;
+    const uint8_t* end = (const uint8_t*)c->end;
+    uintptr_t ceiling = UINTPTR_MAX;
+    int state = 0;
+
+    const uint16_t* root = m->next[0];
+
+    for (; p < end; p++) {
+        // Most bytes leave the root where it is; skip those without
+        // chaining each lookup on the previous one.
+        if (state == 0) {
+            while (p < end && !root[*p]) p++;
+            if (p == end) break;
+        }
+        state = m->next[state][*p];
+        if (m->match[state] < 0) continue;
+
+        for (int t = m->match[state]; t >= 0; t = m->out_link[t]) {
+            for (int i = m->out[t]; i >= 0; i = m->pat_next[i]) {
+                if ((uintptr_t)p + 1 < (uintptr_t)m->kw_len[i] + m->kw_off[i]) continue;
+                uintptr_t start = (uintptr_t)p + 1 - m->kw_len[i] - m->kw_off[i];
+                if (start < c->start || start >= c->limit || start > ceiling) continue;
+                if (m->patterns[i].len > c->end - start) continue;
+                if (!verify(&m->patterns[i], (const uint8_t*)start)) continue;
+                if (!chunk_push(c, start, i)) return;
+            }
+        }
+
+        if (c->count >= 2 * job->max_hits) {
+            qsort(c->hits, c->count, sizeof(ScanHit), hit_cmp);
+            c->count = job->max_hits;
+            ceiling = c->hits[c->count - 1].addr;
+        }
+        if (ceiling != UINTPTR_MAX && (uintptr_t)p >= ceiling + m->max_len) break;
+    }
+
+    qsort(c->hits, c->count, sizeof(ScanHit), hit_cmp);
+    if (c->count > job->max_hits) c->count = job->max_hits;
+}
+
+// Track the completed prefix; once it holds max_hits, later chunks are moot.
+static void chunk_done(ScanJob* job, int idx) {
+    pthread_mutex_lock(&job->lock);
+    job->chunks[idx].done = true;
+    while (job->prefix < job->nchunks && job->chunks[job->prefix].done) {
+        const ScanChunk* c = &job->chunks[job->prefix];
+        int take = job->max_hits - job->prefix_hits;
+        if (take > c->count) take = c->count;
+        if (job->sink && take > 0) {
+            job->sink->fn(c->hits, take, job->sink->ctx);
+        }
+
+        job->prefix_hits += c->count;
+        job->prefix++;
+        if (job->prefix_hits >= job->max_hits) {
+            __atomic_store_n(&job->cutoff, job->prefix, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void* scan_worker(void* arg) {
+    ScanWorker* w = (ScanWorker*)arg;
+    ScanJob* job = w->job;
+
+    cpu_set_t saved;
+    bool pinned = false;
+    if (g_scan_ncpus > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(g_scan_cpus[w->id % g_scan_ncpus], &set);
+        pinned = sched_getaffinity(0, sizeof(saved), &saved) == 0 &&
+                 sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+    int idx;
+    while (queue_pop(&job->queues[w->id], &idx) || (queue_steal(job, w->id) &&
+                                                   queue_pop(&job->queues[w->id], &idx))) {
+        if (idx < __atomic_load_n(&job->cutoff, __ATOMIC_ACQUIRE)) {
+            if (job->multi) {
+                chunk_scan_multi(job, &job->chunks[idx]);
+            } else {
+                chunk_scan(job, &job->chunks[idx]);
+            }
+        }
+        chunk_done(job, idx);
+    }
+
+    // Worker 0 is the calling thread; give it its old affinity back
+    if (pinned) {
+        sched_setaffinity(0, sizeof(saved), &saved);
+    }
+    return NULL;
+}
+
+static int effective_threads(void) {
+    int n = g_scan_threads;
+    if (n <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = cpus > 0 ? (int)cpus : 1;
+    }
+    return n > SCAN_MAX_THREADS ? SCAN_MAX_THREADS : n;
+}
+
+// Chunks overlap by max_len - 1 so a match straddling a boundary is still
+// seen whole by the chunk it starts in.
+static int run_job(ScanJob* job, const ScanRange* ranges, int nranges,
+                   size_t min_len, size_t max_len, int max_hits, ScanHit** out) {
+    *out = NULL;
+    if (max_hits <= 0) return 0;
+
+    int nchunks = 0;
+    for (int i = 0; i < nranges; i++) {
+        if (ranges[i].end - ranges[i].start < min_len) continue;
+        nchunks += (int)((ranges[i].end - ranges[i].start + SCAN_CHUNK_SIZE - 1) / SCAN_CHUNK_SIZE);
+    }
+    if (nchunks == 0) return 0;
+
+    job->chunks = calloc(nchunks, sizeof(ScanChunk));
+    if (!job->chunks) return 0;
+    job->nchunks = nchunks;
+    job->max_hits = max_hits;
+    job->cutoff = nchunks;
+    pthread_mutex_init(&job->lock, NULL);
+
+    int n = 0;
+    for (int i = 0; i < nranges; i++) {
+        if (ranges[i].end - ranges[i].start < min_len) continue;
+        for (uintptr_t s = ranges[i].start; s < ranges[i].end; s += SCAN_CHUNK_SIZE) {
+            ScanChunk* c = &job->chunks[n++];
+            c->range = i;
+            c->start = s;
+            c->limit = ranges[i].end - s > SCAN_CHUNK_SIZE ? s + SCAN_CHUNK_SIZE : ranges[i].end;
+            c->end = ranges[i].end - c->limit > max_len - 1 ? c->limit + max_len - 1 : ranges[i].end;
+        }
+    }
+
+    job->nworkers = effective_threads();
+    if (job->nworkers > nchunks) job->nworkers = nchunks;
+    for (int w = 0; w < job->nworkers; w++) {
+        uint32_t lo = (uint32_t)((int64_t)nchunks * w / job->nworkers);
+        uint32_t hi = (uint32_t)((int64_t)nchunks * (w + 1) / job->nworkers);
+        job->queues[w].span = span_pack(lo, hi);
+    }
+
+    ScanWorker workers[SCAN_MAX_THREADS];
+    pthread_t tids[SCAN_MAX_THREADS];
+    bool started[SCAN_MAX_THREADS] = {false};
+    for (int w = 0; w < job->nworkers; w++) {
+        workers[w].job = job;
+        workers[w].id = w;
+    }
+    for (int w = 1; w < job->nworkers; w++) {
+        started[w] = pthread_create(&tids[w], NULL, scan_worker, &workers[w]) == 0;
+    }
+    scan_worker(&workers[0]);   // steals whatever failed threads left behind
+    for (int w = 1; w < job->nworkers; w++) {
+        if (started[w]) pthread_join(tids[w], NULL);
+    }
+
+    // Chunks are in address order, so concatenating them is deterministic
+    int total = 0;
+    for (int i = 0; i < nchunks && total < max_hits; i++) {
+        total += job->chunks[i].count;
+    }
+    if (total > max_hits) total = max_hits;
+
+    ScanHit* hits = total ? malloc(total * sizeof(ScanHit)) : NULL;
+    int count = 0;
+    for (int i = 0; i < nchunks && hits && count < total; i++) {
+        for (int j = 0; j < job->chunks[i].count && count < total; j++) {
+            hits[count++] = job->chunks[i].hits[j];
+        }
+    }
+    for (int i = 0; i < nchunks; i++) {
+        free(job->chunks[i].hits);
+    }
+    free(job->chunks);
+    pthread_mutex_destroy(&job->lock);
+
+    *out = hits;
+    return count;
+}
+
+int scan_ranges(const ScanPattern* sp, const ScanRange* ranges, int nranges,
+                int max_hits, const ScanSink* sink, ScanHit** out) {
+    ScanJob job;
+    memset(&job, 0, sizeof(job));
+    job.sp = sp;
+    job.sink = sink;
+    return run_job(&job, ranges, nranges, sp->len, sp->len, max_hits, out);
+}
+
+int scan_ranges_multi(const ScanMulti* m, const ScanRange* ranges, int nranges,
+                      int max_hits, const ScanSink* sink, ScanHit** out) {
+    *out = NULL;
+    if (!m->compiled) return 0;
+
+    ScanJob job;
+    memset(&job, 0, sizeof(job));
+    job.multi = m;
+    job.sink = sink;
+    return run_job(&job, ranges, nranges, m->min_len, m->max_len, max_hits, out);
+}
+
+void scan_set_threads(int threads) {
+    g_scan_threads = threads < 0 ? 0 : threads;
+}
+
+int scan_get_threads(void) {
+    return effective_threads();
+}
+
+void scan_set_cpus(const int* cpus, int ncpus) {
+    if (ncpus > SCAN_MAX_THREADS) ncpus = SCAN_MAX_THREADS;
+    for (int i = 0; i < ncpus; i++) {
+        g_scan_cpus[i] = cpus[i];
+    }
+    g_scan_ncpus = ncpus < 0 ? 0 : ncpus;
+}
+
+int scan_get_cpus(int* out, int max) {
+    int n = g_scan_ncpus < max ? g_scan_ncpus : max;
+    for (int i = 0; i < n; i++) {
+        out[i] = g_scan_cpus[i];
+    }
+    return n;
+}
@@ -0,0 +1,274 @@
+#include <agent/symbolize.h>
+#include <agent/symindex.h>
+#include <agent/maps.h>
+#include <agent/globals.h>
+
+#include <elf.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 4-way set associative, LRU within a set.
+#define SYM_CACHE_SETS      512
+#define SYM_CACHE_WAYS      4
+
+typedef struct {
+    uintptr_t pc;               // 0 = empty
+    int module_id;
+    bool resolved;              // symbol looked up (raw lookups skip it)
+    const char* symbol;
+    uintptr_t symbol_addr;
+    uint32_t stamp;
+} CacheEntry;
+
+typedef struct {
+    char* path;
+    const char* name;
+    uintptr_t base;
+    uint64_t offset;            // file offset of base (non-zero inside an APK)
+    bool readable;
+    bool syms_loaded;
+    const SymIndex* syms;
+} Module;
+
+static pthread_mutex_t g_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static CacheEntry g_cache[SYM_CACHE_SETS][SYM_CACHE_WAYS];
+static uint32_t g_clock = 0;
+static uint64_t g_cache_generation = 0;
+
+// Modules are only ever appended; ids index this array. Paths are
+// never freed, so names handed out stay valid.
+static pthread_mutex_t g_module_lock = PTHREAD_MUTEX_INITIALIZER;
+static Module* g_modules = NULL;
+static int g_module_count = 0;
+static int g_module_cap = 0;
+
+static inline uint32_t cache_set(uintptr_t pc) {
+    uint64_t h = (uint64_t)pc * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> 40) & (SYM_CACHE_SETS - 1);
+}
+
+// Acquiring the maps index runs its (rate limited) loader check, which
+// moves the generation on dlopen/dlclose; reading the counter alone
+// would only see maps_invalidate().
+static uint64_t current_generation(void) {
+    const MapsIndex* maps = maps_acquire();
+    uint64_t generation = maps ? maps->generation : maps_generation();
+    maps_release(maps);
+    return generation;
+}
+
+static bool cache_get(uintptr_t pc, bool want_symbol, CacheEntry* out) {
+    bool hit = false;
+    uint64_t generation = current_generation();
+    pthread_mutex_lock(&g_cache_lock);
+
+    if (generation != g_cache_generation) {
+        memset(g_cache, 0, sizeof(g_cache));
+        g_cache_generation = generation;
+    }
+
+    CacheEntry* set = g_cache[cache_set(pc)];
+    for (int i = 0; i < SYM_CACHE_WAYS; i++) {
+        if (set[i].pc == pc && (set[i].resolved || !want_symbol)) {
+            set[i].stamp = ++g_clock;
+            *out = set[i];
+            hit = true;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&g_cache_lock);
+    return hit;
+}
+
+static void cache_put(const CacheEntry* entry) {
+    pthread_mutex_lock(&g_cache_lock);
+
+    CacheEntry* set = g_cache[cache_set(entry->pc)];
+    CacheEntry* victim = &set[0];
+    for (int i = 0; i < SYM_CACHE_WAYS; i++) {
+        if (set[i].pc == entry->pc) {
+            victim = &set[i];
+            break;
+        }
+        if (set[i].stamp < victim->stamp) victim = &set[i];
+    }
+    *victim = *entry;
+    victim->stamp = ++g_clock;
+
+    pthread_mutex_unlock(&g_cache_lock);
+}
+
+static int module_intern(const char* path, uintptr_t base, uint64_t offset, bool readable) {
+    pthread_mutex_lock(&g_module_lock);
+
+    for (int i = g_module_count - 1; i >= 0; i--) {
+        if (g_modules[i].base == base && strcmp(g_modules[i].path, path) == 0) {
+            pthread_mutex_unlock(&g_module_lock);
+            return i;
+        }
+    }
+
+    int id = -1;
+    if (g_module_count == g_module_cap) {
+        int cap = g_module_cap ? g_module_cap * 2 : 64;
+        Module* grown = (Module*)realloc(g_modules, cap * sizeof(Module));
+        if (grown) {
+            g_modules = grown;
+            g_module_cap = cap;
+        }
+    }
+    char* copy = strdup(path);
+    if (copy && g_module_count < g_module_cap) {
+        Module* m = &g_modules[g_module_count];
+        memset(m, 0, sizeof(*m));
+        m->path = copy;
+        const char* slash = strrchr(copy, '/');
+        m->name = slash ? slash + 1 : copy;
+        m->base = base;
+        m->offset = offset;
+        m->readable = readable;
+        id = g_module_count++;
+    } else {
+        free(copy);
+    }
+
+    pthread_mutex_unlock(&g_module_lock);
+    return id;
+}
+
+// The module a region belongs to starts at the lowest mapping of the same
+// file with a smaller offset. Loaders leave PROT_NONE anonymous gaps
+// between segments, so those don't end the walk.
+static int find_module(uintptr_t pc) {
+    const MapsIndex* maps = maps_acquire();
+    if (!maps) return -1;
+
+    int id = -1;
+    const MapRegion* r = maps_lookup(maps, pc);
+    if (r && r->path_id) {
+        int first = (int)(r - maps->regions);
+        for (int j = first - 1; j >= 0; j--) {
+            const MapRegion* prev = &maps->regions[j];
+            if (prev->path_id == r->path_id) {
+                if (prev->offset > maps->regions[first].offset) break;
+                first = j;
+            } else if (prev->path_id != 0 || (prev->perms & (MAPS_PERM_R | MAPS_PERM_W | MAPS_PERM_X))) {
+                break;
+            }
+        }
+        const MapRegion* head = &maps->regions[first];
+        id = module_intern(maps_region_path(maps, head), head->start, head->offset,
+                           (head->perms & MAPS_PERM_R) != 0);
+    }
+
+    maps_release(maps);
+    return id;
+}
+
+// Plain files go through the path (gets .symtab too); APK-embedded
+// libraries and [vdso] only through the loaded image. The ELF is parsed
+// without g_module_lock, which every lookup takes; a racing thread
+// gets the same index back from symindex and only the first store wins.
+static const SymIndex* module_syms(int id) {
+    pthread_mutex_lock(&g_module_lock);
+    Module m = g_modules[id];
+    pthread_mutex_unlock(&g_module_lock);
+    if (m.syms_loaded) return m.syms;
+
+    const SymIndex* syms = NULL;
+    bool elf_image = m.readable && memcmp((const void*)m.base, ELFMAG, SELFMAG) == 0;
+    if (m.offset == 0 && m.path[0] == '/' && (elf_image || !m.readable)) {
+        syms = symindex_get_path(m.path, m.base);
+    }
+    if (!syms && elf_image) {
+        syms = symindex_get_image(m.base);
+    }
+
+    pthread_mutex_lock(&g_module_lock);
+    Module* slot = &g_modules[id];
+    if (!slot->syms_loaded) {
+        slot->syms = syms;
+        slot->syms_loaded = true;
+    }
+    syms = slot->syms;
+    pthread_mutex_unlock(&g_module_lock);
+    return syms;
+}
+
+static void resolve_symbol(CacheEntry* e) {
+    e->resolved = true;
+    e->symbol = NULL;
+    e->symbol_addr = 0;
+    if (e->module_id < 0) return;
+
+    const SymIndex* syms = module_syms(e->module_id);
+    if (!syms) return;
+
+    uintptr_t bias = symindex_load_bias(syms);
+    SymInfo sym;
+    if (!symindex_find_addr(syms, e->pc - bias, &sym)) return;
+
+    // Same rule as dladdr: a sized symbol has to cover the pc.
+    uint64_t delta = (e->pc - bias) - sym.value;
+    if (sym.size ? delta >= sym.size : delta != 0) return;
+
+    e->symbol = sym.name;
+    e->symbol_addr = bias + sym.value;
+}
+
+static bool lookup(uintptr_t pc, bool want_symbol, SymbolizedPC* out) {
+    CacheEntry e;
+    if (!cache_get(pc, want_symbol, &e)) {
+        memset(&e, 0, sizeof(e));
+        e.pc = pc;
+        e.module_id = find_module(pc);
+        if (want_symbol) resolve_symbol(&e);
+        cache_put(&e);
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->pc = pc;
+    out->module_id = e.module_id;
+    if (e.module_id < 0) return false;
+
+    pthread_mutex_lock(&g_module_lock);
+    const Module* m = &g_modules[e.module_id];
+    out->name = m->name;
+    out->path = m->path;
+    out->base = m->base;
+    pthread_mutex_unlock(&g_module_lock);
+
+    out->symbol = e.symbol;
+    out->symbol_addr = e.symbol_addr;
+    return true;
+}
+
+bool symbolize_pc(uintptr_t pc, SymbolizedPC* out) {
+    return lookup(pc, true, out);
+}
+
+bool symbolize_pc_module(uintptr_t pc, SymbolizedPC* out) {
+    return lookup(pc, false, out);
+}
+
+int symbolize_module_count(void) {
+    pthread_mutex_lock(&g_module_lock);
+    int count = g_module_count;
+    pthread_mutex_unlock(&g_module_lock);
+    return count;
+}
+
+bool symbolize_module(int id, SymModule* out) {
+    bool ok = false;
+    pthread_mutex_lock(&g_module_lock);
+    if (id >= 0 && id < g_module_count) {
+        out->name = g_modules[id].name;
+        out->path = g_modules[id].path;
+        out->base = g_modules[id].base;
+        ok = true;
+    }
+    pthread_mutex_unlock(&g_module_lock);
+    return ok;
+}
@@ -0,0 +1,509 @@
+#include <agent/symindex.h>
+#include <agent/elf_hash.h>
+#include <agent/proc.h>
+#include <agent/globals.h>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef NT_GNU_BUILD_ID
+#define NT_GNU_BUILD_ID 3
+#endif
+
+// Symbol references carry the table in the top bit.
+#define REF_STATIC      0x80000000u
+#define REF_INDEX(r)    ((r) & ~REF_STATIC)
+
+typedef struct {
+    uint32_t hash;
+    uint32_t ref;
+} NameEntry;
+
+typedef struct {
+    uint64_t value;
+    uint32_t ref;
+} AddrEntry;
+
+struct SymIndex {
+    char path[256];
+    char key[80];
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    uintptr_t load_addr;
+    uintptr_t load_bias;
+
+    // Tables read from the file. Copies rather than a mapping, so the
+    // index doesn't show up as a second mapping of the library in maps.
+    void* blobs[6];
+    int nblobs;
+    bool from_file;
+
+    const Elf64_Sym* dynsym;
+    const char* dynstr;
+    uint64_t dynstrsz;
+    uint32_t ndynsym;
+    const uint32_t* gnu_hash;
+    const uint32_t* sysv_hash;
+
+    const Elf64_Sym* symtab;
+    const char* strtab;
+    uint64_t strtabsz;
+    uint32_t nsymtab;
+
+    NameEntry* by_name;         // .symtab, plus .dynsym when it has no hash table
+    uint32_t nby_name;
+    AddrEntry* by_addr;         // defined symbols of both tables
+    uint32_t nby_addr;
+
+    SymIndex* next;
+};
+
+static pthread_mutex_t g_symindex_lock = PTHREAD_MUTEX_INITIALIZER;
+static SymIndex* g_indexes = NULL;
+
+static const Elf64_Sym* ref_sym(const SymIndex* idx, uint32_t ref) {
+    return (ref & REF_STATIC) ? &idx->symtab[REF_INDEX(ref)] : &idx->dynsym[ref];
+}
+
+static const char* ref_name(const SymIndex* idx, uint32_t ref) {
+    const Elf64_Sym* sym = ref_sym(idx, ref);
+    bool is_static = ref & REF_STATIC;
+    if (sym->st_name >= (is_static ? idx->strtabsz : idx->dynstrsz)) return "";
+    return (is_static ? idx->strtab : idx->dynstr) + sym->st_name;
+}
+
+static void fill_info(const SymIndex* idx, uint32_t ref, SymInfo* out) {
+    const Elf64_Sym* sym = ref_sym(idx, ref);
+    out->name = ref_name(idx, ref);
+    out->value = sym->st_value;
+    out->size = sym->st_size;
+    out->type = ELF64_ST_TYPE(sym->st_info);
+    out->bind = ELF64_ST_BIND(sym->st_info);
+    out->dynamic = !(ref & REF_STATIC);
+    out->defined = sym->st_shndx != SHN_UNDEF;
+}
+
+static bool indexable(const Elf64_Sym* sym, uint64_t strsz) {
+    unsigned char type = ELF64_ST_TYPE(sym->st_info);
+    return sym->st_name != 0 && sym->st_name < strsz && sym->st_value != 0 && sym->st_shndx != SHN_UNDEF &&
+           (type == STT_FUNC || type == STT_OBJECT || type == STT_NOTYPE || type == STT_GNU_IFUNC);
+}
+
+static int compare_name(const void* a, const void* b) {
+    const NameEntry* x = (const NameEntry*)a;
+    const NameEntry* y = (const NameEntry*)b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return x->ref < y->ref ? -1 : x->ref > y->ref;
+}
+
+// Equal addresses keep .dynsym names first; they're the ones users know.
+static int compare_addr(const void* a, const void* b) {
+    const AddrEntry* x = (const AddrEntry*)a;
+    const AddrEntry* y = (const AddrEntry*)b;
+    if (x->value != y->value) return x->value < y->value ? -1 : 1;
+    return x->ref < y->ref ? -1 : x->ref > y->ref;
+}
+
+static bool build_tables(SymIndex* idx) {
+    bool hash_dynsym = !idx->gnu_hash && !idx->sysv_hash;
+    uint32_t nnames = idx->nsymtab + (hash_dynsym ? idx->ndynsym : 0);
+
+    idx->by_name = (NameEntry*)malloc((nnames ? nnames : 1) * sizeof(NameEntry));
+    idx->by_addr = (AddrEntry*)malloc((idx->ndynsym + idx->nsymtab + 1) * sizeof(AddrEntry));
+    if (!idx->by_name || !idx->by_addr) return false;
+
+    for (uint32_t i = 0; i < idx->ndynsym; i++) {
+        const Elf64_Sym* sym = &idx->dynsym[i];
+        if (!indexable(sym, idx->dynstrsz)) continue;
+        if (hash_dynsym) {
+            idx->by_name[idx->nby_name++] = (NameEntry){elf_gnu_hash(idx->dynstr + sym->st_name), i};
+        }
+        idx->by_addr[idx->nby_addr++] = (AddrEntry){sym->st_value, i};
+    }
+    for (uint32_t i = 0; i < idx->nsymtab; i++) {
+        const Elf64_Sym* sym = &idx->symtab[i];
+        if (!indexable(sym, idx->strtabsz)) continue;
+        idx->by_name[idx->nby_name++] = (NameEntry){elf_gnu_hash(idx->strtab + sym->st_name), i | REF_STATIC};
+        idx->by_addr[idx->nby_addr++] = (AddrEntry){sym->st_value, i | REF_STATIC};
+    }
+
+    qsort(idx->by_name, idx->nby_name, sizeof(NameEntry), compare_name);
+    qsort(idx->by_addr, idx->nby_addr, sizeof(AddrEntry), compare_addr);
+    return true;
+}
+
+static void set_build_id(SymIndex* idx, const uint8_t* note, size_t size) {
+    size_t pos = 0;
+    while (pos + sizeof(Elf64_Nhdr) <= size) {
+        const Elf64_Nhdr* nhdr = (const Elf64_Nhdr*)(note + pos);
+        size_t name_off = pos + sizeof(Elf64_Nhdr);
+        size_t desc_off = name_off + ((nhdr->n_namesz + 3) & ~3u);
+        size_t next = desc_off + ((nhdr->n_descsz + 3) & ~3u);
+        if (next > size) break;
+
+        if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+            memcmp(note + name_off, "GNU", 4) == 0) {
+            size_t len = 0;
+            for (uint32_t i = 0; i < nhdr->n_descsz && len + 3 < sizeof(idx->key); i++) {
+                len += snprintf(idx->key + len, sizeof(idx->key) - len, "%02x", note[desc_off + i]);
+            }
+            return;
+        }
+        pos = next;
+    }
+}
+
+static uintptr_t first_load_vaddr(const Elf64_Phdr* phdr, int phnum) {
+    for (int i = 0; i < phnum; i++) {
+        if (phdr[i].p_type == PT_LOAD) return phdr[i].p_vaddr;
+    }
+    return 0;
+}
+
+static void* read_blob(SymIndex* idx, int fd, uint64_t offset, uint64_t size) {
+    if (size == 0 || size > ((uint64_t)1 << 30) || idx->nblobs == (int)(sizeof(idx->blobs) / sizeof(idx->blobs[0]))) {
+        return NULL;
+    }
+    void* buf = malloc(size);
+    if (!buf) return NULL;
+    if (pread(fd, buf, size, offset) != (ssize_t)size) {
+        free(buf);
+        return NULL;
+    }
+    idx->blobs[idx->nblobs++] = buf;
+    return buf;
+}
+
+// Names that point past the string table are cleared, so neither the
+// sorted tables nor the hash lookups ever read outside it.
+static bool read_table(SymIndex* idx, int fd, const Elf64_Shdr* shdr, int shnum, int i,
+                       const Elf64_Sym** syms, uint32_t* count, const char** strings, uint64_t* strsz) {
+    const Elf64_Shdr* s = &shdr[i];
+    if (s->sh_link >= (uint32_t)shnum) return false;
+    const Elf64_Shdr* link = &shdr[s->sh_link];
+
+    Elf64_Sym* table = (Elf64_Sym*)read_blob(idx, fd, s->sh_offset, s->sh_size);
+    *strings = (const char*)read_blob(idx, fd, link->sh_offset, link->sh_size);
+    if (!table || !*strings || (*strings)[link->sh_size - 1] != '\0') {
+        *syms = NULL;
+        *strings = NULL;
+        return false;
+    }
+    *count = s->sh_size / sizeof(Elf64_Sym);
+    uint32_t bad = 0;
+    for (uint32_t j = 0; j < *count; j++) {
+        if (table[j].st_name >= link->sh_size) {
+            table[j].st_name = 0;
+            bad++;
+        }
+    }
+    if (bad) {
+        LOGW("symindex: %s: %u symbol name(s) outside the string table", idx->path, bad);
+    }
+    *syms = table;
+    *strsz = link->sh_size;
+    return true;
+}
+
+static bool load_file(SymIndex* idx) {
+    int fd = open(idx->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("symindex: cannot open %s", idx->path);
+        return false;
+    }
+
+    struct stat st;
+    Elf64_Ehdr ehdr;
+    if (fstat(fd, &st) < 0 || pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) ||
+        memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 || ehdr.e_ident[EI_CLASS] != ELFCLASS64) {
+        LOGE("symindex: %s is not a 64-bit ELF", idx->path);
+        close(fd);
+        return false;
+    }
+    idx->from_file = true;
+    idx->dev = st.st_dev;
+    idx->ino = st.st_ino;
+    idx->mtime = st.st_mtime;
+
+    Elf64_Phdr* phdr = (Elf64_Phdr*)malloc(ehdr.e_phnum * sizeof(Elf64_Phdr) + 1);
+    if (phdr && pread(fd, phdr, ehdr.e_phnum * sizeof(Elf64_Phdr), ehdr.e_phoff) ==
+                    (ssize_t)(ehdr.e_phnum * sizeof(Elf64_Phdr))) {
+        idx->load_bias = idx->load_addr - first_load_vaddr(phdr, ehdr.e_phnum);
+        for (int i = 0; i < ehdr.e_phnum && !idx->key[0]; i++) {
+            if (phdr[i].p_type != PT_NOTE || phdr[i].p_filesz > 4096) continue;
+            uint8_t note[4096];
+            if (pread(fd, note, phdr[i].p_filesz, phdr[i].p_offset) == (ssize_t)phdr[i].p_filesz) {
+                set_build_id(idx, note, phdr[i].p_filesz);
+            }
+        }
+    }
+    free(phdr);
+
+    Elf64_Shdr* shdr = (Elf64_Shdr*)malloc(ehdr.e_shnum * sizeof(Elf64_Shdr) + 1);
+    if (!shdr || ehdr.e_shnum == 0 ||
+        pread(fd, shdr, ehdr.e_shnum * sizeof(Elf64_Shdr), ehdr.e_shoff) != (ssize_t)(ehdr.e_shnum * sizeof(Elf64_Shdr))) {
+        LOGE("symindex: %s has no section headers", idx->path);
+        free(shdr);
+        close(fd);
+        return false;
+    }
+
+    for (int i = 0; i < ehdr.e_shnum; i++) {
+        switch (shdr[i].sh_type) {
+        case SHT_DYNSYM:
+            if (!idx->dynsym) read_table(idx, fd, shdr, ehdr.e_shnum, i, &idx->dynsym, &idx->ndynsym, &idx->dynstr, &idx->dynstrsz);
+            break;
+        case SHT_SYMTAB:
+            if (!idx->symtab) read_table(idx, fd, shdr, ehdr.e_shnum, i, &idx->symtab, &idx->nsymtab, &idx->strtab, &idx->strtabsz);
+            break;
+        case SHT_GNU_HASH:
+            if (!idx->gnu_hash) idx->gnu_hash = (const uint32_t*)read_blob(idx, fd, shdr[i].sh_offset, shdr[i].sh_size);
+            break;
+        case SHT_HASH:
+            if (!idx->sysv_hash) idx->sysv_hash = (const uint32_t*)read_blob(idx, fd, shdr[i].sh_offset, shdr[i].sh_size);
+            break;
+        }
+    }
+    free(shdr);
+    close(fd);
+
+    if (!idx->dynsym) {
+        idx->gnu_hash = idx->sysv_hash = NULL;
+    }
+    if (!idx->key[0]) {
+        snprintf(idx->key, sizeof(idx->key), "i%lu-%ld", (unsigned long)idx->ino, (long)idx->mtime);
+    }
+    return idx->dynsym || idx->symtab;
+}
+
+// Only what PT_DYNAMIC describes is mapped, so there's no .symtab here.
+static bool load_image(SymIndex* idx) {
+    uintptr_t base = idx->load_addr;
+    const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)base;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
+        LOGW("symindex: bad ELF magic at 0x%lx", (unsigned long)base);
+        return false;
+    }
+
+    const Elf64_Phdr* phdr = (const Elf64_Phdr*)(base + ehdr->e_phoff);
+    idx->load_bias = base - first_load_vaddr(phdr, ehdr->e_phnum);
+
+    const Elf64_Dyn* dynamic = NULL;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == PT_DYNAMIC) {
+            dynamic = (const Elf64_Dyn*)(idx->load_bias + phdr[i].p_vaddr);
+        } else if (phdr[i].p_type == PT_NOTE && !idx->key[0]) {
+            set_build_id(idx, (const uint8_t*)(idx->load_bias + phdr[i].p_vaddr), phdr[i].p_memsz);
+        }
+    }
+    if (!dynamic) {
+        LOGW("symindex: no PT_DYNAMIC at 0x%lx", (unsigned long)base);
+        return false;
+    }
+
+    // Some loaders relocate the dynamic section in place, some don't.
+    uintptr_t dyn_bias = idx->load_bias;
+    for (const Elf64_Dyn* d = dynamic; d->d_tag != DT_NULL; d++) {
+        if (d->d_tag == DT_SYMTAB || d->d_tag == DT_STRTAB) {
+            if (d->d_un.d_ptr >= base) dyn_bias = 0;
+            break;
+        }
+    }
+
+    for (const Elf64_Dyn* d = dynamic; d->d_tag != DT_NULL; d++) {
+        switch (d->d_tag) {
+        case DT_SYMTAB: idx->dynsym = (const Elf64_Sym*)(dyn_bias + d->d_un.d_ptr); break;
+        case DT_STRTAB: idx->dynstr = (const char*)(dyn_bias + d->d_un.d_ptr); break;
+        case DT_STRSZ: idx->dynstrsz = d->d_un.d_val; break;
+        case DT_GNU_HASH: idx->gnu_hash = (const uint32_t*)(dyn_bias + d->d_un.d_ptr); break;
+        case DT_HASH: idx->sysv_hash = (const uint32_t*)(dyn_bias + d->d_un.d_ptr); break;
+        }
+    }
+    if (!idx->dynsym || !idx->dynstr || !idx->dynstrsz || (!idx->gnu_hash && !idx->sysv_hash)) {
+        LOGW("symindex: image at 0x%lx has no usable dynamic symbol table", (unsigned long)base);
+        return false;
+    }
+
+    idx->ndynsym = idx->sysv_hash ? idx->sysv_hash[1] : elf_gnu_symbol_count(idx->gnu_hash);
+    if (!idx->key[0]) {
+        snprintf(idx->key, sizeof(idx->key), "m%lx", (unsigned long)base);
+    }
+    return true;
+}
+
+static void index_free(SymIndex* idx) {
+    for (int i = 0; i < idx->nblobs; i++) {
+        free(idx->blobs[i]);
+    }
+    free(idx->by_name);
+    free(idx->by_addr);
+    free(idx);
+}
+
+static bool still_valid(const SymIndex* idx, const struct stat* st, uintptr_t load_addr) {
+    return idx->load_addr == load_addr &&
+           (!idx->from_file || (idx->dev == st->st_dev && idx->ino == st->st_ino && idx->mtime == st->st_mtime));
+}
+
+// Indexes are never freed once published, so callers can keep pointers.
+// A stale entry stays on the list behind its replacement.
+static const SymIndex* get_index(const char* path, uintptr_t load_addr) {
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    if (path && stat(path, &st) < 0) return NULL;
+
+    pthread_mutex_lock(&g_symindex_lock);
+    for (SymIndex* idx = g_indexes; idx; idx = idx->next) {
+        bool same = path ? (idx->from_file && strcmp(idx->path, path) == 0)
+                         : (!idx->from_file && idx->load_addr == load_addr);
+        if (same && still_valid(idx, &st, load_addr)) {
+            pthread_mutex_unlock(&g_symindex_lock);
+            return idx;
+        }
+    }
+
+    SymIndex* idx = (SymIndex*)calloc(1, sizeof(SymIndex));
+    bool ok = false;
+    if (idx) {
+        idx->load_addr = load_addr;
+        if (path) {
+            snprintf(idx->path, sizeof(idx->path), "%s", path);
+            ok = load_file(idx);
+        } else {
+            snprintf(idx->path, sizeof(idx->path), "[image 0x%lx]", (unsigned long)load_addr);
+            ok = load_image(idx);
+        }
+        ok = ok && build_tables(idx);
+    }
+
+    if (ok) {
+        idx->next = g_indexes;
+        g_indexes = idx;
+        verbose_log("symindex: %s: %u dynamic, %u static symbols (key %s)",
+                    idx->path, idx->ndynsym, idx->nsymtab, idx->key);
+    } else if (idx) {
+        index_free(idx);
+        idx = NULL;
+    }
+    pthread_mutex_unlock(&g_symindex_lock);
+    return idx;
+}
+
+const SymIndex* symindex_get_path(const char* path, uintptr_t load_addr) {
+    return path ? get_index(path, load_addr) : NULL;
+}
+
+const SymIndex* symindex_get_image(uintptr_t base) {
+    return base ? get_index(NULL, base) : NULL;
+}
+
+// APK-embedded libraries ("base.apk!/lib/...") can't be opened by path.
+const SymIndex* symindex_get(const char* lib_name) {
+    uintptr_t base = (uintptr_t)find_library_base(lib_name);
+    if (!base) return NULL;
+
+    char* path = find_library_path(lib_name);
+    const SymIndex* idx = NULL;
+    if (path && !strchr(path, '!')) {
+        idx = get_index(path, base);
+    }
+    if (!idx) {
+        idx = get_index(NULL, base);
+    }
+    free(path);
+    return idx;
+}
+
+static bool find_sorted(const SymIndex* idx, const char* name, bool dynamic, SymInfo* out) {
+    uint32_t h = elf_gnu_hash(name);
+    uint32_t lo = 0, hi = idx->nby_name;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (idx->by_name[mid].hash < h) lo = mid + 1;
+        else hi = mid;
+    }
+    for (uint32_t i = lo; i < idx->nby_name && idx->by_name[i].hash == h; i++) {
+        uint32_t ref = idx->by_name[i].ref;
+        if (!(ref & REF_STATIC) != dynamic) continue;
+        if (strcmp(ref_name(idx, ref), name) == 0) {
+            fill_info(idx, ref, out);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool symindex_find(const SymIndex* idx, const char* name, SymInfo* out) {
+    if (!idx || !name) return false;
+
+    if (idx->dynsym) {
+        long i = -1;
+        if (idx->gnu_hash) {
+            i = elf_gnu_lookup(idx->gnu_hash, idx->dynsym, idx->dynstr, name);
+        } else if (idx->sysv_hash) {
+            i = elf_sysv_lookup(idx->sysv_hash, idx->dynsym, idx->dynstr, name);
+        } else if (find_sorted(idx, name, true, out)) {
+            return true;
+        }
+        if (i >= 0 && idx->dynsym[i].st_value != 0) {
+            fill_info(idx, (uint32_t)i, out);
+            return true;
+        }
+    }
+    return find_sorted(idx, name, false, out);
+}
+
+bool symindex_find_addr(const SymIndex* idx, uint64_t value, SymInfo* out) {
+    if (!idx || idx->nby_addr == 0 || value < idx->by_addr[0].value) return false;
+
+    // Last entry <= value, then back up to the first of its address.
+    uint32_t lo = 0, hi = idx->nby_addr;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (idx->by_addr[mid].value <= value) lo = mid;
+        else hi = mid;
+    }
+    uint64_t found = idx->by_addr[lo].value;
+    while (lo > 0 && idx->by_addr[lo - 1].value == found) lo--;
+
+    // A sized symbol that covers value beats an unsized one at the same address.
+    uint32_t best = lo;
+    for (uint32_t i = lo; i < idx->nby_addr && idx->by_addr[i].value == found; i++) {
+        if (ref_sym(idx, idx->by_addr[i].ref)->st_size > value - found) {
+            best = i;
+            break;
+        }
+    }
+    fill_info(idx, idx->by_addr[best].ref, out);
+    return true;
+}
+
+size_t symindex_count(const SymIndex* idx, bool dynamic) {
+    if (!idx) return 0;
+    return dynamic ? idx->ndynsym : idx->nsymtab;
+}
+
+bool symindex_entry(const SymIndex* idx, bool dynamic, size_t i, SymInfo* out) {
+    if (i >= symindex_count(idx, dynamic)) return false;
+    fill_info(idx, dynamic ? (uint32_t)i : ((uint32_t)i | REF_STATIC), out);
+    return true;
+}
+
+uintptr_t symindex_load_bias(const SymIndex* idx) {
+    return idx ? idx->load_bias : 0;
+}
+
+const char* symindex_path(const SymIndex* idx) {
+    return idx ? idx->path : "";
+}
+
+const char* symindex_key(const SymIndex* idx) {
+    return idx ? idx->key : "";
+}
@@ -0,0 +1,546 @@
+#include <agent/valscan.h>
+#include <agent/scan.h>
+#include <agent/globals.h>
+#include <agent/maps.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#define VS_WINDOW       (1024 * 1024)
+#define VS_MAX_REGION   ((uintptr_t)1 << 32)    // slots are stored as uint32
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    char path[128];
+    size_t nslots;          // aligned positions a whole value fits at
+    size_t count;
+
+    // Dense: bitmap over slots (+ per-slot values unless the session is
+    // uniform). Sparse: sorted slot list (+ values). Never both.
+    uint64_t* bits;
+    uint8_t* snapshot;
+    uint32_t* offs;
+    uint64_t* vals;
+    size_t cap;
+} VsRegion;
+
+typedef struct {
+    ValueType type;
+    size_t size;
+    size_t align;
+    bool uniform;           // every candidate held uniform_val at the last scan
+    uint64_t uniform_val;
+    VsRegion* regions;
+    int nregions;
+    size_t total;
+    int scans;
+} VsSession;
+
+typedef struct {
+    VsSession* s;
+    ValueOp op;
+    uint64_t a;
+    uint64_t b;
+    bool first;
+    bool keep_values;
+    VsRegion* out;
+    int next;               // next region to claim
+} VsPass;
+
+static VsSession g_vs;
+static pthread_mutex_t g_vs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const struct {
+    const char* name;
+    ValueType type;
+    size_t size;
+} k_types[] = {
+    {"u8", VS_U8, 1}, {"u16", VS_U16, 2}, {"u32", VS_U32, 4}, {"u64", VS_U64, 8},
+    {"i8", VS_I8, 1}, {"i16", VS_I16, 2}, {"i32", VS_I32, 4}, {"i64", VS_I64, 8},
+    {"f32", VS_F32, 4}, {"f64", VS_F64, 8},
+};
+
+static const char* k_ops[] = {
+    "eq", "ne", "gt", "lt", "range", "changed", "unchanged", "increased", "decreased"
+};
+
+static size_t type_size(ValueType type) {
+    return k_types[type].size;
+}
+
+bool valscan_parse_type(const char* name, ValueType* type, size_t* align) {
+    for (size_t i = 0; i < sizeof(k_types) / sizeof(k_types[0]); i++) {
+        size_t len = strlen(k_types[i].name);
+        if (strncmp(name, k_types[i].name, len) != 0) continue;
+
+        *type = k_types[i].type;
+        *align = k_types[i].size;
+        if (name[len] == ':') {
+            long a = strtol(name + len + 1, NULL, 10);
+            if (a <= 0 || a > 8) return false;
+            *align = (size_t)a;
+        } else if (name[len] != '\0') {
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+const char* valscan_type_name(ValueType type) {
+    return k_types[type].name;
+}
+
+bool valscan_parse_op(const char* name, ValueOp* op) {
+    for (size_t i = 0; i < sizeof(k_ops) / sizeof(k_ops[0]); i++) {
+        // Accept unambiguous prefixes: "inc", "dec", "unch", ...
+        if (strncmp(name, k_ops[i], strlen(name)) == 0 && strlen(name) >= 2) {
+            *op = (ValueOp)i;
+            return true;
+        }
+    }
+    if (strcmp(name, "==") == 0) { *op = VS_EQ; return true; }
+    if (strcmp(name, "!=") == 0) { *op = VS_NE; return true; }
+    if (strcmp(name, ">") == 0) { *op = VS_GT; return true; }
+    if (strcmp(name, "<") == 0) { *op = VS_LT; return true; }
+    return false;
+}
+
+uint64_t valscan_encode(ValueType type, double number, int64_t integer, bool is_integer) {
+    uint64_t raw = 0;
+    switch (type) {
+    case VS_F32: {
+        float f = is_integer ? (float)integer : (float)number;
+        memcpy(&raw, &f, sizeof(f));
+        return raw;
+    }
+    case VS_F64: {
+        double d = is_integer ? (double)integer : number;
+        memcpy(&raw, &d, sizeof(d));
+        return raw;
+    }
+    default: {
+        int64_t v = is_integer ? integer : (int64_t)number;
+        size_t size = type_size(type);
+        raw = (uint64_t)v;
+        return size == 8 ? raw : raw & (((uint64_t)1 << (size * 8)) - 1);
+    }
+    }
+}
+
+static inline int64_t as_signed(ValueType type, uint64_t v) {
+    switch (type) {
+    case VS_I8:  return (int8_t)v;
+    case VS_I16: return (int16_t)v;
+    case VS_I32: return (int32_t)v;
+    default:     return (int64_t)v;
+    }
+}
+
+void valscan_format(ValueType type, uint64_t raw, char* buf, size_t size) {
+    switch (type) {
+    case VS_F32: {
+        float f;
+        uint32_t bits = (uint32_t)raw;
+        memcpy(&f, &bits, sizeof(f));
+        snprintf(buf, size, "%.9g", f);
+        break;
+    }
+    case VS_F64: {
+        double d;
+        memcpy(&d, &raw, sizeof(d));
+        snprintf(buf, size, "%.17g", d);
+        break;
+    }
+    case VS_I8: case VS_I16: case VS_I32: case VS_I64:
+        snprintf(buf, size, "%lld", (long long)as_signed(type, raw));
+        break;
+    default:
+        snprintf(buf, size, "%llu", (unsigned long long)raw);
+        break;
+    }
+}
+
+// -1 / 0 / 1, or 2 when unordered (NaN)
+static inline int compare(ValueType type, uint64_t x, uint64_t y) {
+    switch (type) {
+    case VS_F32: {
+        float fx, fy;
+        uint32_t bx = (uint32_t)x, by = (uint32_t)y;
+        memcpy(&fx, &bx, sizeof(fx));
+        memcpy(&fy, &by, sizeof(fy));
+        return fx < fy ? -1 : fx > fy ? 1 : fx == fy ? 0 : 2;
+    }
+    case VS_F64: {
+        double dx, dy;
+        memcpy(&dx, &x, sizeof(dx));
+        memcpy(&dy, &y, sizeof(dy));
+        return dx < dy ? -1 : dx > dy ? 1 : dx == dy ? 0 : 2;
+    }
+    case VS_I8: case VS_I16: case VS_I32: case VS_I64: {
+        int64_t sx = as_signed(type, x), sy = as_signed(type, y);
+        return sx < sy ? -1 : sx > sy;
+    }
+    default:
+        return x < y ? -1 : x > y;
+    }
+}
+
+static inline bool test(const VsPass* p, uint64_t cur, uint64_t prev) {
+    ValueType t = p->s->type;
+    switch (p->op) {
+    case VS_EQ:        return compare(t, cur, p->a) == 0;
+    case VS_NE:        return compare(t, cur, p->a) != 0;
+    case VS_GT:        return compare(t, cur, p->a) == 1;
+    case VS_LT:        return compare(t, cur, p->a) == -1;
+    case VS_RANGE: {
+        int lo = compare(t, cur, p->a), hi = compare(t, cur, p->b);
+        return (lo == 0 || lo == 1) && (hi == 0 || hi == -1);
+    }
+    case VS_CHANGED:   return cur != prev;
+    case VS_UNCHANGED: return cur == prev;
+    case VS_INCREASED: return compare(t, cur, prev) == 1;
+    case VS_DECREASED: return compare(t, cur, prev) == -1;
+    }
+    return false;
+}
+
+static inline uint64_t load(const uint8_t* p, size_t size) {
+    uint64_t v = 0;
+    memcpy(&v, p, size);    // little-endian targets only
+    return v;
+}
+
+static void region_free(VsRegion* r) {
+    free(r->bits);
+    free(r->snapshot);
+    free(r->offs);
+    free(r->vals);
+    r->bits = NULL;
+    r->snapshot = NULL;
+    r->offs = NULL;
+    r->vals = NULL;
+    r->count = r->cap = 0;
+}
+
+static size_t dense_bytes(const VsRegion* r, bool keep_values, size_t size) {
+    return (r->nslots + 63) / 64 * 8 + (keep_values ? r->nslots * size : 0);
+}
+
+static bool to_dense(VsRegion* r, bool keep_values, size_t size) {
+    r->bits = calloc((r->nslots + 63) / 64, sizeof(uint64_t));
+    if (!r->bits) return false;
+    if (keep_values) {
+        r->snapshot = malloc(r->nslots * size);
+        if (!r->snapshot) return false;
+    }
+    for (size_t k = 0; k < r->count; k++) {
+        size_t slot = r->offs[k];
+        r->bits[slot / 64] |= (uint64_t)1 << (slot % 64);
+        if (keep_values) memcpy(r->snapshot + slot * size, &r->vals[k], size);
+    }
+    free(r->offs);
+    free(r->vals);
+    r->offs = NULL;
+    r->vals = NULL;
+    r->cap = 0;
+    return true;
+}
+
+// Append a survivor; switches the region to a bitmap once the list would
+// take more memory than one.
+static bool region_add(VsRegion* r, size_t slot, uint64_t value, bool keep_values, size_t size) {
+    if (!r->bits) {
+        size_t list_bytes = (r->count + 1) * (4 + (keep_values ? 8 : 0));
+        if (list_bytes > dense_bytes(r, keep_values, size)) {
+            if (!to_dense(r, keep_values, size)) return false;
+        } else {
+            if (r->count == r->cap) {
+                size_t cap = r->cap ? r->cap * 2 : 256;
+                uint32_t* offs = realloc(r->offs, cap * sizeof(uint32_t));
+                if (!offs) return false;
+                r->offs = offs;
+                if (keep_values) {
+                    uint64_t* vals = realloc(r->vals, cap * sizeof(uint64_t));
+                    if (!vals) return false;
+                    r->vals = vals;
+                }
+                r->cap = cap;
+            }
+            r->offs[r->count] = (uint32_t)slot;
+            if (keep_values) r->vals[r->count] = value;
+            r->count++;
+            return true;
+        }
+    }
+
+    r->bits[slot / 64] |= (uint64_t)1 << (slot % 64);
+    if (keep_values) memcpy(r->snapshot + slot * size, &value, size);
+    r->count++;
+    return true;
+}
+
+// Candidates of the previous scan, in slot order
+typedef struct {
+    const VsSession* s;
+    const VsRegion* r;
+    bool all;
+    size_t k;               // next slot (all, dense) or list index (sparse)
+} VsIter;
+
+// Next candidate slot without consuming it; nslots when there is none
+static size_t iter_peek(const VsIter* it) {
+    const VsRegion* r = it->r;
+    if (it->all) return it->k;
+
+    if (r->bits) {
+        size_t k = it->k;
+        while (k < r->nslots) {
+            uint64_t word = r->bits[k / 64] >> (k % 64);
+            if (word) return k + __builtin_ctzll(word);
+            k = (k / 64 + 1) * 64;
+        }
+        return r->nslots;
+    }
+    return it->k < r->count ? r->offs[it->k] : r->nslots;
+}
+
+static bool iter_next(VsIter* it, size_t limit, size_t* slot, uint64_t* prev) {
+    const VsRegion* r = it->r;
+    size_t size = it->s->size;
+
+    size_t k = iter_peek(it);
+    if (k >= limit || k >= r->nslots) return false;
+    *slot = k;
+
+    if (it->all) {
+        *prev = 0;
+        it->k = k + 1;
+    } else if (r->bits) {
+        *prev = it->s->uniform ? it->s->uniform_val : load(r->snapshot + k * size, size);
+        it->k = k + 1;
+    } else {
+        *prev = it->s->uniform ? it->s->uniform_val : r->vals[it->k];
+        it->k++;
+    }
+    return true;
+}
+
+static void region_pass(VsPass* p, const VsRegion* in, VsRegion* out, uint8_t* window) {
+    const VsSession* s = p->s;
+    size_t size = s->size, align = s->align;
+
+    memcpy(out, in, sizeof(*out));
+    out->bits = NULL;
+    out->snapshot = NULL;
+    out->offs = NULL;
+    out->vals = NULL;
+    out->count = out->cap = 0;
+
+    VsIter it = { s, in, p->first, 0 };
+    size_t per_window = VS_WINDOW / align;
+
+    // Windows start at the next candidate, so gaps between sparse
+    // candidates are never read
+    size_t s0;
+    while ((s0 = iter_peek(&it)) < in->nslots) {
+        size_t s1 = s0 + per_window < in->nslots ? s0 + per_window : in->nslots;
+        if (!in->bits && !p->first) {
+            size_t j = it.k;
+            while (j + 1 < in->count && in->offs[j + 1] < s1) j++;
+            s1 = in->offs[j] + 1;
+        }
+
+        uintptr_t from = in->start + s0 * align;
+        size_t len = (s1 - 1 - s0) * align + size;
+
+        struct iovec local = { window, len };
+        struct iovec remote = { (void*)from, len };
+        bool readable = syscall(__NR_process_vm_readv, getpid(), &local, 1, &remote, 1, 0) == (long)len;
+
+        size_t slot;
+        uint64_t prev;
+        while (iter_next(&it, s1, &slot, &prev)) {
+            if (!readable) continue;
+            uint64_t cur = load(window + (slot - s0) * align, size);
+            if (test(p, cur, prev) && !region_add(out, slot, cur, p->keep_values, size)) {
+                LOGE("valscan: out of memory in %s", in->path);
+                return;
+            }
+        }
+    }
+}
+
+static void* pass_worker(void* arg) {
+    VsPass* p = (VsPass*)arg;
+    uint8_t* window = malloc(VS_WINDOW + 8);
+    if (!window) return NULL;
+
+    int i;
+    while ((i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED)) < p->s->nregions) {
+        region_pass(p, &p->s->regions[i], &p->out[i], window);
+    }
+    free(window);
+    return NULL;
+}
+
+// Regions are independent, so spread them over the scan thread count
+static long run_pass(ValueOp op, uint64_t a, uint64_t b, bool first) {
+    VsSession* s = &g_vs;
+    // After an integer EQ every survivor holds exactly `a`; floats can
+    // compare equal with different bits (-0.0), so they keep their values
+    bool uniform = op == VS_EQ && s->type != VS_F32 && s->type != VS_F64;
+    VsPass pass = { s, op, a, b, first, !uniform, NULL, 0 };
+
+    pass.out = calloc(s->nregions ? s->nregions : 1, sizeof(VsRegion));
+    if (!pass.out) return -1;
+
+    int nthreads = scan_get_threads();
+    if (nthreads > s->nregions) nthreads = s->nregions;
+    pthread_t tids[SCAN_MAX_THREADS];
+    bool started[SCAN_MAX_THREADS] = {false};
+    for (int t = 1; t < nthreads; t++) {
+        started[t] = pthread_create(&tids[t], NULL, pass_worker, &pass) == 0;
+    }
+    pass_worker(&pass);
+    for (int t = 1; t < nthreads; t++) {
+        if (started[t]) pthread_join(tids[t], NULL);
+    }
+
+    s->total = 0;
+    for (int i = 0; i < s->nregions; i++) {
+        region_free(&s->regions[i]);
+        s->regions[i] = pass.out[i];
+        s->total += s->regions[i].count;
+    }
+    free(pass.out);
+
+    s->uniform = !pass.keep_values;
+    s->uniform_val = a;
+    s->scans++;
+    return (long)s->total;
+}
+
+static bool collect_writable(VsSession* s) {
+    const MapsIndex* maps = maps_acquire_fresh();
+    if (!maps) return false;
+
+    int cap = 0;
+    for (int i = 0; i < maps->count; i++) {
+        const MapRegion* m = &maps->regions[i];
+        const char* path = maps_region_path(maps, m);
+        uintptr_t start = m->start, end = m->end;
+        if ((m->perms & (MAPS_PERM_R | MAPS_PERM_W)) != (MAPS_PERM_R | MAPS_PERM_W)) continue;
+        if (strncmp(path, "/dev/", 5) == 0 && !strstr(path, "ashmem")) continue;
+        if (end - start < s->size) continue;
+        if (end - start > VS_MAX_REGION * s->align) end = start + VS_MAX_REGION * s->align;
+
+        if (s->nregions == cap) {
+            cap = cap ? cap * 2 : 256;
+            VsRegion* regions = realloc(s->regions, cap * sizeof(VsRegion));
+            if (!regions) break;
+            s->regions = regions;
+        }
+        VsRegion* r = &s->regions[s->nregions++];
+        memset(r, 0, sizeof(*r));
+        r->start = start;
+        r->end = end;
+        snprintf(r->path, sizeof(r->path), "%s", path);
+        r->nslots = (end - start - s->size) / s->align + 1;
+    }
+    maps_release(maps);
+    return s->nregions > 0;
+}
+
+static void session_free(VsSession* s) {
+    for (int i = 0; i < s->nregions; i++) {
+        region_free(&s->regions[i]);
+    }
+    free(s->regions);
+    memset(s, 0, sizeof(*s));
+}
+
+long valscan_first(ValueType type, size_t align, ValueOp op, uint64_t a, uint64_t b) {
+    if (VS_OP_NEEDS_PREVIOUS(op) || align == 0) return -1;
+
+    pthread_mutex_lock(&g_vs_lock);
+    session_free(&g_vs);
+    g_vs.type = type;
+    g_vs.size = type_size(type);
+    g_vs.align = align;
+
+    long count = -1;
+    if (collect_writable(&g_vs)) {
+        count = run_pass(op, a, b, true);
+        LOGI("valscan: first %s scan over %d regions: %ld candidates",
+             valscan_type_name(type), g_vs.nregions, count);
+    }
+    pthread_mutex_unlock(&g_vs_lock);
+    return count;
+}
+
+long valscan_next(ValueOp op, uint64_t a, uint64_t b) {
+    pthread_mutex_lock(&g_vs_lock);
+    long count = g_vs.scans > 0 ? run_pass(op, a, b, false) : -1;
+    pthread_mutex_unlock(&g_vs_lock);
+    return count;
+}
+
+size_t valscan_results(size_t offset, size_t max, ValueHit* out) {
+    pthread_mutex_lock(&g_vs_lock);
+    VsSession* s = &g_vs;
+    size_t n = 0;
+
+    for (int i = 0; i < s->nregions && n < max; i++) {
+        VsRegion* r = &s->regions[i];
+        if (offset >= r->count) {
+            offset -= r->count;
+            continue;
+        }
+
+        VsIter it = { s, r, false, 0 };
+        if (!r->bits) {
+            it.k = offset;
+            offset = 0;
+        }
+        size_t slot;
+        uint64_t prev;
+        while (n < max && iter_next(&it, r->nslots, &slot, &prev)) {
+            if (offset > 0) {
+                offset--;
+                continue;
+            }
+            out[n].addr = r->start + slot * s->align;
+            out[n].value = prev;
+            out[n].base = r->start;
+            snprintf(out[n].path, sizeof(out[n].path), "%s", r->path);
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&g_vs_lock);
+    return n;
+}
+
+size_t valscan_count(void) {
+    return __atomic_load_n(&g_vs.total, __ATOMIC_RELAXED);
+}
+
+int valscan_scans(void) {
+    return __atomic_load_n(&g_vs.scans, __ATOMIC_RELAXED);
+}
+
+ValueType valscan_type(void) {
+    return g_vs.type;
+}
+
+void valscan_reset(void) {
+    pthread_mutex_lock(&g_vs_lock);
+    session_free(&g_vs);
+    pthread_mutex_unlock(&g_vs_lock);
+}
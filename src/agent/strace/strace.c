@@ -2,10 +2,17 @@
 #include <agent/globals.h>
 #include <agent/proc.h>
 #include <agent/lua_thread.h>
+#include <agent/lua_dispatch.h>
+#include <agent/trace.h>
+#include <agent/output.h>
+#include <agent/stub_alloc.h>
+#include <agent/hook_table.h>
+#include <agent/rcu.h>
 
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 #include <dlfcn.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -62,17 +69,35 @@ static SyscallDef s_syscall_defs[] = {
     {NULL, NULL, NULL, 0, {0}, NULL}
 };
 
-StraceEntry g_strace_hooks[MAX_STRACE_HOOKS];
-int g_strace_count = 0;
+static void strace_entry_reclaim(void* elem) {
+    StraceEntry* entry = (StraceEntry*)elem;
+    if (entry->thunk_addr) {
+        stub_free(entry->thunk_addr);
+        entry->thunk_addr = NULL;
+    }
+    hook_info_release(&entry->hook);
+}
+
+static HookTable g_strace_table = HOOK_TABLE_INIT(StraceEntry, strace_entry_reclaim);
+
+StraceEntry* strace_entry_get(int index) {
+    return (StraceEntry*)hook_table_get(&g_strace_table, index);
+}
+
+int strace_entry_limit(void) {
+    return hook_table_count(&g_strace_table);
+}
 
 static __thread int g_strace_current_index = -1;
+static __thread uint32_t g_strace_current_gen = 0;
 static __thread int g_strace_depth = 0;
 static __thread char g_strace_enter_buf[1024];
 static __thread uint64_t g_strace_skip_retval = 0;
 
-static pthread_mutex_t g_strace_lua_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool g_strace_binary = false;
+static __thread uint8_t g_strace_event[STRACE_EVENT_MAX_SIZE];
+static __thread size_t g_strace_event_len = 0;
 
-extern int g_output_client_fd;
 
 SyscallDef* strace_find_def(const char* name) {
     for (int i = 0; s_syscall_defs[i].name != NULL; i++) {
@@ -214,15 +239,136 @@ static void format_arg(enum SyscallArgType type, uint64_t val, char* buf, size_t
 }
 
 static void strace_output(const char* msg) {
-    if (g_output_client_fd >= 0 && msg) {
-        size_t len = strlen(msg);
-        write(g_output_client_fd, msg, len);
-        write(g_output_client_fd, "\n", 1);
+    if (msg) {
+        output_write_to(OUTPUT_CH_STRACE, msg, strlen(msg));
     }
 }
 
-void strace_set_current_index(int index) {
+// Opens the handler's read section, which ends before the syscall runs
+// (strace_get_original, strace_get_skip_retval): a blocking one must not
+// hold up reclamation. strace_on_return opens another.
+RCU_ENTRY_TEXT void strace_set_current_index(int index) {
+    rcu_read_lock();
     g_strace_current_index = index;
+    g_strace_current_gen = hook_table_gen(&g_strace_table, index);
+}
+
+static void strace_emit_def(int idx, StraceEntry* entry) {
+    StraceEventDef rec;
+    memset(&rec, 0, sizeof(rec));
+
+    rec.hdr.magic = STRACE_EVENT_MAGIC;
+    rec.hdr.type = STRACE_EV_DEF;
+    rec.hdr.size = sizeof(rec);
+    rec.id = (uint16_t)idx;
+    rec.nargs = (uint8_t)entry->def->nr_args;
+    for (int i = 0; i < STRACE_EVENT_MAX_ARGS; i++) {
+        rec.arg_types[i] = (uint8_t)entry->def->arg_types[i];
+    }
+    strncpy(rec.name, entry->def->name, sizeof(rec.name) - 1);
+
+    output_write_raw_to(OUTPUT_CH_STRACE, &rec, sizeof(rec));
+}
+
+void strace_set_binary(bool binary) {
+    __atomic_store_n(&g_strace_binary, binary, __ATOMIC_RELAXED);
+    if (!binary) return;
+
+    int limit = strace_entry_limit();
+    for (int i = 0; i < limit; i++) {
+        StraceEntry* entry = strace_entry_get(i);
+        if (entry && entry->active && entry->def) {
+            strace_emit_def(i, entry);
+        }
+    }
+}
+
+bool strace_is_binary(void) {
+    return __atomic_load_n(&g_strace_binary, __ATOMIC_RELAXED);
+}
+
+static StraceEventPayload* event_add_payload(int arg, int kind) {
+    if (g_strace_event_len + sizeof(StraceEventPayload) + 255 > sizeof(g_strace_event)) {
+        return NULL;
+    }
+    StraceEventCall* rec = (StraceEventCall*)g_strace_event;
+    StraceEventPayload* p = (StraceEventPayload*)(g_strace_event + g_strace_event_len);
+    p->arg = (uint8_t)arg;
+    p->kind = (uint8_t)kind;
+    p->flags = 0;
+    p->len = 0;
+    rec->npayloads++;
+    return p;
+}
+
+static void event_commit_payload(StraceEventPayload* p) {
+    g_strace_event_len += sizeof(StraceEventPayload) + p->len;
+}
+
+// Capture raw args plus the strings that may not outlive the call
+static void strace_event_begin(int idx, SyscallDef* def, pid_t tid, uint64_t* saved_regs) {
+    StraceEventCall* rec = (StraceEventCall*)g_strace_event;
+    memset(rec, 0, sizeof(*rec));
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    rec->hdr.magic = STRACE_EVENT_MAGIC;
+    rec->hdr.type = STRACE_EV_CALL;
+    rec->id = (uint16_t)idx;
+    rec->nargs = (uint8_t)(def->nr_args < STRACE_MAX_ARGS ? def->nr_args : STRACE_MAX_ARGS);
+    rec->tid = tid;
+    rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    memcpy(rec->args, saved_regs, rec->nargs * sizeof(uint64_t));
+    g_strace_event_len = sizeof(*rec);
+
+    for (int i = 0; i < rec->nargs; i++) {
+        if (def->arg_types[i] == ARG_STR && saved_regs[i]) {
+            StraceEventPayload* p = event_add_payload(i, STRACE_PAYLOAD_STR);
+            if (!p) break;
+            const char* str = (const char*)saved_regs[i];
+            size_t len = strnlen(str, STRACE_STR_MAX);
+            memcpy(p + 1, str, len);
+            p->len = (uint8_t)len;
+            if (len == STRACE_STR_MAX && str[len] != '\0') p->flags |= STRACE_PAYLOAD_TRUNCATED;
+            event_commit_payload(p);
+        } else if (def->arg_types[i] == ARG_FD && (int)saved_regs[i] >= 0) {
+            char link_path[64];
+            char path[STRACE_FDPATH_MAX];
+            snprintf(link_path, sizeof(link_path), "/proc/self/fd/%d", (int)saved_regs[i]);
+            ssize_t len = readlink(link_path, path, sizeof(path));
+            if (len <= 0) continue;
+            StraceEventPayload* p = event_add_payload(i, STRACE_PAYLOAD_FDPATH);
+            if (!p) break;
+            memcpy(p + 1, path, len);
+            p->len = (uint8_t)len;
+            event_commit_payload(p);
+        }
+    }
+}
+
+static void strace_event_end(SyscallDef* def, uint64_t ret_val, int err) {
+    StraceEventCall* rec = (StraceEventCall*)g_strace_event;
+    rec->retval = (int64_t)ret_val;
+    rec->err = (int64_t)ret_val < 0 ? err : 0;
+
+    // Buffer contents are only meaningful once the call has returned
+    if ((int64_t)ret_val > 0) {
+        for (int i = 0; i < rec->nargs; i++) {
+            if (def->arg_types[i] != ARG_BUF || !rec->args[i]) continue;
+            StraceEventPayload* p = event_add_payload(i, STRACE_PAYLOAD_BUF);
+            if (!p) break;
+            size_t len = (size_t)ret_val < STRACE_BUF_PREVIEW ? (size_t)ret_val : STRACE_BUF_PREVIEW;
+            memcpy(p + 1, (const void*)rec->args[i], len);
+            p->len = (uint8_t)len;
+            if ((size_t)ret_val > len) p->flags |= STRACE_PAYLOAD_TRUNCATED;
+            event_commit_payload(p);
+        }
+    }
+
+    rec->hdr.size = (uint16_t)g_strace_event_len;
+    output_write_raw_to(OUTPUT_CH_STRACE, g_strace_event, g_strace_event_len);
+    g_strace_event_len = 0;
 }
 
 int strace_on_enter(uint64_t* saved_regs) {
@@ -236,20 +382,25 @@ int strace_on_enter(uint64_t* saved_regs) {
     g_hook_caller_lr = saved_regs[37];
 
     int idx = g_strace_current_index;
-    if (idx < 0 || idx >= g_strace_count) {
+    StraceEntry* entry = (StraceEntry*)hook_table_at(&g_strace_table, idx);
+    if (!entry || !entry->active || !entry->def) {
         g_strace_depth--;
         return 0;
     }
 
-    StraceEntry* entry = &g_strace_hooks[idx];
-    if (!entry->active || !entry->def) {
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    SyscallDef* def = entry->def;
+
+    // Binary mode: renef-strace decodes on the host, nothing to format here
+    g_strace_event_len = 0;
+    if (entry->lua_onCall_ref == LUA_NOREF && strace_is_binary()) {
+        strace_event_begin(idx, def, tid, saved_regs);
+        g_hook_caller_fp = 0;
+        g_hook_caller_lr = 0;
         g_strace_depth--;
         return 0;
     }
 
-    pid_t tid = (pid_t)syscall(SYS_gettid);
-    SyscallDef* def = entry->def;
-
     char output[1024];
     char args_str[768];
     args_str[0] = '\0';
@@ -276,13 +427,24 @@ int strace_on_enter(uint64_t* saved_regs) {
     strncpy(g_strace_enter_buf, output, sizeof(g_strace_enter_buf) - 1);
     g_strace_enter_buf[sizeof(g_strace_enter_buf) - 1] = '\0';
 
-    if (entry->lua_onCall_ref != LUA_NOREF && g_lua_engine) {
-        pthread_mutex_lock(&g_strace_lua_mutex);
-        lua_State* L = lua_engine_get_state(g_lua_engine);
+    if (entry->lua_onCall_ref != LUA_NOREF && g_lua_engine &&
+        (entry->lua_flags & DISPATCH_ASYNC)) {
+        DispatchEvent* ev = lua_dispatch_event_new(DISPATCH_STRACE, DISPATCH_EV_INFO,
+                                                   entry->lua_onCall_ref, output);
+        if (ev) {
+            ev->name = def->name;
+            ev->tid = tid;
+            ev->text_key = "formatted";
+            ev->nargs = def->nr_args < STRACE_MAX_ARGS ? def->nr_args : STRACE_MAX_ARGS;
+            ev->arg_base = 1;
+            memcpy(ev->args, saved_regs, ev->nargs * sizeof(uint64_t));
+            lua_dispatch_post(ev);
+        }
+    } else if (entry->lua_onCall_ref != LUA_NOREF && g_lua_engine) {
+        /* push callback */
+        lua_State* L = lua_dispatch_acquire(DISPATCH_STRACE, entry->lua_onCall_ref,
+                                            entry->lua_flags);
         if (L) {
-            /* push callback */
-            lua_rawgeti(L, LUA_REGISTRYINDEX, entry->lua_onCall_ref);
-
             /* build info table */
             lua_newtable(L);
 
@@ -346,8 +508,8 @@ int strace_on_enter(uint64_t* saved_regs) {
             }
 
             luaL_unref(L, LUA_REGISTRYINDEX, info_ref);
+            lua_dispatch_release(L);
         }
-        pthread_mutex_unlock(&g_strace_lua_mutex);
     }
 
     verbose_log("STRACE: %s", output);
@@ -359,7 +521,12 @@ int strace_on_enter(uint64_t* saved_regs) {
 }
 
 uint64_t strace_on_return(uint64_t ret_val) {
-    if (g_strace_depth > 0) return ret_val;
+    int saved_errno = errno;
+    rcu_read_lock();
+    if (g_strace_depth > 0) {
+        rcu_read_unlock();
+        return ret_val;
+    }
     g_strace_depth++;
 
     uintptr_t my_fp;
@@ -369,27 +536,46 @@ uint64_t strace_on_return(uint64_t ret_val) {
     g_hook_caller_lr = *(uintptr_t*)(handler_fp + 8);
 
     int idx = g_strace_current_index;
-    if (idx < 0 || idx >= g_strace_count) {
-        g_strace_depth--;
-        return ret_val;
+    StraceEntry* entry = (StraceEntry*)hook_table_at(&g_strace_table, idx);
+    SyscallDef* def = NULL;
+    int onCall_ref = LUA_NOREF;
+    int onReturn_ref = LUA_NOREF;
+    int lua_flags = 0;
+    if (entry && entry->active) {
+        def = entry->def;
+        onCall_ref = entry->lua_onCall_ref;
+        onReturn_ref = entry->lua_onReturn_ref;
+        lua_flags = entry->lua_flags;
     }
-
-    StraceEntry* entry = &g_strace_hooks[idx];
-    if (!entry->active || !entry->def) {
+    // Reclaimed and handed to another syscall during the call
+    if (hook_table_gen(&g_strace_table, idx) != g_strace_current_gen) def = NULL;
+    if (!def) {
         g_strace_depth--;
+        rcu_read_unlock();
         return ret_val;
     }
 
     pid_t tid = (pid_t)syscall(SYS_gettid);
 
-    if (entry->lua_onReturn_ref != LUA_NOREF && g_lua_engine) {
-        pthread_mutex_lock(&g_strace_lua_mutex);
-        lua_State* L = lua_engine_get_state(g_lua_engine);
+    if (onReturn_ref != LUA_NOREF && g_lua_engine &&
+        (lua_flags & DISPATCH_ASYNC)) {
+        DispatchEvent* ev = lua_dispatch_event_new(DISPATCH_STRACE, DISPATCH_EV_INFO,
+                                                   onReturn_ref,
+                                                   (int64_t)ret_val < 0 ? strerror(errno) : NULL);
+        if (ev) {
+            ev->name = def->name;
+            ev->tid = tid;
+            ev->text_key = "errno_str";
+            ev->has_retval = true;
+            ev->retval = ret_val;
+            lua_dispatch_post(ev);
+        }
+    } else if (onReturn_ref != LUA_NOREF && g_lua_engine) {
+        lua_State* L = lua_dispatch_acquire(DISPATCH_STRACE, onReturn_ref, lua_flags);
         if (L) {
-            lua_rawgeti(L, LUA_REGISTRYINDEX, entry->lua_onReturn_ref);
             lua_newtable(L);
 
-            lua_pushstring(L, entry->def->name);
+            lua_pushstring(L, def->name);
             lua_setfield(L, -2, "name");
             lua_pushinteger(L, tid);
             lua_setfield(L, -2, "tid");
@@ -411,11 +597,13 @@ uint64_t strace_on_return(uint64_t ret_val) {
                 }
                 lua_pop(L, 1);
             }
+            lua_dispatch_release(L);
         }
-        pthread_mutex_unlock(&g_strace_lua_mutex);
     }
 
-    if (entry->lua_onCall_ref == LUA_NOREF) {
+    if (g_strace_event_len > 0) {
+        strace_event_end(def, ret_val, saved_errno);
+    } else if (onCall_ref == LUA_NOREF) {
         char full_output[1200];
         if ((int64_t)ret_val < 0) {
             snprintf(full_output, sizeof(full_output), "%s = %d (%s)",
@@ -427,31 +615,34 @@ uint64_t strace_on_return(uint64_t ret_val) {
         strace_output(full_output);
     }
 
-    verbose_log("STRACE: %s() = %lld", entry->def->name, (long long)ret_val);
+    trace_log("STRACE: %s() = %lld", def->name, (long long)ret_val);
     (void)tid;
 
     g_hook_caller_fp = 0;
     g_hook_caller_lr = 0;
     g_strace_depth--;
+    rcu_read_unlock();
     return ret_val;
 }
 
+// Both end the read section strace_set_current_index() opened
 void* strace_get_original(void) {
-    int idx = g_strace_current_index;
-    if (idx >= 0 && idx < g_strace_count) {
-        StraceEntry* entry = &g_strace_hooks[idx];
-        if (entry->hook.type == HOOK_PLT_GOT && entry->hook.data.plt_got.patched_count > 0) {
-            return entry->hook.data.plt_got.original_funcs[0];
-        }
+    void* original = NULL;
+    StraceEntry* entry = (StraceEntry*)hook_table_at(&g_strace_table, g_strace_current_index);
+    if (entry && entry->hook.type == HOOK_PLT_GOT) {
+        original = __atomic_load_n(&entry->hook.data.plt_got.original_func, __ATOMIC_ACQUIRE);
     }
-    return NULL;
+    rcu_read_unlock();
+    return original;
 }
 
 uint64_t strace_get_skip_retval(void) {
+    rcu_read_unlock();
     return g_strace_skip_retval;
 }
 
-__attribute__((naked)) void strace_hook_handler(void) {
+// Entry text (rcu.h) up to the read lock, like generic_hook_handler
+RCU_ENTRY_TEXT __attribute__((naked)) void strace_hook_handler(void) {
     __asm__ __volatile__(
         "stp x29, x30, [sp, #-16]!\n"
         "mov x29, sp\n"
@@ -477,6 +668,9 @@ __attribute__((naked)) void strace_hook_handler(void) {
 
         "ldr x0, [sp, #256]\n"
         "bl strace_set_current_index\n"
+        "b 3f\n"
+        ".pushsection .text.strace_hook_handler_body,\"ax\",%progbits\n"
+        "3:\n"
 
         /* strace_on_enter returns 0 (normal) or 1 (skip original) */
         "mov x0, sp\n"
@@ -508,19 +702,13 @@ __attribute__((naked)) void strace_hook_handler(void) {
         "add sp, sp, #288\n"
         "ldp x29, x30, [sp], #16\n"
         "ret\n"
+        ".popsection\n"
     );
 }
 
-static void* create_strace_thunk(int hook_index) {
-    void* thunk = mmap(NULL, PAGE_SIZE,
-                       PROT_READ | PROT_WRITE | PROT_EXEC,
-                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (thunk == MAP_FAILED) {
-        LOGE("strace: Failed to allocate thunk");
-        return NULL;
-    }
-
-    uint32_t* code = (uint32_t*)thunk;
+static size_t build_strace_thunk(uint32_t* code, uintptr_t pc, void* ctx) {
+    (void)pc;
+    int hook_index = *(int*)ctx;
 
     code[0] = 0xD2800011 | ((hook_index & 0xFFFF) << 5);
     code[1] = 0x58000070;
@@ -528,33 +716,37 @@ static void* create_strace_thunk(int hook_index) {
     code[3] = 0xD503201F;
 
     *(uint64_t*)(&code[4]) = (uint64_t)strace_hook_handler;
+    return 32;
+}
 
-    __builtin___clear_cache((char*)thunk, (char*)thunk + 32);
+static void* create_strace_thunk(int hook_index) {
+    void* thunk = stub_create(32, NULL, build_strace_thunk, &hook_index);
+    if (!thunk) {
+        LOGE("strace: Failed to allocate thunk");
+        return NULL;
+    }
 
     LOGI("strace: Created thunk at %p for index %d", thunk, hook_index);
     return thunk;
 }
 
 int strace_install(const char* syscall_name, const char* caller_lib,
-                   int onCall_ref, int onReturn_ref) {
+                   int onCall_ref, int onReturn_ref, int lua_flags) {
     SyscallDef* def = strace_find_def(syscall_name);
     if (!def) {
         LOGE("strace: Unknown syscall: %s", syscall_name);
         return -1;
     }
 
-    for (int i = 0; i < g_strace_count; i++) {
-        if (g_strace_hooks[i].active && g_strace_hooks[i].def == def) {
+    int limit = strace_entry_limit();
+    for (int i = 0; i < limit; i++) {
+        StraceEntry* existing = strace_entry_get(i);
+        if (existing && existing->active && existing->def == def) {
             LOGI("strace: %s already traced", syscall_name);
             return i;
         }
     }
 
-    if (g_strace_count >= MAX_STRACE_HOOKS) {
-        LOGE("strace: Maximum hooks reached (%d)", MAX_STRACE_HOOKS);
-        return -1;
-    }
-
     void* addr = dlsym(RTLD_DEFAULT, def->symbol);
     if (!addr && def->alt_symbol) {
         addr = dlsym(RTLD_DEFAULT, def->alt_symbol);
@@ -569,18 +761,23 @@ int strace_install(const char* syscall_name, const char* caller_lib,
 
     LOGI("strace: Resolved %s at %p", def->name, addr);
 
-    int idx = g_strace_count;
-    StraceEntry* entry = &g_strace_hooks[idx];
-    memset(entry, 0, sizeof(StraceEntry));
+    StraceEntry* entry;
+    int idx = hook_table_alloc(&g_strace_table, (void**)&entry);
+    if (idx < 0) {
+        LOGE("strace: Cannot allocate a trace for %s", syscall_name);
+        return -1;
+    }
 
     entry->def = def;
     entry->resolved_addr = addr;
     entry->lua_onCall_ref = onCall_ref;
     entry->lua_onReturn_ref = onReturn_ref;
+    entry->lua_flags = lua_flags;
 
     void* thunk = create_strace_thunk(idx);
     if (!thunk) {
         LOGE("strace: Failed to create thunk for %s", syscall_name);
+        hook_table_free(&g_strace_table, idx);
         return -1;
     }
     entry->thunk_addr = thunk;
@@ -590,12 +787,16 @@ int strace_install(const char* syscall_name, const char* caller_lib,
     int result = install_plt_got_hook(addr, thunk, &entry->hook, effective_caller);
     if (result != 0) {
         LOGE("strace: Failed to install PLT/GOT hook for %s", syscall_name);
-        munmap(thunk, PAGE_SIZE);
+        strace_entry_reclaim(entry);
+        hook_table_free(&g_strace_table, idx);
         return -1;
     }
 
     entry->active = true;
-    g_strace_count++;
+
+    if (strace_is_binary()) {
+        strace_emit_def(idx, entry);
+    }
 
     LOGI("strace: Installed trace for %s (index=%d, patched=%d GOT entries)",
          def->name, idx, entry->hook.data.plt_got.patched_count);
@@ -604,9 +805,10 @@ int strace_install(const char* syscall_name, const char* caller_lib,
 }
 
 int strace_remove(const char* syscall_name) {
-    for (int i = 0; i < g_strace_count; i++) {
-        StraceEntry* entry = &g_strace_hooks[i];
-        if (!entry->active || !entry->def) continue;
+    int limit = strace_entry_limit();
+    for (int i = 0; i < limit; i++) {
+        StraceEntry* entry = strace_entry_get(i);
+        if (!entry || !entry->active || !entry->def) continue;
         if (strcmp(entry->def->name, syscall_name) != 0) continue;
 
         for (int j = 0; j < entry->hook.data.plt_got.patched_count; j++) {
@@ -618,25 +820,28 @@ int strace_remove(const char* syscall_name) {
             }
         }
         entry->hook.data.plt_got.patched_count = 0;
+        entry->active = false;
 
-        if (entry->thunk_addr) {
-            munmap(entry->thunk_addr, PAGE_SIZE);
-            entry->thunk_addr = NULL;
-        }
-
+        // Handlers already past the GOT keep reading the entry; the thunk
+        // and GOT bookkeeping go with it once they are done
+        int onCall_ref = __atomic_exchange_n(&entry->lua_onCall_ref, LUA_NOREF, __ATOMIC_ACQ_REL);
+        int onReturn_ref = __atomic_exchange_n(&entry->lua_onReturn_ref, LUA_NOREF, __ATOMIC_ACQ_REL);
         if (g_lua_engine) {
-            lua_State* L = lua_engine_get_state(g_lua_engine);
+            lua_State* L = lua_dispatch_lock(DISPATCH_STRACE);
             if (L) {
-                if (entry->lua_onCall_ref != LUA_NOREF)
-                    luaL_unref(L, LUA_REGISTRYINDEX, entry->lua_onCall_ref);
-                if (entry->lua_onReturn_ref != LUA_NOREF)
-                    luaL_unref(L, LUA_REGISTRYINDEX, entry->lua_onReturn_ref);
+                if (onCall_ref != LUA_NOREF) {
+                    luaL_unref(L, LUA_REGISTRYINDEX, onCall_ref);
+                    lua_dispatch_invalidate(onCall_ref);
+                }
+                if (onReturn_ref != LUA_NOREF) {
+                    luaL_unref(L, LUA_REGISTRYINDEX, onReturn_ref);
+                    lua_dispatch_invalidate(onReturn_ref);
+                }
+                lua_dispatch_unlock();
             }
         }
 
-        entry->active = false;
-        entry->lua_onCall_ref = LUA_NOREF;
-        entry->lua_onReturn_ref = LUA_NOREF;
+        hook_table_retire(&g_strace_table, i);
 
         LOGI("strace: Removed trace for %s", syscall_name);
         return 0;
@@ -646,12 +851,13 @@ int strace_remove(const char* syscall_name) {
 
 void strace_remove_all(void) {
     int removed = 0;
-    for (int i = 0; i < g_strace_count; i++) {
-        if (g_strace_hooks[i].active && g_strace_hooks[i].def) {
-            strace_remove(g_strace_hooks[i].def->name);
+    int limit = strace_entry_limit();
+    for (int i = 0; i < limit; i++) {
+        StraceEntry* entry = strace_entry_get(i);
+        if (entry && entry->active && entry->def) {
+            strace_remove(entry->def->name);
             removed++;
         }
     }
-    g_strace_count = 0;
     LOGI("strace: Removed all traces (%d)", removed);
 }
@@ -2,9 +2,12 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <unordered_map>
 #include <cstring>
+#include <cstdio>
 #include <csignal>
 #include <cerrno>
+#include <cinttypes>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -13,6 +16,8 @@
 #include <poll.h>
 #include <getopt.h>
 
+#include <agent/strace_event.h>
+
 #define DEFAULT_TCP_PORT 1907
 #define DEFAULT_HOST "127.0.0.1"
 
@@ -26,9 +31,16 @@
 #define C_CYAN    "\033[36m"
 #define C_MAGENTA "\033[35m"
 
+enum OutputFormat {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_CSV
+};
+
 static volatile bool g_running = true;
 static int g_sock_fd = -1;
 static bool g_no_color = false;
+static OutputFormat g_format = FORMAT_TEXT;
 
 // Colorize a single strace output line
 // Format: [tid:1234] openat(AT_FDCWD, "/data/...", O_RDONLY) = 3
@@ -132,25 +144,280 @@ static void colorize_line(const std::string& line) {
     std::cout << "\n";
 }
 
-static std::string g_line_buffer;
+struct SyscallInfo {
+    std::string name;
+    int nargs = 0;
+    uint8_t arg_types[STRACE_EVENT_MAX_ARGS] = {0};
+};
+
+struct Payload {
+    int kind = 0;
+    bool truncated = false;
+    std::string data;
+};
+
+// Filled from STRACE_EV_DEF records; ids are only valid for one session
+static std::unordered_map<uint16_t, SyscallInfo> g_syscalls;
+
+static std::string paint(const char* color, const std::string& s) {
+    if (g_no_color || g_format != FORMAT_TEXT) return s;
+    return std::string(color) + s + C_RESET;
+}
+
+static std::string escape_bytes(const std::string& data, bool truncated) {
+    std::string out = "\"";
+    char hex[8];
+    for (unsigned char c : data) {
+        if (c >= 32 && c < 127 && c != '"' && c != '\\') {
+            out += (char)c;
+        } else {
+            snprintf(hex, sizeof(hex), "\\x%02x", c);
+            out += hex;
+        }
+    }
+    out += "\"";
+    if (truncated) out += "...";
+    return out;
+}
+
+static std::string format_open_flags(int flags) {
+    std::string s;
+    if ((flags & 3) == 0) s = "O_RDONLY";
+    else if ((flags & 3) == 1) s = "O_WRONLY";
+    else if ((flags & 3) == 2) s = "O_RDWR";
+
+    if (flags & 0x40)    s += "|O_CREAT";
+    if (flags & 0x80)    s += "|O_EXCL";
+    if (flags & 0x200)   s += "|O_TRUNC";
+    if (flags & 0x400)   s += "|O_APPEND";
+    if (flags & 0x800)   s += "|O_NONBLOCK";
+    if (flags & 0x80000) s += "|O_CLOEXEC";
+    return s;
+}
+
+static std::string format_arg(int type, uint64_t val, const Payload* payload) {
+    char buf[64];
+    switch (type) {
+        case ARG_INT:
+            snprintf(buf, sizeof(buf), "%d", (int)val);
+            return buf;
+        case ARG_UINT:
+            snprintf(buf, sizeof(buf), "%u", (unsigned)val);
+            return buf;
+        case ARG_FD:
+            if ((int)val == -100) return paint(C_MAGENTA, "AT_FDCWD");
+            snprintf(buf, sizeof(buf), "%d", (int)val);
+            if (payload && payload->kind == STRACE_PAYLOAD_FDPATH) {
+                return std::string(buf) + paint(C_CYAN, "<" + payload->data + ">");
+            }
+            return buf;
+        case ARG_STR:
+            if (val == 0) return "NULL";
+            if (payload) return paint(C_CYAN, escape_bytes(payload->data, payload->truncated));
+            snprintf(buf, sizeof(buf), "0x%" PRIx64, val);
+            return buf;
+        case ARG_BUF:
+            if (val == 0) return "NULL";
+            if (payload) return paint(C_CYAN, escape_bytes(payload->data, payload->truncated));
+            snprintf(buf, sizeof(buf), "0x%" PRIx64, val);
+            return buf;
+        case ARG_PTR:
+            if (val == 0) return "NULL";
+            snprintf(buf, sizeof(buf), "0x%" PRIx64, val);
+            return buf;
+        case ARG_FLAGS_OPEN:
+            return paint(C_MAGENTA, format_open_flags((int)val));
+        case ARG_MODE:
+            snprintf(buf, sizeof(buf), "0%o", (unsigned)val);
+            return buf;
+        case ARG_SIZE:
+            snprintf(buf, sizeof(buf), "%" PRIu64, val);
+            return buf;
+    }
+    snprintf(buf, sizeof(buf), "0x%" PRIx64, val);
+    return buf;
+}
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    char hex[8];
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 32) {
+            snprintf(hex, sizeof(hex), "\\u%04x", c);
+            out += hex;
+        } else {
+            out += (char)c;
+        }
+    }
+    return out;
+}
+
+static std::string csv_escape(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += "\"";
+    return out;
+}
+
+static void handle_def(const uint8_t* data, size_t size) {
+    StraceEventDef rec;
+    if (size < sizeof(rec)) return;
+    memcpy(&rec, data, sizeof(rec));
+
+    SyscallInfo info;
+    info.name.assign(rec.name, strnlen(rec.name, sizeof(rec.name)));
+    info.nargs = rec.nargs < STRACE_EVENT_MAX_ARGS ? rec.nargs : STRACE_EVENT_MAX_ARGS;
+    memcpy(info.arg_types, rec.arg_types, sizeof(info.arg_types));
+    g_syscalls[rec.id] = info;
+}
+
+static void handle_call(const uint8_t* data, size_t size) {
+    StraceEventCall rec;
+    if (size < sizeof(rec)) return;
+    memcpy(&rec, data, sizeof(rec));
+
+    Payload payloads[STRACE_EVENT_MAX_ARGS];
+    bool has_payload[STRACE_EVENT_MAX_ARGS] = {false};
+    size_t off = sizeof(rec);
+    for (int i = 0; i < rec.npayloads; i++) {
+        StraceEventPayload p;
+        if (off + sizeof(p) > size) break;
+        memcpy(&p, data + off, sizeof(p));
+        off += sizeof(p);
+        if (off + p.len > size) break;
+        if (p.arg < STRACE_EVENT_MAX_ARGS) {
+            payloads[p.arg].kind = p.kind;
+            payloads[p.arg].truncated = (p.flags & STRACE_PAYLOAD_TRUNCATED) != 0;
+            payloads[p.arg].data.assign((const char*)data + off, p.len);
+            has_payload[p.arg] = true;
+        }
+        off += p.len;
+    }
+
+    std::string name;
+    int nargs = rec.nargs < STRACE_EVENT_MAX_ARGS ? rec.nargs : STRACE_EVENT_MAX_ARGS;
+    std::vector<std::string> args;
+    auto it = g_syscalls.find(rec.id);
+    if (it != g_syscalls.end()) {
+        name = it->second.name;
+        for (int i = 0; i < nargs; i++) {
+            args.push_back(format_arg(it->second.arg_types[i], rec.args[i],
+                                      has_payload[i] ? &payloads[i] : nullptr));
+        }
+    } else {
+        name = "syscall#" + std::to_string(rec.id);
+        for (int i = 0; i < nargs; i++) {
+            args.push_back(format_arg(ARG_PTR, rec.args[i], nullptr));
+        }
+    }
+
+    bool failed = rec.retval < 0;
+    const char* err_str = failed ? strerror(rec.err) : "";
+    char ts[32];
+    snprintf(ts, sizeof(ts), "%" PRIu64 ".%06" PRIu64,
+             (uint64_t)(rec.ts_ns / 1000000000ULL), (uint64_t)(rec.ts_ns % 1000000000ULL / 1000));
+
+    if (g_format == FORMAT_JSON) {
+        std::string line = "{\"ts\":" + std::string(ts) +
+                           ",\"tid\":" + std::to_string(rec.tid) +
+                           ",\"syscall\":\"" + json_escape(name) + "\",\"args\":[";
+        for (size_t i = 0; i < args.size(); i++) {
+            if (i > 0) line += ",";
+            line += "\"" + json_escape(args[i]) + "\"";
+        }
+        line += "],\"raw\":[";
+        for (int i = 0; i < nargs; i++) {
+            if (i > 0) line += ",";
+            line += std::to_string(rec.args[i]);
+        }
+        line += "],\"retval\":" + std::to_string(rec.retval);
+        if (failed) {
+            line += ",\"errno\":" + std::to_string(rec.err) +
+                    ",\"error\":\"" + json_escape(err_str) + "\"";
+        }
+        line += "}";
+        std::cout << line << "\n";
+        return;
+    }
+
+    std::string joined;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (i > 0) joined += ", ";
+        joined += args[i];
+    }
+
+    if (g_format == FORMAT_CSV) {
+        std::cout << ts << "," << rec.tid << "," << name << "," << csv_escape(joined) << ","
+                  << rec.retval << "," << (failed ? rec.err : 0) << ","
+                  << csv_escape(err_str) << "\n";
+        return;
+    }
+
+    std::cout << paint(C_DIM, "[tid:" + std::to_string(rec.tid) + "]") << " "
+              << paint(C_BOLD C_YELLOW, name) << "(" << joined << ")";
+    if (failed) {
+        std::cout << paint(C_RED, " = " + std::to_string((int)rec.retval) + " (" + err_str + ")");
+    } else {
+        std::cout << " = " << paint(C_GREEN, std::to_string(rec.retval));
+    }
+    std::cout << "\n";
+}
+
+// Status and script output arrives as plain text lines between records
+static void handle_text_line(const std::string& line) {
+    if (g_format == FORMAT_TEXT) {
+        colorize_line(line);
+    } else {
+        std::cerr << line << "\n";
+    }
+}
+
+static std::string g_stream;
 
 static void process_output(const char* data, size_t len) {
-    g_line_buffer.append(data, len);
+    g_stream.append(data, len);
+
+    size_t pos = 0;
+    while (pos < g_stream.size()) {
+        if ((uint8_t)g_stream[pos] == STRACE_EVENT_MAGIC) {
+            if (g_stream.size() - pos < sizeof(StraceEventHeader)) break;
+
+            StraceEventHeader hdr;
+            memcpy(&hdr, g_stream.data() + pos, sizeof(hdr));
+            if (hdr.size < sizeof(hdr)) {
+                pos++;  // not a record after all, resync
+                continue;
+            }
+            if (g_stream.size() - pos < hdr.size) break;
 
-    size_t start = 0;
-    while (true) {
-        size_t nl = g_line_buffer.find('\n', start);
+            const uint8_t* rec = (const uint8_t*)g_stream.data() + pos;
+            if (hdr.type == STRACE_EV_DEF) {
+                handle_def(rec, hdr.size);
+            } else if (hdr.type == STRACE_EV_CALL) {
+                handle_call(rec, hdr.size);
+            }
+            pos += hdr.size;
+            continue;
+        }
+
+        size_t nl = g_stream.find('\n', pos);
         if (nl == std::string::npos) break;
 
-        std::string line = g_line_buffer.substr(start, nl - start);
+        std::string line = g_stream.substr(pos, nl - pos);
         if (!line.empty()) {
-            colorize_line(line);
+            handle_text_line(line);
         }
-        start = nl + 1;
+        pos = nl + 1;
     }
 
-    if (start > 0) {
-        g_line_buffer = g_line_buffer.substr(start);
+    if (pos > 0) {
+        g_stream.erase(0, pos);
     }
 }
 
@@ -170,6 +437,7 @@ static void print_usage(const char* prog) {
               << "  --active          Show active traces\n"
               << "  --stop            Stop all tracing\n"
               << "  --no-color        Disable colored output\n"
+              << "  --format <fmt>    Output format: text (default), json, csv\n"
               << "  -d <device>       ADB device ID (for multiple devices)\n"
               << "  -H <host>         Server host (default: 127.0.0.1)\n"
               << "  -P <port>         Server port (default: 1907)\n"
@@ -369,6 +637,7 @@ int main(int argc, char* argv[]) {
         {"active",   no_argument, 0, 'A'},
         {"stop",     no_argument, 0, 'S'},
         {"no-color", no_argument, 0, 'N'},
+        {"format",   required_argument, 0, 'F'},
         {"help",     no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
@@ -387,6 +656,15 @@ int main(int argc, char* argv[]) {
             case 'A': do_active = true; break;
             case 'S': do_stop = true; break;
             case 'N': g_no_color = true; break;
+            case 'F':
+                if (strcmp(optarg, "json") == 0) g_format = FORMAT_JSON;
+                else if (strcmp(optarg, "csv") == 0) g_format = FORMAT_CSV;
+                else if (strcmp(optarg, "text") == 0) g_format = FORMAT_TEXT;
+                else {
+                    std::cerr << "Error: Unknown format '" << optarg << "'\n";
+                    return 1;
+                }
+                break;
             case 'h': print_usage(argv[0]); return 0;
             default:  print_usage(argv[0]); return 1;
         }
@@ -484,7 +762,12 @@ int main(int argc, char* argv[]) {
 
     std::cerr << "Tracing syscalls on PID " << pid << "... (Ctrl+C to stop)\n";
 
-    std::string full_cmd = server_cmd + "\n";
+    if (g_format == FORMAT_CSV) {
+        std::cout << "ts,tid,syscall,args,retval,errno,error\n";
+    }
+
+    // Formatting happens here; the agent only sends raw records
+    std::string full_cmd = server_cmd + " --binary\n";
     send(sock, full_cmd.c_str(), full_cmd.length(), MSG_NOSIGNAL);
 
     int flags = fcntl(sock, F_GETFL, 0);
@@ -15,6 +15,8 @@
 #include <renef/server_connection.h>
 #include <renef/crypto.h>
 #include <renef/string_utils.h>
+#include <renef/dump_stream.h>
+#include <renef/elf_rebuild.h>
 #include "transport/uds.h"
 #include "transport/tcp.h"
 #ifndef RENEF_NO_READLINE
@@ -359,7 +361,7 @@ char* lua_api_generator(const char* text, int state) {
 
 char* command_generator(const char* text, int state) {
     static size_t list_index, len;
-    static std::vector<std::string> local_commands = {"help", "color", "clear", "msi", "q"};
+    static std::vector<std::string> local_commands = {"help", "color", "clear", "msi", "dump", "dumpmod", "q"};
 
     if (!state) {
         list_index = 0;
@@ -389,6 +391,8 @@ char* command_generator(const char* text, int state) {
 
 static std::map<std::string, std::string> local_command_descs = {
     {"msi", "Interactive memory scan with TUI (msi <hex_pattern>)"},
+    {"dump", "Dump memory to a local file (dump <addr> <size> <file> | <module> <file> [--lz4] [--resume])"},
+    {"dumpmod", "Dump a loaded module as a rebuilt ELF (dumpmod <lib> <file> [--raw] [--resume])"},
     {"help", "Show available commands"},
     {"color", "Set theme colors (color list, color prompt=RED)"},
     {"clear", "Clear the screen"},
@@ -507,6 +511,8 @@ void show_help() {
     }
 
     printf("  %-15s - %s\n", "msi", "Interactive memory scan (msi <hex_pattern>)");
+    printf("  %-15s - %s\n", "dump", "Dump memory to a local file (dump <addr> <size> <file> | <module> <file> [--lz4] [--resume])");
+    printf("  %-15s - %s\n", "dumpmod", "Dump a loaded module as a rebuilt ELF (dumpmod <lib> <file> [--raw] [--resume])");
     printf("  %-15s - %s\n", "color", "Set theme colors (color list, color prompt=RED)");
     printf("  %-15s - %s\n", "help", "Show this help");
     printf("  %-15s - %s\n", "q", "Exit");
@@ -843,6 +849,7 @@ std::string send_command(const std::string& command) {
         if (!connected) {
             return "";
         }
+        conn.enable_framing();
     }
 
     bool streaming = is_streaming_command(command);
@@ -851,34 +858,30 @@ std::string send_command(const std::string& command) {
     // a streaming command (watch/strace). Hook output may arrive between
     // script execution and watch startup; draining would lose it.
     if (!streaming) {
-        int fd = conn.get_socket_fd();
-        if (fd >= 0) {
-            char drain[4096];
-            int old_flags = fcntl(fd, F_GETFL, 0);
-            fcntl(fd, F_SETFL, old_flags | O_NONBLOCK);
-            while (recv(fd, drain, sizeof(drain), 0) > 0) {}
-            fcntl(fd, F_SETFL, old_flags);
-        }
+        conn.drain();
     }
 
     if (streaming) {
         std::cout << "(Press 'q' to exit watch mode)\n";
     }
 
-    if (!conn.send(command + "\n")) {
+    std::string full_response;
+    ColorManager& cm = ColorManager::instance();
+
+    if (conn.is_framed() && !streaming) {
+        // Returns on the command's END frame instead of a quiet period.
+        full_response = conn.request(command, 10000);
+    } else if (!conn.send(command + "\n")) {
         std::cerr << "Error: Failed to send command\n";
         return "";
     }
 
-    std::string full_response;
-    ColorManager& cm = ColorManager::instance();
-
     if (streaming) {
         // Streaming mode: loop with short timeout, check for 'q' key
         while (true) {
             if (check_quit_key()) {
                 std::cout << "\nExiting watch mode...\n";
-                conn.send("q\n");
+                conn.send_input("q\n");
                 conn.receive(500);
                 break;
             }
@@ -892,7 +895,9 @@ std::string send_command(const std::string& command) {
         }
     } else {
         // Normal mode: single receive with timeout
-        full_response = conn.receive(10000);
+        if (!conn.is_framed()) {
+            full_response = conn.receive(10000);
+        }
 
         if (!full_response.empty()) {
             std::cout << cm.response_color << full_response << RESET;
@@ -905,23 +910,9 @@ std::string send_command(const std::string& command) {
     return full_response;
 }
 
-static std::string send_command_silent(const std::string& command) {
-    ServerConnection& conn = ServerConnection::instance();
-    if (!conn.is_connected()) return "";
-
-    int fd = conn.get_socket_fd();
-    if (fd < 0) return "";
-
-    {
-        char drain[4096];
-        int old_flags = fcntl(fd, F_GETFL, 0);
-        fcntl(fd, F_SETFL, old_flags | O_NONBLOCK);
-        while (recv(fd, drain, sizeof(drain), 0) > 0) {}
-        fcntl(fd, F_SETFL, old_flags);
-    }
-
-    if (!conn.send(command + "\n")) return "";
-
+// Text connections have no END frame; read until the agent's
+// "Lua executed" marker or 10 seconds of silence.
+static std::string read_until_marker(int fd) {
     std::string result;
     char buf[4096];
     int old_flags = fcntl(fd, F_GETFL, 0);
@@ -947,6 +938,25 @@ static std::string send_command_silent(const std::string& command) {
     }
 
     fcntl(fd, F_SETFL, old_flags);
+    return result;
+}
+
+static std::string send_command_silent(const std::string& command) {
+    ServerConnection& conn = ServerConnection::instance();
+    if (!conn.is_connected()) return "";
+
+    int fd = conn.get_socket_fd();
+    if (fd < 0) return "";
+
+    conn.drain();
+
+    std::string result;
+    if (conn.is_framed()) {
+        result = conn.request(command, 10000);
+    } else {
+        if (!conn.send(command + "\n")) return "";
+        result = read_until_marker(fd);
+    }
 
     size_t marker = result.find("\342\234\223");
     if (marker == std::string::npos) marker = result.find("\342\234\227");
@@ -955,6 +965,128 @@ static std::string send_command_silent(const std::string& command) {
     return result;
 }
 
+// Runs a dump command ("mdump"/"dumpmod") and writes its records to file
+// as they arrive. True once the whole range is in the file.
+static bool stream_dump(std::string cmd, const std::string& file, bool resume, DumpFileWriter& writer) {
+    ServerConnection& conn = ServerConnection::instance();
+    if (g_gadget_mode || !conn.is_connected() || !conn.is_framed()) {
+        std::cerr << "ERROR: dump needs a server connection with framing (attach or spawn first)\n";
+        return false;
+    }
+
+    if (!writer.open(file, resume)) {
+        std::cerr << "ERROR: " << writer.error() << "\n";
+        return false;
+    }
+    if (writer.resume_offset() > 0) {
+        cmd += " from=" + std::to_string(writer.resume_offset());
+        std::cout << "[*] Resuming at offset " << writer.resume_offset() << "\n";
+    }
+
+    conn.drain();
+    uint64_t next_report = 0;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = conn.request_stream(cmd, [&](const char* data, size_t len) {
+        if (!writer.feed(data, len)) return;
+        if (writer.end_offset() >= next_report) {
+            std::cout << "\r[*] " << writer.end_offset() / 1024 << " KB" << std::flush;
+            next_report = writer.end_offset() + 1024 * 1024;
+        }
+    });
+    bool written = writer.finish();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (next_report > 0) std::cout << "\n";
+
+    if (!writer.error().empty()) {
+        std::cerr << "ERROR: " << writer.error() << "\n";
+        return false;
+    }
+    if (!ok || !written || !writer.complete()) {
+        std::cerr << "ERROR: dump interrupted at offset " << writer.end_offset()
+                  << " (run again with --resume to continue)\n";
+        return false;
+    }
+
+    if (!writer.info().empty()) std::cout << "[*] " << writer.info() << "\n";
+    std::cout << "[+] " << writer.end_offset() << " bytes written to " << file;
+    if (writer.holes() > 0) {
+        std::cout << " (" << writer.holes() << " unreadable range(s), "
+                  << writer.hole_bytes() << " bytes zero-filled)";
+    }
+    std::cout << "\n[*] " << writer.stored_bytes() << " bytes transferred in "
+              << std::fixed << std::setprecision(2) << secs << "s\n";
+    return true;
+}
+
+// Splits "a b --flag" into positional arguments and the flags given.
+static std::vector<std::string> dump_args(const std::string& args, std::vector<std::string>& flags) {
+    std::vector<std::string> positional;
+    for (const std::string& tok : split(args, ' ')) {
+        if (tok.empty()) continue;
+        if (tok.rfind("--", 0) == 0) flags.push_back(tok);
+        else positional.push_back(tok);
+    }
+    return positional;
+}
+
+static bool has_flag(const std::vector<std::string>& flags, const char* flag) {
+    return std::find(flags.begin(), flags.end(), flag) != flags.end();
+}
+
+// dump <addr> <size> <file> | <module> <file> [--lz4] [--resume]
+// Unreadable pages stay zero in the file.
+static bool handle_dump_command(const std::string& args) {
+    std::vector<std::string> flags;
+    std::vector<std::string> positional = dump_args(args, flags);
+    if (positional.size() < 2 || positional.size() > 3) {
+        std::cerr << "Usage: dump <address> <size> <file> [--lz4] [--resume]\n"
+                  << "       dump <module> <file> [--lz4] [--resume]\n";
+        return false;
+    }
+
+    std::string cmd = "mdump " + positional[0];
+    if (positional.size() == 3) cmd += " " + positional[1];
+    if (has_flag(flags, "--lz4")) cmd += " lz4";
+
+    DumpFileWriter writer;
+    return stream_dump(cmd, positional.back(), has_flag(flags, "--resume"), writer);
+}
+
+// dumpmod <lib> <file> [--raw] [--resume]
+// The module's loaded segments, rebuilt into an ELF file.
+static bool handle_dumpmod_command(const std::string& args) {
+    std::vector<std::string> flags;
+    std::vector<std::string> positional = dump_args(args, flags);
+    if (positional.size() != 2) {
+        std::cerr << "Usage: dumpmod <lib> <file> [--raw] [--resume]\n";
+        return false;
+    }
+
+    std::string cmd = "dumpmod " + positional[0];
+    if (has_flag(flags, "--raw")) cmd += " raw";
+
+    DumpFileWriter writer;
+    const std::string& file = positional[1];
+    if (!stream_dump(cmd, file, has_flag(flags, "--resume"), writer)) return false;
+
+    uint64_t base = 0;
+    size_t pos = writer.info().find("base=");
+    if (pos != std::string::npos) base = strtoull(writer.info().c_str() + pos + 5, nullptr, 16);
+
+    ElfRebuildInfo info;
+    std::string error;
+    if (!rebuild_elf_image(file, base, info, error)) {
+        std::cerr << "ERROR: ELF rebuild failed: " << error << " (raw image kept)\n";
+        return false;
+    }
+    std::cout << "[+] Rebuilt ELF: " << info.segments << " segments, " << info.sections
+              << " sections, " << info.symbols << " dynamic symbols";
+    if (info.dynamic_fixed > 0) std::cout << ", " << info.dynamic_fixed << " dynamic entries rebased";
+    std::cout << "\n[*] Data keeps its runtime pointers; load at 0x" << std::hex << base << std::dec
+              << " to match them\n";
+    return true;
+}
+
 // ─── Client-side AI command (multi-provider) ─────────────────────
 
 enum AIProvider { AI_OLLAMA, AI_OPENAI, AI_ANTHROPIC };
@@ -1856,6 +1988,18 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
+        if (command.rfind("dump ", 0) == 0) {
+            handle_dump_command(command.substr(5));
+            free(input);
+            continue;
+        }
+
+        if (command.rfind("dumpmod ", 0) == 0) {
+            handle_dumpmod_command(command.substr(8));
+            free(input);
+            continue;
+        }
+
         if (command == "color" || command.rfind("color ", 0) == 0) {
             std::string args = command.length() > 6 ? command.substr(6) : "";
             size_t start = args.find_first_not_of(" \t");
@@ -1924,7 +2068,7 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        if (cmd_name == "help" || cmd_name == "q" || cmd_name == "color" || cmd_name == "clear" || cmd_name == "msi") {
+        if (cmd_name == "help" || cmd_name == "q" || cmd_name == "color" || cmd_name == "clear" || cmd_name == "msi" || cmd_name == "dump" || cmd_name == "dumpmod") {
             is_known_command = true;
         }
 
@@ -10,7 +10,8 @@
 
 using json = nlohmann::json;
 
-std::vector<MemScanResult> parse_memscan_json(const std::string& json_response) {
+std::vector<MemScanResult> parse_memscan_json(const std::string& json_response,
+                                              MemScanPage* page) {
     std::vector<MemScanResult> results;
 
     try {
@@ -20,12 +21,21 @@ std::vector<MemScanResult> parse_memscan_json(const std::string& json_response)
             return results;
         }
 
+        if (page) {
+            page->offset = j.value("offset", 0);
+            page->total = j.value("total", j.value("count", 0));
+        }
+
         for (const auto& item : j["results"]) {
             MemScanResult r;
             r.library = item.value("library", "");
             r.offset = item.value("offset", 0L);
             r.address = item.value("address", 0UL);
-            r.hex = item.value("hex", "");
+            if (item.contains("value")) {
+                r.hex = "= " + item.value("value", "");
+            } else {
+                r.hex = item.value("hex", "");
+            }
             r.ascii = item.value("ascii", "");
             results.push_back(r);
         }
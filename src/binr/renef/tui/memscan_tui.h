@@ -13,6 +13,12 @@ struct MemScanResult {
     std::string ascii;
 };
 
+// Position of a result page within the agent's full result set
+struct MemScanPage {
+    int offset = 0;
+    int total = 0;
+};
+
 enum class MemScanAction {
     NONE,
     DUMP,
@@ -29,6 +35,7 @@ struct MemScanSelection {
 
 MemScanSelection show_memscan_tui(const std::vector<MemScanResult>& results);
 
-std::vector<MemScanResult> parse_memscan_json(const std::string& json_response);
+std::vector<MemScanResult> parse_memscan_json(const std::string& json_response,
+                                              MemScanPage* page = nullptr);
 
 #endif
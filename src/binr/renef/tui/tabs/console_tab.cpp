@@ -335,17 +335,18 @@ private:
             return;
         }
 
-        // ms/msj: memory search → results go to Memory tab
-        if (cmd.rfind("ms ", 0) == 0 || cmd.rfind("msj ", 0) == 0) {
+        // ms/msv/msj: memory search → results go to Memory tab
+        if (cmd.rfind("ms ", 0) == 0 || cmd.rfind("msv ", 0) == 0 || cmd.rfind("msj ", 0) == 0) {
             std::string pattern = cmd.substr(cmd.find(' ') + 1);
+            if (cmd.rfind("msv ", 0) == 0) pattern = "--value " + pattern;
             // Always use msj for JSON-parseable output
             CommandAdapter::execute_async("msj " + pattern, state_,
                 [this](const std::string& result) {
-                    auto parsed = parse_memscan_json(result);
-                    int count = (int)parsed.size();
-                    state_->set_scan_results(std::move(parsed));
+                    MemScanPage page;
+                    auto parsed = parse_memscan_json(result, &page);
+                    state_->set_scan_results(std::move(parsed), page);
                     state_->append_console_output(
-                        std::to_string(count) + " result(s) found");
+                        std::to_string(page.total) + " result(s) found");
                     state_->request_view(1); // auto-switch to Memory
                 });
             return;
@@ -144,35 +144,22 @@ private:
                 return;
             }
 
-            // Stream from the main connection's socket
-            int sock = conn.get_socket_fd();
-            char buffer[4096];
-
+            // Stream from the main connection
             while (watching_.load()) {
-                struct pollfd pfd = {sock, POLLIN, 0};
-                int ret = poll(&pfd, 1, 500);
-                if (ret > 0 && (pfd.revents & POLLIN)) {
-                    ssize_t n = recv(sock, buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
-                    if (n > 0) {
-                        buffer[n] = '\0';
-                        state_->append_log(std::string(buffer, n));
-                        state_->request_refresh();
-                    } else if (n == 0) {
-                        state_->append_log("[Watch] connection closed");
-                        state_->request_refresh();
-                        break;
-                    }
+                std::string chunk = conn.receive(500);
+                if (!chunk.empty()) {
+                    state_->append_log(chunk);
+                    state_->request_refresh();
+                } else if (!conn.is_connected()) {
+                    state_->append_log("[Watch] connection closed");
+                    state_->request_refresh();
+                    break;
                 }
             }
 
-            // Exit watch mode on server
-            conn.send("q\n");
-            // Flush remaining data
-            struct pollfd pfd = {sock, POLLIN, 0};
-            if (poll(&pfd, 1, 200) > 0) {
-                char flush[4096];
-                recv(sock, flush, sizeof(flush), MSG_DONTWAIT);
-            }
+            // Exit watch mode on server and flush what it sends on the way out
+            conn.send_input("q\n");
+            conn.receive(200);
 
             watching_.store(false);
             state_->set_watching(false);
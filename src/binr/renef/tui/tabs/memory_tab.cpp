@@ -15,6 +15,7 @@ public:
 
     Element Render() override {
         auto results = state_->get_scan_results();
+        auto page = state_->get_scan_page();
         auto hex_dump = state_->get_hex_dump();
 
         // Scan input line
@@ -25,22 +26,30 @@ public:
                 text("\u2588") | blink | color(Color::Cyan),
             });
         } else {
-            scan_el = text(scan_pattern_.empty() ? "48 89 e5 ..." : scan_pattern_)
+            scan_el = text(scan_pattern_.empty() ? "48 89 e5 ...  or  =u32 100, =next dec" : scan_pattern_)
                 | color(scan_pattern_.empty() ? Color::GrayDark : Color::GrayLight);
         }
 
         auto scan_line = hbox({
-            text(" ms ") | bold | color(Color::Cyan),
+            text(value_mode_ ? " msv " : " ms ") | bold | color(Color::Cyan),
             scan_el | flex,
             text(" Enter") | color(Color::GrayDark),
             text(":search ") | color(Color::GrayDark),
         });
 
+        Element page_line = text("");
+        if (page.total > (int)results.size()) {
+            page_line = text("  " + std::to_string(page.offset + 1) + "-" +
+                             std::to_string(page.offset + (int)results.size()) + " of " +
+                             std::to_string(page.total) + "  n:next  p:prev")
+                | color(Color::GrayDark);
+        }
+
         // Results
         Elements result_rows;
         if (results.empty() && !has_scanned_) {
             result_rows.push_back(
-                text("  s:scan  j/k:nav  Enter:dump  Esc:console") | color(Color::GrayDark));
+                text("  s:scan  j/k:nav  n/p:page  Enter:dump  Esc:console") | color(Color::GrayDark));
         } else if (results.empty()) {
             result_rows.push_back(text("  no matches") | color(Color::GrayDark));
         }
@@ -95,6 +104,7 @@ public:
         content.push_back(scan_line);
         content.push_back(separator() | color(Color::GrayDark));
         content.push_back(results_box | flex);
+        content.push_back(page_line);
 
         if (!hex_rows.empty()) {
             content.push_back(separator() | color(Color::GrayDark));
@@ -141,6 +151,14 @@ public:
             do_dump(results[selected_]);
             return true;
         }
+        if (event == Event::Character('n') || event == Event::Character('p')) {
+            auto page = state_->get_scan_page();
+            int offset = page.offset + (event == Event::Character('n') ? kPageSize : -kPageSize);
+            // Results may come from a console msv as well
+            if (count > 0) value_mode_ = results[0].hex.rfind("= ", 0) == 0;
+            if (offset >= 0 && offset < page.total) do_page(offset);
+            return true;
+        }
         if (event == Event::ArrowUp || event == Event::Character('k')) {
             if (selected_ > 0) selected_--;
             return true;
@@ -156,17 +174,36 @@ public:
     bool Focusable() const override { return true; }
 
 private:
+    // "=<msv args>" runs a value scan, e.g. "=u32 100" then "=next decreased"
     void do_scan() {
         has_scanned_ = true;
-        std::string pattern = scan_pattern_;
-        CommandAdapter::execute_async("msj " + pattern, state_,
+        value_mode_ = scan_pattern_[0] == '=';
+        std::string command = value_mode_ ? "msj --value " + scan_pattern_.substr(1)
+                                          : "msj " + scan_pattern_;
+        CommandAdapter::execute_async(command, state_,
             [this](const std::string& result) {
-                auto parsed = parse_memscan_json(result);
-                state_->set_scan_results(std::move(parsed));
+                MemScanPage page;
+                auto parsed = parse_memscan_json(result, &page);
+                state_->set_scan_results(std::move(parsed), page);
                 selected_ = 0;
             });
     }
 
+    // Hex/ascii context for other pages is rendered by the agent on request
+    void do_page(int offset) {
+        std::string range = std::to_string(offset) + " " + std::to_string(kPageSize);
+        CommandAdapter::execute_async(
+            value_mode_ ? "msj --value list " + range : "msj --page " + range, state_,
+            [this](const std::string& result) {
+                MemScanPage page;
+                auto parsed = parse_memscan_json(result, &page);
+                if (!parsed.empty()) {
+                    state_->set_scan_results(std::move(parsed), page);
+                    selected_ = 0;
+                }
+            });
+    }
+
     void do_dump(const MemScanResult& result) {
         std::stringstream ss;
         ss << "md 0x" << std::hex << result.address << " 256";
@@ -176,10 +213,13 @@ private:
             });
     }
 
+    static constexpr int kPageSize = 100;
+
     std::shared_ptr<TuiState> state_;
     std::string scan_pattern_;
     bool scan_active_ = false;
     bool has_scanned_ = false;
+    bool value_mode_ = false;
     int selected_ = 0;
 };
 
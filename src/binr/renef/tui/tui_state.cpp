@@ -56,9 +56,10 @@ std::vector<HookEntry> TuiState::get_hooks() const {
     return hooks_;
 }
 
-void TuiState::set_scan_results(std::vector<MemScanResult> results) {
+void TuiState::set_scan_results(std::vector<MemScanResult> results, MemScanPage page) {
     std::lock_guard<std::mutex> lock(mutex_);
     scan_results_ = std::move(results);
+    scan_page_ = page;
 }
 
 std::vector<MemScanResult> TuiState::get_scan_results() const {
@@ -66,6 +67,11 @@ std::vector<MemScanResult> TuiState::get_scan_results() const {
     return scan_results_;
 }
 
+MemScanPage TuiState::get_scan_page() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return scan_page_;
+}
+
 void TuiState::set_hex_dump(const std::string& dump) {
     std::lock_guard<std::mutex> lock(mutex_);
     hex_dump_ = dump;
@@ -55,8 +55,9 @@ public:
     std::vector<HookEntry> get_hooks() const;
 
     // Memory scan
-    void set_scan_results(std::vector<MemScanResult> results);
+    void set_scan_results(std::vector<MemScanResult> results, MemScanPage page = {});
     std::vector<MemScanResult> get_scan_results() const;
+    MemScanPage get_scan_page() const;
 
     // Hex dump
     void set_hex_dump(const std::string& dump);
@@ -102,6 +103,7 @@ private:
     std::vector<std::string> console_lines_;
     std::vector<HookEntry> hooks_;
     std::vector<MemScanResult> scan_results_;
+    MemScanPage scan_page_;
     std::string hex_dump_;
     std::vector<ModuleEntry> modules_;
     std::vector<std::string> log_lines_;
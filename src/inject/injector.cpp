@@ -76,6 +76,15 @@ typedef struct {
 
 #endif // __linux__
 
+#include <agent/elf_hash.h>
+
+#ifndef SHT_HASH
+#define SHT_HASH 5
+#endif
+#ifndef SHT_GNU_HASH
+#define SHT_GNU_HASH 0x6ffffff6
+#endif
+
 #ifndef __NR_memfd_create
 #if defined(__aarch64__) || defined(__arm64__)
 #define __NR_memfd_create 279
@@ -240,6 +249,8 @@ uintptr_t find_symbol(const char *lib_path, const char *symbol_name) {
   Elf64_Shdr *dynstr = nullptr;
   Elf64_Shdr *symtab = nullptr;
   Elf64_Shdr *strtab = nullptr;
+  const uint32_t *gnu_hash = nullptr;
+  const uint32_t *sysv_hash = nullptr;
 
   Elf64_Shdr *shstrtab = &shdr[ehdr->e_shstrndx];
   const char *shstrtab_data =
@@ -255,6 +266,13 @@ uintptr_t find_symbol(const char *lib_path, const char *symbol_name) {
       symtab = &shdr[i];
     else if (strcmp(name, ".strtab") == 0)
       strtab = &shdr[i];
+
+    if (shdr[i].sh_type == SHT_GNU_HASH)
+      gnu_hash = reinterpret_cast<const uint32_t *>(
+          static_cast<uint8_t *>(map) + shdr[i].sh_offset);
+    else if (shdr[i].sh_type == SHT_HASH)
+      sysv_hash = reinterpret_cast<const uint32_t *>(
+          static_cast<uint8_t *>(map) + shdr[i].sh_offset);
   }
 
   if (dynsym && dynstr) {
@@ -263,7 +281,18 @@ uintptr_t find_symbol(const char *lib_path, const char *symbol_name) {
     const char *str = static_cast<const char *>(map) + dynstr->sh_offset;
     size_t sym_count = dynsym->sh_size / sizeof(Elf64_Sym);
 
-    for (size_t i = 0; i < sym_count; i++) {
+    // The library's own hash table, when it has one, avoids the full walk
+    long found = -1;
+    if (gnu_hash)
+      found = elf_gnu_lookup(gnu_hash, sym, str, symbol_name);
+    else if (sysv_hash)
+      found = elf_sysv_lookup(sysv_hash, sym, str, symbol_name);
+    if (found >= 0 && sym[found].st_value != 0) {
+      result = sym[found].st_value;
+      goto done;
+    }
+
+    for (size_t i = 0; !gnu_hash && !sysv_hash && i < sym_count; i++) {
       if (sym[i].st_name && sym[i].st_value != 0) {
         if (strcmp(str + sym[i].st_name, symbol_name) == 0) {
           result = sym[i].st_value;
@@ -1,4 +1,6 @@
 #include "renef.h"
+#include <renef/frame_io.h>
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
@@ -10,6 +12,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <string>
 
@@ -21,6 +24,7 @@ struct RenefSession {
     int sock_fd;
     int pid;
     std::string session_key;
+    bool framed = false;
 
     // Watch state
     std::thread watch_thread;
@@ -52,7 +56,44 @@ static int connect_to_server(const char* host, int port) {
     return sock;
 }
 
-static std::string send_command(int sock, const std::string& cmd, int timeout_ms = 5000) {
+// Ask the server for framed replies; an older server answers with an
+// error line and the socket stays on the text protocol.
+static bool negotiate_frames(int sock) {
+    static const char hello[] = "con " FRAME_HELLO "\n";
+    if (send(sock, hello, sizeof(hello) - 1, MSG_NOSIGNAL) != (ssize_t)(sizeof(hello) - 1)) {
+        return false;
+    }
+
+    std::string reply;
+    char c;
+    while (reply.size() < 256) {
+        struct pollfd pfd = {sock, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) <= 0) break;
+        if (recv(sock, &c, 1, 0) <= 0 || c == '\n') break;
+        reply += c;
+    }
+    return reply == "OK frames";
+}
+
+static std::atomic<uint32_t> g_next_request_id{1};
+
+static std::string send_command(int sock, const std::string& cmd, int timeout_ms = 5000,
+                                bool framed = false) {
+    if (framed) {
+        // The END frame ends the reply; no need to guess from its text.
+        std::string payload = cmd;
+        while (!payload.empty() && payload.back() == '\n') payload.pop_back();
+
+        std::string response;
+        FrameReader reader;
+        frame_request(sock, reader, g_next_request_id++, payload, timeout_ms, [&](const Frame& frame) {
+            if (frame.type == FRAME_DATA || frame.type == FRAME_EVENT) {
+                response += frame.payload;
+            }
+        });
+        return response;
+    }
+
     ssize_t sent = send(sock, cmd.c_str(), cmd.length(), 0);
     if (sent < 0) return "";
 
@@ -100,7 +141,8 @@ RenefSession* renef_spawn(const char* package, int hook_type) {
     std::string hook_str = (hook_type == 0) ? "trampoline" : "plt";
     std::string cmd = std::string("spawn ") + package + " --hook=" + hook_str + "\n";
 
-    std::string response = send_command(sock, cmd, 15000);  // 15s timeout for spawn
+    bool framed = negotiate_frames(sock);
+    std::string response = send_command(sock, cmd, 15000, framed);  // 15s timeout for spawn
 
     int pid = 0;
     if (response.find("OK ") == 0) {
@@ -115,6 +157,7 @@ RenefSession* renef_spawn(const char* package, int hook_type) {
     RenefSession* session = new RenefSession();
     session->sock_fd = sock;
     session->pid = pid;
+    session->framed = framed;
 
     return session;
 }
@@ -129,7 +172,8 @@ RenefSession* renef_attach(int pid, int hook_type) {
     char cmd[256];
     snprintf(cmd, sizeof(cmd), "attach %d --hook=%s\n", pid, hook_str.c_str());
 
-    std::string response = send_command(sock, cmd, 10000);
+    bool framed = negotiate_frames(sock);
+    std::string response = send_command(sock, cmd, 10000, framed);
 
     if (response.find("OK") != 0) {
         close(sock);
@@ -139,6 +183,7 @@ RenefSession* renef_attach(int pid, int hook_type) {
     RenefSession* session = new RenefSession();
     session->sock_fd = sock;
     session->pid = pid;
+    session->framed = framed;
 
     return session;
 }
@@ -167,7 +212,7 @@ RenefResult renef_eval(RenefSession* session, const char* lua_code) {
     }
 
     std::string cmd = std::string("exec ") + lua_code + "\n";
-    std::string response = send_command(session->sock_fd, cmd);
+    std::string response = send_command(session->sock_fd, cmd, 5000, session->framed);
 
     result.success = 1;
     result.output = response.empty() ? nullptr : strdup(response.c_str());
@@ -194,7 +239,7 @@ RenefResult renef_load_script(RenefSession* session, const char* path) {
     std::string script = buffer.str();
 
     std::string cmd = "load " + script + "\n";
-    std::string response = send_command(session->sock_fd, cmd, 10000);
+    std::string response = send_command(session->sock_fd, cmd, 10000, session->framed);
 
     result.success = 1;
     result.output = response.empty() ? nullptr : strdup(response.c_str());
@@ -211,7 +256,7 @@ RenefResult renef_memscan(RenefSession* session, const char* pattern) {
     }
 
     std::string cmd = std::string("ms ") + pattern + "\n";
-    std::string response = send_command(session->sock_fd, cmd, 30000);
+    std::string response = send_command(session->sock_fd, cmd, 30000, session->framed);
 
     result.success = 1;
     result.output = response.empty() ? nullptr : strdup(response.c_str());
@@ -234,8 +279,55 @@ uint64_t renef_module_find(RenefSession* session, const char* name) {
     return addr;
 }
 
+// Binary memory commands (mr / mrv / mw) need a framed session: their
+// replies are raw bytes, taken from DATA frames as they arrive. Returns
+// false if the command failed (error END) or timed out.
+static bool binary_request(RenefSession* session, const std::string& cmd,
+                           const std::function<void(const char*, size_t)>& on_data) {
+    FrameReader reader;
+    uint16_t end_flags = 0;
+    bool done = frame_request(session->sock_fd, reader, g_next_request_id++, cmd, 5000,
+        [&](const Frame& frame) {
+            if (frame.type == FRAME_DATA) on_data(frame.payload.data(), frame.payload.size());
+        }, &end_flags);
+    return done && !(end_flags & FRAME_F_ERROR);
+}
+
+static ssize_t read_memory_native(RenefSession* session, uint64_t addr, size_t size, uint8_t* out) {
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "mr %lx %zu", (unsigned long)addr, size);
+
+    // Copied straight into the caller's buffer, frame by frame.
+    size_t got = 0;
+    bool ok = binary_request(session, cmd, [&](const char* data, size_t len) {
+        size_t n = std::min(len, size - got);
+        memcpy(out + got, data, n);
+        got += n;
+    });
+    return ok && got > 0 ? (ssize_t)got : -1;
+}
+
+static ssize_t write_memory_native(RenefSession* session, uint64_t addr, const uint8_t* data, size_t size) {
+    char header[64];
+    snprintf(header, sizeof(header), "mw %lx %zu\n", (unsigned long)addr, size);
+    std::string cmd = header;
+    cmd.append((const char*)data, size);
+
+    std::string reply;
+    bool ok = binary_request(session, cmd, [&](const char* d, size_t len) {
+        reply.append(d, len);
+    });
+
+    unsigned long written = 0;
+    if (!ok || sscanf(reply.c_str(), "OK %lu", &written) != 1) return -1;
+    return (ssize_t)written;
+}
+
 ssize_t renef_read_memory(RenefSession* session, uint64_t addr, size_t size, uint8_t* out) {
     if (!session || !out || size == 0) return -1;
+    if (session->framed) return read_memory_native(session, addr, size, out);
+
+    // Older servers: go through Lua and hex-encode the bytes.
 
     char lua[512];
     snprintf(lua, sizeof(lua),
@@ -268,6 +360,7 @@ ssize_t renef_read_memory(RenefSession* session, uint64_t addr, size_t size, uin
 
 ssize_t renef_write_memory(RenefSession* session, uint64_t addr, const uint8_t* data, size_t size) {
     if (!session || !data || size == 0) return -1;
+    if (session->framed) return write_memory_native(session, addr, data, size);
 
     std::string hex;
     for (size_t i = 0; i < size; i++) {
@@ -288,6 +381,66 @@ ssize_t renef_write_memory(RenefSession* session, uint64_t addr, const uint8_t*
     return success ? (ssize_t)size : -1;
 }
 
+int renef_read_memory_v(RenefSession* session, const RenefMemRange* ranges, size_t count,
+                        uint8_t* out, size_t* lengths) {
+    if (!session || !ranges || !out || !lengths || count == 0) return -1;
+
+    if (!session->framed) {
+        size_t offset = 0;
+        for (size_t i = 0; i < count; i++) {
+            ssize_t n = renef_read_memory(session, ranges[i].addr, ranges[i].size, out + offset);
+            lengths[i] = n > 0 ? (size_t)n : 0;
+            offset += ranges[i].size;
+        }
+        return 0;
+    }
+
+    std::string cmd = "mrv";
+    for (size_t i = 0; i < count; i++) {
+        char range[48];
+        snprintf(range, sizeof(range), " %lx:%zu", (unsigned long)ranges[i].addr, ranges[i].size);
+        cmd += range;
+        lengths[i] = 0;
+    }
+
+    // Reply: per range a u32 LE count, then that many bytes. Bytes go to
+    // the range's slot in `out` as they arrive.
+    size_t index = 0, offset = 0, remaining = 0;
+    uint8_t header[4];
+    size_t header_used = 0;
+    bool ok = binary_request(session, cmd, [&](const char* data, size_t len) {
+        while (len > 0 && index < count) {
+            if (remaining == 0 && header_used < 4) {
+                size_t n = std::min(len, 4 - header_used);
+                memcpy(header + header_used, data, n);
+                header_used += n;
+                data += n;
+                len -= n;
+                if (header_used < 4) break;
+
+                lengths[index] = std::min((size_t)frame_get32(header), ranges[index].size);
+                remaining = lengths[index];
+                if (remaining == 0) {
+                    offset += ranges[index++].size;
+                    header_used = 0;
+                }
+                continue;
+            }
+
+            size_t n = std::min(len, remaining);
+            memcpy(out + offset + (lengths[index] - remaining), data, n);
+            remaining -= n;
+            data += n;
+            len -= n;
+            if (remaining == 0) {
+                offset += ranges[index++].size;
+                header_used = 0;
+            }
+        }
+    });
+    return ok && index == count ? 0 : -1;
+}
+
 int renef_hook(RenefSession* session, const char* lib, uint64_t offset,
                const char* on_enter, const char* on_leave) {
     if (!session || !lib) return -1;
@@ -364,6 +517,11 @@ RenefResult renef_module_symbols(RenefSession* session, const char* name) {
 // Memory read helpers
 uint8_t renef_read_u8(RenefSession* session, uint64_t addr) {
     if (!session) return 0;
+    if (session->framed) {
+        uint8_t val = 0;
+        read_memory_native(session, addr, sizeof(val), (uint8_t*)&val);
+        return val;
+    }
 
     char lua[128];
     snprintf(lua, sizeof(lua), "local v = Memory.readU8(0x%lx); print(v or 0)", (unsigned long)addr);
@@ -379,6 +537,11 @@ uint8_t renef_read_u8(RenefSession* session, uint64_t addr) {
 
 uint16_t renef_read_u16(RenefSession* session, uint64_t addr) {
     if (!session) return 0;
+    if (session->framed) {
+        uint16_t val = 0;
+        read_memory_native(session, addr, sizeof(val), (uint8_t*)&val);
+        return val;
+    }
 
     char lua[128];
     snprintf(lua, sizeof(lua), "local v = Memory.readU16(0x%lx); print(v or 0)", (unsigned long)addr);
@@ -394,6 +557,11 @@ uint16_t renef_read_u16(RenefSession* session, uint64_t addr) {
 
 uint32_t renef_read_u32(RenefSession* session, uint64_t addr) {
     if (!session) return 0;
+    if (session->framed) {
+        uint32_t val = 0;
+        read_memory_native(session, addr, sizeof(val), (uint8_t*)&val);
+        return val;
+    }
 
     char lua[128];
     snprintf(lua, sizeof(lua), "local v = Memory.readU32(0x%lx); print(v or 0)", (unsigned long)addr);
@@ -409,6 +577,11 @@ uint32_t renef_read_u32(RenefSession* session, uint64_t addr) {
 
 uint64_t renef_read_u64(RenefSession* session, uint64_t addr) {
     if (!session) return 0;
+    if (session->framed) {
+        uint64_t val = 0;
+        read_memory_native(session, addr, sizeof(val), (uint8_t*)&val);
+        return val;
+    }
 
     char lua[128];
     snprintf(lua, sizeof(lua), "local v = Memory.readU64(0x%lx); print(v or 0)", (unsigned long)addr);
@@ -437,6 +610,9 @@ RenefResult renef_read_string(RenefSession* session, uint64_t addr, size_t max_l
 // Memory write helpers
 int renef_write_u8(RenefSession* session, uint64_t addr, uint8_t val) {
     if (!session) return -1;
+    if (session->framed) {
+        return write_memory_native(session, addr, (const uint8_t*)&val, sizeof(val)) == sizeof(val) ? 0 : -1;
+    }
 
     char lua[128];
     snprintf(lua, sizeof(lua), "Memory.writeU8(0x%lx, %u)", (unsigned long)addr, val);
@@ -449,6 +625,9 @@ int renef_write_u8(RenefSession* session, uint64_t addr, uint8_t val) {
 
 int renef_write_u16(RenefSession* session, uint64_t addr, uint16_t val) {
     if (!session) return -1;
+    if (session->framed) {
+        return write_memory_native(session, addr, (const uint8_t*)&val, sizeof(val)) == sizeof(val) ? 0 : -1;
+    }
 
     char lua[128];
     snprintf(lua, sizeof(lua), "Memory.writeU16(0x%lx, %u)", (unsigned long)addr, val);
@@ -461,6 +640,9 @@ int renef_write_u16(RenefSession* session, uint64_t addr, uint16_t val) {
 
 int renef_write_u32(RenefSession* session, uint64_t addr, uint32_t val) {
     if (!session) return -1;
+    if (session->framed) {
+        return write_memory_native(session, addr, (const uint8_t*)&val, sizeof(val)) == sizeof(val) ? 0 : -1;
+    }
 
     char lua[128];
     snprintf(lua, sizeof(lua), "Memory.writeU32(0x%lx, %u)", (unsigned long)addr, val);
@@ -473,6 +655,9 @@ int renef_write_u32(RenefSession* session, uint64_t addr, uint32_t val) {
 
 int renef_write_u64(RenefSession* session, uint64_t addr, uint64_t val) {
     if (!session) return -1;
+    if (session->framed) {
+        return write_memory_native(session, addr, (const uint8_t*)&val, sizeof(val)) == sizeof(val) ? 0 : -1;
+    }
 
     char lua[128];
     snprintf(lua, sizeof(lua), "Memory.writeU64(0x%lx, %llu)", (unsigned long)addr, (unsigned long long)val);
@@ -538,7 +723,7 @@ RenefResult renef_hooks_list(RenefSession* session) {
 
     // Send hooks command directly
     std::string cmd = "hooks\n";
-    std::string response = send_command(session->sock_fd, cmd);
+    std::string response = send_command(session->sock_fd, cmd, 5000, session->framed);
 
     result.success = 1;
     result.output = response.empty() ? nullptr : strdup(response.c_str());
@@ -555,6 +740,7 @@ int renef_watch_start(RenefSession* session, RenefMessageCallback callback, void
 
     session->watch_thread = std::thread([session]() {
         char buffer[4096];
+        FrameReader reader;
 
         while (session->watch_running && session->sock_fd >= 0) {
             struct pollfd pfd = {session->sock_fd, POLLIN, 0};
@@ -562,7 +748,15 @@ int renef_watch_start(RenefSession* session, RenefMessageCallback callback, void
 
             if (ret > 0 && (pfd.revents & POLLIN)) {
                 ssize_t n = recv(session->sock_fd, buffer, sizeof(buffer) - 1, 0);
-                if (n > 0) {
+                if (n > 0 && session->framed) {
+                    reader.feed(buffer, (size_t)n);
+                    Frame frame;
+                    while (reader.next(frame)) {
+                        if (frame.type != FRAME_DATA && frame.type != FRAME_EVENT) continue;
+                        session->message_callback(frame.payload.c_str(), frame.payload.size(),
+                                                  session->callback_user_data);
+                    }
+                } else if (n > 0) {
                     buffer[n] = '\0';
                     session->message_callback(buffer, n, session->callback_user_data);
                 } else if (n == 0) {
@@ -17,6 +17,11 @@ typedef struct {
     char* error;
 } RenefResult;
 
+typedef struct {
+    uint64_t addr;
+    size_t size;
+} RenefMemRange;
+
 typedef void (*RenefMessageCallback)(const char* message, size_t len, void* user_data);
 
 RenefSession* renef_spawn(const char* package, int hook_type);
@@ -37,6 +42,10 @@ RenefResult renef_module_symbols(RenefSession* session, const char* name);
 // Memory API
 ssize_t renef_read_memory(RenefSession* session, uint64_t addr, size_t size, uint8_t* out);
 ssize_t renef_write_memory(RenefSession* session, uint64_t addr, const uint8_t* data, size_t size);
+// Reads every range in one round trip. Range i lands at out + (sum of the
+// sizes before it); lengths[i] gets how much of it was readable.
+int renef_read_memory_v(RenefSession* session, const RenefMemRange* ranges, size_t count,
+                        uint8_t* out, size_t* lengths);
 uint8_t renef_read_u8(RenefSession* session, uint64_t addr);
 uint16_t renef_read_u16(RenefSession* session, uint64_t addr);
 uint32_t renef_read_u32(RenefSession* session, uint64_t addr);
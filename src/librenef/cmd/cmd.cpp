@@ -30,13 +30,22 @@ std::unique_ptr<CommandDispatcher> create_eval_command();
 std::unique_ptr<CommandDispatcher> create_load_command();
 std::unique_ptr<CommandDispatcher> create_watch_command();
 std::unique_ptr<CommandDispatcher> create_memscan_command();
+std::unique_ptr<CommandDispatcher> create_memscanpage_command();
+std::unique_ptr<CommandDispatcher> create_memscanvalue_command();
 std::unique_ptr<CommandDispatcher> create_memscanjson_command();
 std::unique_ptr<CommandDispatcher> create_hooks_command();
 std::unique_ptr<CommandDispatcher> create_unhook_command();
 std::unique_ptr<CommandDispatcher> create_sec_command();
 std::unique_ptr<CommandDispatcher> create_memdump_command();
+std::unique_ptr<CommandDispatcher> create_memread_command();
+std::unique_ptr<CommandDispatcher> create_memreadv_command();
+std::unique_ptr<CommandDispatcher> create_memwrite_command();
+std::unique_ptr<CommandDispatcher> create_memdump_stream_command();
+std::unique_ptr<CommandDispatcher> create_module_dump_command();
 std::unique_ptr<CommandDispatcher> create_hookgen_command();
 std::unique_ptr<CommandDispatcher> create_verbose_command();
+std::unique_ptr<CommandDispatcher> create_output_command();
+std::unique_ptr<CommandDispatcher> create_persist_command();
 std::unique_ptr<CommandDispatcher> create_strace_command();
 std::unique_ptr<CommandDispatcher> create_resume_command();
 std::unique_ptr<CommandDispatcher> create_ai_command();
@@ -116,8 +125,9 @@ CommandResult CommandRegistry::dispatch(int client_fd, const char* cmd_buffer, s
     // Drain stale agent output before most commands. Skip for watch —
     // the hook output we want to display may already be in the buffer
     // (hook fired between exec return and watch start).
-    if (sock.is_connected() && cmd_name != "watch") {
-        sock.drain_buffer();
+    SocketHelper& agent = get_socket_helper();
+    if (agent.is_connected() && cmd_name != "watch") {
+        agent.drain_buffer();
     }
 
     return it->second->dispatch(client_fd, cmd_buffer, cmd_size);
@@ -133,13 +143,22 @@ void CommandRegistry::setup_all_commands() {
     register_command(create_load_command());
     register_command(create_watch_command());
     register_command(create_memscan_command());
+    register_command(create_memscanpage_command());
+    register_command(create_memscanvalue_command());
     register_command(create_memscanjson_command());
     register_command(create_hooks_command());
     register_command(create_unhook_command());
     register_command(create_sec_command());
     register_command(create_memdump_command());
+    register_command(create_memread_command());
+    register_command(create_memreadv_command());
+    register_command(create_memwrite_command());
+    register_command(create_memdump_stream_command());
+    register_command(create_module_dump_command());
     register_command(create_hookgen_command());
     register_command(create_verbose_command());
+    register_command(create_output_command());
+    register_command(create_persist_command());
     register_command(create_strace_command());
     register_command(create_resume_command());
     register_command(create_ai_command());
@@ -157,12 +176,85 @@ int CommandRegistry::get_current_pid() const {
 }
 
 void CommandRegistry::set_current_pid(int pid) {
-    if (current_pid > 0 && pid != current_pid) {
-        sock.close_connection();
+    if (current_pid > 0 && pid != current_pid && target_refs[current_pid] <= 0) {
+        close_target(current_pid);
     }
     current_pid = pid;
 }
 
+void CommandRegistry::select_target(int pid) {
+    current_pid = pid;
+}
+
+void CommandRegistry::retain_target(int pid) {
+    if (pid > 0) target_refs[pid]++;
+}
+
+void CommandRegistry::release_target(int pid) {
+    auto it = target_refs.find(pid);
+    if (it == target_refs.end()) return;
+    if (--it->second > 0) return;
+
+    target_refs.erase(it);
+    if (pid != current_pid) {
+        close_target(pid);
+    }
+}
+
+void CommandRegistry::close_target(int pid) {
+    std::lock_guard<std::mutex> lock(agents_lock);
+    auto it = agents.find(pid);
+    if (it != agents.end()) {
+        it->second->close_connection();
+        agents.erase(it);
+    }
+}
+
+void CommandRegistry::for_each_agent(const std::function<void(int pid, SocketHelper&)>& fn) {
+    std::lock_guard<std::mutex> lock(agents_lock);
+    for (auto& [pid, agent] : agents) {
+        fn(pid, *agent);
+    }
+}
+
+bool CommandRegistry::with_agent(int pid, const std::function<void(SocketHelper&)>& fn) {
+    std::lock_guard<std::mutex> lock(agents_lock);
+    auto it = agents.find(pid);
+    if (it == agents.end() || !it->second) return false;
+    fn(*it->second);
+    return true;
+}
+
+void CommandRegistry::set_event_sink(std::function<void(int pid, uint32_t channel, const char*, size_t)> sink) {
+    std::lock_guard<std::mutex> lock(agents_lock);
+    event_sink = std::move(sink);
+    for (auto& [pid, agent] : agents) {
+        int target = pid;
+        if (event_sink) {
+            agent->set_event_sink([this, target](uint32_t channel, const char* data, size_t len) {
+                event_sink(target, channel, data, len);
+            });
+        } else {
+            agent->set_event_sink(nullptr);
+        }
+    }
+}
+
 SocketHelper& CommandRegistry::get_socket_helper() {
-    return sock;
+    if (current_pid <= 0) {
+        return sock;
+    }
+
+    std::lock_guard<std::mutex> lock(agents_lock);
+    std::unique_ptr<SocketHelper>& agent = agents[current_pid];
+    if (!agent) {
+        agent.reset(new SocketHelper());
+        if (event_sink) {
+            int target = current_pid;
+            agent->set_event_sink([this, target](uint32_t channel, const char* data, size_t len) {
+                event_sink(target, channel, data, len);
+            });
+        }
+    }
+    return *agent;
 }
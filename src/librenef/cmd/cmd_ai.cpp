@@ -187,10 +187,9 @@ static std::string exec_on_agent(SocketHelper& sock, int pid, const std::string&
 
     int timeout = 0;
     while (timeout < 30) {
-        struct pollfd pfd = {fd, POLLIN, 0};
-        int ret = poll(&pfd, 1, 100);
+        int ret = sock.wait_data(100);
         if (ret > 0) {
-            ssize_t n = recv(fd, buf, sizeof(buf) - 1, 0);
+            ssize_t n = sock.receive_data(buf, sizeof(buf) - 1);
             if (n > 0) {
                 buf[n] = '\0';
                 output += buf;
@@ -113,7 +113,6 @@ public:
                          size_t cmd_size) override {
     AttachParams params = parse_attach_params(cmd_buffer, cmd_size);
     std::string session_key = generate_auth_key();
-    SocketHelper &sock = CommandRegistry::instance().get_socket_helper();
 
     if (params.pid <= 0) {
       const char *error_msg = "ERROR: Invalid PID\n";
@@ -124,15 +123,13 @@ public:
     bool is_injected = inject(params.pid, RENEF_PAYLOAD_PATH);
     if (is_injected) {
 
-      sock.close_connection();
+      // The connection belongs to the pid, so look it up after switching.
       CommandRegistry::instance().set_current_pid(params.pid);
+      SocketHelper &sock = CommandRegistry::instance().get_socket_helper();
 
-      int con_pid = sock.ensure_connection(params.pid);
-      std::string con_cmd = "con " + session_key + "\n";
-      ssize_t con_payload =
-          sock.send_data(con_cmd.c_str(), con_cmd.length(), false);
-
-      sock.set_session_key(session_key);
+      sock.close_connection();
+      sock.ensure_connection(params.pid);
+      sock.establish_session(session_key);
     }
 
     const char *response = is_injected ? "OK\n" : "FAIL\n";
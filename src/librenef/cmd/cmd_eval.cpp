@@ -48,14 +48,35 @@ public:
 
         const char* lua_code = cmd_buffer + 5;
 
+        int gated = CommandRegistry::instance().gated_pid;
+        bool need_resume = (gated > 0 && gated == pid);
+
+        if (socket_helper.is_framed()) {
+            // The END frame marks completion; no need to scan for the
+            // "Lua executed" banner or wait out a quiet period.
+            int total_bytes = 0;
+            bool ok = socket_helper.request(std::string("exec ") + lua_code,
+                [&](const char* data, size_t len) {
+                    total_bytes += (int)len;
+                    write(client_fd, data, len);
+                }, need_resume ? 500 : 5000);
+
+            fprintf(stderr, "[eval-debug] framed request done: ok=%d, total_bytes=%d\n", ok, total_bytes);
+
+            if (need_resume) {
+                fprintf(stderr, "[spawn-gate] Script delivered (%d bytes), resuming (pid=%d)\n",
+                        total_bytes, gated);
+                ptrace_resume(gated);
+                CommandRegistry::instance().gated_pid = -1;
+            }
+            return CommandResult(true, "Eval executed");
+        }
+
         std::string command = std::string("exec ") + lua_code + "\n";
         fprintf(stderr, "[DEBUG exec] Sending %zu bytes to agent\n", command.length());
         ssize_t sent = socket_helper.send_data(command.c_str(), command.length());
         fprintf(stderr, "[DEBUG exec] Actually sent %zd bytes\n", sent);
 
-        int gated = CommandRegistry::instance().gated_pid;
-        bool need_resume = (gated > 0 && gated == pid);
-
         int flags = fcntl(sock, F_GETFL, 0);
         fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 
@@ -1,10 +1,13 @@
 #include <renef/cmd.h>
 #include <renef/socket_helper.h>
+#include <renef/symcache.h>
 #include <cstdio>
 #include <string>
+#include <vector>
 #include <unistd.h>
 #include <sstream>
 #include <cstring>
+#include <poll.h>
 #include <sys/socket.h>
 
 static std::string generate_hook_template(const std::string& lib_name, const std::string& offset_str) {
@@ -23,6 +26,98 @@ static std::string generate_hook_template(const std::string& lib_name, const std
     return ss.str();
 }
 
+static const int kSymsIdleTimeoutMs = 5000;
+
+// Read one "syms" reply: everything from the SYMS header through END, or
+// a single ERROR line. Hook output sharing the socket is skipped.
+static bool read_syms_reply(SocketHelper& agent, std::string& reply) {
+    std::string pending;
+    char buffer[8192];
+    int idle_ms = 0;
+    bool in_reply = false;
+
+    reply.clear();
+    while (idle_ms < kSymsIdleTimeoutMs) {
+        int ret = agent.wait_data(100);
+        if (ret == 0) {
+            idle_ms += 100;
+            continue;
+        }
+        if (ret < 0) {
+            return false;
+        }
+
+        ssize_t n = agent.receive_data(buffer, sizeof(buffer));
+        if (n <= 0) {
+            return false;
+        }
+        idle_ms = 0;
+        pending.append(buffer, n);
+
+        size_t start = 0;
+        size_t nl;
+        while ((nl = pending.find('\n', start)) != std::string::npos) {
+            size_t len = nl - start;
+            if (!in_reply) {
+                if (pending.compare(start, 6, "ERROR:") == 0) {
+                    reply = pending.substr(start, len + 1);
+                    return true;
+                }
+                in_reply = pending.compare(start, 5, "SYMS ") == 0;
+            }
+            if (in_reply) {
+                reply.append(pending, start, len + 1);
+                if (len == 3 && pending.compare(start, 3, "END") == 0) {
+                    return true;
+                }
+            }
+            start = nl + 1;
+        }
+        pending.erase(0, start);
+    }
+    return false;
+}
+
+// Ask the agent for the module's key first; only pull the whole table
+// when neither this server nor an earlier session has it on disk.
+static std::shared_ptr<const SymbolTable> load_symbols(SocketHelper& socket_helper,
+                                                        const std::string& lib, std::string& error) {
+    std::string reply;
+    std::string command = "syms -k " + lib + "\n";
+    if (socket_helper.send_data(command.c_str(), command.length()) <= 0 ||
+        !read_syms_reply(socket_helper, reply)) {
+        error = "ERROR: Failed to query symbols from agent\n";
+        return nullptr;
+    }
+    if (reply.compare(0, 6, "ERROR:") == 0) {
+        error = reply;
+        return nullptr;
+    }
+
+    std::string key, path;
+    if (!SymbolCache::parse_header(reply.substr(0, reply.find('\n')), key, path)) {
+        error = "ERROR: Unexpected reply from agent\n";
+        return nullptr;
+    }
+
+    std::shared_ptr<const SymbolTable> table = SymbolCache::instance().get(key);
+    if (table) {
+        return table;
+    }
+
+    command = "syms " + lib + "\n";
+    if (socket_helper.send_data(command.c_str(), command.length()) <= 0 ||
+        !read_syms_reply(socket_helper, reply)) {
+        error = "ERROR: Failed to fetch symbols from agent\n";
+        return nullptr;
+    }
+    table = SymbolCache::instance().put(reply);
+    if (!table) {
+        error = reply.compare(0, 6, "ERROR:") == 0 ? reply : "ERROR: Incomplete symbol table from agent\n";
+    }
+    return table;
+}
+
 class HookGen : public CommandDispatcher {
 public:
     std::string get_name() const override {
@@ -82,86 +177,38 @@ public:
             return CommandResult(false, "Connection failed");
         }
 
-        std::string lua_code;
+        std::vector<std::string> libs;
         std::string symbol_name;
-        std::string target_lib;
 
         if (parsed == 1) {
             symbol_name = arg1;
-            target_lib = "";
+            libs = {"libc.so", "libm.so", "libdl.so", "liblog.so", "libart.so"};
         } else {
-            target_lib = arg1;
+            libs = {arg1};
             symbol_name = arg2;
         }
 
-        lua_code = "local function find_symbol(lib, sym)\n"
-                   "  local exports = Module.exports(lib)\n"
-                   "  if not exports then return nil end\n"
-                   "  for i, exp in ipairs(exports) do\n"
-                   "    if exp.name == sym then\n"
-                   "      return exp.offset\n"
-                   "    end\n"
-                   "  end\n"
-                   "  return nil\n"
-                   "end\n";
-
-        if (target_lib.empty()) {
-            lua_code += "local libs = {'libc.so', 'libm.so', 'libdl.so', 'liblog.so', 'libart.so'}\n"
-                       "for _, lib in ipairs(libs) do\n"
-                       "  local offset = find_symbol(lib, '" + symbol_name + "')\n"
-                       "  if offset then\n"
-                       "    print('FOUND:' .. lib .. ':' .. string.format('0x%x', offset))\n"
-                       "    return\n"
-                       "  end\n"
-                       "end\n"
-                       "print('ERROR:Symbol not found')\n";
-        } else {
-            lua_code += "local offset = find_symbol('" + target_lib + "', '" + symbol_name + "')\n"
-                       "if offset then\n"
-                       "  print('FOUND:" + target_lib + ":' .. string.format('0x%x', offset))\n"
-                       "else\n"
-                       "  print('ERROR:Symbol not found in " + target_lib + "')\n"
-                       "end\n";
-        }
-
-        std::string command = "exec " + lua_code + "\n";
-        ssize_t sent = socket_helper.send_data(command.c_str(), command.length());
+        std::string last_error;
+        for (const auto& lib : libs) {
+            std::shared_ptr<const SymbolTable> table = load_symbols(socket_helper, lib, last_error);
+            if (!table) continue;
 
-        if (sent <= 0) {
-            const char* error = "ERROR: Failed to send command to agent\n";
-            write(client_fd, error, strlen(error));
-            return CommandResult(false, "Send failed");
-        }
+            const CachedSymbol* sym = table->find(symbol_name);
+            if (!sym) continue;
 
-        char buffer[8192];
-        ssize_t n = recv(sock, buffer, sizeof(buffer) - 1, 0);
-
-        if (n <= 0) {
-            const char* error = "ERROR: Failed to receive response\n";
-            write(client_fd, error, strlen(error));
-            return CommandResult(false, "Receive failed");
+            char offset_str[32];
+            snprintf(offset_str, sizeof(offset_str), "0x%llx", (unsigned long long)sym->value);
+            std::string template_code = generate_hook_template(lib, offset_str);
+            write(client_fd, template_code.c_str(), template_code.length());
+            return CommandResult(true, "Template generated");
         }
 
-        buffer[n] = '\0';
-        std::string response(buffer);
-
-        if (response.find("FOUND:") == 0) {
-            size_t colon1 = response.find(':', 6);
-            if (colon1 != std::string::npos) {
-                std::string found_lib = response.substr(6, colon1 - 6);
-                std::string offset_str = response.substr(colon1 + 1);
-
-                if (!offset_str.empty() && offset_str.back() == '\n') {
-                    offset_str.pop_back();
-                }
-
-                std::string template_code = generate_hook_template(found_lib, offset_str);
-                write(client_fd, template_code.c_str(), template_code.length());
-                return CommandResult(true, "Template generated");
-            }
+        std::string error = libs.size() == 1 ? "ERROR: Symbol not found in " + libs[0] + "\n"
+                                             : "ERROR: Symbol not found\n";
+        if (!last_error.empty() && libs.size() == 1) {
+            error = last_error;
         }
-
-        write(client_fd, response.c_str(), response.length());
+        write(client_fd, error.c_str(), error.length());
         return CommandResult(false, "Symbol not found");
     }
 };
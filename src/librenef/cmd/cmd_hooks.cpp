@@ -37,12 +37,11 @@ public:
         const char* cmd = "hooks\n";
         socket_helper.send_data(cmd, strlen(cmd));
 
-        char buffer[1024];
-        struct pollfd pfd = {sock, POLLIN, 0};
-        int ret = poll(&pfd, 1, 2000);
+        char buffer[4096];
+        int ret = socket_helper.wait_data(2000);
 
-        if (ret > 0 && (pfd.revents & POLLIN)) {
-            ssize_t n = ::recv(sock, buffer, sizeof(buffer) - 1, 0);
+        if (ret > 0) {
+            ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
             if (n > 0) {
                 buffer[n] = '\0';
                 write(client_fd, buffer, n);
@@ -91,11 +90,10 @@ public:
         socket_helper.send_data(cmd.c_str(), cmd.size());
 
         char buffer[256];
-        struct pollfd pfd = {sock, POLLIN, 0};
-        int ret = poll(&pfd, 1, 2000);
+        int ret = socket_helper.wait_data(2000);
 
-        if (ret > 0 && (pfd.revents & POLLIN)) {
-            ssize_t n = ::recv(sock, buffer, sizeof(buffer) - 1, 0);
+        if (ret > 0) {
+            ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
             if (n > 0) {
                 buffer[n] = '\0';
                 write(client_fd, buffer, n);
@@ -116,7 +114,7 @@ public:
     }
 
     std::string get_description() const override {
-        return "Toggle verbose mode: verbose [on|off]";
+        return "Toggle verbose mode: verbose [on|off|trace [sync]]";
     }
 
     CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
@@ -144,11 +142,10 @@ public:
         socket_helper.send_data(cmd.c_str(), cmd.size());
 
         char buffer[256];
-        struct pollfd pfd = {sock, POLLIN, 0};
-        int ret = poll(&pfd, 1, 2000);
+        int ret = socket_helper.wait_data(2000);
 
-        if (ret > 0 && (pfd.revents & POLLIN)) {
-            ssize_t n = ::recv(sock, buffer, sizeof(buffer) - 1, 0);
+        if (ret > 0) {
+            ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
             if (n > 0) {
                 buffer[n] = '\0';
                 write(client_fd, buffer, n);
@@ -162,6 +159,110 @@ public:
     }
 };
 
+class OutputCommand : public CommandDispatcher {
+public:
+    std::string get_name() const override {
+        return "output";
+    }
+
+    std::string get_description() const override {
+        return "Event output control: output [hook|strace|log] [drop-newest|drop-oldest|block|pause|resume]";
+    }
+
+    CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
+        int pid = CommandRegistry::instance().get_current_pid();
+
+        if (pid <= 0) {
+            const char* error_msg = "ERROR: No target PID set. Please attach/spawn first.\n";
+            write(client_fd, error_msg, strlen(error_msg));
+            return CommandResult(false, "No target PID set");
+        }
+
+        SocketHelper& socket_helper = CommandRegistry::instance().get_socket_helper();
+        int sock = socket_helper.ensure_connection(pid);
+
+        if (sock < 0) {
+            const char* error_msg = "ERROR: Failed to connect to agent\n";
+            write(client_fd, error_msg, strlen(error_msg));
+            return CommandResult(false, "Socket connection failed");
+        }
+
+        std::string cmd(cmd_buffer, cmd_size);
+        if (cmd.empty() || cmd.back() != '\n') {
+            cmd += "\n";
+        }
+        socket_helper.send_data(cmd.c_str(), cmd.size());
+
+        char buffer[256];
+        int ret = socket_helper.wait_data(2000);
+
+        if (ret > 0) {
+            ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
+            if (n > 0) {
+                buffer[n] = '\0';
+                write(client_fd, buffer, n);
+            }
+        } else {
+            const char* error = "ERROR: No response from agent\n";
+            write(client_fd, error, strlen(error));
+        }
+
+        return CommandResult(true, "Output policy updated");
+    }
+};
+
+class PersistCommand : public CommandDispatcher {
+public:
+    std::string get_name() const override {
+        return "persist";
+    }
+
+    std::string get_description() const override {
+        return "Keep hooks installed after the last client disconnects: persist [on|off]";
+    }
+
+    CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
+        int pid = CommandRegistry::instance().get_current_pid();
+
+        if (pid <= 0) {
+            const char* error_msg = "ERROR: No target PID set. Please attach/spawn first.\n";
+            write(client_fd, error_msg, strlen(error_msg));
+            return CommandResult(false, "No target PID set");
+        }
+
+        SocketHelper& socket_helper = CommandRegistry::instance().get_socket_helper();
+        int sock = socket_helper.ensure_connection(pid);
+
+        if (sock < 0) {
+            const char* error_msg = "ERROR: Failed to connect to agent\n";
+            write(client_fd, error_msg, strlen(error_msg));
+            return CommandResult(false, "Socket connection failed");
+        }
+
+        std::string cmd(cmd_buffer, cmd_size);
+        if (cmd.empty() || cmd.back() != '\n') {
+            cmd += "\n";
+        }
+        socket_helper.send_data(cmd.c_str(), cmd.size());
+
+        char buffer[256];
+        int ret = socket_helper.wait_data(2000);
+
+        if (ret > 0) {
+            ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
+            if (n > 0) {
+                buffer[n] = '\0';
+                write(client_fd, buffer, n);
+            }
+        } else {
+            const char* error = "ERROR: No response from agent\n";
+            write(client_fd, error, strlen(error));
+        }
+
+        return CommandResult(true, "Persist mode updated");
+    }
+};
+
 std::unique_ptr<CommandDispatcher> create_hooks_command() {
     return std::make_unique<HooksCommand>();
 }
@@ -173,3 +274,11 @@ std::unique_ptr<CommandDispatcher> create_unhook_command() {
 std::unique_ptr<CommandDispatcher> create_verbose_command() {
     return std::make_unique<VerboseCommand>();
 }
+
+std::unique_ptr<CommandDispatcher> create_output_command() {
+    return std::make_unique<OutputCommand>();
+}
+
+std::unique_ptr<CommandDispatcher> create_persist_command() {
+    return std::make_unique<PersistCommand>();
+}
@@ -50,22 +50,8 @@ public:
 
         char buffer[4096];
         ssize_t n;
-        int agent_fd = socket_helper.get_socket_fd();
-
         while (true) {
-            fd_set read_fds;
-            FD_ZERO(&read_fds);
-            FD_SET(agent_fd, &read_fds);
-
-            struct timeval timeout;
-            timeout.tv_sec = 0;
-            timeout.tv_usec = 200000;
-
-            int select_result = select(agent_fd + 1, &read_fds, NULL, NULL, &timeout);
-
-            if (select_result < 0) {
-                break;
-            } else if (select_result == 0) {
+            if (socket_helper.wait_data(200) <= 0) {
                 break;
             }
 
@@ -70,12 +70,25 @@ public:
         }
 
         std::string hex = hex_encode(lua_script);
-        std::string command = "hexexec " + hex + "\n";
-        socket_helper.send_data(command.c_str(), command.length());
-
         int gated = CommandRegistry::instance().gated_pid;
         bool need_resume = (gated > 0 && gated == pid);
 
+        if (socket_helper.is_framed()) {
+            socket_helper.request("hexexec " + hex, [&](const char* data, size_t len) {
+                write(client_fd, data, len);
+            }, 5000);
+
+            if (need_resume) {
+                fprintf(stderr, "[spawn-gate] Script delivered, resuming (pid=%d)\n", gated);
+                ptrace_resume(gated);
+                CommandRegistry::instance().gated_pid = -1;
+            }
+            return CommandResult(true, "Script loaded and executed");
+        }
+
+        std::string command = "hexexec " + hex + "\n";
+        socket_helper.send_data(command.c_str(), command.length());
+
         int flags = fcntl(sock, F_GETFL, 0);
         fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 
@@ -85,11 +98,10 @@ public:
         const int max_timeout = 50;
 
         while (!script_done && timeout_count < max_timeout) {
-            struct pollfd pfd = {sock, POLLIN, 0};
-            int ret = poll(&pfd, 1, 100);
+            int ret = socket_helper.wait_data(100);
 
-            if (ret > 0 && (pfd.revents & POLLIN)) {
-                ssize_t n = recv(sock, buffer, sizeof(buffer) - 1, 0);
+            if (ret > 0) {
+                ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
                 if (n > 0) {
                     buffer[n] = '\0';
                     write(client_fd, buffer, n);
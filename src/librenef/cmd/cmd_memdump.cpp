@@ -2,6 +2,7 @@
 #include <renef/socket_helper.h>
 #include <renef/string_utils.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
 #include <sstream>
 #include <iomanip>
@@ -181,6 +182,197 @@ public:
     }
 };
 
+// mr / mrv / mw: binary memory access. The agent's reply is raw bytes,
+// so it is passed through untouched and needs a framed agent connection
+// to know where it ends.
+static bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static CommandResult forward_binary(int client_fd, const std::string& agent_cmd, int timeout_ms = 5000) {
+    int pid = CommandRegistry::instance().get_current_pid();
+    if (pid <= 0) {
+        const char* error = "ERROR: No target PID set. Please attach/spawn first.\n";
+        write(client_fd, error, strlen(error));
+        return CommandResult(false, "No PID");
+    }
+
+    SocketHelper& socket_helper = CommandRegistry::instance().get_socket_helper();
+    if (socket_helper.ensure_connection(pid) < 0) {
+        const char* error = "ERROR: Failed to connect to agent\n";
+        write(client_fd, error, strlen(error));
+        return CommandResult(false, "Connection failed");
+    }
+    if (!socket_helper.is_framed()) {
+        const char* error = "ERROR: Agent does not support binary memory commands (update the agent)\n";
+        write(client_fd, error, strlen(error));
+        return CommandResult(false, "Agent not framed");
+    }
+
+    bool ok = socket_helper.request(agent_cmd, [&](const char* data, size_t len) {
+        write_all(client_fd, data, len);
+    }, timeout_ms);
+    return CommandResult(ok, ok ? "Memory transferred" : "Memory access failed");
+}
+
+// First line of a command, without the trailing newline
+static std::string command_line(const char* cmd_buffer, size_t cmd_size) {
+    std::string line(cmd_buffer, cmd_size);
+    size_t end = line.find_first_of("\r\n");
+    if (end != std::string::npos) line.resize(end);
+    return line;
+}
+
+class MemReadCommand : public CommandDispatcher {
+public:
+    std::string get_name() const override {
+        return "mr";
+    }
+
+    std::string get_description() const override {
+        return "Read raw memory bytes (mr <addr> <size>), binary reply";
+    }
+
+    CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
+        std::vector<std::string> parts = split(command_line(cmd_buffer, cmd_size), ' ');
+        if (parts.size() < 3) {
+            const char* error = "Usage: mr <address> <size>\n";
+            write(client_fd, error, strlen(error));
+            return CommandResult(false, "Invalid arguments");
+        }
+
+        uint64_t address = 0;
+        size_t size = 0;
+        try {
+            address = std::stoull(parts[1], nullptr, 16);
+            size = std::stoull(parts[2]);
+        } catch (const std::exception& e) {
+            const char* error = "ERROR: Invalid address or size\n";
+            write(client_fd, error, strlen(error));
+            return CommandResult(false, "Invalid arguments");
+        }
+
+        std::stringstream cmd;
+        cmd << "mr " << std::hex << address << " " << std::dec << size;
+        return forward_binary(client_fd, cmd.str());
+    }
+};
+
+class MemReadvCommand : public CommandDispatcher {
+public:
+    std::string get_name() const override {
+        return "mrv";
+    }
+
+    std::string get_description() const override {
+        return "Read several memory ranges (mrv <addr>:<size> ...), each as u32 length + bytes";
+    }
+
+    CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
+        std::string line = command_line(cmd_buffer, cmd_size);
+        if (line.size() <= 4) {
+            const char* error = "Usage: mrv <address>:<size> [<address>:<size> ...]\n";
+            write(client_fd, error, strlen(error));
+            return CommandResult(false, "Invalid arguments");
+        }
+        return forward_binary(client_fd, line);
+    }
+};
+
+class MemWriteCommand : public CommandDispatcher {
+public:
+    std::string get_name() const override {
+        return "mw";
+    }
+
+    std::string get_description() const override {
+        return "Write raw memory bytes (mw <addr> <size> + newline + data, framed clients)";
+    }
+
+    CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
+        // Forwarded byte for byte: the data follows the first newline.
+        std::string cmd(cmd_buffer, cmd_size);
+        if (cmd.find('\n') == std::string::npos) {
+            const char* error = "Usage: mw <address> <size>\\n<data>\n";
+            write(client_fd, error, strlen(error));
+            return CommandResult(false, "Invalid arguments");
+        }
+        return forward_binary(client_fd, cmd);
+    }
+};
+
+class MemDumpStreamCommand : public CommandDispatcher {
+public:
+    std::string get_name() const override {
+        return "mdump";
+    }
+
+    std::string get_description() const override {
+        return "Stream a large dump (mdump <addr> <size> | <module> [from=<off>] [lz4]), binary records";
+    }
+
+    CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
+        std::string line = command_line(cmd_buffer, cmd_size);
+        if (split(line, ' ').size() < 2) {
+            const char* error = "Usage: mdump <address> <size> | <module> [from=<offset>] [lz4]\n";
+            write(client_fd, error, strlen(error));
+            return CommandResult(false, "Invalid arguments");
+        }
+        // Records are written as the agent produces them; the timeout only
+        // covers a stall between two of them.
+        return forward_binary(client_fd, line, 30000);
+    }
+};
+
+class ModuleDumpCommand : public CommandDispatcher {
+public:
+    std::string get_name() const override {
+        return "dumpmod";
+    }
+
+    std::string get_description() const override {
+        return "Stream a module's loaded segments (dumpmod <lib> [from=<off>] [raw]), binary records";
+    }
+
+    CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
+        std::string line = command_line(cmd_buffer, cmd_size);
+        if (split(line, ' ').size() < 2) {
+            const char* error = "Usage: dumpmod <lib> [from=<offset>] [raw]\n";
+            write(client_fd, error, strlen(error));
+            return CommandResult(false, "Invalid arguments");
+        }
+        return forward_binary(client_fd, line, 30000);
+    }
+};
+
 std::unique_ptr<CommandDispatcher> create_memdump_command() {
     return std::make_unique<MemDumpCommand>();
 }
+
+std::unique_ptr<CommandDispatcher> create_memread_command() {
+    return std::make_unique<MemReadCommand>();
+}
+
+std::unique_ptr<CommandDispatcher> create_memreadv_command() {
+    return std::make_unique<MemReadvCommand>();
+}
+
+std::unique_ptr<CommandDispatcher> create_memwrite_command() {
+    return std::make_unique<MemWriteCommand>();
+}
+
+
+std::unique_ptr<CommandDispatcher> create_memdump_stream_command() {
+    return std::make_unique<MemDumpStreamCommand>();
+}
+
+std::unique_ptr<CommandDispatcher> create_module_dump_command() {
+    return std::make_unique<ModuleDumpCommand>();
+}
\ No newline at end of file
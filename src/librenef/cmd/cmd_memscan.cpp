@@ -3,8 +3,8 @@
 #include <cstdio>
 #include <string>
 #include <cstring>
+#include <functional>
 #include <unistd.h>
-#include <fcntl.h>
 #include <poll.h>
 #include <sys/socket.h>
 #include <sstream>
@@ -13,55 +13,130 @@
 
 using json = nlohmann::json;
 
-static std::string format_memscan_response(const std::string& json_response) {
-    std::ostringstream out;
-
-    try {
-        json j = json::parse(json_response);
+// The agent only keeps its most recent scan; msp pages through it by id.
+static int g_last_scan_id = 0;
 
-        if (!j.value("success", false)) {
-            out << "Error: " << j.value("error", "Unknown error") << "\n";
-            return out.str();
-        }
+static const int kScanIdleTimeoutMs = 30000;
 
-        int count = j.value("count", 0);
+// Read the agent's NDJSON records, handing hit records to on_hit, until a
+// terminal record (done, page or error) arrives. Lines that are not JSON
+// (hook output sharing the socket) are skipped.
+static bool read_scan_records(SocketHelper& agent, const std::function<void(const json&)>& on_hit, json& terminal) {
+    std::string pending;
+    char buffer[8192];
+    int idle_ms = 0;
 
-        if (count == 0) {
-            out << "No matches found.\n";
-            return out.str();
+    while (idle_ms < kScanIdleTimeoutMs) {
+        int ret = agent.wait_data(100);
+        if (ret == 0) {
+            idle_ms += 100;
+            continue;
+        }
+        if (ret < 0) {
+            return false;
         }
 
-        out << "Found " << count << " match(es):\n";
-        out << std::string(60, '-') << "\n";
-
-        int result_num = 1;
-        for (const auto& item : j["results"]) {
-            std::string library = item.value("library", "");
-            long offset = item.value("offset", 0L);
-            unsigned long address = item.value("address", 0UL);
-            std::string hex = item.value("hex", "");
-            std::string ascii = item.value("ascii", "");
-
-            out << "[" << result_num++ << "] ";
-            if (!library.empty()) {
-                out << library << " + 0x" << std::hex << offset << std::dec;
-                out << " (addr: 0x" << std::hex << address << std::dec << ")\n";
-            } else {
-                out << "0x" << std::hex << offset << std::dec << "\n";
+        ssize_t n = agent.receive_data(buffer, sizeof(buffer));
+        if (n <= 0) {
+            return false;
+        }
+        idle_ms = 0;
+        pending.append(buffer, n);
+
+        size_t start = 0;
+        size_t nl;
+        while ((nl = pending.find('\n', start)) != std::string::npos) {
+            std::string line = pending.substr(start, nl - start);
+            start = nl + 1;
+            if (line.empty() || line[0] != '{') continue;
+
+            json record = json::parse(line, nullptr, false);
+            if (record.is_discarded()) continue;
+
+            std::string type = record.value("type", "");
+            if (type == "hit") {
+                on_hit(record);
+            } else if (type == "done" || type == "page" || type == "error") {
+                terminal = record;
+                return true;
             }
-            out << "    Hex:   " << hex << "\n";
-            out << "    ASCII: " << ascii << "\n";
         }
+        pending.erase(0, start);
+    }
+    return false;
+}
 
-        out << std::string(60, '-') << "\n";
+static void write_str(int client_fd, const std::string& s) {
+    write(client_fd, s.c_str(), s.length());
+}
+
+static std::string format_hit(const json& item) {
+    std::ostringstream out;
+    std::string library = item.value("library", "");
+    long offset = item.value("offset", 0L);
+    unsigned long address = item.value("address", 0UL);
 
-    } catch (const json::exception& e) {
-        out << "Error parsing response: " << e.what() << "\n";
+    out << "[" << item.value("index", 0) + 1 << "] ";
+    if (item.contains("pattern")) {
+        out << "(pattern " << item.value("pattern", 0) << ") ";
+    }
+    if (!library.empty()) {
+        out << library << " + 0x" << std::hex << offset << std::dec;
+        out << " (addr: 0x" << std::hex << address << std::dec << ")\n";
+    } else {
+        out << "0x" << std::hex << address << std::dec << "\n";
     }
+    out << "    Hex:   " << item.value("hex", "") << "\n";
+    out << "    ASCII: " << item.value("ascii", "") << "\n";
+    return out.str();
+}
 
+static std::string format_value_hit(const json& item) {
+    std::ostringstream out;
+    std::string library = item.value("library", "");
+
+    out << "[" << item.value("index", 0) + 1 << "] 0x" << std::hex << item.value("address", 0UL);
+    if (!library.empty()) {
+        out << " (" << library << " + 0x" << item.value("offset", 0L) << ")";
+    }
+    out << std::dec << " = " << item.value("value", "") << "\n";
     return out.str();
 }
 
+static std::string trim_args(const char* cmd_buffer, size_t cmd_size, size_t skip) {
+    if (cmd_size <= skip) return "";
+    std::string args(cmd_buffer + skip, cmd_size - skip);
+    while (!args.empty() && isspace(args.back())) args.pop_back();
+    while (!args.empty() && isspace(args.front())) args.erase(0, 1);
+    return args;
+}
+
+static int connect_agent(int client_fd, bool as_json) {
+    int pid = CommandRegistry::instance().get_current_pid();
+
+    if (pid <= 0) {
+        const char* error_msg = as_json ? "{\"success\":false,\"error\":\"No target PID set\"}\n"
+                                        : "ERROR: No target PID set. Please attach/spawn first.\n";
+        write(client_fd, error_msg, strlen(error_msg));
+        return -1;
+    }
+
+    int sock = CommandRegistry::instance().get_socket_helper().ensure_connection(pid);
+    if (sock < 0) {
+        const char* error_msg = as_json ? "{\"success\":false,\"error\":\"Failed to connect to agent\"}\n"
+                                        : "ERROR: Failed to connect to agent\n";
+        write(client_fd, error_msg, strlen(error_msg));
+    }
+    return sock;
+}
+
+static std::string page_request(const std::string& args) {
+    int offset = 0, count = 100;
+    sscanf(args.c_str(), "%d %d", &offset, &count);
+    return "msp " + std::to_string(g_last_scan_id) + " " + std::to_string(offset) + " " +
+           std::to_string(count) + "\n";
+}
+
 class MemScan : public CommandDispatcher {
 public:
     std::string get_name() const override {
@@ -69,201 +144,243 @@ public:
     }
 
     std::string get_description() const override {
-        return "Scan memory for a hex pattern. Usage: ms <hex_pattern>";
+        return "Scan memory for hex patterns (?? = any byte, | separates patterns). Usage: ms <hex_pattern>[|<hex_pattern>...]";
     }
 
     CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
-        int pid = CommandRegistry::instance().get_current_pid();
-
-        if (pid <= 0) {
-            const char* error_msg = "ERROR: No target PID set. Please attach/spawn first.\n";
-            write(client_fd, error_msg, strlen(error_msg));
-            return CommandResult(false, "No target PID set");
-        }
-
-        SocketHelper& socket_helper = CommandRegistry::instance().get_socket_helper();
-        int sock = socket_helper.ensure_connection(pid);
-
+        int sock = connect_agent(client_fd, false);
         if (sock < 0) {
-            const char* error_msg = "ERROR: Failed to connect to agent\n";
-            write(client_fd, error_msg, strlen(error_msg));
             return CommandResult(false, "Socket connection failed");
         }
 
-        if (cmd_size <= 3) {
-            const char* error = "ERROR: Usage: ms <hex_pattern>\nExample: ms FFFF or ms 4A617661\n";
+        std::string hex_pattern = trim_args(cmd_buffer, cmd_size, 3);
+        if (hex_pattern.empty()) {
+            const char* error = "ERROR: Usage: ms <hex_pattern>[|<hex_pattern>...]\nExample: ms FFFF, ms 4A617661 or ms 4A61??61|FF 43 01 D1\n";
             write(client_fd, error, strlen(error));
             return CommandResult(false, "No pattern provided");
         }
 
-        std::string hex_pattern(cmd_buffer + 3, cmd_size - 3);
-
-        while (!hex_pattern.empty() && isspace(hex_pattern.back())) {
-            hex_pattern.pop_back();
-        }
-
         std::string command = "ms " + hex_pattern + "\n";
-        socket_helper.send_data(command.c_str(), command.length());
-
-        int flags = fcntl(sock, F_GETFL, 0);
-        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
-
-        char buffer[8192];
-        std::string response;
-        int timeout_count = 0;
-        const int max_timeout = 100;
-
-        while (timeout_count < max_timeout) {
-            struct pollfd pfd = {sock, POLLIN, 0};
-            int ret = poll(&pfd, 1, 100);
-
-            if (ret > 0 && (pfd.revents & POLLIN)) {
-                ssize_t n = recv(sock, buffer, sizeof(buffer) - 1, 0);
-                if (n > 0) {
-                    buffer[n] = '\0';
-                    response += buffer;
-
-                    size_t json_end = response.find("}\n");
-                    if (json_end != std::string::npos) {
-                        response = response.substr(0, json_end + 2);
-                        break;
-                    }
-                    timeout_count = 0;
-                } else if (n == 0) {
-                    break;
-                }
-            } else if (ret == 0) {
-                timeout_count++;
-            } else {
-                break;
-            }
+        CommandRegistry::instance().get_socket_helper().send_data(command.c_str(), command.length());
+
+        write_str(client_fd, std::string(60, '-') + "\n");
+        int shown = 0;
+        json terminal;
+        bool ok = read_scan_records(CommandRegistry::instance().get_socket_helper(), [&](const json& hit) {
+            write_str(client_fd, format_hit(hit));
+            shown++;
+        }, terminal);
+
+        if (!ok) {
+            write_str(client_fd, "ERROR: No response from agent\n");
+            return CommandResult(false, "Memory scan timed out");
         }
-
-        char drain_buffer[1024];
-        while (true) {
-            struct pollfd pfd = {sock, POLLIN, 0};
-            int ret = poll(&pfd, 1, 10);
-            if (ret > 0 && (pfd.revents & POLLIN)) {
-                ssize_t n = recv(sock, drain_buffer, sizeof(drain_buffer), 0);
-                if (n <= 0) break;
-            } else {
-                break;
-            }
+        if (terminal.value("type", "") == "error") {
+            write_str(client_fd, "Error: " + terminal.value("error", "Unknown error") + "\n");
+            return CommandResult(false, "Memory scan failed");
         }
 
-        fcntl(sock, F_SETFL, flags);
+        g_last_scan_id = terminal.value("scan", 0);
+        int total = terminal.value("count", 0);
 
-        if (!response.empty()) {
-            std::string formatted = format_memscan_response(response);
-            write(client_fd, formatted.c_str(), formatted.length());
+        std::ostringstream out;
+        out << std::string(60, '-') << "\n";
+        if (total == 0) {
+            out << "No matches found.\n";
         } else {
-            const char* error = "ERROR: No response from agent\n";
-            write(client_fd, error, strlen(error));
+            out << "Found " << total << " match(es)";
+            if (terminal.value("truncated", false)) out << " (limit reached)";
+            out << "\n";
+            if (shown < total) {
+                out << "Showing 1-" << shown << ". Use 'msp <offset> [count]' for more.\n";
+            }
         }
+        write_str(client_fd, out.str());
 
         return CommandResult(true, "Memory scan completed");
     }
 };
 
-class MemScanJson : public CommandDispatcher {
+class MemScanPage : public CommandDispatcher {
 public:
     std::string get_name() const override {
-        return "msj";
+        return "msp";
     }
 
     std::string get_description() const override {
-        return "Memory scan with JSON output (for TUI). Usage: msj <hex_pattern>";
+        return "Page through the last ms results. Usage: msp <offset> [count]";
     }
 
     CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
-        int pid = CommandRegistry::instance().get_current_pid();
+        if (g_last_scan_id == 0) {
+            write_str(client_fd, "ERROR: No scan results, run ms first\n");
+            return CommandResult(false, "No scan");
+        }
+
+        int sock = connect_agent(client_fd, false);
+        if (sock < 0) {
+            return CommandResult(false, "Socket connection failed");
+        }
 
-        if (pid <= 0) {
-            const char* error_msg = "{\"success\":false,\"error\":\"No target PID set\"}\n";
-            write(client_fd, error_msg, strlen(error_msg));
-            return CommandResult(false, "No target PID set");
+        std::string command = page_request(trim_args(cmd_buffer, cmd_size, 4));
+        CommandRegistry::instance().get_socket_helper().send_data(command.c_str(), command.length());
+
+        json terminal;
+        bool ok = read_scan_records(CommandRegistry::instance().get_socket_helper(), [&](const json& hit) {
+            write_str(client_fd, format_hit(hit));
+        }, terminal);
+
+        if (!ok) {
+            write_str(client_fd, "ERROR: No response from agent\n");
+            return CommandResult(false, "Memory scan page timed out");
         }
+        if (terminal.value("type", "") == "error") {
+            write_str(client_fd, "Error: " + terminal.value("error", "Unknown error") + "\n");
+            return CommandResult(false, "Memory scan page failed");
+        }
+
+        int offset = terminal.value("offset", 0);
+        int count = terminal.value("count", 0);
+        std::ostringstream out;
+        out << "Showing " << (count ? offset + 1 : offset) << "-" << offset + count
+            << " of " << terminal.value("total", 0) << "\n";
+        write_str(client_fd, out.str());
+
+        return CommandResult(true, "Memory scan page completed");
+    }
+};
+
+class MemScanValue : public CommandDispatcher {
+public:
+    std::string get_name() const override {
+        return "msv";
+    }
+
+    std::string get_description() const override {
+        return "Incremental value scan. Usage: msv <u8..u64|i8..i64|f32|f64>[:align] [eq|ne|gt|lt|range] <value> [value2] | "
+               "msv next <eq|ne|gt|lt|range|changed|unchanged|increased|decreased> [value] [value2] | "
+               "msv list [offset] [count] | msv reset";
+    }
 
-        SocketHelper& socket_helper = CommandRegistry::instance().get_socket_helper();
-        int sock = socket_helper.ensure_connection(pid);
+    CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
+        std::string args = trim_args(cmd_buffer, cmd_size, 4);
+        if (args.empty()) {
+            write_str(client_fd, "ERROR: Usage: msv u32 100, then msv next increased / msv next eq 95\n");
+            return CommandResult(false, "No arguments");
+        }
 
+        int sock = connect_agent(client_fd, false);
         if (sock < 0) {
-            const char* error_msg = "{\"success\":false,\"error\":\"Failed to connect to agent\"}\n";
-            write(client_fd, error_msg, strlen(error_msg));
             return CommandResult(false, "Socket connection failed");
         }
 
-        if (cmd_size <= 4) {
-            const char* error = "{\"success\":false,\"error\":\"No pattern provided\"}\n";
-            write(client_fd, error, strlen(error));
-            return CommandResult(false, "No pattern provided");
-        }
+        std::string command = "msv " + args + "\n";
+        CommandRegistry::instance().get_socket_helper().send_data(command.c_str(), command.length());
 
-        std::string hex_pattern(cmd_buffer + 4, cmd_size - 4);
+        int shown = 0;
+        json terminal;
+        bool ok = read_scan_records(CommandRegistry::instance().get_socket_helper(), [&](const json& hit) {
+            write_str(client_fd, format_value_hit(hit));
+            shown++;
+        }, terminal);
 
-        while (!hex_pattern.empty() && isspace(hex_pattern.back())) {
-            hex_pattern.pop_back();
+        if (!ok) {
+            write_str(client_fd, "ERROR: No response from agent\n");
+            return CommandResult(false, "Value scan timed out");
+        }
+        std::string type = terminal.value("type", "");
+        if (type == "error") {
+            write_str(client_fd, "Error: " + terminal.value("error", "Unknown error") + "\n");
+            return CommandResult(false, "Value scan failed");
         }
 
-        std::string command = "ms " + hex_pattern + "\n";
-        socket_helper.send_data(command.c_str(), command.length());
-
-        int flags = fcntl(sock, F_GETFL, 0);
-        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
-
-        char buffer[8192];
-        std::string response;
-        int timeout_count = 0;
-        const int max_timeout = 100;
-
-        while (timeout_count < max_timeout) {
-            struct pollfd pfd = {sock, POLLIN, 0};
-            int ret = poll(&pfd, 1, 100);
-
-            if (ret > 0 && (pfd.revents & POLLIN)) {
-                ssize_t n = recv(sock, buffer, sizeof(buffer) - 1, 0);
-                if (n > 0) {
-                    buffer[n] = '\0';
-                    response += buffer;
-
-                    size_t json_end = response.find("}\n");
-                    if (json_end != std::string::npos) {
-                        response = response.substr(0, json_end + 2);
-                        break;
-                    }
-                    timeout_count = 0;
-                } else if (n == 0) {
-                    break;
-                }
-            } else if (ret == 0) {
-                timeout_count++;
-            } else {
-                break;
+        std::ostringstream out;
+        if (type == "page") {
+            int offset = terminal.value("offset", 0);
+            out << "Showing " << (shown ? offset + 1 : offset) << "-" << offset + shown
+                << " of " << terminal.value("total", 0) << "\n";
+        } else if (terminal.value("scans", 0) == 0) {
+            out << "Value scan reset\n";
+        } else {
+            long count = terminal.value("count", 0L);
+            out << count << " candidate(s) after scan " << terminal.value("scans", 0)
+                << " (" << terminal.value("value_type", "") << ")\n";
+            if (shown < count) {
+                out << "Showing 1-" << shown << ". Use 'msv list <offset> [count]' for more.\n";
             }
         }
+        write_str(client_fd, out.str());
 
-        char drain_buffer[1024];
-        while (true) {
-            struct pollfd pfd = {sock, POLLIN, 0};
-            int ret = poll(&pfd, 1, 10);
-            if (ret > 0 && (pfd.revents & POLLIN)) {
-                ssize_t n = recv(sock, drain_buffer, sizeof(drain_buffer), 0);
-                if (n <= 0) break;
-            } else {
-                break;
-            }
+        return CommandResult(true, "Value scan completed");
+    }
+};
+
+// Collects the stream into one JSON object for the TUI and scripts:
+//   msj <hex_pattern>              first page of a new scan
+//   msj --page <offset> [count]    another page of the last scan
+//   msj --value <msv arguments>    value scan (hits carry "value")
+class MemScanJson : public CommandDispatcher {
+public:
+    std::string get_name() const override {
+        return "msj";
+    }
+
+    std::string get_description() const override {
+        return "Memory scan with JSON output (for TUI). Usage: msj <hex_pattern> | msj --page <offset> [count] | msj --value <msv args>";
+    }
+
+    CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size) override {
+        int sock = connect_agent(client_fd, true);
+        if (sock < 0) {
+            return CommandResult(false, "Socket connection failed");
         }
 
-        fcntl(sock, F_SETFL, flags);
+        std::string args = trim_args(cmd_buffer, cmd_size, 4);
+        if (args.empty()) {
+            const char* error = "{\"success\":false,\"error\":\"No pattern provided\"}\n";
+            write(client_fd, error, strlen(error));
+            return CommandResult(false, "No pattern provided");
+        }
 
-        if (!response.empty()) {
-            write(client_fd, response.c_str(), response.length());
+        std::string command;
+        if (args.rfind("--page", 0) == 0) {
+            command = page_request(args.substr(6));
+        } else if (args.rfind("--value", 0) == 0) {
+            command = "msv " + trim_args(args.c_str(), args.length(), 7) + "\n";
         } else {
-            const char* error = "{\"success\":false,\"error\":\"No response from agent\"}\n";
-            write(client_fd, error, strlen(error));
+            command = "ms " + args + "\n";
+        }
+        CommandRegistry::instance().get_socket_helper().send_data(command.c_str(), command.length());
+
+        json results = json::array();
+        json terminal;
+        bool ok = read_scan_records(CommandRegistry::instance().get_socket_helper(), [&](const json& hit) {
+            json item = hit;
+            item.erase("type");
+            results.push_back(std::move(item));
+        }, terminal);
+
+        json response;
+        if (!ok) {
+            response = {{"success", false}, {"error", "No response from agent"}};
+        } else if (terminal.value("type", "") == "error") {
+            response = {{"success", false}, {"error", terminal.value("error", "Unknown error")}};
+        } else {
+            if (terminal.value("type", "") == "done" && terminal.contains("scan")) {
+                g_last_scan_id = terminal.value("scan", 0);
+            }
+            response = {
+                {"success", true},
+                {"scan", terminal.value("scan", 0)},
+                {"offset", terminal.value("offset", 0)},
+                {"count", (int)results.size()},
+                {"total", terminal.contains("total") ? terminal.value("total", 0) : terminal.value("count", 0)},
+                {"results", results},
+            };
         }
+        write_str(client_fd, response.dump() + "\n");
 
-        return CommandResult(true, "Memory scan JSON completed");
+        return CommandResult(ok, "Memory scan JSON completed");
     }
 };
 
@@ -271,6 +388,14 @@ std::unique_ptr<CommandDispatcher> create_memscan_command() {
     return std::make_unique<MemScan>();
 }
 
+std::unique_ptr<CommandDispatcher> create_memscanpage_command() {
+    return std::make_unique<MemScanPage>();
+}
+
+std::unique_ptr<CommandDispatcher> create_memscanvalue_command() {
+    return std::make_unique<MemScanValue>();
+}
+
 std::unique_ptr<CommandDispatcher> create_memscanjson_command() {
     return std::make_unique<MemScanJson>();
 }
@@ -40,14 +40,13 @@ public:
         socket_helper.send_data(cmd.c_str(), cmd.size());
 
         char buffer[4096];
-        struct pollfd pfd = {sock, POLLIN, 0};
 
         int timeout_count = 0;
         while (timeout_count < 20) {
-            int ret = poll(&pfd, 1, 100);
+            int ret = socket_helper.wait_data(100);
 
-            if (ret > 0 && (pfd.revents & POLLIN)) {
-                ssize_t n = ::recv(sock, buffer, sizeof(buffer) - 1, 0);
+            if (ret > 0) {
+                ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
                 if (n > 0) {
                     buffer[n] = '\0';
                     write(client_fd, buffer, n);
@@ -108,7 +108,6 @@ public:
     auto spawn_start = std::chrono::steady_clock::now();
 
     std::string session_key = generate_auth_key();
-    SocketHelper &sock = CommandRegistry::instance().get_socket_helper();
 
     if (params.pkg_name.empty()) {
       const char *error_msg = "ERROR: Invalid package name\n";
@@ -182,13 +181,10 @@ public:
 
       // Close old agent connection BEFORE establishing new one
       CommandRegistry::instance().set_current_pid(pid);
+      SocketHelper &sock = CommandRegistry::instance().get_socket_helper();
 
-      int con_pid = sock.ensure_connection(pid);
-      std::string con_cmd = "con " + session_key + "\n";
-      ssize_t con_payload =
-          sock.send_data(con_cmd.c_str(), con_cmd.length(), false);
-
-      sock.set_session_key(session_key);
+      sock.ensure_connection(pid);
+      sock.establish_session(session_key);
 
       if (params.pause) {
         // Main thread is ptrace-stopped. Script will be sent next.
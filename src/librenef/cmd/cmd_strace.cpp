@@ -42,6 +42,16 @@ public:
 
         std::string lua_code;
 
+        // renef-strace asks for binary records and decodes them itself
+        bool binary = false;
+        size_t bin_pos = args.find("--binary");
+        if (bin_pos != std::string::npos) {
+            binary = true;
+            args.erase(bin_pos, 8);
+            while (!args.empty() && args.back() == ' ') args.pop_back();
+            while (!args.empty() && args.front() == ' ') args.erase(0, 1);
+        }
+
         if (args.empty() || args == "--help" || args == "-h") {
             const char* help =
                 "Usage: renef-strace <syscalls|options>\n"
@@ -50,7 +60,8 @@ public:
                 "  renef-strace -a                        Trace all syscalls\n"
                 "  renef-strace --list                   List available syscalls\n"
                 "  renef-strace --active                 Show active traces\n"
-                "  renef-strace --stop                   Stop all tracing\n";
+                "  renef-strace --stop                   Stop all tracing\n"
+                "  renef-strace ... --binary              Emit binary records (for the renef-strace tool)\n";
             write(client_fd, help, strlen(help));
             return CommandResult(true, "Help shown");
         }
@@ -97,6 +108,10 @@ public:
             return CommandResult(false, "Socket connection failed");
         }
 
+        if (binary && lua_code.rfind("Syscall.trace", 0) == 0) {
+            lua_code = "Syscall.binary(true) " + lua_code;
+        }
+
         std::string exec_cmd = "exec " + lua_code + "\n";
         socket_helper.send_data(exec_cmd.c_str(), exec_cmd.size());
 
@@ -105,12 +120,11 @@ public:
             fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 
             char buffer[4096];
-            struct pollfd pfd = {sock, POLLIN, 0};
 
             for (int attempt = 0; attempt < 4; attempt++) {
-                int ret = poll(&pfd, 1, 500);
-                if (ret > 0 && (pfd.revents & POLLIN)) {
-                    ssize_t n = recv(sock, buffer, sizeof(buffer) - 1, 0);
+                int ret = socket_helper.wait_data(500);
+                if (ret > 0) {
+                    ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
                     if (n > 0) {
                         buffer[n] = '\0';
                         write(client_fd, buffer, n);
@@ -143,14 +157,20 @@ public:
 
             if (ret > 0) {
                 if (pfds[0].revents & POLLIN) {
-                    ssize_t n = recv(sock, buffer, sizeof(buffer) - 1, 0);
-                    if (n > 0) {
-                        write(client_fd, buffer, n);
-                    } else if (n == 0) {
-                        const char* msg = "Agent disconnected\n";
-                        write(client_fd, msg, strlen(msg));
-                        running = false;
-                    }
+                    // One framed read can decode more than a buffer's worth.
+                    do {
+                        ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
+                        if (n > 0) {
+                            write(client_fd, buffer, n);
+                        } else {
+                            if (n == 0) {
+                                const char* msg = "Agent disconnected\n";
+                                write(client_fd, msg, strlen(msg));
+                                running = false;
+                            }
+                            break;
+                        }
+                    } while (socket_helper.is_framed() && socket_helper.wait_data(0) > 0);
                 }
 
                 if (pfds[1].revents & (POLLHUP | POLLERR)) {
@@ -175,11 +195,10 @@ public:
         socket_helper.send_data(stop_cmd.c_str(), stop_cmd.size());
 
         {
-            struct pollfd drain_pfd = {sock, POLLIN, 0};
             for (int i = 0; i < 10; i++) {
-                int ret = poll(&drain_pfd, 1, 100);
-                if (ret > 0 && (drain_pfd.revents & POLLIN)) {
-                    ssize_t n = recv(sock, buffer, sizeof(buffer) - 1, 0);
+                int ret = socket_helper.wait_data(100);
+                if (ret > 0) {
+                    ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
                     if (n <= 0) break;
                 } else {
                     break;
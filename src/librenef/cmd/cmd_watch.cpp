@@ -48,8 +48,8 @@ public:
             fcntl(sock, F_SETFL, old_flags | O_NONBLOCK);
             char buf[4096];
             ssize_t drained_total = 0;
-            while (true) {
-                ssize_t n = recv(sock, buf, sizeof(buf), 0);
+            while (socket_helper.wait_data(0) > 0) {
+                ssize_t n = socket_helper.receive_data(buf, sizeof(buf));
                 if (n > 0) {
                     write(client_fd, buf, n);
                     drained_total += n;
@@ -96,17 +96,23 @@ public:
 
             if (ret > 0) {
                 if (pfds[0].revents & POLLIN) {
-                    ssize_t n = recv(sock, buffer, sizeof(buffer) - 1, 0);
-                    fprintf(stderr, "[WATCH] recv from agent: n=%zd\n", n);
-                    if (n > 0) {
-                        buffer[n] = '\0';
-                        fprintf(stderr, "[WATCH] Forwarding to client: %.*s\n", (int)n, buffer);
-                        write(client_fd, buffer, n);
-                    } else if (n == 0) {
-                        const char* msg = "Agent disconnected\n";
-                        write(client_fd, msg, strlen(msg));
-                        running = false;
-                    }
+                    // One framed read can decode more than a buffer's worth.
+                    do {
+                        ssize_t n = socket_helper.receive_data(buffer, sizeof(buffer) - 1);
+                        fprintf(stderr, "[WATCH] recv from agent: n=%zd\n", n);
+                        if (n > 0) {
+                            buffer[n] = '\0';
+                            fprintf(stderr, "[WATCH] Forwarding to client: %.*s\n", (int)n, buffer);
+                            write(client_fd, buffer, n);
+                        } else {
+                            if (n == 0) {
+                                const char* msg = "Agent disconnected\n";
+                                write(client_fd, msg, strlen(msg));
+                                running = false;
+                            }
+                            break;
+                        }
+                    } while (socket_helper.is_framed() && socket_helper.wait_data(0) > 0);
                 }
 
                 if (pfds[1].revents & (POLLHUP | POLLERR)) {
@@ -133,9 +139,8 @@ public:
 
         {
             char drain_buf[4096];
-            struct pollfd drain_pfd = {sock, POLLIN, 0};
-            while (poll(&drain_pfd, 1, 50) > 0 && (drain_pfd.revents & POLLIN)) {
-                ssize_t n = recv(sock, drain_buf, sizeof(drain_buf), 0);
+            while (socket_helper.wait_data(50) > 0) {
+                ssize_t n = socket_helper.receive_data(drain_buf, sizeof(drain_buf));
                 if (n <= 0) break;
             }
         }
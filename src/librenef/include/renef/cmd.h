@@ -3,7 +3,9 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <vector>
+#include <functional>
 #include <renef/socket_helper.h>
 
 struct CommandResult {
@@ -52,11 +54,27 @@ public:
 
     int current_pid = -1;
     int gated_pid = -1;  // PID that is SIGSTOP'd waiting for first exec
-    SocketHelper sock;
+    SocketHelper sock;   // used while no target is set
 
     int get_current_pid() const;
     void set_current_pid(int pid);
 
+    // Several clients of one server can target different agents. Each
+    // target pid has its own agent connection; a client holds a reference
+    // on its target, and a connection is closed once the last reference
+    // goes and the current pid moves elsewhere.
+    void retain_target(int pid);
+    void release_target(int pid);
+    // Make pid current without closing anything (switching between clients)
+    void select_target(int pid);
+    void for_each_agent(const std::function<void(int pid, SocketHelper&)>& fn);
+    // Runs fn on pid's connection, if there is one, without letting it be
+    // closed meanwhile; for threads other than the one running commands.
+    bool with_agent(int pid, const std::function<void(SocketHelper&)>& fn);
+
+    // Agent events of every connection go to sink (see SocketHelper::set_event_sink)
+    void set_event_sink(std::function<void(int pid, uint32_t channel, const char*, size_t)> sink);
+
     void register_command(std::unique_ptr<CommandDispatcher> cmd);
 
     CommandResult dispatch(int client_fd, const char* cmd_buffer, size_t cmd_size);
@@ -76,4 +94,11 @@ private:
     CommandRegistry& operator=(const CommandRegistry&) = delete;
 
     std::map<std::string, std::unique_ptr<CommandDispatcher>> commands;
+
+    std::mutex agents_lock;     // the agents map; the connections lock themselves
+    std::map<int, std::unique_ptr<SocketHelper>> agents;
+    std::map<int, int> target_refs;
+    std::function<void(int, uint32_t, const char*, size_t)> event_sink;
+
+    void close_target(int pid);
 };
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <agent/dump.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Writes an "mdump" record stream (agent/dump.h) into a file as it
+ * arrives. DATA records land at their offset, LZ4 ones decoded first;
+ * holes are left as zeros. The stream may be fed in pieces of any size.
+ */
+class DumpFileWriter {
+public:
+    DumpFileWriter() = default;
+    ~DumpFileWriter();
+    DumpFileWriter(const DumpFileWriter&) = delete;
+    DumpFileWriter& operator=(const DumpFileWriter&) = delete;
+
+    /**
+     * Open (create) the output file. With resume, an existing file is
+     * kept and resume_offset() is where the dump should continue: its
+     * size rounded down to a whole chunk.
+     */
+    bool open(const std::string& path, bool resume);
+    uint64_t resume_offset() const { return resume_offset_; }
+
+    /** False once the stream is malformed or a write failed; see error(). */
+    bool feed(const char* data, size_t len);
+
+    /** Sizes the file to where the dump stopped and closes it. */
+    bool finish();
+
+    bool complete() const { return complete_; }
+    const std::string& info() const { return info_; }
+    const std::string& error() const { return error_; }
+
+    uint64_t data_bytes() const { return data_bytes_; }
+    uint64_t stored_bytes() const { return stored_bytes_; }
+    uint64_t hole_bytes() const { return hole_bytes_; }
+    uint32_t holes() const { return holes_; }
+    uint64_t end_offset() const { return end_offset_; }
+
+private:
+    bool record(const DumpRecord& rec, const uint8_t* payload);
+    bool write_at(uint64_t offset, const uint8_t* data, size_t len);
+    bool fail(const std::string& msg);
+
+    int fd_ = -1;
+    std::string buffer_;
+    std::vector<uint8_t> scratch_;
+    std::string info_;
+    std::string error_;
+    bool complete_ = false;
+    uint64_t resume_offset_ = 0;
+    uint64_t data_bytes_ = 0;
+    uint64_t stored_bytes_ = 0;
+    uint64_t hole_bytes_ = 0;
+    uint32_t holes_ = 0;
+    uint64_t end_offset_ = 0;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Turns a module image written by "dumpmod" (PT_LOAD segments at their
+ * offset from the lowest one) into an ELF file other tools can load:
+ * program headers are pointed at the image layout, dynamic entries that
+ * the loader rebased are made relative again and section headers are
+ * rebuilt from the dynamic table (the originals are not loaded), plus
+ * one .text/.rodata/.data section for the rest of each segment. Segment
+ * contents are left as dumped, relocations included.
+ */
+struct ElfRebuildInfo {
+    int segments = 0;
+    int sections = 0;           // section headers written, null included
+    int dynamic_fixed = 0;      // dynamic entries rebased to 0
+    uint64_t symbols = 0;       // .dynsym entries
+};
+
+/** Rewrites the image at path in place. load_base is where it was mapped. */
+bool rebuild_elf_image(const std::string& path, uint64_t load_base, ElfRebuildInfo& info,
+                       std::string& error);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <agent/frame.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+
+struct Frame {
+    uint8_t type = 0;
+    uint16_t flags = 0;
+    uint32_t id = 0;
+    std::string payload;
+};
+
+/**
+ * Incremental decoder for a framed stream. Bytes that arrive outside a
+ * frame (text written before framing was negotiated) are kept aside
+ * instead of breaking the stream; take_text() hands them out.
+ */
+class FrameReader {
+public:
+    void feed(const char* data, size_t len);
+    bool next(Frame& out);
+    bool has_frame() const { return !frames_.empty(); }
+    std::string take_text();
+    void clear();
+
+private:
+    std::string buffer_;
+    std::string text_;
+    std::deque<Frame> frames_;
+};
+
+/** Write one frame (header and payload), retrying short writes. */
+bool frame_send(int fd, uint8_t type, uint16_t flags, uint32_t id, const void* data, size_t len);
+
+/**
+ * Read whatever is available on fd into reader, waiting up to timeout_ms
+ * (-1 = forever) for the first byte. 1 = read something, 0 = timeout,
+ * -1 = error or peer closed.
+ */
+int frame_pump(int fd, FrameReader& reader, int timeout_ms);
+
+/**
+ * Send a REQUEST and hand every frame that arrives to on_frame until the
+ * END for `id`. Frames for other ids (EVENTs, leftovers) go to on_frame
+ * too. Gives up after idle_timeout_ms without any frame; returns false then.
+ */
+bool frame_request(int fd, FrameReader& reader, uint32_t id, const std::string& payload,
+                   int idle_timeout_ms, const std::function<void(const Frame&)>& on_frame,
+                   uint16_t* end_flags = nullptr);
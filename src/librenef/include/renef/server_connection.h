@@ -1,7 +1,9 @@
 #pragma once
 
+#include <functional>
 #include <string>
 #include <mutex>
+#include <renef/frame_io.h>
 
 class ServerConnection {
 public:
@@ -14,11 +16,34 @@ public:
     bool send(const std::string& data);
     std::string receive(int timeout_ms = 2000);
 
+    // Ask the server for the framed protocol. Old servers answer with an
+    // error line and the connection stays on plain text.
+    bool enable_framing(int timeout_ms = 1000);
+    bool is_framed() const;
+
+    // Keystrokes for the command that is running (watch/strace 'q')
+    bool send_input(const std::string& data);
+
+    // Run one command and collect its output up to the END frame; gives up
+    // after idle_timeout_ms without output. Falls back to send + receive
+    // on a text connection.
+    std::string request(const std::string& command, int idle_timeout_ms = 10000);
+
+    // Same, but hands DATA payloads to on_data as they arrive instead of
+    // collecting them (bulk transfers). Framed connections only; false if
+    // the END never came or carried FRAME_F_ERROR.
+    bool request_stream(const std::string& command,
+                        const std::function<void(const char*, size_t)>& on_data,
+                        int idle_timeout_ms = 30000);
+
+    // Throw away output left over from earlier commands
+    void drain();
+
     // Connection parameters (for creating additional connections)
     std::string get_host() const;
     int get_port() const;
 
-    // Raw socket fd for direct poll/recv (watch streaming)
+    // Raw socket fd for direct poll/recv (watch streaming, text mode only)
     int get_socket_fd() const;
 
 private:
@@ -27,8 +52,15 @@ private:
     ServerConnection(const ServerConnection&) = delete;
     ServerConnection& operator=(const ServerConnection&) = delete;
 
+    void close_locked();
+
     int sock_fd;
     std::mutex mtx;
+
+    bool framed_ = false;
+    FrameReader reader_;
+    uint32_t next_id_ = 1;
+    uint32_t active_id_ = 0;        // request whose END receive() stops at
     std::string connected_host_;
     int connected_port_ = 0;
 };
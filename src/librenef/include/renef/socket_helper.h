@@ -2,12 +2,18 @@
 #include <sys/types.h>
 #include <string>
 #include <memory>
+#include <functional>
+#include <mutex>
+#include <renef/frame_io.h>
 
 class ITransport;
 
 /**
  * Socket helper class for managing agent connections
  * Now uses ITransport for platform-agnostic communication
+ *
+ * Every call holds the connection's lock, so a server can read events
+ * from one thread (try_poll_events) while commands run on another.
  */
 class SocketHelper {
 private:
@@ -15,6 +21,19 @@ private:
     int current_pid;
     std::string session_key;
 
+    // Framed agent connections: decoded frames are flattened into text_ for
+    // the callers that read the agent like a stream.
+    bool framed;
+    FrameReader reader;
+    std::string text;
+    uint32_t next_request_id;
+    std::function<void(uint32_t, const char*, size_t)> event_sink;
+
+    mutable std::recursive_mutex io_lock;
+
+    int pump(int timeout_ms);
+    void absorb_frames();
+
 public:
     SocketHelper();
     ~SocketHelper();
@@ -35,6 +54,61 @@ public:
      */
     ssize_t send_data(const void* data, size_t size, bool prefix_key = true);
 
+    /**
+     * Authenticate the connection with `key` and ask for framing. Agents
+     * that don't know frames stay on the text protocol.
+     * @param key Session key
+     * @return true if the connection is framed
+     */
+    bool establish_session(const std::string& key);
+
+    /**
+     * Run one command and wait for its END frame. Output (including async
+     * events) is passed to on_output as it arrives. Only valid when framed.
+     * @param command Command text without session key
+     * @param on_output Output callback
+     * @param idle_timeout_ms Give up after this long without any frame
+     * @return true if the command completed without error
+     */
+    bool request(const std::string& command,
+                 const std::function<void(const char*, size_t)>& on_output,
+                 int idle_timeout_ms);
+
+    /**
+     * Route EVENT frames (hook, strace and log channels, see agent/output.h)
+     * to sink instead of mixing them into command output. Pass nullptr to
+     * go back to mixing.
+     * @param sink Called with the channel and payload of each event
+     */
+    void set_event_sink(std::function<void(uint32_t, const char*, size_t)> sink);
+
+    /**
+     * Read whatever the agent sent while no command is running and hand
+     * the events to the sink. Only useful when framed with a sink set.
+     * @param timeout_ms Timeout for the first byte
+     * @return 1 read something, 0 timeout, -1 error or closed
+     */
+    int poll_events(int timeout_ms);
+
+    /**
+     * poll_events(0) for a thread that doesn't run commands on this
+     * connection. Doesn't wait: gives up while another thread is using
+     * the connection (it forwards events itself then), or once the
+     * connection no longer runs on fd.
+     * @param fd Socket the caller saw become readable
+     * @param result poll_events() result, when it ran
+     * @return false if nothing was read because of the above
+     */
+    bool try_poll_events(int fd, int* result);
+
+    /**
+     * Wait until agent output can be read (poll() replacement that also
+     * works on framed connections)
+     * @param timeout_ms Timeout, -1 waits forever
+     * @return 1 readable, 0 timeout, -1 error or closed
+     */
+    int wait_data(int timeout_ms);
+
     /**
      * Receive data from agent
      * @param buffer Buffer to receive into
@@ -60,6 +134,11 @@ public:
      */
     bool is_connected() const;
 
+    /**
+     * Check if the agent connection uses frames
+     */
+    bool is_framed() const;
+
     /**
      * Get socket file descriptor
      * @return Current socket fd
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Symbol tables fetched from the agent ("syms <lib>"), kept in memory and
+ * on disk under the module's key (build-id, or inode+mtime). A later
+ * session only has to ask the agent for the key ("syms -k <lib>").
+ */
+struct CachedSymbol {
+    uint64_t value = 0;         // st_value
+    uint64_t size = 0;
+    uint8_t type = 0;           // STT_*
+    bool dynamic = false;       // from .dynsym
+};
+
+struct SymbolTable {
+    std::string key;
+    std::string path;
+    std::unordered_map<std::string, CachedSymbol> by_name;
+    std::map<uint64_t, std::string> by_value;
+
+    /** .dynsym wins over .symtab, like the agent's own lookup. */
+    const CachedSymbol* find(const std::string& name) const;
+    /** Closest symbol at or below value, or nullptr. */
+    const std::string* find_value(uint64_t value) const;
+};
+
+class SymbolCache {
+public:
+    static SymbolCache& instance();
+
+    /** Memory first, then disk. nullptr when the key is unknown. */
+    std::shared_ptr<const SymbolTable> get(const std::string& key);
+
+    /** Parse a full "syms" response and store it. nullptr if malformed. */
+    std::shared_ptr<const SymbolTable> put(const std::string& response);
+
+    /** Parse a "SYMS <key> <path>" header line. */
+    static bool parse_header(const std::string& line, std::string& key, std::string& path);
+
+private:
+    SymbolCache();
+    SymbolCache(const SymbolCache&) = delete;
+    SymbolCache& operator=(const SymbolCache&) = delete;
+
+    static std::shared_ptr<SymbolTable> parse(const std::string& response);
+    std::string file_for(const std::string& key) const;
+
+    std::string dir_;
+    std::mutex mtx_;
+    std::unordered_map<std::string, std::shared_ptr<const SymbolTable>> tables_;
+};
@@ -1,12 +1,89 @@
 #include "server.h"
 #include <renef/cmd.h>
+#include <renef/socket_helper.h>
 #include <iostream>
+#include <chrono>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <unistd.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+static const char kFramesHello[] = "con " FRAME_HELLO;
+static const char kFramesAck[] = "OK frames\n";
+static const char kWatchStart[] = "Watching hook output... (waiting for hooks to trigger)\n";
+
+// A text command is complete once a newline is followed by this much quiet
+// (payloads may contain newlines of their own).
+static const int kLineQuietMs = 50;
+static const size_t kMaxCommand = 1024 * 1024;
+// Past this much unsent output a client's events are dropped and its
+// command output stops being read until it catches up.
+static const size_t kOutbufLimit = 4 * 1024 * 1024;
+// Events a text client gets on its next "watch" (what used to sit in the
+// agent socket until then).
+static const size_t kPendingLimit = 256 * 1024;
+
+struct ClientSession {
+    int fd = -1;
+    int id = 0;
+    std::atomic<bool> framed{false};
+
+    // Loop thread
+    FrameReader reader;
+    std::string inbuf;
+    int64_t line_deadline = 0;
+    std::shared_ptr<ServerJob> text_job;
+    std::map<uint32_t, std::shared_ptr<ServerJob>> jobs;
+
+    // Set by the executor, read by the loop for fan-out
+    std::atomic<int> pid{-1};
+
+    // Under out_lock
+    std::mutex out_lock;
+    std::string outbuf;
+    bool closed = false;
+    bool want_write = false;
+    bool watching = false;
+    uint32_t watch_id = 0;
+    std::string pending;
+    uint64_t events_dropped = 0;
+    std::vector<int> paused_relays;
+};
+
+struct ServerJob {
+    enum Kind { COMMAND, CLOSE };
+    Kind kind = COMMAND;
+    std::shared_ptr<ClientSession> session;
+    uint32_t id = 0;
+    std::string command;
+    int cmd_fd = -1;        // executor end: the command's "client"
+    int relay_fd = -1;      // loop end
+    std::atomic<bool> success{false};
+    std::atomic<bool> held{false};     // framed watch: END waits for the client's INPUT
+};
+
+static int64_t now_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static std::string command_name(const std::string& cmd) {
+    size_t end = cmd.find_first_of(" ~\n");
+    return cmd.substr(0, end);
+}
 
 TransportServer::TransportServer(ITransport* transport)
-    : transport(transport) {
+    : transport(transport), listen_fd(-1), epoll_fd(-1), loop_wake_fd(-1), exec_wake_fd(-1),
+      running(false), next_session_id(1), event_bytes(0), events_dropped(0), agents_changed(false),
+      last_pid(-1) {
 }
 
 TransportServer::~TransportServer() {
@@ -14,86 +91,709 @@ TransportServer::~TransportServer() {
 }
 
 int TransportServer::create_server() {
-    return transport->create_server();
+    listen_fd = transport->create_server();
+    return listen_fd;
 }
 
-int TransportServer::accept_client() {
-    return transport->accept_client();
-}
+int TransportServer::run() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    exec_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen_fd < 0 || epoll_fd < 0 || loop_wake_fd < 0 || exec_wake_fd < 0) {
+        std::cerr << "Failed to set up event loop: " << strerror(errno) << "\n";
+        return -1;
+    }
+    set_nonblocking(listen_fd);
 
-ssize_t TransportServer::send_data(const void* data, size_t size) {
-    return transport->send_data(data, size);
-}
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.fd = loop_wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, loop_wake_fd, &ev);
 
-ssize_t TransportServer::receive_data(void* buffer, size_t size) {
-    return transport->receive_data(buffer, size);
-}
+    CommandRegistry& registry = CommandRegistry::instance();
+    last_pid = registry.get_current_pid();
+    registry.set_event_sink([this](int pid, uint32_t channel, const char* data, size_t len) {
+        fan_out(pid, channel, data, len);
+    });
+    publish_agents();
 
-void TransportServer::handle_client() {
-    std::cout << "Entering handle_client loop (" << transport->get_type() << ")\n";
+    running = true;
+    executor = std::thread(&TransportServer::executor_loop, this);
+    std::cout << "Serving clients (" << transport->get_type() << ")\n";
 
+    struct epoll_event events[64];
+    while (running) {
+        int n = epoll_wait(epoll_fd, events, 64, next_timeout_ms());
+        if (n < 0 && errno != EINTR) {
+            std::cerr << "epoll_wait failed: " << strerror(errno) << "\n";
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            uint32_t what = events[i].events;
+
+            if (fd == listen_fd) {
+                accept_clients();
+            } else if (fd == loop_wake_fd) {
+                uint64_t value;
+                read(loop_wake_fd, &value, sizeof(value));
+            } else if (relays.count(fd)) {
+                read_relay(relays[fd]);
+            } else if (clients.count(fd)) {
+                // Hold a reference: handlers may drop the session from the map.
+                std::shared_ptr<ClientSession> session = clients[fd];
+                if (what & EPOLLOUT) write_ready(session);
+                if (what & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) read_client(session);
+            } else if (agent_fds.count(fd)) {
+                read_agent(fd);
+            }
+        }
+        sync_agents();
+        deliver_events();
+        dispatch_due_lines();
+    }
+
+    running = false;
+    {
+        uint64_t one = 1;
+        write(exec_wake_fd, &one, sizeof(one));
+    }
+    if (executor.joinable()) executor.join();
+    registry.set_event_sink(nullptr);
+    return 0;
+}
+
+void TransportServer::accept_clients() {
     while (true) {
-        std::vector<char> buffer;
-        buffer.reserve(BUFFER_SIZE);
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Failed to accept client: " << strerror(errno) << "\n";
+            }
+            return;
+        }
+
+        auto session = std::make_shared<ClientSession>();
+        session->fd = fd;
+        session->id = next_session_id++;
+        clients[fd] = session;
+        // The number of an agent connection closed since the last sync
+        agent_fds.erase(fd);
 
-        char chunk[BUFFER_SIZE];
-        ssize_t total = 0;
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
 
-        while (true) {
-            ssize_t n = receive_data(chunk, sizeof(chunk));
+        std::cout << "Client #" << session->id << " connected (fd=" << fd << ", "
+                  << clients.size() << " connected)\n";
+    }
+}
 
-            if (n <= 0) {
-                if (total == 0) {
-                    std::cout << "Client disconnected (recv returned " << n << ")\n";
-                    return;
+void TransportServer::read_client(const std::shared_ptr<ClientSession>& session) {
+    char chunk[16384];
+    while (true) {
+        ssize_t n = recv(session->fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            if (session->framed) {
+                session->reader.feed(chunk, (size_t)n);
+                Frame frame;
+                while (session->reader.next(frame)) {
+                    handle_frame(session, frame);
                 }
-                break;
+            } else {
+                handle_text(session, chunk, (size_t)n);
             }
+            if (clients.count(session->fd) == 0) return;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
 
-            buffer.insert(buffer.end(), chunk, chunk + n);
-            total += n;
+        close_session(session);
+        return;
+    }
+}
 
-            if (chunk[n-1] == '\n') {
-                int fd = transport->get_fd();
-                struct pollfd pfd = {fd, POLLIN, 0};
-                if (poll(&pfd, 1, 50) <= 0) {
-                    break;
-                }
+void TransportServer::handle_frame(const std::shared_ptr<ClientSession>& session, const Frame& frame) {
+    if (frame.type == FRAME_INPUT) {
+        bool ends_watch = false;
+        {
+            std::lock_guard<std::mutex> lock(session->out_lock);
+            if (session->watching && session->watch_id == frame.id) {
+                session->watching = false;
+                session->watch_id = 0;
+                ends_watch = true;
             }
+        }
+        if (ends_watch) {
+            queue_frame(*session, FRAME_END, 0, frame.id, nullptr, 0, false);
+            return;
+        }
+        auto it = session->jobs.find(frame.id);
+        if (it != session->jobs.end() && it->second->relay_fd >= 0) {
+            send(it->second->relay_fd, frame.payload.data(), frame.payload.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        return;
+    }
+
+    if (frame.type != FRAME_REQUEST) return;
 
-            if (total > 1024 * 1024) {
-                std::cerr << "Command too large (>1MB), rejecting\n";
-                const char* error = "ERROR: Command too large\n";
-                send_data(error, strlen(error));
+    // Byte for byte: the frame already delimits the command, and commands
+    // like mw carry binary data that may end in a newline.
+    const std::string& cmd = frame.payload;
+    if (session->jobs.count(frame.id)) {
+        const char* error = "ERROR: Request id already in use\n";
+        queue_frame(*session, FRAME_DATA, 0, frame.id, error, strlen(error), false);
+        queue_frame(*session, FRAME_END, FRAME_F_ERROR, frame.id, nullptr, 0, false);
+        return;
+    }
+
+    std::cout << "Client #" << session->id << ": framed command #" << frame.id
+              << " (" << cmd.size() << " bytes)\n";
+    start_job(session, frame.id, cmd);
+}
+
+void TransportServer::handle_text(const std::shared_ptr<ClientSession>& session, const char* data, size_t len) {
+    // Keystrokes for the running command (strace/watch 'q')
+    if (session->text_job) {
+        if (session->text_job->relay_fd >= 0) {
+            send(session->text_job->relay_fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        return;
+    }
+    {
+        // Any input ends a watch, as it did when watch was a blocking command.
+        std::lock_guard<std::mutex> lock(session->out_lock);
+        if (session->watching) {
+            session->watching = false;
+            return;
+        }
+    }
+
+    session->inbuf.append(data, len);
+    if (session->inbuf.size() > kMaxCommand) {
+        std::cerr << "Command too large (>1MB), rejecting\n";
+        const char* error = "ERROR: Command too large\n";
+        queue_output(*session, error, strlen(error), false);
+        close_session(session);
+        return;
+    }
+
+    // The framing handshake is always one line on its own.
+    if (session->inbuf == std::string(kFramesHello) + "\n") {
+        session->inbuf.clear();
+        session->line_deadline = 0;
+        queue_output(*session, kFramesAck, sizeof(kFramesAck) - 1, false);
+        session->framed = true;
+        std::cout << "Client #" << session->id << " switched to framed protocol\n";
+        return;
+    }
+
+    session->line_deadline = session->inbuf.back() == '\n' ? now_ms() + kLineQuietMs : 0;
+}
+
+int TransportServer::next_timeout_ms() {
+    int64_t earliest = 0;
+    for (auto& [fd, session] : clients) {
+        if (session->line_deadline && !session->text_job &&
+            (earliest == 0 || session->line_deadline < earliest)) {
+            earliest = session->line_deadline;
+        }
+    }
+    if (earliest == 0) return -1;
+    int64_t wait = earliest - now_ms();
+    return wait < 0 ? 0 : (int)wait;
+}
+
+void TransportServer::dispatch_due_lines() {
+    int64_t now = now_ms();
+    std::vector<std::shared_ptr<ClientSession>> due;
+    for (auto& [fd, session] : clients) {
+        if (session->line_deadline && session->line_deadline <= now && !session->text_job) {
+            due.push_back(session);
+        }
+    }
+
+    for (auto& session : due) {
+        std::string cmd;
+        cmd.swap(session->inbuf);
+        session->line_deadline = 0;
+        while (!cmd.empty() && (cmd.back() == '\n' || cmd.back() == '\r')) {
+            cmd.pop_back();
+        }
+        if (cmd.empty()) continue;
+
+        std::cout << "Client #" << session->id << ": command (" << cmd.size() << " bytes)\n";
+        start_job(session, 0, cmd);
+    }
+}
+
+// Commands write to a plain fd, so each one gets one end of a socketpair
+// as its "client"; the loop wraps whatever comes out of the other end for
+// the real client (DATA frames, or raw bytes on text connections).
+void TransportServer::start_job(const std::shared_ptr<ClientSession>& session, uint32_t id,
+                                const std::string& command) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0) {
+        const char* error = "ERROR: Failed to create request channel\n";
+        if (session->framed) {
+            queue_frame(*session, FRAME_DATA, 0, id, error, strlen(error), false);
+            queue_frame(*session, FRAME_END, FRAME_F_ERROR, id, nullptr, 0, false);
+        } else {
+            queue_output(*session, error, strlen(error), false);
+        }
+        return;
+    }
+    set_nonblocking(pair[1]);
+
+    auto job = std::make_shared<ServerJob>();
+    job->session = session;
+    job->id = id;
+    job->command = command;
+    job->cmd_fd = pair[0];
+    job->relay_fd = pair[1];
+
+    relays[pair[1]] = job;
+    agent_fds.erase(pair[1]);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = pair[1];
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pair[1], &ev);
+
+    if (session->framed) {
+        session->jobs[id] = job;
+    } else {
+        session->text_job = job;
+    }
+    post(job);
+}
+
+void TransportServer::read_relay(const std::shared_ptr<ServerJob>& job) {
+    ClientSession& session = *job->session;
+    char chunk[16384];
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(session.out_lock);
+            if (!session.closed && session.outbuf.size() > kOutbufLimit) {
+                // Client is behind; resume once write_ready has drained it.
+                struct epoll_event ev = {};
+                ev.data.fd = job->relay_fd;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, job->relay_fd, &ev);
+                session.paused_relays.push_back(job->relay_fd);
+                flush_locked(session);
                 return;
             }
         }
 
-        if (total <= 0) {
-            return;
+        ssize_t n = read(job->relay_fd, chunk, sizeof(chunk));
+        if (n > 0) {
+            if (session.framed) {
+                queue_frame(session, FRAME_DATA, 0, job->id, chunk, (size_t)n, false);
+            } else {
+                queue_output(session, chunk, (size_t)n, false);
+            }
+            continue;
         }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
 
-        buffer.push_back('\0');
+        finish_job(job);
+        return;
+    }
+}
 
-        if (total > 0 && buffer[total-1] == '\n') {
-            buffer[total-1] = '\0';
-            total--;
+// EOF on the relay: the executor is done with the command and closed its
+// end after storing the result.
+void TransportServer::finish_job(const std::shared_ptr<ServerJob>& job) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, job->relay_fd, NULL);
+    relays.erase(job->relay_fd);
+    close(job->relay_fd);
+    job->relay_fd = -1;
+
+    std::shared_ptr<ClientSession> session = job->session;
+    if (session->framed && job->id != 0) {
+        session->jobs.erase(job->id);
+        if (!job->held) {
+            queue_frame(*session, FRAME_END, job->success ? 0 : FRAME_F_ERROR, job->id, nullptr, 0, false);
+        }
+    } else if (session->text_job == job) {
+        session->text_job.reset();
+        // A command typed while this one ran is now due.
+        if (!session->inbuf.empty() && session->inbuf.back() == '\n') {
+            session->line_deadline = now_ms();
         }
+    }
+}
+
+void TransportServer::write_ready(const std::shared_ptr<ClientSession>& session) {
+    std::vector<int> resume;
+    {
+        std::lock_guard<std::mutex> lock(session->out_lock);
+        flush_locked(*session);
+        if (session->outbuf.size() <= kOutbufLimit / 2) {
+            resume.swap(session->paused_relays);
+            flush_locked(*session);
+        }
+    }
+
+    for (int fd : resume) {
+        auto it = relays.find(fd);
+        if (it == relays.end()) continue;
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        read_relay(it->second);
+    }
+}
+
+void TransportServer::close_session(const std::shared_ptr<ClientSession>& session) {
+    if (clients.erase(session->fd) == 0) return;
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->fd, NULL);
+    {
+        std::lock_guard<std::mutex> lock(session->out_lock);
+        session->closed = true;
+        session->outbuf.clear();
+        session->pending.clear();
+        close(session->fd);
+    }
+
+    // Running commands see EOF on their client and stop (watch, strace);
+    // their relays stay registered until the executor lets go.
+    std::vector<std::shared_ptr<ServerJob>> running_jobs;
+    if (session->text_job) running_jobs.push_back(session->text_job);
+    for (auto& [id, job] : session->jobs) running_jobs.push_back(job);
+    for (auto& job : running_jobs) {
+        if (job->relay_fd >= 0) shutdown(job->relay_fd, SHUT_WR);
+    }
+    std::vector<int> paused;
+    uint64_t dropped;
+    {
+        std::lock_guard<std::mutex> lock(session->out_lock);
+        paused.swap(session->paused_relays);
+        dropped = session->events_dropped;
+    }
+    for (int fd : paused) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    auto job = std::make_shared<ServerJob>();
+    job->kind = ServerJob::CLOSE;
+    job->session = session;
+    post(job);
+
+    std::cout << "Client #" << session->id << " disconnected (" << clients.size() << " connected";
+    if (dropped) std::cout << ", " << dropped << " events dropped";
+    std::cout << ")\n";
+}
+
+// Agent connections are watched one-shot: after a read they are re-armed
+// here, or by the next sync if a command had the connection (its reads
+// hand the events over until then).
+void TransportServer::sync_agents() {
+    std::map<int, int> watch;
+    {
+        std::lock_guard<std::mutex> lock(watch_lock);
+        if (!agents_changed) return;
+        agents_changed = false;
+        watch = agent_watch;
+    }
+
+    for (auto it = agent_fds.begin(); it != agent_fds.end();) {
+        if (watch.count(it->first)) {
+            ++it;
+            continue;
+        }
+        // Usually gone already: closing the fd removed it from the set.
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->first, NULL);
+        it = agent_fds.erase(it);
+    }
+    for (auto& [fd, pid] : watch) {
+        // Published before the executor closed it, and reused since
+        if (clients.count(fd) || relays.count(fd)) continue;
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            continue;
+        }
+        agent_fds[fd] = pid;
+    }
+}
+
+void TransportServer::read_agent(int fd) {
+    int pid = agent_fds[fd];
+    bool polled = false;
+    int result = 0;
+    CommandRegistry::instance().with_agent(pid, [&](SocketHelper& agent) {
+        polled = agent.try_poll_events(fd, &result);
+    });
+    // Busy, closed or replaced: left to the next sync.
+    if (!polled || result < 0) return;
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void TransportServer::deliver_events() {
+    std::deque<AgentEvent> batch;
+    uint64_t dropped;
+    {
+        std::lock_guard<std::mutex> lock(event_lock);
+        if (events.empty() && !events_dropped) return;
+        batch.swap(events);
+        event_bytes = 0;
+        dropped = events_dropped;
+        events_dropped = 0;
+    }
+    if (dropped) {
+        std::cerr << "Dropped " << dropped << " agent events (server behind)\n";
+    }
+
+    for (const AgentEvent& event : batch) {
+        for (auto& [fd, session] : clients) {
+            if (session->pid != event.pid) continue;
+
+            if (session->framed) {
+                queue_frame(*session, FRAME_EVENT, 0, event.channel, event.data.data(), event.data.size(), true);
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(session->out_lock);
+            if (session->closed) continue;
+            if (session->watching) {
+                if (session->outbuf.size() > kOutbufLimit) {
+                    session->events_dropped++;
+                    continue;
+                }
+                session->outbuf.append(event.data);
+                flush_locked(*session);
+            } else {
+                session->pending.append(event.data);
+                if (session->pending.size() > kPendingLimit) {
+                    session->pending.erase(0, session->pending.size() - kPendingLimit);
+                }
+            }
+        }
+    }
+}
+
+void TransportServer::post(const std::shared_ptr<ServerJob>& job) {
+    {
+        std::lock_guard<std::mutex> lock(queue_lock);
+        queue.push_back(job);
+    }
+    uint64_t one = 1;
+    write(exec_wake_fd, &one, sizeof(one));
+}
 
-        std::cout << "Received command (" << total << " bytes)\n";
-        handle_command(buffer.data(), total);
+void TransportServer::executor_loop() {
+    while (running) {
+        std::shared_ptr<ServerJob> job;
+        {
+            std::lock_guard<std::mutex> lock(queue_lock);
+            if (!queue.empty()) {
+                job = queue.front();
+                queue.pop_front();
+            }
+        }
+        if (job) {
+            run_job(job);
+        } else {
+            wait_for_work();
+        }
     }
+}
 
-    std::cout << "Exiting handle_client loop\n";
+// Idle: sleep until a job is posted.
+void TransportServer::wait_for_work() {
+    struct pollfd pfd = {exec_wake_fd, POLLIN, 0};
+    if (poll(&pfd, 1, -1) > 0 && (pfd.revents & POLLIN)) {
+        uint64_t value;
+        read(exec_wake_fd, &value, sizeof(value));
+    }
 }
 
-void TransportServer::handle_command(const char* cmd_buffer, size_t cmd_size) {
+// Commands connect, reconnect and close agents; tell the loop which
+// framed connections to watch now. A dead one stays on the list and is
+// left for the next command to notice and reconnect.
+void TransportServer::publish_agents() {
+    std::map<int, int> watch;
+    CommandRegistry::instance().for_each_agent([&](int pid, SocketHelper& agent) {
+        int fd = agent.is_framed() ? agent.get_socket_fd() : -1;
+        if (fd >= 0) watch[fd] = pid;
+    });
+    {
+        std::lock_guard<std::mutex> lock(watch_lock);
+        agent_watch.swap(watch);
+        agents_changed = true;
+    }
+    uint64_t one = 1;
+    write(loop_wake_fd, &one, sizeof(one));
+}
+
+void TransportServer::run_job(const std::shared_ptr<ServerJob>& job) {
     CommandRegistry& registry = CommandRegistry::instance();
-    int client_fd = transport->get_fd();
-    registry.dispatch(client_fd, cmd_buffer, cmd_size);
+    std::shared_ptr<ClientSession> session = job->session;
+
+    if (job->kind == ServerJob::CLOSE) {
+        registry.release_target(session->pid);
+        publish_agents();
+        return;
+    }
+
+    // A client without a target of its own follows the last attach.
+    if (session->pid <= 0 && last_pid > 0) {
+        session->pid = last_pid;
+        registry.retain_target(session->pid);
+    }
+    registry.select_target(session->pid);
+
+    bool watch = command_name(job->command) == "watch";
+    SocketHelper& agent = registry.get_socket_helper();
+
+    if (watch && agent.is_framed()) {
+        // Hook output reaches subscribers by fan_out, so watch only
+        // subscribes; the executor stays free for other clients.
+        std::string backlog;
+        {
+            std::lock_guard<std::mutex> lock(session->out_lock);
+            session->watching = true;
+            session->watch_id = job->id;
+            backlog.swap(session->pending);
+        }
+        agent.drain_buffer();
+        send(job->cmd_fd, backlog.data(), backlog.size(), MSG_NOSIGNAL);
+        send(job->cmd_fd, kWatchStart, sizeof(kWatchStart) - 1, MSG_NOSIGNAL);
+        job->held = session->framed && job->id != 0;
+        job->success = true;
+    } else {
+        if (!watch) {
+            std::lock_guard<std::mutex> lock(session->out_lock);
+            session->pending.clear();
+        }
+        CommandResult result = registry.dispatch(job->cmd_fd, job->command.c_str(), job->command.size());
+        job->success = result.success;
+    }
+
+    int pid = registry.get_current_pid();
+    if (pid != session->pid) {
+        registry.retain_target(pid);
+        registry.release_target(session->pid);
+        session->pid = pid;
+    }
+    last_pid = pid;
+    publish_agents();
+
+    // The loop sends END once it has relayed everything up to this EOF.
+    close(job->cmd_fd);
+    job->cmd_fd = -1;
+}
+
+// Agent event sink: runs on the loop (its own reads) or the executor (a
+// command's reads); delivery is always the loop's, in deliver_events().
+void TransportServer::fan_out(int pid, uint32_t channel, const char* data, size_t len) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(event_lock);
+        if (event_bytes + len > kOutbufLimit) {
+            events_dropped++;
+            return;
+        }
+        wake = events.empty();
+        events.push_back({pid, channel, std::string(data, len)});
+        event_bytes += len;
+    }
+    if (wake) {
+        uint64_t one = 1;
+        write(loop_wake_fd, &one, sizeof(one));
+    }
+}
+
+void TransportServer::queue_output(ClientSession& session, const char* data, size_t len, bool droppable) {
+    std::lock_guard<std::mutex> lock(session.out_lock);
+    if (session.closed) return;
+    if (droppable && session.outbuf.size() > kOutbufLimit) {
+        session.events_dropped++;
+        return;
+    }
+    session.outbuf.append(data, len);
+    flush_locked(session);
+}
+
+void TransportServer::queue_frame(ClientSession& session, uint8_t type, uint16_t flags, uint32_t id,
+                                  const char* data, size_t len, bool droppable) {
+    std::lock_guard<std::mutex> lock(session.out_lock);
+    if (session.closed) return;
+    if (droppable && session.outbuf.size() > kOutbufLimit) {
+        session.events_dropped++;
+        return;
+    }
+
+    uint8_t header[FRAME_HEADER_SIZE];
+    frame_encode(header, type, flags, id, (uint32_t)len);
+    session.outbuf.append((const char*)header, sizeof(header));
+    if (len) session.outbuf.append(data, len);
+    flush_locked(session);
+}
+
+// Caller holds out_lock. Whatever doesn't fit in the socket waits for
+// EPOLLOUT; epoll_ctl is safe from the executor thread too.
+void TransportServer::flush_locked(ClientSession& session) {
+    if (session.closed) return;
+
+    size_t sent = 0;
+    while (sent < session.outbuf.size()) {
+        ssize_t n = ::send(session.fd, session.outbuf.data() + sent, session.outbuf.size() - sent,
+                           MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        // Broken client; the loop sees the hangup and closes it.
+        session.outbuf.clear();
+        sent = 0;
+        break;
+    }
+    session.outbuf.erase(0, sent);
+
+    bool want = !session.outbuf.empty() || !session.paused_relays.empty();
+    if (want != session.want_write) {
+        session.want_write = want;
+        struct epoll_event ev = {};
+        ev.events = (uint32_t)(EPOLLIN | EPOLLRDHUP) | (want ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.fd = session.fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session.fd, &ev);
+    }
 }
 
 void TransportServer::close_server() {
+    if (running.exchange(false) && loop_wake_fd >= 0) {
+        uint64_t one = 1;
+        write(loop_wake_fd, &one, sizeof(one));
+    }
+    // run() joins the executor on its way out; joining here as well
+    // raced it when called from another thread.
+    if (exec_wake_fd >= 0) {
+        uint64_t one = 1;
+        write(exec_wake_fd, &one, sizeof(one));
+    }
     if (transport) {
         transport->close();
     }
@@ -1,20 +1,103 @@
 #pragma once
 
 #include <renef/transport.h>
+#include <renef/frame_io.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 #define BUFFER_SIZE 4096
 
+struct ClientSession;
+struct ServerJob;
+
+struct AgentEvent {
+    int pid;
+    uint32_t channel;
+    std::string data;
+};
+
 /**
- * Generic server wrapper that uses ITransport for communication
- * Replaces the old UdsServer class
+ * Multi-client server on top of an ITransport listener.
+ *
+ * One epoll thread owns the sockets: it accepts clients, reads their
+ * commands (text lines, or REQUEST frames after "con +frames") and relays
+ * command output back. Commands run one at a time on an executor thread,
+ * since the command registry and the agent connections are shared; each
+ * client keeps its own target pid, which is made current for its commands.
+ *
+ * Agent events are fanned out by the loop thread, to every client
+ * targeting that agent. The loop also watches framed agent connections
+ * and reads their events itself, unless a command is using that
+ * connection; the command's reads then hand the events over. Either way
+ * a long command for one target doesn't hold up events of another.
  */
 class TransportServer {
 private:
     std::unique_ptr<ITransport> transport;
+    int listen_fd;
+    int epoll_fd;
+    int loop_wake_fd;
+    int exec_wake_fd;
+    std::atomic<bool> running;
+    int next_session_id;
+
+    // Loop thread only
+    std::map<int, std::shared_ptr<ClientSession>> clients;
+    std::map<int, std::shared_ptr<ServerJob>> relays;   // relay fd -> job
+    std::map<int, int> agent_fds;                       // watched agent fd -> pid
+
+    // Agent events from whichever thread read them, for the loop
+    std::mutex event_lock;
+    std::deque<AgentEvent> events;
+    size_t event_bytes;
+    uint64_t events_dropped;
+
+    // Framed agent connections, published by the executor after each command
+    std::mutex watch_lock;
+    std::map<int, int> agent_watch;
+    bool agents_changed;
+
+    // Executor queue
+    std::mutex queue_lock;
+    std::deque<std::shared_ptr<ServerJob>> queue;
+    std::thread executor;
+
+    // Executor thread only
+    int last_pid;
+
+    void accept_clients();
+    void read_client(const std::shared_ptr<ClientSession>& session);
+    void handle_frame(const std::shared_ptr<ClientSession>& session, const Frame& frame);
+    void handle_text(const std::shared_ptr<ClientSession>& session, const char* data, size_t len);
+    void dispatch_due_lines();
+    int next_timeout_ms();
+    void start_job(const std::shared_ptr<ClientSession>& session, uint32_t id, const std::string& command);
+    void read_relay(const std::shared_ptr<ServerJob>& job);
+    void finish_job(const std::shared_ptr<ServerJob>& job);
+    void write_ready(const std::shared_ptr<ClientSession>& session);
+    void close_session(const std::shared_ptr<ClientSession>& session);
+    void sync_agents();
+    void read_agent(int fd);
+    void deliver_events();
+
+    void post(const std::shared_ptr<ServerJob>& job);
+    void executor_loop();
+    void run_job(const std::shared_ptr<ServerJob>& job);
+    void wait_for_work();
+    void publish_agents();
+    void fan_out(int pid, uint32_t channel, const char* data, size_t len);
 
-    void handle_command(const char* cmd_buffer, size_t cmd_size);
+    void queue_output(ClientSession& session, const char* data, size_t len, bool droppable);
+    void queue_frame(ClientSession& session, uint8_t type, uint16_t flags, uint32_t id,
+                     const char* data, size_t len, bool droppable);
+    void flush_locked(ClientSession& session);
 
 public:
     /**
@@ -31,31 +114,10 @@ public:
     int create_server();
 
     /**
-     * Accept incoming client
-     * @return client fd or -1 on error
-     */
-    int accept_client();
-
-    /**
-     * Handle client communication loop
-     */
-    void handle_client();
-
-    /**
-     * Send data to client
-     * @param data Data to send
-     * @param size Size of data
-     * @return bytes sent or -1 on error
-     */
-    ssize_t send_data(const void* data, size_t size);
-
-    /**
-     * Receive data from client
-     * @param buffer Buffer to receive into
-     * @param size Buffer size
-     * @return bytes received or -1 on error
+     * Serve clients until close_server()
+     * @return 0, or -1 if the event loop could not be set up
      */
-    ssize_t receive_data(void* buffer, size_t size);
+    int run();
 
     /**
      * Close server and connections
@@ -0,0 +1,112 @@
+#include <renef/dump_stream.h>
+#include <agent/lz4.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+DumpFileWriter::~DumpFileWriter() {
+    if (fd_ >= 0) close(fd_);
+}
+
+bool DumpFileWriter::open(const std::string& path, bool resume) {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (resume ? 0 : O_TRUNC);
+    fd_ = ::open(path.c_str(), flags, 0644);
+    if (fd_ < 0) return fail(path + ": " + strerror(errno));
+
+    if (resume) {
+        struct stat st;
+        if (fstat(fd_, &st) == 0 && st.st_size > 0) {
+            resume_offset_ = (uint64_t)st.st_size / DUMP_CHUNK_SIZE * DUMP_CHUNK_SIZE;
+        }
+    }
+    end_offset_ = resume_offset_;
+    return true;
+}
+
+bool DumpFileWriter::feed(const char* data, size_t len) {
+    if (!error_.empty()) return false;
+    buffer_.append(data, len);
+
+    size_t pos = 0;
+    while (buffer_.size() - pos >= DUMP_RECORD_SIZE) {
+        const uint8_t* head = (const uint8_t*)buffer_.data() + pos;
+        DumpRecord rec;
+        if (!dump_decode(head, &rec)) {
+            // Agent errors arrive as text instead of records
+            std::string text = buffer_.substr(pos);
+            size_t nl = text.find('\n');
+            return fail(nl == std::string::npos ? text : text.substr(0, nl));
+        }
+        if (buffer_.size() - pos - DUMP_RECORD_SIZE < rec.stored) break;
+
+        if (!record(rec, head + DUMP_RECORD_SIZE)) return false;
+        pos += DUMP_RECORD_SIZE + rec.stored;
+    }
+    buffer_.erase(0, pos);
+    return true;
+}
+
+bool DumpFileWriter::record(const DumpRecord& rec, const uint8_t* payload) {
+    switch (rec.type) {
+    case DUMP_INFO:
+        info_.assign((const char*)payload, rec.stored);
+        while (!info_.empty() && (info_.back() == '\n' || info_.back() == '\r')) info_.pop_back();
+        return true;
+
+    case DUMP_DATA:
+        stored_bytes_ += rec.stored;
+        data_bytes_ += rec.length;
+        end_offset_ = rec.offset + rec.length;
+        if (rec.codec == DUMP_CODEC_RAW) {
+            if (rec.stored != rec.length) return fail("malformed dump record");
+            return write_at(rec.offset, payload, rec.length);
+        }
+        if (rec.length > FRAME_MAX_PAYLOAD) return fail("malformed dump record");
+        scratch_.resize(rec.length);
+        if (lz4_decompress_block(payload, rec.stored, scratch_.data(), rec.length) != (long)rec.length) {
+            return fail("corrupt LZ4 block at offset " + std::to_string(rec.offset));
+        }
+        return write_at(rec.offset, scratch_.data(), rec.length);
+
+    case DUMP_HOLE:
+        holes_++;
+        hole_bytes_ += rec.length;
+        end_offset_ = rec.offset + rec.length;
+        return true;
+
+    case DUMP_END:
+        end_offset_ = rec.offset;
+        complete_ = true;
+        return true;
+    }
+    return fail("unknown dump record");
+}
+
+bool DumpFileWriter::write_at(uint64_t offset, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd_, data, len, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return fail(std::string("write failed: ") + strerror(errno));
+        data += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+bool DumpFileWriter::finish() {
+    if (fd_ < 0) return false;
+    // A trailing hole never got written; extend the file over it.
+    bool ok = ftruncate(fd_, (off_t)end_offset_) == 0;
+    if (!ok && error_.empty()) error_ = std::string("truncate failed: ") + strerror(errno);
+    close(fd_);
+    fd_ = -1;
+    return ok && error_.empty();
+}
+
+bool DumpFileWriter::fail(const std::string& msg) {
+    if (error_.empty()) error_ = msg;
+    return false;
+}
@@ -0,0 +1,478 @@
+#include <renef/elf_rebuild.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef __linux__
+#include <elf.h>
+#else
+// ELF definitions for non-Linux hosts (see the injector)
+
+#define EI_NIDENT   16
+#define EI_CLASS    4
+#define ELFCLASS64  2
+#define ELFMAG      "\177ELF"
+#define SELFMAG     4
+
+typedef uint16_t Elf64_Half;
+typedef uint32_t Elf64_Word;
+typedef uint64_t Elf64_Xword;
+typedef int64_t Elf64_Sxword;
+typedef uint64_t Elf64_Addr;
+typedef uint64_t Elf64_Off;
+
+typedef struct {
+  unsigned char e_ident[EI_NIDENT];
+  Elf64_Half e_type;
+  Elf64_Half e_machine;
+  Elf64_Word e_version;
+  Elf64_Addr e_entry;
+  Elf64_Off e_phoff;
+  Elf64_Off e_shoff;
+  Elf64_Word e_flags;
+  Elf64_Half e_ehsize;
+  Elf64_Half e_phentsize;
+  Elf64_Half e_phnum;
+  Elf64_Half e_shentsize;
+  Elf64_Half e_shnum;
+  Elf64_Half e_shstrndx;
+} Elf64_Ehdr;
+
+typedef struct {
+  Elf64_Word p_type;
+  Elf64_Word p_flags;
+  Elf64_Off p_offset;
+  Elf64_Addr p_vaddr;
+  Elf64_Addr p_paddr;
+  Elf64_Xword p_filesz;
+  Elf64_Xword p_memsz;
+  Elf64_Xword p_align;
+} Elf64_Phdr;
+
+typedef struct {
+  Elf64_Word sh_name;
+  Elf64_Word sh_type;
+  Elf64_Xword sh_flags;
+  Elf64_Addr sh_addr;
+  Elf64_Off sh_offset;
+  Elf64_Xword sh_size;
+  Elf64_Word sh_link;
+  Elf64_Word sh_info;
+  Elf64_Xword sh_addralign;
+  Elf64_Xword sh_entsize;
+} Elf64_Shdr;
+
+typedef struct {
+  Elf64_Word st_name;
+  unsigned char st_info;
+  unsigned char st_other;
+  Elf64_Half st_shndx;
+  Elf64_Addr st_value;
+  Elf64_Xword st_size;
+} Elf64_Sym;
+
+typedef struct {
+  Elf64_Sxword d_tag;
+  union {
+    Elf64_Xword d_val;
+    Elf64_Addr d_ptr;
+  } d_un;
+} Elf64_Dyn;
+
+#define PT_LOAD         1
+#define PT_DYNAMIC      2
+#define PT_GNU_STACK    0x6474e551
+#define PF_X            1
+#define PF_W            2
+
+#define DT_NULL         0
+#define DT_PLTRELSZ     2
+#define DT_PLTGOT       3
+#define DT_HASH         4
+#define DT_STRTAB       5
+#define DT_SYMTAB       6
+#define DT_RELA         7
+#define DT_RELASZ       8
+#define DT_STRSZ        10
+#define DT_SYMENT       11
+#define DT_INIT         12
+#define DT_FINI         13
+#define DT_REL          17
+#define DT_RELSZ        18
+#define DT_PLTREL       20
+#define DT_DEBUG        21
+#define DT_JMPREL       23
+#define DT_INIT_ARRAY   25
+#define DT_FINI_ARRAY   26
+#define DT_INIT_ARRAYSZ 27
+#define DT_FINI_ARRAYSZ 28
+#define DT_PREINIT_ARRAY 32
+#define DT_GNU_HASH     0x6ffffef5
+#define DT_VERSYM       0x6ffffff0
+#define DT_VERDEF       0x6ffffffc
+#define DT_VERNEED      0x6ffffffe
+
+#define SHT_PROGBITS    1
+#define SHT_STRTAB      3
+#define SHT_RELA        4
+#define SHT_HASH        5
+#define SHT_DYNAMIC     6
+#define SHT_REL         9
+#define SHT_DYNSYM      11
+#define SHT_INIT_ARRAY  14
+#define SHT_FINI_ARRAY  15
+#define SHT_GNU_HASH    0x6ffffff6
+#define SHT_GNU_versym  0x6fffffff
+
+#define SHF_WRITE       0x1
+#define SHF_ALLOC       0x2
+#define SHF_EXECINSTR   0x4
+#define SHN_LORESERVE   0xff00
+
+#endif // __linux__
+
+// Newer or Android-only tags that older <elf.h> lack
+#ifndef DT_RELRSZ
+#define DT_RELRSZ           35
+#define DT_RELR             36
+#endif
+#ifndef SHT_RELR
+#define SHT_RELR            19
+#endif
+#define DT_ANDROID_REL      0x6000000f
+#define DT_ANDROID_RELSZ    0x60000010
+#define DT_ANDROID_RELA     0x60000011
+#define DT_ANDROID_RELASZ   0x60000012
+#define DT_ANDROID_RELR     0x6fffe000
+#define DT_ANDROID_RELRSZ   0x6fffe001
+#define SHT_ANDROID_REL     0x60000001
+#define SHT_ANDROID_RELA    0x60000002
+
+namespace {
+
+constexpr uint64_t kPage = 4096;    // dumpmod rounds segment starts down to this
+constexpr uint64_t kMinGap = 16;    // smaller gaps between tables are padding
+
+// The mapped image, addressed by the module's own virtual addresses
+struct Image {
+    uint8_t* data;
+    size_t size;
+    uint64_t min_vaddr;
+
+    template <typename T>
+    T* at(uint64_t vaddr, size_t count = 1) const {
+        if (vaddr < min_vaddr) return nullptr;
+        uint64_t off = vaddr - min_vaddr;
+        if (off > size || count > (size - off) / sizeof(T)) return nullptr;
+        return (T*)(data + off);
+    }
+};
+
+bool is_pointer_tag(Elf64_Sxword tag) {
+    switch (tag) {
+    case DT_PLTGOT: case DT_HASH: case DT_STRTAB: case DT_SYMTAB: case DT_RELA:
+    case DT_INIT: case DT_FINI: case DT_REL: case DT_JMPREL: case DT_INIT_ARRAY:
+    case DT_FINI_ARRAY: case DT_PREINIT_ARRAY: case DT_RELR: case DT_GNU_HASH:
+    case DT_VERSYM: case DT_VERDEF: case DT_VERNEED: case DT_ANDROID_REL:
+    case DT_ANDROID_RELA: case DT_ANDROID_RELR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// .dynsym entry count by walking DT_GNU_HASH, and the table's size
+// (bounds-checked: packed libraries are the ones that get dumped).
+uint64_t gnu_hash_symbols(const Image& img, uint64_t gnu_hash, uint64_t* table_size) {
+    const uint32_t* h = img.at<uint32_t>(gnu_hash, 4);
+    if (!h) return 0;
+    uint32_t nbuckets = h[0], symoffset = h[1], bloom_size = h[2];
+    uint64_t buckets_at = gnu_hash + 16 + (uint64_t)bloom_size * 8;
+    const uint32_t* buckets = img.at<uint32_t>(buckets_at, nbuckets);
+    if (!buckets) return 0;
+
+    uint32_t last = 0;
+    for (uint32_t b = 0; b < nbuckets; b++) {
+        if (buckets[b] > last) last = buckets[b];
+    }
+    uint64_t chain_at = buckets_at + (uint64_t)nbuckets * 4;
+    uint64_t count = symoffset;
+    if (last >= symoffset) {
+        for (;; last++) {
+            const uint32_t* c = img.at<uint32_t>(chain_at + (uint64_t)(last - symoffset) * 4);
+            if (!c) return 0;
+            if (*c & 1) break;
+        }
+        count = (uint64_t)last + 1;
+    }
+    *table_size = chain_at - gnu_hash + (count - symoffset) * 4;
+    return count;
+}
+
+class SectionTable {
+public:
+    explicit SectionTable(uint64_t min_vaddr) : min_vaddr_(min_vaddr), names_(1, '\0') {
+        headers_.push_back(Elf64_Shdr{});
+    }
+
+    int add(const char* name, uint32_t type, uint64_t flags, uint64_t addr, uint64_t size,
+            uint64_t align, uint64_t entsize, uint32_t link = 0) {
+        Elf64_Shdr sh{};
+        sh.sh_name = (uint32_t)names_.size();
+        sh.sh_type = type;
+        sh.sh_flags = flags;
+        sh.sh_addr = addr;
+        sh.sh_offset = addr - min_vaddr_;
+        sh.sh_size = size;
+        sh.sh_link = link;
+        sh.sh_addralign = align;
+        sh.sh_entsize = entsize;
+        names_.append(name).push_back('\0');
+        headers_.push_back(sh);
+        return (int)headers_.size() - 1;
+    }
+
+    Elf64_Shdr& operator[](int i) { return headers_[i]; }
+    std::vector<Elf64_Shdr>& headers() { return headers_; }
+    std::string& names() { return names_; }
+
+private:
+    uint64_t min_vaddr_;
+    std::string names_;
+    std::vector<Elf64_Shdr> headers_;
+};
+
+bool write_at(int fd, const void* data, size_t len, off_t offset) {
+    const char* p = (const char*)data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+} // namespace
+
+bool rebuild_elf_image(const std::string& path, uint64_t load_base, ElfRebuildInfo& info,
+                       std::string& error) {
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Elf64_Ehdr)) {
+        close(fd);
+        error = "image too small for an ELF header";
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    uint8_t* data = (uint8_t*)mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        error = std::string("mmap failed: ") + strerror(errno);
+        return false;
+    }
+
+    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)data;
+    Elf64_Phdr* phdr = (Elf64_Phdr*)(data + ehdr->e_phoff);
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr->e_phentsize != sizeof(Elf64_Phdr) || ehdr->e_phoff > size ||
+        ehdr->e_phnum > (size - ehdr->e_phoff) / sizeof(Elf64_Phdr)) {
+        munmap(data, size);
+        close(fd);
+        error = "image does not start with a 64-bit ELF header";
+        return false;
+    }
+
+    uint64_t min_vaddr = UINT64_MAX;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == PT_LOAD && (phdr[i].p_vaddr & ~(kPage - 1)) < min_vaddr) {
+            min_vaddr = phdr[i].p_vaddr & ~(kPage - 1);
+        }
+    }
+    if (min_vaddr == UINT64_MAX) {
+        munmap(data, size);
+        close(fd);
+        error = "no PT_LOAD segments";
+        return false;
+    }
+    Image img{data, size, min_vaddr};
+
+    // File layout = memory layout: every segment sits at its address and
+    // PT_LOADs carry their whole memory size, .bss included.
+    const Elf64_Phdr* dynamic = nullptr;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        Elf64_Phdr& p = phdr[i];
+        if (p.p_type == PT_GNU_STACK || p.p_memsz == 0) continue;
+        p.p_offset = p.p_vaddr - min_vaddr;
+        if (p.p_type == PT_LOAD) {
+            p.p_filesz = p.p_memsz;
+            info.segments++;
+        } else if (p.p_type == PT_DYNAMIC) {
+            dynamic = &p;
+        }
+    }
+
+    // The loader may have rebased d_ptr entries (glibc does, bionic
+    // doesn't); DT_DEBUG points at the runtime r_debug.
+    uint64_t dt[64] = {0};
+    uint64_t strtab = 0, symtab = 0, gnu_hash = 0, versym = 0;
+    uint64_t android_rel = 0, android_relsz = 0, android_relr = 0, android_relrsz = 0;
+    bool android_rela = false;
+    Elf64_Dyn* dyn = dynamic ? img.at<Elf64_Dyn>(dynamic->p_vaddr, dynamic->p_memsz / sizeof(Elf64_Dyn))
+                             : nullptr;
+    for (size_t i = 0; dyn && i < dynamic->p_memsz / sizeof(Elf64_Dyn) && dyn[i].d_tag != DT_NULL; i++) {
+        Elf64_Dyn& d = dyn[i];
+        if (d.d_tag == DT_DEBUG) {
+            d.d_un.d_ptr = 0;
+        } else if (is_pointer_tag(d.d_tag) && load_base && d.d_un.d_ptr >= load_base) {
+            d.d_un.d_ptr -= load_base - min_vaddr;
+            info.dynamic_fixed++;
+        }
+
+        uint64_t v = d.d_un.d_val;
+        switch (d.d_tag) {
+        case DT_GNU_HASH: gnu_hash = v; break;
+        case DT_VERSYM: versym = v; break;
+        case DT_ANDROID_REL: android_rel = v; break;
+        case DT_ANDROID_RELA: android_rel = v; android_rela = true; break;
+        case DT_ANDROID_RELSZ: case DT_ANDROID_RELASZ: android_relsz = v; break;
+        case DT_ANDROID_RELR: android_relr = v; break;
+        case DT_ANDROID_RELRSZ: android_relrsz = v; break;
+        default:
+            if (d.d_tag >= 0 && d.d_tag < 64 && !dt[d.d_tag]) dt[d.d_tag] = v;
+        }
+    }
+    strtab = dt[DT_STRTAB];
+    symtab = dt[DT_SYMTAB];
+
+    // .dynsym size: DT_HASH's nchain, else the GNU hash chains
+    uint64_t gnu_hash_size = 0;
+    uint64_t syment = dt[DT_SYMENT] ? dt[DT_SYMENT] : 24;
+    uint64_t gnu_symbols = gnu_hash ? gnu_hash_symbols(img, gnu_hash, &gnu_hash_size) : 0;
+    const uint32_t* sysv_hash = dt[DT_HASH] ? img.at<uint32_t>(dt[DT_HASH], 2) : nullptr;
+    info.symbols = sysv_hash ? sysv_hash[1] : gnu_symbols;
+
+    SectionTable sections(min_vaddr);
+    int dynstr = 0, dynsym = 0;
+    if (symtab && info.symbols) {
+        dynsym = sections.add(".dynsym", SHT_DYNSYM, SHF_ALLOC, symtab, info.symbols * syment, 8, syment);
+        sections[dynsym].sh_info = 1;
+    }
+    if (strtab) {
+        dynstr = sections.add(".dynstr", SHT_STRTAB, SHF_ALLOC, strtab, dt[DT_STRSZ], 1, 0);
+        if (dynsym) sections[dynsym].sh_link = dynstr;
+    }
+    if (versym && dynsym) {
+        sections.add(".gnu.version", SHT_GNU_versym, SHF_ALLOC, versym, info.symbols * 2, 2, 2, dynsym);
+    }
+    if (gnu_hash && gnu_hash_size) {
+        sections.add(".gnu.hash", SHT_GNU_HASH, SHF_ALLOC, gnu_hash, gnu_hash_size, 8, 0, dynsym);
+    }
+    if (sysv_hash) {
+        uint64_t hash_size = (2 + (uint64_t)sysv_hash[0] + sysv_hash[1]) * 4;
+        sections.add(".hash", SHT_HASH, SHF_ALLOC, dt[DT_HASH], hash_size, 8, 4, dynsym);
+    }
+    if (dt[DT_RELA]) {
+        sections.add(".rela.dyn", SHT_RELA, SHF_ALLOC, dt[DT_RELA], dt[DT_RELASZ], 8, 24, dynsym);
+    } else if (dt[DT_REL]) {
+        sections.add(".rel.dyn", SHT_REL, SHF_ALLOC, dt[DT_REL], dt[DT_RELSZ], 8, 16, dynsym);
+    } else if (android_rel) {
+        sections.add(android_rela ? ".rela.dyn" : ".rel.dyn",
+                     android_rela ? SHT_ANDROID_RELA : SHT_ANDROID_REL, SHF_ALLOC,
+                     android_rel, android_relsz, 8, 1, dynsym);
+    }
+    if (dt[DT_RELR] || android_relr) {
+        sections.add(".relr.dyn", SHT_RELR, SHF_ALLOC, dt[DT_RELR] ? dt[DT_RELR] : android_relr,
+                     dt[DT_RELR] ? dt[DT_RELRSZ] : android_relrsz, 8, 8);
+    }
+    if (dt[DT_JMPREL]) {
+        bool rela = dt[DT_PLTREL] != DT_REL;
+        sections.add(rela ? ".rela.plt" : ".rel.plt", rela ? SHT_RELA : SHT_REL, SHF_ALLOC,
+                     dt[DT_JMPREL], dt[DT_PLTRELSZ], 8, rela ? 24 : 16, dynsym);
+    }
+    if (dt[DT_INIT_ARRAY]) {
+        sections.add(".init_array", SHT_INIT_ARRAY, SHF_ALLOC | SHF_WRITE, dt[DT_INIT_ARRAY],
+                     dt[DT_INIT_ARRAYSZ], 8, 8);
+    }
+    if (dt[DT_FINI_ARRAY]) {
+        sections.add(".fini_array", SHT_FINI_ARRAY, SHF_ALLOC | SHF_WRITE, dt[DT_FINI_ARRAY],
+                     dt[DT_FINI_ARRAYSZ], 8, 8);
+    }
+    if (dynamic) {
+        sections.add(".dynamic", SHT_DYNAMIC, SHF_ALLOC | SHF_WRITE, dynamic->p_vaddr,
+                     dynamic->p_filesz, 8, sizeof(Elf64_Dyn), dynstr);
+    }
+
+    // What the tables above leave of each segment becomes .text, .rodata
+    // or .data sections, so code and data are addressable.
+    uint64_t headers_end = min_vaddr + ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr);
+    std::vector<Elf64_Shdr> tables(sections.headers().begin() + 1, sections.headers().end());
+    std::sort(tables.begin(), tables.end(),
+              [](const Elf64_Shdr& a, const Elf64_Shdr& b) { return a.sh_addr < b.sh_addr; });
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        const Elf64_Phdr& p = phdr[i];
+        if (p.p_type != PT_LOAD) continue;
+        const char* name = (p.p_flags & PF_X) ? ".text" : (p.p_flags & PF_W) ? ".data" : ".rodata";
+        uint64_t flags = SHF_ALLOC | ((p.p_flags & PF_X) ? SHF_EXECINSTR : 0) |
+                         ((p.p_flags & PF_W) ? SHF_WRITE : 0);
+        uint64_t align = (p.p_flags & PF_X) ? 16 : 8;
+
+        uint64_t from = p.p_vaddr, to = p.p_vaddr + p.p_memsz;
+        if (from < headers_end && headers_end < to) from = headers_end;
+        for (const Elf64_Shdr& sh : tables) {
+            if (sh.sh_addr + sh.sh_size <= from || sh.sh_addr >= to) continue;
+            if (sh.sh_addr >= from + kMinGap) {
+                sections.add(name, SHT_PROGBITS, flags, from, sh.sh_addr - from, align, 0);
+            }
+            from = std::max(from, sh.sh_addr + sh.sh_size);
+        }
+        if (to >= from + kMinGap) sections.add(name, SHT_PROGBITS, flags, from, to - from, align, 0);
+    }
+
+    // Defined symbols still carry the original section indexes
+    Elf64_Sym* syms = dynsym ? img.at<Elf64_Sym>(symtab, info.symbols) : nullptr;
+    for (uint64_t i = 1; syms && i < info.symbols; i++) {
+        if (syms[i].st_shndx == 0 || syms[i].st_shndx >= SHN_LORESERVE) continue;
+        for (int j = 1; j < (int)sections.headers().size(); j++) {
+            const Elf64_Shdr& sh = sections[j];
+            if (syms[i].st_value >= sh.sh_addr && syms[i].st_value < sh.sh_addr + sh.sh_size) {
+                syms[i].st_shndx = (Elf64_Half)j;
+                break;
+            }
+        }
+    }
+
+    // .shstrtab and the headers go after the image
+    uint64_t names_at = (size + 7) & ~(uint64_t)7;
+    int shstrndx = sections.add(".shstrtab", SHT_STRTAB, 0, min_vaddr + names_at, 0, 1, 0);
+    sections[shstrndx].sh_addr = 0;
+    sections[shstrndx].sh_size = sections.names().size();
+    uint64_t headers_at = (names_at + sections.names().size() + 7) & ~(uint64_t)7;
+
+    ehdr->e_shoff = headers_at;
+    ehdr->e_shentsize = sizeof(Elf64_Shdr);
+    ehdr->e_shnum = (Elf64_Half)sections.headers().size();
+    ehdr->e_shstrndx = (Elf64_Half)shstrndx;
+    info.sections = ehdr->e_shnum;
+
+    bool ok = msync(data, size, MS_SYNC) == 0;
+    munmap(data, size);
+    ok = ok && write_at(fd, sections.names().data(), sections.names().size(), (off_t)names_at) &&
+         write_at(fd, sections.headers().data(), sections.headers().size() * sizeof(Elf64_Shdr),
+                  (off_t)headers_at);
+    if (!ok) error = std::string("write failed: ") + strerror(errno);
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,136 @@
+#include <renef/frame_io.h>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+void FrameReader::feed(const char* data, size_t len) {
+    buffer_.append(data, len);
+
+    size_t pos = 0;
+    while (pos < buffer_.size()) {
+        if ((uint8_t)buffer_[pos] != FRAME_MAGIC) {
+            size_t magic = buffer_.find((char)FRAME_MAGIC, pos);
+            size_t end = magic == std::string::npos ? buffer_.size() : magic;
+            text_.append(buffer_, pos, end - pos);
+            pos = end;
+            continue;
+        }
+        if (buffer_.size() - pos < FRAME_HEADER_SIZE) break;
+
+        FrameHeader header;
+        if (!frame_decode((const uint8_t*)buffer_.data() + pos, &header)) {
+            // Not a header after all; treat the byte as text and move on.
+            text_.push_back(buffer_[pos]);
+            pos++;
+            continue;
+        }
+        if (buffer_.size() - pos - FRAME_HEADER_SIZE < header.length) break;
+
+        Frame frame;
+        frame.type = header.type;
+        frame.flags = header.flags;
+        frame.id = header.id;
+        frame.payload.assign(buffer_, pos + FRAME_HEADER_SIZE, header.length);
+        frames_.push_back(std::move(frame));
+        pos += FRAME_HEADER_SIZE + header.length;
+    }
+    buffer_.erase(0, pos);
+}
+
+bool FrameReader::next(Frame& out) {
+    if (frames_.empty()) return false;
+    out = std::move(frames_.front());
+    frames_.pop_front();
+    return true;
+}
+
+std::string FrameReader::take_text() {
+    std::string text;
+    text.swap(text_);
+    return text;
+}
+
+void FrameReader::clear() {
+    buffer_.clear();
+    text_.clear();
+    frames_.clear();
+}
+
+static bool send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            poll(&pfd, 1, 100);
+            continue;
+        }
+        if (n <= 0) return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+bool frame_send(int fd, uint8_t type, uint16_t flags, uint32_t id, const void* data, size_t len) {
+    if (fd < 0 || len > FRAME_MAX_PAYLOAD) return false;
+
+    // One buffer, so small frames leave in a single segment.
+    std::string out;
+    out.resize(FRAME_HEADER_SIZE);
+    frame_encode((uint8_t*)&out[0], type, flags, id, (uint32_t)len);
+    out.append((const char*)data, len);
+    return send_all(fd, out.data(), out.size());
+}
+
+int frame_pump(int fd, FrameReader& reader, int timeout_ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret == 0) return 0;
+    if (ret < 0) return errno == EINTR ? 0 : -1;
+    if (!(pfd.revents & POLLIN)) return -1;
+
+    char buffer[16384];
+    bool got = false;
+    while (true) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0) {
+            reader.feed(buffer, (size_t)n);
+            got = true;
+            if ((size_t)n < sizeof(buffer)) break;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return got ? 1 : -1;
+    }
+    return got ? 1 : 0;
+}
+
+bool frame_request(int fd, FrameReader& reader, uint32_t id, const std::string& payload,
+                   int idle_timeout_ms, const std::function<void(const Frame&)>& on_frame,
+                   uint16_t* end_flags) {
+    if (!frame_send(fd, FRAME_REQUEST, 0, id, payload.data(), payload.size())) {
+        return false;
+    }
+
+    int idle_ms = 0;
+    while (true) {
+        Frame frame;
+        while (reader.next(frame)) {
+            idle_ms = 0;
+            if (frame.type == FRAME_END && frame.id == id) {
+                if (end_flags) *end_flags = frame.flags;
+                return true;
+            }
+            if (on_frame) on_frame(frame);
+        }
+        if (idle_ms >= idle_timeout_ms) return false;
+
+        int ret = frame_pump(fd, reader, 100);
+        if (ret < 0) return false;
+        if (ret == 0) idle_ms += 100;
+    }
+}
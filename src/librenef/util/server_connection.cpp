@@ -82,11 +82,17 @@ bool ServerConnection::connect(const std::string& host, int port) {
 
 void ServerConnection::disconnect() {
     std::lock_guard<std::mutex> lock(mtx);
+    close_locked();
+}
 
+void ServerConnection::close_locked() {
     if (sock_fd >= 0) {
         close(sock_fd);
         sock_fd = -1;
     }
+    framed_ = false;
+    reader_.clear();
+    active_id_ = 0;
 }
 
 bool ServerConnection::is_connected() const {
@@ -108,6 +114,20 @@ bool ServerConnection::send(const std::string& data) {
 
     if (sock_fd < 0) return false;
 
+    if (framed_) {
+        std::string command = data;
+        while (!command.empty() && (command.back() == '\n' || command.back() == '\r')) {
+            command.pop_back();
+        }
+        uint32_t id = next_id_++;
+        if (!frame_send(sock_fd, FRAME_REQUEST, 0, id, command.data(), command.size())) {
+            close_locked();
+            return false;
+        }
+        active_id_ = id;
+        return true;
+    }
+
     ssize_t total = 0;
     ssize_t len = data.length();
     const char* ptr = data.c_str();
@@ -115,8 +135,7 @@ bool ServerConnection::send(const std::string& data) {
     while (total < len) {
         ssize_t n = ::send(sock_fd, ptr + total, len - total, MSG_NOSIGNAL);
         if (n <= 0) {
-            close(sock_fd);
-            sock_fd = -1;
+            close_locked();
             return false;
         }
         total += n;
@@ -131,6 +150,33 @@ std::string ServerConnection::receive(int timeout_ms) {
     if (sock_fd < 0) return "";
 
     std::string result;
+
+    if (framed_) {
+        // Same shape as the text path (wait for the first output, then
+        // keep going while more follows within 50ms), but the END of the
+        // running request ends it right away.
+        int wait_ms = timeout_ms;
+        while (true) {
+            Frame frame;
+            while (reader_.next(frame)) {
+                if (frame.type == FRAME_DATA || frame.type == FRAME_EVENT) {
+                    result += frame.payload;
+                } else if (frame.type == FRAME_END && frame.id == active_id_) {
+                    active_id_ = 0;
+                    return result;
+                }
+            }
+            int ret = frame_pump(sock_fd, reader_, wait_ms);
+            if (ret < 0) {
+                close_locked();
+                break;
+            }
+            if (ret == 0) break;
+            if (!result.empty()) wait_ms = 50;
+        }
+        return result;
+    }
+
     char buffer[4096];
 
     struct pollfd pfd;
@@ -150,8 +196,7 @@ std::string ServerConnection::receive(int timeout_ms) {
 
         if (n == 0) {
             // Peer closed connection - mark as disconnected
-            close(sock_fd);
-            sock_fd = -1;
+            close_locked();
             break;
         }
 
@@ -161,14 +206,132 @@ std::string ServerConnection::receive(int timeout_ms) {
         }
 
         // Real recv error - mark as disconnected
-        close(sock_fd);
-        sock_fd = -1;
+        close_locked();
         break;
     }
 
     return result;
 }
 
+bool ServerConnection::enable_framing(int timeout_ms) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (sock_fd < 0) return false;
+    if (framed_) return true;
+
+    static const char hello[] = "con " FRAME_HELLO "\n";
+    if (::send(sock_fd, hello, sizeof(hello) - 1, MSG_NOSIGNAL) != (ssize_t)(sizeof(hello) - 1)) {
+        close_locked();
+        return false;
+    }
+
+    // The reply is a single text line either way: "OK frames" or an
+    // unknown-command error from an older server.
+    std::string reply;
+    char c;
+    while (reply.size() < 256) {
+        struct pollfd pfd = {sock_fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) <= 0) break;
+        ssize_t n = recv(sock_fd, &c, 1, 0);
+        if (n <= 0) {
+            close_locked();
+            return false;
+        }
+        if (c == '\n') break;
+        reply += c;
+    }
+
+    framed_ = (reply == "OK frames");
+    return framed_;
+}
+
+bool ServerConnection::is_framed() const {
+    return framed_;
+}
+
+bool ServerConnection::send_input(const std::string& data) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (sock_fd < 0) return false;
+        if (framed_) {
+            if (active_id_ == 0) return false;
+            if (!frame_send(sock_fd, FRAME_INPUT, 0, active_id_, data.data(), data.size())) {
+                close_locked();
+                return false;
+            }
+            return true;
+        }
+    }
+    return send(data);
+}
+
+std::string ServerConnection::request(const std::string& command, int idle_timeout_ms) {
+    if (!framed_) {
+        if (!send(command + "\n")) return "";
+        return receive(idle_timeout_ms);
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (sock_fd < 0) return "";
+
+    std::string result;
+    uint32_t id = next_id_++;
+    active_id_ = id;
+    bool done = frame_request(sock_fd, reader_, id, command, idle_timeout_ms,
+        [&](const Frame& frame) {
+            if (frame.type == FRAME_DATA || frame.type == FRAME_EVENT) {
+                result += frame.payload;
+            }
+        });
+    if (done) {
+        active_id_ = 0;
+    } else if (!is_connected()) {
+        close_locked();
+    }
+    return result;
+}
+
+bool ServerConnection::request_stream(const std::string& command,
+                                      const std::function<void(const char*, size_t)>& on_data,
+                                      int idle_timeout_ms) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (sock_fd < 0 || !framed_) return false;
+
+    uint32_t id = next_id_++;
+    uint16_t end_flags = 0;
+    active_id_ = id;
+    bool done = frame_request(sock_fd, reader_, id, command, idle_timeout_ms,
+        [&](const Frame& frame) {
+            if (frame.type == FRAME_DATA && frame.id == id) {
+                on_data(frame.payload.data(), frame.payload.size());
+            }
+        }, &end_flags);
+    if (done) {
+        active_id_ = 0;
+    } else if (!is_connected()) {
+        close_locked();
+    }
+    return done && !(end_flags & FRAME_F_ERROR);
+}
+
+void ServerConnection::drain() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (sock_fd < 0) return;
+
+    if (framed_) {
+        // Complete frames only; a partial one stays in the reader.
+        while (frame_pump(sock_fd, reader_, 0) > 0) {}
+        Frame frame;
+        while (reader_.next(frame)) {}
+        reader_.take_text();
+        active_id_ = 0;
+        return;
+    }
+
+    char buffer[4096];
+    while (recv(sock_fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+}
+
 std::string ServerConnection::get_host() const {
     return connected_host_;
 }
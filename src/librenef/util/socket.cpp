@@ -4,12 +4,14 @@
 #include <cstring>
 #include <cstdio>
 #include <string>
+#include <algorithm>
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <poll.h>
+#include <cerrno>
 
 SocketHelper::SocketHelper()
-    : transport(nullptr), current_pid(-1) {
+    : transport(nullptr), current_pid(-1), framed(false), next_request_id(1) {
 }
 
 SocketHelper::~SocketHelper() {
@@ -17,6 +19,7 @@ SocketHelper::~SocketHelper() {
 }
 
 int SocketHelper::ensure_connection(int pid) {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
     if (current_pid == pid && transport && transport->is_connected()) {
         return transport->get_fd();
     }
@@ -49,17 +52,31 @@ int SocketHelper::ensure_connection(int pid) {
 }
 
 ssize_t SocketHelper::send_data(const void* data, size_t size, bool prefix_key) {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
     if (!transport || !transport->is_connected()) {
         return -1;
     }
 
-    ssize_t result;
-    if (prefix_key && !session_key.empty()) {
-        std::string full_data = session_key + " " + std::string((const char*)data, size);
-        result = transport->send_data(full_data.c_str(), full_data.length());
-    } else {
-        result = transport->send_data(data, size);
-    }
+    auto send_once = [&]() -> ssize_t {
+        if (framed && prefix_key) {
+            std::string command((const char*)data, size);
+            while (!command.empty() && (command.back() == '\n' || command.back() == '\r')) {
+                command.pop_back();
+            }
+            uint32_t id = next_request_id++;
+            if (!frame_send(transport->get_fd(), FRAME_REQUEST, 0, id, command.data(), command.size())) {
+                return -1;
+            }
+            return (ssize_t)size;
+        }
+        if (prefix_key && !session_key.empty()) {
+            std::string full_data = session_key + " " + std::string((const char*)data, size);
+            return transport->send_data(full_data.c_str(), full_data.length());
+        }
+        return transport->send_data(data, size);
+    };
+
+    ssize_t result = send_once();
 
     if (result < 0 && current_pid > 0) {
         fprintf(stderr, "[SocketHelper] send failed, reconnecting to pid %d...\n", current_pid);
@@ -72,41 +89,196 @@ ssize_t SocketHelper::send_data(const void* data, size_t size, bool prefix_key)
         }
 
         if (!session_key.empty()) {
-            std::string con_cmd = "con " + session_key + "\n";
-            transport->send_data(con_cmd.c_str(), con_cmd.length());
-
-            char drain[256];
-            usleep(50000);
-            int old_flags = fcntl(transport->get_fd(), F_GETFL, 0);
-            fcntl(transport->get_fd(), F_SETFL, old_flags | O_NONBLOCK);
-            while (recv(transport->get_fd(), drain, sizeof(drain), 0) > 0) {}
-            fcntl(transport->get_fd(), F_SETFL, old_flags);
+            establish_session(session_key);
         }
 
-        if (prefix_key && !session_key.empty()) {
-            std::string full_data = session_key + " " + std::string((const char*)data, size);
-            result = transport->send_data(full_data.c_str(), full_data.length());
-        } else {
-            result = transport->send_data(data, size);
-        }
+        result = send_once();
     }
 
     return result;
 }
 
+bool SocketHelper::establish_session(const std::string& key) {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
+    session_key = key;
+    framed = false;
+    reader.clear();
+    text.clear();
+
+    if (!transport || !transport->is_connected()) {
+        return false;
+    }
+
+    std::string con_cmd = "con " + key + " " FRAME_HELLO "\n";
+    if (transport->send_data(con_cmd.c_str(), con_cmd.length()) < 0) {
+        return false;
+    }
+
+    // A framing agent acks with END id 0; an older one says nothing, so
+    // whatever else shows up in the meantime is stale text and dropped.
+    for (int waited = 0; waited < 1000; waited += 50) {
+        if (pump(50) < 0) break;
+        Frame frame;
+        while (reader.next(frame)) {
+            if (frame.type == FRAME_END && frame.id == 0 && frame.payload == FRAME_HELLO) {
+                framed = true;
+            }
+        }
+        if (framed) break;
+    }
+    reader.take_text();
+    return framed;
+}
+
+int SocketHelper::pump(int timeout_ms) {
+    if (!transport || !transport->is_connected()) return -1;
+    return frame_pump(transport->get_fd(), reader, timeout_ms);
+}
+
+void SocketHelper::absorb_frames() {
+    text += reader.take_text();
+    Frame frame;
+    while (reader.next(frame)) {
+        if (frame.type == FRAME_EVENT && event_sink) {
+            event_sink(frame.id, frame.payload.data(), frame.payload.size());
+        } else if (frame.type == FRAME_DATA || frame.type == FRAME_EVENT) {
+            text += frame.payload;
+        }
+    }
+}
+
+void SocketHelper::set_event_sink(std::function<void(uint32_t, const char*, size_t)> sink) {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
+    event_sink = std::move(sink);
+}
+
+int SocketHelper::poll_events(int timeout_ms) {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
+    if (!framed) return -1;
+    int ret = pump(timeout_ms);
+    absorb_frames();
+    return ret;
+}
+
+bool SocketHelper::try_poll_events(int fd, int* result) {
+    std::unique_lock<std::recursive_mutex> lock(io_lock, std::try_to_lock);
+    if (!lock.owns_lock() || !transport || transport->get_fd() != fd) {
+        return false;
+    }
+    *result = poll_events(0);
+    return true;
+}
+
+bool SocketHelper::request(const std::string& command,
+                           const std::function<void(const char*, size_t)>& on_output,
+                           int idle_timeout_ms) {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
+    if (!framed || !transport || !transport->is_connected()) {
+        return false;
+    }
+
+    // Text already flattened out of earlier frames belongs to nobody now.
+    if (!text.empty() && on_output) on_output(text.data(), text.size());
+    text.clear();
+
+    uint16_t end_flags = 0;
+    uint32_t id = next_request_id++;
+    bool done = frame_request(transport->get_fd(), reader, id, command, idle_timeout_ms,
+        [&](const Frame& frame) {
+            if (frame.type == FRAME_EVENT && event_sink) {
+                event_sink(frame.id, frame.payload.data(), frame.payload.size());
+                return;
+            }
+            if (frame.type != FRAME_DATA && frame.type != FRAME_EVENT) return;
+            if (on_output) on_output(frame.payload.data(), frame.payload.size());
+        }, &end_flags);
+
+    std::string stray = reader.take_text();
+    if (!stray.empty() && on_output) on_output(stray.data(), stray.size());
+
+    return done && !(end_flags & FRAME_F_ERROR);
+}
+
+int SocketHelper::wait_data(int timeout_ms) {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
+    if (!transport || !transport->is_connected()) {
+        return -1;
+    }
+
+    if (!framed) {
+        struct pollfd pfd = {transport->get_fd(), POLLIN, 0};
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0) return errno == EINTR ? 0 : -1;
+        if (ret == 0) return 0;
+        return (pfd.revents & POLLIN) ? 1 : -1;
+    }
+
+    // END frames and empty payloads don't count as data, so keep pumping
+    // until text shows up or the time is spent.
+    int waited = 0;
+    while (true) {
+        absorb_frames();
+        if (!text.empty()) return 1;
+        if (timeout_ms >= 0 && waited >= timeout_ms) return 0;
+
+        int slice = timeout_ms < 0 ? 100 : std::min(100, timeout_ms - waited);
+        int ret = pump(slice);
+        if (ret < 0) return -1;
+        if (ret == 0) waited += slice;
+    }
+}
+
 ssize_t SocketHelper::receive_data(void* buffer, size_t size) {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
     if (!transport || !transport->is_connected()) {
         return -1;
     }
-    return transport->receive_data(buffer, size);
+    if (!framed) {
+        return transport->receive_data(buffer, size);
+    }
+
+    // Same contract as recv(): blocks unless the caller made the fd
+    // non-blocking, 0 once the agent has gone away.
+    if (text.empty()) {
+        bool nonblock = fcntl(transport->get_fd(), F_GETFL, 0) & O_NONBLOCK;
+        int ret = wait_data(nonblock ? 0 : -1);
+        if (ret < 0) return 0;
+        if (ret == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    size_t n = std::min(size, text.size());
+    memcpy(buffer, text.data(), n);
+    text.erase(0, n);
+    return (ssize_t)n;
 }
 
 void SocketHelper::drain_buffer() {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
     if (!transport || !transport->is_connected()) return;
 
     int fd = transport->get_fd();
     if (fd < 0) return;
 
+    if (framed) {
+        // Drop complete frames only; a partial one stays in the reader.
+        // Events aren't stale for whoever subscribed to them.
+        for (int i = 0; i < 50; i++) {
+            if (pump(10) <= 0) break;
+        }
+        Frame frame;
+        while (reader.next(frame)) {
+            if (frame.type == FRAME_EVENT && event_sink) {
+                event_sink(frame.id, frame.payload.data(), frame.payload.size());
+            }
+        }
+        reader.take_text();
+        text.clear();
+        return;
+    }
+
     int old_flags = fcntl(fd, F_GETFL, 0);
     fcntl(fd, F_SETFL, old_flags | O_NONBLOCK);
 
@@ -126,25 +298,38 @@ void SocketHelper::drain_buffer() {
 }
 
 bool SocketHelper::is_connected() const {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
     return transport && transport->is_connected();
 }
 
+bool SocketHelper::is_framed() const {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
+    return framed;
+}
+
 int SocketHelper::get_socket_fd() const {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
     return transport ? transport->get_fd() : -1;
 }
 
 void SocketHelper::close_connection() {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
     if (transport) {
         transport->close();
         transport.reset();
         current_pid = -1;
     }
+    framed = false;
+    reader.clear();
+    text.clear();
 }
 
 void SocketHelper::set_session_key(std::string key) {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
     session_key = key;
 }
 
 std::string SocketHelper::get_session_key() {
+    std::lock_guard<std::recursive_mutex> lock(io_lock);
     return session_key;
 }
@@ -0,0 +1,152 @@
+#include <renef/symcache.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __ANDROID__
+#define RENEF_SYMCACHE_DIR "/data/local/tmp/renef/symcache"
+#else
+#define RENEF_SYMCACHE_DIR "/tmp/renef/symcache"
+#endif
+
+const CachedSymbol* SymbolTable::find(const std::string& name) const {
+    auto it = by_name.find(name);
+    return it != by_name.end() ? &it->second : nullptr;
+}
+
+const std::string* SymbolTable::find_value(uint64_t value) const {
+    auto it = by_value.upper_bound(value);
+    if (it == by_value.begin()) return nullptr;
+    --it;
+    return &it->second;
+}
+
+static void make_dirs(const std::string& path) {
+    for (size_t pos = 1; pos != std::string::npos; ) {
+        pos = path.find('/', pos + 1);
+        mkdir(path.substr(0, pos).c_str(), 0755);
+    }
+}
+
+// Keys come from the agent; only accept what symindex_key produces.
+static bool valid_key(const std::string& key) {
+    if (key.empty() || key.size() > 128) return false;
+    for (char c : key) {
+        bool ok = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-';
+        if (!ok) return false;
+    }
+    return true;
+}
+
+SymbolCache& SymbolCache::instance() {
+    static SymbolCache cache;
+    return cache;
+}
+
+SymbolCache::SymbolCache() {
+    const char* env = getenv("RENEF_SYMCACHE_DIR");
+    dir_ = (env && *env) ? env : RENEF_SYMCACHE_DIR;
+}
+
+std::string SymbolCache::file_for(const std::string& key) const {
+    return dir_ + "/" + key + ".sym";
+}
+
+bool SymbolCache::parse_header(const std::string& line, std::string& key, std::string& path) {
+    if (line.compare(0, 5, "SYMS ") != 0) return false;
+
+    size_t key_end = line.find(' ', 5);
+    if (key_end == std::string::npos) return false;
+
+    key = line.substr(5, key_end - 5);
+    path = line.substr(key_end + 1);
+    while (!path.empty() && (path.back() == '\n' || path.back() == '\r')) {
+        path.pop_back();
+    }
+    return valid_key(key);
+}
+
+std::shared_ptr<SymbolTable> SymbolCache::parse(const std::string& response) {
+    auto table = std::make_shared<SymbolTable>();
+    std::istringstream in(response);
+    std::string line;
+
+    if (!std::getline(in, line) || !parse_header(line, table->key, table->path)) {
+        return nullptr;
+    }
+
+    while (std::getline(in, line)) {
+        if (line == "END") return table;
+
+        char name[1024];
+        unsigned long long value, size;
+        unsigned type;
+        char kind;
+        if (sscanf(line.c_str(), "%llx %llx %u %c %1023s", &value, &size, &type, &kind, name) != 5) {
+            continue;
+        }
+
+        CachedSymbol sym;
+        sym.value = value;
+        sym.size = size;
+        sym.type = (uint8_t)type;
+        sym.dynamic = kind == 'd';
+
+        // dynsym lines come first; keep them over same-named symtab entries
+        auto inserted = table->by_name.emplace(name, sym);
+        if (inserted.second) {
+            table->by_value.emplace(value, inserted.first->first);
+        }
+    }
+
+    // A response without END was cut short; don't cache half a table.
+    return nullptr;
+}
+
+std::shared_ptr<const SymbolTable> SymbolCache::get(const std::string& key) {
+    if (!valid_key(key)) return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = tables_.find(key);
+        if (it != tables_.end()) return it->second;
+    }
+
+    std::ifstream file(file_for(key), std::ios::binary);
+    if (!file) return nullptr;
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::shared_ptr<const SymbolTable> table = parse(contents.str());
+    if (!table || table->key != key) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    tables_[key] = table;
+    return table;
+}
+
+std::shared_ptr<const SymbolTable> SymbolCache::put(const std::string& response) {
+    std::shared_ptr<const SymbolTable> table = parse(response);
+    if (!table) return nullptr;
+
+    // "m<base>" keys name an in-memory image and mean nothing next session.
+    if (table->key[0] != 'm') {
+        make_dirs(dir_);
+        std::string path = file_for(table->key);
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+            if (file) file << response;
+        }
+        if (rename(tmp.c_str(), path.c_str()) != 0) {
+            unlink(tmp.c_str());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    tables_[table->key] = table;
+    return table;
+}
@@ -96,22 +96,10 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    while (true) {
-        std::cout << "Waiting for client connection...\n";
-
-        int client = server.accept_client();
-        if (client < 0) {
-            if (errno == EINTR) {
-                std::cout << "accept() interrupted by signal, retrying...\n";
-                continue;
-            }
-            std::cerr << "Failed to accept client: " << strerror(errno) << ", retrying...\n";
-            sleep(1);
-            continue;
-        }
-
-        server.handle_client();
-        std::cout << "Client handler finished, looping back to accept\n";
+    // Serves every client from here on; only returns on a fatal error.
+    if (server.run() < 0) {
+        std::cerr << "Server loop failed\n";
+        return 1;
     }
 
     return 0;
@@ -0,0 +1,78 @@
+#include "support.h"
+
+#include <agent/globals.h>
+#include <agent/trace.h>
+
+#include <stdlib.h>
+
+/*
+ * Cost of the logging statements in a hooked call. The same handler is
+ * built with RENEF_LOG_LEVEL_MAX=0 (statements compiled out) and with
+ * the default maximum, then run with logging off, debug on, and trace
+ * on (which includes debug) both deferred and inline. Fails if logging that is off costs measurably more
+ * than logging that is compiled out.
+ *
+ * Usage: bench_log [calls]
+ */
+
+uint64_t handler_stripped(uint64_t x0, uint64_t x1, uint64_t x2);
+uint64_t handler_leveled(uint64_t x0, uint64_t x1, uint64_t x2);
+
+typedef uint64_t (*handler_fn)(uint64_t, uint64_t, uint64_t);
+
+#define ROUNDS 5
+
+static volatile uint64_t g_sink;
+
+// Best of ROUNDS, in ns per call
+static double run(handler_fn fn, long calls) {
+    double best = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        uint64_t acc = 0;
+        uint64_t start = test_now_ns();
+        for (long i = 0; i < calls; i++) {
+            acc += fn((uint64_t)i, acc, 0x1234);
+        }
+        double ns = (double)(test_now_ns() - start) / (double)calls;
+        g_sink = acc;
+        if (r == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    long calls = argc > 1 ? atol(argv[1]) : 20000000;
+
+    g_log_level = LOG_LEVEL_OFF;
+    double stripped = run(handler_stripped, calls);
+    double off = run(handler_leveled, calls);
+
+    // Enabled paths are slower by design; fewer calls keep the ring from
+    // overflowing into the drop counter for most of the run
+    long slow_calls = calls / 100 > 0 ? calls / 100 : 1;
+
+    g_log_level = LOG_LEVEL_DEBUG;
+    double debug = run(handler_leveled, slow_calls);
+
+    g_log_level = LOG_LEVEL_TRACE;
+    trace_set_deferred(true);
+    double deferred = run(handler_leveled, slow_calls);
+    trace_set_deferred(false);
+    double inline_fmt = run(handler_leveled, slow_calls);
+    g_log_level = LOG_LEVEL_OFF;
+
+    uint64_t recorded = 0, dropped = 0;
+    trace_get_stats(&recorded, &dropped);
+
+    printf("%-22s %8.2f ns/call\n", "compiled out", stripped);
+    printf("%-22s %8.2f ns/call\n", "level off", off);
+    printf("%-22s %8.2f ns/call\n", "debug", debug);
+    printf("%-22s %8.2f ns/call\n", "trace, deferred", deferred);
+    printf("%-22s %8.2f ns/call\n", "trace, inline", inline_fmt);
+    printf("trace records: %llu recorded, %llu dropped\n",
+           (unsigned long long)recorded, (unsigned long long)dropped);
+
+    // One predicted branch per statement; allow for timer noise
+    CHECK(off <= stripped * 1.5 + 1.0);
+    return 0;
+}
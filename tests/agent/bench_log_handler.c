@@ -0,0 +1,17 @@
+#include <agent/globals.h>
+#include <agent/trace.h>
+
+// Stand-in for the native hook entry path (hook_logger), built once per
+// logging configuration. HANDLER names the copy.
+
+__attribute__((noinline))
+uint64_t HANDLER(uint64_t x0, uint64_t x1, uint64_t x2) {
+    verbose_log("hook_logger: target=%p", (void*)(uintptr_t)x0);
+    trace_log("enter x0=%llx x1=%llx x2=%llx",
+              (unsigned long long)x0, (unsigned long long)x1, (unsigned long long)x2);
+
+    uint64_t ret = x0 * 31 + (x1 ^ x2);
+
+    verbose_log("hook_logger: ret=0x%llx", (unsigned long long)ret);
+    return ret;
+}
@@ -0,0 +1,180 @@
+#include "support.h"
+
+#include <agent/maps.h>
+
+#include <link.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * /proc/self/maps index (proc/maps.c): cost of a full rebuild against
+ * the fgets + sscanf loop each caller used to run, of a cached acquire,
+ * and of an address lookup against a linear walk. Lookups are checked
+ * against the linear walk as they go. Extra regions are mapped first so
+ * the process looks like an app (a few thousand mappings), not a small
+ * test binary. Last, the index is used from inside the loader's lock (as
+ * a library load callback does) while another thread rebuilds it.
+ *
+ * Usage: bench_maps [rounds] [extra_regions]
+ */
+
+#define LOOKUPS     200000
+#define PAGE        4096
+
+// Alternating protections keep the kernel from merging neighbours
+static void* map_regions(int count) {
+    uint8_t* base = mmap(NULL, (size_t)count * PAGE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return NULL;
+    for (int i = 1; i < count; i += 2) {
+        mprotect(base + (size_t)i * PAGE, PAGE, PROT_NONE);
+    }
+    return base;
+}
+
+// The per-caller parser the index replaced
+static int parse_maps_sscanf(void) {
+    FILE* fp = fopen("/proc/self/maps", "r");
+    if (!fp) return -1;
+
+    char line[512];
+    int count = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long start, end, offset, inode;
+        unsigned int major, minor;
+        char perms[5];
+        char path[256] = "";
+        if (sscanf(line, "%lx-%lx %4s %lx %x:%x %lu %255s",
+                   &start, &end, perms, &offset, &major, &minor, &inode, path) >= 7) {
+            count++;
+        }
+    }
+    fclose(fp);
+    return count;
+}
+
+static const MapRegion* linear_lookup(const MapsIndex* idx, uintptr_t addr) {
+    for (int i = 0; i < idx->count; i++) {
+        if (addr >= idx->regions[i].start && addr < idx->regions[i].end) {
+            return &idx->regions[i];
+        }
+    }
+    return NULL;
+}
+
+static volatile int g_rebuilding = 1;
+
+static void* rebuild_thread(void* arg) {
+    (void)arg;
+    while (g_rebuilding) {
+        maps_release(maps_acquire_fresh());
+    }
+    return NULL;
+}
+
+static int acquire_in_loader(struct dl_phdr_info* info, size_t size, void* data) {
+    (void)info;
+    (void)size;
+    maps_release(maps_acquire_fresh());
+    (*(int*)data)++;
+    return 0;
+}
+
+// Deadlocks (the alarm fails the test) if the index asks the loader
+// while holding its own lock.
+static int check_loader_lock_order(void) {
+    pthread_t tid;
+    CHECK(pthread_create(&tid, NULL, rebuild_thread, NULL) == 0);
+    alarm(30);
+    int calls = 0;
+    for (int i = 0; i < 50; i++) {
+        dl_iterate_phdr(acquire_in_loader, &calls);
+    }
+    g_rebuilding = 0;
+    pthread_join(tid, NULL);
+    alarm(0);
+    CHECK(calls > 0);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    int extra = argc > 2 ? atoi(argv[2]) : 3000;
+    void* extra_map = extra > 0 ? map_regions(extra) : NULL;
+    CHECK(extra == 0 || extra_map);
+
+    uint64_t t0 = test_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        CHECK(parse_maps_sscanf() > 0);
+    }
+    double sscanf_us = (double)(test_now_ns() - t0) / rounds / 1000.0;
+
+    t0 = test_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        maps_invalidate();
+        const MapsIndex* idx = maps_acquire();
+        CHECK(idx && idx->count > 0);
+        maps_release(idx);
+    }
+    double rebuild_us = (double)(test_now_ns() - t0) / rounds / 1000.0;
+
+    long acquires = (long)rounds * 1000;
+    t0 = test_now_ns();
+    for (long i = 0; i < acquires; i++) {
+        maps_release(maps_acquire());
+    }
+    double acquire_ns = (double)(test_now_ns() - t0) / (double)acquires;
+
+    const MapsIndex* idx = maps_acquire();
+    CHECK(idx && idx->count > 0);
+
+    // Addresses inside and between regions, checked against the walk
+    uintptr_t* addrs = malloc(LOOKUPS * sizeof(uintptr_t));
+    CHECK(addrs);
+    uint64_t rng = 0x2545F4914F6CDD1DULL;
+    for (int i = 0; i < LOOKUPS; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        const MapRegion* r = &idx->regions[rng % (uint64_t)idx->count];
+        addrs[i] = (rng >> 32) & 1 ? r->start + (rng >> 33) % (r->end - r->start) : r->end;
+        CHECK(maps_lookup(idx, addrs[i]) == linear_lookup(idx, addrs[i]));
+    }
+
+    uintptr_t sink = 0;
+    t0 = test_now_ns();
+    for (int i = 0; i < LOOKUPS; i++) {
+        const MapRegion* r = maps_lookup(idx, addrs[i]);
+        sink += r ? r->start : 0;
+    }
+    double lookup_ns = (double)(test_now_ns() - t0) / LOOKUPS;
+
+    t0 = test_now_ns();
+    for (int i = 0; i < LOOKUPS; i++) {
+        const MapRegion* r = linear_lookup(idx, addrs[i]);
+        sink -= r ? r->start : 0;
+    }
+    double linear_ns = (double)(test_now_ns() - t0) / LOOKUPS;
+    CHECK(sink == 0);
+
+    int regions = idx->count;
+    maps_release(idx);
+    free(addrs);
+
+    CHECK(maps_module_base("libc", NULL, 0) != 0);
+    // The loader callback's unindexed read, through the extra regions
+    CHECK(maps_read_module_base("libc") == maps_module_base("libc", NULL, 0));
+    CHECK(maps_read_module_base("no_such_module.so") == 0);
+    if (extra_map) munmap(extra_map, (size_t)extra * PAGE);
+    CHECK(check_loader_lock_order() == 0);
+
+    printf("%d regions\n", regions);
+    printf("%-22s %10.2f us\n", "fgets+sscanf parse", sscanf_us);
+    printf("%-22s %10.2f us\n", "index rebuild", rebuild_us);
+    printf("%-22s %10.2f ns\n", "cached acquire", acquire_ns);
+    printf("%-22s %10.2f ns\n", "lookup (binary)", lookup_ns);
+    printf("%-22s %10.2f ns\n", "lookup (linear)", linear_ns);
+    return 0;
+}
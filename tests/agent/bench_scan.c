@@ -0,0 +1,192 @@
+#include "support.h"
+
+#include <agent/scan.h>
+#include <agent/lua_memory.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Pattern scan throughput (proc/scan.c) against the byte-by-byte masked
+ * compare Memory.search used before. The buffer is filled like a heap:
+ * mostly zeros and small values with some random bytes, and a few
+ * planted matches. Every engine must report exactly the naive loop's
+ * hits.
+ *
+ * Usage: bench_scan [MB]
+ */
+
+#define PLANTED     64
+#define MAX_HITS    100000
+#define MULTI_COUNT 16
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_rand(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+static void fill(uint8_t* buf, size_t size) {
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t r = next_rand();
+        uint64_t word;
+        switch (r & 3) {
+            case 0:
+            case 1: word = 0; break;
+            case 2: word = (r >> 8) & 0xFF; break;
+            default: word = r; break;
+        }
+        memcpy(buf + i, &word, size - i < 8 ? size - i : 8);
+    }
+}
+
+// What memory_search_pattern did per offset before the scan engine
+static int naive_scan(const int* pattern, size_t len, const uint8_t* buf, size_t size,
+                      uintptr_t* hits, int max_hits) {
+    int count = 0;
+    for (size_t i = 0; i + len <= size && count < max_hits; i++) {
+        size_t j = 0;
+        while (j < len && (pattern[j] == WILDCARD_BYTE || pattern[j] == buf[i + j])) j++;
+        if (j == len) hits[count++] = (uintptr_t)(buf + i);
+    }
+    return count;
+}
+
+static double gbps(size_t bytes, uint64_t ns) {
+    return ns ? (double)bytes / (double)ns : 0;
+}
+
+static int check_same(const ScanHit* hits, int n, const uintptr_t* ref, int nref) {
+    CHECK(n == nref);
+    for (int i = 0; i < n; i++) {
+        CHECK(hits[i].addr == ref[i]);
+    }
+    return 0;
+}
+
+static int bench_pattern(const char* name, const int* pattern, size_t len,
+                         const uint8_t* buf, size_t size) {
+    uintptr_t* ref = malloc(MAX_HITS * sizeof(uintptr_t));
+    CHECK(ref);
+
+    uint64_t t0 = test_now_ns();
+    int nref = naive_scan(pattern, len, buf, size, ref, MAX_HITS);
+    uint64_t naive_ns = test_now_ns() - t0;
+
+    ScanPattern sp;
+    CHECK(scan_pattern_init_masked(&sp, pattern, len));
+
+    // One thread through scan_find, as Memory.search on a single region
+    t0 = test_now_ns();
+    int nfind = 0;
+    const uint8_t* end = buf + size;
+    for (const uint8_t* p = scan_find(&sp, buf, end); p && nfind < MAX_HITS;
+         p = scan_find(&sp, p + 1, end)) {
+        CHECK((uintptr_t)p == ref[nfind]);
+        nfind++;
+    }
+    uint64_t find_ns = test_now_ns() - t0;
+    CHECK(nfind == nref);
+
+    ScanRange range = { (uintptr_t)buf, (uintptr_t)end };
+    ScanHit* hits = NULL;
+
+    scan_set_threads(1);
+    t0 = test_now_ns();
+    int n1 = scan_ranges(&sp, &range, 1, MAX_HITS, NULL, &hits);
+    uint64_t one_ns = test_now_ns() - t0;
+    if (check_same(hits, n1, ref, nref)) return 1;
+    free(hits);
+
+    scan_set_threads(0);
+    t0 = test_now_ns();
+    int nn = scan_ranges(&sp, &range, 1, MAX_HITS, NULL, &hits);
+    uint64_t all_ns = test_now_ns() - t0;
+    if (check_same(hits, nn, ref, nref)) return 1;
+    free(hits);
+
+    printf("%-10s hits=%-6d naive %6.2f GB/s | scan_find %6.2f GB/s | "
+           "1 thread %6.2f GB/s | %d thread(s) %6.2f GB/s\n",
+           name, nref, gbps(size, naive_ns), gbps(size, find_ns),
+           gbps(size, one_ns), scan_get_threads(), gbps(size, all_ns));
+    free(ref);
+    return 0;
+}
+
+// Memory.searchMany: one pass for MULTI_COUNT patterns against a pass each
+static int bench_multi(uint8_t* buf, size_t size) {
+    int patterns[MULTI_COUNT][8];
+    ScanMulti* m = scan_multi_create();
+    CHECK(m);
+    for (int i = 0; i < MULTI_COUNT; i++) {
+        for (int j = 0; j < 8; j++) {
+            patterns[i][j] = j == 3 ? WILDCARD_BYTE : (int)((i * 37 + j * 11 + 0x41) & 0xFF);
+        }
+        CHECK(scan_multi_add(m, patterns[i], 8) == i);
+        size_t at = (size_t)(next_rand() % (size - 8));
+        for (int j = 0; j < 8; j++) {
+            buf[at + j] = (uint8_t)(patterns[i][j] == WILDCARD_BYTE ? 0xEE : patterns[i][j]);
+        }
+    }
+    CHECK(scan_multi_compile(m));
+
+    ScanRange range = { (uintptr_t)buf, (uintptr_t)(buf + size) };
+    ScanHit* hits = NULL;
+
+    scan_set_threads(1);
+    uint64_t t0 = test_now_ns();
+    int n = scan_ranges_multi(m, &range, 1, MAX_HITS, NULL, &hits);
+    uint64_t multi_ns = test_now_ns() - t0;
+    free(hits);
+
+    t0 = test_now_ns();
+    int total = 0;
+    for (int i = 0; i < MULTI_COUNT; i++) {
+        ScanPattern sp;
+        CHECK(scan_pattern_init_masked(&sp, patterns[i], 8));
+        total += scan_ranges(&sp, &range, 1, MAX_HITS, NULL, &hits);
+        free(hits);
+    }
+    uint64_t single_ns = test_now_ns() - t0;
+    scan_set_threads(0);
+    scan_multi_free(m);
+
+    CHECK(n == total);
+    printf("%-10s hits=%-6d %d patterns, 1 thread: one pass %6.2f GB/s | "
+           "pass per pattern %6.2f GB/s\n",
+           "multi", n, MULTI_COUNT, gbps(size, multi_ns), gbps(size, single_ns));
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    size_t mb = argc > 1 ? (size_t)atol(argv[1]) : 256;
+    size_t size = mb * 1024 * 1024;
+    uint8_t* buf = malloc(size);
+    CHECK(buf);
+    fill(buf, size);
+
+    static const uint8_t code[] = { 0xFD, 0x7B, 0xBF, 0xA9, 0xFD, 0x03, 0x00, 0x91 };
+    static const char text[] = "frida-agent";
+    for (int i = 0; i < PLANTED; i++) {
+        size_t at = (size_t)(next_rand() % (size - 64));
+        memcpy(buf + at, i & 1 ? (const void*)code : (const void*)text, i & 1 ? sizeof(code) : 11);
+    }
+
+    // Search terms as Memory.search gets them: literal, and with ?? wildcards
+    int literal[11];
+    for (int i = 0; i < 11; i++) literal[i] = (uint8_t)text[i];
+    int masked[8];
+    for (int i = 0; i < 8; i++) masked[i] = i == 2 || i == 6 ? WILDCARD_BYTE : code[i];
+    int zeros[6] = { 0, 0, 0, 0, 0xC3, 0x5A };
+
+    printf("%zu MB buffer\n", mb);
+    int rc = bench_pattern("literal", literal, 11, buf, size)
+          || bench_pattern("wildcard", masked, 8, buf, size)
+          || bench_pattern("zero-run", zeros, 6, buf, size)
+          || bench_multi(buf, size);
+    free(buf);
+    return rc;
+}
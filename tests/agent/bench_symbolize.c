@@ -0,0 +1,167 @@
+#include "support.h"
+
+#include <agent/maps.h>
+#include <agent/symbolize.h>
+
+#include <dlfcn.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Backtrace symbolization (proc/symbolize.c) against dladdr, which
+ * Thread.backtrace() called per frame before. PCs are spread over a set
+ * of libc functions: a few recurring ones (what a hook's backtraces look
+ * like) and enough distinct ones to miss the cache every time. Wherever
+ * dladdr names a symbol, the symbolizer has to name one at the same
+ * address. Last, a dlopen has to move the maps generation (and so flush
+ * the cache) without anyone calling maps_invalidate().
+ *
+ * Usage: bench_symbolize [rounds]
+ */
+
+#define HOT_PCS         16
+#define PCS_PER_FUNC    256
+
+static const char* const k_funcs[] = {
+    "malloc", "free", "memcpy", "strlen", "printf", "fopen", "fread", "qsort",
+    "pthread_create", "pthread_mutex_lock", "clock_gettime", "nanosleep",
+    "open", "read", "write", "mmap", "strtoull", "snprintf", "getenv", "dlopen",
+};
+#define NUM_FUNCS   (int)(sizeof(k_funcs) / sizeof(k_funcs[0]))
+
+// symindex.c resolves libraries by name through proc.c, which needs the
+// output layer; the symbolizer only indexes by path, so these stay unused.
+void* find_library_base(const char* lib_name) {
+    return (void*)maps_module_base(lib_name, NULL, 0);
+}
+
+char* find_library_path(const char* lib_name) {
+    char path[512];
+    return maps_module_base(lib_name, path, sizeof(path)) ? strdup(path) : NULL;
+}
+
+static int object_count(struct dl_phdr_info* info, size_t size, void* data) {
+    (void)info;
+    (void)size;
+    (*(int*)data)++;
+    return 0;
+}
+
+static int check_against_dladdr(const uintptr_t* pcs, int count) {
+    int named = 0;
+    for (int i = 0; i < count; i++) {
+        Dl_info info;
+        SymbolizedPC s;
+        CHECK(symbolize_pc(pcs[i], &s));
+        CHECK(dladdr((void*)pcs[i], &info));
+        CHECK(s.base == (uintptr_t)info.dli_fbase);
+        if (info.dli_sname && info.dli_saddr) {
+            CHECK(s.symbol && s.symbol_addr == (uintptr_t)info.dli_saddr);
+            named++;
+        }
+    }
+    CHECK(named > 0);
+    return 0;
+}
+
+static double frames_per_us(int frames, uint64_t ns) {
+    return ns ? (double)frames * 1000.0 / (double)ns : 0;
+}
+
+static double run_dladdr(const uintptr_t* pcs, int count, int rounds) {
+    uintptr_t sink = 0;
+    uint64_t t0 = test_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < count; i++) {
+            Dl_info info;
+            if (dladdr((void*)pcs[i], &info)) sink += (uintptr_t)info.dli_saddr;
+        }
+    }
+    uint64_t ns = test_now_ns() - t0;
+    return sink ? frames_per_us(count * rounds, ns) : 0;
+}
+
+static double run_symbolize(const uintptr_t* pcs, int count, int rounds, bool raw) {
+    uintptr_t sink = 0;
+    uint64_t t0 = test_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < count; i++) {
+            SymbolizedPC s;
+            if (raw ? symbolize_pc_module(pcs[i], &s) : symbolize_pc(pcs[i], &s)) sink += s.base;
+        }
+    }
+    uint64_t ns = test_now_ns() - t0;
+    return sink ? frames_per_us(count * rounds, ns) : 0;
+}
+
+static int check_dlopen_moves_generation(void) {
+    int before = 0;
+    dl_iterate_phdr(object_count, &before);
+    maps_release(maps_acquire());
+    uint64_t generation = maps_generation();
+
+    void* handle = dlopen("libm.so.6", RTLD_NOW | RTLD_LOCAL);
+    int after = 0;
+    dl_iterate_phdr(object_count, &after);
+    if (!handle || after == before) {
+        // Already loaded (or missing): nothing for the loader check to see
+        if (handle) dlclose(handle);
+        printf("dlopen check skipped: libm.so.6 %s\n", handle ? "already loaded" : "not found");
+        return 0;
+    }
+
+    // Past the maps index's loader recheck interval
+    struct timespec ts = { 0, 60 * 1000 * 1000 };
+    nanosleep(&ts, NULL);
+    SymbolizedPC s;
+    CHECK(symbolize_pc((uintptr_t)dlsym(handle, "cos"), &s));
+    CHECK(maps_generation() != generation);
+    CHECK(s.name && strstr(s.name, "libm"));
+    dlclose(handle);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+
+    int count = NUM_FUNCS * PCS_PER_FUNC;
+    uintptr_t* pcs = malloc((size_t)count * sizeof(uintptr_t));
+    CHECK(pcs);
+    int n = 0;
+    for (int f = 0; f < NUM_FUNCS; f++) {
+        void* fn = dlsym(RTLD_DEFAULT, k_funcs[f]);
+        CHECK(fn);
+        for (int k = 0; k < PCS_PER_FUNC; k++) {
+            pcs[n++] = (uintptr_t)fn + (uintptr_t)k * 4;
+        }
+    }
+
+    CHECK(check_against_dladdr(pcs, count) == 0);
+
+    // One PC from each of the first HOT_PCS function slots
+    uintptr_t hot[HOT_PCS];
+    for (int i = 0; i < HOT_PCS; i++) {
+        hot[i] = pcs[(i % NUM_FUNCS) * PCS_PER_FUNC + (i / NUM_FUNCS) * 4 + 1];
+    }
+
+    int hot_rounds = rounds * 100;
+    double dladdr_hot = run_dladdr(hot, HOT_PCS, hot_rounds);
+    double sym_hot = run_symbolize(hot, HOT_PCS, hot_rounds, false);
+    double raw_hot = run_symbolize(hot, HOT_PCS, hot_rounds, true);
+    double dladdr_miss = run_dladdr(pcs, count, rounds / 10 + 1);
+    double sym_miss = run_symbolize(pcs, count, rounds / 10 + 1, false);
+    CHECK(dladdr_hot > 0 && sym_hot > 0 && raw_hot > 0 && dladdr_miss > 0 && sym_miss > 0);
+
+    CHECK(check_dlopen_moves_generation() == 0);
+    free(pcs);
+
+    printf("%d hot PCs, %d distinct PCs\n", HOT_PCS, count);
+    printf("%-26s %10.2f frames/us\n", "dladdr (hot)", dladdr_hot);
+    printf("%-26s %10.2f frames/us\n", "symbolize_pc (hot)", sym_hot);
+    printf("%-26s %10.2f frames/us\n", "symbolize_pc_module (hot)", raw_hot);
+    printf("%-26s %10.2f frames/us\n", "dladdr (distinct)", dladdr_miss);
+    printf("%-26s %10.2f frames/us\n", "symbolize_pc (distinct)", sym_miss);
+    return 0;
+}
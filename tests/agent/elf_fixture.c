@@ -0,0 +1,18 @@
+/*
+ * A small shared library for test_elf_rebuild: exported code, a
+ * constructor, and data holding pointers (relative relocations), so a
+ * rebuilt image has every table the rebuild fills sections from.
+ */
+
+int fixture_counter = 0;
+
+static const char* const k_names[] = { "one", "two", "three" };
+const char* const* fixture_names = k_names;
+
+__attribute__((constructor)) static void fixture_init(void) {
+    fixture_counter = 40;
+}
+
+int fixture_add(int a) {
+    return a + fixture_counter + (int)(fixture_names[2][0] == 't');
+}
@@ -0,0 +1,14 @@
+#ifndef RENEF_TEST_ANDROID_LOG_H
+#define RENEF_TEST_ANDROID_LOG_H
+
+// Host stand-in for <android/log.h>; support.c drops the messages
+
+#define ANDROID_LOG_DEBUG   3
+#define ANDROID_LOG_INFO    4
+#define ANDROID_LOG_WARN    5
+#define ANDROID_LOG_ERROR   6
+
+int __android_log_print(int prio, const char* tag, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#endif
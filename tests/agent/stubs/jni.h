@@ -0,0 +1,11 @@
+#ifndef RENEF_TEST_JNI_H
+#define RENEF_TEST_JNI_H
+
+// Only the types agent/globals.h mentions; nothing under test calls JNI
+
+struct JNINativeInterface;
+struct JNIInvokeInterface;
+typedef const struct JNINativeInterface* JNIEnv;
+typedef const struct JNIInvokeInterface* JavaVM;
+
+#endif
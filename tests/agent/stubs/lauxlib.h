@@ -0,0 +1 @@
+#include <lua.h>
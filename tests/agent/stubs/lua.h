@@ -0,0 +1,8 @@
+#ifndef RENEF_TEST_LUA_H
+#define RENEF_TEST_LUA_H
+
+// Only the types agent/lua_engine.h mentions; nothing under test runs Lua
+
+typedef struct lua_State lua_State;
+
+#endif
@@ -0,0 +1,53 @@
+#include "support.h"
+
+#include <agent/globals.h>
+#include <agent/output.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// What the agent links against on the device, reduced to counters
+
+int g_log_level = LOG_LEVEL_OFF;
+
+static size_t g_output_bytes = 0;
+
+int __android_log_print(int prio, const char* tag, const char* fmt, ...) {
+    (void)prio;
+    (void)tag;
+    (void)fmt;
+    return 0;
+}
+
+void verbose_log_impl(const char* fmt, ...) {
+    char buf[512];
+    memcpy(buf, "[DBG] ", 6);
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf + 6, sizeof(buf) - 6, fmt, args);
+    va_end(args);
+    if (len < 0) return;
+    if ((size_t)len >= sizeof(buf) - 6) len = sizeof(buf) - 7;
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "%s", buf + 6);
+    output_write_to(OUTPUT_CH_LOG, buf, (size_t)len + 6);
+}
+
+// Weak: tests that link core/output.c get the real one
+__attribute__((weak)) void output_write_to(OutputChannel channel, const char* msg, size_t len) {
+    (void)channel;
+    (void)msg;
+    __atomic_add_fetch(&g_output_bytes, len, __ATOMIC_RELAXED);
+}
+
+size_t test_output_bytes(void) {
+    return __atomic_load_n(&g_output_bytes, __ATOMIC_RELAXED);
+}
+
+uint64_t test_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
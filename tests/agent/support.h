@@ -0,0 +1,21 @@
+#ifndef RENEF_TEST_SUPPORT_H
+#define RENEF_TEST_SUPPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1; \
+        } \
+    } while (0)
+
+/* Bytes the code under test sent through output_write_to() */
+size_t test_output_bytes(void);
+
+uint64_t test_now_ns(void);
+
+#endif
@@ -0,0 +1,231 @@
+#include "support.h"
+
+#include <renef/elf_rebuild.h>
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*
+ * Host side of dumpmod (librenef/util/elf_rebuild.cpp): elf_fixture is
+ * loaded and its PT_LOAD segments are written out from memory the way
+ * the agent streams them (each at its offset from the lowest one, gaps
+ * zero). The rebuilt file is then held against the library on disk:
+ * each table section rebuilt from the dynamic table must sit where the
+ * linker put it, with the same size; dynamic entries the loader rebased
+ * must be link-time values again; the exported function must point at
+ * an executable section. Last, the rebuilt file has to load and run.
+ */
+
+#define PAGE    4096ULL
+
+struct Module {
+    const char* path = nullptr;
+    uint64_t bias = 0;
+    const ElfW(Phdr)* phdr = nullptr;
+    int phnum = 0;
+};
+
+static int find_fixture(struct dl_phdr_info* info, size_t size, void* data) {
+    (void)size;
+    Module* m = (Module*)data;
+    if (!info->dlpi_name || !strstr(info->dlpi_name, "elf_fixture")) return 0;
+    m->path = info->dlpi_name;
+    m->bias = info->dlpi_addr;
+    m->phdr = info->dlpi_phdr;
+    m->phnum = info->dlpi_phnum;
+    return 1;
+}
+
+static std::vector<uint8_t> read_file(const std::string& path) {
+    std::vector<uint8_t> data;
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(fp);
+    return data;
+}
+
+static const Elf64_Shdr* section(const std::vector<uint8_t>& elf, const char* name) {
+    const Elf64_Ehdr* eh = (const Elf64_Ehdr*)elf.data();
+    if (eh->e_shoff == 0 || eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr) > elf.size()) {
+        return nullptr;
+    }
+    const Elf64_Shdr* sh = (const Elf64_Shdr*)(elf.data() + eh->e_shoff);
+    const char* names = (const char*)elf.data() + sh[eh->e_shstrndx].sh_offset;
+    for (int i = 0; i < eh->e_shnum; i++) {
+        if (strcmp(names + sh[i].sh_name, name) == 0) return &sh[i];
+    }
+    return nullptr;
+}
+
+static uint64_t dynamic_value(const std::vector<uint8_t>& elf, const Elf64_Shdr* dyn_sh, int64_t tag) {
+    const Elf64_Dyn* dyn = (const Elf64_Dyn*)(elf.data() + dyn_sh->sh_offset);
+    for (size_t i = 0; i < dyn_sh->sh_size / sizeof(Elf64_Dyn) && dyn[i].d_tag != DT_NULL; i++) {
+        if (dyn[i].d_tag == tag) return dyn[i].d_un.d_val;
+    }
+    return 0;
+}
+
+// What dumpmod writes: PT_LOAD segments from memory, at vaddr - min_vaddr
+static int dump_module(const Module& m, const std::string& out, uint64_t* load_base, int* loads) {
+    uint64_t min_vaddr = UINT64_MAX, end = 0;
+    *loads = 0;
+    for (int i = 0; i < m.phnum; i++) {
+        if (m.phdr[i].p_type != PT_LOAD) continue;
+        min_vaddr = std::min<uint64_t>(min_vaddr, m.phdr[i].p_vaddr & ~(PAGE - 1));
+        end = std::max<uint64_t>(end, m.phdr[i].p_vaddr + m.phdr[i].p_memsz);
+        (*loads)++;
+    }
+    CHECK(*loads > 0);
+
+    std::vector<uint8_t> image(end - min_vaddr, 0);
+    for (int i = 0; i < m.phnum; i++) {
+        const ElfW(Phdr)& p = m.phdr[i];
+        if (p.p_type != PT_LOAD) continue;
+        memcpy(image.data() + (p.p_vaddr - min_vaddr), (const void*)(m.bias + p.p_vaddr), p.p_memsz);
+    }
+    *load_base = m.bias + min_vaddr;
+
+    FILE* fp = fopen(out.c_str(), "wb");
+    CHECK(fp);
+    CHECK(fwrite(image.data(), 1, image.size(), fp) == image.size());
+    fclose(fp);
+    return 0;
+}
+
+static int check_sections(const std::vector<uint8_t>& orig, const std::vector<uint8_t>& rebuilt,
+                          const ElfRebuildInfo& info) {
+    const Elf64_Ehdr* eh = (const Elf64_Ehdr*)rebuilt.data();
+    CHECK(eh->e_shentsize == sizeof(Elf64_Shdr));
+    CHECK(eh->e_shnum == info.sections);
+    CHECK(eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr) <= rebuilt.size());
+    CHECK(section(rebuilt, ".shstrtab") != nullptr);
+
+    // Tables the dynamic section names land on the linker's sections
+    static const char* const tables[] = {
+        ".dynsym", ".dynstr", ".gnu.hash", ".rela.dyn", ".init_array", ".fini_array", ".dynamic",
+    };
+    for (const char* name : tables) {
+        const Elf64_Shdr* want = section(orig, name);
+        const Elf64_Shdr* got = section(rebuilt, name);
+        if (!want) continue;
+        if (!got || got->sh_addr != want->sh_addr || got->sh_size != want->sh_size ||
+            got->sh_type != want->sh_type) {
+            fprintf(stderr, "%s: want addr=%#lx size=%#lx, got %s\n", name,
+                    (unsigned long)want->sh_addr, (unsigned long)want->sh_size,
+                    got ? "a different one" : "none");
+            return 1;
+        }
+        CHECK(got->sh_offset == got->sh_addr);     // min_vaddr is 0 here
+    }
+    CHECK(section(rebuilt, ".dynsym")->sh_link ==
+          (uint32_t)(section(rebuilt, ".dynstr") - (const Elf64_Shdr*)(rebuilt.data() + eh->e_shoff)));
+
+    // Every allocated section is backed by the file
+    const Elf64_Shdr* sh = (const Elf64_Shdr*)(rebuilt.data() + eh->e_shoff);
+    for (int i = 1; i < eh->e_shnum; i++) {
+        if (!(sh[i].sh_flags & SHF_ALLOC)) continue;
+        CHECK(sh[i].sh_offset + sh[i].sh_size <= rebuilt.size());
+    }
+    return 0;
+}
+
+static int check_dynamic(const std::vector<uint8_t>& orig, const std::vector<uint8_t>& rebuilt) {
+    const Elf64_Shdr* want = section(orig, ".dynamic");
+    const Elf64_Shdr* got = section(rebuilt, ".dynamic");
+    CHECK(want && got);
+    const Elf64_Dyn* dyn = (const Elf64_Dyn*)(orig.data() + want->sh_offset);
+    for (size_t i = 0; i < want->sh_size / sizeof(Elf64_Dyn) && dyn[i].d_tag != DT_NULL; i++) {
+        if (dyn[i].d_tag == DT_DEBUG) continue;
+        if (dynamic_value(rebuilt, got, dyn[i].d_tag) != dyn[i].d_un.d_val) {
+            fprintf(stderr, "dynamic tag %#lx: want %#lx, got %#lx\n", (unsigned long)dyn[i].d_tag,
+                    (unsigned long)dyn[i].d_un.d_val,
+                    (unsigned long)dynamic_value(rebuilt, got, dyn[i].d_tag));
+            return 1;
+        }
+    }
+    CHECK(dynamic_value(rebuilt, got, DT_DEBUG) == 0);
+    return 0;
+}
+
+static int check_symbol(const std::vector<uint8_t>& orig, const std::vector<uint8_t>& rebuilt,
+                        const char* name) {
+    const Elf64_Shdr* dynsym = section(rebuilt, ".dynsym");
+    const Elf64_Shdr* dynstr = section(rebuilt, ".dynstr");
+    CHECK(dynsym && dynstr);
+    CHECK(dynsym->sh_size / sizeof(Elf64_Sym) == section(orig, ".dynsym")->sh_size / sizeof(Elf64_Sym));
+
+    const Elf64_Ehdr* eh = (const Elf64_Ehdr*)rebuilt.data();
+    const Elf64_Shdr* sh = (const Elf64_Shdr*)(rebuilt.data() + eh->e_shoff);
+    const Elf64_Sym* syms = (const Elf64_Sym*)(rebuilt.data() + dynsym->sh_offset);
+    const char* strs = (const char*)rebuilt.data() + dynstr->sh_offset;
+    for (size_t i = 1; i < dynsym->sh_size / sizeof(Elf64_Sym); i++) {
+        if (strcmp(strs + syms[i].st_name, name) != 0) continue;
+        CHECK(syms[i].st_shndx > 0 && syms[i].st_shndx < eh->e_shnum);
+        const Elf64_Shdr& in = sh[syms[i].st_shndx];
+        CHECK(in.sh_flags & SHF_EXECINSTR);
+        CHECK(syms[i].st_value >= in.sh_addr && syms[i].st_value < in.sh_addr + in.sh_size);
+        return 0;
+    }
+    fprintf(stderr, "%s not in the rebuilt .dynsym\n", name);
+    return 1;
+}
+
+int main(void) {
+    void* handle = dlopen(ELF_FIXTURE_PATH, RTLD_NOW | RTLD_LOCAL);
+    CHECK(handle);
+    Module m;
+    CHECK(dl_iterate_phdr(find_fixture, &m) == 1);
+    std::vector<uint8_t> orig = read_file(m.path);
+    CHECK(orig.size() > sizeof(Elf64_Ehdr));
+
+    char dir[] = "/tmp/elf_rebuild_XXXXXX";
+    CHECK(mkdtemp(dir));
+    std::string image = std::string(dir) + "/libelf_fixture_rebuilt.so";
+    uint64_t load_base = 0;
+    int loads = 0;
+    CHECK(dump_module(m, image, &load_base, &loads) == 0);
+    // The rebuilt copy is loaded under the same soname below
+    dlclose(handle);
+
+    ElfRebuildInfo info;
+    std::string error;
+    if (!rebuild_elf_image(image, load_base, info, error)) {
+        fprintf(stderr, "rebuild failed: %s\n", error.c_str());
+        return 1;
+    }
+    CHECK(info.segments == loads);
+    CHECK(info.dynamic_fixed > 0);      // glibc rebases d_ptr entries
+
+    std::vector<uint8_t> rebuilt = read_file(image);
+    CHECK(check_sections(orig, rebuilt, info) == 0);
+    CHECK(check_dynamic(orig, rebuilt) == 0);
+    CHECK(check_symbol(orig, rebuilt, "fixture_add") == 0);
+    CHECK(info.symbols == section(orig, ".dynsym")->sh_size / sizeof(Elf64_Sym));
+
+    // Loads, relocates and runs its constructor again from the rebuilt file
+    void* again = dlopen(image.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!again) {
+        fprintf(stderr, "dlopen rebuilt: %s\n", dlerror());
+        return 1;
+    }
+    int (*add)(int) = (int (*)(int))dlsym(again, "fixture_add");
+    CHECK(add && add(1) == 42);
+    dlclose(again);
+
+    unlink(image.c_str());
+    rmdir(dir);
+    printf("%d segments, %d sections, %lu dynamic symbols, %d dynamic entries rebased\n",
+           info.segments, info.sections, (unsigned long)info.symbols, info.dynamic_fixed);
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "support.h"
+
+#include <agent/hook_table.h>
+#include <agent/rcu.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Hook records by index (hook/hook_table.c): a slot goes live, then is
+ * freed (never published) or retired. Retired slots stay readable to
+ * handlers until RCU reclaims them, and only then is the index handed
+ * out again, zeroed and with a new generation. Segments double from
+ * HOOK_TABLE_BASE; records never move as the table grows, and it stops
+ * at HOOK_TABLE_MAX (the thunk's 16-bit index).
+ */
+
+typedef struct {
+    uint64_t marker;
+    int payload[5];
+} Record;
+
+static int g_reclaimed = 0;
+static uint64_t g_last_reclaimed = 0;
+
+static void reclaim(void* elem) {
+    Record* r = (Record*)elem;
+    g_reclaimed++;
+    g_last_reclaimed = r->marker;
+}
+
+static HookTable g_table = HOOK_TABLE_INIT(Record, reclaim);
+
+static int check_states(void) {
+    void* elem = NULL;
+    int a = hook_table_alloc(&g_table, &elem);
+    CHECK(a == 0 && elem);
+    ((Record*)elem)->marker = 100;
+    Record* ra = (Record*)elem;
+    int b = hook_table_alloc(&g_table, &elem);
+    CHECK(b == 1);
+    ((Record*)elem)->marker = 101;
+    CHECK(hook_table_count(&g_table) == 2 && hook_table_live(&g_table) == 2);
+    CHECK(hook_table_at(&g_table, a) == ra && hook_table_get(&g_table, a) == ra);
+    CHECK(hook_table_at(&g_table, 2) == NULL && hook_table_at(&g_table, -1) == NULL);
+    uint32_t gen_a = hook_table_gen(&g_table, a);
+    uint32_t gen_b = hook_table_gen(&g_table, b);
+
+    // Freed: gone at once and reused first, zeroed, with a new generation
+    hook_table_free(&g_table, b);
+    CHECK(hook_table_at(&g_table, b) == NULL && hook_table_get(&g_table, b) == NULL);
+    CHECK(hook_table_live(&g_table) == 1 && g_reclaimed == 0);
+    CHECK(hook_table_alloc(&g_table, &elem) == b);
+    CHECK(((Record*)elem)->marker == 0 && hook_table_gen(&g_table, b) == gen_b + 1);
+
+    // Retired under a reader: handlers still see it, the writer side not
+    rcu_read_lock();
+    hook_table_retire(&g_table, a);
+    CHECK(hook_table_get(&g_table, a) == NULL);
+    CHECK(hook_table_at(&g_table, a) == ra && ra->marker == 100);
+    CHECK(hook_table_live(&g_table) == 1 && g_reclaimed == 0);
+    CHECK(rcu_poll() == 0);
+
+    // Not handed out again while it can be seen
+    int c = hook_table_alloc(&g_table, &elem);
+    CHECK(c == 2 && c != a);
+    ((Record*)elem)->marker = 102;
+
+    // Retiring twice, or a free slot, changes nothing
+    hook_table_retire(&g_table, a);
+    hook_table_free(&g_table, a);
+    CHECK(hook_table_at(&g_table, a) == ra);
+    rcu_read_unlock();
+
+    CHECK(rcu_poll() == 1);
+    CHECK(g_reclaimed == 1 && g_last_reclaimed == 100);
+    CHECK(hook_table_at(&g_table, a) == NULL);
+    CHECK(hook_table_gen(&g_table, a) == gen_a);
+    CHECK(hook_table_alloc(&g_table, &elem) == a && elem == ra);
+    CHECK(ra->marker == 0 && hook_table_gen(&g_table, a) == gen_a + 1);
+
+    // Back to empty for the growth test
+    hook_table_free(&g_table, a);
+    hook_table_free(&g_table, b);
+    hook_table_free(&g_table, c);
+    CHECK(hook_table_live(&g_table) == 0);
+    return 0;
+}
+
+static int check_growth(void) {
+    Record** seen = calloc(HOOK_TABLE_MAX, sizeof(Record*));
+    CHECK(seen);
+    int segments = 1;
+
+    // The three freed slots come back first, then the table grows
+    for (int i = 0; i < HOOK_TABLE_MAX; i++) {
+        void* elem = NULL;
+        int index = hook_table_alloc(&g_table, &elem);
+        CHECK(index >= 0 && index < HOOK_TABLE_MAX && !seen[index]);
+        CHECK(((uintptr_t)elem & 15) == 0);
+        seen[index] = (Record*)elem;
+        seen[index]->marker = 0xC0DE0000u + (uint32_t)index;
+
+        // First slot of a new segment (BASE, 3 * BASE, 7 * BASE, ...):
+        // the ones before it stay where they were
+        unsigned q = (unsigned)index / HOOK_TABLE_BASE + 1;
+        if (index > 0 && index % HOOK_TABLE_BASE == 0 && (q & (q - 1)) == 0) {
+            CHECK(hook_table_at(&g_table, 0) == seen[0]);
+            CHECK(hook_table_at(&g_table, index - 1) == seen[index - 1]);
+            CHECK(seen[index - 1]->marker == 0xC0DE0000u + (uint32_t)(index - 1));
+            segments++;
+        }
+    }
+    CHECK(hook_table_count(&g_table) == HOOK_TABLE_MAX);
+    CHECK(hook_table_live(&g_table) == HOOK_TABLE_MAX);
+    CHECK(segments == 12);      // the last index is in segment 11
+
+    void* elem = NULL;
+    CHECK(hook_table_alloc(&g_table, &elem) == -1);
+
+    // Nothing moved or was overwritten
+    for (int i = 0; i < HOOK_TABLE_MAX; i++) {
+        CHECK(hook_table_at(&g_table, i) == seen[i]);
+        CHECK(seen[i]->marker == 0xC0DE0000u + (uint32_t)i);
+    }
+
+    // Records within a segment are contiguous
+    CHECK((uint8_t*)seen[1] - (uint8_t*)seen[0] == (uint8_t*)seen[HOOK_TABLE_BASE - 1] -
+          (uint8_t*)seen[HOOK_TABLE_BASE - 2]);
+
+    // A full table takes retired slots back once they are reclaimed
+    hook_table_retire(&g_table, 40000);
+    rcu_poll();
+    CHECK(g_reclaimed == 2 && g_last_reclaimed == 0xC0DE0000u + 40000);
+    CHECK(hook_table_alloc(&g_table, &elem) == 40000 && elem == seen[40000]);
+    free(seen);
+    return 0;
+}
+
+int main(void) {
+    CHECK(check_states() == 0);
+    CHECK(check_growth() == 0);
+    printf("%d slots, %d reclaimed\n", hook_table_count(&g_table), g_reclaimed);
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include "support.h"
+
+#include <agent/dump.h>
+#include <agent/lz4.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * LZ4 block codec (core/lz4.c, decoder in agent/lz4.h): buffers like
+ * dump chunks (random, long runs, short periods, text, repeats at and
+ * just past the 64 KB window) are compressed and decoded back at sizes
+ * around the format's edges: the 12-byte match limit, the 15 and
+ * 15 + 255 length fields, and DUMP_CHUNK_SIZE. Random input has to be
+ * refused at the cap memdump.c uses. Truncated and corrupted blocks
+ * have to be rejected without writing past the output.
+ */
+
+#define MAX_LEN     (2 * DUMP_CHUNK_SIZE + 4096)
+#define CANARY      0xA5
+
+typedef enum {
+    KIND_RANDOM,        // incompressible
+    KIND_ZEROS,         // one run
+    KIND_PERIOD3,       // overlapping matches at distance 3
+    KIND_TEXT,          // words from a small vocabulary
+    KIND_EDGE_REPEAT,   // random head, zeros, the head again 65535 later
+    KIND_FAR_REPEAT,    // the same 65537 later, out of the window
+    KIND_COUNT
+} Kind;
+
+static const char* const k_kind_names[KIND_COUNT] = {
+    "random", "zeros", "period3", "text", "edge-repeat", "far-repeat",
+};
+
+static const size_t k_sizes[] = {
+    0, 1, 4, 5, 11, 12, 13, 14, 15, 16, 17, 19, 20, 31, 32,
+    254, 255, 256, 269, 270, 271, 1000, 4095, 4096, 4097,
+    65535, DUMP_CHUNK_SIZE, DUMP_CHUNK_SIZE + 1, 65536 + 4096 + 7, 2 * DUMP_CHUNK_SIZE,
+};
+#define NUM_SIZES   (int)(sizeof(k_sizes) / sizeof(k_sizes[0]))
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t rnd(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t)(g_rng >> 32);
+}
+
+static void fill(uint8_t* buf, size_t len, Kind kind) {
+    static const char* const words[] = { "hook ", "memory ", "scan ", "agent ", "lua ", "\n" };
+    size_t i = 0;
+    switch (kind) {
+    case KIND_RANDOM:
+        for (; i < len; i++) buf[i] = (uint8_t)rnd();
+        break;
+    case KIND_ZEROS:
+        memset(buf, 0, len);
+        break;
+    case KIND_PERIOD3:
+        for (; i < len; i++) buf[i] = (uint8_t)("abc"[i % 3]);
+        break;
+    case KIND_TEXT:
+        while (i < len) {
+            const char* w = words[rnd() % 6];
+            for (; *w && i < len; w++) buf[i++] = (uint8_t)*w;
+        }
+        break;
+    case KIND_EDGE_REPEAT:
+    case KIND_FAR_REPEAT: {
+        // The zeros leave the head's hash table entries in place
+        size_t dist = kind == KIND_EDGE_REPEAT ? 65535 : 65537;
+        for (; i < len; i++) {
+            buf[i] = i >= dist ? buf[i - dist] : i < 1024 ? (uint8_t)rnd() : 0;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static int round_trip(const uint8_t* src, size_t len, uint8_t* packed, uint8_t* out,
+                      size_t* packed_len) {
+    size_t cap = LZ4_BOUND(len);
+    memset(packed, CANARY, cap + 16);
+    size_t n = lz4_compress_block(src, len, packed, cap);
+    CHECK(n > 0 && n <= cap);
+    for (size_t i = cap; i < cap + 16; i++) CHECK(packed[i] == CANARY);
+
+    memset(out, CANARY, len + 16);
+    CHECK(lz4_decompress_block(packed, n, out, len) == (long)len);
+    CHECK(memcmp(src, out, len) == 0);
+    for (size_t i = len; i < len + 16; i++) CHECK(out[i] == CANARY);
+    *packed_len = n;
+    return 0;
+}
+
+// A block that lies must fail or come up short, never write past dst_len
+static int check_rejects_damage(const uint8_t* packed, size_t n, const uint8_t* src,
+                                size_t len, uint8_t* scratch, uint8_t* out) {
+    for (size_t cut = 1; cut <= 8 && cut <= n; cut++) {
+        memset(out, CANARY, len + 16);
+        long r = lz4_decompress_block(packed, n - cut, out, len);
+        CHECK(r != (long)len || memcmp(src, out, len) != 0);
+        for (size_t i = len; i < len + 16; i++) CHECK(out[i] == CANARY);
+    }
+    for (int k = 0; k < 64; k++) {
+        memcpy(scratch, packed, n);
+        scratch[rnd() % n] ^= (uint8_t)(1u << (rnd() % 8));
+        memset(out, CANARY, len + 16);
+        lz4_decompress_block(scratch, n, out, len);
+        for (size_t i = len; i < len + 16; i++) CHECK(out[i] == CANARY);
+    }
+    // One byte short of room for the output
+    if (len > 0) {
+        memset(out, CANARY, len + 16);
+        CHECK(lz4_decompress_block(packed, n, out, len - 1) == -1);
+        for (size_t i = len - 1; i < len + 16; i++) CHECK(out[i] == CANARY);
+    }
+    return 0;
+}
+
+int main(void) {
+    uint8_t* src = malloc(MAX_LEN);
+    uint8_t* packed = malloc(LZ4_BOUND(MAX_LEN) + 16);
+    uint8_t* scratch = malloc(LZ4_BOUND(MAX_LEN) + 16);
+    uint8_t* out = malloc(MAX_LEN + 16);
+    CHECK(src && packed && scratch && out);
+
+    size_t in_total[KIND_COUNT] = {0};
+    size_t out_total[KIND_COUNT] = {0};
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+        for (int s = 0; s < NUM_SIZES; s++) {
+            size_t len = k_sizes[s];
+            fill(src, len, (Kind)kind);
+
+            size_t n;
+            if (round_trip(src, len, packed, out, &n) != 0) {
+                fprintf(stderr, "  %s, %zu bytes\n", k_kind_names[kind], len);
+                return 1;
+            }
+            in_total[kind] += len;
+            out_total[kind] += n;
+
+            if (len >= 64 && kind == KIND_RANDOM) {
+                // memdump.c stores a chunk raw unless it saves 1/16
+                CHECK(lz4_compress_block(src, len, packed, len - len / 16) == 0);
+            }
+            if (len >= 64 && (kind == KIND_ZEROS || kind == KIND_PERIOD3)) {
+                CHECK(n < len / 32 + 16);
+            }
+            if (len > 0 && check_rejects_damage(packed, n, src, len, scratch, out) != 0) {
+                fprintf(stderr, "  damaged %s, %zu bytes\n", k_kind_names[kind], len);
+                return 1;
+            }
+        }
+    }
+
+    // Too small an output buffer is refused, not overrun
+    fill(src, DUMP_CHUNK_SIZE, KIND_TEXT);
+    for (size_t cap = 0; cap < 64; cap++) {
+        memset(packed, CANARY, cap + 16);
+        CHECK(lz4_compress_block(src, DUMP_CHUNK_SIZE, packed, cap) == 0);
+        for (size_t i = cap; i < cap + 16; i++) CHECK(packed[i] == CANARY);
+    }
+
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+        printf("%-11s %9zu -> %9zu bytes\n", k_kind_names[kind], in_total[kind], out_total[kind]);
+    }
+    free(src);
+    free(packed);
+    free(scratch);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include "support.h"
+
+#include <agent/frame.h>
+#include <agent/handlers.h>
+#include <agent/lua_memory.h>
+#include <agent/output.h>
+#include <agent/scan.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * `ms` on a framed connection (handlers/memscan.c, core/output.c): hits
+ * are streamed from scan workers, which are not in the request, and must
+ * still arrive as DATA frames of the request that ran the scan, in order
+ * and ahead of its END. A second attached client must not see them.
+ *
+ * The region collection and pattern helpers of api_memory.c (Lua side)
+ * are replaced below by a single planted buffer.
+ */
+
+#define BUFFER_SIZE     (8 * SCAN_CHUNK_SIZE)
+#define PLANTED         40
+#define PAGE            25
+#define REQUEST_ID      42
+
+int g_output_client_fd = -1;
+
+static uint8_t* g_buffer;
+
+size_t memory_collect_regions(MemoryRegions* regions, const char* lib_filter,
+                              size_t min_len, size_t max_bytes) {
+    (void)lib_filter;
+    (void)min_len;
+    (void)max_bytes;
+    memset(regions, 0, sizeof(*regions));
+    regions->ranges = malloc(sizeof(ScanRange));
+    regions->paths = malloc(sizeof(*regions->paths));
+    if (!regions->ranges || !regions->paths) return 0;
+    regions->ranges[0] = (ScanRange){ (uintptr_t)g_buffer, (uintptr_t)g_buffer + BUFFER_SIZE };
+    snprintf(regions->paths[0], sizeof(regions->paths[0]), "[test]");
+    regions->count = regions->capacity = 1;
+    return BUFFER_SIZE;
+}
+
+void memory_free_regions(MemoryRegions* regions) {
+    free(regions->ranges);
+    free(regions->paths);
+    memset(regions, 0, sizeof(*regions));
+}
+
+bool memory_format_context(uintptr_t addr, uintptr_t regionBegin, uintptr_t regionEnd,
+                           size_t patternLen, char* hex, size_t hexSize,
+                           char* ascii, size_t asciiSize) {
+    (void)addr;
+    (void)regionBegin;
+    (void)regionEnd;
+    (void)patternLen;
+    snprintf(hex, hexSize, "de ad");
+    snprintf(ascii, asciiSize, "..");
+    return true;
+}
+
+int memory_parse_pattern(const char* patternStr, int* outPattern, size_t maxLen) {
+    int count = 0;
+    for (const char* p = patternStr; *p && count < (int)maxLen;) {
+        if (*p == ' ') {
+            p++;
+        } else if (p[0] == '?' && p[1] == '?') {
+            outPattern[count++] = WILDCARD_BYTE;
+            p += 2;
+        } else {
+            char hex[3] = { p[0], p[1], 0 };
+            outPattern[count++] = (int)strtol(hex, NULL, 16);
+            p += p[1] ? 2 : 1;
+        }
+    }
+    return count;
+}
+
+static size_t read_available(int fd, uint8_t* buf, size_t cap) {
+    size_t len = 0;
+    while (len < cap) {
+        ssize_t n = recv(fd, buf + len, cap - len, MSG_DONTWAIT);
+        if (n <= 0) break;
+        len += (size_t)n;
+    }
+    return len;
+}
+
+int main(void) {
+    g_buffer = calloc(1, BUFFER_SIZE);
+    CHECK(g_buffer);
+    static const uint8_t needle[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0x13, 0x37 };
+    for (int i = 0; i < PLANTED; i++) {
+        // Spread over every chunk, so several workers report hits
+        memcpy(g_buffer + (size_t)i * (BUFFER_SIZE / PLANTED) + 17, needle, sizeof(needle));
+    }
+
+    int requester[2], other[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, requester) == 0);
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, other) == 0);
+    output_attach(requester[0]);
+    output_set_framed(requester[0], true);
+    output_attach(other[0]);
+    output_set_framed(other[0], true);
+
+    scan_set_threads(4);
+    output_begin_request(requester[0], REQUEST_ID);
+    char args[64];
+    snprintf(args, sizeof(args), "-n %d de ad be ef 13 37", PAGE);
+    handle_memscan(requester[0], args);
+    output_end_request(0);
+
+    static uint8_t buf[1 << 20];
+    size_t len = read_available(requester[1], buf, sizeof(buf));
+
+    int hits = 0, done = 0, end = 0;
+    for (size_t pos = 0; pos < len;) {
+        CHECK(len - pos >= FRAME_HEADER_SIZE);
+        FrameHeader h;
+        CHECK(frame_decode(buf + pos, &h));
+        pos += FRAME_HEADER_SIZE;
+        CHECK(h.id == REQUEST_ID);
+        CHECK(!end);
+        if (h.type == FRAME_END) {
+            CHECK(h.flags == 0);
+            end = 1;
+            continue;
+        }
+        CHECK(h.type == FRAME_DATA);
+        CHECK(h.length <= len - pos);
+
+        // One NDJSON line per reply
+        char line[2048];
+        CHECK(h.length < sizeof(line));
+        memcpy(line, buf + pos, h.length);
+        line[h.length] = '\0';
+        pos += h.length;
+
+        char expect[32];
+        snprintf(expect, sizeof(expect), "\"index\":%d,", hits);
+        if (strstr(line, "\"type\":\"hit\"")) {
+            CHECK(strstr(line, expect));
+            hits++;
+        } else {
+            CHECK(strstr(line, "\"type\":\"done\""));
+            CHECK(strstr(line, "\"count\":40,"));
+            done++;
+        }
+    }
+    CHECK(hits == PAGE);
+    CHECK(done == 1);
+    CHECK(end);
+
+    // Nothing leaked to the other client as events
+    CHECK(read_available(other[1], buf, sizeof(buf)) == 0);
+    CHECK(errno == EAGAIN || errno == EWOULDBLOCK);
+
+    output_detach(requester[0]);
+    output_detach(other[0]);
+    free(g_buffer);
+    printf("%d hits as DATA frames of request %d\n", hits, REQUEST_ID);
+    return 0;
+}
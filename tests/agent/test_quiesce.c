@@ -0,0 +1,144 @@
+#include "support.h"
+
+#include <agent/quiesce.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Thread parking (hook/quiesce.c): every other thread stops in the
+ * signal handler until threads_resume(), more of them than the initial
+ * slot count included, and where each stopped can be asked for. A
+ * thread that blocks the signal costs QUIESCE_TIMEOUT_MS, is reported
+ * by threads_unparked(), and later takes its stale signal without
+ * waiting for a round that is over.
+ */
+
+#define SPINNERS    4
+#define SLEEPERS    (QUIESCE_INITIAL_THREADS + 40)
+#define THREADS     (SPINNERS + SLEEPERS)
+
+static volatile uint64_t g_spins[SPINNERS];
+static int g_stop = 0;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+
+extern const char __start_quiesce_spin[] __attribute__((weak, visibility("hidden")));
+extern const char __stop_quiesce_spin[] __attribute__((weak, visibility("hidden")));
+
+// No calls in the loop, so a parked spinner's PC is in this section
+__attribute__((section("quiesce_spin"), noinline)) static void spin(volatile uint64_t* counter) {
+    while (!__atomic_load_n(&g_stop, __ATOMIC_RELAXED)) (*counter)++;
+}
+
+static void* spinner_main(void* arg) {
+    spin(&g_spins[(intptr_t)arg]);
+    return NULL;
+}
+
+static void* sleeper_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_lock);
+    while (!g_stop) pthread_cond_wait(&g_cond, &g_lock);
+    pthread_mutex_unlock(&g_lock);
+    return NULL;
+}
+
+static int g_blocker_state = 0;     // 1 blocking the signal, 2 took it late
+
+static void* blocker_main(void* arg) {
+    (void)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGRTMIN + 5);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    __atomic_store_n(&g_blocker_state, 1, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&g_blocker_state, __ATOMIC_ACQUIRE) == 1) usleep(1000);
+    // The round it missed is over: the handler must not wait
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+    __atomic_store_n(&g_blocker_state, 2, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void snapshot(uint64_t* out) {
+    for (int i = 0; i < SPINNERS; i++) out[i] = g_spins[i];
+}
+
+static int check_parks_all(void) {
+    uint64_t before[SPINNERS], after[SPINNERS];
+
+    CHECK(threads_quiesce() == THREADS);
+    CHECK(threads_unparked() == 0);
+    snapshot(before);
+    usleep(20000);
+    snapshot(after);
+    CHECK(memcmp(before, after, sizeof(before)) == 0);
+#if defined(__x86_64__) || defined(__aarch64__)
+    CHECK(threads_quiesced_in((uintptr_t)__start_quiesce_spin, (uintptr_t)__stop_quiesce_spin));
+#endif
+    CHECK(!threads_quiesced_in(1, 2));
+    threads_resume();
+
+    uint64_t start = test_now_ns();
+    for (int i = 0; i < SPINNERS; i++) {
+        while (g_spins[i] == after[i]) {
+            CHECK(test_now_ns() - start < 2000000000ULL);
+            usleep(100);
+        }
+    }
+    return 0;
+}
+
+static int check_timeout(void) {
+    pthread_t blocker;
+    CHECK(pthread_create(&blocker, NULL, blocker_main, NULL) == 0);
+    while (__atomic_load_n(&g_blocker_state, __ATOMIC_ACQUIRE) != 1) usleep(100);
+
+    uint64_t start = test_now_ns();
+    CHECK(threads_quiesce() == THREADS);
+    uint64_t waited_ms = (test_now_ns() - start) / 1000000;
+    CHECK(threads_unparked() == 1);
+    threads_resume();
+    CHECK(waited_ms >= QUIESCE_TIMEOUT_MS - 1 && waited_ms < 10 * QUIESCE_TIMEOUT_MS);
+
+    __atomic_store_n(&g_blocker_state, 3, __ATOMIC_RELEASE);
+    start = test_now_ns();
+    while (__atomic_load_n(&g_blocker_state, __ATOMIC_ACQUIRE) != 2) {
+        CHECK(test_now_ns() - start < 2000000000ULL);
+        usleep(100);
+    }
+    pthread_join(blocker, NULL);
+
+    // Nothing left over for the next round
+    CHECK(threads_quiesce() == THREADS);
+    CHECK(threads_unparked() == 0);
+    threads_resume();
+    return 0;
+}
+
+int main(void) {
+    pthread_t tids[THREADS];
+    for (int i = 0; i < SPINNERS; i++) {
+        CHECK(pthread_create(&tids[i], NULL, spinner_main, (void*)(intptr_t)i) == 0);
+    }
+    for (int i = SPINNERS; i < THREADS; i++) {
+        CHECK(pthread_create(&tids[i], NULL, sleeper_main, NULL) == 0);
+    }
+    // Every spinner running before the first round
+    for (int i = 0; i < SPINNERS; i++) {
+        while (g_spins[i] == 0) usleep(100);
+    }
+
+    CHECK(check_parks_all() == 0);
+    CHECK(check_timeout() == 0);
+
+    pthread_mutex_lock(&g_lock);
+    __atomic_store_n(&g_stop, 1, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&g_cond);
+    pthread_mutex_unlock(&g_lock);
+    for (int i = 0; i < THREADS; i++) pthread_join(tids[i], NULL);
+    printf("%d threads parked and resumed\n", THREADS);
+    return 0;
+}
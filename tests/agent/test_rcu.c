@@ -0,0 +1,167 @@
+#include "support.h"
+
+#include <agent/rcu.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Grace periods (core/rcu.c): a callback must wait for every read
+ * section that could have seen the object, including ones that began
+ * after it was deferred but before the quiesce round that clears it
+ * (threads that came in with a stale index). Read sections begun after
+ * the round must not hold it back, callbacks run in the order they were
+ * deferred, and a thread stopped in RCU_ENTRY_TEXT makes the round fail.
+ * Calls marked with rcu_call_enter() are visible until they exit.
+ */
+
+typedef enum {
+    CMD_NONE,
+    CMD_LOCK,
+    CMD_UNLOCK,
+    CMD_ENTRY,          // spin in entry text until told otherwise
+    CMD_QUIT,
+} Cmd;
+
+typedef struct {
+    pthread_t tid;
+    int cmd;
+    int done;           // last command carried out
+} Reader;
+
+static int g_order[8];
+static int g_ran = 0;
+
+static void record(void* arg) {
+    g_order[g_ran++] = (int)(intptr_t)arg;
+}
+
+RCU_ENTRY_TEXT __attribute__((noinline)) static void spin_in_entry(Reader* r) {
+    __atomic_store_n(&r->done, CMD_ENTRY, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&r->cmd, __ATOMIC_ACQUIRE) == CMD_ENTRY) {
+        __asm__ volatile("" ::: "memory");
+    }
+}
+
+static void* reader_main(void* arg) {
+    Reader* r = (Reader*)arg;
+    int seen = CMD_NONE;
+    while (1) {
+        int cmd = __atomic_load_n(&r->cmd, __ATOMIC_ACQUIRE);
+        if (cmd == seen) {
+            sched_yield();
+            continue;
+        }
+        seen = cmd;
+        if (cmd == CMD_LOCK) rcu_read_lock();
+        if (cmd == CMD_UNLOCK) rcu_read_unlock();
+        if (cmd == CMD_ENTRY) {
+            spin_in_entry(r);       // acknowledges on its own
+            continue;
+        }
+        __atomic_store_n(&r->done, cmd, __ATOMIC_RELEASE);
+        if (cmd == CMD_QUIT) break;
+    }
+    return NULL;
+}
+
+static void send(Reader* r, Cmd cmd) {
+    __atomic_store_n(&r->cmd, cmd, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&r->done, __ATOMIC_ACQUIRE) != (int)cmd) sched_yield();
+}
+
+static int poll_until(int want, int tries) {
+    int total = 0;
+    for (int i = 0; i < tries && total < want; i++) {
+        total += rcu_poll();
+        if (total < want) usleep(1000);
+    }
+    return total;
+}
+
+int main(void) {
+    Reader a = {0}, b = {0};
+    CHECK(pthread_create(&a.tid, NULL, reader_main, &a) == 0);
+    CHECK(pthread_create(&b.tid, NULL, reader_main, &b) == 0);
+
+    // Nothing holds it: the first round clears it
+    rcu_defer(record, (void*)1);
+    CHECK(rcu_poll() == 1 && g_ran == 1);
+
+    // A read section begun before the defer holds it back
+    send(&a, CMD_LOCK);
+    rcu_defer(record, (void*)2);
+    CHECK(rcu_poll() == 0 && g_ran == 1);
+    send(&a, CMD_UNLOCK);
+    CHECK(rcu_poll() == 1 && g_order[1] == 2);
+
+    // So does one begun after the defer but before the round: it may
+    // have come in with the retired index
+    rcu_defer(record, (void*)3);
+    send(&a, CMD_LOCK);
+    CHECK(rcu_poll() == 0);
+    RcuStats rs;
+    rcu_get_stats(&rs);
+    CHECK(rs.active == 1 && rs.pending == 1);
+
+    // One begun after the round does not; callbacks keep their order
+    rcu_defer(record, (void*)4);
+    CHECK(rcu_poll() == 0);             // the round for 4 sees a still in
+    send(&b, CMD_LOCK);
+    send(&a, CMD_UNLOCK);
+    CHECK(rcu_poll() == 2);
+    CHECK(g_ran == 4 && g_order[2] == 3 && g_order[3] == 4);
+    send(&b, CMD_UNLOCK);
+
+    // Nested sections end with the outermost
+    send(&a, CMD_LOCK);
+    send(&a, CMD_NONE);
+    send(&a, CMD_LOCK);
+    rcu_defer(record, (void*)5);
+    send(&a, CMD_UNLOCK);
+    CHECK(rcu_poll() == 0);
+    send(&a, CMD_NONE);
+    send(&a, CMD_UNLOCK);
+    CHECK(rcu_poll() == 1 && g_order[4] == 5);
+
+    // A thread on its way in (entry text) fails the round; the retry
+    // waits RCU_ROUND_RETRY_MS
+    send(&a, CMD_ENTRY);
+    rcu_defer(record, (void*)6);
+    CHECK(rcu_poll() == 0);
+    rcu_get_stats(&rs);
+    CHECK(rs.busy_rounds == 1);
+    send(&a, CMD_NONE);
+    uint64_t start = test_now_ns();
+    CHECK(poll_until(1, 2 * RCU_ROUND_RETRY_MS) == 1 && g_order[5] == 6);
+    CHECK(test_now_ns() - start >= (RCU_ROUND_RETRY_MS - 10) * 1000000ULL);
+
+    // A call through a stub is seen until it exits, outside any section
+    static uint32_t stub[8];
+    send(&b, CMD_LOCK);
+    CHECK(!rcu_in_call(stub, stub + 8));
+    rcu_read_lock();
+    rcu_call_enter(&stub[2]);
+    rcu_read_unlock();
+    CHECK(rcu_in_call(stub, stub + 8));
+    CHECK(!rcu_in_call(stub, stub + 2) && !rcu_in_call(stub + 3, stub + 8));
+    rcu_get_stats(&rs);
+    CHECK(rs.calling == 1 && rs.active == 1);
+    rcu_call_exit();
+    CHECK(!rcu_in_call(stub, stub + 8));
+    send(&b, CMD_UNLOCK);
+
+    send(&a, CMD_QUIT);
+    send(&b, CMD_QUIT);
+    pthread_join(a.tid, NULL);
+    pthread_join(b.tid, NULL);
+
+    rcu_get_stats(&rs);
+    CHECK(rs.pending == 0 && rs.reclaimed == 6 && rs.deferred == 6);
+    printf("%llu rounds (%llu busy), %d readers\n", (unsigned long long)rs.rounds,
+           (unsigned long long)rs.busy_rounds, rs.readers);
+    return 0;
+}
@@ -0,0 +1,366 @@
+#include "support.h"
+
+#include <agent/relocate.h>
+
+#include <string.h>
+
+/*
+ * A64 relocator (hook/relocate.c), checked by decoding what it emits:
+ * each PC-relative class is moved to the last address its field still
+ * reaches (one instruction, same target), one word further (expanded
+ * through a literal, same target), and the same on the negative side.
+ * Also: BL returning past its literal, literal loads of each width,
+ * PRFM dropped when out of reach, branches into the moved block, and
+ * what relocate_insns() refuses or leaves alone.
+ */
+
+#define SRC_PC      0x0000007000000000ULL
+#define X17         17
+#define INSN_NOP    0xD503201F
+
+typedef struct {
+    uint32_t words[RELOC_MAX_INSNS * RELOC_MAX_WORDS];
+    size_t n;
+} Moved;
+
+static Moved move(const uint32_t* insns, size_t count, uintptr_t out_pc) {
+    Moved m;
+    memset(&m, 0, sizeof(m));
+    m.n = relocate_insns(insns, count, SRC_PC, m.words, out_pc);
+    return m;
+}
+
+static Moved move_one(uint32_t insn, uintptr_t out_pc) {
+    return move(&insn, 1, out_pc);
+}
+
+static int64_t sext(uint64_t v, int bits) {
+    return (int64_t)(v << (64 - bits)) >> (64 - bits);
+}
+
+static uintptr_t imm19_target(uint32_t insn, uintptr_t pc) {
+    return pc + (uintptr_t)(sext((insn >> 5) & 0x7FFFF, 19) * 4);
+}
+
+static uintptr_t imm26_target(uint32_t insn, uintptr_t pc) {
+    return pc + (uintptr_t)(sext(insn & 0x03FFFFFF, 26) * 4);
+}
+
+static uintptr_t imm14_target(uint32_t insn, uintptr_t pc) {
+    return pc + (uintptr_t)(sext((insn >> 5) & 0x3FFF, 14) * 4);
+}
+
+static int64_t adr_imm(uint32_t insn) {
+    return sext((((insn >> 5) & 0x7FFFF) << 2) | ((insn >> 29) & 3), 21);
+}
+
+static uint64_t quad_at(const Moved* m, size_t i) {
+    return (uint64_t)m->words[i] | ((uint64_t)m->words[i + 1] << 32);
+}
+
+static uint32_t b_imm(uint32_t base, int64_t delta) {
+    return base | ((uint32_t)(delta / 4) & 0x03FFFFFF);
+}
+
+static uint32_t imm19(uint32_t base, int64_t delta) {
+    return base | (((uint32_t)(delta / 4) & 0x7FFFF) << 5);
+}
+
+static uint32_t imm14(uint32_t base, int64_t delta) {
+    return base | (((uint32_t)(delta / 4) & 0x3FFF) << 5);
+}
+
+static uint32_t adr(uint32_t base, int64_t imm) {
+    return base | (((uint32_t)imm & 3) << 29) | ((((uint32_t)imm >> 2) & 0x7FFFF) << 5);
+}
+
+// LDR Xt, #words*4
+static uint32_t ldr_x_literal(int rt, int words) {
+    return 0x58000000 | ((uint32_t)words << 5) | (uint32_t)rt;
+}
+
+/*
+ * Branch classes: `reach` is the largest forward delta the field holds,
+ * and -(reach + 4) the largest backward one. The expansion of a
+ * conditional branch keeps the condition (and register, bit number)
+ * and jumps over an absolute branch when not taken.
+ */
+typedef struct {
+    const char* name;
+    uint32_t insn;          // with a zero offset field
+    int64_t reach;
+    uintptr_t (*target)(uint32_t, uintptr_t);
+    uint32_t field;         // mask of the offset field
+} BranchCase;
+
+static int check_branch_fits(const BranchCase* c, int64_t delta) {
+    uintptr_t target = SRC_PC + 0x40;
+    uint32_t insn = c->insn;
+    if (c->target == imm26_target) insn = b_imm(insn, 0x40);
+    else if (c->target == imm19_target) insn = imm19(insn, 0x40);
+    else insn = imm14(insn, 0x40);
+
+    uintptr_t out_pc = target - (uintptr_t)delta;
+    Moved m = move_one(insn, out_pc);
+    CHECK(m.n == 1);
+    CHECK((m.words[0] & ~c->field) == (insn & ~c->field));
+    CHECK(c->target(m.words[0], out_pc) == target);
+    return 0;
+}
+
+static int check_branch_expands(const BranchCase* c, int64_t delta) {
+    uintptr_t target = SRC_PC + 0x40;
+    uint32_t insn = c->insn;
+    if (c->target == imm26_target) insn = b_imm(insn, 0x40);
+    else if (c->target == imm19_target) insn = imm19(insn, 0x40);
+    else insn = imm14(insn, 0x40);
+
+    uintptr_t out_pc = target - (uintptr_t)delta;
+    Moved m = move_one(insn, out_pc);
+    if (c->target == imm26_target) {
+        if (insn & 0x80000000) {
+            // BL: LDR x17, lit; BLR x17; B past lit; lit
+            CHECK(m.n == 5);
+            CHECK(m.words[0] == ldr_x_literal(X17, 3));
+            CHECK(m.words[1] == 0xD63F0220);
+            CHECK(imm26_target(m.words[2], out_pc + 8) == out_pc + 20);
+            CHECK(quad_at(&m, 3) == target);
+        } else {
+            // B: LDR x17, lit; BR x17; lit
+            CHECK(m.n == 4);
+            CHECK(m.words[0] == ldr_x_literal(X17, 2));
+            CHECK(m.words[1] == 0xD61F0220);
+            CHECK(quad_at(&m, 2) == target);
+        }
+        return 0;
+    }
+
+    // Bcc/CBZ/TBZ over: B skip; LDR x17, lit; BR x17; lit; skip:
+    CHECK(m.n == 6);
+    CHECK((m.words[0] & ~c->field) == (insn & ~c->field));
+    CHECK(c->target(m.words[0], out_pc) == out_pc + 8);
+    CHECK(imm26_target(m.words[1], out_pc + 4) == out_pc + 24);
+    CHECK(m.words[2] == ldr_x_literal(X17, 2));
+    CHECK(m.words[3] == 0xD61F0220);
+    CHECK(quad_at(&m, 4) == target);
+    return 0;
+}
+
+static int check_branches(void) {
+    static const BranchCase cases[] = {
+        { "B",      0x14000000, (1LL << 27) - 4, imm26_target, 0x03FFFFFF },
+        { "BL",     0x94000000, (1LL << 27) - 4, imm26_target, 0x03FFFFFF },
+        { "B.NE",   0x54000001, (1LL << 20) - 4, imm19_target, 0x7FFFF << 5 },
+        { "CBZ",    0xB4000003, (1LL << 20) - 4, imm19_target, 0x7FFFF << 5 },
+        { "CBNZ w", 0x35000005, (1LL << 20) - 4, imm19_target, 0x7FFFF << 5 },
+        { "TBZ",    0x36280007, (1LL << 15) - 4, imm14_target, 0x3FFF << 5 },
+        { "TBNZ",   0xB7F80009, (1LL << 15) - 4, imm14_target, 0x3FFF << 5 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const BranchCase* c = &cases[i];
+        CHECK(reloc_is_pc_relative(c->insn));
+        if (check_branch_fits(c, c->reach) ||
+            check_branch_fits(c, -c->reach - 4) ||
+            check_branch_fits(c, 0) ||
+            check_branch_expands(c, c->reach + 4) ||
+            check_branch_expands(c, -c->reach - 8)) {
+            fprintf(stderr, "  in %s\n", c->name);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int check_adr(void) {
+    // ADR x5, #+0x10: reaches [-1 MiB, +1 MiB - 1] byte-exact
+    uint32_t insn = adr(0x10000005, 0x10);
+    uintptr_t target = SRC_PC + 0x10;
+    CHECK(reloc_is_pc_relative(insn));
+
+    static const int64_t fit[] = { (1 << 20) - 4, -(1 << 20), 0 };
+    for (size_t i = 0; i < 3; i++) {
+        uintptr_t out_pc = target - (uintptr_t)fit[i];
+        Moved m = move_one(insn, out_pc);
+        CHECK(m.n == 1);
+        CHECK((m.words[0] & 0x9F00001F) == 0x10000005);
+        CHECK(out_pc + (uintptr_t)adr_imm(m.words[0]) == target);
+    }
+
+    // Out of reach: LDR x5, lit; B past lit; lit
+    static const int64_t far[] = { 1 << 20, -(1 << 20) - 4 };
+    for (size_t i = 0; i < 2; i++) {
+        uintptr_t out_pc = target - (uintptr_t)far[i];
+        Moved m = move_one(insn, out_pc);
+        CHECK(m.n == 4);
+        CHECK(m.words[0] == ldr_x_literal(5, 2));
+        CHECK(imm26_target(m.words[1], out_pc + 4) == out_pc + 16);
+        CHECK(quad_at(&m, 2) == target);
+    }
+    return 0;
+}
+
+static int check_adrp(void) {
+    // ADRP x8, #+3 pages
+    uint32_t insn = adr(0x90000008, 3);
+    uintptr_t src_page = SRC_PC & ~(uintptr_t)0xFFF;
+    uintptr_t target = src_page + 3 * 4096;
+    CHECK(reloc_is_pc_relative(insn));
+
+    // The page delta decides, not the byte delta: offsets within the
+    // page of the new location do not matter.
+    static const int64_t fit[] = { (1 << 20) - 1, -(1 << 20), 0 };
+    for (size_t i = 0; i < 3; i++) {
+        for (uintptr_t in_page = 0; in_page < 4096; in_page += 4092) {
+            uintptr_t out_pc = target - (uintptr_t)(fit[i] * 4096) + in_page;
+            Moved m = move_one(insn, out_pc);
+            CHECK(m.n == 1);
+            CHECK((m.words[0] & 0x9F00001F) == 0x90000008);
+            uintptr_t page = (out_pc & ~(uintptr_t)0xFFF) + (uintptr_t)(adr_imm(m.words[0]) * 4096);
+            CHECK(page == target);
+        }
+    }
+
+    // Beyond +/-4 GiB: the page address as a literal
+    static const int64_t far[] = { 1 << 20, -(1 << 20) - 1 };
+    for (size_t i = 0; i < 2; i++) {
+        uintptr_t out_pc = target - (uintptr_t)(far[i] * 4096);
+        Moved m = move_one(insn, out_pc);
+        CHECK(m.n == 4);
+        CHECK(m.words[0] == ldr_x_literal(8, 2));
+        CHECK(imm26_target(m.words[1], out_pc + 4) == out_pc + 16);
+        CHECK(quad_at(&m, 2) == target);
+    }
+    return 0;
+}
+
+static int check_literal_loads(void) {
+    // In reach: the same load, pointed at the same literal
+    static const uint32_t loads[] = {
+        0x18000003,     // LDR w3
+        0x58000003,     // LDR x3
+        0x98000003,     // LDRSW x3
+        0x1C000003,     // LDR s3
+        0x5C000003,     // LDR d3
+        0x9C000003,     // LDR q3
+        0xD8000000,     // PRFM pldl1keep
+    };
+    uintptr_t target = SRC_PC + 0x80;
+    for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+        uint32_t insn = imm19(loads[i], 0x80);
+        CHECK(reloc_is_pc_relative(insn));
+        static const int64_t fit[] = { (1 << 20) - 4, -(1 << 20) };
+        for (size_t k = 0; k < 2; k++) {
+            uintptr_t out_pc = target - (uintptr_t)fit[k];
+            Moved m = move_one(insn, out_pc);
+            CHECK(m.n == 1);
+            CHECK((m.words[0] & 0xFF00001F) == loads[i]);
+            CHECK(imm19_target(m.words[0], out_pc) == target);
+        }
+    }
+
+    // Out of reach: the address as a literal, then a register load of
+    // the same width. GPR loads use their own destination as the base,
+    // SIMD loads x17.
+    static const struct { uint32_t insn; int base; uint32_t load; } far[] = {
+        { 0x18000003, 3,   0xB9400000 },    // LDR w3, [x3]
+        { 0x58000003, 3,   0xF9400000 },    // LDR x3, [x3]
+        { 0x98000003, 3,   0xB9800000 },    // LDRSW x3, [x3]
+        { 0x1C000003, X17, 0xBD400000 },    // LDR s3, [x17]
+        { 0x5C000003, X17, 0xFD400000 },    // LDR d3, [x17]
+        { 0x9C000003, X17, 0x3DC00000 },    // LDR q3, [x17]
+    };
+    for (size_t i = 0; i < sizeof(far) / sizeof(far[0]); i++) {
+        uint32_t insn = imm19(far[i].insn, 0x80);
+        static const int64_t deltas[] = { 1 << 20, -(1 << 20) - 4 };
+        for (size_t k = 0; k < 2; k++) {
+            uintptr_t out_pc = target - (uintptr_t)deltas[k];
+            Moved m = move_one(insn, out_pc);
+            CHECK(m.n == 5);
+            CHECK(m.words[0] == ldr_x_literal(far[i].base, 3));
+            CHECK(m.words[1] == (far[i].load | ((uint32_t)far[i].base << 5) | 3));
+            CHECK(imm26_target(m.words[2], out_pc + 8) == out_pc + 20);
+            CHECK(quad_at(&m, 3) == target);
+        }
+    }
+
+    // PRFM is a hint: dropped rather than expanded
+    Moved m = move_one(imm19(0xD8000000, 0x80), target - (1 << 20));
+    CHECK(m.n == 1);
+    CHECK(m.words[0] == INSN_NOP);
+    return 0;
+}
+
+/*
+ * A prologue moved into a stub 1 GiB away, as a hook would: the
+ * branches that stay inside the block must land on the copies (whose
+ * positions shift as earlier instructions expand), the rest keep their
+ * targets.
+ */
+static int check_block(void) {
+    uint32_t block[6] = {
+        0xA9BF7BFD,                             // stp x29, x30, [sp, #-16]!
+        0x910003FD,                             // mov x29, sp
+        imm19(0xB4000000, 12),                  // cbz x0, +12 (block[5])
+        imm19(0x58000001, 0x1000),              // ldr x1, +0x1000
+        b_imm(0x14000000, -12),                 // b -12 (block[1])
+        adr(0x90000002, 1),                     // adrp x2, +1 page
+    };
+    uintptr_t out_pc = SRC_PC + (1ULL << 30);
+    Moved m = move(block, 6, out_pc);
+
+    // Copied, copied, cbz (in reach of its copy), ldr (5), b (1), adrp (1)
+    CHECK(m.n == 10);
+    CHECK(m.words[0] == block[0]);
+    CHECK(m.words[1] == block[1]);
+    CHECK(!reloc_is_pc_relative(block[0]) && !reloc_is_pc_relative(block[1]));
+
+    CHECK((m.words[2] & 0xFF00001F) == 0xB4000000);
+    CHECK(imm19_target(m.words[2], out_pc + 8) == out_pc + 9 * 4);
+
+    CHECK(m.words[3] == ldr_x_literal(1, 3));
+    CHECK(quad_at(&m, 6) == SRC_PC + 12 + 0x1000);
+
+    CHECK((m.words[8] & 0xFC000000) == 0x14000000);
+    CHECK(imm26_target(m.words[8], out_pc + 8 * 4) == out_pc + 4);
+
+    CHECK((m.words[9] & 0x9F00001F) == 0x90000002);
+    uintptr_t page = ((out_pc + 9 * 4) & ~(uintptr_t)0xFFF) + (uintptr_t)(adr_imm(m.words[9]) * 4096);
+    CHECK(page == (SRC_PC & ~(uintptr_t)0xFFF) + 4096);
+    return 0;
+}
+
+// What the relocator leaves to its caller
+static int check_unsupported(void) {
+    uint32_t block[RELOC_MAX_INSNS + 1];
+    for (size_t i = 0; i < RELOC_MAX_INSNS + 1; i++) block[i] = INSN_NOP;
+    uint32_t out[(RELOC_MAX_INSNS + 1) * RELOC_MAX_WORDS];
+    CHECK(relocate_insns(block, RELOC_MAX_INSNS + 1, SRC_PC, out, SRC_PC + 4096) == 0);
+    CHECK(relocate_insns(block, RELOC_MAX_INSNS, SRC_PC, out, SRC_PC + 4096) == RELOC_MAX_INSNS);
+
+    // Not PC-relative, so copied as is, though some (BR, RET, SVC) end
+    // the block or depend on where it runs; hook install checks those.
+    static const uint32_t other[] = {
+        0xD61F0200,     // br x16
+        0xD65F03C0,     // ret
+        0xD4000001,     // svc #0
+        0xD53BD040,     // mrs x0, tpidr_el0
+        0xF9400000,     // ldr x0, [x0]
+    };
+    for (size_t i = 0; i < sizeof(other) / sizeof(other[0]); i++) {
+        CHECK(!reloc_is_pc_relative(other[i]));
+        Moved m = move_one(other[i], SRC_PC + (1ULL << 40));
+        CHECK(m.n == 1 && m.words[0] == other[i]);
+    }
+    return 0;
+}
+
+int main(void) {
+    CHECK(check_branches() == 0);
+    CHECK(check_adr() == 0);
+    CHECK(check_adrp() == 0);
+    CHECK(check_literal_loads() == 0);
+    CHECK(check_block() == 0);
+    CHECK(check_unsupported() == 0);
+    printf("relocator ok\n");
+    return 0;
+}
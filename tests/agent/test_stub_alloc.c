@@ -0,0 +1,177 @@
+#include "support.h"
+
+#include <agent/hook_table.h>
+#include <agent/rcu.h>
+#include <agent/stub_alloc.h>
+
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * Stub slabs (hook/stub_alloc.c): a stub asked for near an address lands
+ * in branch range of it, and later ones near the same code share that
+ * slab. A freed stub stays parked while a thread may be in it (a read
+ * section from before it was freed, or a call through it) and its slots
+ * are handed on after that, so hooking and unhooking in a loop, each time
+ * with new code, keeps the slab count flat.
+ */
+
+#define LOOP_HOOKS  5000
+
+typedef struct {
+    void* thunk;
+    void* trampoline;
+} Hook;
+
+static void hook_reclaim(void* elem) {
+    Hook* hook = (Hook*)elem;
+    stub_free(hook->thunk);
+    stub_free(hook->trampoline);
+}
+
+static HookTable g_hooks = HOOK_TABLE_INIT(Hook, hook_reclaim);
+
+// Code that differs with the tag, so a parked stub never matches it
+static size_t build_tagged(uint32_t* code, uintptr_t pc, void* ctx) {
+    uint32_t tag = *(uint32_t*)ctx;
+    for (int i = 0; i < 8; i++) code[i] = tag ^ (uint32_t)(pc >> (i * 4));
+    return 8 * sizeof(uint32_t);
+}
+
+static void* create(size_t size, const void* near, uint32_t tag) {
+    return stub_create(size, near, build_tagged, &tag);
+}
+
+static int check_near(void) {
+    StubStats before, after;
+    stub_get_stats(&before);
+
+    // Our own code, and an anonymous mapping far from it
+    const void* code = (const void*)&check_near;
+    void* a = stub_alloc(64, code);
+    void* b = stub_alloc(128, code);
+    CHECK(a && b);
+    CHECK(stub_in_branch_range(code, a) && stub_in_branch_range(code, b));
+    stub_get_stats(&after);
+    CHECK(after.near_hits == before.near_hits + 2 && after.near_misses == before.near_misses);
+    CHECK(after.slabs == before.slabs + 1 && after.near_slabs == before.near_slabs + 1);
+
+    void* far = mmap(NULL, 4096, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(far != MAP_FAILED);
+    if (stub_in_branch_range(code, far)) {
+        fprintf(stderr, "mmap landed near the binary, skipping the far case\n");
+    } else {
+        void* c = stub_alloc(64, far);
+        CHECK(c && stub_in_branch_range(far, c) && !stub_in_branch_range(code, c));
+        stub_get_stats(&after);
+        CHECK(after.near_slabs == before.near_slabs + 2 && after.near_hits == before.near_hits + 3);
+        stub_free(c);
+    }
+    munmap(far, 4096);
+
+    // Written through the alias, read back through the exec view
+    uint32_t* rw = (uint32_t*)stub_writable(a);
+    CHECK(rw);
+    rw[0] = 0xD503201F;     // nop
+    stub_commit(a, 4);
+    CHECK(*(volatile uint32_t*)a == 0xD503201F);
+
+    stub_free(a);
+    stub_free(b);
+    return 0;
+}
+
+// Enough rounds for anything freed before to be past its grace period
+static void settle(void) {
+    for (int i = 0; i < 3; i++) rcu_poll();
+}
+
+static int check_parked(void) {
+    // What check_near() freed is past its grace period by now
+    StubStats st;
+    settle();
+    CHECK(stub_alloc(32, NULL));
+    stub_get_stats(&st);
+    CHECK(st.parked == 0 && st.reclaimed >= 2);
+    int parked = st.parked;
+    uint64_t reclaimed = st.reclaimed;
+
+    // The same code again takes the parked stub back
+    void* a = create(32, NULL, 0x1000);
+    CHECK(a);
+    stub_free(a);
+    CHECK(create(32, NULL, 0x1000) == a);
+    stub_get_stats(&st);
+    CHECK(st.reused >= 1 && st.parked == parked);
+
+    // Held by a read section that began before it was freed
+    rcu_read_lock();
+    stub_free(a);
+    settle();
+    CHECK(stub_alloc(32, NULL));
+    stub_get_stats(&st);
+    CHECK(st.parked == parked + 1 && st.reclaimed == reclaimed);
+    rcu_read_unlock();
+    settle();
+    CHECK(stub_alloc(32, NULL));
+    stub_get_stats(&st);
+    CHECK(st.parked == parked && st.reclaimed == reclaimed + 1);
+
+    // Held while a thread calls through it, outside any read section
+    void* b = create(64, NULL, 0x2000);
+    CHECK(b);
+    rcu_read_lock();
+    rcu_call_enter((uint8_t*)b + 8);
+    rcu_read_unlock();
+    stub_free(b);
+    settle();
+    CHECK(stub_alloc(32, NULL));
+    stub_get_stats(&st);
+    CHECK(st.parked == parked + 1 && st.reclaimed == reclaimed + 1);
+    rcu_call_exit();
+    settle();
+    CHECK(stub_alloc(32, NULL));
+    stub_get_stats(&st);
+    CHECK(st.parked == parked && st.reclaimed == reclaimed + 2);
+    return 0;
+}
+
+static int check_loop(void) {
+    const void* code = (const void*)&check_loop;
+    StubStats st;
+    int slabs = -1;
+
+    for (uint32_t i = 0; i < LOOP_HOOKS; i++) {
+        void* elem = NULL;
+        int index = hook_table_alloc(&g_hooks, &elem);
+        CHECK(index >= 0);
+        Hook* hook = (Hook*)elem;
+        hook->thunk = create(32, code, 2 * i);
+        hook->trampoline = create(64, code, 2 * i + 1);
+        CHECK(hook->thunk && hook->trampoline);
+        hook_table_retire(&g_hooks, index);
+
+        if (i == 100) {
+            stub_get_stats(&st);
+            slabs = st.slabs;
+        }
+    }
+    rcu_poll();
+
+    stub_get_stats(&st);
+    printf("%d hooks: slabs=%d live=%d parked=%d reclaimed=%llu reused=%llu\n", LOOP_HOOKS,
+           st.slabs, st.live, st.parked, (unsigned long long)st.reclaimed,
+           (unsigned long long)st.reused);
+    // Parked for good, two slots a hook would take 10 slabs
+    CHECK(st.slabs == slabs);
+    CHECK(st.reclaimed >= 2 * (LOOP_HOOKS - 100));
+    CHECK(st.parked <= 8);
+    return 0;
+}
+
+int main(void) {
+    CHECK(check_near() == 0);
+    CHECK(check_parked() == 0);
+    CHECK(check_loop() == 0);
+    return 0;
+}